@@ -34,6 +34,8 @@ struct Frame
 {
     unsigned int len;                       /* Received length (after pre-processing) */
     uint8_t d[COBS_MAX_ENC_PACKET_LEN];     /* ...the data itself + room for worst case overhead */
+    uint8_t sum;                            /* Additive sum of d[0..len-1], maintained by COBSPump
+                                             * as it copies so validation never re-reads the payload */
 };
 
 struct COBS
@@ -53,12 +55,21 @@ extern const uint8_t cobs_eop[COBS_EOP_LEN];
 // ====================================================================================================
 
 const uint8_t *COBSgetFrameExtent( const uint8_t *inputEnc, int len );
+
+/* Locate the next sync character, using wide scans where the target supports them */
+const uint8_t *COBSfindSync( const uint8_t *inputEnc, int len );
 bool COBSSimpleDecode( const uint8_t *inputEnc, int len, struct Frame *o );
 bool COBSisEOFRAME( const uint8_t *inputEnc );
 
 void COBSEncode( const uint8_t *frontMsg, int lfront, const uint8_t *backMsg, int lback, const uint8_t *inputMsg, int lmsg, struct Frame *o );
 
 /* Context free functions */
+
+/* Unstuff incoming bytes into frames, calling back as each completes. The frame passed to
+ * the callback is the decoder's own reassembly buffer, reused for the next frame as soon
+ * as the callback returns; downstream layers may alias into it but not retain it. The
+ * unstuffing write is the only pass over the payload between the wire and the consumer.
+ */
 void COBSPump( struct COBS *t, const uint8_t *incoming, int len,
                void ( *packetRxed )( struct Frame *p, void *param ),
                void *param );
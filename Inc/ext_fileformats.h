@@ -31,6 +31,7 @@ struct execEntryHash
     /* Counter at assembly and source line levels */
     uint64_t count;                      /* Instruction level count */
     uint64_t scount;                     /* Source level count (applied to first instruction of a new source line) */
+    uint64_t icount;                     /* Portion of count which was interpolated over trace gaps */
 
     /* Details about this instruction */
     bool     isJump;                     /* Flag if this is a jump instruction */
@@ -39,6 +40,11 @@ struct execEntryHash
     bool     isReturn;                   /* Flag for return */
     uint32_t jumpdest;                   /* Destination for a jump, if it's taken */
 
+    /* Microarchitectural simulation estimates, populated when orbprofile runs with -j */
+    uint64_t i1m;                        /* Estimated L1 instruction cache misses at this address */
+    uint64_t bc;                         /* Conditional branches executed at this address */
+    uint64_t bcm;                        /* ...of which the modelled predictor called wrongly */
+
     /* Location of this line in source code */
     uint32_t fileindex;                  /* File index (from symbols.c) */
     uint32_t functionindex;              /* Function index (from symbols.c) */
@@ -82,10 +88,79 @@ struct subcall
 };
 
 
+/* One function record in the accumulating profile database. Records are held sorted by
+ * build identity then function hash, so lookups within a build are binary searches.
+ */
+#define PDB_NAME_LEN (64)
+
+struct pdbRecord
+{
+    uint64_t buildId;                   /* Identity of the firmware image the samples came from */
+    uint64_t fnHash;                    /* Hash of the function name, the search key within a build */
+    uint64_t samples;                   /* Cumulative instruction samples across merged runs */
+    uint64_t runs;                      /* Number of runs merged into this record */
+    char name[PDB_NAME_LEN];            /* Function name, truncated if need be */
+};
+
+/* Metric identifiers for the columnar statistics format */
+enum colMetric
+{
+    COL_WALLTIME_US,                    /* Wall clock at checkpoint, one value */
+    COL_ADDR,                           /* Instruction addresses */
+    COL_COUNT,                          /* Instruction level counts, same order as COL_ADDR */
+    COL_SCOUNT,                         /* Source level counts, same order as COL_ADDR */
+    COL_EXC_NUM,                        /* Exception numbers (0 = thread mode) */
+    COL_EXC_ENTRIES,                    /* Activation counts, same order as COL_EXC_NUM */
+    COL_EXC_SAMPLES,                    /* PC sample counts, same order as COL_EXC_NUM */
+    COL_EXC_TICKS,                      /* Accumulated ticks, same order as COL_EXC_NUM */
+
+    COL_NUM_METRICS
+};
+
+/* A chunk of one metric as recorded in the footer directory */
+struct colChunkEntry
+{
+    uint32_t metric;                    /* Which enum colMetric this chunk holds */
+    uint32_t sequence;                  /* Checkpoint this chunk belongs to */
+    uint32_t count;                     /* Number of 64 bit values in the chunk */
+    uint64_t offset;                    /* Byte offset of the values in the file */
+};
+
+/* State of an open columnar statistics file */
+struct colWriter
+{
+    FILE *f;                            /* File being appended to */
+    struct colChunkEntry *dir;          /* Directory of chunks written so far */
+    uint32_t numChunks;                 /* Entries in the directory */
+    uint32_t dirCap;                    /* Allocated directory entries */
+    uint32_t sequence;                  /* Current checkpoint number */
+};
+
 // ====================================================================================================
-bool ext_ff_outputDot( char *dotfile, struct subcall *subcallList, struct SymbolSet *ss );
+bool ext_ff_outputDot( char *dotfile, struct subcall *subcallList, struct SymbolSet *ss, uint32_t cutPercent );
 bool ext_ff_outputProfile( char *profile, char *elffile, char *deleteMaterial, bool includeVisits, uint64_t timelen,
                            struct execEntryHash *insthead, struct subcall *subcallList, struct SymbolSet *ss );
+
+/* Open columnar statistics file and write its header */
+bool ext_ff_columnOpen( struct colWriter *w, char *filename );
+
+/* Append one column chunk of 64 bit values for the given metric */
+bool ext_ff_columnChunk( struct colWriter *w, enum colMetric metric, const uint64_t *values, uint32_t count );
+
+/* Mark the end of a checkpoint; chunks written afterwards belong to the next one */
+void ext_ff_columnCheckpoint( struct colWriter *w );
+
+/* Write the footer directory and close the file */
+bool ext_ff_columnClose( struct colWriter *w );
+
+/* Content identity of an ELF image, for keying profile database records; 0 on failure */
+uint64_t ext_ff_profileDbBuildId( char *elffile );
+
+/* Load every record of a profile database; *recs is malloced, count is 0 if there's no file yet */
+bool ext_ff_profileDbRead( char *dbfile, struct pdbRecord **recs, uint32_t *count );
+
+/* Merge function-level totals for one run into the database */
+bool ext_ff_profileDbMerge( char *dbfile, uint64_t buildId, struct execEntryHash *insthead, struct SymbolSet *ss );
 // ====================================================================================================
 
 #ifdef __cplusplus
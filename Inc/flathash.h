@@ -0,0 +1,379 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Flat Hash Module
+ * ================
+ *
+ * Open-addressing hash map specialised for 32-bit keys carrying one pointer of value,
+ * with linear probing and power-of-two sizing; a 64-bit keyed variant for packed key
+ * pairs lives at the bottom of the file. Everything lives in one flat slot array,
+ * so there is no per-entry allocation or chaining overhead and probes stay in cache.
+ * An empty value pointer marks a free slot, so NULL is not a storable value. There is
+ * no per-entry deletion; these maps are built up hot and torn down whole.
+ */
+
+#ifndef _FLATHASH_
+#define _FLATHASH_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLATHASH_MIN_SLOTS (1024)               /* Initial table size; must be a power of two */
+
+struct flatHashSlot
+{
+    uint32_t key;                               /* Key for this slot; only valid when v is set */
+    void *v;                                    /* Value, NULL when the slot is free */
+};
+
+struct flatHash
+{
+    struct flatHashSlot *slot;                  /* Slot storage, a power of two entries long */
+    uint32_t mask;                              /* Number of slots, less one */
+    uint32_t count;                             /* Number of occupied slots */
+};
+
+// ====================================================================================================
+
+static inline uint32_t _flathashMix( uint32_t key )
+
+/* Scramble the key so clustered inputs (addresses mostly differ in low bits) spread out */
+
+{
+    key *= 0x9E3779B1U;
+    return key ^ ( key >> 16 );
+}
+
+// ====================================================================================================
+
+static inline void flathashInit( struct flatHash *f )
+
+{
+    memset( f, 0, sizeof( struct flatHash ) );
+}
+
+// ====================================================================================================
+
+static inline void *flathashFind( const struct flatHash *f, uint32_t key )
+
+/* Return the value stored under key, or NULL if there isn't one */
+
+{
+    if ( !f->slot )
+    {
+        return NULL;
+    }
+
+    for ( uint32_t i = _flathashMix( key ) & f->mask; f->slot[i].v; i = ( i + 1 ) & f->mask )
+    {
+        if ( f->slot[i].key == key )
+        {
+            return f->slot[i].v;
+        }
+    }
+
+    return NULL;
+}
+
+// ====================================================================================================
+
+static inline bool _flathashGrow( struct flatHash *f )
+
+/* Double the table (or create it) and re-place every entry; false if memory ran out */
+
+{
+    uint32_t newLen = f->slot ? ( ( f->mask + 1 ) * 2 ) : FLATHASH_MIN_SLOTS;
+    struct flatHashSlot *ns = ( struct flatHashSlot * )calloc( newLen, sizeof( struct flatHashSlot ) );
+
+    if ( !ns )
+    {
+        return false;
+    }
+
+    for ( uint32_t i = 0; f->slot && ( i <= f->mask ); i++ )
+    {
+        if ( f->slot[i].v )
+        {
+            uint32_t j = _flathashMix( f->slot[i].key ) & ( newLen - 1 );
+
+            while ( ns[j].v )
+            {
+                j = ( j + 1 ) & ( newLen - 1 );
+            }
+
+            ns[j] = f->slot[i];
+        }
+    }
+
+    free( f->slot );
+    f->slot = ns;
+    f->mask = newLen - 1;
+    return true;
+}
+
+// ====================================================================================================
+
+static inline void **flathashEntry( struct flatHash *f, uint32_t key )
+
+/* Return the value slot for key, creating an empty one if it's new; the caller stores its
+ * value through the returned pointer. NULL only if memory ran out.
+ */
+
+{
+    /* Grow at 3/4 load so probe runs stay short */
+    if ( ( !f->slot ) || ( f->count + ( f->count >> 1 ) > f->mask ) )
+    {
+        if ( !_flathashGrow( f ) )
+        {
+            return NULL;
+        }
+    }
+
+    uint32_t i = _flathashMix( key ) & f->mask;
+
+    while ( f->slot[i].v )
+    {
+        if ( f->slot[i].key == key )
+        {
+            return &f->slot[i].v;
+        }
+
+        i = ( i + 1 ) & f->mask;
+    }
+
+    f->slot[i].key = key;
+    f->count++;
+    return &f->slot[i].v;
+}
+
+// ====================================================================================================
+
+static inline uint32_t flathashCount( const struct flatHash *f )
+
+{
+    return f->count;
+}
+
+// ====================================================================================================
+
+static inline void *flathashNext( const struct flatHash *f, uint32_t *it )
+
+/* Iterate the map; start with *it = 0 and call until NULL comes back. The map must not be
+ * modified during the walk.
+ */
+
+{
+    if ( f->slot )
+    {
+        while ( *it <= f->mask )
+        {
+            struct flatHashSlot *s = &f->slot[( *it )++];
+
+            if ( s->v )
+            {
+                return s->v;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// ====================================================================================================
+
+static inline void flathashEmpty( struct flatHash *f, void ( *dispose )( void *v ) )
+
+/* Drop every entry, passing each value to dispose (may be NULL) on the way out. The slot
+ * storage is kept at size for refilling.
+ */
+
+{
+    for ( uint32_t i = 0; f->slot && ( i <= f->mask ); i++ )
+    {
+        if ( f->slot[i].v )
+        {
+            if ( dispose )
+            {
+                dispose( f->slot[i].v );
+            }
+
+            f->slot[i].v = NULL;
+        }
+    }
+
+    f->count = 0;
+}
+
+// ====================================================================================================
+
+static inline void flathashDelete( struct flatHash *f )
+
+/* Release the slot storage; entries themselves are the caller's to free beforehand */
+
+{
+    free( f->slot );
+    flathashInit( f );
+}
+
+// ====================================================================================================
+// 64-bit keyed variant, for maps over packed key pairs. Same design throughout: open
+// addressing, linear probes, multiplicative mixing, growth by whole re-placement so there
+// are never tombstones to step over.
+// ====================================================================================================
+
+struct flatHash64Slot
+{
+    uint64_t key;                               /* Key for this slot; only valid when v is set */
+    void *v;                                    /* Value, NULL when the slot is free */
+};
+
+struct flatHash64
+{
+    struct flatHash64Slot *slot;                /* Slot storage, a power of two entries long */
+    uint32_t mask;                              /* Number of slots, less one */
+    uint32_t count;                             /* Number of occupied slots */
+};
+
+// ====================================================================================================
+
+static inline uint64_t _flathash64Mix( uint64_t key )
+
+/* Multiplicative scramble; key pairs share high/low halves heavily, so fold the top down */
+
+{
+    key *= 0x9E3779B97F4A7C15ULL;
+    return key ^ ( key >> 32 );
+}
+
+// ====================================================================================================
+
+static inline void flathash64Init( struct flatHash64 *f )
+
+{
+    memset( f, 0, sizeof( struct flatHash64 ) );
+}
+
+// ====================================================================================================
+
+static inline void *flathash64Find( const struct flatHash64 *f, uint64_t key )
+
+/* Return the value stored under key, or NULL if there isn't one */
+
+{
+    if ( !f->slot )
+    {
+        return NULL;
+    }
+
+    for ( uint32_t i = _flathash64Mix( key ) & f->mask; f->slot[i].v; i = ( i + 1 ) & f->mask )
+    {
+        if ( f->slot[i].key == key )
+        {
+            return f->slot[i].v;
+        }
+    }
+
+    return NULL;
+}
+
+// ====================================================================================================
+
+static inline bool _flathash64Grow( struct flatHash64 *f )
+
+/* Double the table (or create it) and re-place every entry; false if memory ran out */
+
+{
+    uint32_t newLen = f->slot ? ( ( f->mask + 1 ) * 2 ) : FLATHASH_MIN_SLOTS;
+    struct flatHash64Slot *ns = ( struct flatHash64Slot * )calloc( newLen, sizeof( struct flatHash64Slot ) );
+
+    if ( !ns )
+    {
+        return false;
+    }
+
+    for ( uint32_t i = 0; f->slot && ( i <= f->mask ); i++ )
+    {
+        if ( f->slot[i].v )
+        {
+            uint32_t j = _flathash64Mix( f->slot[i].key ) & ( newLen - 1 );
+
+            while ( ns[j].v )
+            {
+                j = ( j + 1 ) & ( newLen - 1 );
+            }
+
+            ns[j] = f->slot[i];
+        }
+    }
+
+    free( f->slot );
+    f->slot = ns;
+    f->mask = newLen - 1;
+    return true;
+}
+
+// ====================================================================================================
+
+static inline void **flathash64Entry( struct flatHash64 *f, uint64_t key )
+
+/* Return the value slot for key, creating an empty one if it's new; the caller stores its
+ * value through the returned pointer. NULL only if memory ran out.
+ */
+
+{
+    /* Grow at 3/4 load so probe runs stay short */
+    if ( ( !f->slot ) || ( f->count + ( f->count >> 1 ) > f->mask ) )
+    {
+        if ( !_flathash64Grow( f ) )
+        {
+            return NULL;
+        }
+    }
+
+    uint32_t i = _flathash64Mix( key ) & f->mask;
+
+    while ( f->slot[i].v )
+    {
+        if ( f->slot[i].key == key )
+        {
+            return &f->slot[i].v;
+        }
+
+        i = ( i + 1 ) & f->mask;
+    }
+
+    f->slot[i].key = key;
+    f->count++;
+    return &f->slot[i].v;
+}
+
+// ====================================================================================================
+
+static inline uint32_t flathash64Count( const struct flatHash64 *f )
+
+{
+    return f->count;
+}
+
+// ====================================================================================================
+
+static inline void flathash64Delete( struct flatHash64 *f )
+
+/* Release the slot storage; entries themselves are the caller's to free beforehand */
+
+{
+    free( f->slot );
+    flathash64Init( f );
+}
+
+// ====================================================================================================
+#ifdef __cplusplus
+}
+#endif
+#endif
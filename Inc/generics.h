@@ -14,6 +14,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <errno.h>
+#include <stdatomic.h>
 
 #define EOL "\n"
 #ifdef __cplusplus
@@ -64,11 +65,15 @@ typedef int errcode;
 #define CLEAR_SCREEN CMD_ALERT "z"
 #define C_PREV_LN    CMD_ALERT "u"
 #define C_CLR_LN     CMD_ALERT "U"
+#define C_HOME       CMD_ALERT "H"
+#define C_CLR_EOS    CMD_ALERT "J"
 
 /* The actual control codes that do the work */
 #define CC_CLEAR_SCREEN  "\033[2J\033[;H"
 #define CC_PREV_LN       "\033[1F"
 #define CC_CLR_LN        "\033[K"
+#define CC_HOME          "\033[H"
+#define CC_CLR_EOS       "\033[J"
 #define CC_COLOUR        "\033[%d;3%dm"
 #define CC_RES           "\033[0m"
 
@@ -96,17 +101,69 @@ typedef void ( *genericsReportCB )( enum verbLevel l, const char *fmt, ... );
 
 char *genericsEscape( char *str );
 char *genericsUnescape( char *str );
+void genericsHexBytes( char *dst, const uint8_t *src, size_t len, bool upper );
+void genericsPrintable( char *dst, const uint8_t *src, size_t len );
 uint64_t genericsTimestampuS( void );
 uint32_t genericsTimestampmS( void );
 bool genericsSetReportLevel( enum verbLevel lset );
+enum verbLevel genericsGetReportLevel( void );
 void genericsFPrintf( FILE *stream, const char *fmt, ... );
 char *genericsGetBaseDirectory( void );
 const char *genericsBasename( const char *n );
 const char *genericsBasenameN( const char *n, int c );
 void genericsReport( enum verbLevel l, const char *fmt, ... );
+void genericsReportAsync( bool enable );
 void genericsExit( int status, const char *fmt, ... );
 
+/* Level gate in front of genericsReport so rejected messages don't evaluate their arguments
+ * or make the call. Parenthesised or bare references still reach the real function, so it
+ * remains usable as a genericsReportCB.
+ */
+#define genericsReport( l, ... )                        \
+    do                                                  \
+    {                                                   \
+        if ( ( l ) <= genericsGetReportLevel() )        \
+        {                                               \
+            ( genericsReport )( ( l ), __VA_ARGS__ );   \
+        }                                               \
+    } while ( 0 )
+
 void genericsScreenHandling( bool screenHandling );
+bool genericsIsScreenHandling( void );
+bool genericsSetThreadAffinity( int cpu );
+
+/* Block swizzle kernels for trace-port style transforms; dst and src may be the same buffer */
+void genericsReverseBitsBlk( uint8_t *dst, const uint8_t *src, uint32_t len );
+void genericsSwapNibblesBlk( uint8_t *dst, const uint8_t *src, uint32_t len );
+void genericsExpandMaskBlk( uint64_t mask, uint8_t *dst, uint32_t len );
+
+/* Seqlock for plain-data state written by a hot thread and sampled by slow readers (UI,
+ * status reporting). Writers never block; readers retry if they overlapped a write. Only
+ * suitable for data that is safe to copy while torn (no pointers that a writer may free).
+ */
+struct genericsSeqLock
+{
+    atomic_uint_fast32_t seq;              /* Odd while a write is in progress */
+};
+
+void genericsSeqInit( struct genericsSeqLock *s );
+void genericsSeqWriteBegin( struct genericsSeqLock *s );
+void genericsSeqWriteEnd( struct genericsSeqLock *s );
+uint32_t genericsSeqReadBegin( const struct genericsSeqLock *s );
+bool genericsSeqReadRetry( const struct genericsSeqLock *s, uint32_t start );
+
+/* Typed snapshot; dst gets a consistent copy of src, however many retries that takes */
+#define GENERICS_SEQ_SNAPSHOT( s, dst, src )            \
+    do                                                  \
+    {                                                   \
+        uint32_t _sq;                                   \
+        do                                              \
+        {                                               \
+            _sq = genericsSeqReadBegin( s );            \
+            ( dst ) = ( src );                          \
+        }                                               \
+        while ( genericsSeqReadRetry( ( s ), _sq ) );   \
+    } while ( 0 )
 
 // ====================================================================================================
 #ifdef __cplusplus
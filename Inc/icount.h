@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Instruction mix counters
+ * ========================
+ *
+ * Per-class execution counters fed from the instruction walk during trace decode, giving
+ * the kind of instruction-mix data otherwise only available from offline simulation. The
+ * whole facility sits behind the ICOUNT_STATS build toggle (meson option 'icount'): when
+ * it is off the tally compiles to nothing, when it is on each instruction costs a few flag
+ * tests and indexed adds. The block is plain counters so it can be snapshotted and
+ * restored by value alongside the rest of the decode state.
+ */
+
+#ifndef _ICOUNT_
+#define _ICOUNT_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include "loadelf.h"
+#include "generics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ====================================================================================================
+
+enum ICountClass
+{
+    ICOUNT_LOAD,                             /* Executed memory loads */
+    ICOUNT_STORE,                            /* Executed memory stores */
+    ICOUNT_BRANCH_TAKEN,                     /* Branches that were taken */
+    ICOUNT_BRANCH_NOTTAKEN,                  /* Branches that were stepped over */
+    ICOUNT_4BYTE,                            /* Executed 32-bit encodings */
+    ICOUNT_2BYTE,                            /* Executed 16-bit encodings */
+    ICOUNT_NUM
+};
+
+struct ICount
+{
+    uint64_t cnt[ICOUNT_NUM];
+};
+
+// ====================================================================================================
+
+static inline void ICountReset( struct ICount *i )
+{
+#if defined( ICOUNT_STATS )
+    memset( i->cnt, 0, sizeof( i->cnt ) );
+#else
+    ( void )i;
+#endif
+}
+// ====================================================================================================
+static inline void ICountTally( struct ICount *i, enum instructionClass ic, bool executed )
+
+/* Account one instruction from the decode walk; executed is false for a stepped-over branch */
+
+{
+#if defined( ICOUNT_STATS )
+
+    if ( ic & LE_IC_JUMP )
+    {
+        i->cnt[ executed ? ICOUNT_BRANCH_TAKEN : ICOUNT_BRANCH_NOTTAKEN ]++;
+    }
+
+    if ( !executed )
+    {
+        return;
+    }
+
+    i->cnt[ ( ic & LE_IC_4BYTE ) ? ICOUNT_4BYTE : ICOUNT_2BYTE ]++;
+
+    if ( ic & LE_IC_LOAD )
+    {
+        i->cnt[ICOUNT_LOAD]++;
+    }
+
+    if ( ic & LE_IC_STORE )
+    {
+        i->cnt[ICOUNT_STORE]++;
+    }
+
+#else
+    ( void )i;
+    ( void )ic;
+    ( void )executed;
+#endif
+}
+// ====================================================================================================
+static inline void ICountReport( const struct ICount *i )
+
+/* Summarise the accumulated mix */
+
+{
+#if defined( ICOUNT_STATS )
+    uint64_t executed = i->cnt[ICOUNT_4BYTE] + i->cnt[ICOUNT_2BYTE];
+
+    genericsReport( V_INFO, "Instruction mix: %" PRIu64 " executed (%" PRIu64 " 32-bit / %" PRIu64 " 16-bit), "
+                    "%" PRIu64 " loads, %" PRIu64 " stores, branches %" PRIu64 " taken / %" PRIu64 " not taken" EOL,
+                    executed, i->cnt[ICOUNT_4BYTE], i->cnt[ICOUNT_2BYTE],
+                    i->cnt[ICOUNT_LOAD], i->cnt[ICOUNT_STORE],
+                    i->cnt[ICOUNT_BRANCH_TAKEN], i->cnt[ICOUNT_BRANCH_NOTTAKEN] );
+#else
+    ( void )i;
+#endif
+}
+
+// ====================================================================================================
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -12,6 +12,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifndef __cplusplus
+    #include <stdatomic.h>
+#endif
+
 #define ITM_MAX_PACKET  (14) // This length can only happen for a timestamp or some SYNC packets
 #define ITM_DATA_PACKET (4)  // This is the maximum length of everything else
 
@@ -19,6 +23,15 @@
 extern "C" {
 #endif
 
+/* Stats counters are written (relaxed) only by the thread pumping the decoder, but may be */
+/* read concurrently from other threads, so each needs to be individually atomic. No       */
+/* consistency across counters is implied; none is needed for reporting purposes.          */
+#ifdef __cplusplus
+    typedef uint32_t itmStatCount;
+#else
+    typedef _Atomic uint32_t itmStatCount;
+#endif
+
 /* Hardware event numbers (used for the event fifo) */
 enum hwEvents
 {
@@ -63,9 +76,13 @@ enum ITMPumpEvent
     ITM_EV_UNSYNCED,
     ITM_EV_SYNCED,
     ITM_EV_OVERFLOW,
-    ITM_EV_ERROR
+    ITM_EV_ERROR,
+    ITM_EV_BULK_RXED                     /* Coalesced payload span for the bulk channel is ready */
 };
 
+/* Accumulation limit for bulk channel coalescing; a span is never longer than this */
+#define ITM_BULK_BUFFER_LEN (4096)
+
 /* Internal states of the protocol machine */
 enum _protoState
 {
@@ -102,17 +119,17 @@ enum timeDelay {TIME_CURRENT, TIME_DELAYED, EVENT_DELAYED, EVENT_AND_TIME_DELAYE
 struct ITMDecoderStats
 
 {
-    uint32_t lostSyncCount;              /* Number of times sync has been lost */
-    uint32_t syncCount;                  /* Number of times a sync event has been received */
-    uint32_t tpiuSyncCount;              /* Number of times a tpiu sync event has been received (shouldn't happen) */
-    uint32_t overflow;                   /* Number of times an overflow occured */
-    uint32_t SWPkt;                      /* Number of SW Packets received */
-    uint32_t TSPkt;                      /* Number of TS Packets received */
-    uint32_t HWPkt;                      /* Number of HW Packets received */
-    uint32_t XTNPkt;                     /* Number of XTN Packets received */
-    uint32_t ReservedPkt;                /* Number of Reserved Packets received */
-    uint32_t ErrorPkt;                   /* Number of Packets received we don't know how to handle */
-    uint32_t PagePkt;                    /* Number of Packets received containing page sets */
+    itmStatCount lostSyncCount;          /* Number of times sync has been lost */
+    itmStatCount syncCount;              /* Number of times a sync event has been received */
+    itmStatCount tpiuSyncCount;          /* Number of times a tpiu sync event has been received (shouldn't happen) */
+    itmStatCount overflow;               /* Number of times an overflow occured */
+    itmStatCount SWPkt;                  /* Number of SW Packets received */
+    itmStatCount TSPkt;                  /* Number of TS Packets received */
+    itmStatCount HWPkt;                  /* Number of HW Packets received */
+    itmStatCount XTNPkt;                 /* Number of XTN Packets received */
+    itmStatCount ReservedPkt;            /* Number of Reserved Packets received */
+    itmStatCount ErrorPkt;               /* Number of Packets received we don't know how to handle */
+    itmStatCount PagePkt;                /* Number of Packets received containing page sets */
 };
 
 /* The ITM decoder state */
@@ -127,6 +144,12 @@ struct ITMDecoder
     struct ITMPacket pk;                 /* Packet under construction */
     struct ITMDecoderStats stats;        /* Record of the statistics */
     enum _protoState p;                  /* Current state of the receiver */
+
+    int bulkChannel;                     /* Channel whose payload is coalesced, -1 for none */
+    int muxChannel;                      /* Channel carrying sub-channel mux framing, -1 for none */
+    uint8_t muxBase;                     /* Channel number the virtual channels are exposed from */
+    uint32_t bulkLen;                    /* Amount of coalesced payload waiting for collection */
+    uint8_t bulkBuffer[ITM_BULK_BUFFER_LEN]; /* ...and the payload itself */
 };
 
 /* A fully decoded message (expanded in msgDecoder.h) */
@@ -141,6 +164,24 @@ bool ITMGetPacket( struct ITMDecoder *i, struct ITMPacket *p );
 bool ITMGetDecodedPacket( struct ITMDecoder *i, struct msg *decoded );
 
 enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c );
+void ITMPumpBuffer( struct ITMDecoder *i, const uint8_t *d, int len,
+                    void ( *packetEvent )( enum ITMPumpEvent e, void *param ),
+                    void *param );
+
+/* Coalesce payload of one channel into bulk spans rather than per-packet events, -1 to disable */
+void ITMSetBulkChannel( struct ITMDecoder *i, int channel );
+
+/* Demultiplex one channel carrying the sub-channel mux framing; -1 to disable.
+ *
+ * Mux framing: the first payload byte of each SWIT write is a virtual channel number and the
+ * remaining one to three bytes are that stream's data. Demuxed packets re-emerge as ordinary
+ * SW packets on channel vcBase + virtual channel, so every consumer addresses the streams as
+ * normal channels. A write with no payload beyond the header is a keepalive and is dropped.
+ */
+void ITMSetMuxChannel( struct ITMDecoder *i, int channel, uint8_t vcBase );
+
+/* Collect the coalesced span announced by ITM_EV_BULK_RXED; valid only inside the callback */
+bool ITMGetBulkSpan( struct ITMDecoder *i, const uint8_t **d, uint32_t *len );
 
 struct ITMDecoder *ITMDecoderCreate( void );
 void ITMDecoderInit( struct ITMDecoder *i, bool startSynced );
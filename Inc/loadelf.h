@@ -1,8 +1,11 @@
 
 #ifndef _LOADELF_H_
+#define _LOADELF_H_
 
 #include <stdbool.h>
-#include <capstone.h>
+#if defined( WITH_CAPSTONE )
+    #include <capstone.h>
+#endif
 #include <stdint.h>
 #include "generics.h"
 
@@ -23,6 +26,7 @@ struct symbolMemoryStore
     symbolMemaddr   len;                   /* Length of the memory segment */
     char           *name;                  /* Name of the segment as defined by the linker */
     symbolMemptr    data;                  /* Contents of the segment */
+    bool            mapped;                /* Data points into the file mapping, not owned storage */
 };
 
 
@@ -49,11 +53,28 @@ struct symbolFunctionStore
     unsigned int               endline;    /* End line in source file of function */
     symbolMemaddr              lowaddr;    /* Lowest address of function */
     symbolMemaddr              highaddr;   /* Highest address of function */
-    bool                       isinline;   /* Is this an abstract template for a function? */
+    bool                       isinline;   /* Is this an inlined instance of another function? */
+    struct symbolFunctionStore *inlinedIn; /* Function hosting this inline instance, NULL otherwise */
     struct symbolLineStore   **line;       /* Lines comprising this function */
     unsigned int               nlines;     /* Number of lines in line number storage */
 };
 
+/* One flattened span of the inline instance map; spans are disjoint and in address order */
+struct symbolInlineRange
+{
+    symbolMemaddr              lowaddr;    /* First address of this span */
+    symbolMemaddr              highaddr;   /* Last address of this span */
+    struct symbolFunctionStore *func;      /* Innermost inline instance covering the span */
+};
+
+/* Structure for a static or global variable identified in the image */
+struct symbolVariableStore
+{
+    char                      *name;       /* Name of the variable */
+    symbolMemaddr              addr;       /* Base address it occupies */
+    uint64_t                   size;       /* Number of bytes it occupies */
+};
+
 struct symbolSourcecodeStore
 {
     char                     **linetext;   /* Table of text lines in this file */
@@ -62,10 +83,22 @@ struct symbolSourcecodeStore
     unsigned int               nlines;     /* Number of text lines in this file */
 };
 
+enum instructionClass { LE_IC_NONE, LE_IC_JUMP = ( 1 << 0 ), LE_IC_4BYTE = ( 1 << 1 ), LE_IC_CALL = ( 1 << 2 ),  LE_IC_IMMEDIATE = ( 1 << 3 ), LE_IC_IRET = ( 1 << 4 ), LE_IC_LOAD = ( 1 << 5 ), LE_IC_STORE = ( 1 << 6 ) };
+
+/* A single cached disassembled instruction */
+struct dasmCacheEntry
+{
+    symbolMemaddr              addr;       /* Address of the instruction */
+    enum instructionClass      ic;         /* Classification flags as decoded */
+    symbolMemaddr              newaddr;    /* Immediate target, or NO_ADDRESS */
+    unsigned int               textOfsPlus1; /* Offset+1 of rendered text in the arena; 0 = slot empty */
+};
+
 enum symbolTables { PT_PRODUCER, PT_FILENAME, PT_NUMTABLES };
 
 struct symbol
 {
+    char *elfFile;                         /* File this symbol set was loaded from */
     char **stringTable[PT_NUMTABLES];      /* Strings that we don't want to duplicate, so we give them an index */
     unsigned int tableLen[PT_NUMTABLES];   /* Number of strings for each of the deduplication tables */
 
@@ -77,17 +110,42 @@ struct symbol
     struct symbolFunctionStore **func;     /* Table of functions, sorted by start address */
     unsigned int nfunc;                    /* Number of entries in function table */
 
+    struct symbolFunctionStore **inlfunc;  /* Inline instances, kept apart so they can't upset the function search */
+    unsigned int ninlfunc;                 /* Number of inline instances */
+
+    struct symbolInlineRange *inlRange;    /* Flattened innermost-wins spans over the inline instances */
+    unsigned int ninlRange;                /* Number of flattened spans */
+
+    bool inlineSelf;                       /* Lookups attribute addresses to the inline instance, not its host */
+
     struct symbolLineStore **line;         /* Table of source code address indexes, sorted by start address */
     unsigned int nlines;                   /* Number of lines in source code line table */
 
+    struct symbolVariableStore *var;       /* Table of data objects, sorted by base address */
+    unsigned int nvar;                     /* Number of entries in the data object table */
+
     unsigned int cachedSearchIndex;        /* Cached memory search region, to speed up memory fetches */
+    unsigned int cachedFuncIndex;          /* Function found by the previous address lookup */
+    struct symbolLineStore *cachedLine;    /* Line found by the previous address lookup */
 
     int fd;                                /* Handle that we read elf from */
 
+    uint8_t *elfMap;                       /* Private writable mapping of the ELF file, if available */
+    size_t elfMapLen;                      /* Length of that mapping */
+
+#if defined( WITH_CAPSTONE )
     csh caphandle;
+#endif
+
+    /* Disassembly cache, filled as instructions are first decoded... */
+    struct dasmCacheEntry *dasmCache;      /* Hash of already-decoded instructions */
+    unsigned int dasmSlots;                /* Size of the hash; always a power of two */
+    unsigned int dasmUsed;                 /* Number of occupied slots */
+    char *dasmText;                        /* Arena holding the rendered disassembly text */
+    unsigned int dasmTextLen;              /* Bytes of the arena in use */
+    unsigned int dasmTextCap;              /* Bytes of the arena allocated */
 };
 
-enum instructionClass { LE_IC_NONE, LE_IC_JUMP = ( 1 << 0 ), LE_IC_4BYTE = ( 1 << 1 ), LE_IC_CALL = ( 1 << 2 ),  LE_IC_IMMEDIATE = ( 1 << 3 ), LE_IC_IRET = ( 1 << 4 ) };
 
 // ====================================================================================================
 
@@ -97,6 +155,12 @@ const char *symbolSource( struct symbol *p, unsigned int fileNumber, unsigned in
 /* Return function that encloses specified address, or NULL */
 struct symbolFunctionStore *symbolFunctionAt( struct symbol *p, symbolMemaddr addr );
 
+/* Return innermost inlined function instance covering specified address, or NULL */
+struct symbolFunctionStore *symbolInlineAt( struct symbol *p, symbolMemaddr addr );
+
+/* Choose whether lookups attribute an address to the inline instance itself or to its host function */
+void symbolSetInlineAttribution( struct symbol *p, bool self );
+
 /* Get indexed function, or NULL if out of range */
 struct symbolFunctionStore *symbolFunctionIndex( struct symbol *p, unsigned int index );
 
@@ -109,6 +173,16 @@ struct symbolLineStore *symbolFunctionLineIndex( struct symbolFunctionStore *f,
 /* Return line covered by specified memory address, or NULL */
 struct symbolLineStore *symbolLineAt( struct symbol *p, symbolMemaddr addr );
 
+/* Hint that a lookup at this address is imminent; pulls likely index entries towards the cache */
+void symbolPrefetch( struct symbol *p, symbolMemaddr addr );
+
+/* Return static/global variable whose storage covers specified address, or NULL */
+struct symbolVariableStore *symbolVariableAt( struct symbol *p, symbolMemaddr addr );
+
+/* Resolve a batch of addresses to enclosing functions and lines in one pass over the tables */
+void symbolBatchResolve( struct symbol *p, const symbolMemaddr *addr, unsigned int naddr,
+                         struct symbolFunctionStore **function, struct symbolLineStore **line );
+
 /* Get command line that produced this file (compilation unit) */
 const char *symbolGetProducer( struct symbol *p, unsigned int index );
 
@@ -10,6 +10,8 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "itmDecoder.h"
+
 /* Do not change the order of existing message types! */
 enum MSGType
 {
@@ -139,12 +141,35 @@ struct msg
     };
 };
 
-struct ITMPacket;
+/* A batch of decoded messages drawn from a reusable pool. Zero-initialise and re-use; the
+ * pool grows on demand and is retained between calls.
+ */
+struct msgBatch
+{
+    struct msg *pool;                     /* Reusable decoded message storage */
+    uint32_t    poolLen;                  /* Slots allocated in the pool */
+    uint32_t    len;                      /* Messages decoded into this batch */
+};
+
+/* Per-message handler; decoded points at the message, param is caller context */
+typedef void ( *msgHandler )( void *decoded, void *param );
 
 // ====================================================================================================
 
 bool msgDecoder( struct ITMPacket *packet, struct msg *decoded );
 
+/* Pump a whole buffer through the ITM decoder, collecting every decoded message into the
+ * batch pool. Non-packet events (sync gain/loss, overflow, error) are forwarded to
+ * otherEvent if one is given.
+ */
+void msgDecoderBatch( struct ITMDecoder *i, const uint8_t *d, int len, struct msgBatch *b,
+                      void ( *otherEvent )( enum ITMPumpEvent e, void *param ), void *param );
+
+/* Despatch a batch via a MSG_NUM_MSGS-entry handler table, running homogeneous runs of
+ * messages through their handler in a tight loop.
+ */
+void msgBatchDispatch( struct msgBatch *b, const msgHandler *h, void *param );
+
 // ====================================================================================================
 #ifdef __cplusplus
 }
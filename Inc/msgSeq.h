@@ -35,6 +35,10 @@ struct MSGSeq
     bool releaseTimeMsg;     /* Indicator to release msg at head of queue */
 
     struct msg *pbuffer;     /* The buffer */
+
+    struct msg *staged;      /* Time-ordered messages from the last buffer pump */
+    uint32_t stagedCap;      /* Slots allocated in the staging array */
+    uint32_t stagedLen;      /* Messages staged by the last buffer pump */
 };
 
 // ====================================================================================================
@@ -44,6 +48,12 @@ struct msg *MSGSeqGetPacket( struct MSGSeq *d );
 
 bool MSGSeqPump( struct MSGSeq *d, uint8_t c );
 
+/* Pump a whole buffer, staging the time-ordered result contiguously; returns the number of
+ * messages now available from MSGSeqStaged(). The staging array is valid until the next pump.
+ */
+uint32_t MSGSeqPumpBuffer( struct MSGSeq *d, const uint8_t *buf, int len );
+struct msg *MSGSeqStaged( struct MSGSeq *d );
+
 // ====================================================================================================
 #ifdef __cplusplus
 }
@@ -24,7 +24,11 @@ struct nwclientsHandle;
 // ====================================================================================================
 
 void nwclientSend( struct nwclientsHandle *h, uint32_t len, const uint8_t *ipbuffer );
+void nwclientEnableFlowReports( struct nwclientsHandle *h );
 void nwclientShutdown( struct nwclientsHandle *h );
+void nwclientSetPlacement( int cpu );
+void nwclientSetSpill( const char *dir, uint64_t perClientBytes, uint64_t totalBytes );
+void nwclientSpillStats( uint64_t *held, uint64_t *ever );
 struct nwclientsHandle *nwclientStart( int port );
 
 // ====================================================================================================
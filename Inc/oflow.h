@@ -18,6 +18,13 @@
 extern "C" {
 #endif
 
+/* Contents of a flow report frame from the publisher */
+struct OFLOWFlowReport
+{
+    uint64_t seq;                           /* Client position in the published stream, in bytes */
+    uint64_t dropped;                       /* Bytes ever skipped past this client */
+};
+
 struct OFLOWFrame
 {
     unsigned int len;                       /* Received length (after pre-processing) */
@@ -26,7 +33,9 @@ struct OFLOWFrame
     bool         good;                      /* Is the checksum valid? */
     uint64_t     tstamp;                    /* Timestamp for the packet */
 
-    uint8_t *d;                             /* ...pointer to the data itself */
+    uint8_t *d;                             /* ...pointer to the data itself. This references the decoder's
+                                             * frame in place; it is only valid for the duration of the
+                                             * delivery callback and must be consumed or copied before return */
 };
 
 struct OFLOW
@@ -35,6 +44,14 @@ struct OFLOW
     struct COBS c;
     struct OFLOWFrame f;
     uint64_t perror;
+    bool useCRC;                           /* Sender announced CRC32C trailers, so verify them */
+    uint64_t crcErrors;                    /* Frames quarantined for failing CRC verification */
+
+    struct OFLOWFlowReport flow;           /* Most recent flow report from the publisher */
+    uint64_t flowReports;                  /* How many flow reports have been received */
+    uint64_t flowGaps;                     /* Reports which showed fresh host-side loss */
+
+    uint64_t arrivalTime;                  /* Externally supplied timestamp for the next pump, or 0 */
 
     /* Materials for callback */
     void ( *cb )( struct OFLOWFrame *p, void *param );
@@ -46,6 +63,68 @@ struct OFLOW
 #define OFLOW_EOP_LEN            (COBS_EOP_LEN)
 #define OFLOW_TS_RESOLUTION      (1000000000L)
 
+/* Number of correlation samples kept; must be a power of two */
+#define OFLOW_TIMELINE_LEN       (1024)
+
+/* Link capability announcement. A frame on this tag carries a little-endian capability
+ * word; a sender which emits CRC32C trailers announces that here before using them.
+ * Tags from the capability tag upwards are transport-level and host-injected, so they
+ * keep the legacy sum only and are never CRC-checked.
+ */
+#define OFLOW_CAP_TAG            (0x7C)
+#define OFLOW_CAP_CRC32C         (1<<0)
+#define OFLOW_CRC_TRAILER_LEN    (4)
+
+/* Flow report. The daemon injects a frame on this tag into each client's stream so the
+ * far end can see its own position in the published stream and how many bytes have been
+ * skipped past it, distinguishing host-side fan-out loss from probe-side loss.
+ */
+#define OFLOW_FLOW_TAG           (0x7F)
+#define OFLOW_FLOW_PAYLOAD_LEN   (16)
+
+/* Salvage scanner over a damaged OFLOW capture. Feed the raw bytes through in blocks of any
+ * size; the scanner resynchronizes on every frame delimiter, validates each candidate span
+ * against the frame checksum and delivers the survivors, plus a map of the spans nothing
+ * could be recovered from. CRC trailers, where present, ride through as payload exactly as
+ * they would for a receiver that never saw the capability announcement.
+ */
+struct OFLOWSalvage
+{
+    struct Frame decode;                    /* Decode target for the candidate under test */
+    struct OFLOWFrame f;                    /* Recovered frame handed to the delivery callback */
+    uint8_t carry[COBS_MAX_ENC_PACKET_LEN]; /* Candidate bytes held across a feed boundary */
+    int carryLen;                           /* Number of bytes currently held */
+    bool overlong;                          /* Candidate outgrew any legal frame encoding */
+    uint64_t offset;                        /* Capture offset of the next byte to be fed */
+    uint64_t candStart;                     /* Capture offset where the current candidate began */
+    uint64_t gapStart;                      /* Capture offset where the open gap began */
+    bool inGap;                             /* An unrecoverable span is currently open */
+
+    uint64_t framesRecovered;               /* Candidates which decoded and passed the checksum */
+    uint64_t bytesRecovered;                /* Payload bytes those frames carried */
+    uint64_t gaps;                          /* Distinct unrecoverable spans reported */
+    uint64_t bytesLost;                     /* Capture bytes inside those spans */
+
+    void ( *frameCB )( uint64_t at, struct OFLOWFrame *p, void *param ); /* Recovered frame delivery */
+    void ( *gapCB )( uint64_t at, uint64_t len, void *param );           /* Unrecoverable span delivery */
+    void *param;                            /* Passed through to both callbacks */
+};
+
+/* One hardware-to-wall time correlation sample */
+struct OFLOWTimePoint
+{
+    uint64_t hw;                            /* Cumulative hardware (target) timestamp */
+    uint64_t wall;                          /* Wall clock when it was observed */
+};
+
+/* Correlation table between target time and wall clock, built as frames arrive */
+struct OFLOWTimeline
+{
+    struct OFLOWTimePoint point[OFLOW_TIMELINE_LEN]; /* Samples, oldest overwritten on wrap */
+    uint32_t wp;                            /* Number of samples ever noted */
+    uint32_t mru;                           /* Most recently matched sample, tried first */
+};
+
 // ====================================================================================================
 
 static inline uint64_t OFLOWResolution( struct OFLOW *t )
@@ -57,11 +136,28 @@ const uint8_t *OFLOWgetFrameExtent( const uint8_t *inputEnc, int len );
 bool OFLOWisEOFRAME( const uint8_t *inputEnc );
 
 void OFLOWEncode( const uint8_t channel, const uint64_t tstamp, const uint8_t *inputMsg, int len, struct Frame *o );
+void OFLOWEncodeCRC( const uint8_t channel, const uint64_t tstamp, const uint8_t *inputMsg, int len, struct Frame *o );
+void OFLOWEncodeCapabilities( uint32_t caps, struct Frame *o );
+void OFLOWEncodeFlowReport( uint64_t seq, uint64_t dropped, struct Frame *o );
 
 /* Context free functions */
+
+/* Deframe incoming bytes, delivering each completed frame to the callback. Payloads are
+ * validated and handed over in place, without an intermediate copy; see struct OFLOWFrame
+ * for the resulting lifetime rules.
+ */
 void OFLOWPump( struct OFLOW *t, const uint8_t *incoming, int len,
                 void ( *packetRxed )( struct OFLOWFrame *p, void *param ),
                 void *param );
+
+/* Stamp the next pump with a caller-determined reception time (in OFLOW_TS_RESOLUTION units),
+ * rather than the wall clock at decode. Lets a caller which knows when the bytes actually
+ * arrived keep frame timestamps honest even when decode lags behind reception.
+ */
+static inline void OFLOWSetArrivalTime( struct OFLOW *t, uint64_t tstamp )
+{
+    t->arrivalTime = tstamp;
+}
 static inline uint64_t OFLOWGetErrors( struct OFLOW *t )
 {
     return t ? t->perror : ( uint64_t ) -1;
@@ -70,8 +166,39 @@ static inline uint64_t OFLOWGetCOBSErrors( struct OFLOW *t )
 {
     return t ? COBSGetErrors( &t->c ) : -1;
 }
+static inline uint64_t OFLOWGetCRCErrors( struct OFLOW *t )
+{
+    return t ? t->crcErrors : ( uint64_t ) -1;
+}
+static inline bool OFLOWGetFlowReport( struct OFLOW *t, struct OFLOWFlowReport *r )
+{
+    if ( ( !t ) || ( !t->flowReports ) )
+    {
+        return false;
+    }
+
+    *r = t->flow;
+    return true;
+}
+static inline uint64_t OFLOWGetFlowGaps( struct OFLOW *t )
+{
+    return t ? t->flowGaps : ( uint64_t ) -1;
+}
 void OFLOWDelete( struct OFLOW *t );
 struct OFLOW *OFLOWInit( struct OFLOW *t );
+
+/* Capture salvage service */
+void OFLOWSalvageInit( struct OFLOWSalvage *s,
+                       void ( *frameRecovered )( uint64_t at, struct OFLOWFrame *p, void *param ),
+                       void ( *gapFound )( uint64_t at, uint64_t len, void *param ),
+                       void *param );
+void OFLOWSalvagePump( struct OFLOWSalvage *s, const uint8_t *incoming, int len );
+void OFLOWSalvageFinalise( struct OFLOWSalvage *s );
+
+/* Timestamp correlation service */
+void OFLOWTimelineInit( struct OFLOWTimeline *t );
+void OFLOWTimelineNote( struct OFLOWTimeline *t, uint64_t hwTime, uint64_t wallTime );
+bool OFLOWTimelineWall( struct OFLOWTimeline *t, uint64_t hwTime, uint64_t *wallTime );
 // ====================================================================================================
 #ifdef __cplusplus
 }
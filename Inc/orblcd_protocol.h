@@ -1,6 +1,8 @@
 #ifndef _ORBLCD_PROTOCOL_H_
 #define _ORBLCD_PROTOCOL_H_
 
+#include <stdint.h>
+
 #define LCD_DATA_CHANNEL    (28)
 #define LCD_COMMAND_CHANNEL (LCD_DATA_CHANNEL+1)
 
@@ -13,6 +15,7 @@
 #define ORBLCD_CMD_CLOSE_SCREEN (2)
 #define ORBLCD_CMD_CLEAR        (3)
 #define ORBLCD_CMD_GOTOXY       (4)
+#define ORBLCD_CMD_RLE_RUN      (5)
 
 #define LCD_BE                  (0)
 #define LCD_LE                  (1)
@@ -31,8 +34,38 @@
 #define ORBLCD_GET_DEPTH(x)        (((int[]){1,8,16,24})[ORBLCD_DECODE_D(x)])
 #define ORBLCD_PIXELS_PER_WORD(x)  (((int[]){32,4,2,1})[ORBLCD_DECODE_D(x)])
 
+/* Run length extension: repeat the most recent pixel a further n times, advancing the
+ * cursor as if the pixels had been sent individually. One word covers a run of up to
+ * 2^26-1 pixels, so solid fills cost two words instead of one word per pixel (or per
+ * pixel group at lower depths). Decoders which predate this command report and ignore it.
+ */
+#define ORBLCD_ENCODE_RUN(x) ((x)&0x3ffffff)
+#define ORBLCD_DECODE_RUN(x) ((x)&0x3ffffff)
+
 #define ORBLCD_OPEN_SCREEN(x,y,d,l) (ORBLCD_ENCODE_L(l)|ORBLCD_ENCODE_C(ORBLCD_CMD_INIT_LCD)|ORBLCD_ENCODE_D(d)|ORBLCD_ENCODE_X(x)|ORBLCD_ENCODE_Y(y))
 #define ORBLCD_CLOSE_SCREEN       (ORBLCD_ENCODE_C(ORBLCD_CMD_CLOSE_SCREEN))
 #define ORBLCD_CLEAR              (ORBLCD_ENCODE_C(ORBLCD_CMD_CLEAR))
+#define ORBLCD_RLE_RUN(n)         (ORBLCD_ENCODE_C(ORBLCD_CMD_RLE_RUN)|ORBLCD_ENCODE_RUN(n))
+
+/* Shared-memory frame export. orblcd can publish its framebuffer in a POSIX shm segment so
+ * other processes sample frames zero-copy instead of going through the display server. The
+ * header leads the segment and ARGB8888 pixel rows follow it, bytesPerRow per line. seq is a
+ * seqlock; it is odd while a frame (or a mode change) is being written, so a reader copies
+ * the pixels, re-reads seq and retries if it changed or was odd. A reader seeing a magic or
+ * version it doesn't know should walk away.
+ */
+#define ORBLCD_SHM_MAGIC   (0x4f4c4344)
+#define ORBLCD_SHM_VERSION (1)
+
+struct orblcdShmHeader
+{
+    uint32_t magic;                      /* ORBLCD_SHM_MAGIC */
+    uint32_t version;                    /* ORBLCD_SHM_VERSION */
+    uint32_t seq;                        /* Seqlock, odd while contents are in flux */
+    uint32_t modeDescriptor;             /* Geometry and depth, ORBLCD_DECODE_* applies */
+    uint32_t bytesPerRow;                /* Stride of one pixel row in the segment */
+    uint32_t res;                        /* Keeps the pixel data 64-bit aligned */
+    uint64_t frames;                     /* Count of frames committed so far */
+};
 
 #endif
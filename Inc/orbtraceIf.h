@@ -70,11 +70,27 @@ struct OrbtraceIfDevice
     const struct OrbtraceInterfaceType *type;
 };
 
+/* Bits in OrbtraceIfSettings::valid identifying which entries hold a known value */
+#define OTS_TRACEMODE    (1<<0)
+#define OTS_BAUDRATE     (1<<1)
+#define OTS_VOLTAGE(ch)  (1<<(2+(ch)))
+#define OTS_ENABLE(ch)   (1<<(2+CH_MAX+(ch)))
+
+struct OrbtraceIfSettings
+{
+    uint32_t valid;                              /* Which of the entries below are known */
+    uint16_t traceMode;                          /* Trace width or SWO mode register */
+    uint32_t baudrate;                           /* SWO baudrate */
+    uint16_t voltage[CH_MAX];                    /* Channel voltage in mv */
+    bool enable[CH_MAX];                         /* Channel enable state */
+};
+
 struct __attribute__( ( packed ) ) dataBlock
 {
             long unsigned int fillLevel;                         /* How full this block is */
             uint8_t buffer[USB_TRANSFER_SIZE];                   /* Block buffer */
             struct libusb_transfer *usbtfr;                      /* USB Transfer handle */
+            uint64_t arrival;                                    /* Host monotonic time the transfer completed */
 };
 
 struct OrbtraceIf
@@ -95,6 +111,12 @@ struct OrbtraceIf
 
     int numDevices;                              /* Number of matching devices found */
     struct OrbtraceIfDevice *devices;            /* List of matching devices found */
+
+    /* Configuration caching and batching */
+    struct OrbtraceIfSettings current;           /* Last values confirmed written to the probe */
+    struct OrbtraceIfSettings staged;            /* Values awaiting a batch commit */
+    bool batching;                               /* Setters stage rather than transfer */
+    bool batchUnsupported;                       /* Firmware rejected a batch commit */
 };
 // ====================================================================================================
 
@@ -162,10 +184,15 @@ bool OrbtraceSupportsOFLOW( struct OrbtraceIf *o );
 bool OrbtraceIfSetTraceWidth( struct OrbtraceIf *o, int width );
 bool OrbtraceIfSetTraceSWO( struct OrbtraceIf *o, bool isMANCH, bool useTPIU );
 bool OrbtraceIfSetSWOBaudrate( struct OrbtraceIf *o, uint32_t speed );
+bool OrbtraceIfCalibrateSWOBaudrate( struct OrbtraceIf *o, uint32_t maxSpeed, uint32_t *calibrated );
 
 bool OrbtraceIfVoltage( struct OrbtraceIf *o, enum Channel ch, int voltage );
 bool OrbtraceIfSetVoltageEn( struct OrbtraceIf *o, enum Channel ch, bool isOn );
 
+/* Configuration batching; settings made between begin and commit are sent in one transfer */
+void OrbtraceIfBatchBegin( struct OrbtraceIf *o );
+bool OrbtraceIfBatchCommit( struct OrbtraceIf *o );
+
 /* Data transfer specifics */
 bool OrbtraceIfSetupTransfers( struct OrbtraceIf *o, bool hiresTime, struct dataBlock *d, int numBlocks, libusb_transfer_cb_fn callback );
 int OrbtraceIfHandleEvents( struct OrbtraceIf *o );
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Sample Compression Module
+ * =========================
+ *
+ * Delta-encoded, run-length-compressed batches of PC sample addresses, for
+ * carriage between the orbuculum daemon and clients on a dedicated OFLOW tag.
+ */
+
+#ifndef _SAMPLECOMP_
+#define _SAMPLECOMP_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* OFLOW tag carrying compressed sample batches (top of the usable tag range) */
+#define SAMPLECOMP_TAG         (0x7E)
+
+/* Version byte leading each batch */
+#define SAMPLECOMP_VERSION     (1)
+
+/* Batch size bound; must fit in a single OFLOW packet */
+#define SAMPLECOMP_MAX_BATCH   (1024)
+
+/* Worst case bytes one run can need (version excluded); 5 byte delta + 5 byte count */
+#define SAMPLECOMP_MAX_RECORD  (10)
+
+struct sampleCompEncoder
+{
+    uint32_t lastAddr;                     /* Prediction base for the next delta */
+    uint32_t runAddr;                      /* Address of the currently open run */
+    uint32_t runCount;                     /* ...and how many samples it holds */
+    uint32_t numSamples;                   /* Samples captured in this batch so far */
+    uint32_t len;                          /* Bytes used in the batch under construction */
+    uint8_t d[SAMPLECOMP_MAX_BATCH];       /* The batch itself */
+};
+
+typedef void ( *sampleCompCB )( uint32_t addr, uint32_t count, void *param );
+
+// ====================================================================================================
+
+void SampleCompInit( struct sampleCompEncoder *e );
+
+/* Add one sample; returns true when the batch is full and should be taken with SampleCompFinish */
+bool SampleCompAdd( struct sampleCompEncoder *e, uint32_t addr );
+
+/* Close any open run and return the completed batch, resetting the encoder. Returns batch length,
+ * 0 if there was nothing to send. *d points at the batch, valid until the next SampleCompAdd.
+ */
+uint32_t SampleCompFinish( struct sampleCompEncoder *e, const uint8_t **d );
+
+/* Expand a received batch, calling cb once per run. Returns false if the batch was malformed */
+bool SampleCompDecode( const uint8_t *d, int len, sampleCompCB cb, void *param );
+
+// ====================================================================================================
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Self-profiling support
+ * ======================
+ *
+ */
+
+#ifndef _SELFPROF_
+#define _SELFPROF_
+
+#include "generics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ====================================================================================================
+
+/* Arm the sampling self-profiler for this process. Does nothing unless the ORB_SELFPROF
+ * environment variable is set; give it a number to choose the sample rate in Hz, anything
+ * else selects the default. Once armed the tool's own threads are sampled on CPU time and
+ * SIGUSR2 writes the stacks collected so far in flamegraph collapsed format.
+ */
+void selfprofInit( const char *toolName );
+
+// ====================================================================================================
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Shared memory broadcast ring
+ * ============================
+ *
+ * Layout of the shared memory segment the orbuculum daemon advertises alongside each of
+ * its TCP server ports. Local clients map the segment and follow the publisher with
+ * their own private read cursors, which avoids a trip through the loopback network
+ * stack for every byte. The wakeup mutex is process-shared and robust; the data are
+ * never accessed under it.
+ */
+
+#ifndef _SHMRING_H_
+#define _SHMRING_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Name of the segment serving a given TCP port, for use with shm_open */
+#define SHMRING_NAME_FORMAT  "/orbuculum.%d"
+#define SHMRING_NAME_MAX_LEN (32)
+
+#define SHMRING_MAGIC        (0x4f524252)
+#define SHMRING_VERSION      (1)
+
+struct shmRing
+{
+    uint32_t magic;                           /* Set to SHMRING_MAGIC once the segment is ready for use */
+    uint32_t version;                         /* Layout version, SHMRING_VERSION */
+    uint32_t ringSize;                        /* Length of d[] in bytes, always a power of two */
+    uint32_t pid;                             /* Process ID of the publishing daemon */
+
+    pthread_mutex_t      lock;                /* Protects the wakeup condition only, never the data */
+    pthread_cond_t       dataAvailable;       /* Broadcast each time wp moves (CLOCK_MONOTONIC waits) */
+
+    atomic_uint_fast64_t wp;                  /* Total bytes ever published into the ring */
+
+    uint8_t d[];                              /* The ring data */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -41,12 +41,20 @@ struct sioline
     void *dat;
 };
 
+/* Callback to materialize output buffer lines at least up to upToLine (-1 = everything).
+ * Returns the total number of lines now available.
+ */
+typedef int32_t ( *SIOLineProvider )( void *context, int32_t upToLine );
+
 // ====================================================================================================
 const char *SIOgetSaveFilename( struct SIOInstance *sio );
 int32_t SIOgetCurrentLineno( struct SIOInstance *sio );
 int32_t SIOgetLastLineno( struct SIOInstance *sio );
 void SIOsetCurrentLineno( struct SIOInstance *sio, int32_t l );
 void SIOsetOutputBuffer( struct SIOInstance *sio, int32_t numLines, int32_t currentLine, struct sioline **opTextSet, bool amDiving );
+void SIOextendOutputBuffer( struct SIOInstance *sio, int32_t numLines );
+void SIOtrimOutputBuffer( struct SIOInstance *sio, int32_t numLines );
+void SIOsetLineProvider( struct SIOInstance *sio, SIOLineProvider provider, void *context );
 void SIOalert( struct SIOInstance *sio, const char *msg );
 void SIOrequestRefresh( struct SIOInstance *sio );
 void SIOheld( struct SIOInstance *sio, bool isHeld );
@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Shared telemetry segment
+ * ========================
+ *
+ * One small shared-memory segment, published under a well-known name, through which the
+ * tools expose pipeline health counters (bytes moved, events handled, drops, queue depth).
+ * Each tool claims a slot at startup and bumps its counters with relaxed atomics, so the
+ * hot paths pay a single uncontended store. A host agent maps the segment read-only and
+ * samples it at whatever rate it likes without ever making a syscall into the tools.
+ *
+ * No consistency between counters, or between slots, is implied; each value is only
+ * individually coherent, which is all a sampling monitor needs.
+ */
+
+#ifndef _STATSEG_
+#define _STATSEG_
+
+#include <stdint.h>
+
+#ifndef __cplusplus
+    #include <stdatomic.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ====================================================================================================
+
+#define STATSEG_NAME       "/orbstats"       /* Well-known shm name for the segment */
+#define STATSEG_MAGIC      (0x4F524253)      /* "ORBS" */
+#define STATSEG_VERSION    (1)               /* Bumped on any layout change */
+#define STATSEG_MAX_TOOLS  (16)              /* Concurrent publishers supported */
+#define STATSEG_NAME_LEN   (16)              /* Tool name, including terminator */
+
+#ifdef __cplusplus
+    typedef uint32_t statsegWord;
+    typedef uint64_t statsegCount;
+#else
+    typedef _Atomic uint32_t statsegWord;
+    typedef _Atomic uint64_t statsegCount;
+#endif
+
+struct statSlot
+{
+    statsegWord pid;                         /* Claiming process, 0 if the slot is free */
+    char name[STATSEG_NAME_LEN];             /* Tool name, for the monitor's benefit */
+
+    statsegCount bytes;                      /* Raw bytes through this tool */
+    statsegCount events;                     /* Decoded events/messages handled */
+    statsegCount drops;                      /* Bytes or events discarded */
+    statsegCount queueDepth;                 /* Current backlog, in tool-defined units */
+};
+
+struct statSeg
+{
+    statsegWord magic;                       /* STATSEG_MAGIC once initialised */
+    uint32_t version;                        /* STATSEG_VERSION of the creator */
+    struct statSlot slot[STATSEG_MAX_TOOLS];
+};
+
+/* Counter updates from the hot paths; relaxed is sufficient since each counter stands alone */
+#ifdef __cplusplus
+    #define STATSEG_ADD( s, field, n ) do { ( s )->field += ( n ); } while ( 0 )
+    #define STATSEG_SET( s, field, n ) do { ( s )->field = ( n ); } while ( 0 )
+#else
+    #define STATSEG_ADD( s, field, n ) atomic_fetch_add_explicit( &( s )->field, ( n ), memory_order_relaxed )
+    #define STATSEG_SET( s, field, n ) atomic_store_explicit( &( s )->field, ( n ), memory_order_relaxed )
+#endif
+
+// ====================================================================================================
+
+/* Claim a slot in the shared segment, creating the segment if needed. Never returns NULL;
+ * if shared memory is unavailable a process-local slot is handed back instead, so callers
+ * can update counters unconditionally.
+ */
+struct statSlot *statsegPublish( const char *name );
+
+/* Release a slot claimed by statsegPublish. Safe to call with the local fallback slot. */
+void statsegUnpublish( struct statSlot *s );
+
+// ====================================================================================================
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -21,11 +21,44 @@ struct Stream
     enum ReceiveResult ( *receive )( struct Stream *stream, void *buffer, size_t bufferSize,
                                      struct timeval *timeout, size_t *receivedSize );
     void ( *close )( struct Stream *stream );
+
+    /* Export a pollable descriptor which becomes readable when receive() can make progress,
+     * so a caller can fold this stream into its own event loop alongside other descriptors
+     * and timers. Backends which buffer internally (and so can have data ready without the
+     * descriptor showing readable) leave this unset; those callers keep a timeout-driven
+     * receive() instead. Use streamGetReadFd() below rather than calling this directly.
+     */
+    int ( *getReadFd )( struct Stream *stream );
 };
 
+// ====================================================================================================
+
+static inline int streamGetReadFd( struct Stream *stream )
+
+/* Readiness descriptor for this stream, or -1 when the backend doesn't offer one */
+
+{
+    return ( stream->getReadFd ) ? stream->getReadFd( stream ) : -1;
+}
+
 struct Stream *streamCreateSocket( const char *server, int port );
 struct Stream *streamCreateFile( const char *file );
 
+/* Wrap a connected socket in an io_uring multi-shot receive path. Returns NULL when the
+ * kernel can't provide one, in which case the caller keeps its POSIX path. Linux only.
+ */
+struct Stream *streamUringCreateSocket( int socket );
+
+/* Wrap an already-opened and configured descriptor (e.g. a serial port) as a stream. No
+ * content sniffing is performed, so this is safe on non-seekable sources. POSIX only.
+ */
+struct Stream *streamCreateFdFile( int fileDescriptor );
+
+/* Decompressing wrapper over an already-opened zstd file; streamCreateFile applies this
+ * automatically when it spots the zstd magic. Only available when built with zstd support.
+ */
+struct Stream *streamCreateZstdFile( int fileDescriptor );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * String Interning Module
+ * =======================
+ *
+ * Deduplicated string storage; each distinct string is held exactly once and is assigned a
+ * dense index in first-seen order. Lookup is a hash probe rather than a table scan, and the
+ * stored copies remain at fixed addresses for the life of the table.
+ */
+
+#ifndef _STRINTERN_H_
+#define _STRINTERN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STRINTERN_NOT_FOUND (0xffffffff)
+
+struct strInternTable;
+
+// ====================================================================================================
+
+/* Create an empty interning table */
+struct strInternTable *strinternCreate( void );
+
+/* Dispose of a table and every string it holds */
+void strinternDelete( struct strInternTable *t );
+
+/* Return the dense index (0,1,2... in first-seen order) for key, adding it if it's not
+ * already present. If stored is non-NULL it receives the table's own copy of the string,
+ * which stays put until the table is deleted.
+ */
+uint32_t strinternIndex( struct strInternTable *t, const char *key, const char **stored );
+
+/* Look key up without adding it; STRINTERN_NOT_FOUND if it's not there */
+uint32_t strinternFind( struct strInternTable *t, const char *key );
+
+/* Number of distinct strings held */
+uint32_t strinternCount( struct strInternTable *t );
+
+// ====================================================================================================
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * SWO Line Decoder Module
+ * =======================
+ *
+ * Demodulates raw logic-capture samples of a SWO pin into bytes, so captures
+ * taken straight off the wire can be replayed without external preprocessing.
+ * Samples arrive packed eight to a byte, LSB first, at a fixed rate; the
+ * oversampling ratio is given at init time.
+ *
+ * Two line codings are supported;
+ *
+ *   UART (NRZ)  : idle high, one low start bit, eight data bits LSB first,
+ *                 one high stop bit.
+ *   Manchester  : idle low, biphase-L with the bit value carried by the level
+ *                 of the second half-cell. A byte is a single '1' start bit
+ *                 followed by eight data bits LSB first; the leading rising
+ *                 edge of the start bit is used for synchronisation.
+ */
+
+#ifndef _SWO_DECODER_
+#define _SWO_DECODER_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum SWOLineMode
+{
+    SWOLINE_NONE,                           /* Line decode not in use */
+    SWOLINE_UART,                           /* NRZ async coding */
+    SWOLINE_MANCH                           /* Manchester (biphase-L) coding */
+};
+
+/* Statistics down the line decode */
+struct SWOLineDecoderStats
+{
+    uint64_t samples;                       /* Number of samples consumed */
+    uint64_t rxedBytes;                     /* Number of bytes successfully demodulated */
+    uint64_t framingErrors;                 /* Number of byte frames abandoned for bad framing */
+};
+
+struct SWOLineDecoder
+{
+    enum SWOLineMode mode;                  /* Which line coding is in force */
+    uint32_t spb;                           /* Samples per bit period */
+
+    struct SWOLineDecoderStats stats;       /* Record of decoder status */
+
+    /* Sample staging, so a byte frame spanning pump calls isn't lost... */
+    uint8_t *smp;                           /* Packed samples awaiting decode */
+    uint32_t smpCap;                        /* Allocated length of the staging buffer, in bytes */
+    uint32_t smpLen;                        /* Number of valid bytes in the staging buffer */
+    uint64_t pos;                           /* Next sample (bit index) to be consumed */
+};
+
+// ====================================================================================================
+
+void SWOLineDecoderInit( struct SWOLineDecoder *d, enum SWOLineMode mode, uint32_t samplesPerBit );
+void SWOLineDecoderPump( struct SWOLineDecoder *d, const uint8_t *samples, int len,
+                         void ( *bytesRxed )( const uint8_t *bytes, int count, void *param ),
+                         void *param );
+void SWOLineDecoderDelete( struct SWOLineDecoder *d );
+// ====================================================================================================
+#ifdef __cplusplus
+}
+#endif
+#endif
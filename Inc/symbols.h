@@ -35,6 +35,8 @@ extern "C" {
 
 enum symbolErr { SYMBOL_OK, SYMBOL_NOELF, SYMBOL_NOOBJDUMP, SYMBOL_UNSPECIFIED };
 
+struct symbolRegionChunk;
+
 /* Mapping of lines numbers to indicies */
 struct assyLineEntry
 
@@ -79,6 +81,7 @@ struct sourceLineEntry
     char *lineText;                         /* All source text relating to this memory range */
     uint16_t linesInBlock;                  /* How many lines in the source file correspond to this line? */
     uint32_t assyLines;                     /* Number of lines of assembly for this memory range */
+    uint32_t assyCap;                       /* Allocated capacity of the assembly table */
     struct assyLineEntry *assy;             /* Assembly entries for this memory range */
 
     uint32_t functionIdx;                   /* Index back to function this line is part of */
@@ -89,11 +92,16 @@ struct sourceLineEntry
 /* The full set of symbols */
 struct SymbolSet
 {
-    char *elfFile;                         /* File containing structure info */
+    char *elfFile;                         /* File containing structure info (may be a comma-separated federation) */
     char *deleteMaterial;                  /* Material to strip off filenames */
     char *odoptions;                       /* Any options to pass directly to objdump */
     struct stat st;
 
+    /* Federation over multiple images in disjoint address ranges... */
+    char **image;                          /* The individual ELF files making up this set */
+    uint32_t imageCount;                   /* Number of images in the federation */
+    struct stat *imageSt;                  /* Stat records, one per image */
+
     /* For memory saving and speedup... */
     bool recordSource;                     /* Keep a record of source code */
     bool recordAssy;                       /* Keep a record of assembly code */
@@ -102,12 +110,20 @@ struct SymbolSet
     /* For file mapping... */
     uint32_t sourceCount;                  /* Number of source lines we have loaded */
 
+    /* Packed address index over the sorted sources table, for fast lookup... */
+    uint32_t *idxStart;                    /* Line start addresses, one per source line */
+    uint32_t *idxEnd;                      /* ...and the matching line end addresses */
+    uint32_t mruLine;                      /* Most recently matched line, checked first */
+
 
     uint32_t fileCount;                    /* Number of files we have loaded */
     struct fileEntry *files;               /* Table of files */
     uint32_t functionCount;                /* Number of functions we have loaded */
     struct functionEntry *functions;       /* Table of functions */
     struct sourceLineEntry *sources;       /* Table of sources */
+    struct strInternTable *fileNames;      /* Interned name storage backing the files table */
+    struct strInternTable *functionNames;  /* Interned name storage backing the functions table */
+    struct symbolRegionChunk *region;      /* Region holding all line and assembly text */
 };
 
 /* An entry in the names table ... what we return to our caller */
@@ -124,11 +140,20 @@ struct nameEntry
     uint32_t index;
 };
 
+/* Kernel-notified change watching over the image(s) of a symbol set, so validity checking
+ * doesn't have to stat the filesystem every interval. Opaque; Create returns NULL where the
+ * facility isn't available and callers should fall back to SymbolSetValid.
+ */
+struct symbolWatcher;
+
 // ====================================================================================================
 enum symbolErr SymbolSetCreate( struct SymbolSet **ss, const char *filename, const char *deleteMaterial,
                                 bool demanglecpp, bool recordSource, bool recordAssy, const char *objdumpOptions );
 void SymbolSetDelete( struct SymbolSet **s );
 bool SymbolSetValid( struct SymbolSet **s, char *filename );
+struct symbolWatcher *SymbolWatcherCreate( const char *filename );
+bool SymbolWatcherChanged( struct symbolWatcher *w );
+void SymbolWatcherDelete( struct symbolWatcher **w );
 const char *SymbolFilename( struct SymbolSet *s, uint32_t index );
 const char *SymbolFunction( struct SymbolSet *s, uint32_t index );
 bool SymbolLookup( struct SymbolSet *s, uint32_t addr, struct nameEntry *n );
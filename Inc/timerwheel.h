@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Timer Wheel support
+ * ===================
+ *
+ */
+
+#ifndef _TIMERWHEEL_
+#define _TIMERWHEEL_
+
+#include <stdint.h>
+#include "generics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ====================================================================================================
+
+struct twHandle;
+struct twTimer;
+
+typedef void ( *twCallback )( void *context );
+
+// ====================================================================================================
+
+struct twHandle *twInit( void );
+struct twTimer *twRepeat( struct twHandle *h, uint64_t intervaluS, twCallback cb, void *context );
+struct twTimer *twOneshot( struct twHandle *h, uint64_t delayuS, twCallback cb, void *context );
+void twCancel( struct twHandle *h, struct twTimer *t );
+void twShutdown( struct twHandle *h );
+
+// ====================================================================================================
+#ifdef __cplusplus
+}
+#endif
+#endif
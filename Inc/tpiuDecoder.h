@@ -13,10 +13,23 @@
 #include <stdbool.h>
 #include <sys/time.h>
 
+#ifndef __cplusplus
+    #include <stdatomic.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Counters have a single writer (the pumping thread) but can be observed from elsewhere,   */
+/* so they are made atomic to keep reads untorn. They are independent of each other; there  */
+/* is no snapshot consistency across the set.                                               */
+#ifdef __cplusplus
+    typedef uint32_t tpiuStatCount;
+#else
+    typedef _Atomic uint32_t tpiuStatCount;
+#endif
+
 enum TPIUPumpEvent
 {
     TPIU_EV_NONE,
@@ -37,6 +50,7 @@ enum TPIUPumpState
 };
 
 #define TPIU_PACKET_LEN (16)
+#define TPIU_RESYNC_BUFFER_LEN (4096)      /* Bytes retained while hunting for sync, for recovery */
 
 struct TPIUCommsStats
 
@@ -49,11 +63,12 @@ struct TPIUCommsStats
 
 struct TPIUDecoderStats
 {
-    uint32_t lostSync;                     /* Number of times sync has been lost */
-    uint32_t syncCount;                    /* Number of times a sync event has been received */
-    uint32_t halfSyncCount;                /* Number of times a half sync event has been received */
-    uint32_t packets;                      /* Number of packets received */
-    uint32_t error;                        /* Number of times an error has been received */
+    tpiuStatCount lostSync;                /* Number of times sync has been lost */
+    tpiuStatCount syncCount;               /* Number of times a sync event has been received */
+    tpiuStatCount halfSyncCount;           /* Number of times a half sync event has been received */
+    tpiuStatCount packets;                 /* Number of packets received */
+    tpiuStatCount error;                   /* Number of times an error has been received */
+    tpiuStatCount recoveredFrames;         /* Frames' worth of data salvaged by resync recovery */
 };
 
 struct TPIUDecoder
@@ -67,6 +82,11 @@ struct TPIUDecoder
     uint8_t rxedPacket[TPIU_PACKET_LEN];   /* Packet currently under construction */
     bool selfAllocated;                    /* Flag indicating that memory was allocated by the library */
 
+    /* Bytes discarded while hunting for sync are retained here so that, once sync is found,
+     * whole frames immediately preceding it can be validated backwards and replayed */
+    uint8_t resyncBuffer[TPIU_RESYNC_BUFFER_LEN];
+    uint32_t resyncLen;                    /* Number of retained bytes */
+
     struct TPIUDecoderStats stats;         /* Record of decoder stats */
     struct TPIUCommsStats commsStats;      /* Record of Comms stats */
 };
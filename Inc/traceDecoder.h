@@ -11,6 +11,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "generics.h"
 
 #ifdef __cplusplus
@@ -84,6 +85,8 @@ enum TRACEchanges
 /* Flag for unknown/illegal cycle count */
 #define COUNT_UNKNOWN 0xffffffffffffffffL
 #define ADDRESS_UNKNOWN ((symbolMemaddr)-1)
+#define TRACE_RETURN_STACK_LEN (16)
+#define TRACE_CPI_SHIFT (8)                /* Fixed-point fraction bits in the CPI estimate */
 
 // ============================================================================
 // Messages out of the decoder
@@ -144,6 +147,16 @@ struct TRACECPUState
     // Convinience, for debug reporting
     genericsReportCB report;
 
+    // Incremental cycle timeline, integrated from cycle-count packets
+    uint64_t cycleTotal;                 /* Cycles accumulated over the whole run */
+    uint64_t cycleAnchorInst;            /* instCount when the last cycle packet landed */
+    uint64_t cpiEst;                     /* Cycles per instruction over the last interval, fixed point */
+
+    // Architectural return-stack model ( bounded at 16 entries per the ETMv4 spec )
+    symbolMemaddr returnStack[TRACE_RETURN_STACK_LEN]; /* Predicted return addresses */
+    uint32_t returnStackWp;              /* Slot the next push lands in */
+    uint32_t returnStackDepth;           /* Number of live entries */
+
     // Debugging
     uint64_t overflows;
 };
@@ -158,7 +171,13 @@ struct TRACEDecoder;
 
 struct TRACEDecoderEngine
 {
+    /* Specialised whole-buffer pump, with direct calls into the protocol's own handlers. */
+    /* Selected once at TRACEDecoderInit time; the per-byte methods below remain for      */
+    /* engines which do not provide one.                                                  */
+    void ( *pump )          ( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu, const uint8_t *buf, int len, traceDecodeCB cb, void *d );
+
     bool ( *action )        ( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu, uint8_t c  );
+    int  ( *actionSpan )    ( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu, const uint8_t *buf, int len );
     bool ( *actionPair )    ( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu, uint32_t source, uint32_t dest );
     void ( *destroy )       ( struct TRACEDecoderEngine *e );
     bool ( *synced )        ( struct TRACEDecoderEngine *e );
@@ -167,6 +186,17 @@ struct TRACEDecoderEngine
 
     /* Config specific to ETM3.5 */
     void ( *altAddrEncode ) ( struct TRACEDecoderEngine *e, bool using );
+
+    size_t stateSize;                  /* Overall size of engine state, for snapshot/restore */
+};
+
+/* Snapshot of a decoder, sufficient to resume decoding from the point it was taken */
+struct TRACEDecoderSnapshot
+
+{
+    struct TRACEDecoderStats stats;    /* Statistics at the snapshot point */
+    struct TRACECPUState cpu;          /* CPU state at the snapshot point */
+    uint8_t engineState[];             /* Engine internal state (engine->stateSize bytes) */
 };
 
 struct TRACEDecoder
@@ -192,12 +222,84 @@ struct TRACEDecoderStats *TRACEDecoderGetStats( struct TRACEDecoder *i );
 struct TRACECPUState *TRACECPUState( struct TRACEDecoder *i );
 bool TRACEStateChanged( struct TRACEDecoder *i, enum TRACEchanges c );
 
+/* Return-stack model. The client pushes the link address of each executed branch-with-link
+ * and implied returns resolve by popping, mirroring the stack the trace unit itself keeps,
+ * so a return target is known without waiting for an explicit address element. The stack is
+ * circular; overflow discards the oldest entry.
+ */
+static inline void TRACEReturnStackPush( struct TRACECPUState *cpu, symbolMemaddr retAddr )
+{
+    cpu->returnStack[cpu->returnStackWp] = retAddr;
+    cpu->returnStackWp = ( cpu->returnStackWp + 1 ) % TRACE_RETURN_STACK_LEN;
+
+    if ( cpu->returnStackDepth < TRACE_RETURN_STACK_LEN )
+    {
+        cpu->returnStackDepth++;
+    }
+}
+static inline bool TRACEReturnStackPop( struct TRACECPUState *cpu, symbolMemaddr *retAddr )
+{
+    if ( !cpu->returnStackDepth )
+    {
+        return false;
+    }
+
+    cpu->returnStackWp = ( cpu->returnStackWp + TRACE_RETURN_STACK_LEN - 1 ) % TRACE_RETURN_STACK_LEN;
+    cpu->returnStackDepth--;
+    *retAddr = cpu->returnStack[cpu->returnStackWp];
+    return true;
+}
+static inline void TRACEReturnStackFlush( struct TRACECPUState *cpu )
+{
+    cpu->returnStackDepth = 0;
+}
+
+/* Cycle timeline. Engines note the cycle delta carried by each cycle-count packet and the
+ * instruction position it landed at; between packets the timeline interpolates using the
+ * CPI measured over the previous interval. Both sides are O(1), so cycle-accurate function
+ * timing costs nothing extra on the decode path.
+ */
+static inline void TRACECycleNote( struct TRACECPUState *cpu, uint64_t cycles )
+{
+    uint64_t di = cpu->instCount - cpu->cycleAnchorInst;
+
+    cpu->cycleTotal += cycles;
+
+    if ( di )
+    {
+        cpu->cpiEst = ( cycles << TRACE_CPI_SHIFT ) / di;
+    }
+
+    cpu->cycleAnchorInst = cpu->instCount;
+}
+static inline uint64_t TRACECycleTimestamp( struct TRACECPUState *cpu )
+{
+    uint64_t cpi = cpu->cpiEst ? cpu->cpiEst : ( 1 << TRACE_CPI_SHIFT );
+    return cpu->cycleTotal + ( ( ( cpu->instCount - cpu->cycleAnchorInst ) * cpi ) >> TRACE_CPI_SHIFT );
+}
+
 const char *TRACEExceptionName( int exceptionNumber );
 
 const char *TRACEDecodeGetProtocolName( enum TRACEprotocol protocol );
 
 void TRACEDecoderPump( struct TRACEDecoder *i, uint8_t *buf, int len, traceDecodeCB cb, void *d );
 
+struct TRACEDecoderSnapshot *TRACEDecoderSnapshotTake( struct TRACEDecoder *i, struct TRACEDecoderSnapshot *prev );
+void TRACEDecoderSnapshotRestore( struct TRACEDecoder *i, const struct TRACEDecoderSnapshot *s );
+
+/* Config and query specific to MTB streaming mode */
+struct MTBBranchRecord
+{
+    uint64_t seq;                      /* Monotonic sequence number of this record */
+    symbolMemaddr from;                /* Address the branch was taken from */
+    symbolMemaddr to;                  /* Address execution resumed at */
+    bool gapBefore;                    /* Records were lost between this one and its predecessor */
+};
+
+void MTBDecoderSetStreaming( struct TRACEDecoder *i, bool isStreaming );
+uint64_t MTBDecoderIndexCount( struct TRACEDecoder *i );
+bool MTBDecoderIndexRecord( struct TRACEDecoder *i, uint64_t seq, struct MTBBranchRecord *r );
+
 void TRACEDecoderInit( struct TRACEDecoder *i, enum TRACEprotocol protocol, bool usingAltAddrEncodeSet, genericsReportCB report );
 // ====================================================================================================
 #ifdef __cplusplus
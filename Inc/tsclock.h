@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Target clock model
+ * ==================
+ *
+ * Shared accounting of the target timestamp clock. Tools feed every TS message in
+ * here once; the model accumulates target time and, when the CPU speed isn't given
+ * on the command line, fits a nanoseconds-per-tick rate against the wall clock so
+ * tick counts can still be converted to time. All arithmetic is integer fixed
+ * point and every conversion is O(1), so it is safe on the hot message path.
+ */
+
+#ifndef _TSCLOCK_
+#define _TSCLOCK_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "msgDecoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ====================================================================================================
+
+struct TSClock
+{
+    uint64_t ticks;                          /* Cumulative target timestamp, in target clock ticks */
+    uint8_t status;                          /* Quality indication from the most recent TS message */
+    uint64_t nsPerTickQ32;                   /* Nanoseconds per tick, Q32.32 fixed point; 0 if unknown */
+    bool pinned;                             /* Rate was supplied by the caller, don't refit it */
+
+    uint64_t refTicks;                       /* Tick count at the start of the current fit window */
+    uint64_t refWalluS;                      /* Wall clock at the start of the current fit window */
+};
+
+// ====================================================================================================
+
+/* cps is the target clock rate in Hz, or 0 to have the rate fitted from the wall clock */
+void TSClockInit( struct TSClock *c, uint64_t cps );
+
+/* Account one TS message; walluS is the reception wall clock in microseconds */
+void TSClockTick( struct TSClock *c, struct TSMsg *m, uint64_t walluS );
+
+/* O(1) conversions of a tick count under the current rate estimate */
+uint64_t TSClockToNs( const struct TSClock *c, uint64_t ticks );
+uint64_t TSClockToUs( const struct TSClock *c, uint64_t ticks );
+uint64_t TSClockTicksPerSec( const struct TSClock *c );
+
+static inline uint64_t TSClockTicks( const struct TSClock *c )
+{
+    return c->ticks;
+}
+static inline bool TSClockHasRate( const struct TSClock *c )
+{
+    return c->nsPerTickQ32 != 0;
+}
+
+// ====================================================================================================
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -13,10 +13,113 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#if defined( __SSE2__ )
+    #include <emmintrin.h>
+#elif defined( __ARM_NEON )
+    #include <arm_neon.h>
+#endif
 #include "cobs.h"
 
 const uint8_t cobs_eop[COBS_EOP_LEN] = { COBS_SYNC_CHAR };
 
+// ====================================================================================================
+static const uint8_t *_findSync( const uint8_t *p, int len )
+
+/* Return pointer to next sync character in the buffer, or NULL if there isn't one. Uses wide
+ * loads on targets that have them; the residue is left to memchr, which is no slouch either.
+ */
+
+{
+#if defined( __SSE2__ )
+
+    while ( len >= 16 )
+    {
+        __m128i v = _mm_loadu_si128( ( const __m128i * )p );
+        int m = _mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_setzero_si128() ) );
+
+        if ( m )
+        {
+            return p + __builtin_ctz( m );
+        }
+
+        p += 16;
+        len -= 16;
+    }
+
+#elif defined( __ARM_NEON )
+
+    while ( len >= 16 )
+    {
+        uint8x16_t v = vceqq_u8( vld1q_u8( p ), vdupq_n_u8( 0 ) );
+        uint64_t lo = vgetq_lane_u64( vreinterpretq_u64_u8( v ), 0 );
+        uint64_t hi = vgetq_lane_u64( vreinterpretq_u64_u8( v ), 1 );
+
+        if ( lo )
+        {
+            return p + ( __builtin_ctzll( lo ) >> 3 );
+        }
+
+        if ( hi )
+        {
+            return p + 8 + ( __builtin_ctzll( hi ) >> 3 );
+        }
+
+        p += 16;
+        len -= 16;
+    }
+
+#endif
+
+    return len ? memchr( p, COBS_SYNC_CHAR, len ) : NULL;
+}
+
+// ====================================================================================================
+static uint8_t _byteSum( const uint8_t *p, int len )
+
+/* Additive (mod 256) sum of a span. Wide loads with horizontal-add reductions where the
+ * target has them; called on data the copy loop just touched, so it runs from cache.
+ */
+
+{
+    uint64_t sum = 0;
+
+#if defined( __SSE2__ )
+
+    __m128i acc = _mm_setzero_si128();
+
+    while ( len >= 16 )
+    {
+        __m128i v = _mm_loadu_si128( ( const __m128i * )p );
+        acc = _mm_add_epi64( acc, _mm_sad_epu8( v, _mm_setzero_si128() ) );
+        p += 16;
+        len -= 16;
+    }
+
+    sum = ( uint64_t )_mm_cvtsi128_si64( acc ) + ( uint64_t )_mm_cvtsi128_si64( _mm_unpackhi_epi64( acc, acc ) );
+
+#elif defined( __ARM_NEON )
+
+    uint64x2_t acc = vdupq_n_u64( 0 );
+
+    while ( len >= 16 )
+    {
+        uint8x16_t v = vld1q_u8( p );
+        acc = vaddq_u64( acc, vpaddlq_u32( vpaddlq_u16( vpaddlq_u8( v ) ) ) );
+        p += 16;
+        len -= 16;
+    }
+
+    sum = vgetq_lane_u64( acc, 0 ) + vgetq_lane_u64( acc, 1 );
+
+#endif
+
+    while ( len-- )
+    {
+        sum += *p++;
+    }
+
+    return ( uint8_t )sum;
+}
 // ====================================================================================================
 struct COBS *COBSInit( struct COBS *t )
 
@@ -48,7 +151,10 @@ void COBSDelete( struct COBS *t )
 
 void COBSEncode( const uint8_t *frontMsg, int lfront, const uint8_t *backMsg, int lback, const uint8_t *inputMsg, int lmsg, struct Frame *o )
 
-/* Encode frame and write into provided output Frame buffer */
+/* Encode frame and write into provided output Frame buffer. The three source spans are
+ * processed in turn and each is copied in whole runs between sync characters, so the
+ * hot path is memchr/memcpy over the payload rather than a branch per byte.
+ */
 
 {
     uint8_t *wp = o->d;
@@ -63,27 +169,63 @@ void COBSEncode( const uint8_t *frontMsg, int lfront, const uint8_t *backMsg, in
     {
         uint8_t *cp = wp++;
         int seglen = 1;
+        int remaining = len;
 
-        for ( int i = 0; len--; i++ )
+        const uint8_t *seg[3]  = { frontMsg, inputMsg, backMsg };
+        const int      segl[3] = { lfront, lmsg, lback };
+
+        for ( int s = 0; s < 3; s++ )
         {
-            /* Take byte from frontMatter, main message or backMatter depending on where we are in transmission */
-            const uint8_t *rp = ( i < lfront ) ? &frontMsg[i] : ( i < ( lfront + lmsg ) ) ? &inputMsg[i - lfront] : &backMsg[i - ( lfront + lmsg )];
+            const uint8_t *rp = seg[s];
+            int sl = segl[s];
 
-            if ( COBS_SYNC_CHAR != *rp )
+            while ( sl )
             {
-                *wp++ = *rp;
-                seglen++;
-            }
+                /* Longest run we may take before the group code saturates */
+                int runMax = 0xff - seglen;
 
-            if ( ( COBS_SYNC_CHAR == *rp ) || ( 0xff == seglen ) )
-            {
-                *cp = seglen;
-                seglen = 1;
-                cp = wp;
+                if ( runMax > sl )
+                {
+                    runMax = sl;
+                }
 
-                if ( ( COBS_SYNC_CHAR == *rp )  || len )
+                const uint8_t *sync = memchr( rp, COBS_SYNC_CHAR, runMax );
+
+                if ( sync )
                 {
-                    wp++;
+                    /* Copy up to the sync, close the group there and open a fresh one */
+                    int run = sync - rp;
+                    memcpy( wp, rp, run );
+                    wp        += run;
+                    seglen    += run;
+                    rp        += run + 1;
+                    sl        -= run + 1;
+                    remaining -= run + 1;
+
+                    *cp = seglen;
+                    seglen = 1;
+                    cp = wp++;
+                }
+                else
+                {
+                    memcpy( wp, rp, runMax );
+                    wp        += runMax;
+                    seglen    += runMax;
+                    rp        += runMax;
+                    sl        -= runMax;
+                    remaining -= runMax;
+
+                    if ( 0xff == seglen )
+                    {
+                        *cp = seglen;
+                        seglen = 1;
+                        cp = wp;
+
+                        if ( remaining )
+                        {
+                            wp++;
+                        }
+                    }
                 }
             }
         }
@@ -116,8 +258,10 @@ void COBSPump( struct COBS *t, const uint8_t *incoming, int len,
 
 {
     const uint8_t *fp = incoming;
+    const uint8_t *efp = incoming + len;
+    const uint8_t *sync;
 
-    for ( unsigned int rlen = 0; rlen < len; rlen++, fp++ )
+    while ( fp < efp )
     {
         switch ( t->s )
         {
@@ -125,57 +269,96 @@ void COBSPump( struct COBS *t, const uint8_t *incoming, int len,
                 if ( COBS_SYNC_CHAR != *fp )
                 {
                     t->f.len = 0;
+                    t->f.sum = 0;
                     t->intervalCount = *fp;
                     t->maxCount = ( *fp == 255 );
                     t->s = COBS_RXING;
                 }
 
+                fp++;
                 break;
 
             case COBS_DRAINING:  // ---------------------------------------------------------------
-                if ( COBS_SYNC_CHAR == *fp )
+
+                /* Skip straight to the end-of-frame sync, if there is one in this buffer */
+                if ( ( sync = _findSync( fp, efp - fp ) ) )
                 {
                     t->s = COBS_IDLE;
+                    fp = sync + 1;
+                }
+                else
+                {
+                    fp = efp;
                 }
 
                 break;
 
             case COBS_RXING: // -------------------------------------------------------------------
-                t->intervalCount--;
 
-                if ( !t->intervalCount )
+                if ( t->intervalCount > 1 )
                 {
-                    if ( COBS_SYNC_CHAR == *fp )
+                    /* The current interval promises intervalCount-1 data bytes before the next
+                     * boundary...bulk copy the span of them that lies in this buffer.
+                     */
+                    int span = t->intervalCount - 1;
+
+                    if ( span > efp - fp )
                     {
-                        /* This is the end of a packet */
-                        packetRxed( &t->f, param );
-                        t->s = COBS_IDLE;
+                        span = efp - fp;
                     }
-                    else
-                    {
-                        if ( !t->maxCount )
-                        {
-                            t->f.d[t->f.len++] = COBS_SYNC_CHAR;
-                        }
 
-                        t->intervalCount = *fp;
-                        t->maxCount = ( *fp == 255 );
+                    if ( ( sync = _findSync( fp, span ) ) )
+                    {
+                        /* Illegal sync in the middle of an interval...this frame is junk */
+                        t->error++;
+                        t->s = COBS_DRAINING;
+                        fp = sync + 1;
+                        break;
                     }
-                }
-                else
-                {
-                    /* Check for frame overflow ... if it's max then error */
-                    if ( ( t->f.len > COBS_MAX_PACKET_LEN  ) || ( COBS_SYNC_CHAR == *fp ) )
+
+                    if ( t->f.len + span > COBS_MAX_PACKET_LEN )
                     {
+                        /* Frame overflow ... if it's max then error */
                         t->error++;
                         t->s = COBS_DRAINING;
+                        fp += span;
+                        break;
                     }
-                    else
+
+                    memcpy( &t->f.d[t->f.len], fp, span );
+                    t->f.sum += _byteSum( fp, span );
+                    t->f.len += span;
+                    t->intervalCount -= span;
+                    fp += span;
+
+                    if ( fp == efp )
+                    {
+                        break;
+                    }
+                }
+
+                /* Boundary byte: either end of packet or the next interval count */
+                t->intervalCount--;
+
+                if ( COBS_SYNC_CHAR == *fp )
+                {
+                    /* This is the end of a packet */
+                    packetRxed( &t->f, param );
+                    t->s = COBS_IDLE;
+                }
+                else
+                {
+                    if ( !t->maxCount )
                     {
-                        t->f.d[t->f.len++] = *fp;
+                        /* Restored syncs are zero, so the running sum doesn't move */
+                        t->f.d[t->f.len++] = COBS_SYNC_CHAR;
                     }
+
+                    t->intervalCount = *fp;
+                    t->maxCount = ( *fp == 255 );
                 }
 
+                fp++;
                 break;
         }
     }
@@ -237,6 +420,16 @@ bool COBSSimpleDecode( const uint8_t *inputEnc, int len, struct Frame *o )
 
 // ====================================================================================================
 
+const uint8_t *COBSfindSync( const uint8_t *inputEnc, int len )
+
+/* Return pointer to the next sync character in the buffer, or NULL if there isn't one */
+
+{
+    return _findSync( inputEnc, len );
+}
+
+// ====================================================================================================
+
 const uint8_t *COBSgetFrameExtent( const uint8_t *inputEnc, int len )
 
 /* Look through memory until an end of frame marker is found, or memory is exhausted. */
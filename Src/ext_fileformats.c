@@ -7,10 +7,22 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ext_fileformats.h"
+#include "flathash.h"
 
 #define HANDLE_MASK         (0xFFFFFF)   /* cachegrind cannot cope with large file handle numbers */
 
+#define COL_MAGIC           "ORBCOL1\0"  /* Leading magic of a columnar statistics file */
+#define COL_FOOTER_MAGIC    "ORBCOLFT"   /* Trailing magic, preceded by the directory */
+#define COL_MAGIC_LEN       (8)
+
+#define PDB_MAGIC           "ORBPDB1\0"  /* Leading magic of a profile database file */
+#define PDB_MAGIC_LEN       (8)
+#define PDB_HDR_LEN         (PDB_MAGIC_LEN + 8)       /* Magic plus record count and padding */
+#define PDB_REC_LEN         (32 + PDB_NAME_LEN)       /* Four 64 bit fields plus the name */
+
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
@@ -70,14 +82,18 @@ static int _calls_dst_sort_fn( const void *a, const void *b )
 // Dot support
 // ====================================================================================================
 // ====================================================================================================
-bool ext_ff_outputDot( char *dotfile, struct subcall *subcallList, struct SymbolSet *ss )
+bool ext_ff_outputDot( char *dotfile, struct subcall *subcallList, struct SymbolSet *ss, uint32_t cutPercent )
 
-/* Output call graph to dot file */
+/* Output call graph to dot file. cutPercent, when non-zero, drops aggregated edges whose
+ * call count falls below that percentage of the busiest edge, so a focused graph of just
+ * the hot paths can be produced from a full firmware's worth of call data.
+ */
 
 {
     FILE *c;
     uint32_t functionidx, dfunctionidx, fileidx;
     uint64_t cnt;
+    uint64_t hottest = 0;
     struct subcall *s;
 
     if ( !dotfile )
@@ -96,7 +112,28 @@ bool ext_ff_outputDot( char *dotfile, struct subcall *subcallList, struct Symbol
     fprintf( c, "graph calls\n{\n  overlap=true; splines=true; size=\"7.75,10.25\"; orientation=portrait; sep=0.1; nodesep=1;\n" );
 
     HASH_SORT( subcallList, _calls_src_sort_fn );
-    s = subcallList;
+
+    if ( cutPercent )
+    {
+        /* First pass; find the busiest aggregated edge to scale the threshold against */
+        s = subcallList;
+
+        while ( s )
+        {
+            functionidx  = s->srch->functionindex;
+            dfunctionidx = s->dsth->functionindex;
+            cnt = s->count;
+            s = s->hh.next;
+
+            while ( ( s ) && ( functionidx == s->srch->functionindex ) && ( dfunctionidx == s->dsth->functionindex ) )
+            {
+                cnt += s->count;
+                s = s->hh.next;
+            }
+
+            hottest = ( cnt > hottest ) ? cnt : hottest;
+        }
+    }
 
     /* Now go through and label the arrows... */
 
@@ -117,6 +154,12 @@ bool ext_ff_outputDot( char *dotfile, struct subcall *subcallList, struct Symbol
             s = s->hh.next;
         }
 
+        if ( cnt * 100 < hottest * cutPercent )
+        {
+            /* Below the interest threshold; its nodes only appear if a hot edge touches them */
+            continue;
+        }
+
         fprintf( c, "    \"\n(%s)\n%s\n\n\" -- ", SymbolFilename( ss, fileidx ), SymbolFunction( ss, functionidx ) );
         fprintf( c, "\"\n(%s)\n%s\n\n\" [label=%" PRIu64 ", weight=0.1 ];\n", SymbolFilename( ss, fileidx ), SymbolFunction( ss, dfunctionidx ), cnt );
     }
@@ -143,6 +186,7 @@ bool ext_ff_outputProfile( char *profile, char *elffile, char *deleteMaterial, b
     uint32_t prevline = NO_LINE;
     char *e = elffile;
     char *d = deleteMaterial;
+    char *tmpname;
     FILE *c;
 
     if ( !profile )
@@ -150,18 +194,72 @@ bool ext_ff_outputProfile( char *profile, char *elffile, char *deleteMaterial, b
         return false;
     }
 
-    c = fopen( profile, "w" );
+    /* Write to a scratch file and rename over the target, so a half-written profile never
+     * replaces a good one and an interim checkpoint is always safe to load */
+    tmpname = ( char * )malloc( strlen( profile ) + 5 );
+
+    if ( !tmpname )
+    {
+        return false;
+    }
+
+    sprintf( tmpname, "%s.tmp", profile );
+    c = fopen( tmpname, "w" );
+
+    if ( !c )
+    {
+        free( tmpname );
+        return false;
+    }
+
     fprintf( c, "# callgrind format\n" );
 
+    /* An interpolated-count column is only worth its space when some gap repair happened,
+     * and the simulation columns only when a microarchitectural simulation actually ran */
+    bool includeInterpolated = false;
+    bool includeSim = false;
+
+    for ( struct execEntryHash *ip = insthead; ip; ip = ip->hh.next )
+    {
+        if ( ip->icount )
+        {
+            includeInterpolated = true;
+        }
+
+        if ( ( ip->i1m ) || ( ip->bc ) )
+        {
+            includeSim = true;
+        }
+
+        if ( includeInterpolated && includeSim )
+        {
+            break;
+        }
+    }
+
+    fprintf( c, "creator: orbprofile\npositions: instr line\nevent: Inst : CPU Instructions\n" );
+
     if ( includeVisits )
     {
-        fprintf( c, "creator: orbprofile\npositions: instr line\nevent: Inst : CPU Instructions\nevent: Visits : Visits to source line\nevents: Inst Visits\n" );
+        fprintf( c, "event: Visits : Visits to source line\n" );
     }
-    else
+
+    if ( includeInterpolated )
+    {
+        fprintf( c, "event: IInst : Instructions interpolated over trace gaps\n" );
+    }
+
+    if ( includeSim )
     {
-        fprintf( c, "creator: orbprofile\npositions: instr line\nevent: Inst : CPU Instructions\nevents: Inst\n" );
+        /* Cachegrind-compatible event names, so kcachegrind presents them natively */
+        fprintf( c, "event: I1mr : L1 instruction cache misses (simulated)\n" );
+        fprintf( c, "event: Bc : Conditional branches (simulated)\n" );
+        fprintf( c, "event: Bcm : Mispredicted conditional branches (simulated)\n" );
     }
 
+    fprintf( c, "events: Inst%s%s%s\n", includeVisits ? " Visits" : "", includeInterpolated ? " IInst" : "",
+             includeSim ? " I1mr Bc Bcm" : "" );
+
     /* Samples are in time order, so we can determine the extent of time.... */
     fprintf( c, "summary: %" PRIu64 "\n", timelen );
 
@@ -226,15 +324,25 @@ bool ext_ff_outputProfile( char *profile, char *elffile, char *deleteMaterial, b
             }
         }
 
+        fprintf( c, "%" PRIu64, f->count );
+
         if ( includeVisits )
         {
-            fprintf( c, "%" PRIu64 " %" PRIu64 "\n", f->count, f->scount );
+            fprintf( c, " %" PRIu64, f->scount );
         }
-        else
+
+        if ( includeInterpolated )
         {
-            fprintf( c, "%" PRIu64 "\n", f->count );
+            fprintf( c, " %" PRIu64, f->icount );
         }
 
+        if ( includeSim )
+        {
+            fprintf( c, " %" PRIu64 " %" PRIu64 " %" PRIu64, f->i1m, f->bc, f->bcm );
+        }
+
+        fprintf( c, "\n" );
+
 
         prevline = n.line;
         prevaddr = f->addr;
@@ -279,6 +387,503 @@ bool ext_ff_outputProfile( char *profile, char *elffile, char *deleteMaterial, b
 
     fclose( c );
 
+    if ( 0 != rename( tmpname, profile ) )
+    {
+        free( tmpname );
+        return false;
+    }
+
+    free( tmpname );
+    return true;
+}
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Columnar statistics support
+// ====================================================================================================
+// ====================================================================================================
+static bool _colPut32( FILE *f, uint32_t v )
+
+/* Write 32 bit value, explicitly little endian */
+
+{
+    uint8_t b[4] = { v & 0xff, ( v >> 8 ) & 0xff, ( v >> 16 ) & 0xff, ( v >> 24 ) & 0xff };
+    return ( 1 == fwrite( b, 4, 1, f ) );
+}
+// ====================================================================================================
+static bool _colPut64( FILE *f, uint64_t v )
+
+/* Write 64 bit value, explicitly little endian */
+
+{
+    uint8_t b[8];
+
+    for ( int i = 0; i < 8; i++ )
+    {
+        b[i] = ( v >> ( 8 * i ) ) & 0xff;
+    }
+
+    return ( 1 == fwrite( b, 8, 1, f ) );
+}
+// ====================================================================================================
+bool ext_ff_columnOpen( struct colWriter *w, char *filename )
+
+/* Open columnar statistics file and write its header */
+
+{
+    memset( w, 0, sizeof( struct colWriter ) );
+    w->f = fopen( filename, "wb" );
+
+    if ( !w->f )
+    {
+        return false;
+    }
+
+    if ( 1 != fwrite( COL_MAGIC, COL_MAGIC_LEN, 1, w->f ) )
+    {
+        fclose( w->f );
+        w->f = NULL;
+        return false;
+    }
+
+    return true;
+}
+// ====================================================================================================
+bool ext_ff_columnChunk( struct colWriter *w, enum colMetric metric, const uint64_t *values, uint32_t count )
+
+/* Append one column chunk of 64 bit values for the given metric */
+
+{
+    if ( ( !w->f ) || ( !count ) )
+    {
+        return false;
+    }
+
+    if ( w->numChunks == w->dirCap )
+    {
+        w->dirCap = w->dirCap ? w->dirCap * 2 : 64;
+        w->dir = ( struct colChunkEntry * )realloc( w->dir, w->dirCap * sizeof( struct colChunkEntry ) );
+
+        if ( !w->dir )
+        {
+            return false;
+        }
+    }
+
+    struct colChunkEntry *e = &w->dir[w->numChunks];
+    e->metric   = metric;
+    e->sequence = w->sequence;
+    e->count    = count;
+    e->offset   = ftell( w->f );
+
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        if ( !_colPut64( w->f, values[i] ) )
+        {
+            return false;
+        }
+    }
+
+    w->numChunks++;
+    return true;
+}
+// ====================================================================================================
+void ext_ff_columnCheckpoint( struct colWriter *w )
+
+/* Mark the end of a checkpoint; chunks written afterwards belong to the next one. Data are
+ * flushed so a reader mapping the live file sees whole checkpoints.
+ */
+
+{
+    if ( w->f )
+    {
+        fflush( w->f );
+        w->sequence++;
+    }
+}
+// ====================================================================================================
+bool ext_ff_columnClose( struct colWriter *w )
+
+/* Write the footer directory and close the file */
+
+{
+    bool ok = true;
+
+    if ( !w->f )
+    {
+        return false;
+    }
+
+    for ( uint32_t i = 0; i < w->numChunks; i++ )
+    {
+        ok = ok && _colPut32( w->f, w->dir[i].metric );
+        ok = ok && _colPut32( w->f, w->dir[i].sequence );
+        ok = ok && _colPut32( w->f, w->dir[i].count );
+        ok = ok && _colPut32( w->f, 0 );
+        ok = ok && _colPut64( w->f, w->dir[i].offset );
+    }
+
+    ok = ok && _colPut32( w->f, w->numChunks );
+    ok = ok && ( 1 == fwrite( COL_FOOTER_MAGIC, COL_MAGIC_LEN, 1, w->f ) );
+
+    fclose( w->f );
+    free( w->dir );
+    w->f = NULL;
+    w->dir = NULL;
+    return ok;
+}
+// ====================================================================================================
+// ====================================================================================================
+// Accumulating profile database support
+// ====================================================================================================
+// ====================================================================================================
+static uint64_t _pdbHash( const uint8_t *d, size_t len, uint64_t h )
+
+/* FNV-1a, continuable by feeding the previous result back in as h */
+
+{
+    while ( len-- )
+    {
+        h = ( h ^ *d++ ) * 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+#define PDB_HASH_INIT (0xcbf29ce484222325ULL)
+// ====================================================================================================
+static uint64_t _pdbGet64( const uint8_t *b )
+
+/* Read 64 bit value, explicitly little endian */
+
+{
+    uint64_t v = 0;
+
+    for ( int i = 7; i >= 0; i-- )
+    {
+        v = ( v << 8 ) | b[i];
+    }
+
+    return v;
+}
+// ====================================================================================================
+static void _pdbEncodeRec( const struct pdbRecord *r, uint8_t *b )
+
+{
+    for ( int i = 0; i < 8; i++ )
+    {
+        b[i]      = ( r->buildId >> ( 8 * i ) ) & 0xff;
+        b[8 + i]  = ( r->fnHash  >> ( 8 * i ) ) & 0xff;
+        b[16 + i] = ( r->samples >> ( 8 * i ) ) & 0xff;
+        b[24 + i] = ( r->runs    >> ( 8 * i ) ) & 0xff;
+    }
+
+    memcpy( &b[32], r->name, PDB_NAME_LEN );
+}
+// ====================================================================================================
+static void _pdbDecodeRec( const uint8_t *b, struct pdbRecord *r )
+
+{
+    r->buildId = _pdbGet64( &b[0] );
+    r->fnHash  = _pdbGet64( &b[8] );
+    r->samples = _pdbGet64( &b[16] );
+    r->runs    = _pdbGet64( &b[24] );
+    memcpy( r->name, &b[32], PDB_NAME_LEN );
+    r->name[PDB_NAME_LEN - 1] = 0;
+}
+// ====================================================================================================
+static int _pdb_sort_fn( const void *a, const void *b )
+
+/* Order records by build identity, then by function hash within a build */
+
+{
+    const struct pdbRecord *ra = ( const struct pdbRecord * )a;
+    const struct pdbRecord *rb = ( const struct pdbRecord * )b;
+
+    if ( ra->buildId != rb->buildId )
+    {
+        return ( ra->buildId > rb->buildId ) ? 1 : -1;
+    }
+
+    if ( ra->fnHash != rb->fnHash )
+    {
+        return ( ra->fnHash > rb->fnHash ) ? 1 : -1;
+    }
+
+    return 0;
+}
+// ====================================================================================================
+static bool _pdbWriteAll( char *dbfile, const struct pdbRecord *recs, uint32_t count )
+
+/* Rewrite the whole database via a scratch file, so a broken run never corrupts it */
+
+{
+    uint8_t b[PDB_REC_LEN];
+    char *tmpname = ( char * )malloc( strlen( dbfile ) + 5 );
+
+    if ( !tmpname )
+    {
+        return false;
+    }
+
+    sprintf( tmpname, "%s.tmp", dbfile );
+    FILE *f = fopen( tmpname, "wb" );
+
+    if ( !f )
+    {
+        free( tmpname );
+        return false;
+    }
+
+    bool ok = ( 1 == fwrite( PDB_MAGIC, PDB_MAGIC_LEN, 1, f ) );
+    ok = ok && _colPut32( f, count );
+    ok = ok && _colPut32( f, 0 );
+
+    for ( uint32_t i = 0; ok && ( i < count ); i++ )
+    {
+        _pdbEncodeRec( &recs[i], b );
+        ok = ( 1 == fwrite( b, PDB_REC_LEN, 1, f ) );
+    }
+
+    fclose( f );
+    ok = ok && ( 0 == rename( tmpname, dbfile ) );
+    free( tmpname );
+    return ok;
+}
+// ====================================================================================================
+uint64_t ext_ff_profileDbBuildId( char *elffile )
+
+/* Content identity of an ELF image, for keying profile database records; 0 on failure */
+
+{
+    uint8_t b[16384];
+    size_t l;
+    uint64_t h = PDB_HASH_INIT;
+    FILE *f = fopen( elffile, "rb" );
+
+    if ( !f )
+    {
+        return 0;
+    }
+
+    while ( ( l = fread( b, 1, sizeof( b ), f ) ) > 0 )
+    {
+        h = _pdbHash( b, l, h );
+    }
+
+    fclose( f );
+    return h ? h : 1;
+}
+// ====================================================================================================
+bool ext_ff_profileDbRead( char *dbfile, struct pdbRecord **recs, uint32_t *count )
+
+/* Load every record of a profile database; *recs is malloced, count is 0 if there's no file yet */
+
+{
+    uint8_t b[PDB_REC_LEN];
+
+    *recs = NULL;
+    *count = 0;
+
+    FILE *f = fopen( dbfile, "rb" );
+
+    if ( !f )
+    {
+        /* Not existing yet is a legitimate state of an accumulating store */
+        return true;
+    }
+
+    if ( ( 1 != fread( b, PDB_HDR_LEN, 1, f ) ) || ( memcmp( b, PDB_MAGIC, PDB_MAGIC_LEN ) ) )
+    {
+        fclose( f );
+        return false;
+    }
+
+    uint32_t c = b[8] | ( b[9] << 8 ) | ( b[10] << 16 ) | ( ( uint32_t )b[11] << 24 );
+
+    if ( c )
+    {
+        *recs = ( struct pdbRecord * )malloc( c * sizeof( struct pdbRecord ) );
+
+        if ( !*recs )
+        {
+            fclose( f );
+            return false;
+        }
+
+        for ( uint32_t i = 0; i < c; i++ )
+        {
+            if ( 1 != fread( b, PDB_REC_LEN, 1, f ) )
+            {
+                free( *recs );
+                *recs = NULL;
+                fclose( f );
+                return false;
+            }
+
+            _pdbDecodeRec( b, &( *recs )[i] );
+        }
+    }
+
+    *count = c;
+    fclose( f );
     return true;
 }
 // ====================================================================================================
+bool ext_ff_profileDbMerge( char *dbfile, uint64_t buildId, struct execEntryHash *insthead, struct SymbolSet *ss )
+
+/* Merge function-level totals for one run into the database. Records for functions the database
+ * already knows are patched in place, so the steady-state nightly case costs one small write per
+ * function touched; only a run which introduces new functions rewrites the store.
+ */
+
+{
+    struct flatHash agg;
+    struct pdbRecord *touched = NULL;
+    uint32_t numTouched = 0;
+    uint32_t touchedCap = 0;
+
+    if ( ( !dbfile ) || ( !buildId ) )
+    {
+        return false;
+    }
+
+    /* Fold the per-instruction entries down to per-function totals */
+    flathashInit( &agg );
+
+    for ( struct execEntryHash *e = insthead; e; e = e->hh.next )
+    {
+        void **slot = flathashEntry( &agg, e->functionindex );
+
+        if ( !slot )
+        {
+            free( touched );
+            flathashDelete( &agg );
+            return false;
+        }
+
+        if ( !*slot )
+        {
+            if ( numTouched == touchedCap )
+            {
+                touchedCap = touchedCap ? touchedCap * 2 : 256;
+                struct pdbRecord *nt = ( struct pdbRecord * )realloc( touched, touchedCap * sizeof( struct pdbRecord ) );
+
+                if ( !nt )
+                {
+                    free( touched );
+                    flathashDelete( &agg );
+                    return false;
+                }
+
+                touched = nt;
+            }
+
+            struct pdbRecord *t = &touched[numTouched];
+            memset( t, 0, sizeof( struct pdbRecord ) );
+            t->buildId = buildId;
+            strncpy( t->name, SymbolFunction( ss, e->functionindex ), PDB_NAME_LEN - 1 );
+            t->fnHash = _pdbHash( ( const uint8_t * )t->name, strlen( t->name ), PDB_HASH_INIT );
+            t->runs = 1;
+
+            /* The table can't hold index zero as a value, so offset by one */
+            *slot = ( void * )( uintptr_t )( ++numTouched );
+        }
+
+        touched[( uintptr_t )( *slot ) - 1].samples += e->count;
+    }
+
+    flathashDelete( &agg );
+
+    if ( !numTouched )
+    {
+        return true;
+    }
+
+    struct pdbRecord *recs;
+    uint32_t count;
+
+    if ( !ext_ff_profileDbRead( dbfile, &recs, &count ) )
+    {
+        free( touched );
+        return false;
+    }
+
+    /* Fold this run into matching records; anything left over is new to the store */
+    uint32_t numNew = 0;
+    uint32_t *hit = ( uint32_t * )malloc( numTouched * sizeof( uint32_t ) );
+
+    if ( !hit )
+    {
+        free( touched );
+        free( recs );
+        return false;
+    }
+
+    for ( uint32_t i = 0; i < numTouched; i++ )
+    {
+        struct pdbRecord *m = count ? ( struct pdbRecord * )bsearch( &touched[i], recs, count,
+                                      sizeof( struct pdbRecord ), _pdb_sort_fn ) : NULL;
+
+        if ( m )
+        {
+            m->samples += touched[i].samples;
+            m->runs++;
+            hit[i] = ( uint32_t )( m - recs );
+        }
+        else
+        {
+            hit[i] = count + numNew++;
+        }
+    }
+
+    bool ok;
+
+    if ( !numNew )
+    {
+        /* Every function is already on file, so patch just those records in place */
+        uint8_t b[PDB_REC_LEN];
+        FILE *f = fopen( dbfile, "r+b" );
+        ok = ( NULL != f );
+
+        for ( uint32_t i = 0; ok && ( i < numTouched ); i++ )
+        {
+            _pdbEncodeRec( &recs[hit[i]], b );
+            ok = ( 0 == fseek( f, PDB_HDR_LEN + ( long )hit[i] * PDB_REC_LEN, SEEK_SET ) ) &&
+                 ( 1 == fwrite( b, PDB_REC_LEN, 1, f ) );
+        }
+
+        if ( f )
+        {
+            fclose( f );
+        }
+    }
+    else
+    {
+        /* New functions arrived, so extend, re-sort and rewrite the whole store */
+        struct pdbRecord *nr = ( struct pdbRecord * )realloc( recs, ( count + numNew ) * sizeof( struct pdbRecord ) );
+        ok = ( NULL != nr );
+
+        if ( ok )
+        {
+            recs = nr;
+
+            for ( uint32_t i = 0; i < numTouched; i++ )
+            {
+                if ( hit[i] >= count )
+                {
+                    recs[hit[i]] = touched[i];
+                }
+            }
+
+            qsort( recs, count + numNew, sizeof( struct pdbRecord ), _pdb_sort_fn );
+            ok = _pdbWriteAll( dbfile, recs, count + numNew );
+        }
+    }
+
+    free( hit );
+    free( touched );
+    free( recs );
+    return ok;
+}
+// ====================================================================================================
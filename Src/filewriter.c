@@ -11,6 +11,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include "itmDecoder.h"
 #include "generics.h"
@@ -21,6 +24,24 @@ enum fwState { FW_STATE_CLOSED, FW_STATE_GETNAMEA, FW_STATE_GETNAMEE, FW_STATE_U
 #define MAX_FILENAMELEN 1024
 #define MAX_STRLEN 4096
 #define MAX_CONCAT_FILENAMELEN (MAX_STRLEN)
+#define FW_FLUSHBUFFSIZE (65536)            /* Initial size of each flush buffer */
+
+#define FW_JOURNAL_NAME ".fwjournal"        /* State journal kept alongside the written files */
+#define FW_JOURNAL_MAGIC (0x31574a46)       /* "FJW1", also serves as a layout version */
+
+/* Persistent record of one descriptor, updated in place in the mapped journal */
+struct fwJournalEntry
+{
+    uint32_t open;                          /* Non-zero while this descriptor has a file open */
+    uint64_t offset;                        /* Bytes known to have reached the disk */
+    char     name[MAX_CONCAT_FILENAMELEN];  /* Resolved name of the file being written */
+};
+
+struct fwJournal
+{
+    uint32_t magic;                         /* Identifies a valid journal of this layout */
+    struct fwJournalEntry e[FW_MAX_FILES];
+};
 
 static struct
 {
@@ -29,10 +50,28 @@ static struct
         enum fwState s;                     /* Current state of the handle */
         FILE        *f;                     /* Handle for the handle */
         char         name[MAX_FILENAMELEN]; /* Filename */
+
+        /* Double write buffers; the decode side fills one while the flush thread drains the other */
+        struct fwBuffer
+        {
+            uint8_t     *d;                 /* Data awaiting write */
+            uint32_t     len;               /* Amount of data in the buffer */
+            uint32_t     size;              /* Allocated size of the buffer */
+        } b[2];
+        uint8_t      fill;                  /* Which buffer the decode side is filling */
+        bool         closeReq;              /* Close this file once its buffers are drained */
     } file[FW_MAX_FILES];
 
     char            *basedir;     /* Where we are going to put everything */
     bool             initialised; /* Have we been initialised? */
+
+    struct fwJournal *j;          /* Mapped state journal, or NULL if it couldn't be created */
+
+    /* Flush thread materials */
+    pthread_t        flushThread; /* Thread performing the actual disk writes */
+    pthread_mutex_t  lock;        /* Protects the buffers and file states */
+    pthread_cond_t   dataPending; /* Signalled when there is work for the flush thread */
+    pthread_cond_t   drained;     /* Signalled each time the flush thread empties a buffer */
 } _f;
 
 // ====================================================================================================
@@ -42,12 +81,258 @@ static struct
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
+static void _journalOpenFile( uint32_t n, const char *name, uint64_t offset )
+
+/* Checkpoint that this descriptor now has a file open at the given offset */
+
+{
+    if ( !_f.j )
+    {
+        return;
+    }
+
+    strncpy( _f.j->e[n].name, name, MAX_CONCAT_FILENAMELEN - 1 );
+    _f.j->e[n].offset = offset;
+    _f.j->e[n].open = 1;
+    msync( _f.j, sizeof( struct fwJournal ), MS_SYNC );
+}
+// ====================================================================================================
+static void _journalCloseFile( uint32_t n )
+
+/* Checkpoint that this descriptor no longer has a file open */
+
+{
+    if ( !_f.j )
+    {
+        return;
+    }
+
+    _f.j->e[n].open = 0;
+    msync( _f.j, sizeof( struct fwJournal ), MS_SYNC );
+}
+// ====================================================================================================
+static void _journalAdvance( uint32_t n, uint64_t len )
+
+/* Checkpoint more bytes having reached the disk for this descriptor */
+
+{
+    if ( !_f.j )
+    {
+        return;
+    }
+
+    _f.j->e[n].offset += len;
+    msync( _f.j, sizeof( struct fwJournal ), MS_ASYNC );
+}
+// ====================================================================================================
+static void _journalAttach( void )
+
+/* Map the state journal, creating it if it doesn't already exist */
+
+{
+    char journalName[MAX_CONCAT_FILENAMELEN];
+
+    snprintf( journalName, MAX_CONCAT_FILENAMELEN, "%s/%s", _f.basedir ? _f.basedir : ".", FW_JOURNAL_NAME );
+
+    int fd = open( journalName, O_RDWR | O_CREAT, 0644 );
+
+    if ( ( fd < 0 ) || ( ftruncate( fd, sizeof( struct fwJournal ) ) < 0 ) )
+    {
+        genericsReport( V_WARN, "Couldn't create filewriter journal [%s], running without one" EOL, journalName );
+
+        if ( fd >= 0 )
+        {
+            close( fd );
+        }
+
+        return;
+    }
+
+    _f.j = ( struct fwJournal * )mmap( NULL, sizeof( struct fwJournal ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+
+    if ( _f.j == MAP_FAILED )
+    {
+        genericsReport( V_WARN, "Couldn't map filewriter journal [%s], running without one" EOL, journalName );
+        _f.j = NULL;
+    }
+}
+// ====================================================================================================
+static void _journalRecover( void )
+
+/* Re-open any files a previous instance left mid-transfer, at their checkpointed offsets */
+
+{
+    if ( ( !_f.j ) || ( _f.j->magic != FW_JOURNAL_MAGIC ) )
+    {
+        /* Nothing usable from before; start a fresh journal */
+        if ( _f.j )
+        {
+            memset( _f.j, 0, sizeof( struct fwJournal ) );
+            _f.j->magic = FW_JOURNAL_MAGIC;
+            msync( _f.j, sizeof( struct fwJournal ), MS_SYNC );
+        }
+
+        return;
+    }
+
+    for ( uint32_t n = 0; n < FW_MAX_FILES; n++ )
+    {
+        if ( !_f.j->e[n].open )
+        {
+            continue;
+        }
+
+        _f.j->e[n].name[MAX_CONCAT_FILENAMELEN - 1] = 0;
+        FILE *f = fopen( _f.j->e[n].name, "rb+" );
+
+        if ( !f )
+        {
+            genericsReport( V_WARN, "Journal names [%s] on descriptor %d but it can't be re-opened" EOL, _f.j->e[n].name, n );
+            _journalCloseFile( n );
+            continue;
+        }
+
+        /* Anything beyond the last checkpoint may be a torn write, so cut back to it */
+        if ( ( ftruncate( fileno( f ), _f.j->e[n].offset ) < 0 ) ||
+                ( fseek( f, _f.j->e[n].offset, SEEK_SET ) < 0 ) )
+        {
+            genericsReport( V_WARN, "Couldn't restore [%s] to its checkpoint" EOL, _f.j->e[n].name );
+            fclose( f );
+            _journalCloseFile( n );
+            continue;
+        }
+
+        genericsReport( V_INFO, "Resuming [%s] on descriptor %d at offset %lu" EOL, _f.j->e[n].name, n, ( unsigned long )_f.j->e[n].offset );
+        strncpy( _f.file[n].name, _f.j->e[n].name, MAX_FILENAMELEN - 1 );
+        _f.file[n].f = f;
+        _f.file[n].s = FW_STATE_OPEN;
+    }
+}
+// ====================================================================================================
+static void *_flushThread( void *arg )
+
+/* Drain pending write buffers to disk, away from the decode thread */
+
+{
+    ( void )arg;
+
+    pthread_mutex_lock( &_f.lock );
+
+    for ( ;; )
+    {
+        int32_t n = -1;
+
+        for ( int32_t i = 0; i < FW_MAX_FILES; i++ )
+        {
+            if ( ( _f.file[i].b[_f.file[i].fill].len ) || ( _f.file[i].closeReq ) )
+            {
+                n = i;
+                break;
+            }
+        }
+
+        if ( n < 0 )
+        {
+            pthread_cond_wait( &_f.dataPending, &_f.lock );
+            continue;
+        }
+
+        /* Swap the buffers over; the decode side carries straight on into the fresh one */
+        struct fwBuffer *drain = &_f.file[n].b[_f.file[n].fill];
+        _f.file[n].fill ^= 1;
+
+        FILE *f = _f.file[n].f;
+        bool doClose = _f.file[n].closeReq;
+
+        if ( doClose )
+        {
+            _f.file[n].closeReq = false;
+            _f.file[n].f = NULL;
+        }
+
+        pthread_mutex_unlock( &_f.lock );
+
+        /* Perform the disk work with the lock dropped, as one coalesced write */
+        if ( ( f ) && ( drain->len ) )
+        {
+            size_t done = fwrite( drain->d, 1, drain->len, f );
+            fflush( f );
+            _journalAdvance( n, done );
+        }
+
+        if ( ( f ) && ( doClose ) )
+        {
+            fclose( f );
+            _journalCloseFile( n );
+        }
+
+        pthread_mutex_lock( &_f.lock );
+        drain->len = 0;
+        pthread_cond_broadcast( &_f.drained );
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+static void _queueWrite( uint32_t n, const uint8_t *d, uint32_t len )
+
+/* Hand bytes over to the flush thread; the decode path only ever copies into memory */
+
+{
+    pthread_mutex_lock( &_f.lock );
+
+    struct fwBuffer *b = &_f.file[n].b[_f.file[n].fill];
+
+    if ( b->len + len > b->size )
+    {
+        b->size = b->size ? b->size * 2 : FW_FLUSHBUFFSIZE;
+        b->d = ( uint8_t * )realloc( b->d, b->size );
+        MEMCHECKV( b->d );
+    }
+
+    memcpy( &b->d[b->len], d, len );
+    b->len += len;
+
+    pthread_cond_signal( &_f.dataPending );
+    pthread_mutex_unlock( &_f.lock );
+}
+// ====================================================================================================
+static void _requestClose( uint32_t n )
+
+/* Ask the flush thread to close this file once anything outstanding has been written */
+
+{
+    pthread_mutex_lock( &_f.lock );
+    _f.file[n].closeReq = true;
+    _f.file[n].s = FW_STATE_CLOSED;
+    memset( _f.file[n].name, 0, MAX_FILENAMELEN );
+    pthread_cond_signal( &_f.dataPending );
+    pthread_mutex_unlock( &_f.lock );
+}
+// ====================================================================================================
+static void _waitDrained( uint32_t n )
+
+/* Wait for any outstanding write or close on this descriptor to complete */
+
+{
+    pthread_mutex_lock( &_f.lock );
+
+    while ( ( _f.file[n].closeReq ) || ( _f.file[n].b[0].len ) || ( _f.file[n].b[1].len ) )
+    {
+        pthread_cond_wait( &_f.drained, &_f.lock );
+    }
+
+    pthread_mutex_unlock( &_f.lock );
+}
+// ====================================================================================================
 void _processCompleteName( uint32_t n )
 
 /* We got the whole name from the remote end, so process it */
 
 {
     char workingName[MAX_CONCAT_FILENAMELEN] = { 0 };
+    char dirName[MAX_CONCAT_FILENAMELEN];
     char *resolvedName;
     char *compareName;
 
@@ -66,7 +351,10 @@ void _processCompleteName( uint32_t n )
     /* Make sure we haven't broken out of the current directory          */
     /* Start by getting both the real path of the requested file and the */
     /* real path of the current directory.                               */
-    resolvedName = realpath( dirname( workingName ), NULL );
+    /* dirname modifies its argument, so give it a scratch copy to chew on */
+    strncpy( dirName, workingName, MAX_CONCAT_FILENAMELEN - 1 );
+    dirName[MAX_CONCAT_FILENAMELEN - 1] = 0;
+    resolvedName = realpath( dirname( dirName ), NULL );
 
     if ( _f.basedir )
     {
@@ -101,6 +389,8 @@ void _processCompleteName( uint32_t n )
             {
                 genericsReport( V_INFO, "File [%s] opened for append" EOL, workingName, n );
                 _f.file[n].s = FW_STATE_OPEN;
+                fseek( _f.file[n].f, 0, SEEK_END );
+                _journalOpenFile( n, workingName, ftell( _f.file[n].f ) );
             }
             else
             {
@@ -119,6 +409,7 @@ void _processCompleteName( uint32_t n )
             {
                 genericsReport( V_INFO, "File [%s] opened for write" EOL, workingName, n );
                 _f.file[n].s = FW_STATE_OPEN;
+                _journalOpenFile( n, workingName, 0 );
             }
             else
             {
@@ -206,16 +497,17 @@ bool filewriterProcess( struct swMsg *m )
         case FW_CMD_OPENE:     // Open file for empty write (i.e. flush and write)
             genericsReport( V_DEBUG, "Attempt to open or create file" EOL );
 
-            if ( _f.file[FW_GET_FILEID( c )].f )
+            if ( ( _f.file[FW_GET_FILEID( c )].f ) && ( !_f.file[FW_GET_FILEID( c )].closeReq ) )
             {
-                /* There was a file open, close it */
+                /* There was a file open, get it closed */
                 genericsReport( V_WARN, "Attempt to write to descriptor %d while open writing %s" EOL, FW_GET_FILEID( c ),
                                 _f.file[FW_GET_FILEID( c )].name );
-                fclose( _f.file[FW_GET_FILEID( c )].f );
-                _f.file[FW_GET_FILEID( c )].f = NULL;
-                _f.file[FW_GET_FILEID( c )].f = NULL;
+                _requestClose( FW_GET_FILEID( c ) );
             }
 
+            /* Make sure nothing is still in flight before the descriptor is re-used */
+            _waitDrained( FW_GET_FILEID( c ) );
+
             memset( _f.file[FW_GET_FILEID( c )].name, 0, MAX_FILENAMELEN );
 
             /* Start collecting the name */
@@ -234,7 +526,7 @@ bool filewriterProcess( struct swMsg *m )
         // -----------------------
 
         case FW_CMD_CLOSE:     // Close file
-            if ( !_f.file[FW_GET_FILEID( c )].f )
+            if ( ( !_f.file[FW_GET_FILEID( c )].f ) || ( _f.file[FW_GET_FILEID( c )].closeReq ) )
             {
                 /* There was no file open, complain */
                 genericsReport( V_DEBUG, "Attempt to close descriptor %d while not open" EOL, FW_GET_FILEID( c ) );
@@ -242,10 +534,9 @@ bool filewriterProcess( struct swMsg *m )
             else
             {
                 genericsReport( V_INFO, "Close %s" EOL,  _f.file[FW_GET_FILEID( c )].name );
-                fclose( _f.file[FW_GET_FILEID( c )].f );
-                _f.file[FW_GET_FILEID( c )].f = NULL;
-                memset( _f.file[FW_GET_FILEID( c )].name, 0, MAX_FILENAMELEN );
-                _f.file[FW_GET_FILEID( c )].s = FW_STATE_CLOSED;
+
+                /* The flush thread performs the close once anything outstanding has hit the disk */
+                _requestClose( FW_GET_FILEID( c ) );
             }
 
             break;
@@ -281,8 +572,8 @@ bool filewriterProcess( struct swMsg *m )
                 }
                 else
                 {
-                    genericsReport( V_DEBUG, "Wrote %d bytes on descriptor %d" EOL, FW_GET_BYTES( c ), FW_GET_FILEID( c ) );
-                    fwrite( &d[1], 1, FW_GET_BYTES( c ), _f.file[FW_GET_FILEID( c )].f );
+                    genericsReport( V_DEBUG, "Buffered %d bytes on descriptor %d" EOL, FW_GET_BYTES( c ), FW_GET_FILEID( c ) );
+                    _queueWrite( FW_GET_FILEID( c ), &d[1], FW_GET_BYTES( c ) );
                 }
             }
 
@@ -303,8 +594,22 @@ bool filewriterInit( char *basedir )
 /* Initialise the filewriter */
 
 {
-    _f.initialised = true;
     _f.basedir     = basedir;
+
+    _journalAttach();
+    _journalRecover();
+
+    pthread_mutex_init( &_f.lock, NULL );
+    pthread_cond_init( &_f.dataPending, NULL );
+    pthread_cond_init( &_f.drained, NULL );
+
+    if ( pthread_create( &_f.flushThread, NULL, &_flushThread, NULL ) )
+    {
+        genericsReport( V_ERROR, "Failed to create filewriter flush thread" EOL );
+        return false;
+    }
+
+    _f.initialised = true;
     genericsReport( V_DEBUG, "Filewriter initialised" EOL );
     return true;
 }
@@ -10,6 +10,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <inttypes.h>
 #include <sys/time.h>
 
 #ifdef WIN32
@@ -19,6 +23,12 @@
     #include <unistd.h>
 #endif
 
+#if defined( __SSE2__ )
+    #include <emmintrin.h>
+#elif defined( __ARM_NEON )
+    #include <arm_neon.h>
+#endif
+
 #include "generics.h"
 
 #if defined(WIN32)
@@ -27,6 +37,31 @@
 
 #define MAX_STRLEN (_POSIX_ARG_MAX) // Maximum length of debug string
 
+/* Async report sink; slots are claimed by CAS so any thread can log, and a writer thread
+ * performs the terminal output. Only V_INFO and below go async; errors and warnings are
+ * rare and must survive a crash, so they stay synchronous.
+ */
+#define LOG_RING_ENTRIES (256)              // Must be a power of two
+#define LOG_RING_MASK (LOG_RING_ENTRIES - 1)
+#define LOG_MSG_MAX (256)
+
+struct logEntry
+{
+    atomic_bool ready;                      /* Set once the message text is complete */
+    enum verbLevel l;
+    char msg[LOG_MSG_MAX];
+};
+
+static struct logEntry _logRing[LOG_RING_ENTRIES];
+static atomic_uint_fast64_t _logWp;         /* Claimed slots (any thread) */
+static atomic_uint_fast64_t _logRp;         /* Retired slots (writer thread only) */
+static atomic_uint_fast64_t _logDropped;    /* Messages shed because the ring was full */
+static pthread_t _logThread;
+static pthread_mutex_t _logMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _logUpdated = PTHREAD_COND_INITIALIZER;
+static volatile bool _logAsync;
+static volatile bool _logExit;
+
 /* Flag indicating if active screen handling is in use */
 bool _screenHandling;
 
@@ -163,6 +198,117 @@ char *genericsUnescape( char *str )
     return workingBuffer;
 }
 // ====================================================================================================
+void genericsHexBytes( char *dst, const uint8_t *src, size_t len, bool upper )
+
+/* Render len bytes as 2*len hex digits, without a terminator. Wide paths convert a
+ * 16 byte lane per iteration; the scalar tail uses a digit table, so no printf
+ * machinery is involved at any length.
+ */
+
+{
+    static const char digitsL[] = "0123456789abcdef";
+    static const char digitsU[] = "0123456789ABCDEF";
+    const char *digits = upper ? digitsU : digitsL;
+
+#if defined( __SSE2__ )
+    const __m128i nine   = _mm_set1_epi8( 9 );
+    const __m128i zero   = _mm_set1_epi8( '0' );
+    const __m128i alpha  = _mm_set1_epi8( ( upper ? 'A' : 'a' ) - '0' - 10 );
+    const __m128i lowNib = _mm_set1_epi8( 0x0f );
+
+    while ( len >= 16 )
+    {
+        __m128i v  = _mm_loadu_si128( ( const __m128i * )src );
+        __m128i hi = _mm_and_si128( _mm_srli_epi16( v, 4 ), lowNib );
+        __m128i lo = _mm_and_si128( v, lowNib );
+
+        /* nibble -> character: '0' base, shifted into the letter range above 9 */
+        hi = _mm_add_epi8( _mm_add_epi8( hi, zero ), _mm_and_si128( _mm_cmpgt_epi8( hi, nine ), alpha ) );
+        lo = _mm_add_epi8( _mm_add_epi8( lo, zero ), _mm_and_si128( _mm_cmpgt_epi8( lo, nine ), alpha ) );
+
+        _mm_storeu_si128( ( __m128i * )dst, _mm_unpacklo_epi8( hi, lo ) );
+        _mm_storeu_si128( ( __m128i * )( dst + 16 ), _mm_unpackhi_epi8( hi, lo ) );
+        src += 16;
+        dst += 32;
+        len -= 16;
+    }
+
+#elif defined( __ARM_NEON )
+    const uint8x16_t nine  = vdupq_n_u8( 9 );
+    const uint8x16_t zero  = vdupq_n_u8( '0' );
+    const uint8x16_t alpha = vdupq_n_u8( ( upper ? 'A' : 'a' ) - '0' - 10 );
+
+    while ( len >= 16 )
+    {
+        uint8x16_t v  = vld1q_u8( src );
+        uint8x16_t hi = vshrq_n_u8( v, 4 );
+        uint8x16_t lo = vandq_u8( v, vdupq_n_u8( 0x0f ) );
+
+        hi = vaddq_u8( vaddq_u8( hi, zero ), vandq_u8( vcgtq_u8( hi, nine ), alpha ) );
+        lo = vaddq_u8( vaddq_u8( lo, zero ), vandq_u8( vcgtq_u8( lo, nine ), alpha ) );
+
+        uint8x16x2_t out = { { hi, lo } };
+        vst2q_u8( ( uint8_t * )dst, out );
+        src += 16;
+        dst += 32;
+        len -= 16;
+    }
+
+#endif
+
+    while ( len-- )
+    {
+        *dst++ = digits[*src >> 4];
+        *dst++ = digits[*src++ & 0x0f];
+    }
+}
+// ====================================================================================================
+void genericsPrintable( char *dst, const uint8_t *src, size_t len )
+
+/* Copy len bytes with everything outside printable ASCII replaced by '.', a 16 byte
+ * lane at a time where the target allows. Handy for pushing received data at a
+ * terminal or curses window without control codes wrecking the display.
+ */
+
+{
+#if defined( __SSE2__ )
+    const __m128i spaceM1 = _mm_set1_epi8( 0x1f );
+    const __m128i del     = _mm_set1_epi8( 0x7f );
+    const __m128i dot     = _mm_set1_epi8( '.' );
+
+    while ( len >= 16 )
+    {
+        __m128i v = _mm_loadu_si128( ( const __m128i * )src );
+
+        /* Signed compares; bytes >= 0x80 are negative so they fail the lower bound */
+        __m128i ok = _mm_and_si128( _mm_cmpgt_epi8( v, spaceM1 ), _mm_cmplt_epi8( v, del ) );
+        _mm_storeu_si128( ( __m128i * )dst, _mm_or_si128( _mm_and_si128( ok, v ), _mm_andnot_si128( ok, dot ) ) );
+        src += 16;
+        dst += 16;
+        len -= 16;
+    }
+
+#elif defined( __ARM_NEON )
+
+    while ( len >= 16 )
+    {
+        uint8x16_t v = vld1q_u8( src );
+        uint8x16_t ok = vandq_u8( vcgtq_u8( v, vdupq_n_u8( 0x1f ) ), vcltq_u8( v, vdupq_n_u8( 0x7f ) ) );
+        vst1q_u8( ( uint8_t * )dst, vbslq_u8( ok, v, vdupq_n_u8( '.' ) ) );
+        src += 16;
+        dst += 16;
+        len -= 16;
+    }
+
+#endif
+
+    while ( len-- )
+    {
+        uint8_t c = *src++;
+        *dst++ = ( ( c >= 0x20 ) && ( c < 0x7f ) ) ? ( char )c : '.';
+    }
+}
+// ====================================================================================================
 static enum verbLevel lstore = V_WARN;
 
 bool genericsSetReportLevel( enum verbLevel lset )
@@ -391,6 +537,24 @@ void genericsFPrintf( FILE *stream, const char *fmt, ... )
                     p++;
                     break;
 
+                case 'H':
+                    if ( _screenHandling )
+                    {
+                        fprintf( stream, CC_HOME );
+                    }
+
+                    p++;
+                    break;
+
+                case 'J':
+                    if ( _screenHandling )
+                    {
+                        fprintf( stream, CC_CLR_EOS );
+                    }
+
+                    p++;
+                    break;
+
                 case 'r':
                     if ( _screenHandling )
                     {
@@ -415,26 +579,146 @@ void genericsFPrintf( FILE *stream, const char *fmt, ... )
     fflush( stream );
 }
 // ====================================================================================================
+static void _reportOut( enum verbLevel l, const char *msg )
+
+/* Deliver one report message to the terminal */
+
+{
+    static char *colours[V_MAX_VERBLEVEL] = {C_VERB_ERROR, C_VERB_WARN, C_VERB_INFO, C_VERB_DEBUG};
+
+    fflush( stdout );
+    genericsFPrintf( stderr, colours[l] );
+    genericsFPrintf( stderr, "%s", msg );
+    genericsFPrintf( stderr, C_RESET );
+    fflush( stderr );
+}
+// ====================================================================================================
+static void *_logWorker( void *param )
+
+/* Drain the async report ring to the terminal */
+
+{
+    while ( true )
+    {
+        pthread_mutex_lock( &_logMutex );
+
+        while ( ( atomic_load( &_logRp ) == atomic_load( &_logWp ) ) && ( !_logExit ) )
+        {
+            pthread_cond_wait( &_logUpdated, &_logMutex );
+        }
+
+        pthread_mutex_unlock( &_logMutex );
+
+        uint64_t rp = atomic_load( &_logRp );
+
+        if ( rp == atomic_load( &_logWp ) )
+        {
+            /* Nothing left to drain, so this must be an exit request */
+            break;
+        }
+
+        struct logEntry *e = &_logRing[rp & LOG_RING_MASK];
+
+        if ( !atomic_load( &e->ready ) )
+        {
+            /* Slot claimed but the text isn't complete yet; give the producer a moment */
+            sched_yield();
+            continue;
+        }
+
+        _reportOut( e->l, e->msg );
+        atomic_store( &e->ready, false );
+        atomic_store( &_logRp, rp + 1 );
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+void genericsReportAsync( bool enable )
+
+/* Switch informational reporting between synchronous and ring-buffered output */
+
+{
+    if ( enable == _logAsync )
+    {
+        return;
+    }
+
+    if ( enable )
+    {
+        _logExit = false;
+
+        if ( !pthread_create( &_logThread, NULL, &_logWorker, NULL ) )
+        {
+            _logAsync = true;
+        }
+    }
+    else
+    {
+        /* Stop accepting new async messages, then let the writer drain what remains */
+        _logAsync = false;
+        _logExit = true;
+        pthread_mutex_lock( &_logMutex );
+        pthread_cond_signal( &_logUpdated );
+        pthread_mutex_unlock( &_logMutex );
+        pthread_join( _logThread, NULL );
+
+        uint64_t d = atomic_exchange( &_logDropped, 0 );
+
+        if ( d )
+        {
+            genericsReport( V_WARN, "%" PRIu64 " report messages were shed because the log writer fell behind" EOL, d );
+        }
+    }
+}
+// ====================================================================================================
+#undef genericsReport
 void genericsReport( enum verbLevel l, const char *fmt, ... )
 
 /* Debug reporting stream */
 
 {
     static char op[MAX_STRLEN];
-    static char *colours[V_MAX_VERBLEVEL] = {C_VERB_ERROR, C_VERB_WARN, C_VERB_INFO, C_VERB_DEBUG};
 
-    if ( l <= lstore )
+    if ( l > lstore )
     {
-        fflush( stdout );
-        genericsFPrintf( stderr, colours[l] );
+        return;
+    }
+
+    if ( ( _logAsync ) && ( l >= V_INFO ) )
+    {
+        /* Claim a slot; on a full ring the message is shed rather than waiting on the terminal */
+        uint64_t wp = atomic_load( &_logWp );
+
+        do
+        {
+            if ( wp - atomic_load( &_logRp ) >= LOG_RING_ENTRIES )
+            {
+                atomic_fetch_add( &_logDropped, 1 );
+                return;
+            }
+        }
+        while ( !atomic_compare_exchange_weak( &_logWp, &wp, wp + 1 ) );
+
+        struct logEntry *e = &_logRing[wp & LOG_RING_MASK];
         va_list va;
         va_start( va, fmt );
-        vsnprintf( op, MAX_STRLEN, fmt, va );
+        vsnprintf( e->msg, LOG_MSG_MAX, fmt, va );
         va_end( va );
-        genericsFPrintf( stderr, "%s", op );
-        genericsFPrintf( stderr, C_RESET );
-        fflush( stderr );
+        e->l = l;
+        atomic_store( &e->ready, true );
+
+        pthread_mutex_lock( &_logMutex );
+        pthread_cond_signal( &_logUpdated );
+        pthread_mutex_unlock( &_logMutex );
+        return;
     }
+
+    va_list va;
+    va_start( va, fmt );
+    vsnprintf( op, MAX_STRLEN, fmt, va );
+    va_end( va );
+    _reportOut( l, op );
 }
 // ====================================================================================================
 void genericsExit( int status, const char *fmt, ... )
@@ -455,9 +739,170 @@ void genericsExit( int status, const char *fmt, ... )
     exit( status );
 }
 // ====================================================================================================
+bool genericsSetThreadAffinity( int cpu )
+
+/* Pin the calling thread to the given CPU. Returns false if that isn't possible, either
+ * because the platform doesn't support it or because the CPU doesn't exist.
+ */
+
+{
+#if defined( LINUX )
+    cpu_set_t set;
+
+    if ( cpu < 0 )
+    {
+        return false;
+    }
+
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+
+    return ( 0 == pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) );
+#else
+    ( void )cpu;
+    return false;
+#endif
+}
+// ====================================================================================================
 void genericsScreenHandling( bool screenHandling )
 
 {
     _screenHandling = screenHandling;
 }
 // ====================================================================================================
+bool genericsIsScreenHandling( void )
+
+{
+    return _screenHandling;
+}
+// ====================================================================================================
+// Block swizzle kernels. GCC and Clang lower the vector-extension bodies to whatever SIMD the
+// target offers (SSE2, NEON, ...) so there are no ISA-specific paths; other compilers get the
+// scalar loops, which the bulk paths also use for their sub-vector tails.
+// ====================================================================================================
+#if defined( __GNUC__ )
+    typedef uint8_t swizzleVec __attribute__( ( vector_size( 16 ) ) );
+    #define SWIZZLE_VEC_LEN (16)
+#endif
+
+void genericsReverseBitsBlk( uint8_t *dst, const uint8_t *src, uint32_t len )
+
+/* Reverse the bit order within every byte of the block */
+
+{
+#if defined( __GNUC__ )
+
+    while ( len >= SWIZZLE_VEC_LEN )
+    {
+        swizzleVec v;
+        memcpy( &v, src, SWIZZLE_VEC_LEN );
+        v = ( v >> 4 ) | ( v << 4 );
+        v = ( ( v & 0x33 ) << 2 ) | ( ( v >> 2 ) & 0x33 );
+        v = ( ( v & 0x55 ) << 1 ) | ( ( v >> 1 ) & 0x55 );
+        memcpy( dst, &v, SWIZZLE_VEC_LEN );
+        src += SWIZZLE_VEC_LEN;
+        dst += SWIZZLE_VEC_LEN;
+        len -= SWIZZLE_VEC_LEN;
+    }
+
+#endif
+
+    while ( len-- )
+    {
+        uint8_t v = *src++;
+        v = ( v >> 4 ) | ( v << 4 );
+        v = ( ( v & 0x33 ) << 2 ) | ( ( v >> 2 ) & 0x33 );
+        v = ( ( v & 0x55 ) << 1 ) | ( ( v >> 1 ) & 0x55 );
+        *dst++ = v;
+    }
+}
+// ====================================================================================================
+void genericsSwapNibblesBlk( uint8_t *dst, const uint8_t *src, uint32_t len )
+
+/* Exchange the high and low nibbles of every byte of the block */
+
+{
+#if defined( __GNUC__ )
+
+    while ( len >= SWIZZLE_VEC_LEN )
+    {
+        swizzleVec v;
+        memcpy( &v, src, SWIZZLE_VEC_LEN );
+        v = ( v >> 4 ) | ( v << 4 );
+        memcpy( dst, &v, SWIZZLE_VEC_LEN );
+        src += SWIZZLE_VEC_LEN;
+        dst += SWIZZLE_VEC_LEN;
+        len -= SWIZZLE_VEC_LEN;
+    }
+
+#endif
+
+    while ( len-- )
+    {
+        uint8_t v = *src++;
+        *dst++ = ( v >> 4 ) | ( v << 4 );
+    }
+}
+// ====================================================================================================
+void genericsExpandMaskBlk( uint64_t mask, uint8_t *dst, uint32_t len )
+
+/* Expand bit n of the mask into byte n of the block, set bits becoming 0xff */
+
+{
+    if ( len > 64 )
+    {
+        len = 64;
+    }
+
+    for ( uint32_t i = 0; i < len; i++ )
+    {
+        *dst++ = ( mask & ( 1ULL << i ) ) ? 0xff : 0;
+    }
+}
+// ====================================================================================================
+void genericsSeqInit( struct genericsSeqLock *s )
+
+{
+    atomic_store_explicit( &s->seq, 0, memory_order_relaxed );
+}
+// ====================================================================================================
+void genericsSeqWriteBegin( struct genericsSeqLock *s )
+
+/* Open a write section; the sequence goes odd so overlapping readers know to retry */
+
+{
+    uint32_t v = atomic_load_explicit( &s->seq, memory_order_relaxed );
+    atomic_store_explicit( &s->seq, v + 1, memory_order_relaxed );
+    atomic_thread_fence( memory_order_release );
+}
+// ====================================================================================================
+void genericsSeqWriteEnd( struct genericsSeqLock *s )
+
+{
+    uint32_t v = atomic_load_explicit( &s->seq, memory_order_relaxed );
+    atomic_thread_fence( memory_order_release );
+    atomic_store_explicit( &s->seq, v + 1, memory_order_release );
+}
+// ====================================================================================================
+uint32_t genericsSeqReadBegin( const struct genericsSeqLock *s )
+
+/* Wait out any in-progress write, returning the sequence the read is based on */
+
+{
+    uint32_t v;
+
+    while ( ( v = atomic_load_explicit( &( ( struct genericsSeqLock * )s )->seq, memory_order_acquire ) ) & 1 )
+    {
+        /* Writer active...writes are short, so just go round again */
+    }
+
+    return v;
+}
+// ====================================================================================================
+bool genericsSeqReadRetry( const struct genericsSeqLock *s, uint32_t start )
+
+{
+    atomic_thread_fence( memory_order_acquire );
+    return atomic_load_explicit( &( ( struct genericsSeqLock * )s )->seq, memory_order_relaxed ) != start;
+}
+// ====================================================================================================
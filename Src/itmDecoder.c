@@ -31,6 +31,10 @@
 #define MAX_PACKET            (5)
 #define DEFAULT_PAGE_REGISTER (0x07)
 
+/* Stats counters only ever have one writer, so a relaxed load/store pair is enough and */
+/* cheaper than a full atomic increment on the decode path                              */
+#define STATS_INC(x) atomic_store_explicit( &(x), atomic_load_explicit( &(x), memory_order_relaxed ) + 1U, memory_order_relaxed )
+
 // ====================================================================================================
 struct ITMDecoder *ITMDecoderCreate( void )
 
@@ -49,10 +53,48 @@ void ITMDecoderInit( struct ITMDecoder *i, bool startSynced )
     i->pk.len = 0;
     i->contextIDlen = 0;
     i->pk.pageRegister = DEFAULT_PAGE_REGISTER;
+    i->bulkChannel = -1;
+    i->bulkLen = 0;
+    i->muxChannel = -1;
+    i->muxBase = 0;
     ITMDecoderForceSync( i, startSynced );
     ITMDecoderZeroStats( i );
 }
 // ====================================================================================================
+void ITMSetBulkChannel( struct ITMDecoder *i, int channel )
+
+/* Coalesce payload of one channel into bulk spans rather than per-packet events, -1 to disable */
+
+{
+    i->bulkChannel = channel;
+    i->bulkLen = 0;
+}
+// ====================================================================================================
+void ITMSetMuxChannel( struct ITMDecoder *i, int channel, uint8_t vcBase )
+
+/* Demultiplex one channel carrying the sub-channel mux framing; -1 to disable */
+
+{
+    i->muxChannel = channel;
+    i->muxBase = vcBase;
+}
+// ====================================================================================================
+bool ITMGetBulkSpan( struct ITMDecoder *i, const uint8_t **d, uint32_t *len )
+
+/* Collect the coalesced span announced by ITM_EV_BULK_RXED; valid only inside the callback */
+
+{
+    if ( !i->bulkLen )
+    {
+        return false;
+    }
+
+    *d = i->bulkBuffer;
+    *len = i->bulkLen;
+    i->bulkLen = 0;
+    return true;
+}
+// ====================================================================================================
 void ITMDecoderZeroStats( struct ITMDecoder *i )
 
 {
@@ -80,7 +122,7 @@ void ITMDecoderForceSync( struct ITMDecoder *i, bool isSynced )
         if ( isSynced )
         {
             i->p = ITM_IDLE;
-            i->stats.syncCount++;
+            STATS_INC( i->stats.syncCount );
             i->pk.len = 0;
         }
     }
@@ -88,7 +130,7 @@ void ITMDecoderForceSync( struct ITMDecoder *i, bool isSynced )
     {
         if ( !isSynced )
         {
-            i->stats.lostSyncCount++;
+            STATS_INC( i->stats.lostSyncCount );
             i->p = ITM_UNSYNCED;
         }
     }
@@ -105,7 +147,7 @@ bool ITMGetPacket( struct ITMDecoder *i, struct ITMPacket *p )
         return false;
     }
 
-    memcpy( p->d, &i->pk, sizeof( struct ITMPacket ) );
+    memcpy( p, &i->pk, sizeof( struct ITMPacket ) );
     return true;
 }
 // ====================================================================================================
@@ -136,12 +178,12 @@ enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c )
 
     if ( ( ( i->syncStat )&TPIU_SYNCMASK ) == TPIU_SYNCPATTERN )
     {
-        i->stats.tpiuSyncCount++;
+        STATS_INC( i->stats.tpiuSyncCount );
     }
 
     if ( ( ( i->syncStat )&SYNCMASK ) == SYNCPATTERN )
     {
-        i->stats.syncCount++;
+        STATS_INC( i->stats.syncCount );
 
         /* Page register is reset on a sync */
         i->pk.pageRegister = 0;
@@ -189,13 +231,13 @@ enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c )
                     if ( !( c & 0x04 ) )
                     {
                         /* This is a Instrumentation (SW) packet */
-                        i->stats.SWPkt++;
+                        STATS_INC( i->stats.SWPkt );
                         newState = ITM_SW;
                     }
                     else
                     {
                         /* This is a HW packet */
-                        i->stats.HWPkt++;
+                        STATS_INC( i->stats.HWPkt );
                         newState = ITM_HW;
                     }
 
@@ -209,7 +251,7 @@ enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c )
                 if ( c == 0b01110000 )
                 {
                     /* This is an overflow packet */
-                    i->stats.overflow++;
+                    STATS_INC( i->stats.overflow );
                     retVal = ITM_EV_OVERFLOW;
                     break;
                 }
@@ -220,7 +262,7 @@ enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c )
                     i->pk.len = 1; /* The '1' is deliberate. */
                     /* This is a timestamp packet */
                     i->pk.d[0] = c;
-                    i->stats.TSPkt++;
+                    STATS_INC( i->stats.TSPkt );
 
                     if ( c & 0x80 )
                     {
@@ -268,14 +310,14 @@ enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c )
                 {
                     /* Extension Packet */
                     i->pk.len = 1; /* The '1' is deliberate. */
-                    i->stats.XTNPkt++;
+                    STATS_INC( i->stats.XTNPkt );
 
                     i->pk.d[0] = c;
 
                     if ( !( c & 0x84 ) )
                     {
                         /* This is the Stimulus Port Page Register setting ... deal with it here */
-                        i->stats.PagePkt++;
+                        STATS_INC( i->stats.PagePkt );
                         i->pk.pageRegister = ( c >> 4 ) & 0x07;
                     }
                     else
@@ -294,7 +336,7 @@ enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c )
                 {
                     /* Reserved packets - we have no idea what these are */
                     i->pk.len = 1;
-                    i->stats.ReservedPkt++;
+                    STATS_INC( i->stats.ReservedPkt );
                     i->pk.d[0] = c;
 
                     if ( !( c & 0x80 ) )
@@ -319,7 +361,7 @@ enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c )
                 // *************************************************
                 /* This is a reserved encoding we don't know how to handle */
                 /* ...assume it's line noise and wait for sync again */
-                i->stats.ErrorPkt++;
+                STATS_INC( i->stats.ErrorPkt );
 #ifdef DEBUG
                 fprintf( stderr, EOL "%02X " EOL, c );
 #endif
@@ -354,6 +396,25 @@ enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c )
                     newState = ITM_IDLE;
                     i->pk.type = ITM_PT_SW;
                     retVal = ITM_EV_PACKET_RXED;
+
+                    if ( i->muxChannel == ( int )( ( i->pk.pageRegister << 5 ) | i->pk.srcAddr ) )
+                    {
+                        /* Sub-channel mux framing; the leading payload byte routes the rest
+                         * of the write, which re-emerges as a normal SW packet. A write that
+                         * is all header is a keepalive and vanishes here.
+                         */
+                        if ( i->pk.len < 2 )
+                        {
+                            retVal = ITM_EV_NONE;
+                        }
+                        else
+                        {
+                            i->pk.srcAddr = i->muxBase + i->pk.d[0];
+                            i->pk.len--;
+                            memmove( i->pk.d, &i->pk.d[1], i->pk.len );
+                            memset( &i->pk.d[i->pk.len], 0, ITM_MAX_PACKET - i->pk.len );
+                        }
+                    }
                 }
 
                 break;
@@ -438,3 +499,144 @@ enum ITMPumpEvent ITMPump( struct ITMDecoder *i, uint8_t c )
     return retVal;
 }
 // ====================================================================================================
+
+static inline uint64_t _foldSyncStat( uint64_t syncStat, const uint8_t *d, int len )
+
+/* Collapse a span of bytes into the sync shift register...only the tail of it can matter */
+
+{
+    if ( len > 8 )
+    {
+        d += len - 8;
+        len = 8;
+    }
+
+    while ( len-- )
+    {
+        syncStat = ( syncStat << 8 ) | *d++;
+    }
+
+    return syncStat;
+}
+
+// ====================================================================================================
+
+static const uint8_t *_nextSyncMark( const uint8_t *d, int len )
+
+/* Return first byte which could complete an ITM (0x80) or TPIU (0x7f) sync pattern, or NULL */
+
+{
+    const uint8_t *m1 = memchr( d, 0x80, len );
+    const uint8_t *m2 = memchr( d, 0x7f, len );
+
+    if ( !m1 )
+    {
+        return m2;
+    }
+
+    if ( !m2 )
+    {
+        return m1;
+    }
+
+    return ( m1 < m2 ) ? m1 : m2;
+}
+
+// ====================================================================================================
+
+void ITMPumpBuffer( struct ITMDecoder *i, const uint8_t *d, int len,
+                    void ( *packetEvent )( enum ITMPumpEvent e, void *param ),
+                    void *param )
+
+/* Pump a whole buffer through the protocol decoder, calling back for each non-trivial event.
+ * Equivalent to pushing the bytes through ITMPump one at a time, except that payload runs and
+ * unsynced stretches are consumed in bulk rather than a state machine pass per byte.
+ */
+
+{
+    const uint8_t *dp = d;
+    const uint8_t *edp = d + len;
+    const uint8_t *mark;
+    enum ITMPumpEvent ev;
+
+    while ( dp < edp )
+    {
+        if ( ITM_UNSYNCED == i->p )
+        {
+            /* Nothing can happen before a byte which could complete a sync pattern */
+            if ( !( mark = _nextSyncMark( dp, edp - dp ) ) )
+            {
+                i->syncStat = _foldSyncStat( i->syncStat, dp, edp - dp );
+                return;
+            }
+
+            i->syncStat = _foldSyncStat( i->syncStat, dp, mark - dp );
+            dp = mark;
+        }
+        else if ( ( ( ITM_SW == i->p ) || ( ITM_HW == i->p ) ) && ( i->targetCount - i->pk.len > 1 ) )
+        {
+            /* Bulk-collect the promised payload run, leaving the final byte to the state
+             * machine so packet completion happens in exactly one place. Bytes which could
+             * complete a sync pattern mid-payload are excluded and take the slow path too.
+             */
+            int span = i->targetCount - i->pk.len - 1;
+
+            if ( span > edp - dp )
+            {
+                span = edp - dp;
+            }
+
+            if ( ( mark = _nextSyncMark( dp, span ) ) )
+            {
+                span = mark - dp;
+            }
+
+            if ( span )
+            {
+                memcpy( &i->pk.d[i->pk.len], dp, span );
+                i->pk.len += span;
+                i->syncStat = _foldSyncStat( i->syncStat, dp, span );
+                dp += span;
+                continue;
+            }
+        }
+
+        if ( ITM_EV_NONE != ( ev = ITMPump( i, *dp++ ) ) )
+        {
+            if ( ( ITM_EV_PACKET_RXED == ev ) && ( ITM_PT_SW == i->pk.type ) &&
+                    ( i->bulkChannel == ( int )( ( i->pk.pageRegister << 5 ) | i->pk.srcAddr ) ) )
+            {
+                /* The bulk channel coalesces across packets; its consumer gets one span
+                 * callback per accumulation rather than an event per four bytes
+                 */
+                memcpy( &i->bulkBuffer[i->bulkLen], i->pk.d, i->pk.len );
+                i->bulkLen += i->pk.len;
+
+                if ( i->bulkLen + ITM_DATA_PACKET > ITM_BULK_BUFFER_LEN )
+                {
+                    packetEvent( ITM_EV_BULK_RXED, param );
+                    i->bulkLen = 0;
+                }
+            }
+            else
+            {
+                /* Hand over anything coalesced first, so stream ordering is preserved */
+                if ( i->bulkLen )
+                {
+                    packetEvent( ITM_EV_BULK_RXED, param );
+                    i->bulkLen = 0;
+                }
+
+                packetEvent( ev, param );
+            }
+        }
+    }
+
+    /* Whatever is left coalesced goes out before the buffer does */
+    if ( i->bulkLen )
+    {
+        packetEvent( ITM_EV_BULK_RXED, param );
+        i->bulkLen = 0;
+    }
+}
+// ====================================================================================================
@@ -0,0 +1,904 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * ITM Fifo Interface
+ * ==================
+ *
+ * Backend for the per-channel named pipe interface described in itmfifos.h.
+ * All fifos are serviced by a single epoll driven engine thread; the decode
+ * side stages formatted records into per-channel rings and never blocks, so
+ * an abandoned or slow fifo reader cannot wedge the demux for everyone else.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "generics.h"
+#include "itmfifos.h"
+#include "itmDecoder.h"
+#include "tpiuDecoder.h"
+#include "msgDecoder.h"
+#include "oflow.h"
+#include "fileWriter.h"
+
+#define MAX_STRING_LENGTH (4096)             /* Maximum length of a formatted record */
+
+#define FIFO_RING_SIZE    (65536)            /* Bytes of staging per channel */
+#define FIFO_RING_RECORDS (4096)             /* Maximum staged records per channel */
+#define FIFO_COALESCE_MAX (1024)             /* Limit on merging adjacent records into one slot */
+
+/* What to do with a new record when a stalled reader has filled the staging ring */
+enum stallPolicy
+{
+    STALL_DROP_NEWEST,                       /* Keep the contiguous prefix, lose latest data */
+    STALL_DROP_OLDEST                        /* Coalesce the stall into one gap, keep latest data */
+};
+
+struct Channel
+{
+    char *chanName;                          /* Filename of the fifo */
+    char *presFormat;                        /* Format string for the channel */
+    char *fifoName;                          /* Full path of the fifo on disk */
+    bool  charFmt;                           /* Format executes once per payload byte */
+    enum stallPolicy policy;                 /* What to lose when the reader stalls */
+
+    int  fd;                                 /* Write end of the fifo, -1 if not open */
+    bool armed;                              /* fd currently registered for EPOLLOUT */
+
+    /* Staging ring; data bytes plus a parallel ring of record lengths so that */
+    /* drops always happen on whole-record boundaries.                         */
+    uint8_t  ring[FIFO_RING_SIZE];           /* Data awaiting despatch */
+    uint32_t dataHead;                       /* Read index into ring */
+    uint32_t dataCount;                      /* Bytes currently staged */
+    uint16_t recLen[FIFO_RING_RECORDS];      /* Length of each staged record */
+    uint32_t recHead;                        /* Oldest staged record */
+    uint32_t recCount;                       /* Number of staged records */
+    uint32_t headSent;                       /* Bytes of oldest record already on the wire */
+
+    uint64_t dropped;                        /* Records lost to reader stall */
+};
+
+struct itmfifosHandle
+{
+    /* The decoders and the packets from them */
+    struct ITMDecoder i;
+    struct OFLOW oflow;
+    struct TPIUCommsStats comms;             /* Legacy surface; nothing updates this via OFLOW */
+    uint64_t timeStamp;                      /* Latest received time */
+
+    /* Configuration materials */
+    char *chanPath;                          /* Path to where the fifos live */
+    bool useFilewriter;                      /* Is the filewriter in use? */
+    bool permafiles;                         /* Use permanent files rather than fifos */
+    bool forceITMSync;                       /* Do we need ITM syncs? */
+    int  tag;                                /* Which orbflow tag are we decoding? */
+    enum Prot protocol;                      /* What protocol are we receiving? */
+
+    struct Channel c[NUM_CHANNELS + 1];      /* Output for each channel */
+
+    /* The fifo service engine */
+    pthread_t engineThread;                  /* Thread running the epoll loop */
+    pthread_mutex_t lock;                    /* Protection for the staging rings */
+    int  epollfd;                            /* Engine wait set */
+    int  wakefd;                             /* eventfd used to wake the engine for shutdown */
+    bool engineRunning;                      /* Has the engine been started? */
+    volatile bool ending;                    /* Flag indicating the engine should quit */
+};
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Internals
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+static void _armChannel( struct itmfifosHandle *f, struct Channel *c, bool armed )
+
+/* Set or clear EPOLLOUT interest for this channel's fifo */
+
+{
+    struct epoll_event ev;
+
+    if ( ( c->fd < 0 ) || ( c->armed == armed ) )
+    {
+        return;
+    }
+
+    ev.events = armed ? EPOLLOUT : 0;
+    ev.data.u32 = c - f->c;
+
+    if ( epoll_ctl( f->epollfd, EPOLL_CTL_MOD, c->fd, &ev ) < 0 )
+    {
+        genericsReport( V_WARN, "Failed to rearm fifo %s (%s)" EOL, c->fifoName, strerror( errno ) );
+        return;
+    }
+
+    c->armed = armed;
+}
+// ====================================================================================================
+static void _popRecord( struct Channel *c )
+
+/* Remove the oldest whole record from the staging ring. Caller holds the lock. */
+
+{
+    uint32_t len = c->recLen[c->recHead];
+
+    c->dataHead = ( c->dataHead + len ) % FIFO_RING_SIZE;
+    c->dataCount -= len;
+    c->recHead = ( c->recHead + 1 ) % FIFO_RING_RECORDS;
+    c->recCount--;
+}
+// ====================================================================================================
+static void _stageRecord( struct itmfifosHandle *f, struct Channel *c, const char *d, uint32_t len )
+
+/* Append a formatted record to a channel staging ring, applying the stall policy if it's full */
+
+{
+    uint32_t tail;
+
+    if ( ( !len ) || ( c->fd < 0 ) || ( len > FIFO_RING_SIZE ) )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &f->lock );
+
+    if ( ( c->dataCount + len > FIFO_RING_SIZE ) || ( c->recCount == FIFO_RING_RECORDS ) )
+    {
+        if ( c->policy == STALL_DROP_OLDEST )
+        {
+            /* Make room by shedding old records, but never one that is already part-written */
+            /* to the fifo; chopping that would tear a record on the reader side.            */
+            while ( ( c->recCount ) && ( !c->headSent ) &&
+                    ( ( c->dataCount + len > FIFO_RING_SIZE ) || ( c->recCount == FIFO_RING_RECORDS ) ) )
+            {
+                _popRecord( c );
+                c->dropped++;
+            }
+        }
+
+        if ( ( c->dataCount + len > FIFO_RING_SIZE ) || ( c->recCount == FIFO_RING_RECORDS ) )
+        {
+            c->dropped++;
+            pthread_mutex_unlock( &f->lock );
+            return;
+        }
+    }
+
+    /* Room confirmed, so copy the record in (possibly in two parts over the wrap) */
+    tail = ( c->dataHead + c->dataCount ) % FIFO_RING_SIZE;
+
+    /* Coalesce small adjacent records into one slot so that a stream of tiny records   */
+    /* (e.g. a %c format) can never exhaust the record ring before the byte ring fills. */
+    /* Merged records drop together under the stall policy, which is still on whole     */
+    /* record boundaries from the reader's point of view.                               */
+    uint32_t lastRec = ( c->recHead + c->recCount - 1 ) % FIFO_RING_RECORDS;
+    bool merge = ( c->recCount ) &&
+                 ( ( c->recCount > 1 ) || ( !c->headSent ) ) &&
+                 ( c->recLen[lastRec] + len <= FIFO_COALESCE_MAX );
+
+    if ( tail + len <= FIFO_RING_SIZE )
+    {
+        memcpy( &c->ring[tail], d, len );
+    }
+    else
+    {
+        memcpy( &c->ring[tail], d, FIFO_RING_SIZE - tail );
+        memcpy( c->ring, &d[FIFO_RING_SIZE - tail], len - ( FIFO_RING_SIZE - tail ) );
+    }
+
+    c->dataCount += len;
+
+    if ( merge )
+    {
+        c->recLen[lastRec] += len;
+    }
+    else
+    {
+        c->recLen[( c->recHead + c->recCount ) % FIFO_RING_RECORDS] = len;
+        c->recCount++;
+    }
+
+    /* epoll_ctl is guaranteed to take effect even while the engine is parked in epoll_wait */
+    _armChannel( f, c, true );
+
+    pthread_mutex_unlock( &f->lock );
+}
+// ====================================================================================================
+static void _drainChannel( struct itmfifosHandle *f, struct Channel *c )
+
+/* The fifo reported writable; despatch as much staged data as it will take. Caller holds the lock. */
+
+{
+    struct iovec iov[2];
+    int iovcnt;
+    ssize_t written;
+
+    while ( c->dataCount )
+    {
+        /* Pending data are at most two contiguous regions of the ring */
+        if ( c->dataHead + c->dataCount <= FIFO_RING_SIZE )
+        {
+            iov[0].iov_base = &c->ring[c->dataHead];
+            iov[0].iov_len  = c->dataCount;
+            iovcnt = 1;
+        }
+        else
+        {
+            iov[0].iov_base = &c->ring[c->dataHead];
+            iov[0].iov_len  = FIFO_RING_SIZE - c->dataHead;
+            iov[1].iov_base = c->ring;
+            iov[1].iov_len  = c->dataCount - iov[0].iov_len;
+            iovcnt = 2;
+        }
+
+        written = writev( c->fd, iov, iovcnt );
+
+        if ( written <= 0 )
+        {
+            if ( ( written < 0 ) && ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) && ( errno != EINTR ) )
+            {
+                genericsReport( V_WARN, "Write to fifo %s failed (%s)" EOL, c->fifoName, strerror( errno ) );
+            }
+
+            /* Fifo is full (or in trouble); stay armed and wait for the next EPOLLOUT */
+            return;
+        }
+
+        /* Retire whatever got onto the wire, whole records first */
+        c->dataHead = ( c->dataHead + written ) % FIFO_RING_SIZE;
+        c->dataCount -= written;
+        c->headSent += written;
+
+        while ( ( c->recCount ) && ( c->headSent >= c->recLen[c->recHead] ) )
+        {
+            c->headSent -= c->recLen[c->recHead];
+            c->recHead = ( c->recHead + 1 ) % FIFO_RING_RECORDS;
+            c->recCount--;
+        }
+    }
+
+    /* Nothing left to send, so stop asking for writability */
+    _armChannel( f, c, false );
+}
+// ====================================================================================================
+static void *_engineThread( void *arg )
+
+/* The single thread servicing every fifo */
+
+{
+    struct itmfifosHandle *f = ( struct itmfifosHandle * )arg;
+    struct epoll_event ev[NUM_CHANNELS + 2];
+    uint64_t tick;
+    int nfds;
+
+    while ( !f->ending )
+    {
+        nfds = epoll_wait( f->epollfd, ev, NUM_CHANNELS + 2, -1 );
+
+        if ( nfds < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            genericsReport( V_ERROR, "epoll_wait failed (%s)" EOL, strerror( errno ) );
+            break;
+        }
+
+        pthread_mutex_lock( &f->lock );
+
+        for ( int e = 0; e < nfds; e++ )
+        {
+            if ( ev[e].data.u32 > NUM_CHANNELS )
+            {
+                /* This is the wake eventfd, used only to get us out of epoll_wait at shutdown */
+                read( f->wakefd, &tick, sizeof( tick ) );
+            }
+            else
+            {
+                _drainChannel( f, &f->c[ev[e].data.u32] );
+            }
+        }
+
+        pthread_mutex_unlock( &f->lock );
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+// Decoders for each message
+// ====================================================================================================
+static void _handleException( struct itmfifosHandle *f, struct excMsg *m )
+
+{
+    char construct[MAX_STRING_LENGTH];
+    int opLen = snprintf( construct, MAX_STRING_LENGTH, "%d,%" PRIu64 ",%d,%d" EOL,
+                          HWEVENT_EXCEPTION, f->timeStamp, m->eventType, m->exceptionNumber );
+    _stageRecord( f, &f->c[HW_CHANNEL], construct, opLen );
+}
+// ====================================================================================================
+static void _handleDWTEvent( struct itmfifosHandle *f, struct dwtMsg *m )
+
+{
+    char construct[MAX_STRING_LENGTH];
+    int opLen = snprintf( construct, MAX_STRING_LENGTH, "%d,%" PRIu64 ",%d" EOL,
+                          HWEVENT_DWT, f->timeStamp, m->event );
+    _stageRecord( f, &f->c[HW_CHANNEL], construct, opLen );
+}
+// ====================================================================================================
+static void _handlePCSample( struct itmfifosHandle *f, struct pcSampleMsg *m )
+
+{
+    char construct[MAX_STRING_LENGTH];
+    int opLen;
+
+    if ( m->sleep )
+    {
+        opLen = snprintf( construct, MAX_STRING_LENGTH, "%d,%" PRIu64 ",**SLEEP**" EOL, HWEVENT_PCSample, f->timeStamp );
+    }
+    else
+    {
+        opLen = snprintf( construct, MAX_STRING_LENGTH, "%d,%" PRIu64 ",0x%08x" EOL, HWEVENT_PCSample, f->timeStamp, m->pc );
+    }
+
+    _stageRecord( f, &f->c[HW_CHANNEL], construct, opLen );
+}
+// ====================================================================================================
+static void _handleDataRWWP( struct itmfifosHandle *f, struct watchMsg *m )
+
+{
+    char construct[MAX_STRING_LENGTH];
+    int opLen = snprintf( construct, MAX_STRING_LENGTH, "%d,%" PRIu64 ",%d,%s,0x%x" EOL,
+                          HWEVENT_RWWT, f->timeStamp, m->comp, m->isWrite ? "Write" : "Read", m->data );
+    _stageRecord( f, &f->c[HW_CHANNEL], construct, opLen );
+}
+// ====================================================================================================
+static void _handleDataAccessWP( struct itmfifosHandle *f, struct wptMsg *m )
+
+{
+    char construct[MAX_STRING_LENGTH];
+    int opLen = snprintf( construct, MAX_STRING_LENGTH, "%d,%" PRIu64 ",%d,0x%08x" EOL,
+                          HWEVENT_AWP, f->timeStamp, m->comp, m->data );
+    _stageRecord( f, &f->c[HW_CHANNEL], construct, opLen );
+}
+// ====================================================================================================
+static void _handleDataOffsetWP( struct itmfifosHandle *f, struct oswMsg *m )
+
+{
+    char construct[MAX_STRING_LENGTH];
+    int opLen = snprintf( construct, MAX_STRING_LENGTH, "%d,%" PRIu64 ",%d,0x%04x" EOL,
+                          HWEVENT_OFS, f->timeStamp, m->comp, m->offset );
+    _stageRecord( f, &f->c[HW_CHANNEL], construct, opLen );
+}
+// ====================================================================================================
+static void _handleNISYNC( struct itmfifosHandle *f, struct nisyncMsg *m )
+
+{
+    char construct[MAX_STRING_LENGTH];
+    int opLen = snprintf( construct, MAX_STRING_LENGTH, "%d,%" PRIu64 ",%d,0x%08x" EOL,
+                          HWEVENT_NISYNC, f->timeStamp, m->type, m->addr );
+    _stageRecord( f, &f->c[HW_CHANNEL], construct, opLen );
+}
+// ====================================================================================================
+static void _handleTS( struct itmfifosHandle *f, struct TSMsg *m )
+
+{
+    char construct[MAX_STRING_LENGTH];
+
+    f->timeStamp += m->timeInc;
+
+    int opLen = snprintf( construct, MAX_STRING_LENGTH, "%d,%d,%" PRIu64 EOL,
+                          HWEVENT_TS, m->timeStatus, f->timeStamp );
+    _stageRecord( f, &f->c[HW_CHANNEL], construct, opLen );
+}
+// ====================================================================================================
+static void _handleSW( struct itmfifosHandle *f, struct swMsg *m )
+
+{
+    char construct[MAX_STRING_LENGTH];
+    struct Channel *c;
+    int opLen;
+
+    if ( ( f->useFilewriter ) && ( m->srcAddr == FW_CHANNEL ) )
+    {
+        /* This is for the filewriter, despatch it there rather than to a fifo */
+        filewriterProcess( m );
+        return;
+    }
+
+    if ( m->srcAddr >= NUM_CHANNELS )
+    {
+        return;
+    }
+
+    c = &f->c[m->srcAddr];
+
+    if ( !c->presFormat )
+    {
+        return;
+    }
+
+    if ( c->charFmt )
+    {
+        /* Format executes once for each byte of the payload */
+        for ( uint32_t b = 0; b < m->len; b++ )
+        {
+            opLen = snprintf( construct, MAX_STRING_LENGTH, c->presFormat, ( m->value >> ( b * 8 ) ) & 0xff );
+            _stageRecord( f, c, construct, opLen );
+        }
+    }
+    else
+    {
+        opLen = snprintf( construct, MAX_STRING_LENGTH, c->presFormat, m->value );
+        _stageRecord( f, c, construct, opLen );
+    }
+}
+// ====================================================================================================
+static void _itmPumpProcess( struct itmfifosHandle *f )
+
+/* Handle individual message types from SWO */
+
+{
+    struct msg p;
+
+    if ( !ITMGetDecodedPacket( &f->i, &p ) )
+    {
+        return;
+    }
+
+    switch ( p.genericMsg.msgtype )
+    {
+        case MSG_SOFTWARE:
+            _handleSW( f, &p.swMsg );
+            break;
+
+        case MSG_NISYNC:
+            _handleNISYNC( f, &p.nisyncMsg );
+            break;
+
+        case MSG_OSW:
+            _handleDataOffsetWP( f, &p.oswMsg );
+            break;
+
+        case MSG_DATA_ACCESS_WP:
+            _handleDataAccessWP( f, &p.wptMsg );
+            break;
+
+        case MSG_DATA_RWWP:
+            _handleDataRWWP( f, &p.watchMsg );
+            break;
+
+        case MSG_PC_SAMPLE:
+            _handlePCSample( f, &p.pcSampleMsg );
+            break;
+
+        case MSG_DWT_EVENT:
+            _handleDWTEvent( f, &p.dwtMsg );
+            break;
+
+        case MSG_EXCEPTION:
+            _handleException( f, &p.excMsg );
+            break;
+
+        case MSG_TS:
+            _handleTS( f, ( struct TSMsg * )&p );
+            break;
+
+        default:
+            break;
+    }
+}
+// ====================================================================================================
+static void _itmPumpEvent( enum ITMPumpEvent e, void *param )
+
+{
+    struct itmfifosHandle *f = ( struct itmfifosHandle * )param;
+
+    if ( ITM_EV_PACKET_RXED == e )
+    {
+        _itmPumpProcess( f );
+    }
+}
+// ====================================================================================================
+static void _OFLOWpacketRxed( struct OFLOWFrame *p, void *param )
+
+{
+    struct itmfifosHandle *f = ( struct itmfifosHandle * )param;
+
+    if ( !p->good )
+    {
+        genericsReport( V_INFO, "Bad packet received" EOL );
+    }
+    else
+    {
+        if ( p->tag == f->tag )
+        {
+            ITMPumpBuffer( &f->i, p->d, p->len, _itmPumpEvent, f );
+        }
+    }
+}
+// ====================================================================================================
+static bool _makeFifoTasks( struct itmfifosHandle *f )
+
+/* Create fifos according to what was defined in the configuration, and open our write ends */
+
+{
+    struct Channel *c;
+    struct epoll_event ev;
+
+    for ( int t = 0; t < NUM_CHANNELS + 1; t++ )
+    {
+        c = &f->c[t];
+        c->fd = -1;
+
+        if ( !c->chanName )
+        {
+            continue;
+        }
+
+        if ( asprintf( &c->fifoName, "%s%s", f->chanPath ? f->chanPath : "", c->chanName ) < 0 )
+        {
+            return false;
+        }
+
+        if ( ( mkfifo( c->fifoName, 0666 ) < 0 ) && ( errno != EEXIST ) )
+        {
+            genericsReport( V_ERROR, "Couldn't create fifo %s (%s)" EOL, c->fifoName, strerror( errno ) );
+            return false;
+        }
+
+        /* Open read+write so this succeeds with no reader attached and writes simply     */
+        /* back-pressure into the pipe buffer; the staging ring absorbs (and then sheds)  */
+        /* anything beyond that, so a missing or stalled reader costs nobody else a beat. */
+        c->fd = open( c->fifoName, O_RDWR | O_NONBLOCK );
+
+        if ( c->fd < 0 )
+        {
+            genericsReport( V_ERROR, "Couldn't open fifo %s (%s)" EOL, c->fifoName, strerror( errno ) );
+            return false;
+        }
+
+        /* Register with the engine, initially with no writability interest */
+        ev.events = 0;
+        ev.data.u32 = t;
+
+        if ( epoll_ctl( f->epollfd, EPOLL_CTL_ADD, c->fd, &ev ) < 0 )
+        {
+            genericsReport( V_ERROR, "Couldn't register fifo %s (%s)" EOL, c->fifoName, strerror( errno ) );
+            return false;
+        }
+    }
+
+    return true;
+}
+// ====================================================================================================
+static void _removeFifoTasks( struct itmfifosHandle *f )
+
+/* Close down fifos and get rid of them from the filesystem (unless they are permafiles) */
+
+{
+    struct Channel *c;
+
+    for ( int t = 0; t < NUM_CHANNELS + 1; t++ )
+    {
+        c = &f->c[t];
+
+        if ( c->fd >= 0 )
+        {
+            close( c->fd );
+            c->fd = -1;
+        }
+
+        if ( c->fifoName )
+        {
+            if ( !f->permafiles )
+            {
+                unlink( c->fifoName );
+            }
+
+            if ( c->dropped )
+            {
+                genericsReport( V_INFO, "Dropped %" PRIu64 " records on %s due to reader stall" EOL, c->dropped, c->fifoName );
+            }
+
+            free( c->fifoName );
+            c->fifoName = NULL;
+        }
+    }
+}
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Externally available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+void itmfifoProtocolPump( struct itmfifosHandle *f, uint8_t *c, int len )
+
+/* Top level protocol pump */
+
+{
+    switch ( f->protocol )
+    {
+        case PROT_OFLOW:
+            OFLOWPump( &f->oflow, c, len, _OFLOWpacketRxed, f );
+            break;
+
+        case PROT_ITM:
+            ITMPumpBuffer( &f->i, c, len, _itmPumpEvent, f );
+            break;
+
+        default:
+            genericsReport( V_WARN, "Unknown protocol in use" EOL );
+            break;
+    }
+}
+// ====================================================================================================
+void itmfifoForceSync( struct itmfifosHandle *f, bool synced )
+
+{
+    ITMDecoderForceSync( &f->i, synced );
+}
+// ====================================================================================================
+void itmfifoSetChannel( struct itmfifosHandle *f, int chan, char *n, char *s )
+
+{
+    if ( ( chan < 0 ) || ( chan > NUM_CHANNELS ) )
+    {
+        return;
+    }
+
+    if ( f->c[chan].chanName )
+    {
+        free( f->c[chan].chanName );
+    }
+
+    if ( f->c[chan].presFormat )
+    {
+        free( f->c[chan].presFormat );
+        f->c[chan].presFormat = NULL;
+    }
+
+    f->c[chan].chanName = n ? strdup( n ) : NULL;
+
+    if ( s )
+    {
+        f->c[chan].presFormat = strdup( genericsUnescape( s ) );
+        f->c[chan].charFmt = ( strstr( f->c[chan].presFormat, "%c" ) != NULL );
+    }
+}
+// ====================================================================================================
+void itmfifoSetChanPath( struct itmfifosHandle *f, char *s )
+
+{
+    if ( f->chanPath )
+    {
+        free( f->chanPath );
+    }
+
+    f->chanPath = s ? strdup( s ) : NULL;
+}
+// ====================================================================================================
+void itmfifoSetProtocol( struct itmfifosHandle *f, enum Prot p )
+
+{
+    f->protocol = p;
+}
+// ====================================================================================================
+void itmfifoSetForceITMSync( struct itmfifosHandle *f, bool s )
+
+{
+    f->forceITMSync = s;
+}
+// ====================================================================================================
+void itmfifoSettag( struct itmfifosHandle *f, int tag )
+
+{
+    f->tag = tag;
+}
+// ====================================================================================================
+char *itmfifoGetChannelName( struct itmfifosHandle *f, int chan )
+
+{
+    return ( ( chan >= 0 ) && ( chan <= NUM_CHANNELS ) ) ? f->c[chan].chanName : NULL;
+}
+// ====================================================================================================
+char *itmfifoGetChannelFormat( struct itmfifosHandle *f, int chan )
+
+{
+    return ( ( chan >= 0 ) && ( chan <= NUM_CHANNELS ) ) ? f->c[chan].presFormat : NULL;
+}
+// ====================================================================================================
+char *itmfifoGetChanPath( struct itmfifosHandle *f )
+
+{
+    return f->chanPath;
+}
+// ====================================================================================================
+enum Prot itmfifoGetProtocol( struct itmfifosHandle *f )
+
+{
+    return f->protocol;
+}
+// ====================================================================================================
+struct TPIUCommsStats *itmfifoGetCommsStats( struct itmfifosHandle *f )
+
+{
+    return &f->comms;
+}
+// ====================================================================================================
+struct ITMDecoderStats *itmfifoGetITMDecoderStats( struct itmfifosHandle *f )
+
+{
+    return ITMDecoderGetStats( &f->i );
+}
+// ====================================================================================================
+bool itmfifoGetForceITMSync( struct itmfifosHandle *f )
+
+{
+    return f->forceITMSync;
+}
+// ====================================================================================================
+int itmfifoGettag( struct itmfifosHandle *f )
+
+{
+    return f->tag;
+}
+// ====================================================================================================
+void itmfifoUsePermafiles( struct itmfifosHandle *f, bool usePermafilesSet )
+
+{
+    f->permafiles = usePermafilesSet;
+}
+// ====================================================================================================
+void itmfifoFilewriter( struct itmfifosHandle *f, bool useFilewriter, char *workingPath )
+
+{
+    f->useFilewriter = useFilewriter;
+
+    if ( f->useFilewriter )
+    {
+        filewriterInit( workingPath );
+    }
+}
+// ====================================================================================================
+bool itmfifoCreate( struct itmfifosHandle *f )
+
+/* Create the fifo set and start the service engine */
+
+{
+    /* Cycle through channels and set up the fifos */
+    ITMDecoderInit( &f->i, f->forceITMSync );
+    OFLOWInit( &f->oflow );
+
+    f->epollfd = epoll_create1( 0 );
+
+    if ( f->epollfd < 0 )
+    {
+        return false;
+    }
+
+    f->wakefd = eventfd( 0, EFD_NONBLOCK );
+
+    if ( f->wakefd < 0 )
+    {
+        return false;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = NUM_CHANNELS + 1 };
+
+    if ( epoll_ctl( f->epollfd, EPOLL_CTL_ADD, f->wakefd, &ev ) < 0 )
+    {
+        return false;
+    }
+
+    if ( !_makeFifoTasks( f ) )
+    {
+        return false;
+    }
+
+    pthread_mutex_init( &f->lock, NULL );
+
+    if ( pthread_create( &f->engineThread, NULL, &_engineThread, f ) )
+    {
+        return false;
+    }
+
+    f->engineRunning = true;
+    return true;
+}
+// ====================================================================================================
+void itmfifoShutdown( struct itmfifosHandle *f )
+
+/* Destroy the fifo set */
+
+{
+    if ( f->engineRunning )
+    {
+        uint64_t tick = 1;
+        f->ending = true;
+
+        if ( write( f->wakefd, &tick, sizeof( tick ) ) < 0 )
+        {
+            /* Nothing sensible to do; the join below may take until the next wakeup */
+        }
+
+        pthread_join( f->engineThread, NULL );
+        f->engineRunning = false;
+    }
+
+    _removeFifoTasks( f );
+
+    if ( f->epollfd >= 0 )
+    {
+        close( f->epollfd );
+    }
+
+    if ( f->wakefd >= 0 )
+    {
+        close( f->wakefd );
+    }
+
+    for ( int t = 0; t < NUM_CHANNELS + 1; t++ )
+    {
+        if ( f->c[t].chanName )
+        {
+            free( f->c[t].chanName );
+        }
+
+        if ( f->c[t].presFormat )
+        {
+            free( f->c[t].presFormat );
+        }
+    }
+
+    if ( f->chanPath )
+    {
+        free( f->chanPath );
+    }
+
+    free( f );
+}
+// ====================================================================================================
+struct itmfifosHandle *itmfifoInit( bool forceITMSyncSet, enum Prot p, int tag )
+
+/* Get a new instance of the fifo handler */
+
+{
+    struct itmfifosHandle *f = ( struct itmfifosHandle * )calloc( 1, sizeof( struct itmfifosHandle ) );
+    MEMCHECK( f, NULL );
+
+    f->protocol = p;
+    f->forceITMSync = forceITMSyncSet;
+    f->tag = tag;
+    f->epollfd = -1;
+    f->wakefd = -1;
+
+    for ( int t = 0; t < NUM_CHANNELS + 1; t++ )
+    {
+        f->c[t].fd = -1;
+
+        /* Text channels keep the contiguous prefix of their stream when a reader stalls; */
+        /* the hardware event channel prefers the most recent state instead.              */
+        f->c[t].policy = ( t == HW_CHANNEL ) ? STALL_DROP_OLDEST : STALL_DROP_NEWEST;
+    }
+
+    /* The hardware channel always exists */
+    f->c[HW_CHANNEL].chanName = strdup( HWFIFO_NAME );
+
+    return f;
+}
+// ====================================================================================================
@@ -3,11 +3,16 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <string.h>
+#include <pthread.h>
 #include <gelf.h>
 #include <ctype.h>
 #include <dwarf.h>
 #include <libdwarf.h>
+#if !defined( WIN32 )
+    #include <sys/mman.h>
+#endif
 
 #include "loadelf.h"
 #include "generics.h"
@@ -16,8 +21,43 @@
 #define DP_MAX_LINE_LEN (4095)
 #define IS_INFO (true)
 
+/* Maximum number of threads walking compilation units concurrently */
+#define MAX_LINE_WORKERS (8)
+
 static char _print_buffer[DP_MAX_LINE_LEN];
 
+/* Extent of one compilation unit's records in a worker's scratch tables, kept so the
+ * unit can be serialized to (or recognised in) the per-CU cache.
+ */
+struct cuExtent
+{
+    uint64_t hash;                           /* Hash over the CU's .debug_info bytes, 0 = uncacheable */
+    uint32_t f0, f1;                         /* Function table slice belonging to this CU */
+    uint32_t l0, l1;                         /* Line table slice belonging to this CU */
+};
+
+struct cuCacheIndex;
+
+/* Context for one line-table loading worker */
+struct lineWorkerContext
+{
+    struct symbol scratch;                   /* Private accumulation target, merged into the real set at the end */
+    const char *filename;                    /* ELF file to open a private cursor on */
+    int stride;                              /* Total number of workers walking the CU list */
+    int offset;                              /* Which CUs in the round-robin are ours */
+    char printBuffer[DP_MAX_LINE_LEN];       /* Private buffer for the dwarf printf callback */
+    pthread_t thread;
+    bool ok;                                 /* Flag indicating this worker completed */
+
+    /* Differential reload support... */
+    const uint8_t *debugInfo;                /* Raw .debug_info bytes for CU change detection */
+    size_t debugInfoLen;                     /* ...and how many of them there are */
+    const struct cuCacheIndex *oldCache;     /* Per-CU records from the previous load, if any */
+    struct cuExtent *cu;                     /* Extents of the CUs this worker owns */
+    unsigned int ncu;                        /* Number of them */
+    unsigned int reused;                     /* How many came from the cache rather than a parse */
+};
+
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
@@ -87,6 +127,59 @@ static int _matchFunc( const void *a, const void *b )
 
 // ====================================================================================================
 
+static int _compareInlineFunc( const void *a, const void *b )
+
+/* Order inline instances by start address, wider (outer) instance first at equal starts */
+
+{
+    const struct symbolFunctionStore *af = *( struct symbolFunctionStore ** )a;
+    const struct symbolFunctionStore *bf = *( struct symbolFunctionStore ** )b;
+
+    if ( af->lowaddr < bf->lowaddr )
+    {
+        return -1;
+    }
+
+    if ( af->lowaddr > bf->lowaddr )
+    {
+        return 1;
+    }
+
+    if ( af->highaddr > bf->highaddr )
+    {
+        return -1;
+    }
+
+    if ( af->highaddr < bf->highaddr )
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+// ====================================================================================================
+
+static int _matchInlineRange( const void *a, const void *b )
+{
+    const symbolMemaddr key = *( symbolMemaddr * )a;
+    const struct symbolInlineRange *r = ( const struct symbolInlineRange * )b;
+
+    if ( key < r->lowaddr )
+    {
+        return -1;
+    }
+
+    if ( key > r->highaddr )
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+// ====================================================================================================
+
 static int _compareLineMem( const void *a, const void *b )
 
 {
@@ -128,6 +221,119 @@ static int _matchLine( const void *a, const void *b )
 }
 // ====================================================================================================
 
+static int _compareVar( const void *a, const void *b )
+
+{
+    const symbolMemaddr as = ( ( struct symbolVariableStore * )a )->addr;
+    const symbolMemaddr bs = ( ( struct symbolVariableStore * )b )->addr;
+
+    if ( as < bs )
+    {
+        return -1;
+    }
+
+    if ( as > bs )
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+// ====================================================================================================
+
+static int _matchVar( const void *a, const void *b )
+{
+    const symbolMemaddr key = *( uint64_t * )a;
+    const struct symbolVariableStore *v = ( const struct symbolVariableStore * )b;
+
+    if ( key < v->addr )
+    {
+        return -1;
+    }
+
+    if ( key >= v->addr + v->size )
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+// ====================================================================================================
+
+static void _loadVariables( struct symbol *p )
+
+/* Collect sized data objects from the symbol table, sorted by address, so data accesses can be
+ * attributed to the variable they landed in. Failure just leaves the table empty.
+ */
+
+{
+    Elf *e;
+    Elf_Scn *scn = NULL;
+    GElf_Shdr shdr;
+    int fd;
+
+#ifndef O_BINARY
+
+    if ( ( fd = open( p->elfFile, O_RDONLY, 0 ) ) < 0 )
+#else
+    if ( ( fd = open( p->elfFile, O_RDONLY | O_BINARY, 0 ) ) < 0 )
+#endif
+    {
+        return;
+    }
+
+    if ( ( elf_version( EV_CURRENT ) == EV_NONE ) || ( NULL == ( e = elf_begin( fd, ELF_C_READ, NULL ) ) ) )
+    {
+        close( fd );
+        return;
+    }
+
+    while ( ( scn = elf_nextscn( e, scn ) ) != NULL )
+    {
+        if ( ( gelf_getshdr( scn, &shdr ) != &shdr ) || ( shdr.sh_type != SHT_SYMTAB ) )
+        {
+            continue;
+        }
+
+        Elf_Data *data = elf_getdata( scn, NULL );
+
+        if ( !data )
+        {
+            continue;
+        }
+
+        int nsyms = shdr.sh_size / shdr.sh_entsize;
+
+        for ( int i = 0; i < nsyms; i++ )
+        {
+            GElf_Sym sym;
+            char *name;
+
+            if ( ( gelf_getsym( data, i, &sym ) != &sym ) ||
+                    ( GELF_ST_TYPE( sym.st_info ) != STT_OBJECT ) ||
+                    ( !sym.st_size ) || ( sym.st_shndx == SHN_UNDEF ) ||
+                    ( NULL == ( name = elf_strptr( e, shdr.sh_link, sym.st_name ) ) ) || ( !*name ) )
+            {
+                continue;
+            }
+
+            p->var = ( struct symbolVariableStore * )realloc( p->var, ( p->nvar + 1 ) * sizeof( struct symbolVariableStore ) );
+            struct symbolVariableStore *v = &p->var[p->nvar++];
+            v->name = strdup( name );
+            v->addr = sym.st_value;
+            v->size = sym.st_size;
+        }
+    }
+
+    qsort( p->var, p->nvar, sizeof( struct symbolVariableStore ), _compareVar );
+    elf_end( e );
+    close( fd );
+}
+
+// ====================================================================================================
+
 static bool _readProg( struct symbol *p )
 
 {
@@ -136,57 +342,117 @@ static bool _readProg( struct symbol *p )
     GElf_Shdr shdr;
     size_t shstrndx;
     char *name;
+    int fd;
+
+    /* Use a private cursor on the file so this can run concurrently with the DWARF side */
+#ifndef O_BINARY
+
+    if ( ( fd = open( p->elfFile, O_RDONLY, 0 ) ) < 0 )
+#else
+    if ( ( fd = open( p->elfFile, O_RDONLY | O_BINARY, 0 ) ) < 0 )
+#endif
+    {
+        return false;
+    }
 
     if ( elf_version( EV_CURRENT ) == EV_NONE )
     {
         fprintf( stderr, "ELF library initialization failed : %s ", elf_errmsg ( -1 ) );
-        return p;
+        close( fd );
+        return false;
+    }
+
+#if !defined( WIN32 )
+    /* Map the image writable-private so segments can be referenced zero-copy; anything that
+     * patches the loaded image copies just the touched pages, courtesy of the kernel's CoW. */
+    struct stat st;
+
+    if ( 0 == fstat( fd, &st ) )
+    {
+        uint8_t *m = ( uint8_t * )mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+
+        if ( MAP_FAILED != m )
+        {
+            p->elfMap = m;
+            p->elfMapLen = st.st_size;
+        }
     }
 
-    if ( ( e = elf_begin( p->fd, ELF_C_READ, NULL ) ) == NULL )
+#endif
+
+    if ( ( e = elf_begin( fd, ELF_C_READ, NULL ) ) == NULL )
     {
         fprintf( stderr, "ELF Begin failed\n" );
+        close( fd );
         return false;
     }
 
     if ( elf_getshdrstrndx( e, &shstrndx ) != 0 )
     {
         fprintf( stderr, "elf_getshdrstrndx failed: %s\n", elf_errmsg( -1 ) );
+        elf_end( e );
+        close( fd );
         return false;
     }
 
-    /* Read this into memory by iterating over sections */
+    /* Collect the loadable sections by iterating over section headers */
     while ( ( scn = elf_nextscn( e, scn ) ) != NULL )
     {
 
         if ( gelf_getshdr( scn, &shdr ) != &shdr )
         {
             fprintf( stderr, "getshdr () failed : %s\n", elf_errmsg( -1 ) );
+            elf_end( e );
+            close( fd );
             return false;
         }
 
         if ( ( name = elf_strptr ( e, shstrndx, shdr.sh_name ) ) == NULL )
         {
             fprintf( stderr, " elf_strptr () failed : %s\n", elf_errmsg ( -1 ) );
+            elf_end( e );
+            close( fd );
             return false;
         }
 
         if ( ( shdr.sh_flags & SHF_ALLOC ) && ( shdr.sh_type == SHT_PROGBITS ) )
         {
+            uint8_t *source = NULL;
+            bool mapped = false;
             Elf_Data *data = NULL;
 
-            /* This is program code or data; Allocate a new section */
-            if ( ( data = elf_rawdata ( scn, data ) ) != NULL )
+            if ( ( p->elfMap ) && ( shdr.sh_offset + shdr.sh_size <= p->elfMapLen ) )
+            {
+                /* This is program code or data, referenced in place from the mapping */
+                source = &p->elfMap[shdr.sh_offset];
+                mapped = true;
+            }
+            else if ( ( data = elf_rawdata ( scn, data ) ) != NULL )
+            {
+                /* No mapping available, so this section gets copied into owned storage */
+                source = ( uint8_t * )data->d_buf;
+            }
+
+            if ( source )
             {
                 p->mem = ( struct symbolMemoryStore * )realloc( p->mem, ( p->nsect_mem + 1 ) * sizeof( struct symbolMemoryStore ) );
                 struct symbolMemoryStore *n = p->mem + p->nsect_mem;
                 p->nsect_mem++;
 
-                n->start = shdr.sh_addr;
-                n->len   = shdr.sh_size;
-                n->name  = strdup( name );
-                n->data  = ( uint8_t * )malloc( n->len );
-                memmove( n->data, data->d_buf, n->len );
+                n->start  = shdr.sh_addr;
+                n->len    = shdr.sh_size;
+                n->name   = strdup( name );
+                n->mapped = mapped;
+
+                if ( mapped )
+                {
+                    n->data = source;
+                }
+                else
+                {
+                    n->data = ( uint8_t * )malloc( n->len );
+                    memmove( n->data, source, n->len );
+                }
             }
         }
     }
@@ -195,7 +461,17 @@ static bool _readProg( struct symbol *p )
     qsort( p->mem, p->nsect_mem, sizeof( struct symbolMemoryStore ), _compareMem );
     p->cachedSearchIndex = -1;
     elf_end( e );
-    return p;
+    close( fd );
+    return true;
+}
+// ====================================================================================================
+
+static void *_readProgWorker( void *param )
+
+/* Thread wrapper so the memory image loads in parallel with the line tables */
+
+{
+    return ( void * )( uintptr_t )_readProg( ( struct symbol * )param );
 }
 
 // ====================================================================================================
@@ -341,7 +617,7 @@ void _dwarf_print( void *p, const char *line )
 
 // ====================================================================================================
 
-static void _processFunctionDie( struct symbol *p, Dwarf_Debug dbg, Dwarf_Die die, int filenameN, int producerN, Dwarf_Addr cu_base_addr )
+static void _processFunctionDie( struct symbol *p, Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Half dietag, int filenameN, int producerN, Dwarf_Addr cu_base_addr )
 
 {
     char *name = NULL;
@@ -352,27 +628,26 @@ static void _processFunctionDie( struct symbol *p, Dwarf_Debug dbg, Dwarf_Die di
 
     Dwarf_Attribute attr_data;
     Dwarf_Half attr_tag;
-    bool isinline = false;
+    bool isinline = ( dietag == DW_TAG_inlined_subroutine );
     struct symbolFunctionStore *newFunc;
 
     Dwarf_Off specification_offset;
     Dwarf_Die specification_die;
+    Dwarf_Die abstract_origin_die = NULL;
 
-    /* See if this is an inline die usage */
+    /* A concrete instance (inlined copy, or out-of-line body of an inline function) carries
+     * almost nothing itself; name and declaration details live on the abstract definition.
+     */
     attr_tag = DW_AT_abstract_origin;
 
     if ( DW_DLV_OK == dwarf_attr( die, attr_tag, &attr_data, 0 ) )
     {
-        /* It is, so track back to the real one */
         Dwarf_Off abstract_origin_offset;
-        Dwarf_Die abstract_origin_die;
-        attr_tag = DW_AT_abstract_origin;
-        dwarf_attr( die, attr_tag, &attr_data, 0 );
-        dwarf_global_formref( attr_data, &abstract_origin_offset, 0 );
 
-        if ( DW_DLV_OK == dwarf_offdie_b( dbg, abstract_origin_offset, IS_INFO, &abstract_origin_die, 0 ) )
+        if ( ( DW_DLV_OK != dwarf_global_formref( attr_data, &abstract_origin_offset, 0 ) ) ||
+                ( DW_DLV_OK != dwarf_offdie_b( dbg, abstract_origin_offset, IS_INFO, &abstract_origin_die, 0 ) ) )
         {
-            isinline = true;
+            abstract_origin_die = NULL;
         }
     }
 
@@ -386,25 +661,35 @@ static void _processFunctionDie( struct symbol *p, Dwarf_Debug dbg, Dwarf_Die di
 
     specification_die = die;
 
-    /* Get the possibly mangled linkage name if it exists */
+    /* Get the possibly mangled linkage name if it exists, here or on the abstract definition */
     if ( DW_DLV_OK == dwarf_attr( die, DW_AT_linkage_name, &attr_data, 0 ) )
     {
         dwarf_formstring( attr_data, &manglename, 0 );
     }
+    else if ( ( abstract_origin_die ) && ( DW_DLV_OK == dwarf_attr( abstract_origin_die, DW_AT_linkage_name, &attr_data, 0 ) ) )
+    {
+        dwarf_formstring( attr_data, &manglename, 0 );
+    }
 
     if ( DW_DLV_OK != dwarf_diename( die, &name, 0 ) )
     {
-        /* Name will be hidden in a specification reference */
-        attr_tag = DW_AT_specification;
-
-        if ( dwarf_attr( die, attr_tag, &attr_data, 0 ) == DW_DLV_OK )
+        if ( ( abstract_origin_die ) && ( DW_DLV_OK == dwarf_diename( abstract_origin_die, &name, 0 ) ) )
+        {
+            /* The declaration coordinates come from the abstract definition too */
+            specification_die = abstract_origin_die;
+        }
+        else
         {
-            dwarf_attr( die, attr_tag, &attr_data, 0 );
+            /* Name will be hidden in a specification reference */
+            attr_tag = DW_AT_specification;
 
-            if ( DW_DLV_OK == dwarf_global_formref( attr_data, &specification_offset, 0 ) )
+            if ( dwarf_attr( ( abstract_origin_die ) ? abstract_origin_die : die, attr_tag, &attr_data, 0 ) == DW_DLV_OK )
             {
-                dwarf_offdie_b( dbg, specification_offset, IS_INFO, &specification_die, 0 );
-                dwarf_diename( specification_die, &name, 0 );
+                if ( DW_DLV_OK == dwarf_global_formref( attr_data, &specification_offset, 0 ) )
+                {
+                    dwarf_offdie_b( dbg, specification_offset, IS_INFO, &specification_die, 0 );
+                    dwarf_diename( specification_die, &name, 0 );
+                }
             }
         }
     }
@@ -466,7 +751,7 @@ static void _processDie( struct symbol *p, Dwarf_Debug dbg, Dwarf_Die die, int l
 
         if ( ( tag == DW_TAG_subprogram ) || ( tag == DW_TAG_inlined_subroutine ) )
         {
-            _processFunctionDie( p, dbg, sib, filenameN, producerN, cu_base_addr );
+            _processFunctionDie( p, dbg, sib, tag, filenameN, producerN, cu_base_addr );
         }
     }
 
@@ -508,106 +793,989 @@ static char *_joinPaths( const char *p1, const char *p2 )
     }
 }
 
+// ====================================================================================================
+// Per-CU differential cache. Incremental firmware builds typically change a handful of
+// compilation units, so each CU's parsed records are kept keyed by a hash of its
+// .debug_info bytes. On reload, units whose bytes are unchanged are inflated straight
+// from the cache and only the changed ones pay for a DIE walk and line-program run.
 // ====================================================================================================
 
-static bool _readLines( struct symbol *p )
+#define CUCACHE_SUFFIX  ".cucache"
+#define CUCACHE_MAGIC   (0x43554944)             /* 'CUID' */
+#define CUCACHE_VERSION (1)
+
+struct cuCacheFileHeader
 {
-    Dwarf_Debug dbg;
-    Dwarf_Error err;
-    Dwarf_Unsigned cu_header_length = 0;
-    Dwarf_Half     version_stamp = 0;
-    Dwarf_Off      abbrev_offset = 0;
-    Dwarf_Addr     cu_low_addr;
-    Dwarf_Half     address_size = 0;
-    Dwarf_Unsigned next_cu_header = 0;
-    Dwarf_Die      cu_die = NULL;
+    uint32_t magic;                              /* Identification of a per-CU cache file */
+    uint32_t version;                            /* Layout version */
+    uint32_t ncu;                                /* Number of CU records following */
+};
 
-    bool retval = false;
-    Dwarf_Half dw_length_size = 0;
-    Dwarf_Half dw_extension_size = 0;
-    Dwarf_Sig8 dw_type_signature;
-    Dwarf_Unsigned dw_typeoffset = 0;
-    Dwarf_Half dw_header_cu_type = DW_UT_compile;
+/* One prior CU record, pointing into the loaded blob */
+struct cuCacheEntry
+{
+    uint64_t hash;                               /* Hash of the CU's .debug_info bytes */
+    const uint8_t *payload;                      /* Serialized records for the unit */
+    size_t len;                                  /* Length of the payload */
+};
 
-    char *name;
-    char *producer;
-    char *compdir;
+struct cuCacheIndex
+{
+    uint8_t *blob;                               /* The whole cache file, read into memory */
+    struct cuCacheEntry *e;                      /* Index over the records in it */
+    unsigned int n;                              /* Number of records */
+};
 
-    unsigned int filenameN;
-    unsigned int producerN;
+// ====================================================================================================
 
-    if ( 0 != dwarf_init_b( p->fd, DW_GROUPNUMBER_ANY, NULL, NULL, &dbg, &err ) )
+static uint64_t _fnv64( const uint8_t *d, size_t len )
+
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while ( len-- )
     {
-        return false;
+        h = ( h ^ *d++ ) * 0x100000001b3ULL;
     }
 
-    struct Dwarf_Printf_Callback_Info_s print_setup =
-    {
-        .dp_user_pointer = p,
-        .dp_fptr = &_dwarf_print,
-        .dp_buffer = _print_buffer,
-        .dp_buffer_len = DP_MAX_LINE_LEN,
-        .dp_buffer_user_provided = true,
-        .dp_reserved = NULL
+    return h;
+}
 
-    };
+// ====================================================================================================
 
-    dwarf_register_printf_callback( dbg, &print_setup );
+static void _cachePutString( FILE *f, const char *s )
 
-    /* Add an empty string to each string table, so the 0th element is the empty string in all cases */
-    for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
+{
+    uint32_t l = s ? strlen( s ) + 1 : 0;
+    fwrite( &l, sizeof( l ), 1, f );
+
+    if ( l )
     {
-        _findOrAddString( "", &p->stringTable[pt],  &p->tableLen[pt] );
+        fwrite( s, l, 1, f );
     }
+}
 
-    /* 1: Collect the functions and lines */
-    /* ---------------------------------- */
-    while ( true )
+// ====================================================================================================
+
+static char *_cacheGetString( const uint8_t **rp, const uint8_t *erp )
+
+/* Pull a counted string out of the mapped cache, or NULL if it's absent or the map is truncated */
+
+{
+    uint32_t l;
+
+    if ( *rp + sizeof( l ) > erp )
     {
-        memset( &dw_type_signature, 0, sizeof( dw_type_signature ) );
+        return NULL;
+    }
 
-        if ( DW_DLV_OK != dwarf_next_cu_header_d( dbg, true, &cu_header_length,
-                &version_stamp, &abbrev_offset, &address_size,
-                &dw_length_size, &dw_extension_size, &dw_type_signature,
-                &dw_typeoffset, &next_cu_header, &dw_header_cu_type, 0 ) )
-        {
-            break;
-        }
+    memcpy( &l, *rp, sizeof( l ) );
+    *rp += sizeof( l );
 
-        dwarf_siblingof_b( dbg, NULL, IS_INFO, &cu_die, 0 );
+    if ( ( !l ) || ( *rp + l > erp ) || ( ( *rp )[l - 1] != 0 ) )
+    {
+        return NULL;
+    }
 
-        dwarf_diename( cu_die, &name, 0 );
-        dwarf_die_text( cu_die, DW_AT_producer, &producer, 0 );
-        dwarf_die_text( cu_die, DW_AT_comp_dir, &compdir, 0 );
+    char *s = strdup( ( const char * )*rp );
+    *rp += l;
+    return s;
+}
 
-        /* Need to construct the fully qualified filename from the directory + filename */
-        char *s = _joinPaths( compdir, name );
-        filenameN  = _findOrAddString( s, &p->stringTable[PT_FILENAME],  &p->tableLen[PT_FILENAME] );
-        free( s );
-        producerN =  _findOrAddString( producer, &p->stringTable[PT_PRODUCER],  &p->tableLen[PT_PRODUCER] );
+// ====================================================================================================
 
-        /* Kickoff the process for the DIE and its children to get the functions in this cu */
+static char *_cuCacheName( const char *elfFile )
 
-        dwarf_lowpc( cu_die, &cu_low_addr, 0 );
-        _processDie( p, dbg, cu_die, 0, filenameN, producerN, cu_low_addr );
+{
+    char *n = ( char * )malloc( strlen( elfFile ) + strlen( CUCACHE_SUFFIX ) + 1 );
+    MEMCHECK( n, NULL );
+    strcpy( n, elfFile );
+    strcat( n, CUCACHE_SUFFIX );
+    return n;
+}
 
-        /* ...and the source lines */
-        _getSourceLines( p, dbg, cu_die );
+// ====================================================================================================
 
-        dwarf_dealloc( dbg, cu_die, DW_DLA_DIE );
-    }
+static void _cuCacheFree( struct cuCacheIndex *i )
 
-    if ( p->nlines && p->nfunc )
+{
+    if ( i )
     {
-        /* 2: We have the lines and functions. Clean them up and interlink them so they're useful to applications */
-        /* ------------------------------------------------------------------------------------------------------ */
-        /* Sort tables into address order, just in case they're not ... no gaurantees from the DWARF */
-        qsort( p->line, p->nlines, sizeof( struct symbolLineStore * ), _compareLineMem );
-        qsort( p->func, p->nfunc, sizeof( struct symbolFunctionStore * ), _compareFunc );
+        free( i->blob );
+        free( i->e );
+        free( i );
+    }
+}
 
-        /* Combine addresses in the lines table which have the same memory location...those aren't too useful for us      */
-        int nlines = 0;
-        struct symbolLineStore **nls = NULL;
+// ====================================================================================================
+
+static struct cuCacheIndex *_cuCacheLoad( const char *elfFile )
+
+/* Read the previous per-CU cache and index its records. Anything suspicious abandons the lot. */
+
+{
+    char *cname = _cuCacheName( elfFile );
+    FILE *f = fopen( cname, "rb" );
+    free( cname );
+
+    if ( !f )
+    {
+        return NULL;
+    }
+
+    struct cuCacheIndex *i = ( struct cuCacheIndex * )calloc( 1, sizeof( struct cuCacheIndex ) );
+    MEMCHECK( i, NULL );
+
+    fseek( f, 0, SEEK_END );
+    long flen = ftell( f );
+    fseek( f, 0, SEEK_SET );
+
+    struct cuCacheFileHeader hdr;
+
+    if ( ( flen < ( long )sizeof( hdr ) ) || ( 1 != fread( &hdr, sizeof( hdr ), 1, f ) ) ||
+            ( hdr.magic != CUCACHE_MAGIC ) || ( hdr.version != CUCACHE_VERSION ) )
+    {
+        fclose( f );
+        free( i );
+        return NULL;
+    }
+
+    size_t bloblen = flen - sizeof( hdr );
+    i->blob = ( uint8_t * )malloc( bloblen );
+    MEMCHECK( i->blob, NULL );
+
+    if ( 1 != fread( i->blob, bloblen, 1, f ) )
+    {
+        fclose( f );
+        _cuCacheFree( i );
+        return NULL;
+    }
+
+    fclose( f );
+
+    const uint8_t *rp = i->blob;
+    const uint8_t *erp = i->blob + bloblen;
+    i->e = ( struct cuCacheEntry * )calloc( hdr.ncu, sizeof( struct cuCacheEntry ) );
+    MEMCHECK( i->e, NULL );
+
+    for ( uint32_t c = 0; c < hdr.ncu; c++ )
+    {
+        uint64_t hash;
+        uint32_t plen;
+
+        if ( rp + sizeof( hash ) + sizeof( plen ) > erp )
+        {
+            _cuCacheFree( i );
+            return NULL;
+        }
+
+        memcpy( &hash, rp, sizeof( hash ) );
+        rp += sizeof( hash );
+        memcpy( &plen, rp, sizeof( plen ) );
+        rp += sizeof( plen );
+
+        if ( rp + plen > erp )
+        {
+            _cuCacheFree( i );
+            return NULL;
+        }
+
+        i->e[c].hash    = hash;
+        i->e[c].payload = rp;
+        i->e[c].len     = plen;
+        i->n++;
+        rp += plen;
+    }
+
+    return i;
+}
+
+// ====================================================================================================
+
+static const struct cuCacheEntry *_cuCacheLookup( const struct cuCacheIndex *i, uint64_t hash )
+
+{
+    if ( ( i ) && ( hash ) )
+    {
+        for ( unsigned int c = 0; c < i->n; c++ )
+        {
+            if ( i->e[c].hash == hash )
+            {
+                return &i->e[c];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// ====================================================================================================
+
+static bool _cuCacheInflate( struct symbol *p, const uint8_t *payload, size_t len )
+
+/* Recreate one CU's records in the scratch set, exactly as the parse would have made them */
+
+{
+    const uint8_t *rp = payload;
+    const uint8_t *erp = payload + len;
+    char **locals = NULL;
+    bool retval = false;
+    uint32_t counts[3];
+
+    if ( rp + sizeof( counts ) > erp )
+    {
+        return false;
+    }
+
+    memcpy( counts, rp, sizeof( counts ) );
+    rp += sizeof( counts );
+
+    locals = ( char ** )calloc( counts[0], sizeof( char * ) );
+    MEMCHECK( locals, false );
+
+    for ( uint32_t i = 0; i < counts[0]; i++ )
+    {
+        if ( NULL == ( locals[i] = _cacheGetString( &rp, erp ) ) )
+        {
+            goto terminate;
+        }
+    }
+
+    for ( uint32_t i = 0; i < counts[1]; i++ )
+    {
+        uint64_t addrs[2];
+        uint32_t meta[6];
+
+        if ( rp + sizeof( addrs ) + sizeof( meta ) > erp )
+        {
+            goto terminate;
+        }
+
+        memcpy( addrs, rp, sizeof( addrs ) );
+        rp += sizeof( addrs );
+        memcpy( meta, rp, sizeof( meta ) );
+        rp += sizeof( meta );
+
+        char *funcname = _cacheGetString( &rp, erp );
+        char *manglename = _cacheGetString( &rp, erp );
+
+        if ( ( !funcname ) || ( !manglename ) || ( meta[0] >= counts[0] ) || ( meta[1] >= counts[0] ) )
+        {
+            free( funcname );
+            free( manglename );
+            goto terminate;
+        }
+
+        p->func = ( struct symbolFunctionStore ** )realloc( p->func, sizeof( struct symbolFunctionStore * ) * ( p->nfunc + 1 ) );
+        struct symbolFunctionStore *fn = p->func[p->nfunc++] = ( struct symbolFunctionStore * )calloc( 1, sizeof( struct symbolFunctionStore ) );
+        MEMCHECK( fn, false );
+
+        fn->lowaddr   = addrs[0];
+        fn->highaddr  = addrs[1];
+        fn->producer  = _findOrAddString( locals[meta[0]], &p->stringTable[PT_PRODUCER], &p->tableLen[PT_PRODUCER] );
+        fn->filename  = _findOrAddString( locals[meta[1]], &p->stringTable[PT_FILENAME], &p->tableLen[PT_FILENAME] );
+        fn->startline = meta[2];
+        fn->startcol  = meta[3];
+        fn->endline   = meta[4];
+        fn->isinline  = ( meta[5] != 0 );
+        fn->funcname  = funcname;
+
+        if ( *manglename )
+        {
+            fn->manglename = manglename;
+        }
+        else
+        {
+            free( manglename );
+        }
+    }
+
+    for ( uint32_t i = 0; i < counts[2]; i++ )
+    {
+        uint64_t lowaddr;
+        uint32_t meta[2];
+
+        if ( rp + sizeof( lowaddr ) + sizeof( meta ) > erp )
+        {
+            goto terminate;
+        }
+
+        memcpy( &lowaddr, rp, sizeof( lowaddr ) );
+        rp += sizeof( lowaddr );
+        memcpy( meta, rp, sizeof( meta ) );
+        rp += sizeof( meta );
+
+        if ( meta[0] >= counts[0] )
+        {
+            goto terminate;
+        }
+
+        p->line = ( struct symbolLineStore ** )realloc( p->line, sizeof( struct symbolLineStore * ) * ( p->nlines + 1 ) );
+        struct symbolLineStore *l = p->line[p->nlines++] = ( struct symbolLineStore * )calloc( 1, sizeof( struct symbolLineStore ) );
+        MEMCHECK( l, false );
+
+        l->lowaddr   = lowaddr;
+        l->startline = meta[1];
+        l->isinline  = true;
+        l->filename  = _findOrAddString( locals[meta[0]], &p->stringTable[PT_FILENAME], &p->tableLen[PT_FILENAME] );
+    }
+
+    retval = true;
+
+terminate:
+
+    for ( uint32_t i = 0; i < counts[0]; i++ )
+    {
+        free( locals[i] );
+    }
+
+    free( locals );
+    return retval;
+}
+
+// ====================================================================================================
+
+static uint32_t _localString( const char *s, char ***locals, uint32_t *nlocals )
+
+/* Find or add a string in a CU-local serialization table */
+
+{
+    for ( uint32_t i = 0; i < *nlocals; i++ )
+    {
+        if ( !strcmp( ( *locals )[i], s ) )
+        {
+            return i;
+        }
+    }
+
+    *locals = ( char ** )realloc( *locals, sizeof( char * ) * ( *nlocals + 1 ) );
+    ( *locals )[*nlocals] = ( char * )s;
+    return ( *nlocals )++;
+}
+
+// ====================================================================================================
+
+static void _cuCacheWrite( struct lineWorkerContext *ctx, int nworkers, const char *elfFile )
+
+/* Serialize every worker's per-CU slices, before the merge disturbs them. Failure is
+ * harmless...the next reload just parses everything again.
+ */
+
+{
+    char *cname = _cuCacheName( elfFile );
+    FILE *f = fopen( cname, "wb" );
+    free( cname );
+
+    if ( !f )
+    {
+        return;
+    }
+
+    struct cuCacheFileHeader hdr = { .magic = CUCACHE_MAGIC, .version = CUCACHE_VERSION, .ncu = 0 };
+    fwrite( &hdr, sizeof( hdr ), 1, f );
+
+    for ( int w = 0; w < nworkers; w++ )
+    {
+        struct symbol *p = &ctx[w].scratch;
+
+        for ( unsigned int c = 0; c < ctx[w].ncu; c++ )
+        {
+            struct cuExtent *x = &ctx[w].cu[c];
+
+            if ( !x->hash )
+            {
+                continue;
+            }
+
+            /* Collect the strings this unit's records reference into a local table */
+            char **locals = NULL;
+            uint32_t nlocals = 0;
+
+            for ( uint32_t i = x->f0; i < x->f1; i++ )
+            {
+                _localString( p->stringTable[PT_PRODUCER][p->func[i]->producer], &locals, &nlocals );
+                _localString( p->stringTable[PT_FILENAME][p->func[i]->filename], &locals, &nlocals );
+            }
+
+            for ( uint32_t i = x->l0; i < x->l1; i++ )
+            {
+                _localString( p->stringTable[PT_FILENAME][p->line[i]->filename], &locals, &nlocals );
+            }
+
+            fwrite( &x->hash, sizeof( x->hash ), 1, f );
+            uint32_t plen = 0;
+            long lenPos = ftell( f );
+            fwrite( &plen, sizeof( plen ), 1, f );
+            long payloadStart = ftell( f );
+
+            uint32_t counts[3] = { nlocals, x->f1 - x->f0, x->l1 - x->l0 };
+            fwrite( counts, sizeof( counts ), 1, f );
+
+            for ( uint32_t i = 0; i < nlocals; i++ )
+            {
+                _cachePutString( f, locals[i] );
+            }
+
+            for ( uint32_t i = x->f0; i < x->f1; i++ )
+            {
+                struct symbolFunctionStore *fn = p->func[i];
+                uint64_t addrs[2] = { fn->lowaddr, fn->highaddr };
+                uint32_t meta[6] =
+                {
+                    _localString( p->stringTable[PT_PRODUCER][fn->producer], &locals, &nlocals ),
+                    _localString( p->stringTable[PT_FILENAME][fn->filename], &locals, &nlocals ),
+                    fn->startline, fn->startcol, fn->endline, fn->isinline ? 1 : 0
+                };
+                fwrite( addrs, sizeof( addrs ), 1, f );
+                fwrite( meta, sizeof( meta ), 1, f );
+                _cachePutString( f, fn->funcname );
+                _cachePutString( f, fn->manglename ? fn->manglename : "" );
+            }
+
+            for ( uint32_t i = x->l0; i < x->l1; i++ )
+            {
+                struct symbolLineStore *l = p->line[i];
+                uint64_t lowaddr = l->lowaddr;
+                uint32_t meta[2] = { _localString( p->stringTable[PT_FILENAME][l->filename], &locals, &nlocals ), l->startline };
+                fwrite( &lowaddr, sizeof( lowaddr ), 1, f );
+                fwrite( meta, sizeof( meta ), 1, f );
+            }
+
+            /* Now the length is known, go back and fill it in */
+            long payloadEnd = ftell( f );
+            plen = payloadEnd - payloadStart;
+            fseek( f, lenPos, SEEK_SET );
+            fwrite( &plen, sizeof( plen ), 1, f );
+            fseek( f, payloadEnd, SEEK_SET );
+
+            free( locals );
+            hdr.ncu++;
+        }
+    }
+
+    fseek( f, 0, SEEK_SET );
+    fwrite( &hdr, sizeof( hdr ), 1, f );
+    fclose( f );
+}
+
+// ====================================================================================================
+
+static uint8_t *_loadDebugInfo( const char *elfFile, size_t *len )
+
+/* Pull a copy of the .debug_info section so CUs can be hashed for change detection */
+
+{
+    Elf *e;
+    Elf_Scn *scn = NULL;
+    GElf_Shdr shdr;
+    size_t shstrndx;
+    char *name;
+    uint8_t *result = NULL;
+    int fd;
+
+    *len = 0;
+
+#ifndef O_BINARY
+
+    if ( ( fd = open( elfFile, O_RDONLY, 0 ) ) < 0 )
+#else
+    if ( ( fd = open( elfFile, O_RDONLY | O_BINARY, 0 ) ) < 0 )
+#endif
+    {
+        return NULL;
+    }
+
+    if ( ( elf_version( EV_CURRENT ) == EV_NONE ) || ( NULL == ( e = elf_begin( fd, ELF_C_READ, NULL ) ) ) )
+    {
+        close( fd );
+        return NULL;
+    }
+
+    if ( elf_getshdrstrndx( e, &shstrndx ) == 0 )
+    {
+        while ( ( scn = elf_nextscn( e, scn ) ) != NULL )
+        {
+            if ( ( gelf_getshdr( scn, &shdr ) == &shdr ) &&
+                    ( NULL != ( name = elf_strptr( e, shstrndx, shdr.sh_name ) ) ) &&
+                    ( !strcmp( name, ".debug_info" ) ) )
+            {
+                Elf_Data *data = elf_rawdata( scn, NULL );
+
+                if ( ( data ) && ( data->d_buf ) && ( data->d_size ) )
+                {
+                    result = ( uint8_t * )malloc( data->d_size );
+                    MEMCHECK( result, NULL );
+                    memcpy( result, data->d_buf, data->d_size );
+                    *len = data->d_size;
+                }
+
+                break;
+            }
+        }
+    }
+
+    elf_end( e );
+    close( fd );
+    return result;
+}
+
+// ====================================================================================================
+
+static void *_readLinesWorker( void *arg )
+
+/* Walk the compilation units of the file with a private Dwarf cursor, processing only the CUs
+ * allocated to this worker in the round-robin, and accumulating into the private scratch set.
+ */
+
+{
+    struct lineWorkerContext *c = ( struct lineWorkerContext * )arg;
+    struct symbol *p = &c->scratch;
+    Dwarf_Debug dbg;
+    Dwarf_Error err;
+    Dwarf_Unsigned cu_header_length = 0;
+    Dwarf_Half     version_stamp = 0;
+    Dwarf_Off      abbrev_offset = 0;
+    Dwarf_Addr     cu_low_addr;
+    Dwarf_Half     address_size = 0;
+    Dwarf_Unsigned next_cu_header = 0;
+    Dwarf_Die      cu_die = NULL;
+
+    Dwarf_Half dw_length_size = 0;
+    Dwarf_Half dw_extension_size = 0;
+    Dwarf_Sig8 dw_type_signature;
+    Dwarf_Unsigned dw_typeoffset = 0;
+    Dwarf_Half dw_header_cu_type = DW_UT_compile;
+
+    char *name;
+    char *producer;
+    char *compdir;
+
+    unsigned int filenameN;
+    unsigned int producerN;
+
+    int cuNumber = 0;
+    uint64_t cuStart = 0;
+    int fd;
+
+#ifndef O_BINARY
+
+    if ( ( fd = open( c->filename, O_RDONLY, 0 ) ) < 0 )
+#else
+    if ( ( fd = open( c->filename, O_RDONLY | O_BINARY, 0 ) ) < 0 )
+#endif
+    {
+        return NULL;
+    }
+
+    if ( 0 != dwarf_init_b( fd, DW_GROUPNUMBER_ANY, NULL, NULL, &dbg, &err ) )
+    {
+        close( fd );
+        return NULL;
+    }
+
+    struct Dwarf_Printf_Callback_Info_s print_setup =
+    {
+        .dp_user_pointer = p,
+        .dp_fptr = &_dwarf_print,
+        .dp_buffer = c->printBuffer,
+        .dp_buffer_len = DP_MAX_LINE_LEN,
+        .dp_buffer_user_provided = true,
+        .dp_reserved = NULL
+
+    };
+
+    dwarf_register_printf_callback( dbg, &print_setup );
+
+    /* Add an empty string to each string table, so the 0th element is the empty string in all cases */
+    for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
+    {
+        _findOrAddString( "", &p->stringTable[pt],  &p->tableLen[pt] );
+    }
+
+    while ( true )
+    {
+        memset( &dw_type_signature, 0, sizeof( dw_type_signature ) );
+
+        if ( DW_DLV_OK != dwarf_next_cu_header_d( dbg, true, &cu_header_length,
+                &version_stamp, &abbrev_offset, &address_size,
+                &dw_length_size, &dw_extension_size, &dw_type_signature,
+                &dw_typeoffset, &next_cu_header, &dw_header_cu_type, 0 ) )
+        {
+            break;
+        }
+
+        uint64_t thisStart = cuStart;
+        cuStart = next_cu_header;
+
+        if ( ( cuNumber++ % c->stride ) != c->offset )
+        {
+            /* Another worker is dealing with this CU */
+            continue;
+        }
+
+        /* Hash this unit's raw bytes, so an unchanged unit can come from the cache */
+        uint64_t cuHash = 0;
+
+        if ( ( c->debugInfo ) && ( next_cu_header > thisStart ) && ( next_cu_header <= c->debugInfoLen ) )
+        {
+            cuHash = _fnv64( &c->debugInfo[thisStart], next_cu_header - thisStart );
+        }
+
+        uint32_t f0 = p->nfunc;
+        uint32_t l0 = p->nlines;
+
+        const struct cuCacheEntry *prior = _cuCacheLookup( c->oldCache, cuHash );
+
+        if ( ( prior ) && ( _cuCacheInflate( p, prior->payload, prior->len ) ) )
+        {
+            /* The unit is unchanged since last time...no need to walk it again */
+            c->reused++;
+        }
+        else
+        {
+            /* Rewind to the slice as it stood before any partial inflate */
+            while ( p->nfunc > f0 )
+            {
+                struct symbolFunctionStore *fn = p->func[--p->nfunc];
+                free( fn->funcname );
+                free( fn->manglename );
+                free( fn );
+            }
+
+            while ( p->nlines > l0 )
+            {
+                free( p->line[--p->nlines] );
+            }
+
+            dwarf_siblingof_b( dbg, NULL, IS_INFO, &cu_die, 0 );
+
+            dwarf_diename( cu_die, &name, 0 );
+            dwarf_die_text( cu_die, DW_AT_producer, &producer, 0 );
+            dwarf_die_text( cu_die, DW_AT_comp_dir, &compdir, 0 );
+
+            /* Need to construct the fully qualified filename from the directory + filename */
+            char *s = _joinPaths( compdir, name );
+            filenameN  = _findOrAddString( s, &p->stringTable[PT_FILENAME],  &p->tableLen[PT_FILENAME] );
+            free( s );
+            producerN =  _findOrAddString( producer, &p->stringTable[PT_PRODUCER],  &p->tableLen[PT_PRODUCER] );
+
+            /* Kickoff the process for the DIE and its children to get the functions in this cu */
+
+            dwarf_lowpc( cu_die, &cu_low_addr, 0 );
+            _processDie( p, dbg, cu_die, 0, filenameN, producerN, cu_low_addr );
+
+            /* ...and the source lines */
+            _getSourceLines( p, dbg, cu_die );
+
+            dwarf_dealloc( dbg, cu_die, DW_DLA_DIE );
+        }
+
+        /* Record the slice this CU contributed, so it can be cached for the next reload */
+        c->cu = ( struct cuExtent * )realloc( c->cu, sizeof( struct cuExtent ) * ( c->ncu + 1 ) );
+        MEMCHECK( c->cu, NULL );
+        c->cu[c->ncu++] = ( struct cuExtent )
+        {
+            .hash = cuHash, .f0 = f0, .f1 = p->nfunc, .l0 = l0, .l1 = p->nlines
+        };
+    }
+
+    dwarf_finish( dbg );
+    close( fd );
+    c->ok = true;
+    return NULL;
+}
+
+// ====================================================================================================
+
+static void _mergeWorkerResults( struct symbol *p, struct symbol *w )
+
+/* Fold a worker's private function and line tables into the main symbol set, remapping its
+ * private string table indices into the shared tables as we go.
+ */
+
+{
+    unsigned int *remap[PT_NUMTABLES];
+
+    for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
+    {
+        remap[pt] = ( unsigned int * )malloc( sizeof( unsigned int ) * w->tableLen[pt] );
+        MEMCHECKV( remap[pt] );
+
+        for ( unsigned int i = 0; i < w->tableLen[pt]; i++ )
+        {
+            remap[pt][i] = _findOrAddString( w->stringTable[pt][i], &p->stringTable[pt], &p->tableLen[pt] );
+            free( w->stringTable[pt][i] );
+        }
+
+        free( w->stringTable[pt] );
+        w->stringTable[pt] = NULL;
+        w->tableLen[pt] = 0;
+    }
+
+    if ( w->nfunc )
+    {
+        p->func = ( struct symbolFunctionStore ** )realloc( p->func, sizeof( struct symbolFunctionStore * ) * ( p->nfunc + w->nfunc ) );
+
+        for ( unsigned int i = 0; i < w->nfunc; i++ )
+        {
+            struct symbolFunctionStore *f = w->func[i];
+            f->filename = remap[PT_FILENAME][f->filename];
+            f->producer = remap[PT_PRODUCER][f->producer];
+            p->func[p->nfunc++] = f;
+        }
+
+        free( w->func );
+        w->func = NULL;
+        w->nfunc = 0;
+    }
+
+    if ( w->nlines )
+    {
+        p->line = ( struct symbolLineStore ** )realloc( p->line, sizeof( struct symbolLineStore * ) * ( p->nlines + w->nlines ) );
+
+        for ( unsigned int i = 0; i < w->nlines; i++ )
+        {
+            struct symbolLineStore *l = w->line[i];
+            l->filename = remap[PT_FILENAME][l->filename];
+            p->line[p->nlines++] = l;
+        }
+
+        free( w->line );
+        w->line = NULL;
+        w->nlines = 0;
+    }
+
+    for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
+    {
+        free( remap[pt] );
+    }
+}
+
+// ====================================================================================================
+
+static void _buildInlineIndex( struct symbol *p )
+
+/* Flatten the (possibly nested) inline instance extents into disjoint spans in which the
+ * innermost instance wins, so an address resolves with one binary search regardless of
+ * nesting depth. Worst case is two spans per instance.
+ */
+
+{
+    free( p->inlRange );
+    p->inlRange = NULL;
+    p->ninlRange = 0;
+
+    if ( !p->ninlfunc )
+    {
+        return;
+    }
+
+    qsort( p->inlfunc, p->ninlfunc, sizeof( struct symbolFunctionStore * ), _compareInlineFunc );
+
+    p->inlRange = ( struct symbolInlineRange * )malloc( sizeof( struct symbolInlineRange ) * 2 * p->ninlfunc );
+    MEMCHECKV( p->inlRange );
+
+    struct symbolFunctionStore **stack = ( struct symbolFunctionStore ** )malloc( sizeof( struct symbolFunctionStore * ) * p->ninlfunc );
+    MEMCHECKV( stack );
+
+    unsigned int depth = 0;
+    symbolMemaddr cursor = 0;
+
+    for ( unsigned int i = 0; i <= p->ninlfunc; i++ )
+    {
+        struct symbolFunctionStore *f = ( i < p->ninlfunc ) ? p->inlfunc[i] : NULL;
+
+        /* Retire everything on the stack that ends before this instance begins */
+        while ( ( depth ) && ( ( !f ) || ( stack[depth - 1]->highaddr < f->lowaddr ) ) )
+        {
+            struct symbolFunctionStore *top = stack[--depth];
+
+            if ( cursor <= top->highaddr )
+            {
+                p->inlRange[p->ninlRange].lowaddr  = cursor;
+                p->inlRange[p->ninlRange].highaddr = top->highaddr;
+                p->inlRange[p->ninlRange].func     = top;
+                p->ninlRange++;
+                cursor = top->highaddr + 1;
+            }
+        }
+
+        if ( !f )
+        {
+            break;
+        }
+
+        /* The enclosing instance owns the gap up to where the nested one starts */
+        if ( ( depth ) && ( cursor < f->lowaddr ) )
+        {
+            p->inlRange[p->ninlRange].lowaddr  = cursor;
+            p->inlRange[p->ninlRange].highaddr = f->lowaddr - 1;
+            p->inlRange[p->ninlRange].func     = stack[depth - 1];
+            p->ninlRange++;
+        }
+
+        stack[depth++] = f;
+        cursor = f->lowaddr;
+    }
+
+    free( stack );
+}
+
+// ====================================================================================================
+
+static void _partitionInlines( struct symbol *p )
+
+/* Move inline instances out of the main function table into their own set. They overlap the
+ * functions they were inlined into, so leaving them in place would break the binary search
+ * over function extents; instead they get the flattened span index built above.
+ */
+
+{
+    unsigned int w = 0;
+
+    for ( unsigned int i = 0; i < p->nfunc; i++ )
+    {
+        if ( p->func[i]->isinline )
+        {
+            p->inlfunc = ( struct symbolFunctionStore ** )realloc( p->inlfunc, sizeof( struct symbolFunctionStore * ) * ( p->ninlfunc + 1 ) );
+            p->inlfunc[p->ninlfunc++] = p->func[i];
+        }
+        else
+        {
+            p->func[w++] = p->func[i];
+        }
+    }
+
+    p->nfunc = w;
+
+    /* With the overlaps gone the host of each instance is findable */
+    for ( unsigned int i = 0; i < p->ninlfunc; i++ )
+    {
+        struct symbolFunctionStore **fp = ( struct symbolFunctionStore ** )bsearch( &p->inlfunc[i]->lowaddr, p->func, p->nfunc,
+                sizeof( struct symbolFunctionStore * ), _matchFunc );
+        p->inlfunc[i]->inlinedIn = fp ? *fp : NULL;
+    }
+
+    _buildInlineIndex( p );
+}
+
+// ====================================================================================================
+
+static bool _readLines( struct symbol *p )
+{
+    bool retval = false;
+    bool allok = true;
+
+#if defined( WIN32 )
+    int nworkers = 4;
+#else
+    int nworkers = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+
+    if ( nworkers < 1 )
+    {
+        nworkers = 1;
+    }
+
+    if ( nworkers > MAX_LINE_WORKERS )
+    {
+        nworkers = MAX_LINE_WORKERS;
+    }
+
+    /* 1: Collect the functions and lines, with CUs distributed round-robin over the workers */
+    /* -------------------------------------------------------------------------------------- */
+    struct lineWorkerContext *ctx = ( struct lineWorkerContext * )calloc( nworkers, sizeof( struct lineWorkerContext ) );
+    MEMCHECK( ctx, false );
+
+    /* Raw .debug_info bytes and any prior per-CU cache, for differential reload */
+    size_t debugInfoLen = 0;
+    uint8_t *debugInfo = _loadDebugInfo( p->elfFile, &debugInfoLen );
+    struct cuCacheIndex *oldCache = _cuCacheLoad( p->elfFile );
+
+    for ( int i = 0; i < nworkers; i++ )
+    {
+        ctx[i].filename     = p->elfFile;
+        ctx[i].stride       = nworkers;
+        ctx[i].offset       = i;
+        ctx[i].debugInfo    = debugInfo;
+        ctx[i].debugInfoLen = debugInfoLen;
+        ctx[i].oldCache     = oldCache;
+    }
+
+    for ( int i = 1; i < nworkers; i++ )
+    {
+        if ( pthread_create( &ctx[i].thread, NULL, &_readLinesWorker, &ctx[i] ) )
+        {
+            /* Couldn't spawn...just run this slice on the main thread instead */
+            _readLinesWorker( &ctx[i] );
+            ctx[i].thread = 0;
+        }
+    }
+
+    /* Take the first slice ourselves rather than sitting idle */
+    _readLinesWorker( &ctx[0] );
+
+    for ( int i = 1; i < nworkers; i++ )
+    {
+        if ( ctx[i].thread )
+        {
+            pthread_join( ctx[i].thread, NULL );
+        }
+    }
+
+    unsigned int reused = 0;
+    unsigned int totalCU = 0;
+
+    for ( int i = 0; i < nworkers; i++ )
+    {
+        allok = allok && ctx[i].ok;
+        reused  += ctx[i].reused;
+        totalCU += ctx[i].ncu;
+    }
+
+    /* Serialize the per-CU slices before the merge disturbs the worker scratch sets */
+    if ( allok && totalCU )
+    {
+        _cuCacheWrite( ctx, nworkers, p->elfFile );
+        genericsReport( V_INFO, "Reused %u of %u CUs from differential cache" EOL, reused, totalCU );
+    }
+
+    free( debugInfo );
+    _cuCacheFree( oldCache );
+
+    /* Add an empty string to each string table, so the 0th element is the empty string in all cases */
+    for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
+    {
+        _findOrAddString( "", &p->stringTable[pt],  &p->tableLen[pt] );
+    }
+
+    for ( int i = 0; i < nworkers; i++ )
+    {
+        _mergeWorkerResults( p, &ctx[i].scratch );
+        free( ctx[i].cu );
+    }
+
+    free( ctx );
+
+    if ( !allok )
+    {
+        return false;
+    }
+
+    if ( p->nlines && p->nfunc )
+    {
+        /* 2: We have the lines and functions. Clean them up and interlink them so they're useful to applications */
+        /* ------------------------------------------------------------------------------------------------------ */
+        /* Sort tables into address order, just in case they're not ... no gaurantees from the DWARF */
+        qsort( p->line, p->nlines, sizeof( struct symbolLineStore * ), _compareLineMem );
+        qsort( p->func, p->nfunc, sizeof( struct symbolFunctionStore * ), _compareFunc );
+
+        /* Inline instances overlap their hosts, so they can't share the function table */
+        _partitionInlines( p );
+
+        /* Combine addresses in the lines table which have the same memory location...those aren't too useful for us      */
+        int nlines = 0;
+        struct symbolLineStore **nls = NULL;
 
         for ( int i = 0; i < p->nlines - 1; i++ )
         {
@@ -670,10 +1838,19 @@ static bool _readLines( struct symbol *p )
             p->line[p->nlines - 1]->highaddr = p->line[p->nlines - 1]->lowaddr + 2;
             p->line[0]->lowaddr = p->line[0]->highaddr - 2;
 
-            /* Allocate lines to functions ... these will be in address order 'cos the lines already are */
+            /* Allocate lines to functions ... these will be in address order 'cos the lines already are, */
+            /* so a single merge against the sorted function table covers the lot */
+            unsigned int fi = 0;
+
             for ( int i = 0; i < p->nlines; i++ )
             {
-                struct symbolFunctionStore *f = symbolFunctionAt( p, p->line[i]->lowaddr );
+                while ( ( fi < p->nfunc ) && ( p->func[fi]->highaddr < p->line[i]->lowaddr ) )
+                {
+                    fi++;
+                }
+
+                struct symbolFunctionStore *f = ( ( fi < p->nfunc ) && ( p->func[fi]->lowaddr <= p->line[i]->lowaddr ) )
+                                                ? p->func[fi] : NULL;
                 p->line[i]->function = f;
                 p->line[i]->isinline = false;
 
@@ -689,48 +1866,533 @@ static bool _readLines( struct symbol *p )
         }
     }
 
-    dwarf_finish( dbg );
-
     return retval;
 }
 
 // ====================================================================================================
+// On-disk symbol cache. Parsing DWARF for a big image takes seconds; the digested function and
+// line tables serialize to a few MB which load back in tens of milliseconds. The cache sits
+// alongside the ELF, is versioned, and is keyed by a hash of the ELF contents so a rebuilt
+// image can never match a stale cache.
+// ====================================================================================================
+
+#define SYMCACHE_SUFFIX  ".symcache"
+#define SYMCACHE_MAGIC   (0x53594d43)            /* 'SYMC' */
+#define SYMCACHE_VERSION (2)
 
-static bool _loadSource( struct symbol *p )
+#define NO_FUNCTION_INDEX (0xffffffff)
 
+struct symCacheHeader
 {
-    char *r;
-    size_t l;
+    uint32_t magic;                              /* Identification of a cache file */
+    uint32_t version;                            /* Layout version of this cache file */
+    uint64_t key;                                /* Hash of the ELF this cache was digested from */
+    uint32_t tableLen[PT_NUMTABLES];             /* String table lengths */
+    uint32_t nfunc;                              /* Number of functions */
+    uint32_t ninl;                               /* Number of inline instances */
+    uint32_t nlines;                             /* Number of lines */
+};
+
+// ====================================================================================================
+
+static uint64_t _elfHash( int fd )
+
+/* FNV-1a over the whole ELF contents, used as the cache key */
+
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    uint8_t buf[65536];
+    ssize_t r;
+
+    lseek( fd, 0, SEEK_SET );
+
+    while ( ( r = read( fd, buf, sizeof( buf ) ) ) > 0 )
+    {
+        for ( ssize_t i = 0; i < r; i++ )
+        {
+            h = ( h ^ buf[i] ) * 0x100000001b3ULL;
+        }
+    }
+
+    lseek( fd, 0, SEEK_SET );
+    return h;
+}
+
+// ====================================================================================================
+
+static char *_symCacheName( const char *elfFile )
+
+{
+    char *n = ( char * )malloc( strlen( elfFile ) + strlen( SYMCACHE_SUFFIX ) + 1 );
+    MEMCHECK( n, NULL );
+    strcpy( n, elfFile );
+    strcat( n, SYMCACHE_SUFFIX );
+    return n;
+}
+
+// ====================================================================================================
+
+static void _writeSymCache( struct symbol *p, uint64_t key )
+
+/* Serialize the digested tables. Failure is harmless...we just pay the parse again next time */
+
+{
+    char *cname = _symCacheName( p->elfFile );
+    FILE *f = fopen( cname, "wb" );
+    free( cname );
+
+    if ( !f )
+    {
+        return;
+    }
+
+    struct symCacheHeader hdr =
+    {
+        .magic   = SYMCACHE_MAGIC,
+        .version = SYMCACHE_VERSION,
+        .key     = key,
+        .nfunc   = p->nfunc,
+        .ninl    = p->ninlfunc,
+        .nlines  = p->nlines
+    };
+
+    for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
+    {
+        hdr.tableLen[pt] = p->tableLen[pt];
+    }
+
+    fwrite( &hdr, sizeof( hdr ), 1, f );
+
+    for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
+    {
+        for ( unsigned int i = 0; i < p->tableLen[pt]; i++ )
+        {
+            _cachePutString( f, p->stringTable[pt][i] );
+        }
+    }
+
+    for ( unsigned int i = 0; i < p->nfunc; i++ )
+    {
+        struct symbolFunctionStore *fn = p->func[i];
+        uint64_t addrs[2] = { fn->lowaddr, fn->highaddr };
+        uint32_t meta[6] = { fn->producer, fn->filename, fn->startline, fn->startcol, fn->endline, fn->isinline ? 1 : 0 };
+
+        fwrite( addrs, sizeof( addrs ), 1, f );
+        fwrite( meta, sizeof( meta ), 1, f );
+        _cachePutString( f, fn->funcname );
+        _cachePutString( f, fn->manglename ? fn->manglename : "" );
+    }
+
+    for ( unsigned int i = 0; i < p->ninlfunc; i++ )
+    {
+        struct symbolFunctionStore *fn = p->inlfunc[i];
+        uint64_t addrs[2] = { fn->lowaddr, fn->highaddr };
+        uint32_t meta[6] = { fn->producer, fn->filename, fn->startline, fn->startcol, fn->endline, 1 };
+        uint32_t hostIndex = NO_FUNCTION_INDEX;
+
+        if ( fn->inlinedIn )
+        {
+            struct symbolFunctionStore **fp = ( struct symbolFunctionStore ** )bsearch( &fn->inlinedIn->lowaddr, p->func, p->nfunc,
+                    sizeof( struct symbolFunctionStore * ), _matchFunc );
+
+            if ( fp )
+            {
+                hostIndex = fp - p->func;
+            }
+        }
+
+        fwrite( addrs, sizeof( addrs ), 1, f );
+        fwrite( meta, sizeof( meta ), 1, f );
+        fwrite( &hostIndex, sizeof( hostIndex ), 1, f );
+        _cachePutString( f, fn->funcname );
+        _cachePutString( f, fn->manglename ? fn->manglename : "" );
+    }
+
+    for ( unsigned int i = 0; i < p->nlines; i++ )
+    {
+        struct symbolLineStore *l = p->line[i];
+        uint64_t addrs[2] = { l->lowaddr, l->highaddr };
+        uint32_t funcIndex = NO_FUNCTION_INDEX;
+
+        /* Functions are sorted and unique, so recover the index by search */
+        if ( l->function )
+        {
+            struct symbolFunctionStore **fp = ( struct symbolFunctionStore ** )bsearch( &l->lowaddr, p->func, p->nfunc,
+                    sizeof( struct symbolFunctionStore * ), _matchFunc );
+
+            if ( fp )
+            {
+                funcIndex = fp - p->func;
+            }
+        }
+
+        uint32_t meta[4] = { l->filename, l->startline, l->isinline ? 1 : 0, funcIndex };
+        fwrite( addrs, sizeof( addrs ), 1, f );
+        fwrite( meta, sizeof( meta ), 1, f );
+    }
+
+    fclose( f );
+}
+
+// ====================================================================================================
+
+static bool _readSymCache( struct symbol *p, uint64_t key )
+
+/* Rebuild the function and line tables from the mapped cache file. Any inconsistency at all
+ * abandons the cache and falls back to a full parse.
+ */
+
+{
+    struct symCacheHeader hdr;
+    bool retval = false;
+    uint8_t *map = NULL;
+    size_t maplen = 0;
+    int fd;
+
+    char *cname = _symCacheName( p->elfFile );
+#ifndef O_BINARY
+    fd = open( cname, O_RDONLY, 0 );
+#else
+    fd = open( cname, O_RDONLY | O_BINARY, 0 );
+#endif
+    free( cname );
+
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    struct stat st;
+
+    if ( ( fstat( fd, &st ) < 0 ) || ( st.st_size < ( off_t )sizeof( hdr ) ) )
+    {
+        close( fd );
+        return false;
+    }
+
+    maplen = st.st_size;
+
+#if !defined( WIN32 )
+    map = ( uint8_t * )mmap( NULL, maplen, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+    if ( map == MAP_FAILED )
+    {
+        map = NULL;
+    }
+
+#endif
+
+    if ( !map )
+    {
+        /* No mapping available...fall back to reading the whole thing */
+        map = ( uint8_t * )malloc( maplen );
+        MEMCHECK( map, false );
+
+        if ( read( fd, map, maplen ) != ( ssize_t )maplen )
+        {
+            free( map );
+            close( fd );
+            return false;
+        }
+
+        maplen = 0;           /* Flag that this is owned memory, not a mapping */
+    }
+
+    const uint8_t *rp = map;
+    const uint8_t *erp = map + st.st_size;
+
+    memcpy( &hdr, rp, sizeof( hdr ) );
+    rp += sizeof( hdr );
+
+    if ( ( hdr.magic != SYMCACHE_MAGIC ) || ( hdr.version != SYMCACHE_VERSION ) || ( hdr.key != key ) )
+    {
+        goto terminate;
+    }
+
+    /* Pull the string tables */
+    for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
+    {
+        for ( uint32_t i = 0; i < hdr.tableLen[pt]; i++ )
+        {
+            char *s = _cacheGetString( &rp, erp );
+
+            if ( !s )
+            {
+                goto terminate;
+            }
+
+            p->stringTable[pt] = ( char ** )realloc( p->stringTable[pt], sizeof( char * ) * ( p->tableLen[pt] + 1 ) );
+            p->stringTable[pt][p->tableLen[pt]++] = s;
+        }
+    }
+
+    /* ...then the functions */
+    for ( uint32_t i = 0; i < hdr.nfunc; i++ )
+    {
+        uint64_t addrs[2];
+        uint32_t meta[6];
+
+        if ( rp + sizeof( addrs ) + sizeof( meta ) > erp )
+        {
+            goto terminate;
+        }
+
+        memcpy( addrs, rp, sizeof( addrs ) );
+        rp += sizeof( addrs );
+        memcpy( meta, rp, sizeof( meta ) );
+        rp += sizeof( meta );
+
+        if ( ( meta[0] >= p->tableLen[PT_PRODUCER] ) || ( meta[1] >= p->tableLen[PT_FILENAME] ) )
+        {
+            goto terminate;
+        }
+
+        char *funcname = _cacheGetString( &rp, erp );
+        char *manglename = _cacheGetString( &rp, erp );
 
-    /* We need to aqquire source code for all of the files that we have an entry in the stringtable, so let's start by making room */
-    p->source = ( struct symbolSourcecodeStore ** )calloc( 1, sizeof( struct symbolSourcecodeStore * )*p->tableLen[PT_FILENAME] );
+        if ( ( !funcname ) || ( !manglename ) )
+        {
+            free( funcname );
+            free( manglename );
+            goto terminate;
+        }
+
+        p->func = ( struct symbolFunctionStore ** )realloc( p->func, sizeof( struct symbolFunctionStore * ) * ( p->nfunc + 1 ) );
+        struct symbolFunctionStore *fn = p->func[p->nfunc++] = ( struct symbolFunctionStore * )calloc( 1, sizeof( struct symbolFunctionStore ) );
+        MEMCHECK( fn, false );
+
+        fn->lowaddr   = addrs[0];
+        fn->highaddr  = addrs[1];
+        fn->producer  = meta[0];
+        fn->filename  = meta[1];
+        fn->startline = meta[2];
+        fn->startcol  = meta[3];
+        fn->endline   = meta[4];
+        fn->isinline  = ( meta[5] != 0 );
+        fn->funcname  = funcname;
+
+        if ( *manglename )
+        {
+            fn->manglename = manglename;
+        }
+        else
+        {
+            free( manglename );
+        }
+    }
+
+    /* ...then the inline instances, re-tied to their hosts */
+    for ( uint32_t i = 0; i < hdr.ninl; i++ )
+    {
+        uint64_t addrs[2];
+        uint32_t meta[6];
+        uint32_t hostIndex;
+
+        if ( rp + sizeof( addrs ) + sizeof( meta ) + sizeof( hostIndex ) > erp )
+        {
+            goto terminate;
+        }
+
+        memcpy( addrs, rp, sizeof( addrs ) );
+        rp += sizeof( addrs );
+        memcpy( meta, rp, sizeof( meta ) );
+        rp += sizeof( meta );
+        memcpy( &hostIndex, rp, sizeof( hostIndex ) );
+        rp += sizeof( hostIndex );
+
+        if ( ( ( hostIndex != NO_FUNCTION_INDEX ) && ( hostIndex >= p->nfunc ) ) ||
+                ( meta[0] >= p->tableLen[PT_PRODUCER] ) || ( meta[1] >= p->tableLen[PT_FILENAME] ) )
+        {
+            goto terminate;
+        }
+
+        char *funcname = _cacheGetString( &rp, erp );
+        char *manglename = _cacheGetString( &rp, erp );
+
+        if ( ( !funcname ) || ( !manglename ) )
+        {
+            free( funcname );
+            free( manglename );
+            goto terminate;
+        }
+
+        p->inlfunc = ( struct symbolFunctionStore ** )realloc( p->inlfunc, sizeof( struct symbolFunctionStore * ) * ( p->ninlfunc + 1 ) );
+        struct symbolFunctionStore *fn = p->inlfunc[p->ninlfunc++] = ( struct symbolFunctionStore * )calloc( 1, sizeof( struct symbolFunctionStore ) );
+        MEMCHECK( fn, false );
+
+        fn->lowaddr   = addrs[0];
+        fn->highaddr  = addrs[1];
+        fn->producer  = meta[0];
+        fn->filename  = meta[1];
+        fn->startline = meta[2];
+        fn->startcol  = meta[3];
+        fn->endline   = meta[4];
+        fn->isinline  = true;
+        fn->inlinedIn = ( hostIndex != NO_FUNCTION_INDEX ) ? p->func[hostIndex] : NULL;
+        fn->funcname  = funcname;
+
+        if ( *manglename )
+        {
+            fn->manglename = manglename;
+        }
+        else
+        {
+            free( manglename );
+        }
+    }
 
-    for ( int i = 0; i < p->tableLen[PT_FILENAME]; i++ )
+    /* ...and finally the lines, hooking them back onto their functions */
+    for ( uint32_t i = 0; i < hdr.nlines; i++ )
     {
-        r = readsourcefile( p->stringTable[PT_FILENAME][i], &l );
+        uint64_t addrs[2];
+        uint32_t meta[4];
+
+        if ( rp + sizeof( addrs ) + sizeof( meta ) > erp )
+        {
+            goto terminate;
+        }
+
+        memcpy( addrs, rp, sizeof( addrs ) );
+        rp += sizeof( addrs );
+        memcpy( meta, rp, sizeof( meta ) );
+        rp += sizeof( meta );
+
+        if ( ( meta[0] >= p->tableLen[PT_FILENAME] ) ||
+                ( ( meta[3] != NO_FUNCTION_INDEX ) && ( meta[3] >= p->nfunc ) ) )
+        {
+            goto terminate;
+        }
+
+        p->line = ( struct symbolLineStore ** )realloc( p->line, sizeof( struct symbolLineStore * ) * ( p->nlines + 1 ) );
+        struct symbolLineStore *l = p->line[p->nlines++] = ( struct symbolLineStore * )calloc( 1, sizeof( struct symbolLineStore ) );
+        MEMCHECK( l, false );
 
-        /* Create an entry for this file. It will remain zero (NULL) if there are no lines in it, because r was NULL */
-        struct symbolSourcecodeStore *store = p->source[i] = ( struct symbolSourcecodeStore * )calloc( 1, sizeof( struct symbolSourcecodeStore ) );
+        l->lowaddr   = addrs[0];
+        l->highaddr  = addrs[1];
+        l->filename  = meta[0];
+        l->startline = meta[1];
+        l->isinline  = ( meta[2] != 0 );
 
-        /* Lines in sio.c are demarked by \n, \r or \0 ... so we just need to find the indicies to one after each of those */
-        while ( l )
+        if ( meta[3] != NO_FUNCTION_INDEX )
         {
-            /* Add this line to the storage. */
-            store->linetext = ( char ** )realloc( store->linetext, sizeof( char * ) * ( store->nlines + 1 ) );
-            store->linetext[store->nlines++] = r;
+            struct symbolFunctionStore *fn = p->func[meta[3]];
+            l->function = fn;
+            fn->line = ( struct symbolLineStore ** )realloc( fn->line, sizeof( struct symbolLineStore * ) * ( fn->nlines + 1 ) );
+            fn->line[fn->nlines++] = l;
+        }
+    }
+
+    _buildInlineIndex( p );
+
+    retval = ( p->nlines != 0 ) && ( p->nfunc != 0 );
 
-            /* Spin forwards for next newline or eof */
-            while ( ( --l > 0 ) && ( *r++ != '\n' ) ) {};
+terminate:
 
-            if ( l )
+    if ( !retval )
+    {
+        /* Leave no trace of a part-read cache behind, the full parse starts from scratch */
+        for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
+        {
+            for ( unsigned int i = 0; i < p->tableLen[pt]; i++ )
             {
-                *r++ = 0;
-                l--;
+                free( p->stringTable[pt][i] );
             }
+
+            free( p->stringTable[pt] );
+            p->stringTable[pt] = NULL;
+            p->tableLen[pt] = 0;
+        }
+
+        for ( unsigned int i = 0; i < p->nfunc; i++ )
+        {
+            free( p->func[i]->funcname );
+            free( p->func[i]->manglename );
+            free( p->func[i]->line );
+            free( p->func[i] );
+        }
+
+        free( p->func );
+        p->func = NULL;
+        p->nfunc = 0;
+
+        for ( unsigned int i = 0; i < p->ninlfunc; i++ )
+        {
+            free( p->inlfunc[i]->funcname );
+            free( p->inlfunc[i]->manglename );
+            free( p->inlfunc[i] );
+        }
+
+        free( p->inlfunc );
+        p->inlfunc = NULL;
+        p->ninlfunc = 0;
+        free( p->inlRange );
+        p->inlRange = NULL;
+        p->ninlRange = 0;
+
+        for ( unsigned int i = 0; i < p->nlines; i++ )
+        {
+            free( p->line[i] );
+        }
+
+        free( p->line );
+        p->line = NULL;
+        p->nlines = 0;
+    }
+
+
+#if !defined( WIN32 )
+
+    if ( maplen )
+    {
+        munmap( map, maplen );
+    }
+    else
+#endif
+    {
+        free( map );
+    }
+
+    close( fd );
+    return retval;
+}
+
+// ====================================================================================================
+
+static struct symbolSourcecodeStore *_loadSourceFile( struct symbol *p, unsigned int fileNumber )
+
+/* Fault in the text of a single source file. Files are only ever read here, the first time a
+ * line from them is asked for, so acquisition doesn't touch files nobody ever looks at. The
+ * store is created even if the read fails, so a missing file is only attempted once.
+ */
+
+{
+    char *r;
+    size_t l;
+
+    r = readsourcefile( p->stringTable[PT_FILENAME][fileNumber], &l );
+
+    struct symbolSourcecodeStore *store = p->source[fileNumber] =
+                                              ( struct symbolSourcecodeStore * )calloc( 1, sizeof( struct symbolSourcecodeStore ) );
+    MEMCHECK( store, NULL );
+
+    /* Lines in sio.c are demarked by \n, \r or \0 ... so we just need to find the indicies to one after each of those */
+    while ( l )
+    {
+        /* Add this line to the storage. */
+        store->linetext = ( char ** )realloc( store->linetext, sizeof( char * ) * ( store->nlines + 1 ) );
+        store->linetext[store->nlines++] = r;
+
+        /* Spin forwards for next newline or eof */
+        while ( ( --l > 0 ) && ( *r++ != '\n' ) ) {};
+
+        if ( l )
+        {
+            *r++ = 0;
+            l--;
         }
     }
 
-    return true;
+    return store;
 }
 
 // ====================================================================================================
@@ -748,7 +2410,18 @@ const char *symbolSource( struct symbol *p, unsigned int fileNumber, unsigned in
 {
     assert( p );
 
-    if ( ( fileNumber < p->tableLen[PT_FILENAME] ) && p->source && ( lineNumber < p->source[fileNumber]->nlines ) )
+    if ( ( fileNumber >= p->tableLen[PT_FILENAME] ) || ( !p->source ) )
+    {
+        return NULL;
+    }
+
+    /* First reference to this file...go and get its contents */
+    if ( !p->source[fileNumber] )
+    {
+        _loadSourceFile( p, fileNumber );
+    }
+
+    if ( lineNumber < p->source[fileNumber]->nlines )
     {
         return ( const char * )p->source[fileNumber]->linetext[lineNumber];
     }
@@ -765,13 +2438,64 @@ struct symbolFunctionStore *symbolFunctionAt( struct symbol *p, symbolMemaddr ad
 
 {
     assert( p );
+
+    /* In self-attribution mode an address inside an inlined copy reports the inlined
+     * function rather than the giant host it was folded into */
+    if ( p->inlineSelf )
+    {
+        struct symbolFunctionStore *f = symbolInlineAt( p, addr );
+
+        if ( f )
+        {
+            return f;
+        }
+    }
+
+    /* Instruction-grain callers mostly stay inside one function for long runs, so try the last hit first */
+    if ( ( p->cachedFuncIndex < p->nfunc ) &&
+            ( addr >= p->func[p->cachedFuncIndex]->lowaddr ) && ( addr <= p->func[p->cachedFuncIndex]->highaddr ) )
+    {
+        return p->func[p->cachedFuncIndex];
+    }
+
     struct symbolFunctionStore **fp = ( struct symbolFunctionStore ** )bsearch( &addr, p->func, p->nfunc, sizeof( struct symbolFunctionStore * ), _matchFunc );
 
+    if ( fp )
+    {
+        p->cachedFuncIndex = fp - p->func;
+    }
+
     return fp ? *fp : NULL;
 }
 
 // ====================================================================================================
 
+struct symbolFunctionStore *symbolInlineAt( struct symbol *p, symbolMemaddr addr )
+
+/* Return innermost inlined function instance covering specified address, or NULL */
+
+{
+    assert( p );
+
+    struct symbolInlineRange *r = ( struct symbolInlineRange * )bsearch( &addr, p->inlRange, p->ninlRange,
+                                  sizeof( struct symbolInlineRange ), _matchInlineRange );
+
+    return r ? r->func : NULL;
+}
+
+// ====================================================================================================
+
+void symbolSetInlineAttribution( struct symbol *p, bool self )
+
+/* Choose whether lookups attribute an address to the inline instance itself or to its host function */
+
+{
+    assert( p );
+    p->inlineSelf = self;
+}
+
+// ====================================================================================================
+
 struct symbolFunctionStore *symbolFunctionIndex( struct symbol *p, unsigned int index )
 
 /* Get indexed function, or NULL if out of range */
@@ -808,12 +2532,180 @@ struct symbolLineStore *symbolLineAt( struct symbol *p, symbolMemaddr addr )
 
 {
     assert( p );
-    struct symbolLineStore **l = ( struct symbolLineStore ** )bsearch( &addr, p->line, p->nlines, sizeof( struct symbolLineStore * ), _matchLine );
+
+    /* A line typically covers several instructions, so the previous answer is often still right */
+    if ( ( p->cachedLine ) &&
+            ( addr >= p->cachedLine->lowaddr ) && ( addr <= p->cachedLine->highaddr ) )
+    {
+        return p->cachedLine;
+    }
+
+    /* Trace decode rarely leaves the current function for long, so resolve that first (itself
+     * cached) and search its own few lines rather than the whole image's table */
+    struct symbolFunctionStore *f = symbolFunctionAt( p, addr );
+    struct symbolLineStore **l = NULL;
+
+    if ( ( f ) && ( f->nlines ) )
+    {
+        l = ( struct symbolLineStore ** )bsearch( &addr, f->line, f->nlines, sizeof( struct symbolLineStore * ), _matchLine );
+    }
+
+    if ( !l )
+    {
+        /* No enclosing function, or a line straddling a function boundary; the global table settles it */
+        l = ( struct symbolLineStore ** )bsearch( &addr, p->line, p->nlines, sizeof( struct symbolLineStore * ), _matchLine );
+    }
+
+    if ( l )
+    {
+        p->cachedLine = *l;
+    }
+
     return l ? *l : NULL;
 }
 
 // ====================================================================================================
 
+void symbolPrefetch( struct symbol *p, symbolMemaddr addr )
+
+/* Hint that a lookup at this address is imminent; pulls likely index entries towards the cache */
+
+{
+    if ( ( !p ) || ( !p->nfunc ) )
+    {
+        return;
+    }
+
+    /* Staying within the cached function is the overwhelmingly common case; warm the
+     * middle of its line table directly so the later bsearch starts from cache. */
+    if ( ( p->cachedFuncIndex < p->nfunc ) &&
+            ( addr >= p->func[p->cachedFuncIndex]->lowaddr ) && ( addr <= p->func[p->cachedFuncIndex]->highaddr ) )
+    {
+        struct symbolFunctionStore *f = p->func[p->cachedFuncIndex];
+
+        if ( f->nlines )
+        {
+            __builtin_prefetch( &f->line[f->nlines / 2], 0, 1 );
+            __builtin_prefetch( f->line[f->nlines / 2], 0, 1 );
+        }
+
+        return;
+    }
+
+    /* Otherwise hint every possible probe target of the first levels of the upcoming
+     * binary searches. Taking both children at each level means no comparison (and so
+     * no stalling demand load) is needed here; the real search then finds its top
+     * probes already resident and reaches DRAM for the deeper ones that much sooner. */
+    for ( unsigned int d = 2; d <= 8; d <<= 1 )
+    {
+        for ( unsigned int i = 1; i < d; i += 2 )
+        {
+            __builtin_prefetch( p->func[( ( uint64_t )p->nfunc * i ) / d], 0, 1 );
+
+            if ( p->nlines )
+            {
+                __builtin_prefetch( p->line[( ( uint64_t )p->nlines * i ) / d], 0, 1 );
+            }
+        }
+    }
+}
+
+// ====================================================================================================
+
+struct symbolVariableStore *symbolVariableAt( struct symbol *p, symbolMemaddr addr )
+
+/* Return static/global variable whose storage covers specified address, or NULL */
+
+{
+    assert( p );
+
+    return ( struct symbolVariableStore * )bsearch( &addr, p->var, p->nvar,
+            sizeof( struct symbolVariableStore ), _matchVar );
+}
+
+// ====================================================================================================
+struct symbolBatchEntry
+{
+    symbolMemaddr addr;                  /* Address to be resolved */
+    unsigned int pos;                    /* Slot in the caller's arrays where the answer goes */
+};
+
+static int _compareBatchEntry( const void *a, const void *b )
+
+{
+    const symbolMemaddr as = ( ( const struct symbolBatchEntry * )a )->addr;
+    const symbolMemaddr bs = ( ( const struct symbolBatchEntry * )b )->addr;
+
+    if ( as < bs )
+    {
+        return -1;
+    }
+
+    if ( as > bs )
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+// ====================================================================================================
+void symbolBatchResolve( struct symbol *p, const symbolMemaddr *addr, unsigned int naddr,
+                         struct symbolFunctionStore **function, struct symbolLineStore **line )
+
+/* Resolve a batch of addresses to their enclosing functions and lines. The batch is sorted
+ * once and then merged against the sorted tables, so the whole set costs a single pass
+ * rather than a bsearch per address. Either output array may be NULL if it's not wanted;
+ * entries with no covering function or line come back NULL.
+ */
+
+{
+    assert( p );
+
+    struct symbolBatchEntry *ix = ( struct symbolBatchEntry * )malloc( naddr * sizeof( struct symbolBatchEntry ) );
+    MEMCHECKV( ix );
+
+    for ( unsigned int i = 0; i < naddr; i++ )
+    {
+        ix[i].addr = addr[i];
+        ix[i].pos = i;
+    }
+
+    qsort( ix, naddr, sizeof( struct symbolBatchEntry ), _compareBatchEntry );
+
+    unsigned int fi = 0;
+    unsigned int li = 0;
+
+    for ( unsigned int i = 0; i < naddr; i++ )
+    {
+        symbolMemaddr a = ix[i].addr;
+
+        if ( function )
+        {
+            while ( ( fi < p->nfunc ) && ( p->func[fi]->highaddr < a ) )
+            {
+                fi++;
+            }
+
+            function[ix[i].pos] = ( ( fi < p->nfunc ) && ( p->func[fi]->lowaddr <= a ) ) ? p->func[fi] : NULL;
+        }
+
+        if ( line )
+        {
+            while ( ( li < p->nlines ) && ( p->line[li]->highaddr < a ) )
+            {
+                li++;
+            }
+
+            line[ix[i].pos] = ( ( li < p->nlines ) && ( p->line[li]->lowaddr <= a ) ) ? p->line[li] : NULL;
+        }
+    }
+
+    free( ix );
+}
+
+// ====================================================================================================
+
 const char *symbolGetProducer( struct symbol *p, unsigned int index )
 
 /* Get command line that produced this code */
@@ -896,12 +2788,16 @@ void symbolDelete( struct symbol *p )
             close( p->fd );
         }
 
+#if defined( WITH_CAPSTONE )
+
         /* Close the disassembler if it's in use */
         if ( !p->caphandle )
         {
             cs_close( &p->caphandle );
         }
 
+#endif
+
         if ( p->nsect_mem )
         {
             for ( int i = p->nsect_mem - 1; i; i-- )
@@ -910,7 +2806,7 @@ void symbolDelete( struct symbol *p )
                 {
                     free( p->mem[i].name );
 
-                    if ( p->mem[i].data )
+                    if ( ( p->mem[i].data ) && ( !p->mem[i].mapped ) )
                     {
                         free( p->mem[i].data );
                     }
@@ -920,6 +2816,15 @@ void symbolDelete( struct symbol *p )
             free( p->mem );
         }
 
+#if !defined( WIN32 )
+
+        if ( p->elfMap )
+        {
+            munmap( p->elfMap, p->elfMapLen );
+        }
+
+#endif
+
         while ( p->nfunc )
         {
             struct symbolFunctionStore *f = p->func[--p->nfunc];
@@ -945,6 +2850,25 @@ void symbolDelete( struct symbol *p )
             free( f );
         }
 
+        while ( p->ninlfunc )
+        {
+            struct symbolFunctionStore *f = p->inlfunc[--p->ninlfunc];
+            free( f->funcname );
+            free( f->manglename );
+            free( f->line );
+            free( f );
+        }
+
+        free( p->inlfunc );
+        free( p->inlRange );
+
+        while ( p->nvar )
+        {
+            free( p->var[--p->nvar].name );
+        }
+
+        free( p->var );
+
         /* Flush the string tables */
         for ( enum symbolTables pt = 0; pt < PT_NUMTABLES; pt++ )
         {
@@ -965,16 +2889,33 @@ void symbolDelete( struct symbol *p )
             free( p->line );
         }
 
-        /* Remove any source code we might be holding */
-        for ( int i = 0; i < p->tableLen[PT_FILENAME]; i++ )
+        /* Remove any source code we might be holding; only files that were faulted in exist */
+        if ( p->source )
         {
-            /* Text is all allocated in one block by readsource, so just deleting the firt element is enough */
-            free( p->source[i]->linetext[0] );
+            for ( int i = 0; i < p->tableLen[PT_FILENAME]; i++ )
+            {
+                if ( !p->source[i] )
+                {
+                    continue;
+                }
+
+                if ( p->source[i]->nlines )
+                {
+                    /* Text is all allocated in one block by readsource, so just deleting the firt element is enough */
+                    free( p->source[i]->linetext[0] );
+                }
+
+                /* ...and the block of pointers to lines in that text */
+                free( p->source[i]->linetext );
+                free( p->source[i] );
+            }
 
-            /* ...and the block of pointers to lines in that text */
-            free( p->source[i] );
+            free( p->source );
         }
 
+        free( p->dasmCache );
+        free( p->dasmText );
+        free( p->elfFile );
         free( p );
     }
 
@@ -983,6 +2924,83 @@ void symbolDelete( struct symbol *p )
 
 // ====================================================================================================
 
+#if defined( WITH_CAPSTONE )
+
+#define DASM_INITIAL_SLOTS (16384)       /* Starting size of disassembly cache; power of two */
+#define DASM_TEXT_CHUNK    (65536)       /* Granularity of text arena growth */
+
+static unsigned int _dasmCacheSlot( struct symbol *p, symbolMemaddr addr )
+
+/* Find the cache slot for addr; either its entry or the empty slot where it would live */
+
+{
+    unsigned int i = ( ( unsigned int )addr * 2654435761u ) & ( p->dasmSlots - 1 );
+
+    while ( ( p->dasmCache[i].textOfsPlus1 ) && ( p->dasmCache[i].addr != addr ) )
+    {
+        i = ( i + 1 ) & ( p->dasmSlots - 1 );
+    }
+
+    return i;
+}
+
+// ====================================================================================================
+
+static void _dasmCacheAdd( struct symbol *p, symbolMemaddr addr, enum instructionClass ic,
+                           symbolMemaddr newaddr, const char *text )
+
+/* Remember a decoded instruction, so subsequent visits to this address are just a probe */
+
+{
+    if ( !p->dasmCache )
+    {
+        p->dasmSlots = DASM_INITIAL_SLOTS;
+        p->dasmCache = ( struct dasmCacheEntry * )calloc( p->dasmSlots, sizeof( struct dasmCacheEntry ) );
+        MEMCHECKV( p->dasmCache );
+    }
+
+    /* Grow at three quarters full, so probe chains stay short */
+    if ( p->dasmUsed * 4 >= p->dasmSlots * 3 )
+    {
+        struct dasmCacheEntry *old = p->dasmCache;
+        unsigned int oldSlots = p->dasmSlots;
+        p->dasmSlots *= 2;
+        p->dasmCache = ( struct dasmCacheEntry * )calloc( p->dasmSlots, sizeof( struct dasmCacheEntry ) );
+        MEMCHECKV( p->dasmCache );
+
+        for ( unsigned int i = 0; i < oldSlots; i++ )
+        {
+            if ( old[i].textOfsPlus1 )
+            {
+                p->dasmCache[_dasmCacheSlot( p, old[i].addr )] = old[i];
+            }
+        }
+
+        free( old );
+    }
+
+    unsigned int len = strlen( text ) + 1;
+
+    if ( p->dasmTextLen + len > p->dasmTextCap )
+    {
+        p->dasmTextCap += ( len > DASM_TEXT_CHUNK ) ? len : DASM_TEXT_CHUNK;
+        p->dasmText = ( char * )realloc( p->dasmText, p->dasmTextCap );
+        MEMCHECKV( p->dasmText );
+    }
+
+    memcpy( &p->dasmText[p->dasmTextLen], text, len );
+
+    struct dasmCacheEntry *e = &p->dasmCache[_dasmCacheSlot( p, addr )];
+    e->addr         = addr;
+    e->ic           = ic;
+    e->newaddr      = newaddr;
+    e->textOfsPlus1 = p->dasmTextLen + 1;
+    p->dasmTextLen += len;
+    p->dasmUsed++;
+}
+
+// ====================================================================================================
+
 char *symbolDisassembleLine( struct symbol *p, enum instructionClass *ic, symbolMemaddr addr, symbolMemaddr *newaddr )
 
 /* Return assembly code representing this line */
@@ -990,6 +3008,7 @@ char *symbolDisassembleLine( struct symbol *p, enum instructionClass *ic, symbol
 {
     cs_insn *insn;
     size_t count;
+    symbolMemaddr na = NO_ADDRESS;
     static char op[255];
 
     if ( newaddr )
@@ -999,6 +3018,24 @@ char *symbolDisassembleLine( struct symbol *p, enum instructionClass *ic, symbol
 
     *ic = 0;
 
+    /* Serve repeat visits straight from the cache */
+    if ( p->dasmCache )
+    {
+        struct dasmCacheEntry *e = &p->dasmCache[_dasmCacheSlot( p, addr )];
+
+        if ( e->textOfsPlus1 )
+        {
+            *ic = e->ic;
+
+            if ( newaddr )
+            {
+                *newaddr = e->newaddr;
+            }
+
+            return &p->dasmText[e->textOfsPlus1 - 1];
+        }
+    }
+
     if ( !p->caphandle )
     {
         /* Disassembler isn't initialised yet */
@@ -1056,6 +3093,21 @@ char *symbolDisassembleLine( struct symbol *p, enum instructionClass *ic, symbol
         /* Was it an exception return? */
         *ic |=  ( ( insn->id == ARM_INS_ERET ) ) ? LE_IC_JUMP | LE_IC_IRET : 0;
 
+        /* Does it read memory? */
+        *ic |= ( ( insn->id == ARM_INS_LDR )    || ( insn->id == ARM_INS_LDRB )   || ( insn->id == ARM_INS_LDRH )   ||
+                 ( insn->id == ARM_INS_LDRSB )  || ( insn->id == ARM_INS_LDRSH )  || ( insn->id == ARM_INS_LDRD )   ||
+                 ( insn->id == ARM_INS_LDM )    || ( insn->id == ARM_INS_LDMDB )  || ( insn->id == ARM_INS_POP )    ||
+                 ( insn->id == ARM_INS_LDREX )  || ( insn->id == ARM_INS_LDREXB ) || ( insn->id == ARM_INS_LDREXH ) ||
+                 ( insn->id == ARM_INS_VLDR )   || ( insn->id == ARM_INS_TBB )    || ( insn->id == ARM_INS_TBH )
+               ) ? LE_IC_LOAD : 0;
+
+        /* Does it write memory? */
+        *ic |= ( ( insn->id == ARM_INS_STR )    || ( insn->id == ARM_INS_STRB )   || ( insn->id == ARM_INS_STRH )   ||
+                 ( insn->id == ARM_INS_STRD )   || ( insn->id == ARM_INS_STM )    || ( insn->id == ARM_INS_STMDB )  ||
+                 ( insn->id == ARM_INS_PUSH )   || ( insn->id == ARM_INS_STREX )  || ( insn->id == ARM_INS_STREXB ) ||
+                 ( insn->id == ARM_INS_STREXH ) || ( insn->id == ARM_INS_VSTR )
+               ) ? LE_IC_STORE : 0;
+
 
         /* Add text describing instruction */
         if ( *ic & LE_IC_4BYTE )
@@ -1078,10 +3130,11 @@ char *symbolDisassembleLine( struct symbol *p, enum instructionClass *ic, symbol
                 if ( insn->detail->arm.operands[n].type == ARM_OP_IMM )
                 {
                     *ic |= LE_IC_IMMEDIATE;
+                    na = detail->arm.operands[n].imm;
 
                     if ( newaddr )
                     {
-                        *newaddr = detail->arm.operands[n].imm;
+                        *newaddr = na;
                     }
 
                     break;
@@ -1101,11 +3154,33 @@ char *symbolDisassembleLine( struct symbol *p, enum instructionClass *ic, symbol
         sprintf( op, "No disassembly" );
     }
 
+    _dasmCacheAdd( p, addr, *ic, na, op );
     cs_free( insn, count );
 
     return op;
 }
 
+#else
+
+char *symbolDisassembleLine( struct symbol *p, enum instructionClass *ic, symbolMemaddr addr, symbolMemaddr *newaddr )
+
+/* Return assembly code representing this line; without a disassembler built in there is none */
+
+{
+    ( void )p;
+    ( void )addr;
+    *ic = LE_IC_NONE;
+
+    if ( newaddr )
+    {
+        *newaddr = NO_ADDRESS;
+    }
+
+    return NULL;
+}
+
+#endif
+
 // ====================================================================================================
 
 bool symbolSetValid( struct symbol *p )
@@ -1155,27 +3230,73 @@ struct symbol *symbolAcquire( char *filename, bool loadmem, bool loadsource )
         return NULL;
     }
 
-    /* Load the memory image if this was requested...if it fails then we fail */
-    if ( loadmem && ( !_readProg( p ) ) )
+    p->elfFile = strdup( filename );
+    MEMCHECK( p->elfFile, NULL );
+
+    /* Kick the memory image load off on its own thread; it only touches the section headers
+     * and the mapping, so it can run in parallel with the DWARF side below. */
+    pthread_t memThread;
+    bool memThreaded = false;
+    bool memOK = true;
+
+    if ( loadmem )
     {
-        symbolDelete( p );
-        return NULL;
+        if ( !pthread_create( &memThread, NULL, &_readProgWorker, p ) )
+        {
+            memThreaded = true;
+        }
+        else
+        {
+            memOK = _readProg( p );
+        }
+    }
+
+    /* Data objects come straight off the symbol table; nice and cheap */
+    _loadVariables( p );
+
+    /* Load the functions and source code line mappings, preferring the digested cache from a
+     * previous run over a fresh DWARF parse when it matches the current image.
+     */
+    uint64_t key = _elfHash( p->fd );
+
+    if ( !_readSymCache( p, key ) )
+    {
+        if ( !_readLines( p ) )
+        {
+            if ( memThreaded )
+            {
+                pthread_join( memThread, NULL );
+            }
+
+            symbolDelete( p );
+            return NULL;
+        }
+
+        _writeSymCache( p, key );
     }
 
-    /* Load the functions and source code line mappings if requested */
-    if ( !_readLines( p ) )
+    if ( memThreaded )
     {
-        symbolDelete( p );
-        return NULL;
+        void *res;
+        pthread_join( memThread, &res );
+        memOK = ( bool )( uintptr_t )res;
     }
 
-    /* ...finally, the source code if requested. This can only be done if mem or functions we requested */
-    if ( ( loadsource && loadmem )  && !_loadSource( p ) )
+    /* The memory image was requested...if it failed then we fail */
+    if ( loadmem && !memOK )
     {
         symbolDelete( p );
         return NULL;
     }
 
+    /* ...finally, room for the source code if requested; the text itself is faulted in by
+     * symbolSource the first time each file is displayed. This can only be done if mem was requested */
+    if ( loadsource && loadmem )
+    {
+        p->source = ( struct symbolSourcecodeStore ** )calloc( p->tableLen[PT_FILENAME], sizeof( struct symbolSourcecodeStore * ) );
+        MEMCHECK( p->source, NULL );
+    }
+
     return p;
 }
 // ====================================================================================================
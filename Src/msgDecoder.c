@@ -10,11 +10,21 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "itmDecoder.h"
 #include "msgDecoder.h"
 #include "generics.h"
 
+/* Context carried through the pump while a batch is being collected */
+struct batchPumpContext
+{
+    struct ITMDecoder *i;                 /* Decoder the bytes are being pumped through */
+    struct msgBatch   *b;                 /* Batch being filled */
+    void ( *otherEvent )( enum ITMPumpEvent e, void *param ); /* Forwarding for non-packet events */
+    void              *param;             /* Caller context for otherEvent */
+};
+
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
@@ -54,7 +64,7 @@ static bool _handlePCSample( struct ITMPacket *packet, struct pcSampleMsg *decod
     else
     {
         decoded->sleep = false;
-        decoded->pc = ( packet->d[3] << 24 ) | ( packet->d[2] << 16 ) | ( packet->d[1] << 8 ) | ( packet->d[0] );
+        decoded->pc = ( ( uint32_t )packet->d[3] << 24 ) | ( packet->d[2] << 16 ) | ( packet->d[1] << 8 ) | ( packet->d[0] );
     }
 
     return true;
@@ -80,7 +90,7 @@ static bool _handleDataRWWP( struct ITMPacket *packet, struct watchMsg *decoded
             break;
 
         default:
-            decoded->data = ( packet->d[0] ) | ( ( packet->d[1] ) << 8 ) | ( ( packet->d[2] ) << 16 ) | ( ( packet->d[3] ) << 24 );
+            decoded->data = ( packet->d[0] ) | ( ( packet->d[1] ) << 8 ) | ( ( packet->d[2] ) << 16 ) | ( ( uint32_t )( packet->d[3] ) << 24 );
             break;
     }
 
@@ -94,7 +104,7 @@ static bool _handleDataAccessWP( struct ITMPacket *packet, struct wptMsg *decode
 {
     decoded->msgtype = MSG_DATA_ACCESS_WP;
     decoded->comp = ( packet->srcAddr >> 1 ) & 0x3;
-    decoded->data = ( packet->d[0] ) | ( ( packet->d[1] ) << 8 ) | ( ( packet->d[2] ) << 16 ) | ( ( packet->d[3] ) << 24 );
+    decoded->data = ( packet->d[0] ) | ( ( packet->d[1] ) << 8 ) | ( ( packet->d[2] ) << 16 ) | ( ( uint32_t )( packet->d[3] ) << 24 );
     return true;
 }
 // ====================================================================================================
@@ -156,6 +166,26 @@ static bool _handleHW( struct ITMPacket *packet, struct msg *decoded )
     return wasDecoded;
 }
 // ====================================================================================================
+static void _batchPumpEvent( enum ITMPumpEvent e, void *param )
+
+/* Collect each completed packet into the next batch slot; everything else goes to the caller */
+
+{
+    struct batchPumpContext *c = ( struct batchPumpContext * )param;
+
+    if ( ITM_EV_PACKET_RXED == e )
+    {
+        /* The pool was sized for the input buffer, so a slot is always available */
+        assert( c->b->len < c->b->poolLen );
+        ITMGetDecodedPacket( c->i, &c->b->pool[c->b->len] );
+        c->b->len++;
+    }
+    else if ( c->otherEvent )
+    {
+        ( c->otherEvent )( e, c->param );
+    }
+}
+// ====================================================================================================
 static bool _handleSW( struct ITMPacket *packet, struct swMsg *decoded )
 
 {
@@ -166,7 +196,7 @@ static bool _handleSW( struct ITMPacket *packet, struct swMsg *decoded )
 
     /* Build 32 bit value the long way around to avoid type-punning issues */
     decoded->value =
-                ( packet->d[3] << 24 ) |
+                ( ( uint32_t )packet->d[3] << 24 ) |
                 ( packet->d[2] << 16 ) |
                 ( packet->d[1] << 8 ) |
                 ( packet->d[0] );
@@ -182,7 +212,7 @@ static bool _handleNISYNC( struct ITMPacket *packet, struct nisyncMsg *decoded )
                 ( packet->d[1] & 0xFE ) |
                 ( packet->d[2] << 8 ) |
                 ( packet->d[3] << 16 ) |
-                ( packet->d[4] << 24 );
+                ( ( uint32_t )packet->d[4] << 24 );
     return true;
 }
 // ====================================================================================================
@@ -278,3 +308,63 @@ bool msgDecoder( struct ITMPacket *packet, struct msg *decoded )
     return wasDecoded;
 }
 // ====================================================================================================
+void msgDecoderBatch( struct ITMDecoder *i, const uint8_t *d, int len, struct msgBatch *b,
+                      void ( *otherEvent )( enum ITMPumpEvent e, void *param ), void *param )
+
+/* Pump a whole buffer through the protocol decoder, collecting the decoded messages into the
+ * batch pool so the caller can despatch them in bulk rather than one callback per message.
+ */
+
+{
+    struct batchPumpContext c = { .i = i, .b = b, .otherEvent = otherEvent, .param = param };
+
+    /* Every message costs at least one byte on the wire, so the input length bounds the
+     * number of messages this call can produce.
+     */
+    if ( b->poolLen < ( uint32_t )len )
+    {
+        b->pool = ( struct msg * )realloc( b->pool, len * sizeof( struct msg ) );
+        MEMCHECKV( b->pool );
+        b->poolLen = len;
+    }
+
+    b->len = 0;
+    ITMPumpBuffer( i, d, len, _batchPumpEvent, &c );
+}
+// ====================================================================================================
+void msgBatchDispatch( struct msgBatch *b, const msgHandler *h, void *param )
+
+/* Despatch a collected batch through the handler table. Runs of same-type messages (which
+ * dominate real traces, e.g. bursts of SWIT or PC sample traffic) resolve the handler once
+ * and then loop tightly over the run.
+ */
+
+{
+    uint32_t n = 0;
+
+    while ( n < b->len )
+    {
+        enum MSGType t = b->pool[n].genericMsg.msgtype;
+        assert( t < MSG_NUM_MSGS );
+
+        uint32_t e = n + 1;
+
+        while ( ( e < b->len ) && ( b->pool[e].genericMsg.msgtype == t ) )
+        {
+            e++;
+        }
+
+        if ( h[t] )
+        {
+            for ( ; n < e; n++ )
+            {
+                ( h[t] )( &b->pool[n], param );
+            }
+        }
+        else
+        {
+            n = e;
+        }
+    }
+}
+// ====================================================================================================
@@ -134,9 +134,56 @@ bool MSGSeqPump( struct MSGSeq *d, uint8_t c )
             r = _bufferPacket(  d );
             break;
 
+        // ------------------------------------
+        case ITM_EV_BULK_RXED:
+            /* Bulk spans are delivered via the batch path, not the sequencer */
+            break;
+
             // ------------------------------------
     }
 
     return r;
 }
 // ====================================================================================================
+uint32_t MSGSeqPumpBuffer( struct MSGSeq *d, const uint8_t *buf, int len )
+
+/* Pump a whole buffer through the sequencer, staging released messages contiguously so the
+ * consumer can run them in one tight loop instead of interleaving pump and fetch per byte.
+ */
+
+{
+    struct msg *p;
+
+    /* Worst case is every byte decoding to a message, plus anything already queued */
+    uint32_t bound = ( uint32_t )len + d->pbl;
+
+    if ( d->stagedCap < bound )
+    {
+        d->staged = ( struct msg * )realloc( d->staged, bound * sizeof( struct msg ) );
+        MEMCHECKV( d->staged );
+        d->stagedCap = bound;
+    }
+
+    d->stagedLen = 0;
+
+    while ( len-- )
+    {
+        if ( MSGSeqPump( d, *buf++ ) )
+        {
+            /* A timestamp (or full buffer) released the queue...stage it in order */
+            while ( ( p = MSGSeqGetPacket( d ) ) )
+            {
+                memcpy( &d->staged[d->stagedLen++], p, sizeof( struct msg ) );
+            }
+        }
+    }
+
+    return d->stagedLen;
+}
+// ====================================================================================================
+struct msg *MSGSeqStaged( struct MSGSeq *d )
+
+{
+    return d->staged;
+}
+// ====================================================================================================
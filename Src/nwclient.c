@@ -10,6 +10,7 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <fcntl.h>
+#include <stdatomic.h>
 #ifdef WIN32
     #include <winsock2.h>
     #include <ws2tcpip.h>
@@ -27,12 +28,23 @@
 #endif
 #ifdef LINUX
     #include <linux/tcp.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+#if !defined( WIN32 ) && !defined( LINUX )
+    #include <netinet/tcp.h>
 #endif
 #include <assert.h>
 #include <strings.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include "generics.h"
 #include "nwclient.h"
+#include "cobs.h"
+#include "oflow.h"
+#ifdef LINUX
+    #include "shmring.h"
+#endif
 
 
 #ifdef WIN32
@@ -48,15 +60,71 @@
     #endif
 #endif
 
+/* Shared broadcast ring. Must be a power of two, and big enough to hold several
+ * full transfers so a client serviced a little late doesn't get lapped immediately.
+ */
+#define RING_SIZE    (TRANSFER_SIZE * 16)
+#define RING_MASK    (RING_SIZE - 1)
+
+/* Winsock has no self-pipe for the publisher to kick the manager with, so there the
+ * manager wakes on a short timeout instead. Everywhere else it sleeps until kicked.
+ */
+#ifdef WIN32
+    #define MANAGER_POLL_TIMEOUT_MS (10)
+#else
+    #define MANAGER_POLL_TIMEOUT_MS (-1)
+#endif
+
+/* Maximum length of a command line a client may send us */
+#define CLIENT_CMD_MAX_LEN  (128)
+
+/* Number of distinct tags a client can subscribe to */
+#define CLIENT_NUM_TAGS     (256)
+
+/* Throughput-policy coalescing thresholds; a bulk client's data is held back until
+ * either is met, so it goes out in fewer, larger writes.
+ */
+#define BULK_COALESCE_BYTES (64*1024)
+#define BULK_COALESCE_MS    (5)
+
+/* On flow-reporting ports a report is injected at least once per this much delivered data */
+#define FLOW_REPORT_EVERY   (RING_SIZE / 4)
+
+/* A client this far behind gets its backlog spilled to disk before the publisher laps it */
+#define SPILL_HIGH_WATER    (RING_SIZE - 2 * TRANSFER_SIZE)
+
+#ifdef LINUX
+    /* systemd socket activation; inherited listening sockets start at this fd */
+    #define SD_LISTEN_FDS_START (3)
+#endif
+
 /* Master structure for the set of nwclients */
 struct nwclientsHandle
 
 {
-    volatile struct nwClient *firstClient;    /* Head of linked list of network clients */
-    pthread_mutex_t           clientList;     /* Lock for list of network clients */
+    volatile struct nwClient *firstClient;    /* Head of linked list of network clients; owned and
+                                               * walked exclusively by the manager thread */
+
+    uint8_t                  *ring;           /* Broadcast ring all clients read from */
+    atomic_uint_fast64_t      ringWp;         /* Total bytes ever published into ring */
 
     int                       sockfd;         /* The socket for the inferior */
-    pthread_t                 ipThread;       /* The listening thread for n/w clients */
+    pthread_t                 ipThread;       /* The manager thread for n/w clients */
+    volatile bool             ending;         /* Flag asking the manager to close down */
+    bool                      flowReports;    /* Inject flow reports, and resync rather than drop laggards */
+
+#ifndef WIN32
+    int                       wakeFd[2];      /* Self-pipe the publisher kicks the manager over */
+#endif
+
+    /* Manager-thread poll set, grown on demand as clients come and go */
+    struct pollfd            *pfds;
+    int                       pfdCap;
+
+#ifdef LINUX
+    struct shmRing           *shm;            /* Shared memory segment for local clients, if we got one */
+    char                      shmName[SHMRING_NAME_MAX_LEN]; /* Name it was created under, for unlinking */
+#endif
 };
 
 /* Descriptor for individual connected network clients */
@@ -68,45 +136,168 @@ struct nwClient
     volatile struct nwClient *nextClient;
     volatile struct nwClient *prevClient;
 
+    uint64_t                  rp;                /* This client's read cursor into the ring */
+    volatile bool             finish;            /* Flag that this client is done with */
+
+    /* Optional server-side subscription, engaged by a FILTER command from the client.
+     * Only meaningful on ports carrying COBS-framed OFLOW data. */
+    bool                      filtering;         /* Has this client subscribed to specific tags? */
+    uint8_t                   wanted[CLIENT_NUM_TAGS / 8]; /* Bitmap of subscribed tags */
+    uint64_t                  stalledAt;         /* Write point when we last ran out of complete frames */
+    char                      cmd[CLIENT_CMD_MAX_LEN];     /* Command line under assembly */
+    uint32_t                  cmdLen;            /* Amount of command collected so far */
+
+    /* Transmission policy, chosen by a MODE command from the client */
+    bool                      bulk;              /* Coalesce small sends rather than despatching at once */
+    bool                      holding;           /* Data is currently being held for coalescing */
+    uint32_t                  holdSince;         /* When the hold started */
+
+    /* Flow accounting, used on flow-reporting ports only */
+    uint64_t                  dropped;           /* Bytes ever skipped past this client */
+    uint64_t                  reportedDrops;     /* ...value of the above in the last report */
+    uint64_t                  lastReportRp;      /* Cursor position at the last report */
+    uint8_t                   ctl[COBS_MAX_ENC_PACKET_LEN]; /* Control frame awaiting despatch */
+    uint32_t                  ctlLen;            /* Length of queued control frame */
+    uint32_t                  ctlSent;           /* Amount of it that has gone out */
+
+    /* Oldest-first spill, engaged when this client is close to being lapped */
+    FILE                     *spill;             /* Backing file holding data the ring would have lapped */
+    uint64_t                  spillWp;           /* Bytes written into the current spill file */
+    uint64_t                  spillRp;           /* Bytes of it already sent on */
+
     /* Parameters used to run the client */
     int                       fdNo;             /* file descriptor of incoming connection */
 };
 
+/* CPU that manager threads should be pinned to, or -1 to let the scheduler place them */
+static int _placementCpu = -1;
+
+/* Laggard spill policy; applies to every port, with the aggregate budget shared between them */
+static const char *_spillDir;                    /* Directory for spill files, NULL = policy off */
+static uint64_t _spillClientMax;                 /* Per-client spill budget in bytes */
+static uint64_t _spillTotalMax;                  /* Aggregate spill budget in bytes */
+static atomic_uint_fast64_t _spillHeld;          /* Spill bytes currently held on disk */
+static atomic_uint_fast64_t _spillEver;          /* Spill bytes ever written, for telemetry */
+
+// ====================================================================================================
+// Shared memory transport for clients on the same host
 // ====================================================================================================
-static int _lock_with_timeout( pthread_mutex_t *mutex, const struct timespec *ts )
+#ifdef LINUX
+static void _shmRingCreate( struct nwclientsHandle *h, int port )
+
+/* Create and advertise a shared memory segment that mirrors this port. The main data
+ * ring is placed directly in the segment so local clients read the same bytes the TCP
+ * writers do, without a second copy. Failure here isn't fatal; we just serve TCP only.
+ */
+
 {
-    int ret;
-    int left, step;
+    pthread_mutexattr_t ma;
+    pthread_condattr_t ca;
+
+    snprintf( h->shmName, sizeof( h->shmName ), SHMRING_NAME_FORMAT, port );
+
+    /* Tidy away any segment a previous instance left behind */
+    shm_unlink( h->shmName );
 
-    left = ts->tv_sec * 1000;       /* how much waiting is left, in msec */
-    step = 10;                      /* msec to sleep at each trywait() failure */
+    int fd = shm_open( h->shmName, O_CREAT | O_EXCL | O_RDWR, 0666 );
 
-    do
+    if ( fd < 0 )
     {
-        if ( ( ret = pthread_mutex_trylock( mutex ) ) != 0 )
-        {
-            struct timespec dly;
+        genericsReport( V_INFO, "No shared memory segment for port %d, TCP only" EOL, port );
+        return;
+    }
+
+    if ( ftruncate( fd, sizeof( struct shmRing ) + RING_SIZE ) < 0 )
+    {
+        close( fd );
+        shm_unlink( h->shmName );
+        return;
+    }
 
-            dly.tv_sec = 0;
-            dly.tv_nsec = step * 1000000;
-            nanosleep( &dly, NULL );
+    h->shm = ( struct shmRing * )mmap( NULL, sizeof( struct shmRing ) + RING_SIZE,
+                                       PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
 
-            left -= step;
-        }
+    if ( MAP_FAILED == h->shm )
+    {
+        h->shm = NULL;
+        shm_unlink( h->shmName );
+        return;
     }
-    while ( ret != 0 && left > 0 );
 
-    return ret;
+    /* The wakeup needs to work across processes, and survive a client dying inside it */
+    pthread_mutexattr_init( &ma );
+    pthread_mutexattr_setpshared( &ma, PTHREAD_PROCESS_SHARED );
+    pthread_mutexattr_setrobust( &ma, PTHREAD_MUTEX_ROBUST );
+    pthread_mutex_init( &h->shm->lock, &ma );
+    pthread_mutexattr_destroy( &ma );
+
+    pthread_condattr_init( &ca );
+    pthread_condattr_setpshared( &ca, PTHREAD_PROCESS_SHARED );
+    pthread_condattr_setclock( &ca, CLOCK_MONOTONIC );
+    pthread_cond_init( &h->shm->dataAvailable, &ca );
+    pthread_condattr_destroy( &ca );
+
+    h->shm->ringSize = RING_SIZE;
+    h->shm->pid = getpid();
+    atomic_init( &h->shm->wp, 0 );
+    h->shm->version = SHMRING_VERSION;
+
+    /* Only once everything else is in place does the segment become valid to attach */
+    h->shm->magic = SHMRING_MAGIC;
+
+    genericsReport( V_INFO, "Shared memory transport available on %s" EOL, h->shmName );
+}
+// ====================================================================================================
+static void _shmRingRemove( struct nwclientsHandle *h )
+
+/* Withdraw the segment. Clients which still have it mapped keep their mapping until
+ * they notice the publisher has gone; we don't destroy the sync objects under them.
+ */
+
+{
+    if ( h->shm )
+    {
+        h->shm->magic = 0;
+        munmap( h->shm, sizeof( struct shmRing ) + RING_SIZE );
+        h->shm = NULL;
+        shm_unlink( h->shmName );
+    }
 }
+// ====================================================================================================
+static void _shmRingKick( struct shmRing *r )
+
+/* Wake any local clients waiting on the segment */
+
+{
+    if ( EOWNERDEAD == pthread_mutex_lock( &r->lock ) )
+    {
+        /* A client died while holding the wakeup lock...recover it and carry on */
+        pthread_mutex_consistent( &r->lock );
+    }
 
+    pthread_cond_broadcast( &r->dataAvailable );
+    pthread_mutex_unlock( &r->lock );
+}
+#endif
 // ====================================================================================================
 // Network server implementation for raw SWO feed
 // ====================================================================================================
-static void _clientRemoveNoLock( volatile struct nwClient *c )
+static void _clientRemove( volatile struct nwClient *c )
+
+/* Unhook a client from the list and release it. Only ever called on the manager thread,
+ * which is the sole owner of the list, so no locking is involved.
+ */
 
 {
     close( c->fdNo );
 
+    if ( c->spill )
+    {
+        atomic_fetch_sub( &_spillHeld, c->spillWp - c->spillRp );
+        fclose( c->spill );
+    }
+
     if ( c->prevClient )
     {
         c->prevClient->nextClient = c->nextClient;
@@ -125,223 +316,1115 @@ static void _clientRemoveNoLock( volatile struct nwClient *c )
     free( ( void * )c );
 }
 // ====================================================================================================
-static void *_listenTask( void *arg )
+static void _clientSetNodelay( struct nwClient *c, bool enable )
 
-{
-    struct nwclientsHandle *h = ( struct nwclientsHandle * )arg;
-    const struct timespec ts = {.tv_sec = 1, .tv_nsec = 0};
-    int newsockfd;
-#ifdef WIN32
-    int clilen;
-#else
-    socklen_t clilen;
-#endif
-    struct sockaddr_in cli_addr;
-    struct nwClient *client;
-    char s[100];
+/* Switch Nagle coalescing in the kernel off (for latency) or back on (for throughput) */
 
-    clilen = sizeof( cli_addr );
-    listen( h->sockfd, 5 );
+{
+    int flag = enable ? 1 : 0;
+    setsockopt( c->fdNo, IPPROTO_TCP, TCP_NODELAY, ( const void * )&flag, sizeof( flag ) );
+}
+// ====================================================================================================
+static void _clientRunCommand( struct nwClient *c )
+
+/* Act on a complete command line from the client. The verbs are
+ *    FILTER <tag>[,<tag>...]
+ * which subscribes the client to just those OFLOW tags (no tags returns it to the
+ * full stream), and
+ *    MODE LATENCY|THROUGHPUT
+ * which picks this client's transmission policy; interactive consumers want small
+ * writes despatched immediately, bulk consumers want them coalesced.
+ */
 
-    while ( true )
+{
+    if ( !strncasecmp( c->cmd, "MODE", 4 ) )
     {
-        newsockfd = accept( h->sockfd, ( struct sockaddr * ) &cli_addr, &clilen );
+        char *m = &c->cmd[4];
 
-        if ( newsockfd < 0 )
+        while ( ' ' == *m )
         {
-            close( newsockfd );
-            break;
+            m++;
+        }
+
+        if ( !strcasecmp( m, "THROUGHPUT" ) )
+        {
+            c->bulk = true;
+            _clientSetNodelay( c, false );
+        }
+        else if ( !strcasecmp( m, "LATENCY" ) )
+        {
+            c->bulk = false;
+            c->holding = false;
+            _clientSetNodelay( c, true );
+        }
+        else
+        {
+            genericsReport( V_INFO, "Unrecognised mode from client index %d" EOL, c->fdNo );
+            return;
         }
 
-        inet_ntop( AF_INET, &cli_addr.sin_addr, s, 99 );
-        genericsReport( V_INFO, "New connection from %s index %d" EOL, s, newsockfd );
+        genericsReport( V_INFO, "Client index %d selected %s policy" EOL, c->fdNo,
+                        c->bulk ? "throughput" : "latency" );
+        return;
+    }
+
+    if ( strncasecmp( c->cmd, "FILTER", 6 ) )
+    {
+        genericsReport( V_INFO, "Unknown command from client index %d" EOL, c->fdNo );
+        return;
+    }
 
-        /* We got a new connection - spawn a record to handle it */
-        client = ( struct nwClient * )calloc( 1, sizeof( struct nwClient ) );
-        MEMCHECK( client, NULL );
+    char *p = &c->cmd[6];
+    bool gotTag = false;
 
-        client->parent = h;
-        client->fdNo = newsockfd;
+    memset( ( void * )c->wanted, 0, sizeof( c->wanted ) );
 
-        /* Make port non-blocking */
-#ifdef WIN32
-        unsigned long mode = 0;
-        ioctlsocket( newsockfd, FIONBIO, &mode );
-#else
-        int flags = fcntl( newsockfd, F_GETFL, 0 );
+    while ( *p )
+    {
+        if ( ( *p >= '0' ) && ( *p <= '9' ) )
+        {
+            unsigned long tag = strtoul( p, &p, 10 );
 
-        if ( flags == -1 )
+            if ( tag < CLIENT_NUM_TAGS )
+            {
+                c->wanted[tag / 8] |= ( 1 << ( tag % 8 ) );
+                gotTag = true;
+            }
+        }
+        else
         {
-            return false;
+            p++;
         }
+    }
 
-        flags |= O_NONBLOCK;
-        fcntl( newsockfd, F_SETFL, flags );
-#endif
+    c->filtering = gotTag;
+    genericsReport( V_INFO, "Client index %d %s" EOL, c->fdNo,
+                    gotTag ? "subscribed to specific tags" : "returned to full stream" );
+}
+// ====================================================================================================
+static void _clientPollCommand( struct nwClient *c )
 
-        /* Hook into linked list */
-        if ( _lock_with_timeout( &h->clientList, &ts ) < 0 )
-        {
-            genericsExit( -1, "Failed to acquire mutex" EOL );
-        }
+/* Collect any command bytes the client has sent us. The socket is non-blocking, so this
+ * costs one failed recv when there's nothing there, which is the usual case.
+ */
 
-        client->nextClient = h->firstClient;
-        client->prevClient = NULL;
+{
+#if !defined( WIN32 )
+    uint8_t buf[CLIENT_CMD_MAX_LEN];
+    ssize_t r;
 
-        if ( client->nextClient )
+    while ( ( r = recv( c->fdNo, buf, sizeof( buf ), MSG_DONTWAIT ) ) > 0 )
+    {
+        for ( ssize_t i = 0; i < r; i++ )
         {
-            client->nextClient->prevClient = client;
+            if ( ( '\n' == buf[i] ) || ( '\r' == buf[i] ) )
+            {
+                if ( c->cmdLen )
+                {
+                    c->cmd[c->cmdLen] = 0;
+                    _clientRunCommand( c );
+                    c->cmdLen = 0;
+                }
+            }
+            else if ( c->cmdLen < CLIENT_CMD_MAX_LEN - 1 )
+            {
+                c->cmd[c->cmdLen++] = buf[i];
+            }
         }
-
-        h->firstClient = client;
-
-        pthread_mutex_unlock( &h->clientList );
     }
 
-    if ( h->sockfd )
+    if ( ( 0 == r ) && ( !c->finish ) )
     {
-        close( h->sockfd );
+        /* Orderly shutdown from the far end */
+        c->finish = true;
     }
 
-    return NULL;
+#endif
 }
 // ====================================================================================================
-// ====================================================================================================
-// ====================================================================================================
-// Externally available routines
-// ====================================================================================================
-// ====================================================================================================
-// ====================================================================================================
-void nwclientSend( struct nwclientsHandle *h, uint32_t len, const uint8_t *ipbuffer )
+static uint64_t _clientFilterExtent( struct nwclientsHandle *h, struct nwClient *c, uint64_t wp )
+
+/* Advance this client's cursor over complete frames it hasn't subscribed to, then return
+ * the extent of the run of consecutive complete wanted frames at the cursor. A return equal
+ * to the cursor means nothing is ready; an incomplete frame at the tail stays put until the
+ * rest of it is published. The tag is peeked straight out of the COBS encoding...the first
+ * decoded byte is enc[1] unless the leading code byte says it's a literal sync character.
+ */
 
 {
-    const struct timespec ts = {.tv_sec = 1, .tv_nsec = 0};
+    uint64_t e = c->rp;
+    bool skipping = true;
 
-    if ( h && h->firstClient )
+    while ( e != wp )
     {
-        if ( _lock_with_timeout( &h->clientList, &ts ) < 0 )
+        /* Measure this frame, including its terminating sync */
+        uint64_t fl = 0;
+
+        while ( ( e + fl != wp ) && ( COBS_SYNC_CHAR != h->ring[( e + fl ) & RING_MASK] ) )
         {
-            genericsExit( -1, "Failed to acquire mutex" EOL );
+            fl++;
         }
 
-        /* Now kick all the clients that new data arrived for them to distribute */
-        volatile struct nwClient *n = h->firstClient;
-
-        while ( n )
+        if ( e + fl == wp )
         {
-            ssize_t t = len;
-            ssize_t sent = 0;
-            void *p = ( void * )ipbuffer;
+            /* Frame is still incomplete, can't judge or forward it yet */
+            break;
+        }
 
-            while ( t && ( sent >= 0 ) )
-            {
-                sent = send( n->fdNo, p, t, MSG_NOSIGNAL );
-                p += sent;
-                t -= sent;
-            }
+        fl++;
+
+        uint8_t b0  = h->ring[e & RING_MASK];
+        uint8_t tag = ( b0 > 1 ) ? h->ring[( e + 1 ) & RING_MASK] : COBS_SYNC_CHAR;
+        bool wanted = ( fl > 2 ) && ( ( c->wanted[tag / 8] >> ( tag % 8 ) ) & 1 );
 
-            if ( t )
+        if ( skipping )
+        {
+            if ( wanted )
             {
-                genericsReport( V_INFO, "Killed connection index %d" EOL, n->fdNo );
-                volatile struct nwClient *newn = n->nextClient;
-                _clientRemoveNoLock( n );
-                n = newn;
+                skipping = false;
             }
             else
             {
-                n = n->nextClient;
+                /* Nobody will miss this one...step the cursor straight over it */
+                e += fl;
+                c->rp = e;
+                continue;
             }
         }
+        else if ( !wanted )
+        {
+            break;
+        }
 
-        pthread_mutex_unlock( &h->clientList );
+        e += fl;
     }
+
+    return skipping ? c->rp : e;
 }
 // ====================================================================================================
-struct nwclientsHandle *nwclientStart( int port )
+static bool _clientPending( struct nwclientsHandle *h, struct nwClient *c )
 
-/* Creating the listening server thread */
+/* Does this client have anything it could usefully send right now? */
 
 {
-    struct sockaddr_in serv_addr;
-    int flag = 1;
-    struct nwclientsHandle *h = ( struct nwclientsHandle * )calloc( 1, sizeof( struct nwclientsHandle ) );
-    MEMCHECK( h, NULL );
+    uint64_t wp = atomic_load( &h->ringWp );
+
+    return ( c->ctlSent != c->ctlLen ) || ( c->spill ) ||
+           ( ( wp != c->rp ) && !( ( c->filtering ) && ( wp == c->stalledAt ) ) );
+}
+// ====================================================================================================
+static void _clientQueueFlowReport( struct nwClient *c )
 
-    h->sockfd = socket( AF_INET, SOCK_STREAM, 0 );
-    setsockopt( h->sockfd, SOL_SOCKET, SO_REUSEPORT, ( const void * )&flag, sizeof( flag ) );
+/* Stage a flow report for injection into this client's stream; it carries the client's
+ * position in the published stream and its cumulative loss, so the far end can tell
+ * host-side fan-out overload from probe-side loss.
+ */
 
-    if ( h->sockfd < 0 )
+{
+    struct Frame f;
+
+    OFLOWEncodeFlowReport( c->rp, c->dropped, &f );
+    memcpy( c->ctl, f.d, f.len );
+    c->ctlLen = f.len;
+    c->ctlSent = 0;
+    c->reportedDrops = c->dropped;
+    c->lastReportRp = c->rp;
+}
+// ====================================================================================================
+static bool _clientFlushControl( struct nwClient *c )
+
+/* Push out any staged control frame, returning true once none remains. The frame goes ahead
+ * of ring data so it can never be split by it.
+ */
+
+{
+    while ( c->ctlSent < c->ctlLen )
     {
-        genericsReport( V_ERROR, "Error opening socket" EOL );
-        goto free_and_return;
+        ssize_t sent = send( c->fdNo, ( const void * )&c->ctl[c->ctlSent], c->ctlLen - c->ctlSent, MSG_NOSIGNAL );
+
+        if ( sent > 0 )
+        {
+            c->ctlSent += sent;
+        }
+        else if ( ( sent < 0 ) && ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) )
+        {
+            return false;
+        }
+        else
+        {
+            c->finish = true;
+            return false;
+        }
     }
 
-    memset( ( char * ) &serv_addr, 0, sizeof( serv_addr ) );
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons( port );
+    c->ctlLen = c->ctlSent = 0;
+    return true;
+}
+// ====================================================================================================
+static void _clientSpillAppend( struct nwclientsHandle *h, struct nwClient *c, uint64_t wp )
+
+/* Move this client's ring backlog onto disk so the publisher can lap the ring without the
+ * client losing the data. The whole span goes in one or two sequential writes. If either
+ * budget would be exceeded nothing is moved, and the established overrun handling deals
+ * with the client when the lap eventually lands.
+ */
+
+{
+    uint64_t n = wp - c->rp;
 
-    if ( setsockopt( h->sockfd, SOL_SOCKET, SO_REUSEADDR, ( const void * ) &flag, sizeof( flag ) ) < 0 )
+    if ( ( ( c->spillWp - c->spillRp ) + n > _spillClientMax ) ||
+            ( atomic_load( &_spillHeld ) + n > _spillTotalMax ) )
     {
-        genericsReport( V_ERROR, "setsockopt(SO_REUSEADDR) failed" );
-        goto free_and_return;
+        return;
     }
 
-    if ( bind( h->sockfd, ( struct sockaddr * ) &serv_addr, sizeof( serv_addr ) ) < 0 )
+    if ( !c->spill )
     {
-        genericsReport( V_ERROR, "Error on binding" EOL );
-        goto free_and_return;
+        char fname[256];
+        snprintf( fname, sizeof( fname ), "%s/nwspill.%d.%d", _spillDir, ( int )getpid(), c->fdNo );
+        c->spill = fopen( fname, "w+b" );
+
+        if ( !c->spill )
+        {
+            genericsReport( V_WARN, "Could not open spill file %s" EOL, fname );
+            return;
+        }
+
+#if !defined( WIN32 )
+        /* Anonymous from birth, so the space comes back however we exit */
+        unlink( fname );
+#endif
+        c->spillWp = c->spillRp = 0;
     }
 
-    /* Create a mutex to lock the client list */
-    pthread_mutex_init( &h->clientList, NULL );
+    /* Batched sequential append; two writes at most, when the span wraps the ring end */
+    fseek( c->spill, ( long )c->spillWp, SEEK_SET );
 
-    /* We have the listening socket - spawn a thread to handle it */
-    if ( pthread_create( &( h->ipThread ), NULL, &_listenTask, h ) )
+    uint32_t ri = c->rp & RING_MASK;
+    size_t done;
+
+    if ( ri + n > RING_SIZE )
     {
-        genericsReport( V_ERROR, "Failed to create listening thread" EOL );
-        goto free_and_return;
+        done = fwrite( &h->ring[ri], 1, RING_SIZE - ri, c->spill );
+
+        if ( done == RING_SIZE - ri )
+        {
+            done += fwrite( h->ring, 1, n - done, c->spill );
+        }
+    }
+    else
+    {
+        done = fwrite( &h->ring[ri], 1, n, c->spill );
     }
 
-    return h;
+    /* If the publisher lapped us while we were copying then what just went to disk may be
+     * torn. Leave spillWp and rp where they were; the stale bytes are logically absent (the
+     * next append seeks back over them) and the overrun handling picks the client up.
+     */
+    if ( atomic_load( &h->ringWp ) - c->rp > RING_SIZE )
+    {
+        return;
+    }
 
-free_and_return:
-    free( h );
-    return NULL;
+    c->spillWp += done;
+    c->rp += done;
+    atomic_fetch_add( &_spillHeld, done );
+    atomic_fetch_add( &_spillEver, done );
+
+    if ( done != n )
+    {
+        genericsReport( V_WARN, "Spill write fell short for client index %d" EOL, c->fdNo );
+    }
 }
 // ====================================================================================================
-void nwclientShutdown( struct nwclientsHandle *h )
+static bool _clientDrainSpill( struct nwClient *c )
+
+/* Push spilled data at this client's socket, returning true once the file is empty and the
+ * client can go back to reading the ring. Ordering is preserved because everything that was
+ * published while the spill existed either followed it into the file or still sits in the
+ * ring beyond the client's cursor.
+ */
 
 {
-    const struct timespec ts = {.tv_sec = 1, .tv_nsec = 0};
+    uint8_t buf[TRANSFER_SIZE];
 
-    if ( !h )
+    while ( c->spillRp != c->spillWp )
     {
-        return;
+        uint64_t n = c->spillWp - c->spillRp;
+
+        if ( n > sizeof( buf ) )
+        {
+            n = sizeof( buf );
+        }
+
+        fseek( c->spill, ( long )c->spillRp, SEEK_SET );
+        n = fread( buf, 1, n, c->spill );
+
+        if ( !n )
+        {
+            /* Unreadable...nothing to do but abandon what's left of it */
+            break;
+        }
+
+        ssize_t sent = send( c->fdNo, buf, n, MSG_NOSIGNAL );
+
+        if ( sent > 0 )
+        {
+            c->spillRp += sent;
+            atomic_fetch_sub( &_spillHeld, sent );
+        }
+        else if ( ( sent < 0 ) && ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) )
+        {
+            return false;
+        }
+        else
+        {
+            c->finish = true;
+            return false;
+        }
+    }
+
+    /* Finished with this file; any unreadable residue is surrendered from the budget */
+    atomic_fetch_sub( &_spillHeld, c->spillWp - c->spillRp );
+    fclose( c->spill );
+    c->spill = NULL;
+    c->spillWp = c->spillRp = 0;
+    return true;
+}
+// ====================================================================================================
+static void _clientDrain( struct nwclientsHandle *h, struct nwClient *c )
+
+/* Push as much of the ring as this client's socket will take. Everything is non-blocking;
+ * a full socket just leaves the cursor where it is and the manager waits for POLLOUT. A
+ * client that falls a whole ring behind the publisher has overrun; on a flow-reporting
+ * port it is resynced at the next frame boundary with the loss accounted, elsewhere it
+ * is disconnected. Everyone else is unaffected by it.
+ */
+
+{
+    uint64_t wp = atomic_load( &h->ringWp );
+
+    /* Budget permitting, a client nearing a lap has its backlog moved oldest-first onto
+     * disk rather than waiting to lose it */
+    if ( ( _spillDir ) && ( wp - c->rp > SPILL_HIGH_WATER ) )
+    {
+        _clientSpillAppend( h, c, wp );
     }
 
-    /* Flag that we're ending - this ensures the listening thread dies */
-    int tsockfd = h->sockfd;
-    h->sockfd = 0;
-    close( tsockfd );
+    if ( wp - c->rp > RING_SIZE )
+    {
+        if ( !h->flowReports )
+        {
+            genericsReport( V_INFO, "Client index %d overran, disconnecting" EOL, c->fdNo );
+            c->finish = true;
+            return;
+        }
+
+        /* Skip forward to the first frame boundary in the oldest data the publisher won't
+         * lap imminently, and account everything stepped over as dropped.
+         */
+        uint64_t e = wp - RING_SIZE + TRANSFER_SIZE;
+
+        while ( ( e != wp ) && ( COBS_SYNC_CHAR != h->ring[e & RING_MASK] ) )
+        {
+            e++;
+        }
+
+        if ( e != wp )
+        {
+            e++;
+        }
+
+        c->dropped += e - c->rp;
+        c->rp = e;
+        genericsReport( V_INFO, "Client index %d overran, resynced with %" PRIu64 " bytes dropped" EOL,
+                        c->fdNo, c->dropped );
+    }
 
-    if ( _lock_with_timeout( &h->clientList, &ts ) < 0 )
+    /* A bulk client with only a little on offer waits briefly for more to accumulate,
+     * unless a control frame is queued, which always goes at once */
+    if ( ( c->bulk ) && ( c->ctlLen == c->ctlSent ) && ( wp - c->rp < BULK_COALESCE_BYTES ) )
     {
-        genericsExit( -1, "Failed to acquire mutex" EOL );
+        uint32_t now = genericsTimestampmS();
+
+        if ( !c->holding )
+        {
+            c->holding = true;
+            c->holdSince = now;
+            return;
+        }
+
+        if ( now - c->holdSince < BULK_COALESCE_MS )
+        {
+            return;
+        }
     }
 
-    /* Shut all the client connections */
-    volatile struct nwClient *c = h->firstClient;
+    c->holding = false;
 
-    /* Terminate all the clients */
-    while ( c )
+    /* A pending control frame goes out ahead of any more stream data */
+    if ( !_clientFlushControl( c ) )
+    {
+        return;
+    }
+
+    /* Anything already spilled goes out next, so ordering is preserved */
+    if ( ( c->spill ) && ( !_clientDrainSpill( c ) ) )
+    {
+        return;
+    }
+
+    /* Inject a flow report when there is fresh loss to tell the client about, or just
+     * periodically; only ever at a frame boundary so the framing stays intact.
+     */
+    if ( ( h->flowReports ) &&
+            ( ( c->dropped != c->reportedDrops ) || ( c->rp - c->lastReportRp >= FLOW_REPORT_EVERY ) ) &&
+            ( ( !c->rp ) || ( COBS_SYNC_CHAR == h->ring[( c->rp - 1 ) & RING_MASK] ) ) )
+    {
+        _clientQueueFlowReport( c );
+
+        if ( !_clientFlushControl( c ) )
+        {
+            return;
+        }
+    }
+
+    /* Send everything between our cursor and the write point, a transfer at a time. The
+     * publisher may overwrite the ring while we work, so each span is staged into a bounce
+     * buffer and the write point re-checked before it goes out; a client lapped mid-copy
+     * sends nothing torn, it just falls into the overrun handling on the next pass.
+     */
+    uint8_t txBuf[TRANSFER_SIZE];
+
+    while ( ( wp != c->rp ) && ( !c->finish ) )
+    {
+        uint64_t sendWp = wp;
+
+        if ( c->filtering )
+        {
+            sendWp = _clientFilterExtent( h, c, wp );
+
+            if ( sendWp == c->rp )
+            {
+                /* Nothing complete and wanted yet...sleep until more is published */
+                c->stalledAt = wp;
+                break;
+            }
+        }
+
+        uint32_t ri = c->rp & RING_MASK;
+        uint64_t t  = sendWp - c->rp;
+        ssize_t sent;
+
+        if ( t > TRANSFER_SIZE )
+        {
+            t = TRANSFER_SIZE;
+        }
+
+        /* Stage the span, wrapping over the ring end if needed */
+        if ( ri + t > RING_SIZE )
+        {
+            uint32_t firstSpan = RING_SIZE - ri;
+            memcpy( txBuf, &h->ring[ri], firstSpan );
+            memcpy( &txBuf[firstSpan], h->ring, t - firstSpan );
+        }
+        else
+        {
+            memcpy( txBuf, &h->ring[ri], t );
+        }
+
+        /* If the publisher lapped us while we were copying then what we staged may be torn */
+        if ( atomic_load( &h->ringWp ) - c->rp > RING_SIZE )
+        {
+            break;
+        }
+
+        /* SIGPIPE is ignored process-wide, so a vanished client surfaces as EPIPE here */
+        sent = send( c->fdNo, txBuf, t, MSG_NOSIGNAL );
+
+        if ( sent > 0 )
+        {
+            c->rp += sent;
+        }
+        else if ( ( sent < 0 ) && ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) )
+        {
+            /* Client socket is full...POLLOUT will bring us back when it drains, and the
+             * overrun check above catches it if it stays stuck for too long. */
+            break;
+        }
+        else
+        {
+            genericsReport( V_INFO, "Lost connection index %d" EOL, c->fdNo );
+            c->finish = true;
+        }
+    }
+}
+// ====================================================================================================
+static void _clientAccept( struct nwclientsHandle *h )
+
+/* Take on a new connection from the listening socket */
+
+{
+    struct sockaddr_in cli_addr;
+#ifdef WIN32
+    int clilen = sizeof( cli_addr );
+#else
+    socklen_t clilen = sizeof( cli_addr );
+#endif
+    char s[100];
+
+    int newsockfd = accept( h->sockfd, ( struct sockaddr * ) &cli_addr, &clilen );
+
+    if ( newsockfd < 0 )
+    {
+        return;
+    }
+
+    inet_ntop( AF_INET, &cli_addr.sin_addr, s, 99 );
+    genericsReport( V_INFO, "New connection from %s index %d" EOL, s, newsockfd );
+
+    /* We got a new connection - spawn a record to handle it */
+    struct nwClient *client = ( struct nwClient * )calloc( 1, sizeof( struct nwClient ) );
+    MEMCHECKV( client );
+
+    client->parent = h;
+    client->fdNo = newsockfd;
+
+    /* Low latency is the default policy; a MODE command opts into coalescing */
+    _clientSetNodelay( client, true );
+
+    /* New clients start from the current write point...they don't get history */
+    client->rp = atomic_load( &h->ringWp );
+
+    /* Make port non-blocking */
+#ifdef WIN32
+    unsigned long mode = 1;
+    ioctlsocket( newsockfd, FIONBIO, &mode );
+#else
+    int flags = fcntl( newsockfd, F_GETFL, 0 );
+
+    if ( flags != -1 )
+    {
+        fcntl( newsockfd, F_SETFL, flags | O_NONBLOCK );
+    }
+
+#endif
+
+    /* Hook into linked list; we are the only thread that ever touches it */
+    client->nextClient = h->firstClient;
+    client->prevClient = NULL;
+
+    if ( client->nextClient )
+    {
+        client->nextClient->prevClient = client;
+    }
+
+    h->firstClient = client;
+}
+// ====================================================================================================
+static void *_managerTask( void *arg )
+
+/* Single thread servicing the listening socket and every connected client. Clients all
+ * read from the shared ring at their own cursor, so there is no per-client buffering;
+ * the poll set carries POLLOUT only for clients with unsent data, and the publisher
+ * kicks us over the self-pipe when something new lands in the ring.
+ */
+
+{
+    struct nwclientsHandle *h = ( struct nwclientsHandle * )arg;
+
+    if ( ( _placementCpu >= 0 ) && ( !genericsSetThreadAffinity( _placementCpu ) ) )
+    {
+        genericsReport( V_WARN, "Could not pin network manager to CPU %d" EOL, _placementCpu );
+    }
+
+    listen( h->sockfd, 5 );
+
+    while ( !h->ending )
+    {
+        volatile struct nwClient *c;
+        int numClients = 0;
+        int n = 0;
+
+        for ( c = h->firstClient; c; c = c->nextClient )
+        {
+            numClients++;
+        }
+
+        /* Two fixed slots; the wake pipe (when we have one) and the listening socket */
+        if ( numClients + 2 > h->pfdCap )
+        {
+            h->pfdCap = numClients + 2;
+            h->pfds = ( struct pollfd * )realloc( h->pfds, h->pfdCap * sizeof( struct pollfd ) );
+            MEMCHECKV( h->pfds );
+        }
+
+#ifndef WIN32
+        h->pfds[n].fd = h->wakeFd[0];
+        h->pfds[n].events = POLLIN;
+        n++;
+#endif
+
+        if ( h->sockfd > 0 )
+        {
+            h->pfds[n].fd = h->sockfd;
+            h->pfds[n].events = POLLIN;
+            n++;
+        }
+
+        int firstClientSlot = n;
+        int timeout = MANAGER_POLL_TIMEOUT_MS;
+
+        for ( c = h->firstClient; c; c = c->nextClient )
+        {
+            bool pending = _clientPending( h, ( struct nwClient * )c );
+            bool held    = ( c->bulk ) && ( c->holding );
+
+            h->pfds[n].fd = c->fdNo;
+            h->pfds[n].events = POLLIN | ( ( pending && !held ) ? POLLOUT : 0 );
+
+            /* A held client needs us back when its window runs out, not when its socket drains */
+            if ( pending && held )
+            {
+                timeout = BULK_COALESCE_MS;
+            }
+
+            n++;
+        }
+
+        if ( poll( h->pfds, n, timeout ) < 0 )
+        {
+            break;
+        }
+
+        if ( h->ending )
+        {
+            break;
+        }
+
+#ifndef WIN32
+
+        if ( h->pfds[0].revents & POLLIN )
+        {
+            /* Drain the kick; its only message is that the write point moved */
+            uint8_t scratch[16];
+
+            while ( read( h->wakeFd[0], scratch, sizeof( scratch ) ) > 0 )
+            {
+            }
+        }
+
+#endif
+
+        if ( ( h->sockfd > 0 ) && ( h->pfds[firstClientSlot - 1].fd == h->sockfd ) &&
+                ( h->pfds[firstClientSlot - 1].revents & POLLIN ) )
+        {
+            _clientAccept( h );
+        }
+
+        /* Service the clients which were in the poll set; one just accepted sits at the
+         * head of the list without a slot, so resynchronise on fd and it gets its turn
+         * next time around.
+         */
+        n = firstClientSlot;
+
+        for ( c = h->firstClient; c && ( n < firstClientSlot + numClients ); c = c->nextClient )
+        {
+            if ( c->fdNo != h->pfds[n].fd )
+            {
+                continue;
+            }
+
+            struct nwClient *cc = ( struct nwClient * )c;
+
+            if ( h->pfds[n].revents & ( POLLIN | POLLERR | POLLHUP ) )
+            {
+                /* Deal with any subscription changes the client has sent */
+                _clientPollCommand( cc );
+            }
+
+            if ( !cc->finish )
+            {
+                _clientDrain( h, cc );
+            }
+
+            n++;
+        }
+
+        /* Tidy away anyone who finished this pass */
+        c = h->firstClient;
+
+        while ( c )
+        {
+            volatile struct nwClient *nextc = c->nextClient;
+
+            if ( c->finish )
+            {
+                _clientRemove( c );
+            }
+
+            c = nextc;
+        }
+    }
+
+    /* Close down; drop every remaining client and the listening socket */
+    while ( h->firstClient )
+    {
+        _clientRemove( h->firstClient );
+    }
+
+    if ( h->sockfd > 0 )
+    {
+        close( h->sockfd );
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Externally available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+void nwclientSend( struct nwclientsHandle *h, uint32_t len, const uint8_t *ipbuffer )
+
+/* Publish a block into the broadcast ring. This is a single copy regardless of how
+ * many clients are attached; the manager thread drains it to each at its own pace.
+ *
+ * This path takes no lock and never touches the client registry; connects and
+ * disconnects happen entirely on the manager thread, which is the registry's only
+ * owner, so a client joining or leaving can never stall publication. The only
+ * shared state is the ring write point, which moves by a single atomic store
+ * after the payload bytes are in place.
+ */
+
+{
+    if ( !h || !len )
+    {
+        return;
+    }
+
+    assert( len <= RING_SIZE );
+
+    uint64_t wp = atomic_load( &h->ringWp );
+    uint32_t wi = wp & RING_MASK;
+
+    /* Copy in, wrapping over the ring end if needed */
+    if ( wi + len > RING_SIZE )
+    {
+        uint32_t firstSpan = RING_SIZE - wi;
+        memcpy( &h->ring[wi], ipbuffer, firstSpan );
+        memcpy( &h->ring[0], &ipbuffer[firstSpan], len - firstSpan );
+    }
+    else
+    {
+        memcpy( &h->ring[wi], ipbuffer, len );
+    }
+
+    atomic_store( &h->ringWp, wp + len );
+
+#ifdef LINUX
+
+    /* Local clients share the ring storage, they just need their own write point and kick */
+    if ( h->shm )
+    {
+        atomic_store( &h->shm->wp, wp + len );
+        _shmRingKick( h->shm );
+    }
+
+#endif
+
+#ifndef WIN32
+    /* Kick the manager so it distributes the new data. If the pipe is full then a kick
+     * is already pending, which serves just as well. */
+    uint8_t kick = 0;
+
+    if ( write( h->wakeFd[1], &kick, 1 ) < 0 )
+    {
+    }
+
+#endif
+}
+// ====================================================================================================
+void nwclientEnableFlowReports( struct nwclientsHandle *h )
+
+/* Mark this port as carrying COBS-framed OFLOW data that flow reports may be injected
+ * into. Overrunning clients on such a port are resynced and told about their loss
+ * rather than disconnected.
+ */
+
+{
+    if ( h )
+    {
+        h->flowReports = true;
+    }
+}
+// ====================================================================================================
+void nwclientSetPlacement( int cpu )
+
+/* Set the CPU that manager threads created from here on will be pinned to (-1 = unpinned).
+ * Applies to threads started after the call, not to ones already running.
+ */
+
+{
+    _placementCpu = cpu;
+}
+// ====================================================================================================
+void nwclientSetSpill( const char *dir, uint64_t perClientBytes, uint64_t totalBytes )
+
+/* Engage the laggard spill policy; clients about to be lapped get their backlog moved into
+ * files under dir, within the given per-client and aggregate byte budgets.
+ */
+
+{
+    _spillDir = dir;
+    _spillClientMax = perClientBytes;
+    _spillTotalMax = totalBytes;
+}
+// ====================================================================================================
+void nwclientSpillStats( uint64_t *held, uint64_t *ever )
+
+/* Telemetry for the interval report; spill bytes currently held and ever written */
+
+{
+    *held = atomic_load( &_spillHeld );
+    *ever = atomic_load( &_spillEver );
+}
+// ====================================================================================================
+// Socket activation
+// ====================================================================================================
+#ifdef LINUX
+static int _numActivationFds;
+static int *_activationFd;
+
+static void _activationCollect( void )
+
+/* Collect any pre-bound listening sockets the service manager handed over. Runs once; the
+ * environment is scrubbed afterwards so forked children don't inherit a stale fd claim.
+ */
+
+{
+    static bool collected = false;
+
+    if ( collected )
+    {
+        return;
+    }
+
+    collected = true;
+
+    const char *pidStr = getenv( "LISTEN_PID" );
+    const char *fdStr  = getenv( "LISTEN_FDS" );
+
+    if ( ( !pidStr ) || ( !fdStr ) || ( atoi( pidStr ) != getpid() ) )
+    {
+        return;
+    }
+
+    int n = atoi( fdStr );
+
+    if ( ( n <= 0 ) || ( n > 1024 ) )
+    {
+        return;
+    }
+
+    _activationFd = ( int * )calloc( n, sizeof( int ) );
+    MEMCHECKV( _activationFd );
+
+    for ( int i = 0; i < n; i++ )
+    {
+        /* The manager passes these with CLOEXEC clear; they mustn't leak any further */
+        _activationFd[i] = SD_LISTEN_FDS_START + i;
+        fcntl( _activationFd[i], F_SETFD, FD_CLOEXEC );
+    }
+
+    _numActivationFds = n;
+    unsetenv( "LISTEN_PID" );
+    unsetenv( "LISTEN_FDS" );
+    unsetenv( "LISTEN_FDNAMES" );
+}
+// ====================================================================================================
+static int _activationAdopt( int port )
+
+/* Return an inherited listening socket already bound to this TCP port, or -1 to bind
+ * conventionally. Each inherited fd is adoptable exactly once.
+ */
+
+{
+    struct sockaddr_in sa;
+    socklen_t sl;
+
+    _activationCollect();
+
+    for ( int i = 0; i < _numActivationFds; i++ )
+    {
+        if ( _activationFd[i] < 0 )
+        {
+            continue;
+        }
+
+        sl = sizeof( sa );
+
+        if ( ( getsockname( _activationFd[i], ( struct sockaddr * )&sa, &sl ) < 0 ) ||
+                ( sa.sin_family != AF_INET ) || ( ntohs( sa.sin_port ) != port ) )
+        {
+            continue;
+        }
+
+        int fd = _activationFd[i];
+        _activationFd[i] = -1;
+        return fd;
+    }
+
+    return -1;
+}
+#endif
+// ====================================================================================================
+struct nwclientsHandle *nwclientStart( int port )
+
+/* Creating the managing server thread */
+
+{
+    struct sockaddr_in serv_addr;
+    int flag = 1;
+    struct nwclientsHandle *h = ( struct nwclientsHandle * )calloc( 1, sizeof( struct nwclientsHandle ) );
+    MEMCHECK( h, NULL );
+
+#ifdef LINUX
+    /* If we can get a shared memory segment then the ring lives in it, so clients on
+     * this host can read the data in place rather than over loopback TCP. */
+    _shmRingCreate( h, port );
+
+    if ( h->shm )
+    {
+        h->ring = h->shm->d;
+    }
+    else
+#endif
+    {
+        h->ring = ( uint8_t * )malloc( RING_SIZE );
+        MEMCHECK( h->ring, NULL );
+    }
+
+    atomic_init( &h->ringWp, 0 );
+
+#ifndef WIN32
+
+    /* Non-blocking on both ends; a full pipe means a wake is already queued */
+    if ( pipe( h->wakeFd ) < 0 )
+    {
+        genericsReport( V_ERROR, "Failed to create manager wake pipe" EOL );
+        goto free_and_return;
+    }
+
+    fcntl( h->wakeFd[0], F_SETFL, fcntl( h->wakeFd[0], F_GETFL, 0 ) | O_NONBLOCK );
+    fcntl( h->wakeFd[1], F_SETFL, fcntl( h->wakeFd[1], F_GETFL, 0 ) | O_NONBLOCK );
+#endif
+
+#ifdef LINUX
+    /* A socket-activated start hands over listening sockets already bound, so clients can
+     * connect (and queue in the backlog) while the daemon is still coming up */
+    h->sockfd = _activationAdopt( port );
+
+    if ( h->sockfd < 0 )
+#endif
+    {
+        h->sockfd = socket( AF_INET, SOCK_STREAM, 0 );
+        setsockopt( h->sockfd, SOL_SOCKET, SO_REUSEPORT, ( const void * )&flag, sizeof( flag ) );
+
+        if ( h->sockfd < 0 )
+        {
+            genericsReport( V_ERROR, "Error opening socket" EOL );
+            goto free_and_return;
+        }
+
+        memset( ( char * ) &serv_addr, 0, sizeof( serv_addr ) );
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_addr.s_addr = INADDR_ANY;
+        serv_addr.sin_port = htons( port );
+
+        if ( setsockopt( h->sockfd, SOL_SOCKET, SO_REUSEADDR, ( const void * ) &flag, sizeof( flag ) ) < 0 )
+        {
+            genericsReport( V_ERROR, "setsockopt(SO_REUSEADDR) failed" );
+            goto free_and_return;
+        }
+
+        if ( bind( h->sockfd, ( struct sockaddr * ) &serv_addr, sizeof( serv_addr ) ) < 0 )
+        {
+            genericsReport( V_ERROR, "Error on binding" EOL );
+            goto free_and_return;
+        }
+    }
+
+    /* We have the listening socket - spawn the manager thread to handle it */
+    if ( pthread_create( &( h->ipThread ), NULL, &_managerTask, h ) )
+    {
+        genericsReport( V_ERROR, "Failed to create manager thread" EOL );
+        goto free_and_return;
+    }
+
+    return h;
+
+free_and_return:
+#ifdef LINUX
+
+    if ( h->shm )
+    {
+        _shmRingRemove( h );
+    }
+    else
+#endif
+    {
+        free( h->ring );
+    }
+
+    free( h );
+    return NULL;
+}
+// ====================================================================================================
+void nwclientShutdown( struct nwclientsHandle *h )
+
+{
+    if ( !h )
+    {
+        return;
+    }
+
+    /* Flag that we're ending, and kick the manager so it notices; it carries all the
+     * clients away with it. */
+    h->ending = true;
+
+#ifndef WIN32
+    uint8_t kick = 0;
+
+    if ( write( h->wakeFd[1], &kick, 1 ) < 0 )
+    {
+    }
+
+#endif
+
+    pthread_join( h->ipThread, NULL );
+
+#ifndef WIN32
+    close( h->wakeFd[0] );
+    close( h->wakeFd[1] );
+#endif
+
+    free( h->pfds );
+
+#ifdef LINUX
+
+    if ( h->shm )
+    {
+        _shmRingRemove( h );
+    }
+    else
+#endif
     {
-        volatile struct nwClient *newc = c->nextClient;
-        _clientRemoveNoLock( c );
-        c = newc;
+        free( h->ring );
     }
 
-    pthread_mutex_unlock( &h->clientList );
     free( h );
 }
 // ====================================================================================================
@@ -14,6 +14,100 @@
 #include "cobs.h"
 #include "oflow.h"
 
+#if defined( __SSE4_2__ )
+    #include <nmmintrin.h>
+#elif defined( __ARM_FEATURE_CRC32 )
+    #include <arm_acle.h>
+#endif
+
+// ====================================================================================================
+// CRC32C (Castagnoli), reflected form, as used by the optional frame trailers. The raw
+// accumulator is exposed so the tag and payload spans can be chained; _frameCRC applies
+// the conventional pre/post inversion.
+// ====================================================================================================
+#if defined( __SSE4_2__ )
+static uint32_t _crc32c( uint32_t crc, const uint8_t *d, int len )
+
+{
+    while ( len >= 8 )
+    {
+        uint64_t v;
+        memcpy( &v, d, 8 );
+        crc = ( uint32_t )_mm_crc32_u64( crc, v );
+        d += 8;
+        len -= 8;
+    }
+
+    while ( len-- )
+    {
+        crc = _mm_crc32_u8( crc, *d++ );
+    }
+
+    return crc;
+}
+#elif defined( __ARM_FEATURE_CRC32 )
+static uint32_t _crc32c( uint32_t crc, const uint8_t *d, int len )
+
+{
+    while ( len >= 8 )
+    {
+        uint64_t v;
+        memcpy( &v, d, 8 );
+        crc = __crc32cd( crc, v );
+        d += 8;
+        len -= 8;
+    }
+
+    while ( len-- )
+    {
+        crc = __crc32cb( crc, *d++ );
+    }
+
+    return crc;
+}
+#else
+static uint32_t _crc32c( uint32_t crc, const uint8_t *d, int len )
+
+{
+    static uint32_t table[256];
+    static bool tableBuilt = false;
+
+    if ( !tableBuilt )
+    {
+        for ( uint32_t i = 0; i < 256; i++ )
+        {
+            uint32_t c = i;
+
+            for ( int j = 0; j < 8; j++ )
+            {
+                c = ( c >> 1 ) ^ ( 0x82F63B78 & -( c & 1 ) );
+            }
+
+            table[i] = c;
+        }
+
+        tableBuilt = true;
+    }
+
+    while ( len-- )
+    {
+        crc = table[( crc ^ *d++ ) & 0xff] ^ ( crc >> 8 );
+    }
+
+    return crc;
+}
+#endif
+// ====================================================================================================
+static uint32_t _frameCRC( uint8_t tag, const uint8_t *d, int len )
+
+/* CRC over a frame as it is protected on the wire; the tag byte followed by the payload */
+
+{
+    uint32_t crc = 0xFFFFFFFF;
+    crc = _crc32c( crc, &tag, 1 );
+    crc = _crc32c( crc, d, len );
+    return ~crc;
+}
 // ====================================================================================================
 struct OFLOW *OFLOWInit( struct OFLOW *t )
 
@@ -71,6 +165,69 @@ void OFLOWEncode( const uint8_t channel, const uint64_t tstamp, const uint8_t *i
 
 // ====================================================================================================
 
+void OFLOWEncodeCRC( const uint8_t channel, const uint64_t tstamp, const uint8_t *inputMsg, int len, struct Frame *o )
+
+/* Encode frame with a CRC32C trailer ahead of the sum byte. The sum still balances the
+ * whole frame, so a receiver which hasn't engaged CRC verification sees a valid legacy
+ * frame with four extra payload bytes; senders must announce OFLOW_CAP_CRC32C first.
+ */
+
+{
+    const uint8_t frontMatter[1] = { channel };
+    uint32_t crc = _frameCRC( channel, inputMsg, len );
+    uint8_t backMatter[OFLOW_CRC_TRAILER_LEN + 1] = { crc & 0xff, ( crc >> 8 ) & 0xff, ( crc >> 16 ) & 0xff, ( crc >> 24 ) & 0xff };
+    uint8_t sum = channel;
+
+    /* Calculate packet sum for last byte */
+    for ( int i = 0; i < len; i++ )
+    {
+        sum += inputMsg[i];
+    }
+
+    for ( int i = 0; i < OFLOW_CRC_TRAILER_LEN; i++ )
+    {
+        sum += backMatter[i];
+    }
+
+    /* Ensure total sums to 0 */
+    backMatter[OFLOW_CRC_TRAILER_LEN] = 256 - sum;
+
+    COBSEncode( frontMatter, 1, backMatter, OFLOW_CRC_TRAILER_LEN + 1, inputMsg, len, o );
+}
+
+// ====================================================================================================
+
+void OFLOWEncodeCapabilities( uint32_t caps, struct Frame *o )
+
+/* Encode a capability announcement frame. This rides the reserved capability tag and is
+ * consumed by the decoder rather than forwarded; it never carries a CRC trailer itself.
+ */
+
+{
+    uint8_t d[4] = { caps & 0xff, ( caps >> 8 ) & 0xff, ( caps >> 16 ) & 0xff, ( caps >> 24 ) & 0xff };
+
+    OFLOWEncode( OFLOW_CAP_TAG, 0, d, 4, o );
+}
+
+// ====================================================================================================
+void OFLOWEncodeFlowReport( uint64_t seq, uint64_t dropped, struct Frame *o )
+
+/* Create a flow report frame; both fields little-endian */
+
+{
+    uint8_t d[OFLOW_FLOW_PAYLOAD_LEN];
+
+    for ( int i = 0; i < 8; i++ )
+    {
+        d[i]     = ( seq >> ( 8 * i ) ) & 0xff;
+        d[i + 8] = ( dropped >> ( 8 * i ) ) & 0xff;
+    }
+
+    OFLOWEncode( OFLOW_FLOW_TAG, 0, d, OFLOW_FLOW_PAYLOAD_LEN, o );
+}
+
+// ====================================================================================================
+
 bool OFLOWisEOFRAME( const uint8_t *inputEnc )
 
 {
@@ -95,17 +252,68 @@ static void _pumpcb( struct Frame *p, void *param )
         t->f.sum  = p->d[p->len - 1]; /* Last byte of an OFLOW frame is the sum */
         t->f.d    = &p->d[1];         /* This is the rest of the data */
 
-        /* Calculate received packet sum and insert good status into packet */
-        uint8_t sum  = t->f.tag;
+        /* The unstuffer summed the bytes as it copied them; a whole frame balances to zero,
+         * so validation here is a compare, not a second pass over the payload */
+        t->f.good = ( 0 == p->sum );
+        t->perror += !( t->f.good );
 
-        for ( int i = 0; i < t->f.len; i++ )
+        /* A capability announcement is link-level; act on it and consume it */
+        if ( OFLOW_CAP_TAG == t->f.tag )
         {
-            sum += t->f.d[i];
+            if ( ( t->f.good ) && ( t->f.len >= 4 ) )
+            {
+                uint32_t caps = t->f.d[0] | ( t->f.d[1] << 8 ) | ( ( uint32_t )t->f.d[2] << 16 ) | ( ( uint32_t )t->f.d[3] << 24 );
+                t->useCRC = ( 0 != ( caps & OFLOW_CAP_CRC32C ) );
+            }
+
+            return;
         }
 
-        sum += t->f.sum;
-        t->f.good = ( sum == 0 );
-        t->perror += !( t->f.good );
+        /* Flow reports are also link-level; note the statistics and consume the frame */
+        if ( OFLOW_FLOW_TAG == t->f.tag )
+        {
+            if ( ( t->f.good ) && ( t->f.len >= OFLOW_FLOW_PAYLOAD_LEN ) )
+            {
+                struct OFLOWFlowReport rep = { 0, 0 };
+
+                for ( int i = 7; i >= 0; i-- )
+                {
+                    rep.seq     = ( rep.seq << 8 )     | t->f.d[i];
+                    rep.dropped = ( rep.dropped << 8 ) | t->f.d[i + 8];
+                }
+
+                t->flowGaps += ( rep.dropped > t->flow.dropped );
+                t->flow = rep;
+                t->flowReports++;
+            }
+
+            return;
+        }
+
+        /* Once announced, CRC trailers cover every regular tag; the reserved transport
+         * tags are host-injected behind the sender's back and keep the sum only.
+         */
+        if ( ( t->useCRC ) && ( t->f.tag < OFLOW_CAP_TAG ) )
+        {
+            if ( t->f.len < OFLOW_CRC_TRAILER_LEN )
+            {
+                t->crcErrors++;
+                t->perror++;
+                return;
+            }
+
+            t->f.len -= OFLOW_CRC_TRAILER_LEN;
+            const uint8_t *cp = &t->f.d[t->f.len];
+            uint32_t rxCRC = cp[0] | ( cp[1] << 8 ) | ( ( uint32_t )cp[2] << 16 ) | ( ( uint32_t )cp[3] << 24 );
+
+            if ( rxCRC != _frameCRC( t->f.tag, t->f.d, t->f.len ) )
+            {
+                /* Corrupt frame...quarantine it rather than poisoning downstream decoders */
+                t->crcErrors++;
+                t->perror++;
+                return;
+            }
+        }
 
         /* Timestamp was already set for this cluster */
         ( t->cb )( &t->f, t->param );
@@ -122,12 +330,318 @@ void OFLOWPump( struct OFLOW *t, const uint8_t *incoming, int len,
 {
     struct timespec ts;
     t->cb = packetRxed;
-    clock_gettime( CLOCK_REALTIME, &ts );
-    t->f.tstamp = ts.tv_sec * OFLOW_TS_RESOLUTION + ts.tv_nsec; /* For now, fake the timestamp */
+
+    if ( t->arrivalTime )
+    {
+        /* The caller knows when these bytes really arrived; use that and consume it */
+        t->f.tstamp = t->arrivalTime;
+        t->arrivalTime = 0;
+    }
+    else
+    {
+        clock_gettime( CLOCK_REALTIME, &ts );
+        t->f.tstamp = ts.tv_sec * OFLOW_TS_RESOLUTION + ts.tv_nsec; /* For now, fake the timestamp */
+    }
+
     t->param = param;
     COBSPump( &t->c, incoming, len, _pumpcb, t );
 }
 
+// ====================================================================================================
+// Capture salvage service
+// ====================================================================================================
+static bool _salvageDecode( const uint8_t *fp, int n, struct Frame *o )
+
+/* Strict COBS decode of a delimiter-free candidate span. Unlike COBSSimpleDecode this never
+ * reads beyond the span and insists the group codes tile it exactly, which is what separates
+ * a plausible frame from rubbish that merely happens to sit between two delimiters.
+ */
+
+{
+    const uint8_t *efp = fp + n;
+    uint8_t *op = o->d;
+
+    while ( fp < efp )
+    {
+        uint8_t interval = *fp++;
+
+        if ( efp - fp < interval - 1 )
+        {
+            /* Group code promises more bytes than the candidate holds */
+            return false;
+        }
+
+        memcpy( op, fp, interval - 1 );
+        op += interval - 1;
+        fp += interval - 1;
+
+        if ( ( interval != 0xff ) && ( fp < efp ) )
+        {
+            *op++ = COBS_SYNC_CHAR;
+        }
+    }
+
+    o->len = op - o->d;
+    return o->len != 0;
+}
+// ====================================================================================================
+static void _salvageCandidate( struct OFLOWSalvage *s, const uint8_t *cand, int n )
+
+/* Judge one delimiter-bounded candidate; deliver it if it proves out, otherwise fold it into
+ * the gap under construction. A gap closes (and is reported) only when a good frame follows.
+ */
+
+{
+    bool wasOverlong = s->overlong;
+    s->overlong = false;
+
+    if ( ( !wasOverlong ) && ( !n ) )
+    {
+        /* Bare delimiter...idle padding, not evidence of damage */
+        return;
+    }
+
+    bool good = false;
+
+    if ( ( !wasOverlong ) && ( n <= COBS_MAX_ENC_PACKET_LEN ) &&
+            ( _salvageDecode( cand, n, &s->decode ) ) && ( s->decode.len >= 2 ) )
+    {
+        uint8_t sum = 0;
+
+        for ( unsigned int i = 0; i < s->decode.len; i++ )
+        {
+            sum += s->decode.d[i];
+        }
+
+        good = ( 0 == sum );
+    }
+
+    if ( !good )
+    {
+        if ( !s->inGap )
+        {
+            s->inGap = true;
+            s->gapStart = s->candStart;
+        }
+
+        return;
+    }
+
+    if ( s->inGap )
+    {
+        s->gaps++;
+        s->bytesLost += s->candStart - s->gapStart;
+
+        if ( s->gapCB )
+        {
+            s->gapCB( s->gapStart, s->candStart - s->gapStart, s->param );
+        }
+
+        s->inGap = false;
+    }
+
+    s->f.len  = s->decode.len - 2;
+    s->f.tag  = s->decode.d[0];
+    s->f.sum  = s->decode.d[s->decode.len - 1];
+    s->f.good = true;
+    s->f.tstamp = 0;
+    s->f.d    = &s->decode.d[1];
+
+    s->framesRecovered++;
+    s->bytesRecovered += s->f.len;
+
+    if ( s->frameCB )
+    {
+        s->frameCB( s->candStart, &s->f, s->param );
+    }
+}
+// ====================================================================================================
+void OFLOWSalvageInit( struct OFLOWSalvage *s,
+                       void ( *frameRecovered )( uint64_t at, struct OFLOWFrame *p, void *param ),
+                       void ( *gapFound )( uint64_t at, uint64_t len, void *param ),
+                       void *param )
+
+/* Reset a salvage scanner and attach its delivery callbacks */
+
+{
+    memset( s, 0, sizeof( struct OFLOWSalvage ) );
+    s->frameCB = frameRecovered;
+    s->gapCB   = gapFound;
+    s->param   = param;
+}
+// ====================================================================================================
+void OFLOWSalvagePump( struct OFLOWSalvage *s, const uint8_t *incoming, int len )
+
+/* Scan a block of a damaged capture. Delimiter location uses the wide scan, and a candidate
+ * lying wholly inside the block is judged in place; only spans straddling a feed boundary
+ * pay for a copy, so block size is a free choice for the caller.
+ */
+
+{
+    const uint8_t *fp = incoming;
+    const uint8_t *efp = incoming + len;
+
+    while ( fp < efp )
+    {
+        if ( ( !s->carryLen ) && ( !s->overlong ) )
+        {
+            s->candStart = s->offset;
+        }
+
+        const uint8_t *sync = COBSfindSync( fp, efp - fp );
+        int take = sync ? ( int )( sync - fp ) : ( int )( efp - fp );
+
+        if ( ( sync ) && ( !s->carryLen ) && ( !s->overlong ) )
+        {
+            /* Whole candidate lies in this block...judge it where it sits */
+            s->offset += take + 1;
+            _salvageCandidate( s, fp, take );
+            fp = sync + 1;
+            continue;
+        }
+
+        /* Accumulate into the carry buffer, spilling to 'overlong' if it can't fit */
+        if ( s->carryLen + take > ( int )sizeof( s->carry ) )
+        {
+            s->overlong = true;
+        }
+        else
+        {
+            memcpy( &s->carry[s->carryLen], fp, take );
+            s->carryLen += take;
+        }
+
+        s->offset += take;
+
+        if ( !sync )
+        {
+            return;
+        }
+
+        s->offset++;
+        _salvageCandidate( s, s->carry, s->carryLen );
+        s->carryLen = 0;
+        fp = sync + 1;
+    }
+}
+// ====================================================================================================
+void OFLOWSalvageFinalise( struct OFLOWSalvage *s )
+
+/* Flush scanner state at end of capture; a trailing candidate with no closing delimiter is
+ * by definition unprovable, so it lands in the gap map along with any gap still open.
+ */
+
+{
+    if ( ( s->carryLen ) || ( s->overlong ) )
+    {
+        if ( !s->inGap )
+        {
+            s->inGap = true;
+            s->gapStart = s->candStart;
+        }
+
+        s->carryLen = 0;
+        s->overlong = false;
+    }
+
+    if ( s->inGap )
+    {
+        s->gaps++;
+        s->bytesLost += s->offset - s->gapStart;
+
+        if ( s->gapCB )
+        {
+            s->gapCB( s->gapStart, s->offset - s->gapStart, s->param );
+        }
+
+        s->inGap = false;
+    }
+}
+
+// ====================================================================================================
+// Timestamp correlation service
+// ====================================================================================================
+void OFLOWTimelineInit( struct OFLOWTimeline *t )
+
+/* Empty the correlation table */
+
+{
+    memset( t, 0, sizeof( struct OFLOWTimeline ) );
+}
+
+// ====================================================================================================
+void OFLOWTimelineNote( struct OFLOWTimeline *t, uint64_t hwTime, uint64_t wallTime )
+
+/* Record one correlation sample. Samples that don't advance the hardware clock just refresh
+ * the wall time of the newest entry, so the table only holds distinct target times.
+ */
+
+{
+    if ( t->wp )
+    {
+        struct OFLOWTimePoint *last = &t->point[( t->wp - 1 ) & ( OFLOW_TIMELINE_LEN - 1 )];
+
+        if ( hwTime <= last->hw )
+        {
+            last->wall = wallTime;
+            return;
+        }
+    }
+
+    t->point[t->wp & ( OFLOW_TIMELINE_LEN - 1 )].hw   = hwTime;
+    t->point[t->wp & ( OFLOW_TIMELINE_LEN - 1 )].wall = wallTime;
+    t->wp++;
+}
+
+// ====================================================================================================
+bool OFLOWTimelineWall( struct OFLOWTimeline *t, uint64_t hwTime, uint64_t *wallTime )
+
+/* Return interpolated wall time for the given hardware time. The previously matched segment is
+ * tried first, so walking a monotonic sequence of queries costs a compare or two per call.
+ * Queries beyond either end of the table extrapolate along the nearest segment.
+ */
+
+{
+    if ( t->wp < 2 )
+    {
+        return false;
+    }
+
+    uint32_t oldest = ( t->wp > OFLOW_TIMELINE_LEN ) ? t->wp - OFLOW_TIMELINE_LEN : 0;
+    uint32_t newest = t->wp - 1;
+
+    /* Resume from the most recently used segment, then slide to bracket the query */
+    uint32_t s = t->mru;
+
+    if ( ( s < oldest ) || ( s >= newest ) )
+    {
+        s = oldest;
+    }
+
+    while ( ( s > oldest ) && ( hwTime < t->point[s & ( OFLOW_TIMELINE_LEN - 1 )].hw ) )
+    {
+        s--;
+    }
+
+    while ( ( s < newest - 1 ) && ( hwTime >= t->point[( s + 1 ) & ( OFLOW_TIMELINE_LEN - 1 )].hw ) )
+    {
+        s++;
+    }
+
+    t->mru = s;
+
+    const struct OFLOWTimePoint *p0 = &t->point[s & ( OFLOW_TIMELINE_LEN - 1 )];
+    const struct OFLOWTimePoint *p1 = &t->point[( s + 1 ) & ( OFLOW_TIMELINE_LEN - 1 )];
+
+    /* Signed arithmetic, since the query may lie before the segment start */
+    int64_t dh = ( int64_t )( hwTime - p0->hw );
+    int64_t spanH = ( int64_t )( p1->hw - p0->hw );
+    int64_t spanW = ( int64_t )( p1->wall - p0->wall );
+
+    *wallTime = p0->wall + ( spanW * dh ) / spanH;
+    return true;
+}
+
 // ====================================================================================================
 
 const uint8_t *OFLOWgetFrameExtent( const uint8_t *inputEnc, int len )
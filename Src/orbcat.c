@@ -20,12 +20,15 @@
 
 #include "nw.h"
 #include "git_version_info.h"
+#include "selfprof.h"
 #include "generics.h"
 #include "itmDecoder.h"
 #include "msgDecoder.h"
 #include "msgSeq.h"
 #include "stream.h"
 #include "oflow.h"
+#include "tsclock.h"
+#include "loadelf.h"
 
 #define NUM_CHANNELS  32
 
@@ -35,6 +38,8 @@
 #define MSG_REORDER_BUFLEN  (10)          /* Maximum number of samples to re-order for timekeeping */
 #define ONE_SEC_IN_USEC     (1000000L)    /* Used for time conversions...usec in one sec */
 
+#define DEDUP_REPORT_INTERVAL (ONE_SEC_IN_USEC) /* Interim fold record interval during a repeat storm */
+
 /* Formats for timestamping */
 #define REL_FORMAT            C_TSTAMP "%6" PRIu64 ".%03" PRIu64 "|" C_RESET
 #define REL_FORMAT_INIT       C_TSTAMP " R-Initial|" C_RESET
@@ -62,11 +67,15 @@ struct
     uint32_t tag;                            /* Which OFLOW tag are we decoding? */
     bool forceITMSync;
     uint64_t cps;                            /* Cycles per second for target CPU */
+    int muxChannel;                          /* Channel carrying sub-channel mux framing, -1 for none */
+    unsigned int muxBase;                    /* Channel the demuxed virtual channels appear from */
 
     enum TSType tsType;
     char *tsLineFormat;
     char tsTrigger;
     bool mono;                               /* Supress colour in output */
+    bool binary;                             /* Emit the self-describing binary event stream */
+    bool dedup;                              /* Fold repeated output lines into count records */
 
     /* Sink information */
     char *presFormat[NUM_CHANNELS + 1];      /* Format string for each channel */
@@ -77,6 +86,7 @@ struct
     enum Prot protocol;                      /* What protocol to communicate (default to OFLOW (== orbuculum)) */
 
     char *file;                              /* File host connection */
+    char *elffile;                           /* Elf file for watchpoint address attribution */
     bool endTerminate;                       /* Terminate when file/socket "ends" */
     bool ex;                             /* Support exception reporting */
 } options =
@@ -85,7 +95,41 @@ struct
     .tag = 1,
     .port = OFCLIENT_SERVER_PORT,
     .server = "localhost",
-    .tsTrigger = DEFAULT_TS_TRIGGER
+    .tsTrigger = DEFAULT_TS_TRIGGER,
+    .muxChannel = -1
+};
+
+/* Channel format strings compiled into opcode lists, so no per-message scanning is needed */
+enum fmtOpType
+{
+    FMT_LIT,                                 /* Copy literal text */
+    FMT_DEC,                                 /* Signed decimal of the value */
+    FMT_UDEC,                                /* Unsigned decimal of the value */
+    FMT_HEX,                                 /* Hex of the value */
+    FMT_CHR,                                 /* The value as a single character */
+    FMT_GEN_INT,                             /* Anything else integer-flavoured, via snprintf */
+    FMT_GEN_FLT                              /* Anything else float-flavoured, via snprintf */
+};
+
+#define FMT_MAX_SPEC (24)                    /* Longest single conversion spec we'll accept */
+
+struct fmtOp
+{
+    enum fmtOpType t;                        /* What this op does */
+    const char *lit;                         /* FMT_LIT: start of text (points into format string) */
+    uint16_t litLen;                         /* FMT_LIT: length of text */
+    char spec[FMT_MAX_SPEC];                 /* FMT_GEN_*: single-conversion format */
+    uint8_t width;                           /* Fast conversions: minimum field width */
+    bool zeroPad;                            /* Fast conversions: pad with zeros rather than spaces */
+    bool upper;                              /* FMT_HEX: uppercase digits */
+};
+
+struct fmtProg
+{
+    struct fmtOp *op;                        /* The opcodes, executed in order */
+    uint32_t nops;
+    bool charMode;                           /* Execute once per payload byte rather than once per message */
+    bool hexOnly;                            /* Program is a bare "%02x"-style dump; use the block hex kernel */
 };
 
 struct
@@ -95,10 +139,11 @@ struct
     struct MSGSeq    d;
     struct ITMPacket h;
     struct OFLOW c;
+    struct OFLOWTimeline timeline;       /* Hardware to wall clock correlation */
+    struct msgBatch batch;               /* Reusable pool for block-at-a-time decode */
 
     struct Frame cobsPart;               /* Any part frame that has been received */
-    enum timeDelay timeStatus;           /* Indicator of if this time is exact */
-    uint64_t timeStamp;                  /* Latest received time */
+    struct TSClock tsClock;              /* Running model of the target timestamp clock */
     uint64_t lastTimeStamp;              /* Last received time */
     uint64_t te;                         /* Time on host side for line stamping */
     bool gotte;                          /* Flag that we have the initial time */
@@ -107,6 +152,27 @@ struct
     uint64_t oldte;                      /* Old time for interval calculation */
     char dwtText[MAX_STRING_LENGTH];     /* DWT text that arrived while a line was in progress */
     bool ending;                         /* Time to shut up shop */
+
+    uint8_t binBlock[65536];             /* Staged binary records awaiting a block flush */
+    uint32_t binLen;                     /* Amount staged so far */
+    bool binHeaderSent;                  /* Schema header has been emitted */
+
+    struct fmtProg fmtProg[NUM_CHANNELS]; /* Compiled form of each channel's format string */
+    struct fmtProg *chanProg[256];       /* Program for any possible source address, NULL if unconfigured;
+                                          * sized for the full address byte so lookup needs no range check */
+
+    char opBlock[MAX_STRING_LENGTH];     /* Staged output awaiting a block flush */
+    size_t opBlockLen;                   /* Amount of staged output */
+
+    char dedupLine[MAX_STRING_LENGTH];   /* Line being withheld for duplicate comparison */
+    size_t dedupLineLen;                 /* Amount of it assembled so far */
+    char dedupStamp[MAX_STRING_LENGTH];  /* Timestamp captured when that line started */
+    bool dedupBypass;                    /* Line overflowed the hold buffer and streams through as-is */
+    uint64_t dedupLastDigest;            /* Digest of the last completed line */
+    uint64_t dedupRepeats;               /* Completed lines folded into the pending record so far */
+    uint64_t dedupLastReport;            /* Host time of the last fold record, for interim flushes */
+
+    struct symbol *s;                    /* Symbols for watchpoint address attribution, if available */
 } _r;
 
 #define DWT_TO_US (100000L)
@@ -122,10 +188,422 @@ uint64_t _timestamp( void )
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
+// Channel format compilation and execution
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+static void _fmtEmitOp( struct fmtProg *prog, const struct fmtOp *op )
+
+{
+    prog->op = ( struct fmtOp * )realloc( prog->op, ( prog->nops + 1 ) * sizeof( struct fmtOp ) );
+    MEMCHECKV( prog->op );
+    prog->op[prog->nops++] = *op;
+}
+// ====================================================================================================
+static void _fmtCompile( const char *fmt, struct fmtProg *prog )
+
+/* Translate a printf-style channel format into an opcode list */
+
+{
+    const char *p = fmt;
+    const char *litStart = fmt;
+    struct fmtOp op;
+    bool isFloat = false;
+
+    while ( *p )
+    {
+        if ( *p != '%' )
+        {
+            p++;
+            continue;
+        }
+
+        if ( p[1] == '%' )
+        {
+            /* Literal percent; fold the first % into the pending literal and resume after the pair */
+            memset( &op, 0, sizeof( op ) );
+            op.t = FMT_LIT;
+            op.lit = litStart;
+            op.litLen = ( p + 1 ) - litStart;
+            _fmtEmitOp( prog, &op );
+            p += 2;
+            litStart = p;
+            continue;
+        }
+
+        /* Flush any literal text accumulated up to this conversion */
+        if ( p - litStart )
+        {
+            memset( &op, 0, sizeof( op ) );
+            op.t = FMT_LIT;
+            op.lit = litStart;
+            op.litLen = p - litStart;
+            _fmtEmitOp( prog, &op );
+        }
+
+        const char *spec = p++;
+        bool zeroPad = false;
+        bool generic = false;
+        uint32_t width = 0;
+
+        while ( ( *p == '0' ) || ( *p == '-' ) || ( *p == ' ' ) || ( *p == '+' ) || ( *p == '#' ) )
+        {
+            /* Only zero padding is handled natively; other flags get the snprintf fallback */
+            if ( *p == '0' )
+            {
+                zeroPad = true;
+            }
+            else
+            {
+                generic = true;
+            }
+
+            p++;
+        }
+
+        while ( isdigit( *p ) )
+        {
+            width = width * 10 + ( *p++ - '0' );
+        }
+
+        if ( width > 31 )
+        {
+            generic = true;
+        }
+
+        if ( *p == '.' )
+        {
+            generic = true;
+            p++;
+
+            while ( isdigit( *p ) )
+            {
+                p++;
+            }
+        }
+
+        while ( ( *p == 'l' ) || ( *p == 'h' ) || ( *p == 'z' ) || ( *p == 'j' ) )
+        {
+            generic = true;
+            p++;
+        }
+
+        char conv = *p;
+
+        if ( !conv )
+        {
+            /* Dangling % at the end...treat the remnant as literal text */
+            litStart = spec;
+            break;
+        }
+
+        p++;
+        memset( &op, 0, sizeof( op ) );
+        op.width = width;
+        op.zeroPad = zeroPad;
+
+        switch ( conv )
+        {
+            case 'd':
+            case 'i':
+                op.t = FMT_DEC;
+                break;
+
+            case 'u':
+                op.t = FMT_UDEC;
+                break;
+
+            case 'X':
+                op.upper = true;
+
+            /* Fallthrough */
+            case 'x':
+                op.t = FMT_HEX;
+                break;
+
+            case 'c':
+                op.t = FMT_CHR;
+                prog->charMode = true;
+
+                if ( width )
+                {
+                    generic = true;
+                }
+
+                break;
+
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+                op.t = FMT_GEN_FLT;
+                generic = true;
+                isFloat = true;
+                break;
+
+            default:
+                /* Includes %s and friends; they behave exactly as badly as they used to */
+                op.t = FMT_GEN_INT;
+                generic = true;
+                break;
+        }
+
+        if ( generic )
+        {
+            size_t sl = p - spec;
+
+            if ( sl >= FMT_MAX_SPEC )
+            {
+                sl = FMT_MAX_SPEC - 1;
+            }
+
+            memcpy( op.spec, spec, sl );
+            op.spec[sl] = 0;
+
+            if ( op.t != FMT_GEN_FLT )
+            {
+                op.t = FMT_GEN_INT;
+            }
+        }
+
+        _fmtEmitOp( prog, &op );
+        litStart = p;
+    }
+
+    if ( p - litStart )
+    {
+        memset( &op, 0, sizeof( op ) );
+        op.t = FMT_LIT;
+        op.lit = litStart;
+        op.litLen = p - litStart;
+        _fmtEmitOp( prog, &op );
+    }
+
+    /* A float conversion consumes the whole value, so per-byte execution makes no sense */
+    if ( isFloat )
+    {
+        prog->charMode = false;
+    }
+
+    /* The classic hex-dump format gets the block conversion kernel rather than the op loop */
+    prog->hexOnly = ( ( prog->nops == 1 ) && ( prog->op[0].t == FMT_HEX ) &&
+                      ( prog->op[0].width == 2 ) && ( prog->op[0].zeroPad ) && ( !prog->charMode ) );
+}
+// ====================================================================================================
+static char *_fmtEmitNum( char *o, char *end, uint32_t v, uint32_t base, const struct fmtOp *op, bool negative )
+
+/* Render one number, right-justified in any requested field width */
+
+{
+    char tmp[34];
+    uint32_t n = 0;
+    const char *digits = op->upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+    do
+    {
+        tmp[n++] = digits[v % base];
+        v /= base;
+    }
+    while ( v );
+
+    if ( negative )
+    {
+        if ( op->zeroPad )
+        {
+            while ( n + 1 < op->width )
+            {
+                tmp[n++] = '0';
+            }
+
+            tmp[n++] = '-';
+        }
+        else
+        {
+            tmp[n++] = '-';
+
+            while ( n < op->width )
+            {
+                tmp[n++] = ' ';
+            }
+        }
+    }
+    else
+    {
+        while ( n < op->width )
+        {
+            tmp[n++] = op->zeroPad ? '0' : ' ';
+        }
+    }
+
+    while ( ( n ) && ( o < end ) )
+    {
+        *o++ = tmp[--n];
+    }
+
+    return o;
+}
+// ====================================================================================================
+static size_t _fmtExecute( const struct fmtProg *prog, uint32_t value, uint32_t nBytes, char *out, size_t outLen )
+
+/* Run a compiled format over one message payload, returning the length of the result */
+
+{
+    /* Single-byte messages under a pure hex format go straight through the hex kernel;
+     * wider values keep the op loop so the established digit order is preserved */
+    if ( ( prog->hexOnly ) && ( nBytes <= 1 ) && ( outLen >= 3 ) )
+    {
+        uint8_t b = value & 0xff;
+        genericsHexBytes( out, &b, 1, prog->op[0].upper );
+        out[2] = 0;
+        return 2;
+    }
+
+    char *o = out;
+    char *end = out + outLen - 1;
+    uint32_t passes = ( prog->charMode ) ? ( nBytes ? nBytes : 1 ) : 1;
+
+    for ( uint32_t pass = 0; pass < passes; pass++ )
+    {
+        uint32_t v = ( prog->charMode ) ? ( ( value >> ( 8 * pass ) ) & 0xff ) : value;
+
+        for ( uint32_t i = 0; i < prog->nops; i++ )
+        {
+            const struct fmtOp *op = &prog->op[i];
+
+            switch ( op->t )
+            {
+                case FMT_LIT:
+                {
+                    size_t l = op->litLen;
+
+                    if ( l > ( size_t )( end - o ) )
+                    {
+                        l = end - o;
+                    }
+
+                    memcpy( o, op->lit, l );
+                    o += l;
+                    break;
+                }
+
+                case FMT_DEC:
+                {
+                    int32_t sv = ( int32_t )v;
+                    o = _fmtEmitNum( o, end, ( sv < 0 ) ? -( uint32_t )sv : ( uint32_t )sv, 10, op, sv < 0 );
+                    break;
+                }
+
+                case FMT_UDEC:
+                    o = _fmtEmitNum( o, end, v, 10, op, false );
+                    break;
+
+                case FMT_HEX:
+                    o = _fmtEmitNum( o, end, v, 16, op, false );
+                    break;
+
+                case FMT_CHR:
+                    if ( o < end )
+                    {
+                        *o++ = ( char )v;
+                    }
+
+                    break;
+
+                case FMT_GEN_INT:
+                {
+                    int r = snprintf( o, end - o + 1, op->spec, v );
+
+                    if ( r > 0 )
+                    {
+                        o += ( r > end - o ) ? end - o : r;
+                    }
+
+                    break;
+                }
+
+                case FMT_GEN_FLT:
+                {
+                    /* type punning on same host, after correctly building 32bit val
+                     * only unsafe on systems where u32/float have diff byte order */
+                    float f;
+                    memcpy( &f, &value, sizeof( f ) );
+                    int r = snprintf( o, end - o + 1, op->spec, f );
+
+                    if ( r > 0 )
+                    {
+                        o += ( r > end - o ) ? end - o : r;
+                    }
+
+                    break;
+                }
+            }
+        }
+    }
+
+    *o = 0;
+    return o - out;
+}
+// ====================================================================================================
+static void _compileFormats( void )
+
+/* Compile each configured channel format, once, before any traffic arrives */
+
+{
+    for ( uint32_t c = 0; c < NUM_CHANNELS; c++ )
+    {
+        if ( options.presFormat[c] )
+        {
+            _fmtCompile( options.presFormat[c], &_r.fmtProg[c] );
+            _r.chanProg[c] = &_r.fmtProg[c];
+        }
+    }
+}
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
 // Handler for individual message types from SWO
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
+static void _stageFlush( void )
+
+/* Push staged output to the terminal */
+
+{
+    if ( _r.opBlockLen )
+    {
+        genericsFPrintf( stdout, "%s", _r.opBlock );
+        _r.opBlockLen = 0;
+        _r.opBlock[0] = 0;
+    }
+}
+// ====================================================================================================
+static void _stage( const char *s )
+
+/* Stage output for a block flush rather than printing it piecemeal */
+
+{
+    size_t l = strlen( s );
+
+    if ( l >= MAX_STRING_LENGTH )
+    {
+        /* Too big to stage...flush what's pending to keep ordering, then print directly */
+        _stageFlush();
+        genericsFPrintf( stdout, "%s", s );
+        return;
+    }
+
+    if ( _r.opBlockLen + l >= MAX_STRING_LENGTH )
+    {
+        _stageFlush();
+    }
+
+    memcpy( &_r.opBlock[_r.opBlockLen], s, l + 1 );
+    _r.opBlockLen += l;
+}
+// ====================================================================================================
 static void _printTimestamp( char *strstore )
 
 {
@@ -195,12 +673,12 @@ static void _printTimestamp( char *strstore )
         case TSStamp: // -----------------------------------------------------------------------
             if ( options.cps )
             {
-                uint64_t tms = ( _r.timeStamp * 1000000 ) / options.cps;
+                uint64_t tms = TSClockToUs( &_r.tsClock, TSClockTicks( &_r.tsClock ) );
                 sprintf( strstore, STAMP_FORMAT_MS, tms / 1000000, ( tms / 1000 ) % 1000, tms % 1000 );
             }
             else
             {
-                sprintf( strstore, STAMP_FORMAT, _r.timeStamp );
+                sprintf( strstore, STAMP_FORMAT, TSClockTicks( &_r.tsClock ) );
             }
 
             break;
@@ -208,17 +686,17 @@ static void _printTimestamp( char *strstore )
         case TSStampDelta: // ------------------------------------------------------------------
             if ( !_r.gotte )
             {
-                _r.lastTimeStamp = _r.timeStamp;
+                _r.lastTimeStamp = TSClockTicks( &_r.tsClock );
                 _r.gotte = true;
             }
 
-            uint64_t delta = _r.timeStamp - _r.lastTimeStamp;
-            _r.lastTimeStamp = _r.timeStamp;
+            uint64_t delta = TSClockTicks( &_r.tsClock ) - _r.lastTimeStamp;
+            _r.lastTimeStamp = TSClockTicks( &_r.tsClock );
 
             if ( options.cps )
             {
-                /* Provide some rounding .. we're at the limits of what's sensible here */
-                uint64_t tms = ( delta * 10000000 + options.cps / 2 ) / options.cps;
+                /* We're at the limits of what's sensible here; tenth-of-us resolution */
+                uint64_t tms = ( TSClockToNs( &_r.tsClock, delta ) + 50 ) / 100;
                 sprintf( strstore, STAMP_FORMAT_MS_DELTA, tms / 10000000, ( tms / 10000 ) % 10000, ( tms / 10 ) % 1000, tms % 10 );
             }
             else
@@ -233,6 +711,156 @@ static void _printTimestamp( char *strstore )
     }
 }
 // ====================================================================================================
+// Duplicate line folding. Targets stuck in assert loops can emit the same line millions of
+// times; rather than writing gigabytes the repeats are counted and folded into periodic
+// "last message repeated N times" records. Only the digest of the previous line and the line
+// currently being assembled are held, so memory stays bounded however long the storm runs.
+// ====================================================================================================
+static uint64_t _lineDigest( const char *s, size_t len )
+
+/* FNV-1a over the line content */
+
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while ( len-- )
+    {
+        h ^= ( uint8_t ) * s++;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+// ====================================================================================================
+static void _dedupFlushRepeats( void )
+
+/* Emit the pending fold record, if there is one */
+
+{
+    char opConstruct[MAX_STRING_LENGTH];
+
+    if ( _r.dedupRepeats )
+    {
+        _printTimestamp( opConstruct );
+        _stage( opConstruct );
+        snprintf( opConstruct, MAX_STRING_LENGTH, "last message repeated %" PRIu64 " times" EOL, _r.dedupRepeats );
+        _stage( opConstruct );
+        _r.dedupRepeats = 0;
+    }
+
+    _r.dedupLastReport = _timestamp();
+}
+// ====================================================================================================
+static void _dedupStageLine( const char *s )
+
+/* Append text to the line being withheld for comparison */
+
+{
+    size_t l = strlen( s );
+
+    if ( ( _r.dedupBypass ) || ( _r.dedupLineLen + l >= MAX_STRING_LENGTH ) )
+    {
+        /* Too long to hold onto...let the line stream through undeduped */
+        if ( !_r.dedupBypass )
+        {
+            _dedupFlushRepeats();
+            _stage( _r.dedupStamp );
+            _stage( _r.dedupLine );
+            _r.dedupLineLen = 0;
+            _r.dedupLine[0] = 0;
+            _r.dedupBypass = true;
+        }
+
+        _stage( s );
+        return;
+    }
+
+    memcpy( &_r.dedupLine[_r.dedupLineLen], s, l + 1 );
+    _r.dedupLineLen += l;
+}
+// ====================================================================================================
+static void _dedupLineComplete( void )
+
+/* The withheld line is finished; either fold it into the repeat count or release it */
+
+{
+    if ( _r.dedupBypass )
+    {
+        /* The tail of an overflowed line; it was never held, so it can't be compared */
+        _stage( EOL );
+        _r.dedupBypass = false;
+        _r.dedupLastDigest = 0;
+        return;
+    }
+
+    uint64_t digest = _lineDigest( _r.dedupLine, _r.dedupLineLen );
+
+    if ( digest == _r.dedupLastDigest )
+    {
+        _r.dedupRepeats++;
+
+        /* Interim records during a storm, so counts survive an interrupted session */
+        if ( _timestamp() - _r.dedupLastReport > DEDUP_REPORT_INTERVAL )
+        {
+            _dedupFlushRepeats();
+        }
+    }
+    else
+    {
+        _dedupFlushRepeats();
+        _r.dedupLastDigest = digest;
+        _stage( _r.dedupStamp );
+        _stage( _r.dedupLine );
+        _stage( EOL );
+    }
+
+    _r.dedupLineLen = 0;
+    _r.dedupLine[0] = 0;
+}
+// ====================================================================================================
+static void _dedupText( char *p )
+
+/* Line assembly for dedup mode; output is withheld until the trigger so repeats can be folded */
+
+{
+    char *q;
+
+    while ( *p )
+    {
+        if ( !_r.inLine )
+        {
+            /* The timestamp is captured now but only emitted if the line turns out to be fresh */
+            _printTimestamp( _r.dedupStamp );
+            _r.inLine = true;
+        }
+
+        q = strchr( p, options.tsTrigger );
+
+        if ( q )
+        {
+            *q = 0;
+            _dedupStageLine( p );
+            _dedupLineComplete();
+            _r.inLine = false;
+
+            /* ...and if there were any DWT messages to print we'd better output those */
+            if ( _r.dwtText[0] )
+            {
+                _stage( _r.dwtText );
+                _stage( EOL );
+                _r.dwtText[0] = 0;
+            }
+        }
+        else
+        {
+            _dedupStageLine( p );
+            break;
+        }
+
+        p = q + 1;
+    }
+}
+// ====================================================================================================
 static void _outputText( char *p )
 
 {
@@ -241,13 +869,19 @@ static void _outputText( char *p )
 
     char *q;
 
+    if ( options.dedup )
+    {
+        _dedupText( p );
+        return;
+    }
+
     while ( *p )
     {
         /* If this is the first character in a new line, then we need to generate a timestamp */
         if ( !_r.inLine )
         {
             _printTimestamp( opConstruct );
-            genericsFPrintf( stdout, "%s", opConstruct );
+            _stage( opConstruct );
             _r.inLine = true;
         }
 
@@ -257,21 +891,23 @@ static void _outputText( char *p )
         if ( q )
         {
             *q = 0;
-            genericsFPrintf( stdout, "%s" EOL, p );
+            _stage( p );
+            _stage( EOL );
             /* Once we've output these data then we're not in a line any more */
             _r.inLine = false;
 
             /* ...and if there were any DWT messages to print we'd better output those */
             if ( _r.dwtText[0] )
             {
-                genericsFPrintf( stdout, "%s" EOL, _r.dwtText );
+                _stage( _r.dwtText );
+                _stage( EOL );
                 _r.dwtText[0] = 0;
             }
         }
         else
         {
             /* Just output the whole of the data we've got, then we're done */
-            genericsFPrintf( stdout, "%s", p );
+            _stage( p );
             break;
         }
 
@@ -297,7 +933,7 @@ void _expex( const char *fmt, ... )
     /* See if we exceeded max length...if so then output what we have and start a fresh buffer */
     if ( MAX_STRING_LENGTH - strlen( _r.dwtText ) < 100 )
     {
-        genericsFPrintf( stdout, "%s", _r.dwtText );
+        _stage( _r.dwtText );
         _r.dwtText[0] = 0;
     }
 
@@ -311,7 +947,7 @@ void _expex( const char *fmt, ... )
 
     if ( !_r.inLine )
     {
-        genericsFPrintf( stdout, "%s", _r.dwtText );
+        _stage( _r.dwtText );
         _r.dwtText[0] = 0;
     }
 }
@@ -396,7 +1032,17 @@ void _handleDataAccessWP( struct wptMsg *m, struct ITMDecoder *i )
 {
     if ( options.ex )
     {
-        _expex( "HWEVENT_AWP type %d at address 0x%08x" EOL, m->comp, m->data );
+        /* If we have symbols then name the data object this address falls inside */
+        struct symbolVariableStore *v = _r.s ? symbolVariableAt( _r.s, m->data ) : NULL;
+
+        if ( v )
+        {
+            _expex( "HWEVENT_AWP type %d at address 0x%08x (%s+0x%" PRIx64 ")" EOL, m->comp, m->data, v->name, ( uint64_t )( m->data - v->addr ) );
+        }
+        else
+        {
+            _expex( "HWEVENT_AWP type %d at address 0x%08x" EOL, m->comp, m->data );
+        }
     }
 }
 // ====================================================================================================
@@ -427,40 +1073,17 @@ static void _handleSW( struct swMsg *m, struct ITMDecoder *i )
     assert( m->msgtype == MSG_SOFTWARE );
     char opConstruct[MAX_STRING_LENGTH];
 
-    char *p = opConstruct;
-
-    /* Make sure line is empty by default */
-    *p = 0;
+    /* One load decides if this channel is interesting, however many were configured */
+    struct fmtProg *prog = _r.chanProg[m->srcAddr];
 
-    /* Print anything we want to output into the buffer */
-    if ( ( m->srcAddr < NUM_CHANNELS ) && ( options.presFormat[m->srcAddr] ) )
+    if ( !prog )
     {
-        // formatted output....start with specials
-        if ( strstr( options.presFormat[m->srcAddr], "%f" ) )
-        {
-            /* type punning on same host, after correctly building 32bit val
-             * only unsafe on systems where u32/float have diff byte order */
-            float *nastycast = ( float * )&m->value;
-            p += snprintf( p, MAX_STRING_LENGTH - ( p - opConstruct ), options.presFormat[m->srcAddr], *nastycast, *nastycast, *nastycast, *nastycast );
-        }
-        else if ( strstr( options.presFormat[m->srcAddr], "%c" ) )
-        {
-            /* Format contains %c, so execute repeatedly for all characters in sent data */
-            uint8_t op[4] = {m->value & 0xff, ( m->value >> 8 ) & 0xff, ( m->value >> 16 ) & 0xff, ( m->value >> 24 ) & 0xff};
-            uint32_t l = 0;
-
-            do
-            {
-                p += snprintf( p, MAX_STRING_LENGTH - ( p - opConstruct ), options.presFormat[m->srcAddr], op[l], op[l], op[l] );
-            }
-            while ( ++l < m->len );
-        }
-        else
-        {
-            p += snprintf( p, MAX_STRING_LENGTH - ( p - opConstruct ), options.presFormat[m->srcAddr], m->value, m->value, m->value, m->value );
-        }
+        return;
     }
 
+    /* Print anything we want to output into the buffer, via the compiled form of the format */
+    _fmtExecute( prog, m->value, m->len, opConstruct, MAX_STRING_LENGTH );
+
     /* Whatever we have, it can be sent for output */
     _outputText( opConstruct );
 }
@@ -469,35 +1092,185 @@ static void _handleTS( struct TSMsg *m, struct ITMDecoder *i )
 
 {
     assert( m->msgtype == MSG_TS );
-    _r.timeStamp += m->timeInc;
+    TSClockTick( &_r.tsClock, m, _timestamp() );
+
+    /* File a correlation point so target times can be mapped to wall clock on demand */
+    OFLOWTimelineNote( &_r.timeline, TSClockTicks( &_r.tsClock ), _timestamp() );
 }
 // ====================================================================================================
-static void _itmPumpProcess( char c )
+// Binary event stream. An alternative sink to the text formatter: one schema signature at
+// stream start, then fixed little-endian records, each length-prefixed, so an ingestion
+// pipeline consumes events without parsing formatted text. Message type values are stable
+// by contract (see msgDecoder.h), so they double as the record type.
+// ====================================================================================================
+#define BIN_SIGNATURE "%ORBCATB1%"
+
+static void _binFlush( void )
 
 {
-    struct msg p;
-    struct msg *pp;
+    if ( _r.binLen )
+    {
+        fwrite( _r.binBlock, 1, _r.binLen, stdout );
+        _r.binLen = 0;
+    }
+}
+// ====================================================================================================
+static uint8_t *_binPut32( uint8_t *p, uint32_t v )
 
-    typedef void ( *handlers )( void *decoded, struct ITMDecoder * i );
+{
+    *p++ = v & 0xff;
+    *p++ = ( v >> 8 ) & 0xff;
+    *p++ = ( v >> 16 ) & 0xff;
+    *p++ = ( v >> 24 ) & 0xff;
+    return p;
+}
+// ====================================================================================================
+static uint8_t *_binStage( uint8_t len, uint8_t type )
+
+/* Reserve one record in the staging block and fill its common prefix; the caller
+ * appends the type-specific fields to the returned pointer.
+ */
+
+{
+    if ( !_r.binHeaderSent )
+    {
+        memcpy( _r.binBlock, BIN_SIGNATURE, sizeof( BIN_SIGNATURE ) - 1 );
+        _r.binLen = sizeof( BIN_SIGNATURE ) - 1;
+        _r.binHeaderSent = true;
+    }
+
+    if ( _r.binLen + len > sizeof( _r.binBlock ) )
+    {
+        _binFlush();
+    }
+
+    uint8_t *p = &_r.binBlock[_r.binLen];
+    _r.binLen += len;
+
+    *p++ = len;
+    *p++ = type;
+    p = _binPut32( p, ( uint32_t )TSClockTicks( &_r.tsClock ) );
+    return _binPut32( p, ( uint32_t )( TSClockTicks( &_r.tsClock ) >> 32 ) );
+}
+// ====================================================================================================
+static void _binHandler( void *decoded, void *param )
+
+/* Serialize one decoded message as a fixed record. Every message struct leads with its
+ * type, so one handler covers the whole table.
+ */
 
-    /* Handlers for each complete message received */
-    static const handlers h[MSG_NUM_MSGS] =
+{
+    struct msg *m = ( struct msg * )decoded;
+    uint8_t *p;
+
+    switch ( m->genericMsg.msgtype )
     {
-        /* MSG_UNKNOWN */         NULL,
-        /* MSG_RESERVED */        NULL,
-        /* MSG_ERROR */           NULL,
-        /* MSG_NONE */            NULL,
-        /* MSG_SOFTWARE */        ( handlers )_handleSW,
-        /* MSG_NISYNC */          ( handlers )_handleNISYNC,
-        /* MSG_OSW */             ( handlers )_handleDataOffsetWP,
-        /* MSG_DATA_ACCESS_WP */  ( handlers )_handleDataAccessWP,
-        /* MSG_DATA_RWWP */       ( handlers )_handleDataRWWP,
-        /* MSG_PC_SAMPLE */       NULL,
-        /* MSG_DWT_EVENT */       ( handlers )_handleDWTEvent,
-        /* MSG_EXCEPTION */       ( handlers )_handleException,
-        /* MSG_TS */              ( handlers )_handleTS
-    };
+        case MSG_TS:
+        {
+            struct TSMsg *ts = ( struct TSMsg * )decoded;
+
+            /* The running target time advances before the record carrying it is cut */
+            TSClockTick( &_r.tsClock, ts, _timestamp() );
+            OFLOWTimelineNote( &_r.timeline, TSClockTicks( &_r.tsClock ), _timestamp() );
+            p = _binStage( 15, MSG_TS );
+            *p++ = ts->timeStatus;
+            _binPut32( p, ts->timeInc );
+            break;
+        }
+
+        case MSG_SOFTWARE:
+            p = _binStage( 16, MSG_SOFTWARE );
+            *p++ = m->swMsg.srcAddr;
+            *p++ = m->swMsg.len;
+            _binPut32( p, m->swMsg.value );
+            break;
+
+        case MSG_NISYNC:
+            p = _binStage( 15, MSG_NISYNC );
+            *p++ = m->nisyncMsg.type;
+            _binPut32( p, m->nisyncMsg.addr );
+            break;
+
+        case MSG_OSW:
+            p = _binStage( 15, MSG_OSW );
+            *p++ = m->oswMsg.comp;
+            _binPut32( p, m->oswMsg.offset );
+            break;
 
+        case MSG_DATA_ACCESS_WP:
+            p = _binStage( 15, MSG_DATA_ACCESS_WP );
+            *p++ = m->wptMsg.comp;
+            _binPut32( p, m->wptMsg.data );
+            break;
+
+        case MSG_DATA_RWWP:
+            p = _binStage( 16, MSG_DATA_RWWP );
+            *p++ = m->watchMsg.comp;
+            *p++ = m->watchMsg.isWrite ? 1 : 0;
+            _binPut32( p, m->watchMsg.data );
+            break;
+
+        case MSG_PC_SAMPLE:
+            p = _binStage( 15, MSG_PC_SAMPLE );
+            *p++ = m->pcSampleMsg.sleep ? 1 : 0;
+            _binPut32( p, m->pcSampleMsg.pc );
+            break;
+
+        case MSG_DWT_EVENT:
+            p = _binStage( 11, MSG_DWT_EVENT );
+            *p++ = m->dwtMsg.event;
+            break;
+
+        case MSG_EXCEPTION:
+            p = _binStage( 15, MSG_EXCEPTION );
+            p = _binPut32( p, m->excMsg.exceptionNumber );
+            *p = m->excMsg.eventType;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Binary-mode handler table; every type the text table serves, plus PC samples */
+static const msgHandler hBin[MSG_NUM_MSGS] =
+{
+    /* MSG_UNKNOWN */         NULL,
+    /* MSG_RESERVED */        NULL,
+    /* MSG_ERROR */           NULL,
+    /* MSG_NONE */            NULL,
+    /* MSG_SOFTWARE */        _binHandler,
+    /* MSG_NISYNC */          _binHandler,
+    /* MSG_OSW */             _binHandler,
+    /* MSG_DATA_ACCESS_WP */  _binHandler,
+    /* MSG_DATA_RWWP */       _binHandler,
+    /* MSG_PC_SAMPLE */       _binHandler,
+    /* MSG_DWT_EVENT */       _binHandler,
+    /* MSG_EXCEPTION */       _binHandler,
+    /* MSG_TS */              _binHandler
+};
+// ====================================================================================================
+/* Handlers for each complete message received */
+static const msgHandler h[MSG_NUM_MSGS] =
+{
+    /* MSG_UNKNOWN */         NULL,
+    /* MSG_RESERVED */        NULL,
+    /* MSG_ERROR */           NULL,
+    /* MSG_NONE */            NULL,
+    /* MSG_SOFTWARE */        ( msgHandler )_handleSW,
+    /* MSG_NISYNC */          ( msgHandler )_handleNISYNC,
+    /* MSG_OSW */             ( msgHandler )_handleDataOffsetWP,
+    /* MSG_DATA_ACCESS_WP */  ( msgHandler )_handleDataAccessWP,
+    /* MSG_DATA_RWWP */       ( msgHandler )_handleDataRWWP,
+    /* MSG_PC_SAMPLE */       NULL,
+    /* MSG_DWT_EVENT */       ( msgHandler )_handleDWTEvent,
+    /* MSG_EXCEPTION */       ( msgHandler )_handleException,
+    /* MSG_TS */              ( msgHandler )_handleTS
+};
+// ====================================================================================================
+static void _itmPumpBuffer( const uint8_t *d, int len )
+
+{
     /* For any mode except the ones where we collect timestamps from the target we need to send */
     /* the samples out directly to give the host a chance of having accurate timing info. For   */
     /* target-based timestamps we need to re-sequence the messages so that the timestamps are   */
@@ -505,37 +1278,32 @@ static void _itmPumpProcess( char c )
 
     if ( ( options.tsType != TSStamp ) && ( options.tsType != TSStampDelta ) )
     {
-        if ( ITM_EV_PACKET_RXED == ITMPump( &_r.i, c ) )
-        {
-            if ( ITMGetDecodedPacket( &_r.i, &p )  )
-            {
-                assert( p.genericMsg.msgtype < MSG_NUM_MSGS );
-
-                if ( h[p.genericMsg.msgtype] )
-                {
-                    ( h[p.genericMsg.msgtype] )( &p, &_r.i );
-                }
-            }
-        }
+        /* Decode the whole block in one pass, then despatch it as a batch so runs of
+         * same-type messages go through their handler back to back.
+         */
+        msgDecoderBatch( &_r.i, d, len, &_r.batch, NULL, NULL );
+        msgBatchDispatch( &_r.batch, options.binary ? hBin : h, &_r.i );
     }
     else
     {
+        /* Pump the whole buffer through the sequencer, then run the time-ordered result
+         * in one tight consumer loop.
+         */
+        uint32_t n = MSGSeqPumpBuffer( &_r.d, d, len );
+        struct msg *pp = MSGSeqStaged( &_r.d );
 
-        /* Pump messages into the store until we get a time message, then we can read them out */
-        if ( !MSGSeqPump( &_r.d, c ) )
-        {
-            return;
-        }
+        const msgHandler *tab = options.binary ? hBin : h;
 
-        /* We are synced timewise, so empty anything that has been waiting */
-        while ( ( pp = MSGSeqGetPacket( &_r.d ) ) )
+        while ( n-- )
         {
             assert( pp->genericMsg.msgtype < MSG_NUM_MSGS );
 
-            if ( h[pp->genericMsg.msgtype] )
+            if ( tab[pp->genericMsg.msgtype] )
             {
-                ( h[pp->genericMsg.msgtype] )( pp, &_r.i );
+                ( tab[pp->genericMsg.msgtype] )( pp, &_r.i );
             }
+
+            pp++;
         }
     }
 }
@@ -551,14 +1319,20 @@ static void _printHelp( const char *const progName )
 
 {
     genericsFPrintf( stderr, "Usage: %s [options]" EOL, progName );
+    genericsFPrintf( stderr, "    -b, --binary:       Output a length-prefixed binary event stream instead of text" EOL );
     genericsFPrintf( stderr, "    -c, --channel:      <Number>,<Format> of channel to add into output stream (repeat per channel)" EOL );
     genericsFPrintf( stderr, "    -C, --cpufreq:      <Frequency in KHz> (Scaled) speed of the CPU" EOL
                      "                        generally /1, /4, /16 or /64 of the real CPU speed," EOL );
+    genericsFPrintf( stderr, "    -d, --dedup:        Fold repeated output lines into \"last message repeated N times\"" EOL
+                     "                        records (output is withheld until each line completes)" EOL );
+    genericsFPrintf( stderr, "    -e, --elf-file:     <filename> Use this elf file to name data objects hit by watchpoints" EOL );
     genericsFPrintf( stderr, "    -E, --eof:          Terminate when the file/socket ends/is closed, or wait for more/reconnect" EOL );
     genericsFPrintf( stderr, "    -f, --input-file:   <filename> Take input from specified file" EOL );
     genericsFPrintf( stderr, "    -g, --trigger:      <char> to use to trigger timestamp (default is newline)" EOL );
     genericsFPrintf( stderr, "    -h, --help:         This help" EOL );
     genericsFPrintf( stderr, "    -n, --itm-sync:     Enforce sync requirement for ITM (i.e. ITM needs to issue syncs)" EOL );
+    genericsFPrintf( stderr, "    -m, --mux:          <Channel>,<Base> Demultiplex virtual channels muxed on <Channel> so they" EOL
+                     "                        appear as ordinary channels starting at <Base>" EOL );
     genericsFPrintf( stderr, "    -p, --protocol:     Protocol to communicate. Defaults to OFLOW if -s is not set, otherwise ITM" EOL );
     genericsFPrintf( stderr, "    -s, --server:       <Server>:<Port> to use" EOL );
     genericsFPrintf( stderr, "    -t, --tag:          <stream>: Which orbflow tag to use (normally 1)" EOL );
@@ -578,13 +1352,17 @@ static void _printVersion( void )
 // ====================================================================================================
 static struct option _longOptions[] =
 {
+    {"binary", no_argument, NULL, 'b'},
     {"channel", required_argument, NULL, 'c'},
     {"cpufreq", required_argument, NULL, 'C'},
+    {"dedup", no_argument, NULL, 'd'},
+    {"elf-file", required_argument, NULL, 'e'},
     {"eof", no_argument, NULL, 'E'},
     {"input-file", required_argument, NULL, 'f'},
     {"help", no_argument, NULL, 'h'},
     {"trigger", required_argument, NULL, 'g' },
     {"itm-sync", no_argument, NULL, 'n'},
+    {"mux", required_argument, NULL, 'm'},
     {"no-colour", no_argument, NULL, 'M'},
     {"no-color", no_argument, NULL, 'M'},
     {"protocol", required_argument, NULL, 'p'},
@@ -609,10 +1387,16 @@ bool _processOptions( int argc, char *argv[] )
 
 #define DELIMITER ','
 
-    while ( ( c = getopt_long ( argc, argv, "c:C:Ef:g:hVnMp:s:t:T:v:x", _longOptions, &optionIndex ) ) != -1 )
+    while ( ( c = getopt_long ( argc, argv, "bc:C:de:Ef:g:hVm:nMp:s:t:T:v:x", _longOptions, &optionIndex ) ) != -1 )
         switch ( c )
         {
             // ------------------------------------
+            case 'b':
+                options.binary = true;
+                break;
+
+            // ------------------------------------
+
             case 'C':
                 options.cps = atoi( optarg ) * 1000;
 
@@ -624,6 +1408,11 @@ bool _processOptions( int argc, char *argv[] )
 
                 break;
 
+            // ------------------------------------
+            case 'd':
+                options.dedup = true;
+                break;
+
             // ------------------------------------
             case 'h':
                 _printHelp( argv[0] );
@@ -634,6 +1423,11 @@ bool _processOptions( int argc, char *argv[] )
                 _printVersion();
                 return false;
 
+            // ------------------------------------
+            case 'e':
+                options.elffile = optarg;
+                break;
+
             // ------------------------------------
             case 'E':
                 options.endTerminate = true;
@@ -649,6 +1443,21 @@ bool _processOptions( int argc, char *argv[] )
                 options.tsTrigger = genericsUnescape( optarg )[0];
                 break;
 
+            // ------------------------------------
+            case 'm':
+            {
+                unsigned int base = 0;
+
+                if ( 2 != sscanf( optarg, "%d,%u", &options.muxChannel, &base ) )
+                {
+                    genericsReport( V_ERROR, "Mux specification must be <Channel>,<Base>" EOL );
+                    return false;
+                }
+
+                options.muxBase = base;
+                break;
+            }
+
             // ------------------------------------
             case 'n':
                 options.forceITMSync = false;
@@ -854,6 +1663,12 @@ bool _processOptions( int argc, char *argv[] )
     genericsReport( V_INFO, "ForceSync  : %s" EOL, options.forceITMSync ? "true" : "false" );
     genericsReport( V_INFO, "Timestamp  : %s" EOL, tsTypeString[options.tsType] );
     genericsReport( V_INFO, "Exceptions : %s" EOL, options.ex ? "On" : "Off" );
+    genericsReport( V_INFO, "Dedup      : %s" EOL, options.dedup ? "On" : "Off" );
+
+    if ( options.muxChannel >= 0 )
+    {
+        genericsReport( V_INFO, "Mux        : channel %d, virtual channels from %u" EOL, options.muxChannel, options.muxBase );
+    }
 
     if ( options.cps )
     {
@@ -934,10 +1749,7 @@ static void _OFLOWpacketRxed ( struct OFLOWFrame *p, void *param )
     {
         if ( p->tag == options.tag )
         {
-            for ( int i = 0; i < p->len; i++ )
-            {
-                _itmPumpProcess( p->d[i] );
-            }
+            _itmPumpBuffer( p->d, p->len );
         }
     }
 }
@@ -961,7 +1773,7 @@ static void _feedStream( struct Stream *stream )
         {
             if ( result == RECEIVE_RESULT_EOF && options.endTerminate )
             {
-                return;
+                break;
             }
             else if ( result == RECEIVE_RESULT_ERROR )
             {
@@ -979,25 +1791,40 @@ static void _feedStream( struct Stream *stream )
             else
             {
                 /* ITM goes directly through the protocol pump */
-                unsigned char *c = cbw;
-
-                while ( receivedSize-- )
-                {
-                    _itmPumpProcess( *c++ );
-                }
+                _itmPumpBuffer( cbw, receivedSize );
             }
 
             /* Check if an exception report timed out */
             if ( ( _r.inLine ) && _r.dwtText[0] && ( _timestamp() - _r.dwtte > DWT_TO_US ) )
             {
+                _stageFlush();
                 genericsFPrintf( stderr, EOL "%s", _r.dwtText );
                 _r.dwtText[0] = 0;
                 _r.inLine = false;
             }
 
+            /* A fold record from a repeat storm shouldn't wait forever for the next line */
+            if ( ( options.dedup ) && ( _r.dedupRepeats ) && ( _timestamp() - _r.dedupLastReport > DEDUP_REPORT_INTERVAL ) )
+            {
+                _dedupFlushRepeats();
+            }
+
+            /* Everything this read produced goes out in one block */
+            _stageFlush();
+            _binFlush();
             fflush( stdout );
         }
     }
+
+    /* Nothing stays behind when the stream goes away */
+    if ( options.dedup )
+    {
+        _dedupFlushRepeats();
+    }
+
+    _stageFlush();
+    _binFlush();
+    fflush( stdout );
 }
 
 // ====================================================================================================
@@ -1011,6 +1838,8 @@ static void _intHandler( int sig )
 int main( int argc, char *argv[] )
 
 {
+    selfprofInit( "orbcat" );
+
     bool alreadyReported = false;
 
     if ( !_processOptions( argc, argv ) )
@@ -1020,9 +1849,29 @@ int main( int argc, char *argv[] )
 
     genericsScreenHandling( !options.mono );
 
+    /* Channel formats are fixed from here on, so they can be compiled */
+    _compileFormats();
+
+    if ( options.elffile )
+    {
+        _r.s = symbolAcquire( options.elffile, false, false );
+
+        if ( !_r.s )
+        {
+            genericsReport( V_WARN, "Elf file or symbols in it not found, watchpoint addresses will not be named" EOL );
+        }
+    }
+
     /* Reset the handlers before we start */
     ITMDecoderInit( &_r.i, options.forceITMSync );
+
+    if ( options.muxChannel >= 0 )
+    {
+        ITMSetMuxChannel( &_r.i, options.muxChannel, options.muxBase );
+    }
     OFLOWInit( &_r.c );
+    OFLOWTimelineInit( &_r.timeline );
+    TSClockInit( &_r.tsClock, options.cps );
     MSGSeqInit( &_r.d, &_r.i, MSG_REORDER_BUFLEN );
 
     /* This ensures the signal handler gets called */
@@ -1079,6 +1928,11 @@ int main( int argc, char *argv[] )
         }
     }
 
+    if ( _r.s )
+    {
+        symbolDelete( _r.s );
+    }
+
     return 0;
 }
 // ====================================================================================================
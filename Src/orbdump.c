@@ -9,12 +9,13 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <getopt.h>
 #include <signal.h>
 
 #include "generics.h"
-#include "uthash.h"
 #include "git_version_info.h"
+#include "selfprof.h"
 #include "generics.h"
 #include "oflow.h"
 #include "itmDecoder.h"
@@ -342,9 +343,14 @@ static void _intHandler( int sig )
 // ====================================================================================================
 int main( int argc, char *argv[] )
 {
+    selfprofInit( "orbdump" );
+
     uint8_t cbw[TRANSFER_SIZE];
     uint64_t firstTime = 0;
     size_t octetsRxed = 0;
+    uint64_t lastReport = 0;
+    size_t lastOctets = 0;
+    bool progressShown = false;
     FILE *opFile;
 
     ssize_t t;
@@ -473,6 +479,36 @@ int main( int argc, char *argv[] )
 
         octetsRxed += fwrite( cbw, 1, receivedSize, opFile );
 
+        /* Give an interactive user a live rate line, and push what we have down to disk,
+         * so long captures land incrementally rather than sitting in the stdio buffer */
+        uint64_t now = _timestamp();
+
+        if ( now - lastReport >= 1000 )
+        {
+            if ( ( lastReport ) && ( isatty( STDERR_FILENO ) ) )
+            {
+                double rate = ( double )( octetsRxed - lastOctets ) / ( double )( now - lastReport );
+
+                if ( options.timelen )
+                {
+                    uint64_t end = firstTime + options.timelen;
+                    genericsFPrintf( stderr, "%zu bytes, %.1f KiB/s, %us remaining   \r",
+                                     octetsRxed, rate * 1000.0 / 1024.0,
+                                     ( unsigned int )( ( end > now ) ? ( end - now ) / 1000 : 0 ) );
+                }
+                else
+                {
+                    genericsFPrintf( stderr, "%zu bytes, %.1f KiB/s   \r", octetsRxed, rate * 1000.0 / 1024.0 );
+                }
+
+                progressShown = true;
+            }
+
+            lastReport = now;
+            lastOctets = octetsRxed;
+            fflush( opFile );
+        }
+
         if ( !ITMDecoderIsSynced( &_r.i ) )
         {
             genericsReport( V_WARN, "Warning:Sync lost while writing output" EOL );
@@ -488,6 +524,11 @@ int main( int argc, char *argv[] )
         }
     }
 
+    if ( progressShown )
+    {
+        genericsFPrintf( stderr, EOL );
+    }
+
     stream->close( stream );
     free( stream );
     fclose( opFile );
@@ -14,14 +14,19 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 #include <SDL.h>
 #include <SDL_thread.h>
 #include <signal.h>
 
 #include "git_version_info.h"
+#include "selfprof.h"
 #include "generics.h"
 #include "itmDecoder.h"
 #include "msgDecoder.h"
@@ -51,10 +56,25 @@ struct TApp
     SDL_Renderer *renderer;                               /* Renderer onto output window */
 
     SDL_Texture  *texture;                                /* Texture used for construction of image */
-    uint8_t       *pixels;                                /* Pixel buffer in texture */
+    uint8_t       *pixels;                                /* Pixel buffer being drawn into */
+    uint8_t       *shadow;                                /* Pixels as last uploaded to the texture */
     uint32_t      map8to24bit[256];                       /* Colour index table for 8 to 24 bit mapping */
     int pwidth;                                           /* Width of one line of pixel buffer */
 
+    int dirtyX0;                                          /* Bounding box of writes since last upload... */
+    int dirtyY0;
+    int dirtyX1;                                          /* ...inclusive; empty when dirtyY1 < dirtyY0 */
+    int dirtyY1;
+
+    uint32_t lastPixel;                                   /* Most recent pixel value, for RLE expansion */
+
+    /* Shared memory frame export */
+    char *shmName;                                        /* Segment name, NULL for no export */
+    struct orblcdShmHeader *shmHdr;                       /* Mapped segment, NULL until a mode arrives */
+    uint8_t *shmPixels;                                   /* Pixel area of the mapped segment */
+    size_t shmSize;                                       /* Current size of the mapping */
+    int shmFd;                                            /* Backing descriptor */
+
 } _app =
 {
     .chan        = LCD_DATA_CHANNEL,
@@ -109,6 +129,187 @@ struct RunTime
 // Target application specifics
 // ====================================================================================================
 
+static void _dirtyReset( struct TApp *a )
+
+/* Mark the frame as clean */
+
+{
+    a->dirtyX0 = a->dirtyY0 = INT_MAX;
+    a->dirtyX1 = a->dirtyY1 = INT_MIN;
+}
+
+/*************************************/
+
+static void _dirtyAll( struct TApp *a )
+
+/* Mark the whole frame as needing upload */
+
+{
+    a->dirtyX0 = a->dirtyY0 = 0;
+    a->dirtyX1 = ORBLCD_DECODE_X( a->modeDescriptor ) - 1;
+    a->dirtyY1 = ORBLCD_DECODE_Y( a->modeDescriptor ) - 1;
+}
+
+/*************************************/
+
+static void _shmSetMode( struct TApp *a )
+
+/* Create or resize the exported segment for the current mode. The seqlock stays odd for the
+ * whole transition so a sampler never trusts a half-reshaped frame.
+ */
+
+{
+    size_t need = sizeof( struct orblcdShmHeader ) + ORBLCD_DECODE_Y( a->modeDescriptor ) * a->pwidth;
+
+    if ( !a->shmHdr )
+    {
+        a->shmFd = shm_open( a->shmName, O_CREAT | O_RDWR, 0644 );
+
+        if ( a->shmFd < 0 )
+        {
+            genericsReport( V_ERROR, "Couldn't open shm segment %s" EOL, a->shmName );
+            a->shmName = NULL;
+            return;
+        }
+    }
+    else
+    {
+        /* Mark in-flux before the old mapping goes away */
+        atomic_fetch_add( ( _Atomic uint32_t * )&a->shmHdr->seq, 1 );
+        munmap( a->shmHdr, a->shmSize );
+        a->shmHdr = NULL;
+    }
+
+    if ( ( ftruncate( a->shmFd, need ) < 0 ) ||
+            ( MAP_FAILED == ( a->shmHdr = ( struct orblcdShmHeader * )mmap( NULL, need, PROT_READ | PROT_WRITE, MAP_SHARED, a->shmFd, 0 ) ) ) )
+    {
+        genericsReport( V_ERROR, "Couldn't size shm segment %s" EOL, a->shmName );
+        a->shmHdr = NULL;
+        close( a->shmFd );
+        a->shmName = NULL;
+        return;
+    }
+
+    a->shmSize = need;
+    a->shmPixels = ( uint8_t * )( a->shmHdr + 1 );
+
+    a->shmHdr->seq |= 1;                                  /* In flux until the first commit */
+    atomic_thread_fence( memory_order_release );
+    a->shmHdr->magic = ORBLCD_SHM_MAGIC;
+    a->shmHdr->version = ORBLCD_SHM_VERSION;
+    a->shmHdr->modeDescriptor = a->modeDescriptor;
+    a->shmHdr->bytesPerRow = a->pwidth;
+}
+
+/*************************************/
+
+static void _shmCommit( struct TApp *a )
+
+/* Publish the just-completed frame; bracket the copy with the seqlock so samplers retry
+ * rather than ever seeing a torn frame.
+ */
+
+{
+    _Atomic uint32_t *seq = ( _Atomic uint32_t * )&a->shmHdr->seq;
+    uint32_t s = atomic_load( seq ) | 1;
+
+    atomic_store( seq, s );                               /* Odd: in flux */
+    atomic_thread_fence( memory_order_release );
+
+    memcpy( a->shmPixels, a->pixels, ORBLCD_DECODE_Y( a->modeDescriptor ) * a->pwidth );
+    a->shmHdr->frames++;
+
+    atomic_thread_fence( memory_order_release );
+    atomic_store( seq, s + 1 );                           /* Even: stable */
+}
+
+/*************************************/
+
+static void _presentFrame( struct RunTime *r )
+
+/* Upload only the regions which really changed, then flip. The write-tracking bounding box
+ * is diffed row by row against the shadow copy, so repeated writes of identical data (a
+ * target redrawing a mostly static screen) collapse to small or empty texture uploads.
+ */
+
+{
+    struct TApp *a = r->app;
+    int w = ORBLCD_DECODE_X( a->modeDescriptor );
+
+    if ( a->shmHdr )
+    {
+        _shmCommit( a );
+    }
+
+    if ( ( a->dirtyY1 >= a->dirtyY0 ) && ( a->shadow ) )
+    {
+        int bx0 = ( a->dirtyX0 > 0 ) ? a->dirtyX0 : 0;
+        int bx1 = ( a->dirtyX1 < w - 1 ) ? a->dirtyX1 : w - 1;
+        int y = a->dirtyY0;
+
+        while ( y <= a->dirtyY1 )
+        {
+            uint32_t *pRow = ( uint32_t * )&a->pixels[y * a->pwidth];
+            uint32_t *sRow = ( uint32_t * )&a->shadow[y * a->pwidth];
+
+            /* Skip rows which turn out to be unchanged */
+            if ( !memcmp( &pRow[bx0], &sRow[bx0], ( bx1 - bx0 + 1 ) * sizeof( uint32_t ) ) )
+            {
+                y++;
+                continue;
+            }
+
+            /* Collect the band of consecutive changed rows, tightening the columns */
+            int bandY = y;
+            int minC = bx1;
+            int maxC = bx0;
+
+            while ( y <= a->dirtyY1 )
+            {
+                pRow = ( uint32_t * )&a->pixels[y * a->pwidth];
+                sRow = ( uint32_t * )&a->shadow[y * a->pwidth];
+                int c0 = bx0;
+                int c1 = bx1;
+
+                while ( ( c0 <= c1 ) && ( pRow[c0] == sRow[c0] ) )
+                {
+                    c0++;
+                }
+
+                if ( c0 > c1 )
+                {
+                    /* Clean row terminates the band */
+                    break;
+                }
+
+                while ( pRow[c1] == sRow[c1] )
+                {
+                    c1--;
+                }
+
+                minC = ( c0 < minC ) ? c0 : minC;
+                maxC = ( c1 > maxC ) ? c1 : maxC;
+                y++;
+            }
+
+            SDL_Rect rect = { .x = minC, .y = bandY, .w = maxC - minC + 1, .h = y - bandY };
+            SDL_UpdateTexture( a->texture, &rect, &a->pixels[minC * 4 + bandY * a->pwidth], a->pwidth );
+
+            /* Bring the shadow into line with what the texture now holds */
+            for ( int sy = bandY; sy < bandY + rect.h; sy++ )
+            {
+                memcpy( &a->shadow[minC * 4 + sy * a->pwidth], &a->pixels[minC * 4 + sy * a->pwidth], rect.w * sizeof( uint32_t ) );
+            }
+        }
+    }
+
+    SDL_RenderCopy( a->renderer, a->texture, NULL, NULL );
+    SDL_RenderPresent( a->renderer );
+    _dirtyReset( a );
+}
+
+/*************************************/
+
 static void _paintPixels( struct swMsg *m, struct RunTime *r )
 
 {
@@ -164,7 +365,14 @@ static void _paintPixels( struct swMsg *m, struct RunTime *r )
         }
 
         /* Output bitdepth is always the same, so span calculation is too */
-        *( uint32_t * )&r->app->pixels[r->app->x * 4 + r->app->y * r->app->pwidth] = y | 0xff000000;
+        r->app->lastPixel = y | 0xff000000;
+        *( uint32_t * )&r->app->pixels[r->app->x * 4 + r->app->y * r->app->pwidth] = r->app->lastPixel;
+
+        /* Fold this write into the dirty bounding box */
+        r->app->dirtyX0 = ( r->app->x < r->app->dirtyX0 ) ? r->app->x : r->app->dirtyX0;
+        r->app->dirtyX1 = ( r->app->x > r->app->dirtyX1 ) ? r->app->x : r->app->dirtyX1;
+        r->app->dirtyY0 = ( r->app->y < r->app->dirtyY0 ) ? r->app->y : r->app->dirtyY0;
+        r->app->dirtyY1 = ( r->app->y > r->app->dirtyY1 ) ? r->app->y : r->app->dirtyY1;
 
         if ( ++r->app->x >= ORBLCD_DECODE_X( r->app->modeDescriptor ) )
         {
@@ -183,6 +391,55 @@ static void _paintPixels( struct swMsg *m, struct RunTime *r )
 
 /*************************************/
 
+static void _expandRun( struct RunTime *r, uint32_t n )
+
+/* Repeat the most recent pixel n further times, row span at a time */
+
+{
+    struct TApp *a = r->app;
+    int w = ORBLCD_DECODE_X( a->modeDescriptor );
+    int h = ORBLCD_DECODE_Y( a->modeDescriptor );
+
+    if ( !a->pixels )
+    {
+        return;
+    }
+
+    while ( n )
+    {
+        uint32_t span = w - a->x;
+        span = ( span > n ) ? n : span;
+
+        uint32_t *p = ( uint32_t * )&a->pixels[a->x * 4 + a->y * a->pwidth];
+
+        for ( uint32_t i = 0; i < span; i++ )
+        {
+            p[i] = a->lastPixel;
+        }
+
+        /* One dirty update covers the whole span */
+        a->dirtyX0 = ( a->x < a->dirtyX0 ) ? a->x : a->dirtyX0;
+        a->dirtyX1 = ( a->x + ( int )span - 1 > a->dirtyX1 ) ? a->x + ( int )span - 1 : a->dirtyX1;
+        a->dirtyY0 = ( a->y < a->dirtyY0 ) ? a->y : a->dirtyY0;
+        a->dirtyY1 = ( a->y > a->dirtyY1 ) ? a->y : a->dirtyY1;
+
+        a->x += span;
+        n -= span;
+
+        if ( a->x >= w )
+        {
+            a->x = 0;
+
+            if ( ++a->y >= h )
+            {
+                a->y = 0;
+            }
+        }
+    }
+}
+
+/*************************************/
+
 static void _handleCommand( struct swMsg *m, struct RunTime *r )
 
 {
@@ -214,6 +471,11 @@ static void _handleCommand( struct swMsg *m, struct RunTime *r )
                     free( r->app->pixels );
                 }
 
+                if ( r->app->shadow )
+                {
+                    free( r->app->shadow );
+                }
+
                 r->app->mainWindow    = SDL_CreateWindow( r->app->windowTitle,
                                         SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
                                         ORBLCD_DECODE_X( r->app->modeDescriptor ) * r->app->scale, ORBLCD_DECODE_Y( r->app->modeDescriptor ) * r->app->scale, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE );
@@ -222,16 +484,25 @@ static void _handleCommand( struct swMsg *m, struct RunTime *r )
                 SDL_RenderSetLogicalSize( r->app->renderer, ORBLCD_DECODE_X( r->app->modeDescriptor ), ORBLCD_DECODE_Y( r->app->modeDescriptor ) );
                 r->app->texture       = SDL_CreateTexture( r->app->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, ORBLCD_DECODE_X( r->app->modeDescriptor ), ORBLCD_DECODE_Y( r->app->modeDescriptor ) );
 
-                /* Create the memory for drawing the image */
+                /* Create the memory for drawing the image, double buffered so only genuine
+                 * changes get uploaded */
                 r->app->pwidth        = sizeof( uint32_t ) * ORBLCD_DECODE_X( r->app->modeDescriptor );
                 r->app->pixels        = ( uint8_t * )calloc( ORBLCD_DECODE_Y( r->app->modeDescriptor ) * r->app->pwidth, 1 );
+                r->app->shadow        = ( uint8_t * )calloc( ORBLCD_DECODE_Y( r->app->modeDescriptor ) * r->app->pwidth, 1 );
+
+                /* The fresh texture has undefined contents, so the first flip uploads it all */
+                SDL_UpdateTexture( r->app->texture, NULL, r->app->pixels, r->app->pwidth );
+                _dirtyReset( r->app );
+
+                if ( r->app->shmName )
+                {
+                    _shmSetMode( r->app );
+                }
             }
             else
             {
-                /* Repaint the SDL window */
-                SDL_UpdateTexture( r->app->texture, NULL, r->app->pixels, r->app->pwidth );
-                SDL_RenderCopy( r->app->renderer, r->app->texture, NULL, NULL );
-                SDL_RenderPresent( r->app->renderer );
+                /* Repaint the SDL window with whatever regions changed this frame */
+                _presentFrame( r );
             }
 
             r->app->x = r->app->y = 0;
@@ -241,6 +512,7 @@ static void _handleCommand( struct swMsg *m, struct RunTime *r )
             if ( r->app->pixels )
             {
                 memset( r->app->pixels, 0, ORBLCD_DECODE_Y( r->app->modeDescriptor ) * r->app->pwidth );
+                _dirtyAll( r->app );
             }
 
             break;
@@ -258,6 +530,10 @@ static void _handleCommand( struct swMsg *m, struct RunTime *r )
 
             break;
 
+        case ORBLCD_CMD_RLE_RUN: // -----------------------------------------------------------
+            _expandRun( r, ORBLCD_DECODE_RUN( m->value ) );
+            break;
+
         default:  // --------------------------------------------------------------------------------------------
             genericsReport( V_INFO, "Unknown LCD protocol message %d,length %d" EOL, ORBLCD_DECODE_C( m->value ), m->len );
             break;
@@ -324,7 +600,8 @@ void _itmPumpProcess( char c, struct RunTime *r )
 
             break;
 
-        default:
+        case ITM_EV_BULK_RXED:
+            /* No bulk channel consumer here; spans are simply discarded */
             break;
     }
 }
@@ -435,6 +712,7 @@ void _printHelp( const char *const progName )
     genericsFPrintf( stderr, "    -f, --input-file:   <filename> Take input from specified file" EOL );
     genericsFPrintf( stderr, "    -h, --help:         This help" EOL );
     genericsFPrintf( stderr, "    -n, --itm-sync:     Enforce sync requirement for ITM (i.e. ITM needs to issue syncs)" EOL );
+    genericsFPrintf( stderr, "    -m, --shm:          <name> Publish frames to POSIX shared memory segment <name>" EOL );
     genericsFPrintf( stderr, "    -p, --protocol:     Protocol to communicate. Defaults to OFLOW if -s is not set, otherwise ITM" EOL );
     genericsFPrintf( stderr, "    -s, --server:       <Server>:<Port> to use" EOL );
     genericsFPrintf( stderr, "    -S, --sbcolour:     <Colour> to be used for single bit renders, ignored for other bit depths" EOL );
@@ -459,6 +737,7 @@ static struct option _longOptions[] =
     {"help", no_argument, NULL, 'h'},
     {"input-file", required_argument, NULL, 'f'},
     {"itm-sync", no_argument, NULL, 'n'},
+    {"shm", required_argument, NULL, 'm'},
     {"protocol", required_argument, NULL, 'p'},
     {"server", required_argument, NULL, 's'},
     {"sbcolour", required_argument, NULL, 'S'},
@@ -479,7 +758,7 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
     bool serverExplicit = false;
     bool portExplicit = false;
 
-    while ( ( c = getopt_long ( argc, argv, "c:Ef:hnp:s:S:t:v:Vw:z:", _longOptions, &optionIndex ) ) != -1 )
+    while ( ( c = getopt_long ( argc, argv, "c:Ef:hm:np:s:S:t:v:Vw:z:", _longOptions, &optionIndex ) ) != -1 )
         switch ( c )
         {
             // ------------------------------------
@@ -503,6 +782,11 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
                 _printHelp( argv[0] );
                 return false;
 
+            // ------------------------------------
+            case 'm':
+                r->app->shmName = optarg;
+                break;
+
             // ------------------------------------
             case 'n':
                 r->options->forceITMSync = false;
@@ -696,6 +980,8 @@ static void _intHandler( int sig )
 int main( int argc, char *argv[] )
 
 {
+    selfprofInit( "orblcd" );
+
     bool alreadyReported = false;
 
     if ( !_processOptions( argc, argv, &_r ) )
@@ -775,6 +1061,13 @@ int main( int argc, char *argv[] )
         }
     }
 
+    if ( _r.app->shmHdr )
+    {
+        munmap( _r.app->shmHdr, _r.app->shmSize );
+        close( _r.app->shmFd );
+        shm_unlink( _r.app->shmName );
+    }
+
     SDL_Quit();
     return 0;
 }
@@ -18,14 +18,22 @@
 #include <signal.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#if !defined( WIN32 )
+    #include <sys/mman.h>
+#endif
 
 #include "git_version_info.h"
+#include "selfprof.h"
 #include "generics.h"
 #include "nw.h"
 #include "traceDecoder.h"
 #include "oflow.h"
 #include "loadelf.h"
+#include "icount.h"
 #include "sio.h"
+#include "strintern.h"
 #include "stream.h"
 
 #define REMOTE_SERVER       "localhost"
@@ -41,6 +49,21 @@ const char *protString[] = {"OFLOW", "ETM", NULL};
 #define INTERVAL_TIME_MS    (1000)      /* Intervaltime between acculumator resets */
 #define HANG_TIME_MS        (200)       /* Time without a packet after which we dump the buffer */
 #define TICK_TIME_MS        (100)       /* Time intervals for screen updates and keypress check */
+#define RAW_BLOCK_RING_LEN  (16)        /* Number of raw blocks between reader thread and decode */
+#define SYNC_INDEX_LEN      (256)       /* Number of capture sync points remembered for decode */
+
+#define DECODE_CHUNK_SIZE   (64*1024)   /* Capture bytes decoded per slice of incremental decode */
+
+#define OPTEXT_RESERVE_LINES (16*1024*1024) /* Address space reserved for the output line store */
+#define OPTEXT_COMMIT_LINES  (64*1024)  /* Lines committed to that reserve per growth step */
+#define DECODE_FIRST_LINES  (2000)      /* Lines materialized before the first screen update */
+#define DECODE_SLICE_LINES  (20000)     /* Lines materialized per pass round the main loop */
+
+#define SESSION_MAGIC       (0x4f4d5353) /* 'OMSS', identifying a session snapshot file */
+#define SESSION_VERSION     (2)          /* Layout version of the session snapshot */
+#define SESSION_HDR_LEN     (4096)       /* Bytes reserved for the header, so the capture window
+                                          * that follows it sits on a page boundary and can be
+                                          * mapped straight in on restore */
 
 /* Record for options, either defaults or from command line */
 struct Options
@@ -53,6 +76,8 @@ struct Options
 
     char *elffile;                      /* File to use for symbols etc. */
     char *odoptions;                    /* Options to pass directly to objdump */
+    char *captureFile;                  /* File backing the post-mortem buffer on disk */
+    char *sessionFile;                  /* Previously saved session snapshot to restore */
 
     int buflen;                         /* Length of post-mortem buffer, in bytes */
     int tag;                            /* which OFLOW stream are we decoding? */
@@ -82,6 +107,28 @@ struct dataBlock
     uint8_t buffer[TRANSFER_SIZE];
 };
 
+/* On-disk header of a session snapshot; the raw capture window follows at SESSION_HDR_LEN.
+ * The same layout doubles as the index sidecar written beside a capture file after its first
+ * replay, in which case the source identity fields tie it to the exact file content.
+ */
+struct sessionHeader
+{
+    uint32_t magic;                      /* SESSION_MAGIC */
+    uint32_t version;                    /* SESSION_VERSION */
+    uint32_t buflen;                     /* Length of the capture window that follows, in bytes */
+    uint32_t traceProt;                  /* Trace protocol the capture was made with */
+    int32_t  wp;                         /* Ring write pointer into the window */
+    int32_t  rp;                         /* Ring read pointer into the window */
+    int32_t  currentLine;                /* Browsing position when the snapshot was taken */
+    uint32_t syncIndexWp;                /* Next sync index slot to be (over)written */
+    uint32_t tag;                        /* OFLOW tag the capture window was filtered on */
+    uint32_t pad;                        /* Keep the 64-bit fields below naturally aligned */
+    uint64_t captureCount;               /* Total bytes ever captured into the ring */
+    uint64_t srcLen;                     /* Sidecar only: length of the source capture file */
+    uint64_t srcSum;                     /* Sidecar only: FNV-1a sum of its contents, else 0 */
+    uint64_t syncIndex[SYNC_INDEX_LEN];  /* Capture counts at which sync patterns started */
+};
+
 /* Materials required to be maintained across callbacks for output construction */
 struct opConstruct
 {
@@ -94,6 +141,24 @@ struct opConstruct
 /* Maximum depth of call stack, defined Section 5.3 or ARM IHI0064H.a ID120820 */
 #define MAX_CALL_STACK (15)
 
+/* Checkpoint of decode progress, allowing a re-decode to pick up partway through the buffer */
+struct decodeCheckpoint
+{
+    bool valid;                          /* Checkpoint contents can be used */
+    struct TRACEDecoderSnapshot *snap;   /* Decoder state as at the checkpoint */
+    uint64_t totalBytes;                 /* Total stream bytes seen when taken */
+    int wp;                              /* Ring write pointer when taken */
+    int rp;                              /* Ring read pointer when taken */
+    int32_t numLines;                    /* Output buffer length when taken */
+    struct opConstruct op;               /* Output construction state when taken */
+    symbolMemaddr callStack[MAX_CALL_STACK]; /* Call stack when taken */
+    unsigned int stackDepth;             /* ...and its depth */
+    bool stackDelPending;                /* Stack deletion possibility flag when taken */
+    bool traceRunning;                   /* Trace-active flag when taken */
+    uint32_t context;                    /* Executing context when taken */
+    struct ICount icount;                /* Instruction mix counters when taken */
+};
+
 struct RunTime
 {
     struct TRACEDecoder i;
@@ -109,10 +174,19 @@ struct RunTime
     uint64_t oldTotalHangBytes;         /* Number of bytes transferred in previous hang interval */
 
     uint8_t *pmBuffer;                  /* The post-mortem buffer */
+    size_t pmMapLen;                    /* Mapped length of the buffer, 0 if it was malloc'ed */
     int wp;                             /* Index pointers for ring buffer */
     int rp;
 
+    uint64_t captureCount;              /* Total number of bytes ever captured into the ring */
+    uint32_t zeroRun;                   /* Length of current run of zero bytes in the capture */
+    uint64_t syncIndex[SYNC_INDEX_LEN]; /* Capture counts at which sync patterns started */
+    uint32_t syncIndexWp;               /* Next sync index slot to be (over)written */
+
     struct sioline *opText;             /* Text of the output buffer */
+    int32_t opTextCap;                  /* Allocated capacity of the output buffer */
+    bool opTextMapped;                  /* The store is a virtual reserve, not a heap block */
+    struct strInternTable *lineText;    /* Interned text of the output lines */
     int32_t lineNum;                    /* Current line number in output buffer */
     int32_t numLines;                   /* Number of lines in the output buffer */
 
@@ -125,9 +199,22 @@ struct RunTime
 
     bool held;                          /* If we are actively collecting data */
 
+    int32_t sessionLine;                /* Browsing position recorded in a restored session */
+    bool sessionCursorPending;          /* That position still needs to be applied to the UI */
+
     struct SIOInstance *sio;            /* Our screen IO instance for managed I/O */
 
-    struct dataBlock rawBlock;          /* Datablock received from distribution */
+    struct Stream *stream;              /* Stream the reader thread is collecting from */
+    struct dataBlock rawBlockRing[RAW_BLOCK_RING_LEN]; /* Raw data ring between reader and decode */
+    atomic_uint_fast32_t rbWp;          /* Producer index into the raw block ring */
+    atomic_uint_fast32_t rbRp;          /* Consumer index into the raw block ring */
+    pthread_t readerThread;             /* Thread performing the blocking stream reads */
+    bool readerRunning;                 /* Set while the reader thread is alive */
+    volatile bool readerError;          /* Reader saw an unrecoverable receive error */
+    volatile bool readerEOF;            /* Reader reached the end of an input file */
+
+    pthread_t symbolThread;             /* Thread loading the symbol set in the background */
+    bool symbolsLoading;                /* Set until the symbol loader has been joined */
 
     struct opConstruct op;              /* The mechanical elements for creating the output buffer */
 
@@ -138,6 +225,16 @@ struct RunTime
     symbolMemaddr callStack[MAX_CALL_STACK]; /* Stack of calls */
     unsigned int stackDepth;            /* Maximum stack depth */
     bool stackDelPending;               /* Possibility to remove an entry from the stack, if address not given */
+
+    struct ICount icount;               /* Instruction mix over the decoded window (ICOUNT_STATS builds) */
+
+    struct decodeCheckpoint chk;        /* Decode checkpoint, for incremental re-decode */
+
+    struct
+    {
+        bool active;                    /* Decode of the capture window is still in progress */
+        int nextp;                      /* Next undecoded position in the post-mortem buffer */
+    } pend;                             /* Decode work outstanding beyond the materialized lines */
 } _r;
 
 /* For opening the editor (Shift-Right-Arrow) the following command lines work for a few editors;
@@ -170,6 +267,7 @@ static void _printHelp( const char *const progName )
     genericsFPrintf( stderr, "Usage: %s [options]" EOL, progName );
     genericsFPrintf( stderr, "    -A, --alt-addr-enc: Do not use alternate address encoding" EOL );
     genericsFPrintf( stderr, "    -b, --buffer-len:   <Length> Length of post-mortem buffer, in KBytes (Default %d KBytes)" EOL, DEFAULT_PM_BUFLEN_K );
+    genericsFPrintf( stderr, "    -c, --capture-file: <file> Back the post-mortem buffer with a file on disk (permits very large -b)" EOL );
     genericsFPrintf( stderr, "    -C, --editor-cmd:   <command> Command line for external editor (%%f = filename, %%l = line)" EOL );
     genericsFPrintf( stderr, "    -D, --no-demangle:  Switch off C++ symbol demangling" EOL );
     genericsFPrintf( stderr, "    -d, --del-prefix:   <String> Material to delete off the front of filenames" EOL );
@@ -189,6 +287,7 @@ static void _printHelp( const char *const progName )
 
     genericsFPrintf( stderr, "} trace protocol to use, default is %s" EOL, TRACEDecodeGetProtocolName( TRACE_PROT_LIST_START ) );
     genericsFPrintf( stderr, "    -s, --server:       <Server>:<Port> to use" EOL );
+    genericsFPrintf( stderr, "    -S, --session:      <file> Restore a browsing session saved from within the program" EOL );
     genericsFPrintf( stderr, "    -t, --tag:          <stream>: Which OFLOW tag to use (normally 2)" EOL );
     genericsFPrintf( stderr, "    -v, --verbose:      <level> Verbose mode 0(errors)..3(debug)" EOL );
     genericsFPrintf( stderr, "    -V, --version:      Print version and exit" EOL );
@@ -208,6 +307,7 @@ static struct option _longOptions[] =
 {
     {"alt-addr-enc", no_argument, NULL, 'A'},
     {"buffer-len", required_argument, NULL, 'b'},
+    {"capture-file", required_argument, NULL, 'c'},
     {"editor-cmd", required_argument, NULL, 'C'},
     {"no-demangle", required_argument, NULL, 'D'},
     {"del-prefix", required_argument, NULL, 'd'},
@@ -221,6 +321,7 @@ static struct option _longOptions[] =
     {"trace-proto", required_argument, NULL, 'P'},
     {"protocol", required_argument, NULL, 'p'},
     {"server", required_argument, NULL, 's'},
+    {"session", required_argument, NULL, 'S'},
     {"tag", required_argument, NULL, 't'},
     {"verbose", required_argument, NULL, 'v'},
     {"version", no_argument, NULL, 'V'},
@@ -234,7 +335,7 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
     bool protExplicit = false;
     bool serverExplicit = false;
 
-    while ( ( c = getopt_long ( argc, argv, "Ab:C:Dd:Ee:f:hVMO:p:P:s:t:v:w", _longOptions, &optionIndex ) ) != -1 )
+    while ( ( c = getopt_long ( argc, argv, "Ab:c:C:Dd:Ee:f:hVMO:p:P:s:S:t:v:w", _longOptions, &optionIndex ) ) != -1 )
         switch ( c )
         {
             // ------------------------------------
@@ -247,6 +348,11 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
                 r->options->buflen = atoi( optarg ) * 1024;
                 break;
 
+            // ------------------------------------
+            case 'c':
+                r->options->captureFile = optarg;
+                break;
+
             // ------------------------------------
             case 'C':
                 r->options->openFileCL = optarg;
@@ -364,6 +470,12 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
 
             // ------------------------------------
 
+            case 'S':
+                r->options->sessionFile = optarg;
+                break;
+
+            // ------------------------------------
+
             case 't':
                 r->options->tag = atoi( optarg );
                 break;
@@ -433,6 +545,21 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
 
     genericsReport( V_INFO, "Elf File         : %s" EOL, r->options->elffile );
 
+    if ( r->options->captureFile )
+    {
+        genericsReport( V_INFO, "Capture File     : %s" EOL, r->options->captureFile );
+    }
+
+    if ( r->options->sessionFile )
+    {
+        if ( ( r->options->file ) || ( r->options->captureFile ) )
+        {
+            genericsExit( V_ERROR, "Session restore cannot be combined with -f or -c" EOL );
+        }
+
+        genericsReport( V_INFO, "Session File     : %s" EOL, r->options->sessionFile );
+    }
+
     if ( r->options->traceProt >= TRACE_PROT_NONE )
     {
         genericsExit( V_ERROR, "Unrecognised decode protocol" EOL );
@@ -475,13 +602,43 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
     return true;
 }
 // ====================================================================================================
-static void _processBlock( struct RunTime *r )
+static void _captureNote( struct RunTime *r, uint8_t c )
+
+/* Watch the capture stream for alignment sync patterns and index where they start. The index
+ * lets a later decode drop straight onto a sync point rather than grinding through however
+ * much unsyncable lead-in precedes it in the buffer.
+ */
+
+{
+    r->captureCount++;
+
+    if ( !c )
+    {
+        r->zeroRun++;
+        return;
+    }
+
+    if ( 0x80 == c )
+    {
+        /* ASYNC is a run of zeroes terminated by 0x80; five zeroes for ETM3.5, eleven for ETM4 */
+        uint32_t need = ( TRACE_PROT_ETM4 == r->options->traceProt ) ? 11 : 5;
+
+        if ( ( r->zeroRun >= need ) && ( TRACE_PROT_MTB != r->options->traceProt ) )
+        {
+            r->syncIndex[( r->syncIndexWp++ ) % SYNC_INDEX_LEN] = r->captureCount - 1 - r->zeroRun;
+        }
+    }
+
+    r->zeroRun = 0;
+}
+// ====================================================================================================
+static void _processBlock( struct RunTime *r, struct dataBlock *b )
 
 /* Generic block processor for received data */
 
 {
-    uint8_t *c = r->rawBlock.buffer;
-    uint32_t y = r->rawBlock.fillLevel;
+    uint8_t *c = b->buffer;
+    uint32_t y = b->fillLevel;
 
     genericsReport( V_DEBUG, "RXED Packet of %d bytes" EOL, y );
 
@@ -500,14 +657,15 @@ static void _processBlock( struct RunTime *r )
             }
         }
 
-        c = r->rawBlock.buffer;
-        y = r->rawBlock.fillLevel;
+        c = b->buffer;
+        y = b->fillLevel;
 #endif
 
         r->newTotalBytes += y;
 
         while ( y-- )
         {
+            _captureNote( r, *c );
             r->pmBuffer[r->wp] = *c++;
             uint32_t nwp = ( r->wp + 1 ) % r->options->buflen;
 
@@ -535,6 +693,7 @@ static bool _rxAdd( struct RunTime *r, uint8_t c )
 {
     r->newTotalBytes ++;
 
+    _captureNote( r, c );
     r->pmBuffer[r->wp] = c;
     uint32_t nwp = ( r->wp + 1 ) % r->options->buflen;
 
@@ -581,6 +740,105 @@ static void _OFLOWpacketRxed ( struct OFLOWFrame *p, void *param )
     }
 }
 
+// ====================================================================================================
+static void *_streamReaderTask( void *arg )
+
+/* Dedicated reader thread...pulls blocks off the stream into the raw block ring so the decode
+ * and UI side never sits behind a blocking receive and capture keeps up while the user browses.
+ */
+
+{
+    struct RunTime *r = ( struct RunTime * )arg;
+    struct timeval tv;
+
+    while ( !r->ending )
+    {
+        /* Wait for a free slot...the consumer drains every tick, so this is momentary at worst */
+        while ( ( atomic_load( &r->rbWp ) - atomic_load( &r->rbRp ) ) >= RAW_BLOCK_RING_LEN )
+        {
+            if ( r->ending )
+            {
+                return NULL;
+            }
+
+            usleep( TICK_TIME_MS * 100 );
+        }
+
+        struct dataBlock *b = &r->rawBlockRing[atomic_load( &r->rbWp ) % RAW_BLOCK_RING_LEN];
+
+        tv.tv_sec = 0;
+        tv.tv_usec  = 10000;
+
+        enum ReceiveResult result = r->stream->receive( r->stream, b->buffer, TRANSFER_SIZE, &tv, ( size_t * )&b->fillLevel );
+
+        if ( result == RECEIVE_RESULT_ERROR )
+        {
+            r->readerError = true;
+            break;
+        }
+
+        if ( ( ( result == RECEIVE_RESULT_EOF ) || ( b->fillLevel <= 0 ) ) && r->options->file )
+        {
+            r->readerEOF = true;
+            break;
+        }
+
+        if ( b->fillLevel > 0 )
+        {
+            atomic_store( &r->rbWp, atomic_load( &r->rbWp ) + 1 );
+        }
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+static void _startReader( struct RunTime *r, struct Stream *stream )
+
+/* Fire up the reader to feed the raw block ring from this stream */
+
+{
+    r->stream = stream;
+    atomic_store( &r->rbWp, 0 );
+    atomic_store( &r->rbRp, 0 );
+    r->readerError = r->readerEOF = false;
+
+    if ( pthread_create( &r->readerThread, NULL, &_streamReaderTask, r ) )
+    {
+        genericsExit( -1, "Failed to create stream reader thread" EOL );
+    }
+
+    r->readerRunning = true;
+}
+// ====================================================================================================
+static void *_symbolLoaderTask( void *arg )
+
+/* Load the symbol set away from the main thread so capture can start without waiting on it */
+
+{
+    struct RunTime *r = ( struct RunTime * )arg;
+
+    r->s = symbolAcquire( r->options->elffile, true, true );
+    return NULL;
+}
+// ====================================================================================================
+static bool _awaitSymbols( struct RunTime *r )
+
+/* Collect the background symbol load, if there is one; false if no symbols came of it */
+
+{
+    if ( r->symbolsLoading )
+    {
+        pthread_join( r->symbolThread, NULL );
+        r->symbolsLoading = false;
+
+        if ( r->s )
+        {
+            genericsReport( V_DEBUG, "Loaded %s" EOL, r->options->elffile );
+        }
+    }
+
+    return ( NULL != r->s );
+}
 // ====================================================================================================
 static void _flushBuffer( struct RunTime *r )
 
@@ -590,18 +848,29 @@ static void _flushBuffer( struct RunTime *r )
     /* Tell the UI there's nothing more to show */
     SIOsetOutputBuffer( r->sio, 0, 0, NULL, false );
 
-    /* Remove all of the recorded lines */
-    while ( r->numLines-- )
+    /* All of the recorded line text lives in the intern table, so it goes in one action */
+    if ( r->lineText )
     {
-        if ( !r->opText[r->numLines].isRef )
-        {
-            free( r->opText[r->numLines].buffer );
-        }
+        strinternDelete( r->lineText );
+        r->lineText = NULL;
     }
 
     /* and the opText buffer */
-    free( r->opText );
+#if !defined( WIN32 )
+
+    if ( r->opTextMapped )
+    {
+        munmap( r->opText, OPTEXT_RESERVE_LINES * sizeof( struct sioline ) );
+        r->opTextMapped = false;
+    }
+    else
+#endif
+    {
+        free( r->opText );
+    }
+
     r->opText = NULL;
+    r->opTextCap = 0;
     r->numLines = 0;
 
     /* ...and the file/line references */
@@ -609,15 +878,67 @@ static void _flushBuffer( struct RunTime *r )
     r->op.currentFileindex = NO_FILE;
     r->op.currentFunctionptr = NULL;
     r->op.workingAddr = NO_DESTADDRESS;
+
+    /* Nothing in the output is left for a decode checkpoint to build on */
+    r->chk.valid = false;
+
+    /* The mix counters cover exactly the decoded output, so they restart with it */
+    ICountReset( &r->icount );
+
+    /* ...and any decode that was in progress over the old window is abandoned */
+    r->pend.active = false;
 }
 // ====================================================================================================
-// Strdup leak is deliberately ignored. That is the central purpose of this code. It's cleaned
-// upin __flushBuffer above.
-#pragma GCC diagnostic push
-#if !defined(__clang__)
-    #pragma GCC diagnostic ignored "-Wanalyzer-malloc-leak"
+static struct sioline *_opBufferSlot( struct RunTime *r )
+
+/* Return the next free line slot, growing the output buffer geometrically when needed */
+
+{
+    if ( r->numLines == r->opTextCap )
+    {
+#if !defined( WIN32 )
+
+        if ( !r->opText )
+        {
+            /* Reserve address space for the whole store up front; pages are only committed as
+             * lines arrive, so growth never moves or copies what is already recorded */
+            void *m = mmap( NULL, OPTEXT_RESERVE_LINES * sizeof( struct sioline ), PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+
+            if ( MAP_FAILED != m )
+            {
+                r->opText = ( struct sioline * )m;
+                r->opTextMapped = true;
+            }
+        }
+
+        if ( r->opTextMapped )
+        {
+            if ( r->opTextCap == OPTEXT_RESERVE_LINES )
+            {
+                genericsExit( -1, "Output buffer line limit reached" EOL );
+            }
+
+            if ( mprotect( &r->opText[r->opTextCap], OPTEXT_COMMIT_LINES * sizeof( struct sioline ),
+                           PROT_READ | PROT_WRITE ) )
+            {
+                genericsExit( -1, "Could not grow output buffer" EOL );
+            }
+
+            r->opTextCap += OPTEXT_COMMIT_LINES;
+        }
+        else
 #endif
+        {
+            r->opTextCap = r->opTextCap ? ( r->opTextCap * 2 ) : 1024;
+            r->opText = ( struct sioline * )realloc( r->opText, ( sizeof( struct sioline ) ) * r->opTextCap );
+            MEMCHECKV( r->opText );
+        }
+    }
 
+    return &r->opText[r->numLines];
+}
+// ====================================================================================================
 static void _appendToOPBuffer( struct RunTime *r, void *dat, int32_t lineno, enum LineType lt, const char *fmt, ... )
 
 /* Add line to output buffer, in a printf stylee */
@@ -626,6 +947,7 @@ static void _appendToOPBuffer( struct RunTime *r, void *dat, int32_t lineno, enu
     char construct[SCRATCH_STRING_LEN];
     va_list va;
     char *p;
+    const char *stored;
 
     va_start( va, fmt );
     vsnprintf( construct, SCRATCH_STRING_LEN, fmt, va );
@@ -636,30 +958,37 @@ static void _appendToOPBuffer( struct RunTime *r, void *dat, int32_t lineno, enu
 
     *p = 0;
 
-    r->opText = ( struct sioline * )realloc( r->opText, ( sizeof( struct sioline ) ) * ( r->numLines + 1 ) );
-    r->opText[r->numLines].buffer = strdup( construct );
-    r->opText[r->numLines].lt     = lt;
-    r->opText[r->numLines].line   = lineno;
-    r->opText[r->numLines].isRef  = false;
-    r->opText[r->numLines].dat    = dat;
+    if ( !r->lineText )
+    {
+        r->lineText = strinternCreate();
+    }
+
+    /* Repeated lines (file::function headers, revisited source) are stored exactly once; the
+     * interned copy stays put until _flushBuffer, so the slot just references it. */
+    strinternIndex( r->lineText, construct, &stored );
+
+    struct sioline *l = _opBufferSlot( r );
+    l->buffer = ( char * )stored;
+    l->lt     = lt;
+    l->line   = lineno;
+    l->isRef  = true;
+    l->dat    = dat;
     r->numLines++;
 }
-#pragma GCC diagnostic pop
-
 // ====================================================================================================
 static void _appendRefToOPBuffer( struct RunTime *r, void *dat, int32_t lineno, enum LineType lt, const char *ref )
 
 /* Add line to output buffer, as a reference (which don't be free'd later) */
 
 {
-    r->opText = ( struct sioline * )realloc( r->opText, ( sizeof( struct sioline ) ) * ( r->numLines + 1 ) );
+    struct sioline *l = _opBufferSlot( r );
 
     /* This line removes the 'const', but we know to not mess with this line */
-    r->opText[r->numLines].buffer = ( char * )ref;
-    r->opText[r->numLines].lt     = lt;
-    r->opText[r->numLines].line   = lineno;
-    r->opText[r->numLines].isRef  = true;
-    r->opText[r->numLines].dat    = dat;
+    l->buffer = ( char * )ref;
+    l->lt     = lt;
+    l->line   = lineno;
+    l->isRef  = true;
+    l->dat    = dat;
     r->numLines++;
 }
 // ====================================================================================================
@@ -692,6 +1021,9 @@ static void _addRetToStack( struct RunTime *r, symbolMemaddr p )
     r->callStack[r->stackDepth] = p;
     _traceReport( V_DEBUG, "Pushed %08x to return stack", r->callStack[r->stackDepth] );
 
+    /* This address will be looked up when the call returns; get its index entries moving now */
+    symbolPrefetch( r->s, p );
+
     if ( r->stackDepth < MAX_CALL_STACK - 1 )
     {
         /* We aren't at max depth, so go ahead and remove this entry */
@@ -881,6 +1213,9 @@ static void _traceCB( void *d )
         r->stackDelPending = false;
         /* Whatever the state was, this is an explicit setting of an address, so we need to respect it */
         r->op.workingAddr = cpu->addr;
+
+        /* The instruction walk below will resolve this address; overlap its index fetch with the remaining event handling */
+        symbolPrefetch( r->s, cpu->addr );
     }
     else
     {
@@ -963,6 +1298,14 @@ static void _traceCB( void *d )
 
         if ( a )
         {
+            /* An immediate branch target is known before its disposition is consumed; taken or
+             * not, start pulling its index entries in behind the output formatting below */
+            if ( ( ic & ( LE_IC_JUMP | LE_IC_CALL ) ) && ( ic & LE_IC_IMMEDIATE ) )
+            {
+                symbolPrefetch( r->s, newaddr );
+            }
+
+
             /* Calculate if this instruction was executed. This is slightly hairy depending on which protocol we're using;         */
             /*   * ETM3.5: Instructions are executed based on disposition bit (LSB in disposition word)                            */
             /*   * ETM4  : ETM4 everything up to a branch is executed...decision about that branch is based on disposition bit     */
@@ -979,6 +1322,7 @@ static void _traceCB( void *d )
                                              ( ( ( r->op.workingAddr != targetAddr ) && ( ! ( ic & LE_IC_JUMP ) ) )  ||
                                                ( r->op.workingAddr == targetAddr )
                                              ) ) );
+            ICountTally( &r->icount, ic, insExecuted );
             _appendToOPBuffer( r, l, r->op.currentLine, insExecuted ? LT_ASSEMBLY : LT_NASSEMBLY, a );
 
 
@@ -1057,13 +1401,169 @@ static void _traceCB( void *d )
     }
 }
 
+// ====================================================================================================
+static void _checkpointTake( struct RunTime *r )
+
+/* Record decode progress so a future re-decode can resume from here rather than starting over */
+
+{
+    r->chk.snap = TRACEDecoderSnapshotTake( &r->i, r->chk.snap );
+
+    if ( !r->chk.snap )
+    {
+        r->chk.valid = false;
+        return;
+    }
+
+    r->chk.totalBytes      = r->newTotalBytes;
+    r->chk.wp              = r->wp;
+    r->chk.rp              = r->rp;
+    r->chk.numLines        = r->numLines;
+    r->chk.op              = r->op;
+    memcpy( r->chk.callStack, r->callStack, sizeof( r->callStack ) );
+    r->chk.stackDepth      = r->stackDepth;
+    r->chk.stackDelPending = r->stackDelPending;
+    r->chk.traceRunning    = r->traceRunning;
+    r->chk.context         = r->context;
+    r->chk.icount          = r->icount;
+    r->chk.valid           = true;
+}
+// ====================================================================================================
+static bool _checkpointRestore( struct RunTime *r )
+
+/* Return decode state to the checkpoint, provided everything it covered is still in the buffer
+ * unchanged (i.e. data has only been appended since it was taken).
+ */
+
+{
+    if ( ( !r->chk.valid ) ||
+            ( r->rp != r->chk.rp ) ||
+            ( r->newTotalBytes - r->chk.totalBytes !=
+              ( uint64_t )( ( ( r->wp + r->options->buflen ) - r->chk.wp ) % r->options->buflen ) ) )
+    {
+        return false;
+    }
+
+    TRACEDecoderSnapshotRestore( &r->i, r->chk.snap );
+    r->op              = r->chk.op;
+    memcpy( r->callStack, r->chk.callStack, sizeof( r->callStack ) );
+    r->stackDepth      = r->chk.stackDepth;
+    r->stackDelPending = r->chk.stackDelPending;
+    r->traceRunning    = r->chk.traceRunning;
+    r->context         = r->chk.context;
+    r->icount          = r->chk.icount;
+
+    /* Drop any output lines rendered beyond the checkpoint...these will be regenerated. Their
+     * text stays interned and is simply re-referenced by the regeneration. */
+    r->numLines = r->chk.numLines;
+
+    /* ...and make sure the UI doesn't retain search index entries over them */
+    SIOtrimOutputBuffer( r->sio, r->numLines );
+
+    return true;
+}
+// ====================================================================================================
+static void _decodeMore( struct RunTime *r, int32_t targetLines )
+
+/* Run any pending decode forwards until at least targetLines lines exist (-1 = decode everything) */
+
+{
+    while ( ( r->pend.active ) && ( ( targetLines < 0 ) || ( r->numLines < targetLines ) ) )
+    {
+        int avail = ( ( r->wp + r->options->buflen ) - r->pend.nextp ) % r->options->buflen;
+
+        if ( !avail )
+        {
+            /* The whole window is now decoded...only here does a resume checkpoint make sense */
+            r->pend.active = false;
+            _checkpointTake( r );
+            ICountReport( &r->icount );
+            break;
+        }
+
+        int chunk = ( avail < DECODE_CHUNK_SIZE ) ? avail : DECODE_CHUNK_SIZE;
+
+        /* Don't run over the end of the ring...the wrapped part is the next slice */
+        if ( chunk > r->options->buflen - r->pend.nextp )
+        {
+            chunk = r->options->buflen - r->pend.nextp;
+        }
+
+        TRACEDecoderPump( &r->i, &r->pmBuffer[r->pend.nextp], chunk, _traceCB, r );
+        r->pend.nextp = ( r->pend.nextp + chunk ) % r->options->buflen;
+    }
+}
+// ====================================================================================================
+static int32_t _provideLines( void *context, int32_t upToLine )
+
+/* Callback from the UI when it needs output lines beyond those materialized so far */
+
+{
+    struct RunTime *r = ( struct RunTime * )context;
+
+    _decodeMore( r, ( upToLine < 0 ) ? -1 : upToLine + 1 );
+    return r->numLines;
+}
 // ====================================================================================================
 static bool _dumpBuffer( struct RunTime *r )
 
 /* Dump received data buffer into text buffer */
 
 {
-    _flushBuffer( r );
+    int fromp;
+
+    if ( _checkpointRestore( r ) )
+    {
+        /* Previous decode is still a valid prefix...only the delta needs to be processed */
+        fromp = r->chk.wp;
+    }
+    else
+    {
+        _flushBuffer( r );
+        fromp = r->rp;
+
+#if !defined( WIN32 )
+
+        /* A full sweep reads the whole window front to back, possibly several times as the UI
+         * pulls more lines; tell the VM so it prefetches ahead rather than on demand. */
+        if ( r->pmMapLen )
+        {
+            madvise( r->pmBuffer, r->pmMapLen, MADV_SEQUENTIAL );
+            madvise( r->pmBuffer, r->pmMapLen, MADV_WILLNEED );
+        }
+
+#endif
+
+        /* If the capture indexed any sync points still inside the window then skip straight
+         * to the first of them...the decoder can make nothing of what comes before it */
+        if ( ( !r->singleShot ) && ( TRACE_PROT_MTB != r->options->traceProt ) )
+        {
+            uint32_t avail = ( ( r->wp + r->options->buflen ) - r->rp ) % r->options->buflen;
+            uint64_t rpCount = r->captureCount - avail;
+            uint64_t best = UINT64_MAX;
+
+            for ( uint32_t i = 0; i < SYNC_INDEX_LEN; i++ )
+            {
+                uint64_t s = r->syncIndex[i];
+
+                if ( ( s >= rpCount ) && ( s < r->captureCount ) && ( s < best ) )
+                {
+                    best = s;
+                }
+            }
+
+            if ( UINT64_MAX != best )
+            {
+                fromp = ( r->rp + ( uint32_t )( best - rpCount ) ) % r->options->buflen;
+            }
+        }
+    }
+
+    if ( !_awaitSymbols( r ) )
+    {
+        genericsReport( V_ERROR, "Elf file or symbols in it not found" EOL );
+        return false;
+    }
 
     if ( !symbolSetValid( r->s ) )
     {
@@ -1087,11 +1587,11 @@ static bool _dumpBuffer( struct RunTime *r )
         TRACEDecoderForceSync( &r->i, false );
     }
 
-    /* Two calls in case buffer is wrapped - submit both parts */
-    TRACEDecoderPump( &r->i, &r->pmBuffer[r->rp], r->options->buflen - r->rp, _traceCB, r );
-
-    /* The length of this second buffer can be 0 for case buffer is not wrapped */
-    TRACEDecoderPump( &r->i, &r->pmBuffer[0], r->wp, _traceCB, r );
+    /* Materialize enough for the first paint...the remainder is decoded a slice at a time in
+     * the main loop, or synchronously when the UI asks for lines beyond those shown */
+    r->pend.active = true;
+    r->pend.nextp  = fromp;
+    _decodeMore( r, r->numLines + DECODE_FIRST_LINES );
 
     /* Submit this constructed buffer for display */
     SIOsetOutputBuffer( r->sio, r->numLines, r->numLines - 1, &r->opText, false );
@@ -1203,11 +1703,220 @@ static void _doFilesurface( struct RunTime *r )
     SIOsetCurrentLineno( r->sio, r->lineNum );
 }
 // ====================================================================================================
+static bool _sessionHeaderValid( int fd, const struct sessionHeader *hdr )
+
+/* Check that the ring geometry in a snapshot header is internally consistent and that the
+ * file really holds the capture window it announces, so a truncated or corrupt file cannot
+ * hand the decoder indices outside the mapped window or map pages past EOF. The sync index
+ * write pointer is not checked; it is a free-running counter that is always used modulo.
+ */
+
+{
+    struct stat st;
+
+    return ( ( hdr->buflen != 0 ) &&
+             ( hdr->wp >= 0 ) && ( ( uint32_t )hdr->wp < hdr->buflen ) &&
+             ( hdr->rp >= 0 ) && ( ( uint32_t )hdr->rp < hdr->buflen ) &&
+             ( 0 == fstat( fd, &st ) ) &&
+             ( ( uint64_t )st.st_size >= SESSION_HDR_LEN + ( uint64_t )hdr->buflen ) );
+}
+// ====================================================================================================
+static bool _sessionWrite( struct RunTime *r, const char *fn, int32_t currentLine, uint64_t srcLen, uint64_t srcSum )
+
+/* Write the capture window and browsing state as a single snapshot. The window goes out
+ * verbatim (un-rotated) so a restore can map it rather than copy it; decoder state is not
+ * stored since re-decode from the raw window is fast enough not to be worth it.
+ */
+
+{
+    struct sessionHeader hdr = { 0 };
+    FILE *f = fopen( fn, "wb" );
+
+    if ( !f )
+    {
+        return false;
+    }
+
+    hdr.magic        = SESSION_MAGIC;
+    hdr.version      = SESSION_VERSION;
+    hdr.buflen       = r->options->buflen;
+    hdr.traceProt    = r->options->traceProt;
+    hdr.wp           = r->wp;
+    hdr.rp           = r->rp;
+    hdr.currentLine  = currentLine;
+    hdr.syncIndexWp  = r->syncIndexWp;
+    hdr.tag          = r->options->tag;
+    hdr.captureCount = r->captureCount;
+    hdr.srcLen       = srcLen;
+    hdr.srcSum       = srcSum;
+    memcpy( hdr.syncIndex, r->syncIndex, sizeof( hdr.syncIndex ) );
+
+    if ( ( 1 != fwrite( &hdr, sizeof( hdr ), 1, f ) ) ||
+            ( 0 != fseek( f, SESSION_HDR_LEN, SEEK_SET ) ) ||
+            ( 1 != fwrite( r->pmBuffer, r->options->buflen, 1, f ) ) )
+    {
+        fclose( f );
+        return false;
+    }
+
+    fclose( f );
+    return true;
+}
+// ====================================================================================================
+static void _sessionSave( struct RunTime *r )
+
+/* Write the browsing state as a snapshot next to the other saved outputs, restorable with -S */
+
+{
+    char fn[SCRATCH_STRING_LEN];
+
+    snprintf( fn, SCRATCH_STRING_LEN, "%s.session", SIOgetSaveFilename( r->sio ) );
+
+    if ( !_sessionWrite( r, fn, SIOgetCurrentLineno( r->sio ), 0, 0 ) )
+    {
+        SIOalert( r->sio, "Save Session Failed" );
+    }
+}
+// ====================================================================================================
+static bool _fileSum( const char *path, uint64_t *len, uint64_t *sum )
+
+/* FNV-1a over a whole file; a sequential read is cheap next to a replay, and any content
+ * change at all shows up in it.
+ */
+
+{
+    uint8_t buf[65536];
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t n;
+    FILE *f = fopen( path, "rb" );
+
+    if ( !f )
+    {
+        return false;
+    }
+
+    *len = 0;
+
+    while ( ( n = fread( buf, 1, sizeof( buf ), f ) ) > 0 )
+    {
+        for ( size_t i = 0; i < n; i++ )
+        {
+            h = ( h ^ buf[i] ) * 0x100000001b3ULL;
+        }
+
+        *len += n;
+    }
+
+    fclose( f );
+    *sum = h;
+    return true;
+}
+// ====================================================================================================
+static void _sidecarSave( struct RunTime *r )
+
+/* Leave an index sidecar beside the capture file once its replay completes, so the next open
+ * of the same content can map the deframed window straight back in and skip the replay.
+ */
+
+{
+#if !defined( WIN32 )
+    char fn[SCRATCH_STRING_LEN];
+    uint64_t srcLen;
+    uint64_t srcSum;
+
+    if ( !_fileSum( r->options->file, &srcLen, &srcSum ) )
+    {
+        return;
+    }
+
+    snprintf( fn, SCRATCH_STRING_LEN, "%s.index", r->options->file );
+
+    if ( _sessionWrite( r, fn, 0, srcLen, srcSum ) )
+    {
+        genericsReport( V_INFO, "Wrote index sidecar %s" EOL, fn );
+    }
+
+#endif
+}
+// ====================================================================================================
+static bool _sidecarRestore( struct RunTime *r )
+
+/* Restore capture state from an index sidecar, provided it still matches the capture file's
+ * exact content and the tag being decoded; anything else falls back to a full replay.
+ */
+
+{
+#if !defined( WIN32 )
+    struct sessionHeader hdr;
+    char fn[SCRATCH_STRING_LEN];
+    uint64_t srcLen;
+    uint64_t srcSum;
+
+    snprintf( fn, SCRATCH_STRING_LEN, "%s.index", r->options->file );
+    int fd = open( fn, O_RDONLY );
+
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    if ( ( sizeof( hdr ) != read( fd, &hdr, sizeof( hdr ) ) ) ||
+            ( SESSION_MAGIC != hdr.magic ) || ( SESSION_VERSION != hdr.version ) ||
+            ( hdr.tag != ( uint32_t )r->options->tag ) || ( !_sessionHeaderValid( fd, &hdr ) ) )
+    {
+        close( fd );
+        return false;
+    }
+
+    /* The sidecar must describe this exact content, or trusting it would lose the replay's tail */
+    if ( ( !_fileSum( r->options->file, &srcLen, &srcSum ) ) ||
+            ( srcLen != hdr.srcLen ) || ( srcSum != hdr.srcSum ) )
+    {
+        genericsReport( V_INFO, "Index sidecar is stale; replaying %s in full" EOL, r->options->file );
+        close( fd );
+        return false;
+    }
+
+    /* The window maps copy-on-write, so nothing done here can damage the sidecar */
+    uint8_t *m = ( uint8_t * )mmap( NULL, hdr.buflen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, SESSION_HDR_LEN );
+    close( fd );
+
+    if ( MAP_FAILED == ( void * )m )
+    {
+        return false;
+    }
+
+    r->pmBuffer = m;
+    r->pmMapLen = hdr.buflen;
+
+    /* The sidecar dictates window size and protocol, exactly as a session restore does */
+    r->options->buflen    = hdr.buflen;
+    r->options->traceProt = hdr.traceProt;
+    r->wp                 = hdr.wp;
+    r->rp                 = hdr.rp;
+    r->captureCount       = hdr.captureCount;
+    r->syncIndexWp        = hdr.syncIndexWp;
+    memcpy( r->syncIndex, hdr.syncIndex, sizeof( r->syncIndex ) );
+
+    r->sessionLine          = hdr.currentLine;
+    r->sessionCursorPending = ( hdr.currentLine > 0 );
+
+    genericsReport( V_INFO, "Restored %s from its index sidecar" EOL, r->options->file );
+    return true;
+#else
+    return false;
+#endif
+}
+// ====================================================================================================
 static void _doSave( struct RunTime *r, bool includeDebug )
 
-/* Save buffer in both raw and processed formats */
+/* Save buffer in raw, processed and restorable session formats */
 
 {
+    /* Everything has to be materialized before it can be saved */
+    _decodeMore( r, -1 );
+    SIOextendOutputBuffer( r->sio, r->numLines );
+
     FILE *f;
     char fn[SCRATCH_STRING_LEN];
     uint32_t w;
@@ -1286,9 +1995,56 @@ static void _doSave( struct RunTime *r, bool includeDebug )
 
     fclose( f );
 
+    _sessionSave( r );
+
     SIOalert( r->sio, "Save Complete" );
 }
 // ====================================================================================================
+static void _createPMBuffer( struct RunTime *r )
+
+/* Allocate the post-mortem capture buffer. Decode sweeps walk the whole window repeatedly, so
+ * for large buffers TLB pressure is real money; explicit 2MB huge pages are tried first, then
+ * an ordinary mapping with a transparent-huge-page hint, and only then a plain allocation.
+ */
+
+{
+#if !defined( WIN32 )
+    size_t len = r->options->buflen;
+
+#if defined( MAP_HUGETLB )
+    /* hugetlb mappings must be a whole number of huge pages, and need pages reserved by the
+     * administrator; failure here is routine and just drops through. */
+    size_t hlen = ( len + ( 2 * 1024 * 1024 - 1 ) ) & ~( size_t )( 2 * 1024 * 1024 - 1 );
+    r->pmBuffer = ( uint8_t * )mmap( NULL, hlen, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+
+    if ( MAP_FAILED != ( void * )r->pmBuffer )
+    {
+        r->pmMapLen = hlen;
+        genericsReport( V_INFO, "Capture buffer on explicit huge pages" EOL );
+        return;
+    }
+
+#endif
+
+    r->pmBuffer = ( uint8_t * )mmap( NULL, len, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+    if ( MAP_FAILED != ( void * )r->pmBuffer )
+    {
+        r->pmMapLen = len;
+#if defined( MADV_HUGEPAGE )
+        madvise( r->pmBuffer, len, MADV_HUGEPAGE );
+#endif
+        return;
+    }
+
+#endif
+
+    r->pmBuffer = ( uint8_t * )calloc( 1, r->options->buflen );
+    MEMCHECKV( r->pmBuffer );
+}
+// ====================================================================================================
 static void _doExit( void )
 
 /* Perform any explicit exit functions */
@@ -1310,9 +2066,10 @@ static void _doExit( void )
 int main( int argc, char *argv[] )
 
 {
+    selfprofInit( "orbmortem" );
+
     int32_t lastTTime, lastTSTime, lastHTime;
-    struct Stream *stream;              /* Stream that we are collecting data from */
-    struct timeval tv;
+    struct Stream *stream = NULL;       /* Stream that we are collecting data from */
     enum SIOEvent s;
 
     /* Have a basic name and search string set up */
@@ -1334,24 +2091,18 @@ int main( int argc, char *argv[] )
 
     if ( _r.options->file != NULL )
     {
-        if ( NULL == ( stream = streamCreateFile( _r.options->file ) ) )
+        /* A matching index sidecar means the capture state can be mapped straight in; only
+         * without one does the file need to be replayed through the deframer. */
+        if ( !_sidecarRestore( &_r ) )
         {
-            genericsExit( V_ERROR, "File not found" EOL );
-            _r.ending = true;
+            if ( NULL == ( stream = streamCreateFile( _r.options->file ) ) )
+            {
+                genericsExit( V_ERROR, "File not found" EOL );
+                _r.ending = true;
+            }
         }
     }
 
-    /* Check we've got _some_ symbols to start from */
-    _r.s = symbolAcquire( _r.options->elffile, true, true );
-
-    if ( !_r.s )
-    {
-        genericsReport( V_ERROR, "Elf file or symbols in it not found" EOL );
-        return -1;
-    }
-
-    genericsReport( V_DEBUG, "Loaded %s" EOL, _r.options->elffile );
-
     /* This ensures the atexit gets called */
     if ( SIG_ERR == signal( SIGINT, _intHandler ) )
     {
@@ -1372,22 +2123,126 @@ int main( int argc, char *argv[] )
 
 #endif
 
-    /* Create the buffer memory */
-    _r.pmBuffer = ( uint8_t * )calloc( 1, _r.options->buflen );
+    /* Create the buffer memory, either anonymous, restored from a session, or backed by a
+     * capture file on disk */
+    if ( _r.pmBuffer )
+    {
+        /* Already mapped straight from an index sidecar; nothing to create */
+    }
+    else if ( _r.options->sessionFile )
+    {
+#if !defined( WIN32 )
+        struct sessionHeader hdr;
+        int fd = open( _r.options->sessionFile, O_RDONLY );
+
+        if ( ( fd < 0 ) || ( sizeof( hdr ) != read( fd, &hdr, sizeof( hdr ) ) ) )
+        {
+            genericsExit( -1, "Couldn't read session file %s" EOL, _r.options->sessionFile );
+        }
+
+        if ( ( SESSION_MAGIC != hdr.magic ) || ( SESSION_VERSION != hdr.version ) )
+        {
+            genericsExit( -1, "%s is not a recognised session file" EOL, _r.options->sessionFile );
+        }
+
+        if ( !_sessionHeaderValid( fd, &hdr ) )
+        {
+            genericsExit( -1, "Session file %s is truncated or corrupt" EOL, _r.options->sessionFile );
+        }
+
+        /* The window maps copy-on-write, so nothing done here can damage the snapshot */
+        _r.pmBuffer = ( uint8_t * )mmap( NULL, hdr.buflen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, SESSION_HDR_LEN );
+        close( fd );
+
+        if ( MAP_FAILED == ( void * )_r.pmBuffer )
+        {
+            genericsExit( -1, "Couldn't map session file %s" EOL, _r.options->sessionFile );
+        }
+
+        _r.pmMapLen = hdr.buflen;
+
+        /* The snapshot dictates window size and protocol, whatever the command line said */
+        _r.options->buflen    = hdr.buflen;
+        _r.options->traceProt = hdr.traceProt;
+        _r.wp                 = hdr.wp;
+        _r.rp                 = hdr.rp;
+        _r.captureCount       = hdr.captureCount;
+        _r.syncIndexWp        = hdr.syncIndexWp;
+        memcpy( _r.syncIndex, hdr.syncIndex, sizeof( _r.syncIndex ) );
+
+        _r.sessionLine          = hdr.currentLine;
+        _r.sessionCursorPending = ( hdr.currentLine > 0 );
+#else
+        genericsExit( -1, "Session restore is not supported on this platform" EOL );
+#endif
+    }
+    else if ( _r.options->captureFile )
+    {
+#if !defined( WIN32 )
+        int fd = open( _r.options->captureFile, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+
+        if ( ( fd < 0 ) || ( ftruncate( fd, _r.options->buflen ) < 0 ) )
+        {
+            genericsExit( -1, "Couldn't create capture file %s" EOL, _r.options->captureFile );
+        }
+
+        _r.pmBuffer = ( uint8_t * )mmap( NULL, _r.options->buflen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        close( fd );
+
+        if ( MAP_FAILED == ( void * )_r.pmBuffer )
+        {
+            genericsExit( -1, "Couldn't map capture file %s" EOL, _r.options->captureFile );
+        }
+
+        _r.pmMapLen = _r.options->buflen;
+#else
+        genericsExit( -1, "Capture files are not supported on this platform" EOL );
+#endif
+    }
+    else
+    {
+        _createPMBuffer( &_r );
+    }
 
     TRACEDecoderInit( &_r.i, _r.options->traceProt, !( _r.options->noAltAddr ), _traceReport );
 
     OFLOWInit( &_r.c );
 
+    /* Symbol loading can take seconds on a big image, and capture doesn't need it; load in the
+     * background and only wait for it when the first decode actually wants symbols.
+     */
+    _r.symbolsLoading = true;
+
+    if ( pthread_create( &_r.symbolThread, NULL, &_symbolLoaderTask, &_r ) )
+    {
+        genericsExit( -1, "Failed to create symbol loader thread" EOL );
+    }
+
+    /* Get bytes flowing into the ring before the screen comes up, so for a live connection the
+     * crash moment we were launched for is already being captured while ncurses initializes.
+     */
+    if ( ( NULL == _r.options->file ) && ( NULL == _r.options->sessionFile ) )
+    {
+        stream = streamCreateSocket( _r.options->server, _r.options->port + ( ( PROT_OFLOW != _r.options->commProt ) ? 1 : 0 ) );
+    }
+
+    if ( stream )
+    {
+        _startReader( &_r, stream );
+    }
+
     /* Create a screen and interaction handler */
     _r.sio = SIOsetup( _r.progName, _r.options->elffile, ( _r.options->file != NULL ) );
 
+    /* The UI can pull further decoded lines on demand rather than needing them all up front */
+    SIOsetLineProvider( _r.sio, _provideLines, &_r );
+
     /* Put a record of the protocol in use on screen */
     SIOtagText( _r.sio, TRACEDecodeGetProtocolName( _r.options->traceProt ) );
 
     while ( !_r.ending )
     {
-        if ( NULL == _r.options->file )
+        if ( ( NULL == _r.options->file ) && ( NULL == _r.options->sessionFile ) && ( !stream ) )
         {
             /* Keep trying to open a network connection at half second intervals */
             while ( 1 )
@@ -1412,52 +2267,84 @@ int main( int argc, char *argv[] )
             }
         }
 
+        if ( stream && !_r.readerRunning )
+        {
+            _startReader( &_r, stream );
+        }
+
         /* ----------------------------------------------------------------------------- */
         /* This is the main active loop...only break out of this when ending or on error */
         /* ----------------------------------------------------------------------------- */
         while ( !_r.ending )
         {
-            tv.tv_sec = 0;
-            tv.tv_usec  = 10000;
-
             if ( stream )
             {
-                /* We always read the data, even if we're held, to keep the socket alive */
-                enum ReceiveResult result = stream->receive( stream, _r.rawBlock.buffer, TRANSFER_SIZE, &tv, ( size_t * )&_r.rawBlock.fillLevel );
+                /* Drain whatever the reader thread has collected. We always consume the data, */
+                /* even when held, to keep the ring moving and the socket alive.               */
+                bool drained = false;
 
-                /* Try to re-establish socket if there was an error */
-                if ( result == RECEIVE_RESULT_ERROR )
+                while ( atomic_load( &_r.rbRp ) != atomic_load( &_r.rbWp ) )
                 {
+                    struct dataBlock *b = &_r.rawBlockRing[atomic_load( &_r.rbRp ) % RAW_BLOCK_RING_LEN];
+
+                    if ( !_r.held )
+                    {
+                        /* Pump all of the data through the protocol handler */
+
+                        if ( PROT_OFLOW == _r.options->commProt )
+                        {
+                            OFLOWPump( &_r.c, b->buffer, b->fillLevel, _OFLOWpacketRxed, &_r );
+                        }
+                        else
+                        {
+                            _processBlock( &_r, b );
+                        }
+                    }
+
+                    atomic_store( &_r.rbRp, atomic_load( &_r.rbRp ) + 1 );
+                    drained = true;
+                }
+
+                if ( _r.readerError )
+                {
+                    /* Try to re-establish socket if there was an error */
                     break;
                 }
 
-                if ( ( ( result == RECEIVE_RESULT_EOF ) || ( _r.rawBlock.fillLevel <= 0 ) ) && _r.options->file )
+                if ( _r.readerEOF )
                 {
                     /* Read from file is complete, remove it */
+                    pthread_join( _r.readerThread, NULL );
+                    _r.readerRunning = false;
+
                     stream->close( stream );
                     free( stream );
 
-                    stream = NULL;
+                    stream = _r.stream = NULL;
+
+                    if ( _r.options->file )
+                    {
+                        /* The replay work is done; leave its result beside the file for next time */
+                        _sidecarSave( &_r );
+                    }
+                }
+                else if ( ( !drained ) && ( !_r.pend.active ) )
+                {
+                    /* Nothing waiting...no point in checking for keypresses _too_ often! */
+                    usleep( TICK_TIME_MS * 100 );
                 }
             }
-            else
+            else if ( !_r.pend.active )
             {
                 /* No point in checking for keypresses _too_ often! */
                 usleep( TICK_TIME_MS * 100 );
             }
 
-            if ( !_r.held )
+            /* Progress any outstanding decode a slice at a time, keeping the UI responsive */
+            if ( ( _r.pend.active ) && ( !_r.diving ) )
             {
-                /* Pump all of the data through the protocol handler */
-
-                if ( PROT_OFLOW == _r.options->commProt )
-                {
-                    OFLOWPump( &_r.c, _r.rawBlock.buffer, _r.rawBlock.fillLevel, _OFLOWpacketRxed, &_r );
-                }
-                else
-                {
-                    _processBlock( &_r );
-                }
+                _decodeMore( &_r, _r.numLines + DECODE_SLICE_LINES );
+                SIOextendOutputBuffer( _r.sio, _r.numLines );
             }
 
             /* Update the outputs and deal with any keys that made it up this high */
@@ -1465,7 +2352,7 @@ int main( int argc, char *argv[] )
             switch ( ( s = SIOHandler( _r.sio, ( genericsTimestampmS() - lastTTime ) > TICK_TIME_MS, _r.oldTotalIntervalBytes, _r.options->withDebugText ) ) )
             {
                 case SIO_EV_HOLD:  // ----------------- Request for Hold Start/Stop -------------------------------------
-                    if ( !_r.options->file )
+                    if ( ( !_r.options->file ) && ( !_r.options->sessionFile ) )
                     {
                         _r.held = !_r.held;
 
@@ -1595,7 +2482,7 @@ int main( int argc, char *argv[] )
             /* Deal with possible timeout on sampling, or if this is a read-from-file that is finished */
             if ( ( !_r.numLines )  &&
                     (
-                                ( _r.options->file && !stream ) ||
+                                ( ( _r.options->file || _r.options->sessionFile ) && !stream ) ||
                                 ( ( ( genericsTimestampmS() - lastHTime ) > HANG_TIME_MS ) &&
                                   ( _r.newTotalBytes - _r.oldTotalHangBytes == 0 ) &&
                                   ( _r.wp != _r.rp ) )
@@ -1611,6 +2498,21 @@ int main( int argc, char *argv[] )
                 {
                     _r.held = true;
                     SIOheld( _r.sio, _r.held );
+
+                    if ( _r.sessionCursorPending )
+                    {
+                        /* Put the view back where the snapshot left it */
+                        _decodeMore( &_r, _r.sessionLine + 1 );
+                        SIOextendOutputBuffer( _r.sio, _r.numLines );
+
+                        if ( _r.sessionLine < _r.numLines )
+                        {
+                            SIOsetCurrentLineno( _r.sio, _r.sessionLine );
+                        }
+
+                        SIOrequestRefresh( _r.sio );
+                        _r.sessionCursorPending = false;
+                    }
                 }
             }
 
@@ -1638,6 +2540,12 @@ int main( int argc, char *argv[] )
         /* End of main loop ... we get here because something forced us out              */
         /* ----------------------------------------------------------------------------- */
 
+        if ( _r.readerRunning )
+        {
+            pthread_join( _r.readerThread, NULL );
+            _r.readerRunning = false;
+        }
+
         if ( stream )
         {
             stream->close( stream );
@@ -1658,7 +2566,11 @@ int main( int argc, char *argv[] )
         }
     }
 
-    symbolDelete( _r.s );
+    if ( _awaitSymbols( &_r ) )
+    {
+        symbolDelete( _r.s );
+    }
+
     return OK;
 }
 
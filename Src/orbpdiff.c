@@ -0,0 +1,354 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Profile database query module for Orbuculum
+ * ===========================================
+ *
+ * Lists the builds held in an accumulating profile database written by orbprofile, and
+ * extracts per-function deltas between two of them, so a regression shows up as a sorted
+ * table rather than a scripting exercise over callgrind files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "git_version_info.h"
+#include "generics.h"
+#include "ext_fileformats.h"
+
+/* ---------- CONFIGURATION ----------------- */
+struct Options                           /* Record for options, either defaults or from command line */
+{
+    char *dbfile;                        /* Profile database to query */
+    char *oldBuild;                      /* Reference build identity, in hex */
+    char *newBuild;                      /* Candidate build identity, in hex */
+    uint32_t cutoff;                     /* Report only the top n movers, 0 for everything */
+} _options;
+
+struct deltaLine                         /* One function's standing in the two builds under comparison */
+{
+    const char *name;
+    uint64_t oldAvg;                     /* Mean samples per run in the reference build */
+    uint64_t newAvg;                     /* Mean samples per run in the candidate build */
+    bool inOld;
+    bool inNew;
+};
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Internally available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+static int64_t _delta( const struct deltaLine *l )
+
+{
+    return ( int64_t )l->newAvg - ( int64_t )l->oldAvg;
+}
+// ====================================================================================================
+static int _delta_sort_fn( const void *a, const void *b )
+
+/* Sort lines by the magnitude of their movement, largest first */
+
+{
+    int64_t da = _delta( ( const struct deltaLine * )a );
+    int64_t db = _delta( ( const struct deltaLine * )b );
+
+    da = ( da < 0 ) ? -da : da;
+    db = ( db < 0 ) ? -db : db;
+
+    if ( da != db )
+    {
+        return ( db > da ) ? 1 : -1;
+    }
+
+    return strcmp( ( ( const struct deltaLine * )a )->name, ( ( const struct deltaLine * )b )->name );
+}
+// ====================================================================================================
+static void _sliceBuild( struct pdbRecord *recs, uint32_t count, uint64_t buildId,
+                         uint32_t *first, uint32_t *num )
+
+/* Locate the contiguous run of records for one build; records are sorted by build identity */
+
+{
+    uint32_t i = 0;
+
+    while ( ( i < count ) && ( recs[i].buildId < buildId ) )
+    {
+        i++;
+    }
+
+    *first = i;
+
+    while ( ( i < count ) && ( recs[i].buildId == buildId ) )
+    {
+        i++;
+    }
+
+    *num = i - *first;
+}
+// ====================================================================================================
+static void _listBuilds( struct pdbRecord *recs, uint32_t count )
+
+/* Summarise each build held in the database, one line apiece */
+
+{
+    uint32_t i = 0;
+
+    printf( "%-18s %9s %9s %12s" EOL, "Build", "Functions", "Runs", "Samples" );
+
+    while ( i < count )
+    {
+        uint64_t buildId = recs[i].buildId;
+        uint64_t samples = 0;
+        uint64_t runs = 0;
+        uint32_t fns = 0;
+
+        while ( ( i < count ) && ( recs[i].buildId == buildId ) )
+        {
+            samples += recs[i].samples;
+
+            if ( recs[i].runs > runs )
+            {
+                runs = recs[i].runs;
+            }
+
+            fns++;
+            i++;
+        }
+
+        printf( "%016" PRIx64 " %9" PRIu32 " %9" PRIu64 " %12" PRIu64 EOL, buildId, fns, runs, samples );
+    }
+}
+// ====================================================================================================
+static bool _reportDelta( struct pdbRecord *recs, uint32_t count, uint64_t oldId, uint64_t newId )
+
+/* Merge-join the two builds on function hash and print movement, biggest movers first */
+
+{
+    uint32_t oldFirst, oldNum, newFirst, newNum;
+
+    _sliceBuild( recs, count, oldId, &oldFirst, &oldNum );
+    _sliceBuild( recs, count, newId, &newFirst, &newNum );
+
+    if ( !oldNum )
+    {
+        genericsReport( V_ERROR, "Build %016" PRIx64 " is not in the database" EOL, oldId );
+        return false;
+    }
+
+    if ( !newNum )
+    {
+        genericsReport( V_ERROR, "Build %016" PRIx64 " is not in the database" EOL, newId );
+        return false;
+    }
+
+    struct deltaLine *line = ( struct deltaLine * )calloc( oldNum + newNum, sizeof( struct deltaLine ) );
+    MEMCHECK( line, false );
+
+    /* Records within a build are sorted by function hash, so one pass pairs them up */
+    uint32_t o = oldFirst;
+    uint32_t n = newFirst;
+    uint32_t numLines = 0;
+
+    while ( ( o < oldFirst + oldNum ) || ( n < newFirst + newNum ) )
+    {
+        struct deltaLine *l = &line[numLines++];
+        bool takeOld = ( o < oldFirst + oldNum ) &&
+                       ( ( n == newFirst + newNum ) || ( recs[o].fnHash <= recs[n].fnHash ) );
+        bool takeNew = ( n < newFirst + newNum ) &&
+                       ( ( o == oldFirst + oldNum ) || ( recs[n].fnHash <= recs[o].fnHash ) );
+
+        if ( takeOld )
+        {
+            l->name = recs[o].name;
+            l->oldAvg = recs[o].samples / recs[o].runs;
+            l->inOld = true;
+            o++;
+        }
+
+        if ( takeNew )
+        {
+            l->name = recs[n].name;
+            l->newAvg = recs[n].samples / recs[n].runs;
+            l->inNew = true;
+            n++;
+        }
+    }
+
+    qsort( line, numLines, sizeof( struct deltaLine ), _delta_sort_fn );
+
+    if ( ( _options.cutoff ) && ( numLines > _options.cutoff ) )
+    {
+        numLines = _options.cutoff;
+    }
+
+    printf( "%12s %12s %12s  %s" EOL, "Old/run", "New/run", "Delta", "Function" );
+
+    for ( uint32_t i = 0; i < numLines; i++ )
+    {
+        struct deltaLine *l = &line[i];
+
+        if ( !l->inOld )
+        {
+            printf( "%12s %12" PRIu64 " %+12" PRId64 "  %s (new)" EOL, "-", l->newAvg, _delta( l ), l->name );
+        }
+        else if ( !l->inNew )
+        {
+            printf( "%12" PRIu64 " %12s %+12" PRId64 "  %s (gone)" EOL, l->oldAvg, "-", _delta( l ), l->name );
+        }
+        else
+        {
+            printf( "%12" PRIu64 " %12" PRIu64 " %+12" PRId64 "  %s" EOL, l->oldAvg, l->newAvg, _delta( l ), l->name );
+        }
+    }
+
+    free( line );
+    return true;
+}
+// ====================================================================================================
+static void _printHelp( const char *const progName )
+
+{
+    genericsFPrintf( stderr, "Usage: %s [options] <database>" EOL, progName );
+    genericsFPrintf( stderr, "    -h, --help:         This help" EOL );
+    genericsFPrintf( stderr, "    -n, --new-build:    <BuildId> candidate build to compare, in hex" EOL );
+    genericsFPrintf( stderr, "    -o, --old-build:    <BuildId> reference build to compare against, in hex" EOL );
+    genericsFPrintf( stderr, "    -c, --cutoff:       <n> only report the top n movers" EOL );
+    genericsFPrintf( stderr, "    -v, --verbose:      <level> Verbose mode 0(errors)..3(debug)" EOL );
+    genericsFPrintf( stderr, "    -V, --version:      Print version and exit" EOL );
+    genericsFPrintf( stderr, EOL "Without -o/-n the builds held in the database are listed." EOL );
+}
+// ====================================================================================================
+void _printVersion( void )
+
+{
+    genericsFPrintf( stderr, "orbpdiff version " GIT_DESCRIBE EOL );
+}
+// ====================================================================================================
+static struct option _longOptions[] =
+{
+    {"cutoff", required_argument, NULL, 'c'},
+    {"help", no_argument, NULL, 'h'},
+    {"new-build", required_argument, NULL, 'n'},
+    {"old-build", required_argument, NULL, 'o'},
+    {"verbose", required_argument, NULL, 'v'},
+    {"version", no_argument, NULL, 'V'},
+    {NULL, no_argument, NULL, 0}
+};
+// ====================================================================================================
+static bool _processOptions( int argc, char *argv[] )
+
+{
+    int c, optionIndex = 0;
+
+    while ( ( c = getopt_long ( argc, argv, "c:hn:o:v:V", _longOptions, &optionIndex ) ) != -1 )
+
+        switch ( c )
+        {
+            // ------------------------------------
+            case 'c':
+                _options.cutoff = atoi( optarg );
+                break;
+
+            // ------------------------------------
+            case 'h':
+                _printHelp( argv[0] );
+                return false;
+
+            // ------------------------------------
+            case 'n':
+                _options.newBuild = optarg;
+                break;
+
+            // ------------------------------------
+            case 'o':
+                _options.oldBuild = optarg;
+                break;
+
+            // ------------------------------------
+            case 'v':
+                genericsSetReportLevel( atoi( optarg ) );
+                break;
+
+            // ------------------------------------
+            case 'V':
+                _printVersion();
+                return false;
+
+            // ------------------------------------
+            case '?':
+                genericsReport( V_ERROR, "Unrecognised option" EOL );
+                return false;
+
+            // ------------------------------------
+            default:
+                return false;
+                // ------------------------------------
+        }
+
+    if ( optind >= argc )
+    {
+        genericsReport( V_ERROR, "No database file specified" EOL );
+        return false;
+    }
+
+    _options.dbfile = argv[optind];
+
+    if ( ( !_options.oldBuild ) != ( !_options.newBuild ) )
+    {
+        genericsReport( V_ERROR, "-o and -n must be given together" EOL );
+        return false;
+    }
+
+    return true;
+}
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Externally available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+int main( int argc, char *argv[] )
+
+{
+    struct pdbRecord *recs;
+    uint32_t count;
+
+    if ( !_processOptions( argc, argv ) )
+    {
+        /* processOptions generates its own error messages */
+        genericsExit( -1, "" EOL );
+    }
+
+    if ( !ext_ff_profileDbRead( _options.dbfile, &recs, &count ) )
+    {
+        genericsExit( -1, "%s is not a profile database" EOL, _options.dbfile );
+    }
+
+    if ( !count )
+    {
+        genericsExit( -1, "%s holds no records" EOL, _options.dbfile );
+    }
+
+    bool ok = true;
+
+    if ( _options.oldBuild )
+    {
+        ok = _reportDelta( recs, count,
+                           strtoull( _options.oldBuild, NULL, 16 ),
+                           strtoull( _options.newBuild, NULL, 16 ) );
+    }
+    else
+    {
+        _listBuilds( recs, count );
+    }
+
+    free( recs );
+    return ok ? 0 : -1;
+}
+// ====================================================================================================
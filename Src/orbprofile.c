@@ -9,17 +9,27 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <signal.h>
 #include <semaphore.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <assert.h>
 #include <getopt.h>
+#include <time.h>
 
 #include "git_version_info.h"
+#include "selfprof.h"
+
+/* Route uthash bucket storage through the record arena too...buckets are never given back */
+static void *_arenaAlloc( size_t size );
+#define uthash_malloc( sz ) _arenaAlloc( sz )
+#define uthash_free( ptr, sz )
 #include "uthash.h"
 #include "generics.h"
+#include "flathash.h"
 #include "traceDecoder.h"
 #include "oflow.h"
 #include "symbols.h"
@@ -37,6 +47,23 @@ const char *protString[] = {"OFLOW", "ETM", NULL};
 /* How many transfer buffers from the source to allocate */
 #define NUM_RAW_BLOCKS (1000)
 
+/* Direct-lookup paging over the exec table, indexed by halfword address */
+#define INST_PAGE_BITS (10)                       /* Halfword slots per page */
+#define INST_PAGE_LEN  ( 1 << INST_PAGE_BITS )
+#define INST_DIR_LEN   ( 1 << ( 31 - INST_PAGE_BITS ) )
+
+/* Exclusion filter geometry: a Bloom prefilter over address pages guards the interval table */
+#define EXC_PAGE_BITS  (9)                        /* Bytes per prefilter page, as a power of two */
+#define EXC_BLOOM_BITS (12)                       /* log2 of the prefilter size in bits */
+#define EXC_BLOOM_LEN  ( 1 << ( EXC_BLOOM_BITS - 6 ) )
+
+/* Longest straight-line run batch-accounted as one block */
+#define BLOCK_MAX_LEN  (64)
+
+/* Microarchitectural simulation transport geometry */
+#define SIM_RING_LEN   (65536)                    /* Events in the decode-to-worker ring, power of two */
+#define SIM_MAX_RUN    (4096)                     /* Longest fetch run batched into one event, in bytes */
+
 #define DBG_OUT(...) fprintf(stderr,__VA_ARGS__)
 //#define DBG_OUT(...)
 
@@ -59,9 +86,12 @@ struct Options                           /* Record for options, either defaults
 
     char *elffile;                       /* Target program config */
     char *odoptions;                     /* Options to pass directly to objdump */
+    char *exclude;                       /* Functions to exclude from the profile */
 
     char *dotfile;                       /* File to output dot information */
     char *profile;                       /* File to output profile information */
+    char *profileDb;                     /* Accumulating profile database to merge this run into */
+    int  writeInterval;                  /* Interval between interim profile writes, 0 = only at exit */
     int  sampleDuration;                 /* How long we are going to sample for */
     bool mono;                           /* Supress colour in output */
     bool noaltAddr;                      /* Dont use alternate addressing */
@@ -72,6 +102,11 @@ struct Options                           /* Record for options, either defaults
     char *server;
     enum Prot protocol;                  /* What protocol to communicate (default to OFLOW (== orbuculum)) */
 
+    char *simulate;                      /* Microarchitectural simulation spec, NULL = off */
+    uint32_t simCacheKb;                 /* Modelled icache size, 0 = no cache model */
+    uint32_t simWays;                    /* Modelled icache associativity */
+    uint32_t simLineBytes;               /* Modelled icache line length */
+    uint32_t simBtbBits;                 /* log2 of bimodal predictor entries, 0 = static prediction */
 
 } _options =
 {
@@ -98,15 +133,57 @@ struct opConstruct
 
     bool isExceptReturn;                 /* Is this flagged as an exception return? */
     bool isException;                    /* Is this flagged as an exception? */
+
+    bool gapPending;                     /* An overflow lost trace; repair is owed at the next address */
+    uint32_t gapFrom;                    /* Last address known to be reached before the gap */
+    uint64_t gapsRepaired;               /* Gaps bridged by an unambiguous path */
+    uint64_t gapsLost;                   /* Gaps with no single path, written off as before */
 };
 
 /* A block of received data */
 struct dataBlock
 {
     ssize_t fillLevel;
+    uint64_t tstamp;                     /* Reception wall time, so decode lag can't skew frame stamps */
     uint8_t buffer[TRANSFER_SIZE];
 };
 
+/* One event handed to the simulation worker */
+struct simEvt
+{
+    uint32_t a;                          /* Run start address, or branch address with bit 0 set */
+    uint32_t b;                          /* Run end, or branch taken (bit 0) and backward (bit 1) flags */
+};
+
+/* Per-address simulation tallies, direct-paged like the exec table */
+struct simCnt
+{
+    uint64_t i1m;                        /* Estimated icache misses attributed to this address */
+    uint64_t bc;                         /* Conditional branch executions */
+    uint64_t bcm;                        /* ...of which the predictor model called wrongly */
+};
+
+/* An address range covering an excluded function */
+struct excRange
+{
+    uint32_t start;                      /* First address of the range */
+    uint32_t end;                        /* Last address of the range (inclusive) */
+};
+
+/* A straight-line run of already-walked instructions. Executions are tallied against the
+ * block and only expanded into the per-instruction counts when a report is due.
+ */
+struct blockEntry
+{
+    uint32_t addr;                               /* First instruction of the run (hash key) */
+    uint32_t nInstr;                             /* Number of instructions in the run */
+    uint32_t nextAddr;                           /* Address following the final instruction */
+    struct execEntryHash *prev;                  /* Fallthrough predecessor, for line-change accounting */
+    struct execEntryHash *member[BLOCK_MAX_LEN]; /* The instructions themselves */
+    uint64_t entered[BLOCK_MAX_LEN];             /* Runs which ended at each member */
+    UT_hash_handle hh;
+};
+
 /* ----------- LIVE STATE ----------------- */
 struct RunTime
 {
@@ -121,7 +198,18 @@ struct RunTime
     /* Calls related info */
     struct edge *calls;                         /* Call data table */
     struct subcall *subhead;                    /* Calls onstruct data */
+    struct flatHash64 subindex;                 /* Flat index over it, keyed on the packed src/dst
+                                                 * pair; every call event probes here, the uthash
+                                                 * chain is kept only for the report writers */
     struct execEntryHash *insthead;             /* Exec table handle for hash */
+    struct execEntryHash ***instDir;            /* Direct-indexed pages over the exec table */
+    struct blockEntry *blockhead;               /* Straight-line block table handle for hash */
+
+    /* Address ranges excluded from accounting, sorted by start address */
+    struct excRange *exc;                       /* The interval table itself */
+    uint32_t excCount;                          /* Number of intervals in the table */
+    uint32_t excMru;                            /* Most recently matched interval, tried first */
+    uint64_t excBloom[EXC_BLOOM_LEN];           /* Page prefilter; a clear bit means not excluded */
 
     /* Subroutine related info...the call stack and its length */
     struct _subcallAccount *substack;           /* Calls stack data */
@@ -137,18 +225,50 @@ struct RunTime
 
     /* Subprocess control and interworking */
     pthread_t processThread;                    /* Thread handling received data flow */
-    pthread_cond_t dataForClients;              /* Semaphore counting data for clients */
-    pthread_mutex_t dataForClients_m;           /* Mutex for counting data for clients */
-
-    /* Ring buffer for samples ... this 'pads' the rate data arrive and how fast they can be processed */
-    int wp;                                     /* Read and write pointers into transfer buffers */
-    int rp;
+    pthread_cond_t dataForClients;              /* Signalled when blocks are queued */
+    pthread_mutex_t dataForClients_m;           /* Protects the wakeup condition only */
+
+    /* Lock-free ring between the reader and the decoder; the reader publishes at wp and never
+     * waits on the decoder, the decoder retires at rp. Blocks are shed (and accounted) if the
+     * decoder falls a whole ring behind, rather than ever stalling reception.
+     */
+    atomic_uint_fast64_t wp;                    /* Ring write point (reader thread only) */
+    atomic_uint_fast64_t rp;                    /* Ring read point (decode thread only) */
+    uint64_t droppedBlocks;                     /* Blocks lost because the decoder fell behind */
     struct dataBlock rawBlock[NUM_RAW_BLOCKS];  /* Transfer buffers from the receiver */
 
+    /* Microarchitectural simulation. The decode thread publishes fetch runs and branch outcomes
+     * at simWp and never waits on the worker; events are shed (and accounted) if the worker falls
+     * a whole ring behind, so full-speed capture is unaffected by the simulation cost.
+     */
+    pthread_t simThread;                        /* The worker itself */
+    pthread_mutex_t simLock;                    /* Serialises counter folding against the worker */
+    volatile bool simExit;                      /* Worker leaves once this is set and the ring is dry */
+    atomic_uint_fast64_t simWp;                 /* Event ring write point (decode thread only) */
+    atomic_uint_fast64_t simRp;                 /* Event ring read point (worker only) */
+    struct simEvt simRing[SIM_RING_LEN];        /* The event ring */
+    uint32_t simRunStart;                       /* Fetch run being accumulated (decode thread only) */
+    uint32_t simRunEnd;                         /* ...and its current end */
+    uint64_t simEventsLost;                     /* Events shed because the worker fell behind */
+
+    struct simCnt **simDir;                     /* Direct-indexed per-address tallies (worker only) */
+    uint32_t simSets;                           /* Modelled icache sets */
+    uint32_t simLineBits;                       /* log2 of the modelled line length */
+    uint32_t *simTags;                          /* Cache tag store, sets * ways entries */
+    uint8_t *simAge;                            /* LRU ages matching the tag store */
+    uint8_t *simBimod;                          /* Bimodal predictor counters */
+    uint64_t simFetches;                        /* Line fetches modelled */
+    uint64_t simMisses;                         /* ...of which missed */
+    uint64_t simBc;                             /* Conditional branches modelled */
+    uint64_t simBcm;                            /* ...of which mispredicted */
+
     /* State info */
     volatile bool ending;                       /* Flag indicating app is terminating */
     bool     sampling;                          /* Are we actively sampling at the moment */
+    uint64_t firstArrival;                      /* Reception time of the first good trace frame */
+    uint64_t lastArrival;                       /* ...and of the most recent one */
     uint32_t starttime;                         /* At what time did we start sampling? */
+    uint64_t lastCheckpoint;                    /* When the profile was last written out mid-run */
 
     /* Turn addresses into files and routines tags */
     uint32_t nameCount;
@@ -165,6 +285,239 @@ struct RunTime
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
+
+/* Grow-only arena for the execEntryHash, subcall and uthash bucket records created in the hot
+ * decode path. Long runs make millions of these tiny allocations and none is ever individually
+ * released, so handing them out of large chunks avoids both per-block allocator overhead and
+ * heap fragmentation. Everything comes back in one chain walk at exit. Chunks are sized and
+ * aligned for transparent hugepages, which takes most of the TLB pressure off the record-
+ * chasing paths on long runs.
+ */
+
+#define ARENA_CHUNK_SIZE (2 * 1024 * 1024)   /* Bytes of record storage per arena chunk */
+#define ARENA_ALIGN      (2 * 1024 * 1024)   /* Hugepage alignment for the chunks */
+
+struct arenaChunk
+{
+    struct arenaChunk *next;             /* Chain of chunks, newest first */
+    size_t fill;                         /* Bytes of this chunk already handed out */
+    size_t len;                          /* Bytes of storage in this chunk */
+    uint8_t d[];                         /* The storage itself */
+};
+
+static struct arenaChunk *_arena = NULL;
+
+// ====================================================================================================
+static void *_arenaAlloc( size_t size )
+
+/* Hand out zeroed storage from the current chunk, opening a fresh one when it's exhausted */
+
+{
+    /* Keep returned blocks aligned for the strictest member of the records we store */
+    size = ( size + 7 ) & ~( ( size_t )7 );
+
+    if ( ( !_arena ) || ( _arena->fill + size > _arena->len ) )
+    {
+        size_t clen = ( size > ARENA_CHUNK_SIZE ) ? size : ARENA_CHUNK_SIZE;
+        struct arenaChunk *c = NULL;
+
+        if ( posix_memalign( ( void ** )&c, ARENA_ALIGN, sizeof( struct arenaChunk ) + clen ) )
+        {
+            c = NULL;
+        }
+
+        MEMCHECK( c, NULL );
+        memset( c, 0, sizeof( struct arenaChunk ) + clen );
+#if defined( MADV_HUGEPAGE )
+        madvise( c, sizeof( struct arenaChunk ) + clen, MADV_HUGEPAGE );
+#endif
+        c->len = clen;
+        c->next = _arena;
+        _arena = c;
+    }
+
+    void *p = &_arena->d[_arena->fill];
+    _arena->fill += size;
+    return p;
+}
+// ====================================================================================================
+static void _arenaFree( void )
+
+/* Bulk-release every record the run created */
+
+{
+    while ( _arena )
+    {
+        struct arenaChunk *c = _arena;
+        _arena = c->next;
+        free( c );
+    }
+}
+// ====================================================================================================
+static int _excCompare( const void *a, const void *b )
+
+{
+    uint32_t sa = ( ( const struct excRange * )a )->start;
+    uint32_t sb = ( ( const struct excRange * )b )->start;
+    return ( sa > sb ) - ( sa < sb );
+}
+// ====================================================================================================
+static void _excBloomNote( struct RunTime *r, uint32_t page )
+
+/* Mark a page as possibly containing excluded code, using two independent probes */
+
+{
+    uint32_t h1 = ( page * 0x9E3779B1 ) >> ( 32 - EXC_BLOOM_BITS );
+    uint32_t h2 = ( page * 0x85EBCA77 ) >> ( 32 - EXC_BLOOM_BITS );
+    r->excBloom[h1 >> 6] |= 1ULL << ( h1 & 63 );
+    r->excBloom[h2 >> 6] |= 1ULL << ( h2 & 63 );
+}
+// ====================================================================================================
+static void _buildExclusions( struct RunTime *r )
+
+/* Turn the list of excluded function names into a sorted address range table, plus a Bloom
+ * prefilter over address pages so the common (non-excluded) case is rejected in a couple of
+ * bit tests rather than a search.
+ */
+
+{
+    if ( !r->options->exclude )
+    {
+        return;
+    }
+
+    char *list = strdup( r->options->exclude );
+    MEMCHECKV( list );
+
+    for ( char *name = strtok( list, "," ); name; name = strtok( NULL, "," ) )
+    {
+        bool found = false;
+
+        for ( uint32_t i = 0; i < r->s->functionCount; i++ )
+        {
+            if ( ( r->s->functions[i].name ) && ( !strcmp( r->s->functions[i].name, name ) ) )
+            {
+                r->exc = ( struct excRange * )realloc( r->exc, ( r->excCount + 1 ) * sizeof( struct excRange ) );
+                MEMCHECKV( r->exc );
+                r->exc[r->excCount].start = r->s->functions[i].startAddr;
+                r->exc[r->excCount].end   = r->s->functions[i].endAddr;
+                r->excCount++;
+                found = true;
+                genericsReport( V_INFO, "Excluding %s (%08x..%08x)" EOL, name,
+                                r->s->functions[i].startAddr, r->s->functions[i].endAddr );
+            }
+        }
+
+        if ( !found )
+        {
+            genericsReport( V_WARN, "No function %s found to exclude" EOL, name );
+        }
+    }
+
+    free( list );
+
+    if ( !r->excCount )
+    {
+        return;
+    }
+
+    qsort( r->exc, r->excCount, sizeof( struct excRange ), _excCompare );
+
+    /* Merge any overlapping or adjacent ranges so the search sees disjoint intervals */
+    uint32_t o = 0;
+
+    for ( uint32_t i = 1; i < r->excCount; i++ )
+    {
+        if ( r->exc[i].start <= r->exc[o].end + 1 )
+        {
+            if ( r->exc[i].end > r->exc[o].end )
+            {
+                r->exc[o].end = r->exc[i].end;
+            }
+        }
+        else
+        {
+            r->exc[++o] = r->exc[i];
+        }
+    }
+
+    r->excCount = o + 1;
+
+    for ( uint32_t i = 0; i < r->excCount; i++ )
+    {
+        for ( uint32_t page = r->exc[i].start >> EXC_PAGE_BITS; page <= r->exc[i].end >> EXC_PAGE_BITS; page++ )
+        {
+            _excBloomNote( r, page );
+        }
+    }
+}
+// ====================================================================================================
+static inline bool _addrExcluded( struct RunTime *r, uint32_t addr )
+
+/* Check if an address falls in an excluded range; Bloom prefilter first, table only on a hit */
+
+{
+    if ( !r->excCount )
+    {
+        return false;
+    }
+
+    uint32_t page = addr >> EXC_PAGE_BITS;
+    uint32_t h1 = ( page * 0x9E3779B1 ) >> ( 32 - EXC_BLOOM_BITS );
+
+    if ( !( r->excBloom[h1 >> 6] & ( 1ULL << ( h1 & 63 ) ) ) )
+    {
+        return false;
+    }
+
+    uint32_t h2 = ( page * 0x85EBCA77 ) >> ( 32 - EXC_BLOOM_BITS );
+
+    if ( !( r->excBloom[h2 >> 6] & ( 1ULL << ( h2 & 63 ) ) ) )
+    {
+        return false;
+    }
+
+    /* The prefilter thinks this page holds excluded code; consult the interval table, trying
+     * the last match first since excluded hot loops revisit the same range */
+    if ( ( addr >= r->exc[r->excMru].start ) && ( addr <= r->exc[r->excMru].end ) )
+    {
+        return true;
+    }
+
+    int32_t lo = 0;
+    int32_t hi = r->excCount - 1;
+
+    while ( lo <= hi )
+    {
+        int32_t mid = ( lo + hi ) / 2;
+
+        if ( addr < r->exc[mid].start )
+        {
+            hi = mid - 1;
+        }
+        else if ( addr > r->exc[mid].end )
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            r->excMru = mid;
+            return true;
+        }
+    }
+
+    return false;
+}
+// ====================================================================================================
+static uint64_t _costNow( struct TRACECPUState *cpu )
+
+/* Position on the cost timeline; true cycles when the stream carries cycle counts,
+ * instruction count otherwise */
+
+{
+    return cpu->cycleTotal ? TRACECycleTimestamp( cpu ) : cpu->instCount;
+}
+// ====================================================================================================
 static void _callEvent( struct RunTime *r, uint32_t retAddr, uint32_t to )
 
 /* This is a call or a return, manipulate stack tracking appropriately */
@@ -179,17 +532,22 @@ static void _callEvent( struct RunTime *r, uint32_t retAddr, uint32_t to )
     /* This is a call */
     r->substack[r->substacklen].sig.src     = retAddr;
     r->substack[r->substacklen].sig.dst     = to;
-    r->substack[r->substacklen].inTicks     = cpu->instCount;
+    r->substack[r->substacklen].inTicks     = _costNow( cpu );
 
-    /* Find a record for this source/dest pair */
-    HASH_FIND( hh, r->subhead, &r->substack[r->substacklen].sig, sizeof( struct subcallSig ), s );
+    /* Find a record for this source/dest pair; one flat probe covers find and insert */
+    void **slot = flathash64Entry( &r->subindex, ( ( uint64_t )retAddr << 32 ) | to );
+    MEMCHECKV( slot );
+    s = ( struct subcall * )*slot;
 
     if ( !s )
     {
         /* This call entry doesn't exist (i.e. it's the first time this from/to pair have been seen...let's create it */
-        s = ( struct subcall * )calloc( 1, sizeof( struct subcall ) );
+        s = ( struct subcall * )_arenaAlloc( sizeof( struct subcall ) );
         MEMCHECKV( s );
         memcpy( &s->sig, &r->substack[r->substacklen].sig, sizeof( struct subcallSig ) );
+        *slot = s;
+
+        /* The chained table only exists so the dot and profile writers can walk the records */
         HASH_ADD( hh, r->subhead, sig, sizeof( struct subcallSig ), s );
     }
 
@@ -236,11 +594,12 @@ static void _returnEvent( struct RunTime *r, uint32_t to )
         }
 
         DBG_OUT( " DEC:%3d %08x " EOL, r->substacklen + 1, r->substack[r->substacklen].sig.src );
-        HASH_FIND( hh, r->subhead, &r->substack[r->substacklen].sig, sizeof( struct subcallSig ), s );
+        s = ( struct subcall * )flathash64Find( &r->subindex,
+                                               ( ( uint64_t )r->substack[r->substacklen].sig.src << 32 ) | r->substack[r->substacklen].sig.dst );
         assert( s );
 
         /* We don't bother deallocating memory here cos it'll be done the next time we make a call */
-        s->myCost += cpu->instCount - r->substack[r->substacklen].inTicks;
+        s->myCost += _costNow( cpu ) - r->substack[r->substacklen].inTicks;
         s->count++;
     }
     while ( to != r->substack[r->substacklen].sig.src );
@@ -255,46 +614,456 @@ static void _returnEvent( struct RunTime *r, uint32_t to )
 
         DBG_OUT( "(wanted %08x, got %08x)" EOL, to, r->substack[r->substacklen].sig.src );
     }
-}
-// ====================================================================================================
-static void _hashFindOrCreate( struct RunTime *r, uint32_t addr, struct execEntryHash **h )
-{
-    struct nameEntry n;
+}
+// ====================================================================================================
+static void _hashFindOrCreate( struct RunTime *r, uint32_t addr, struct execEntryHash **h )
+{
+    struct nameEntry n;
+
+    /* Try the direct page index first; on the per-instruction path this is the common case
+     * and costs two dereferences rather than a hash of the address */
+    uint32_t hw = addr >> 1;
+    struct execEntryHash **page = r->instDir[hw >> INST_PAGE_BITS];
+    struct execEntryHash *e = page ? page[hw & ( INST_PAGE_LEN - 1 )] : NULL;
+
+    if ( ( e ) && ( e->addr == addr ) )
+    {
+        *h = e;
+        return;
+    }
+
+    HASH_FIND_INT( r->insthead, &addr, *h );
+
+    if ( !( *h ) )
+    {
+        /* We don't have this address captured yet, do it now */
+        if ( SymbolLookup( r->s, r->op.workingAddr, &n ) )
+        {
+            if ( n.assyLine == ASSY_NOT_FOUND )
+            {
+                genericsExit( -1, "No assembly for function at address %08x, %s" EOL, r->op.workingAddr, SymbolFunction( r->s, n.functionindex ) );
+            }
+
+            *h = _arenaAlloc( sizeof( struct execEntryHash ) );
+            MEMCHECKV( *h );
+
+            ( *h )->addr          = r->op.workingAddr;
+            ( *h )->fileindex     = n.fileindex;
+            ( *h )->line          = n.line;
+            ( *h )->functionindex = n.functionindex;
+            ( *h )->isJump        = n.assy[n.assyLine].isJump;
+            ( *h )->isSubCall     = n.assy[n.assyLine].isSubCall;
+            ( *h )->isReturn      = n.assy[n.assyLine].isReturn;
+            ( *h )->jumpdest      = n.assy[n.assyLine].jumpdest;
+            ( *h )->is4Byte       = n.assy[n.assyLine].is4Byte;
+            ( *h )->codes         = n.assy[n.assyLine].codes;
+            ( *h )->assyText      = n.assy[n.assyLine].lineText;
+        }
+        else
+        {
+            genericsExit( -1, "No symbol for address %08x" EOL, r->op.workingAddr );
+        }
+
+        HASH_ADD_INT( r->insthead, addr, ( *h ) );
+    }
+
+    /* Index the entry so the next visit to this address is a direct lookup */
+    if ( !page )
+    {
+        page = ( struct execEntryHash ** )calloc( INST_PAGE_LEN, sizeof( struct execEntryHash * ) );
+        MEMCHECKV( page );
+        r->instDir[hw >> INST_PAGE_BITS] = page;
+    }
+
+    if ( !page[hw & ( INST_PAGE_LEN - 1 )] )
+    {
+        page[hw & ( INST_PAGE_LEN - 1 )] = *h;
+    }
+}
+// ====================================================================================================
+// Microarchitectural simulation. Reconstructed fetch runs and branch outcomes go over a lock-free
+// ring to a worker driving an i-cache model and a branch predictor, so the decode path pays one
+// ring write per basic block. Estimated misses are tallied per address and folded into the exec
+// entries ahead of each report, surfacing in the callgrind output as cachegrind events. Only the
+// instruction side can be modelled; the trace carries no data addresses, so there is no d-cache.
+// ====================================================================================================
+
+#define SIM_INVALID_TAG (0xffffffff)
+
+static bool _simParseSpec( struct Options *o )
+
+/* Turn a -j argument (preset name, or kb,ways,linebytes,btbbits) into model geometry */
+
+{
+    if ( !strcasecmp( o->simulate, "cortex-m7" ) )
+    {
+        /* 16K two-way icache with 32 byte lines, and a modest dynamic predictor */
+        o->simCacheKb = 16;
+        o->simWays = 2;
+        o->simLineBytes = 32;
+        o->simBtbBits = 9;
+        return true;
+    }
+
+    if ( !strcasecmp( o->simulate, "cortex-m33" ) )
+    {
+        /* No cache, and static backward-taken branch prediction */
+        o->simCacheKb = 0;
+        o->simWays = 0;
+        o->simLineBytes = 32;
+        o->simBtbBits = 0;
+        return true;
+    }
+
+    if ( 4 != sscanf( o->simulate, "%u,%u,%u,%u", &o->simCacheKb, &o->simWays, &o->simLineBytes, &o->simBtbBits ) )
+    {
+        return false;
+    }
+
+    if ( o->simBtbBits > 20 )
+    {
+        return false;
+    }
+
+    if ( !o->simCacheKb )
+    {
+        return true;
+    }
+
+    if ( ( !o->simWays ) || ( o->simLineBytes < 4 ) || ( o->simLineBytes & ( o->simLineBytes - 1 ) ) )
+    {
+        return false;
+    }
+
+    /* The set count the geometry implies has to come out whole and power-of-two */
+    uint32_t sets = o->simCacheKb * 1024 / ( o->simLineBytes * o->simWays );
+    return ( sets != 0 ) && ( !( sets & ( sets - 1 ) ) );
+}
+// ====================================================================================================
+static void _simPush( struct RunTime *r, uint32_t a, uint32_t b )
+
+/* Publish one event to the simulation worker, shedding (and accounting) it when the ring is full */
+
+{
+    uint64_t wp = atomic_load( &r->simWp );
+
+    if ( wp - atomic_load( &r->simRp ) >= SIM_RING_LEN )
+    {
+        r->simEventsLost++;
+        return;
+    }
+
+    r->simRing[wp % SIM_RING_LEN].a = a;
+    r->simRing[wp % SIM_RING_LEN].b = b;
+    atomic_store( &r->simWp, wp + 1 );
+}
+// ====================================================================================================
+static void _simFlushRun( struct RunTime *r )
+
+/* Emit the straight-line fetch run being accumulated, if there is one */
+
+{
+    if ( r->simRunEnd > r->simRunStart )
+    {
+        _simPush( r, r->simRunStart, r->simRunEnd );
+    }
+
+    r->simRunStart = r->simRunEnd = 0;
+}
+// ====================================================================================================
+static void _simRange( struct RunTime *r, uint32_t start, uint32_t end )
+
+/* Fold a sequentially-fetched address range into the pending run, emitting on discontinuity */
+
+{
+    if ( !r->simSets )
+    {
+        /* No cache is being modelled, so fetch runs have nobody to inform */
+        return;
+    }
+
+    if ( ( start != r->simRunEnd ) || ( end - r->simRunStart > SIM_MAX_RUN ) )
+    {
+        _simFlushRun( r );
+        r->simRunStart = start;
+    }
+
+    r->simRunEnd = end;
+}
+// ====================================================================================================
+static struct simCnt *_simCnt( struct RunTime *r, uint32_t addr )
+
+/* Per-address simulation tallies, direct-paged like the exec table (worker thread only) */
+
+{
+    uint32_t hw = addr >> 1;
+    struct simCnt **pagep = &r->simDir[hw >> INST_PAGE_BITS];
+
+    if ( !*pagep )
+    {
+        *pagep = ( struct simCnt * )calloc( INST_PAGE_LEN, sizeof( struct simCnt ) );
+        MEMCHECK( *pagep, NULL );
+    }
+
+    return &( *pagep )[hw & ( INST_PAGE_LEN - 1 )];
+}
+// ====================================================================================================
+static void _simTouchLines( struct RunTime *r, uint32_t start, uint32_t end )
+
+/* Run every cache line of [start, end) through the icache model, attributing any miss to the
+ * first instruction address which touched the line.
+ */
+
+{
+    for ( uint32_t line = start >> r->simLineBits; line <= ( end - 1 ) >> r->simLineBits; line++ )
+    {
+        r->simFetches++;
+
+        uint32_t base = ( line & ( r->simSets - 1 ) ) * r->options->simWays;
+        uint32_t victim = 0;
+        bool hit = false;
+
+        for ( uint32_t w = 0; w < r->options->simWays; w++ )
+        {
+            if ( r->simTags[base + w] == line )
+            {
+                hit = true;
+                r->simAge[base + w] = 0;
+            }
+            else
+            {
+                if ( r->simAge[base + w] < 0xff )
+                {
+                    r->simAge[base + w]++;
+                }
+
+                if ( r->simAge[base + w] > r->simAge[base + victim] )
+                {
+                    victim = w;
+                }
+            }
+        }
+
+        if ( !hit )
+        {
+            r->simMisses++;
+            r->simTags[base + victim] = line;
+            r->simAge[base + victim] = 0;
+
+            uint32_t at = line << r->simLineBits;
+
+            if ( at < start )
+            {
+                at = start;
+            }
+
+            _simCnt( r, at )->i1m++;
+        }
+    }
+}
+// ====================================================================================================
+static void _simBranchEvent( struct RunTime *r, uint32_t addr, bool taken, bool backward )
+
+/* Run one conditional branch outcome through the predictor model */
+
+{
+    bool predictTaken;
+
+    if ( r->simBimod )
+    {
+        uint8_t *ctr = &r->simBimod[( addr >> 1 ) & ( ( 1u << r->options->simBtbBits ) - 1 )];
+        predictTaken = ( *ctr >= 2 );
+
+        if ( taken )
+        {
+            if ( *ctr < 3 )
+            {
+                ( *ctr )++;
+            }
+        }
+        else if ( *ctr )
+        {
+            ( *ctr )--;
+        }
+    }
+    else
+    {
+        /* Static prediction; backward branches are loops and presumed taken */
+        predictTaken = backward;
+    }
+
+    struct simCnt *cn = _simCnt( r, addr );
+    cn->bc++;
+    r->simBc++;
+
+    if ( predictTaken != taken )
+    {
+        cn->bcm++;
+        r->simBcm++;
+    }
+}
+// ====================================================================================================
+static void *_simWorkerTask( void *params )
+
+/* Drain the event ring into the models. Work arrives in bursts, so everything published is
+ * consumed before sleeping again.
+ */
+
+{
+    struct RunTime *r = ( struct RunTime * )params;
+
+    while ( true )
+    {
+        uint64_t rp = atomic_load( &r->simRp );
+        uint64_t wp = atomic_load( &r->simWp );
+
+        if ( rp == wp )
+        {
+            if ( r->simExit )
+            {
+                break;
+            }
+
+            usleep( TICK_TIME_MS * 1000 );
+            continue;
+        }
+
+        pthread_mutex_lock( &r->simLock );
+
+        while ( rp != wp )
+        {
+            struct simEvt *e = &r->simRing[rp % SIM_RING_LEN];
+
+            if ( e->a & 1 )
+            {
+                _simBranchEvent( r, e->a & ~1u, e->b & 1, e->b & 2 );
+            }
+            else
+            {
+                _simTouchLines( r, e->a, e->b );
+            }
+
+            rp++;
+        }
+
+        atomic_store( &r->simRp, rp );
+        pthread_mutex_unlock( &r->simLock );
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+static void _simInit( struct RunTime *r )
+
+/* Size the models from the parsed geometry and get the worker going */
+
+{
+    struct Options *o = r->options;
+
+    r->simDir = ( struct simCnt ** )calloc( INST_DIR_LEN, sizeof( struct simCnt * ) );
+    MEMCHECKV( r->simDir );
+
+    if ( o->simCacheKb )
+    {
+        uint32_t lb = 0;
+
+        while ( ( 1u << lb ) < o->simLineBytes )
+        {
+            lb++;
+        }
+
+        r->simLineBits = lb;
+        r->simSets = o->simCacheKb * 1024 / ( o->simLineBytes * o->simWays );
+        r->simTags = ( uint32_t * )malloc( r->simSets * o->simWays * sizeof( uint32_t ) );
+        MEMCHECKV( r->simTags );
+        memset( r->simTags, 0xff, r->simSets * o->simWays * sizeof( uint32_t ) );
+        r->simAge = ( uint8_t * )calloc( r->simSets * o->simWays, 1 );
+        MEMCHECKV( r->simAge );
+    }
+
+    if ( o->simBtbBits )
+    {
+        r->simBimod = ( uint8_t * )calloc( 1u << o->simBtbBits, 1 );
+        MEMCHECKV( r->simBimod );
+    }
+
+    if ( pthread_mutex_init( &r->simLock, NULL ) != 0 )
+    {
+        genericsExit( -1, "Failed to establish simulation lock" EOL );
+    }
+
+    if ( pthread_create( &r->simThread, NULL, &_simWorkerTask, r ) )
+    {
+        genericsExit( -1, "Failed to create simulation thread" EOL );
+    }
+}
+// ====================================================================================================
+static void _simFold( struct RunTime *r )
+
+/* Settle the simulation tallies into the exec entries ahead of a report. The tallies are
+ * cumulative, so interim and final folds both rebuild the exec-side fields from scratch.
+ */
+
+{
+    if ( !r->options->simulate )
+    {
+        return;
+    }
+
+    _simFlushRun( r );
+
+    /* Give the worker a moment to catch up; the estimates stay valid even if it doesn't */
+    for ( int i = 0; ( i < 500 ) && ( atomic_load( &r->simRp ) != atomic_load( &r->simWp ) ); i++ )
+    {
+        usleep( 1000 );
+    }
 
-    HASH_FIND_INT( r->insthead, &addr, *h );
+    pthread_mutex_lock( &r->simLock );
 
-    if ( !( *h ) )
+    for ( struct execEntryHash *e = r->insthead; e; e = e->hh.next )
     {
-        /* We don't have this address captured yet, do it now */
-        if ( SymbolLookup( r->s, r->op.workingAddr, &n ) )
+        e->i1m = e->bc = e->bcm = 0;
+    }
+
+    for ( uint32_t p = 0; p < INST_DIR_LEN; p++ )
+    {
+        struct simCnt *page = r->simDir[p];
+
+        if ( !page )
         {
-            if ( n.assyLine == ASSY_NOT_FOUND )
+            continue;
+        }
+
+        for ( uint32_t s = 0; s < INST_PAGE_LEN; s++ )
+        {
+            struct simCnt *cn = &page[s];
+
+            if ( !( cn->i1m | cn->bc ) )
             {
-                genericsExit( -1, "No assembly for function at address %08x, %s" EOL, r->op.workingAddr, SymbolFunction( r->s, n.functionindex ) );
+                continue;
             }
 
-            *h = calloc( 1, sizeof( struct execEntryHash ) );
-            MEMCHECKV( *h );
+            uint32_t addr = ( ( p << INST_PAGE_BITS ) | s ) << 1;
+            struct execEntryHash *e = NULL;
+            HASH_FIND_INT( r->insthead, &addr, e );
 
-            ( *h )->addr          = r->op.workingAddr;
-            ( *h )->fileindex     = n.fileindex;
-            ( *h )->line          = n.line;
-            ( *h )->functionindex = n.functionindex;
-            ( *h )->isJump        = n.assy[n.assyLine].isJump;
-            ( *h )->isSubCall     = n.assy[n.assyLine].isSubCall;
-            ( *h )->isReturn      = n.assy[n.assyLine].isReturn;
-            ( *h )->jumpdest      = n.assy[n.assyLine].jumpdest;
-            ( *h )->is4Byte       = n.assy[n.assyLine].is4Byte;
-            ( *h )->codes         = n.assy[n.assyLine].codes;
-            ( *h )->assyText      = n.assy[n.assyLine].lineText;
-        }
-        else
-        {
-            genericsExit( -1, "No symbol for address %08x" EOL, r->op.workingAddr );
-        }
+            if ( !e )
+            {
+                /* A line boundary can fall in the back half of a 4 byte instruction */
+                uint32_t pa = addr - 2;
+                HASH_FIND_INT( r->insthead, &pa, e );
+            }
 
-        HASH_ADD_INT( r->insthead, addr, ( *h ) );
+            if ( e )
+            {
+                e->i1m += cn->i1m;
+                e->bc  += cn->bc;
+                e->bcm += cn->bcm;
+            }
+        }
     }
+
+    pthread_mutex_unlock( &r->simLock );
 }
 // ====================================================================================================
 static void _handleInstruction( struct RunTime *r, bool actioned )
@@ -312,13 +1081,32 @@ static void _handleInstruction( struct RunTime *r, bool actioned )
     //                               ( r->op.h->isJump ) ? "J" : " ", ( r->op.h->isSubCall ) ? "S" : r->op.h->isReturn ? "R" : " ", ( actioned ) ? ( r->op.h->is4Byte ? 'X' : 'x' ) : '-',
     //                               r->op.h->assyText );
 
-    /* OK, by hook or by crook we've got an address entry now, so increment the number of executions */
-    r->op.h->count++;
+    /* OK, by hook or by crook we've got an address entry now, so increment the number of
+     * executions...unless this address is in an excluded range, in which case the flow is
+     * still followed (the decoder needs the instruction semantics) but nothing is counted.
+     */
+    if ( !_addrExcluded( r, r->op.workingAddr ) )
+    {
+        r->op.h->count++;
+
+        /* If source postion changed then update source code line visitation counts too */
+        if ( ( r->op.oldh ) && ( ( r->op.h->line != r->op.oldh->line ) || ( r->op.h->functionindex != r->op.oldh->functionindex ) ) )
+        {
+            r->op.h->scount++;
+        }
+    }
 
-    /* If source postion changed then update source code line visitation counts too */
-    if ( ( r->op.oldh ) && ( ( r->op.h->line != r->op.oldh->line ) || ( r->op.h->functionindex != r->op.oldh->functionindex ) ) )
+    if ( r->options->simulate )
     {
-        r->op.h->scount++;
+        /* Hand the fetch of this instruction, and any branch outcome, to the simulation worker */
+        _simRange( r, r->op.h->addr, r->op.h->addr + ( r->op.h->is4Byte ? 4 : 2 ) );
+
+        if ( r->op.h->isJump )
+        {
+            _simPush( r, r->op.h->addr | 1,
+                      ( actioned ? 1 : 0 ) |
+                      ( ( ( r->op.h->jumpdest ) && ( r->op.h->jumpdest < r->op.h->addr ) ) ? 2 : 0 ) );
+        }
     }
 
     /* If this is a computable destination then action it */
@@ -343,13 +1131,220 @@ static void _checkJumps( struct RunTime *r )
 
         if ( ( TRACEStateChanged( &r->i, EV_CH_EX_EXIT ) ) || ( r->op.h->isReturn ) )
         {
+            symbolMemaddr predicted;
+
+            /* An implied return is resolved from the return-stack model rather than waiting
+             * for an address element; if an explicit address already landed it wins. */
+            if ( ( r->op.h->isReturn ) && ( TRACEReturnStackPop( TRACECPUState( &r->i ), &predicted ) ) &&
+                    ( r->op.workingAddr == r->op.h->addr + ( ( r->op.h->is4Byte ) ? 4 : 2 ) ) )
+            {
+                r->op.workingAddr = predicted;
+            }
+
             _returnEvent( r, r->op.workingAddr );
         }
 
         if ( r->op.h->isSubCall )
         {
-            _callEvent( r, r->op.h->addr + ( ( r->op.h->is4Byte ) ? 4 : 2 ), r->op.workingAddr );
+            uint32_t retAddr = r->op.h->addr + ( ( r->op.h->is4Byte ) ? 4 : 2 );
+            TRACEReturnStackPush( TRACECPUState( &r->i ), retAddr );
+            _callEvent( r, retAddr, r->op.workingAddr );
+        }
+    }
+}
+// ====================================================================================================
+// Basic-block batching. A straight-line run the profiler has already walked instruction by
+// instruction is described by a block record, so later passes through the same code account
+// the whole run in one step. Tallies stay in the block until _blockFlush folds them into the
+// per-instruction entries ahead of any report, keeping the output identical either way.
+// ====================================================================================================
+static struct blockEntry *_blockFindOrCreate( struct RunTime *r, uint32_t addr )
+
+/* Fetch the block starting at addr, building it over already-seen instructions on first use */
+
+{
+    struct blockEntry *b;
+
+    HASH_FIND_INT( r->blockhead, &addr, b );
+
+    if ( b )
+    {
+        return b;
+    }
+
+    b = ( struct blockEntry * )_arenaAlloc( sizeof( struct blockEntry ) );
+    MEMCHECK( b, NULL );
+
+    b->addr = addr;
+    b->prev = r->op.h;
+
+    /* Only instructions already walked the slow way qualify; unseen code ends the run, and
+     * gets its entry (and symbol check) on its own first execution as before */
+    while ( b->nInstr < BLOCK_MAX_LEN )
+    {
+        uint32_t hw = addr >> 1;
+        struct execEntryHash **page = r->instDir[hw >> INST_PAGE_BITS];
+        struct execEntryHash *e = page ? page[hw & ( INST_PAGE_LEN - 1 )] : NULL;
+
+        if ( ( !e ) || ( e->addr != addr ) )
+        {
+            HASH_FIND_INT( r->insthead, &addr, e );
+        }
+
+        if ( ( !e ) || ( e->isJump ) || ( e->isSubCall ) || ( e->isReturn ) )
+        {
+            break;
+        }
+
+        b->member[b->nInstr++] = e;
+        addr += e->is4Byte ? 4 : 2;
+    }
+
+    b->nextAddr = addr;
+    HASH_ADD_INT( r->blockhead, addr, b );
+    return b;
+}
+// ====================================================================================================
+static void _blockFlush( struct RunTime *r )
+
+/* Expand batched block executions into the per-instruction counts */
+
+{
+    for ( struct blockEntry *b = r->blockhead; b; b = b->hh.next )
+    {
+        uint64_t runs = 0;
+
+        for ( int32_t i = b->nInstr - 1; i >= 0; i-- )
+        {
+            runs += b->entered[i];
+            b->entered[i] = 0;
+
+            if ( !runs )
+            {
+                continue;
+            }
+
+            struct execEntryHash *e = b->member[i];
+
+            if ( !_addrExcluded( r, e->addr ) )
+            {
+                e->count += runs;
+
+                struct execEntryHash *p = i ? b->member[i - 1] : b->prev;
+
+                if ( ( p ) && ( ( e->line != p->line ) || ( e->functionindex != p->functionindex ) ) )
+                {
+                    e->scount += runs;
+                }
+            }
+        }
+    }
+}
+// ====================================================================================================
+// Trace gap repair. An overflow loses an interval of execution; when the only possible path
+// through already-seen code between the last known address and the resync address is unique,
+// the gap is attributed along that path (flagged separately in the callgrind output) instead
+// of being dropped. Anything ambiguous - a second path, unseen code, a loop - is left lost.
+// ====================================================================================================
+
+#define GAP_REPAIR_MAX_PATH (512)        /* Longest path we'll consider bridging */
+#define GAP_REPAIR_MAX_WORK (4096)       /* Expansion budget for the path search */
+
+static struct execEntryHash *_gapStack[GAP_REPAIR_MAX_PATH];
+static struct execEntryHash *_gapPath[GAP_REPAIR_MAX_PATH];
+static uint32_t _gapPathLen;
+static uint32_t _gapWork;
+
+static uint32_t _gapSearch( struct RunTime *r, uint32_t addr, uint32_t target, uint32_t depth )
+
+/* Count simple paths from addr to target through instructions we have already executed,
+ * saturating at two since one is the only interesting answer. The sole path is recorded.
+ */
+
+{
+    if ( addr == target )
+    {
+        memcpy( _gapPath, _gapStack, depth * sizeof( struct execEntryHash * ) );
+        _gapPathLen = depth;
+        return 1;
+    }
+
+    if ( ( depth >= GAP_REPAIR_MAX_PATH ) || ( !_gapWork ) )
+    {
+        return 2;
+    }
+
+    _gapWork--;
+
+    /* Only code that has executed before qualifies; a gap through unseen code is ambiguous */
+    struct execEntryHash *h = NULL;
+    HASH_FIND_INT( r->insthead, &addr, h );
+
+    if ( !h )
+    {
+        return 0;
+    }
+
+    /* A loop on the path can have run any number of times, so simple paths only */
+    for ( uint32_t i = 0; i < depth; i++ )
+    {
+        if ( _gapStack[i] == h )
+        {
+            return 0;
+        }
+    }
+
+    _gapStack[depth] = h;
+
+    uint32_t found = 0;
+
+    /* A return leaves by an address we can't know statically, so it ends this line of search */
+    if ( !h->isReturn )
+    {
+        found = _gapSearch( r, h->addr + ( h->is4Byte ? 4 : 2 ), target, depth + 1 );
+
+        if ( ( found < 2 ) && ( ( h->isJump ) || ( h->isSubCall ) ) && ( h->jumpdest ) )
+        {
+            found += _gapSearch( r, h->jumpdest, target, depth + 1 );
+        }
+    }
+
+    return ( found > 2 ) ? 2 : found;
+}
+// ====================================================================================================
+static void _gapRepair( struct RunTime *r, uint32_t resyncAddr )
+
+/* Attempt to bridge an overflow gap now that trace has resynced at resyncAddr */
+
+{
+    r->op.gapPending = false;
+
+    if ( ( !r->op.gapFrom ) || ( r->op.gapFrom == resyncAddr ) )
+    {
+        return;
+    }
+
+    _gapWork = GAP_REPAIR_MAX_WORK;
+    _gapPathLen = 0;
+
+    if ( 1 == _gapSearch( r, r->op.gapFrom, resyncAddr, 0 ) )
+    {
+        /* Exactly one way to have got there; account each step, marked as interpolated */
+        for ( uint32_t i = 0; i < _gapPathLen; i++ )
+        {
+            if ( !_addrExcluded( r, _gapPath[i]->addr ) )
+            {
+                _gapPath[i]->count++;
+                _gapPath[i]->icount++;
+            }
         }
+
+        r->op.gapsRepaired++;
+        DBG_OUT( "Gap %08x..%08x repaired over %d instructions" EOL, r->op.gapFrom, resyncAddr, _gapPathLen );
+    }
+    else
+    {
+        r->op.gapsLost++;
     }
 }
 // ====================================================================================================
@@ -380,7 +1375,7 @@ static void _traceCB( void *d )
         }
 
         /* Create false entry for an interrupt source */
-        r->op.inth = calloc( 1, sizeof( struct execEntryHash ) );
+        r->op.inth = _arenaAlloc( sizeof( struct execEntryHash ) );
 
         MEMCHECKV( r->op.inth );
         r->op.inth->addr          = INTERRUPT;
@@ -393,6 +1388,15 @@ static void _traceCB( void *d )
 
     r->op.lasttstamp = cpu->instCount;
 
+    /* An overflow means an unknown stretch of execution is missing; note where we were so a
+     * repair can be attempted when the next address element arrives */
+    if ( ( TRACEStateChanged( &r->i, EV_CH_OVERFLOW ) ) ||
+            ( ( TRACEStateChanged( &r->i, EV_CH_REASON ) ) && ( cpu->reason == TRACE_REASON_TRACEOVF ) ) )
+    {
+        r->op.gapFrom = r->op.workingAddr;
+        r->op.gapPending = true;
+    }
+
     /* Pull changes introduced by this event ============================== */
 
     if ( TRACEStateChanged( &r->i, EV_CH_ENATOMS ) )
@@ -415,6 +1419,12 @@ static void _traceCB( void *d )
                     if ( TRACEStateChanged( &r->i, EV_CH_ADDRESS ) )
                     {
                         DBG_OUT( "New addr %08x" EOL, cpu->addr );
+
+                        if ( r->op.gapPending )
+                        {
+                            _gapRepair( r, cpu->addr );
+                        }
+
                         r->op.workingAddr = cpu->addr;
                     }
 
@@ -431,6 +1441,11 @@ static void _traceCB( void *d )
                 _callEvent( r, r->op.workingAddr, cpu->addr );
             }
 
+            if ( r->op.gapPending )
+            {
+                _gapRepair( r, cpu->addr );
+            }
+
             r->op.workingAddr = cpu->addr;
             DBG_OUT( "A:%08x" EOL, cpu->addr );
         }
@@ -449,6 +1464,37 @@ static void _traceCB( void *d )
             _handleInstruction( r, disposition & 1 );
             _checkJumps( r );
             disposition >>= 1;
+
+            /* After a straight-line step, a known block continuing from here is taken in one go.
+             * Straight-line members carry no branch semantics, so their disposition bits only
+             * need consuming, not consulting. */
+            if ( ( incAddr > 1 ) && ( r->op.h ) &&
+                    ( !r->op.h->isJump ) && ( !r->op.h->isSubCall ) && ( !r->op.h->isReturn ) )
+            {
+                struct blockEntry *b = _blockFindOrCreate( r, r->op.workingAddr );
+                uint32_t j = ( incAddr - 1 < b->nInstr ) ? incAddr - 1 : b->nInstr;
+
+                /* Shifting disposition by its full width would be undefined; cap the bite */
+                if ( j > 31 )
+                {
+                    j = 31;
+                }
+
+                if ( j )
+                {
+                    b->entered[j - 1]++;
+                    incAddr -= j;
+                    disposition >>= j;
+                    r->op.workingAddr = ( j == b->nInstr ) ? b->nextAddr : b->member[j]->addr;
+                    r->op.h = b->member[j - 1];
+
+                    if ( r->options->simulate )
+                    {
+                        /* The fetches of a batched run go to the simulation in one range */
+                        _simRange( r, b->addr, r->op.workingAddr );
+                    }
+                }
+            }
         }
     }
 }
@@ -466,15 +1512,20 @@ static void _printHelp( const char *const progName )
     genericsFPrintf( stderr, "    -f, --input-file:   Take input from specified file" EOL );
     genericsFPrintf( stderr, "    -h, --help:         This help" EOL );
     genericsFPrintf( stderr, "    -I, --interval:     <Interval> Time between samples (in ms)" EOL );
+    genericsFPrintf( stderr, "    -j, --sim:          <preset|kb,ways,linebytes,btbbits> simulate icache/branch predictor" EOL );
+    genericsFPrintf( stderr, "                        (presets: cortex-m7, cortex-m33)" EOL );
     genericsFPrintf( stderr, "    -M, --no-colour:    Supress colour in output" EOL );
     genericsFPrintf( stderr, "    -O, --objdump-opts: <options> Options to pass directly to objdump" EOL );
     genericsFPrintf( stderr, "    -P, --trace-proto:  {ETM35|MTB} trace protocol to use, default is ETM35" EOL );
     genericsFPrintf( stderr, "    -p, --protocol:     Protocol to communicate. Defaults to OFLOW if -s is not set, otherwise raw ETM" EOL );
     genericsFPrintf( stderr, "    -s, --server:       <Server>:<Port> to use" EOL );
     genericsFPrintf( stderr, "    -t, --tag:          <stream>: Which OFLOW tag to use (normally 2)" EOL );
+    genericsFPrintf( stderr, "    -u, --profile-db:   <Filename> accumulating profile database to merge this run into" EOL );
     genericsFPrintf( stderr, "    -T, --all-truncate: truncate -d material off all references (i.e. make output relative)" EOL );
     genericsFPrintf( stderr, "    -v, --verbose:      <level> Verbose mode 0(errors)..3(debug)" EOL );
     genericsFPrintf( stderr, "    -V, --version:      Print version and exit" EOL );
+    genericsFPrintf( stderr, "    -w, --checkpoint:   <Interval> Seconds between interim profile writes (0=only at end)" EOL );
+    genericsFPrintf( stderr, "    -x, --exclude:      <Function>[,<Function>] to exclude from the profile" EOL );
     genericsFPrintf( stderr, "    -y, --graph-file:   <Filename> dotty filename for structured callgraph output" EOL );
     genericsFPrintf( stderr, "    -z, --cache-file:   <Filename> profile filename for kcachegrind output" EOL );
     genericsFPrintf( stderr, EOL "(Will connect one port higher than that set in -s when Orbflow is not used)" EOL );
@@ -496,6 +1547,7 @@ static struct option _longOptions[] =
     {"input-file", required_argument, NULL, 'f'},
     {"help", no_argument, NULL, 'h'},
     {"interval", required_argument, NULL, 'I'},
+    {"sim", required_argument, NULL, 'j'},
     {"no-colour", no_argument, NULL, 'M'},
     {"no-color", no_argument, NULL, 'M'},
     {"objdump-opts", required_argument, NULL, 'O'},
@@ -504,8 +1556,11 @@ static struct option _longOptions[] =
     {"server", required_argument, NULL, 's'},
     {"all-truncate", no_argument, NULL, 'T'},
     {"tag", required_argument, NULL, 't'},
+    {"profile-db", required_argument, NULL, 'u'},
     {"verbose", required_argument, NULL, 'v'},
     {"version", no_argument, NULL, 'V'},
+    {"checkpoint", required_argument, NULL, 'w'},
+    {"exclude", required_argument, NULL, 'x'},
     {"graph-file", required_argument, NULL, 'y'},
     {"cache-file", required_argument, NULL, 'z'},
     {NULL, no_argument, NULL, 0}
@@ -518,7 +1573,7 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
     bool protExplicit = false;
     bool serverExplicit = false;
 
-    while ( ( c = getopt_long ( argc, argv, "ADd:e:Ef:hVI:MO:P:p:s:t:Tv:y:z:", _longOptions, &optionIndex ) ) != -1 )
+    while ( ( c = getopt_long ( argc, argv, "ADd:e:Ef:hVI:j:MO:P:p:s:t:Tu:v:w:x:y:z:", _longOptions, &optionIndex ) ) != -1 )
 
         switch ( c )
         {
@@ -557,6 +1612,11 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
                 _printHelp( r->progName );
                 exit( 0 );
 
+            // ------------------------------------
+            case 'j':
+                r->options->simulate = optarg;
+                break;
+
             // ------------------------------------
 
             case 'M':
@@ -650,6 +1710,11 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
                 r->options->truncateDeleteMaterial = true;
                 break;
 
+            // ------------------------------------
+            case 'u':
+                r->options->profileDb = optarg;
+                break;
+
             // ------------------------------------
             case 'v':
                 if ( !isdigit( *optarg ) )
@@ -661,6 +1726,16 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
                 genericsSetReportLevel( atoi( optarg ) );
                 break;
 
+            // ------------------------------------
+            case 'w':
+                r->options->writeInterval = atoi( optarg ) * 1000;
+                break;
+
+            // ------------------------------------
+            case 'x':
+                r->options->exclude = optarg;
+                break;
+
             // ------------------------------------
             case 'y':
                 r->options->dotfile = optarg;
@@ -712,6 +1787,11 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
         genericsExit( V_ERROR, "Unrecognised decode protocol" EOL );
     }
 
+    if ( ( r->options->simulate ) && ( !_simParseSpec( r->options ) ) )
+    {
+        genericsExit( -2, "Simulation spec must be cortex-m7, cortex-m33 or kb,ways,linebytes,btbbits with power-of-two geometry" EOL );
+    }
+
 
     genericsReport( V_INFO, "orbprofile version " GIT_DESCRIBE EOL );
     genericsReport( V_INFO, "Server          : %s:%d" EOL, r->options->server, r->options->port );
@@ -721,8 +1801,16 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
     genericsReport( V_INFO, "Protocol        : %s" EOL, TRACEDecodeGetProtocolName( r->options->tProtocol ) );
     genericsReport( V_INFO, "Orbflow Tag     : %d" EOL, r->options->tag );
     genericsReport( V_INFO, "DOT file        : %s" EOL, r->options->dotfile ? r->options->dotfile : "None" );
+    genericsReport( V_INFO, "Exclusions      : %s" EOL, r->options->exclude ? r->options->exclude : "None" );
     genericsReport( V_INFO, "Sample Duration : %d mS" EOL, r->options->sampleDuration );
 
+    if ( r->options->simulate )
+    {
+        genericsReport( V_INFO, "Simulation      : %uKb/%u-way/%uB-line icache, %s predictor" EOL,
+                        r->options->simCacheKb, r->options->simWays, r->options->simLineBytes,
+                        r->options->simBtbBits ? "bimodal" : "static" );
+    }
+
     switch ( r->options->protocol )
     {
         case PROT_OFLOW:
@@ -750,6 +1838,8 @@ static void _doExit( void )
     /* Give them a bit of time, then we're leaving anyway */
     usleep( 200 );
 
+    /* All of the records created during the run go back in one go */
+    _arenaFree();
 }
 // ====================================================================================================
 static void _intHandler( int sig )
@@ -773,6 +1863,14 @@ static void _OFLOWpacketRxed ( struct OFLOWFrame *p, void *param )
     {
         if ( p->tag == _r.options->tag )
         {
+            /* Keep the wall anchors for the run; tstamp is reception time, not decode time */
+            if ( !_r.firstArrival )
+            {
+                _r.firstArrival = p->tstamp;
+            }
+
+            _r.lastArrival = p->tstamp;
+
             TRACEDecoderPump( &_r.i, p->d, p->len, _traceCB, &_r );
         }
     }
@@ -788,21 +1886,33 @@ static void *_processBlocks( void *params )
 
     while ( true )
     {
-        pthread_cond_wait( &r->dataForClients, &r->dataForClients_m );
+        pthread_mutex_lock( &r->dataForClients_m );
+
+        while ( atomic_load( &r->rp ) == atomic_load( &r->wp ) )
+        {
+            pthread_cond_wait( &r->dataForClients, &r->dataForClients_m );
+        }
 
-        if ( r->rp != ( volatile int )r->wp )
+        pthread_mutex_unlock( &r->dataForClients_m );
+
+        /* Drain everything that has been published before sleeping again */
+        uint64_t rp = atomic_load( &r->rp );
+
+        while ( rp != atomic_load( &r->wp ) )
         {
-            genericsReport( V_DEBUG, "RXED Packet of %d bytes" EOL, r->rawBlock[r->rp].fillLevel );
+            struct dataBlock *b = &r->rawBlock[rp % NUM_RAW_BLOCKS];
+
+            genericsReport( V_DEBUG, "RXED Packet of %d bytes" EOL, b->fillLevel );
 
             /* Check to see if we've finished (a zero length packet */
-            if ( !r->rawBlock[r->rp].fillLevel )
+            if ( !b->fillLevel )
             {
-                break;
+                return NULL;
             }
 
 #ifdef DUMP_BLOCK
-            uint8_t *c = r->rawBlock[r->rp].buffer;
-            uint32_t y = r->rawBlock[r->rp].fillLevel;
+            uint8_t *c = b->buffer;
+            uint32_t y = b->fillLevel;
 
             DBG_OUT( EOL );
 
@@ -820,15 +1930,46 @@ static void *_processBlocks( void *params )
 
             if ( PROT_OFLOW == r->options->protocol )
             {
-                OFLOWPump( &_r.c, r->rawBlock[r->rp].buffer, r->rawBlock[r->rp].fillLevel, _OFLOWpacketRxed, &_r );
+                /* Frames are stamped with when their block was received; during an ETM burst
+                 * this decoder can run a whole ring behind, and decode-time stamps would
+                 * drift by the depth of that backlog. */
+                OFLOWSetArrivalTime( &_r.c, b->tstamp );
+                OFLOWPump( &_r.c, b->buffer, b->fillLevel, _OFLOWpacketRxed, &_r );
             }
             else
             {
                 /* Pump all of the data through the protocol handler */
-                TRACEDecoderPump( &r->i, r->rawBlock[r->rp].buffer, r->rawBlock[r->rp].fillLevel, _traceCB, &_r );
+                TRACEDecoderPump( &r->i, b->buffer, b->fillLevel, _traceCB, &_r );
             }
 
-            r->rp = ( r->rp + 1 ) % NUM_RAW_BLOCKS;
+            /* Retire the block; the reader can reuse it from here on */
+            atomic_store( &r->rp, ++rp );
+
+            /* If interim profile writes were asked for then do one when the interval is up.
+             * This thread owns the hashes, so writing here can't race the decoder. */
+            if ( ( r->options->writeInterval ) && ( r->options->profile ) && ( r->sampling ) )
+            {
+                uint64_t tnow = genericsTimestampmS();
+
+                if ( tnow - r->lastCheckpoint >= ( uint64_t )r->options->writeInterval )
+                {
+                    _blockFlush( r );
+                    _simFold( r );
+
+                    if ( ext_ff_outputProfile( r->options->profile, r->options->elffile,
+                                               r->options->truncateDeleteMaterial ? r->options->deleteMaterial : NULL,
+                                               true,
+                                               r->op.lasttstamp - r->op.firsttstamp,
+                                               r->insthead,
+                                               r->subhead,
+                                               r->s ) )
+                    {
+                        genericsReport( V_INFO, "Checkpointed profile" EOL );
+                    }
+
+                    r->lastCheckpoint = tnow;
+                }
+            }
         }
     }
 
@@ -838,8 +1979,12 @@ static void *_processBlocks( void *params )
 int main( int argc, char *argv[] )
 
 {
+    selfprofInit( "orbprofile" );
+
     struct timeval tv;
+    struct timespec tnow;
     struct Stream *stream = NULL;
+    struct dataBlock spill;                     /* Receive target while the ring is full, so reads never stall */
     enum symbolErr r;
 
     DBG_OUT( "This utility is in development. Use at your own risk!!" EOL );
@@ -848,6 +1993,10 @@ int main( int argc, char *argv[] )
     _r.progName = genericsBasename( argv[0] );
     _r.options = &_options;
 
+    /* Page directory for direct instruction lookup...virtual space only until pages are touched */
+    _r.instDir = ( struct execEntryHash *** )calloc( INST_DIR_LEN, sizeof( struct execEntryHash ** ) );
+    MEMCHECK( _r.instDir, -1 );
+
     if ( pthread_mutex_init( &_r.dataForClients_m, NULL ) != 0 )
     {
         genericsExit( -1, "Failed to establish mutex for condition variablee" EOL );
@@ -888,6 +2037,11 @@ int main( int argc, char *argv[] )
     TRACEDecoderInit( &_r.i, _r.options->tProtocol, !_r.options->noaltAddr, genericsReport );
     OFLOWInit( &_r.c );
 
+    if ( _r.options->simulate )
+    {
+        _simInit( &_r );
+    }
+
     while ( !_r.ending )
     {
         if ( _r.options->file != NULL )
@@ -935,6 +2089,14 @@ int main( int argc, char *argv[] )
             }
 
             genericsReport( V_WARN, "Loaded %s" EOL, _r.options->elffile );
+
+            /* Compile the exclusion list against the fresh symbol set */
+            free( _r.exc );
+            _r.exc = NULL;
+            _r.excCount = 0;
+            _r.excMru = 0;
+            memset( _r.excBloom, 0, sizeof( _r.excBloom ) );
+            _buildExclusions( &_r );
         }
 
         _r.intervalBytes = 0;
@@ -953,7 +2115,13 @@ int main( int argc, char *argv[] )
             tv.tv_usec  = TICK_TIME_MS * 1000;
 
 
-            struct dataBlock *rxBlock = &_r.rawBlock[_r.wp];
+            uint64_t wp = atomic_load( &_r.wp );
+            bool full = ( wp - atomic_load( &_r.rp ) >= NUM_RAW_BLOCKS );
+
+            /* If the decoder has fallen a whole ring behind then receive into the spill block
+             * and shed the result; reception itself must never stall on the decoder.
+             */
+            struct dataBlock *rxBlock = full ? &spill : &_r.rawBlock[wp % NUM_RAW_BLOCKS];
 
             enum ReceiveResult result = stream->receive( stream, rxBlock->buffer, TRANSFER_SIZE, &tv, ( size_t * )&rxBlock->fillLevel );
 
@@ -971,32 +2139,43 @@ int main( int argc, char *argv[] )
             /* ...record the fact that we received some data */
             _r.intervalBytes += rxBlock->fillLevel;
 
-            int nwp = ( _r.wp + 1 ) % NUM_RAW_BLOCKS;
+            clock_gettime( CLOCK_REALTIME, &tnow );
+            rxBlock->tstamp = tnow.tv_sec * OFLOW_TS_RESOLUTION + tnow.tv_nsec;
 
-            if ( nwp == ( volatile int )_r.rp )
+            if ( full )
             {
-                genericsExit( -1, "Overflow" EOL );
+                _r.droppedBlocks++;
             }
+            else
+            {
+                atomic_store( &_r.wp, wp + 1 );
 
-            _r.wp = nwp;
-            pthread_cond_signal( &_r.dataForClients );
+                pthread_mutex_lock( &_r.dataForClients_m );
+                pthread_cond_signal( &_r.dataForClients );
+                pthread_mutex_unlock( &_r.dataForClients_m );
+            }
 
             /* Update the intervals */
             if ( ( ( volatile bool ) _r.sampling ) && ( ( genericsTimestampmS() - ( volatile uint32_t )_r.starttime ) > _r.options->sampleDuration ) )
             {
                 _r.ending = true;
 
-                /* Post an empty data packet to flag to packet processor that it's done */
-                int nwp = ( _r.wp + 1 ) % NUM_RAW_BLOCKS;
+                /* Post an empty data packet to flag to packet processor that it's done. If the
+                 * ring is momentarily full then wait for room; the decoder is draining it.
+                 */
+                wp = atomic_load( &_r.wp );
 
-                if ( nwp == ( volatile int )_r.rp )
+                while ( wp - atomic_load( &_r.rp ) >= NUM_RAW_BLOCKS )
                 {
-                    genericsExit( -1, "Overflow" EOL );
+                    usleep( 1000 );
                 }
 
-                _r.rawBlock[_r.wp].fillLevel = 0;
-                _r.wp = nwp;
+                _r.rawBlock[wp % NUM_RAW_BLOCKS].fillLevel = 0;
+                atomic_store( &_r.wp, wp + 1 );
+
+                pthread_mutex_lock( &_r.dataForClients_m );
                 pthread_cond_signal( &_r.dataForClients );
+                pthread_mutex_unlock( &_r.dataForClients_m );
             }
         }
 
@@ -1007,13 +2186,63 @@ int main( int argc, char *argv[] )
     /* Wait for data processing to be completed */
     pthread_join( _r.processThread, NULL );
 
+    /* Settle any batched block tallies into the per-instruction counts before reporting */
+    _blockFlush( &_r );
+
+    if ( _r.options->simulate )
+    {
+        /* Collect the simulation worker once its ring is dry, then settle its estimates */
+        _simFlushRun( &_r );
+        _r.simExit = true;
+        pthread_join( _r.simThread, NULL );
+        _simFold( &_r );
+    }
+
     /* Data are collected, now process and report */
     genericsReport( V_INFO, "Received %d raw sample bytes, %ld function changes, %ld distinct addresses" EOL,
                     _r.intervalBytes, HASH_COUNT( _r.subhead ), HASH_COUNT( _r.insthead ) );
 
+    if ( _r.droppedBlocks )
+    {
+        genericsReport( V_WARN, "%lu blocks were shed because the decoder fell behind" EOL, ( unsigned long )_r.droppedBlocks );
+    }
+
+    if ( _r.lastArrival > _r.firstArrival )
+    {
+        uint64_t span = _r.lastArrival - _r.firstArrival;
+        genericsReport( V_INFO, "Trace spanned %" PRIu64 ".%03" PRIu64 "s of wall time" EOL,
+                        span / OFLOW_TS_RESOLUTION, ( span % OFLOW_TS_RESOLUTION ) / 1000000 );
+    }
+
+    if ( ( _r.op.gapsRepaired ) || ( _r.op.gapsLost ) )
+    {
+        genericsReport( V_INFO, "%lu overflow gaps repaired by interpolation, %lu unrepairable" EOL,
+                        ( unsigned long )_r.op.gapsRepaired, ( unsigned long )_r.op.gapsLost );
+    }
+
+    if ( _r.options->simulate )
+    {
+        if ( _r.simFetches )
+        {
+            genericsReport( V_INFO, "Simulated %" PRIu64 " line fetches, %" PRIu64 " missed (%" PRIu64 "%%)" EOL,
+                            _r.simFetches, _r.simMisses, ( _r.simMisses * 100 ) / _r.simFetches );
+        }
+
+        if ( _r.simBc )
+        {
+            genericsReport( V_INFO, "Simulated %" PRIu64 " conditional branches, %" PRIu64 " mispredicted (%" PRIu64 "%%)" EOL,
+                            _r.simBc, _r.simBcm, ( _r.simBcm * 100 ) / _r.simBc );
+        }
+
+        if ( _r.simEventsLost )
+        {
+            genericsReport( V_WARN, "%" PRIu64 " simulation events were shed, estimates are partial" EOL, _r.simEventsLost );
+        }
+    }
+
     if ( HASH_COUNT( _r.subhead ) )
     {
-        if ( ext_ff_outputDot( _r.options->dotfile, _r.subhead, _r.s ) )
+        if ( ext_ff_outputDot( _r.options->dotfile, _r.subhead, _r.s, 0 ) )
         {
             genericsReport( V_INFO, "Output DOT" EOL );
         }
@@ -1042,6 +2271,18 @@ int main( int argc, char *argv[] )
                 genericsExit( -1, "Failed to output profile" EOL );
             }
         }
+
+        if ( _r.options->profileDb )
+        {
+            uint64_t buildId = ext_ff_profileDbBuildId( _r.options->elffile );
+
+            if ( ( !buildId ) || ( !ext_ff_profileDbMerge( _r.options->profileDb, buildId, _r.insthead, _r.s ) ) )
+            {
+                genericsExit( -1, "Failed to merge into profile database" EOL );
+            }
+
+            genericsReport( V_INFO, "Merged run into %s under build %016" PRIx64 EOL, _r.options->profileDb, buildId );
+        }
     }
 
     return OK;
@@ -14,8 +14,10 @@
 #include <signal.h>
 #include <assert.h>
 #include <getopt.h>
+#include <inttypes.h>
 
 #include "git_version_info.h"
+#include "selfprof.h"
 #include "uthash.h"
 #include "generics.h"
 #include "itmDecoder.h"
@@ -28,10 +30,15 @@
 
 #define TICK_TIME_MS        (1)          /* Time intervals for checks */
 #define DEFAULT_DURATION_MS (1000)       /* Default time to sample, in mS */
+#define COLUMN_CHECKPOINT_MS (1000)      /* Interval between columnar statistics checkpoints */
 
 #define DEFAULT_TRACE_CHANNEL  30        /* ITM Channel that we expect trace data to arrive on */
 #define DEFAULT_FILE_CHANNEL   29        /* ITM Channel that we expect file data to arrive on */
 
+#define DWT_NUM_EVENTS       (6)         /* CPI, Exc, Sleep, LSU, Fold and Cyc event flags */
+#define DWT_WINDOW_MS        (1000)      /* Width of one counter aggregation window */
+#define DWT_HISTORY_WINDOWS  (64)        /* Completed windows retained for quantile estimation */
+
 /* Interface to/from target */
 #define COMMS_MASK (0xF0000000)
 #define IN_EVENT   (0x40000000)
@@ -43,6 +50,40 @@ const char *protString[] = {"OFLOW", "ITM", NULL};
 /* States for sample reception state machine */
 enum CDState { CD_waitinout, CD_waitsrc, CD_waitdst };
 
+#define MAX_EXCEPTION_DEPTH 32           /* Deepest exception preemption nesting we track */
+#define THREAD_CONTEXT      0            /* Context number representing thread mode */
+
+/* Per-context (thread mode or exception handler) execution state. Each context owns its  */
+/* own shadow call stack so calls and costs are attributed to whoever was actually        */
+/* running, even across preemption.                                                       */
+struct stackContext
+{
+    uint32_t exceptionNumber;            /* Key; THREAD_CONTEXT for thread mode */
+    uint64_t entries;                    /* Number of times this context became active */
+    uint64_t samples;                    /* PC samples landing while this context was active */
+    uint64_t inTicks;                    /* Tick count when this context last became active */
+    uint64_t ticks;                      /* Total ticks accumulated while active */
+
+    struct subcall **substack;           /* Shadow call stack for this context */
+    uint32_t substacklen;                /* Current depth of the shadow stack */
+    uint32_t substackcap;                /* Allocated depth of the shadow stack */
+
+    UT_hash_handle hh;                   /* Hash handle, keyed by exceptionNumber */
+};
+
+/* Windowed aggregation of DWT counter overflow events. Each event flag signals a wrap of  */
+/* its 8-bit counter on the target (or a POSTCNT tap for Cyc), so per-window counts are    */
+/* direct microarchitectural rates without any decode cost beyond a few increments.        */
+struct dwtStats
+{
+    uint32_t count[DWT_NUM_EVENTS];      /* Events inside the currently open window */
+    uint32_t hist[DWT_HISTORY_WINDOWS][DWT_NUM_EVENTS]; /* Ring of completed windows */
+    uint32_t head;                       /* Next ring slot to be filled */
+    uint32_t windows;                    /* Total number of completed windows */
+    uint64_t total[DWT_NUM_EVENTS];      /* Lifetime event totals */
+    uint32_t windowStartmS;              /* Host time the current window opened */
+};
+
 /* ---------- CONFIGURATION ----------------- */
 struct Options                           /* Record for options, either defaults or from command line */
 {
@@ -59,8 +100,11 @@ struct Options                           /* Record for options, either defaults
     int traceChannel;                    /* ITM Channel used for trace */
     int fileChannel;                     /* ITM Channel used for file output */
 
+    char *dwtstatfile;                   /* File to stream windowed DWT counter statistics into */
     char *dotfile;                       /* File to output dot information */
+    uint32_t dotCut;                     /* Drop dot edges below this percentage of the hottest */
     char *profile;                       /* File to output profile information */
+    char *columnfile;                    /* File to output columnar statistics */
     uint32_t sampleDuration;             /* How long we are going to sample for */
     bool forceITMSync;                   /* Do we assume ITM starts synced? */
     bool mono;                           /* Supress colour in output */
@@ -107,8 +151,19 @@ struct RunTime
     struct edge *calls;                 /* Call data table */
 
     struct subcall *subhead;            /* Calls onstruct data */
-    struct subcall **substack;          /* Calls stack data */
-    uint32_t substacklen;               /* Calls stack length */
+
+    /* Context attribution */
+    struct stackContext *ctxhead;       /* Pool of contexts seen so far */
+    struct stackContext *activeCtx;     /* Context currently executing */
+    struct stackContext *ctxStack[MAX_EXCEPTION_DEPTH]; /* Contexts preempted by exceptions */
+    uint32_t ctxStackLen;               /* Current preemption nesting depth */
+    bool ctxOverflowed;                 /* Nesting went deeper than we can track */
+
+    struct colWriter col;               /* Columnar statistics output, if requested */
+    uint32_t lastCheckpointmS;          /* When the last columnar checkpoint was taken */
+
+    struct dwtStats dwt;                /* Windowed DWT counter aggregation */
+    FILE *dwtFile;                      /* Where the completed windows stream to */
 
     struct execEntryHash *insthead;     /* Exec table handle for hash */
 
@@ -140,6 +195,341 @@ struct RunTime
 // ====================================================================================================
 
 
+// ====================================================================================================
+// Context tracking across exception preemption
+// ====================================================================================================
+static struct stackContext *_contextGet( struct RunTime *r, uint32_t exceptionNumber )
+
+/* Find, or create, the context record for the given exception number */
+
+{
+    struct stackContext *c;
+
+    HASH_FIND_INT( r->ctxhead, &exceptionNumber, c );
+
+    if ( !c )
+    {
+        c = ( struct stackContext * )calloc( 1, sizeof( struct stackContext ) );
+
+        if ( !c )
+        {
+            genericsExit( ENOMEM,  "Memory allocation failure at %s::%d", __FILE__, __LINE__ );
+        }
+
+        c->exceptionNumber = exceptionNumber;
+        HASH_ADD_INT( r->ctxhead, exceptionNumber, c );
+    }
+
+    return c;
+}
+// ====================================================================================================
+static void _contextActivate( struct RunTime *r, struct stackContext *c )
+
+/* Switch attribution to the given context, settling ticks for the outgoing one */
+
+{
+    if ( r->activeCtx )
+    {
+        r->activeCtx->ticks += r->tcount - r->activeCtx->inTicks;
+    }
+
+    c->inTicks = r->tcount;
+    c->entries++;
+    r->activeCtx = c;
+}
+// ====================================================================================================
+// DWT counter aggregation
+// ====================================================================================================
+static const char *_dwtEvName[DWT_NUM_EVENTS] = {"CPI", "Exc", "Sleep", "LSU", "Fold", "Cyc"};
+
+static void _dwtWindowRoll( struct RunTime *r, uint32_t nowmS )
+
+/* Close any windows which have elapsed, filing them into the history ring and streaming them
+ * out. Quiet seconds file as zero windows, so rates and quantiles stay honest across idle.
+ */
+
+{
+    struct dwtStats *d = &r->dwt;
+
+    if ( !d->windowStartmS )
+    {
+        d->windowStartmS = nowmS;
+        return;
+    }
+
+    while ( nowmS - d->windowStartmS >= DWT_WINDOW_MS )
+    {
+        if ( r->dwtFile )
+        {
+            fprintf( r->dwtFile, "%" PRIu32, d->windows );
+
+            for ( int i = 0; i < DWT_NUM_EVENTS; i++ )
+            {
+                fprintf( r->dwtFile, ",%" PRIu32, d->count[i] );
+            }
+
+            fprintf( r->dwtFile, "\n" );
+            fflush( r->dwtFile );
+        }
+
+        memcpy( d->hist[d->head], d->count, sizeof( d->count ) );
+        d->head = ( d->head + 1 ) % DWT_HISTORY_WINDOWS;
+        d->windows++;
+        memset( d->count, 0, sizeof( d->count ) );
+        d->windowStartmS += DWT_WINDOW_MS;
+    }
+}
+// ====================================================================================================
+static void _handleDWTEvent( struct RunTime *r )
+
+/* Accumulate DWT counter overflow events into the current window */
+
+{
+    struct dwtMsg *m = ( struct dwtMsg * )&r->m;
+
+    if ( !r->options->dwtstatfile )
+    {
+        return;
+    }
+
+    _dwtWindowRoll( r, genericsTimestampmS() );
+
+    for ( int i = 0; i < DWT_NUM_EVENTS; i++ )
+    {
+        if ( m->event & ( 1 << i ) )
+        {
+            r->dwt.count[i]++;
+            r->dwt.total[i]++;
+        }
+    }
+}
+// ====================================================================================================
+static int _dwt_sort_fn( const void *a, const void *b )
+
+{
+    uint32_t av = *( const uint32_t * )a;
+    uint32_t bv = *( const uint32_t * )b;
+    return ( av > bv ) - ( av < bv );
+}
+// ====================================================================================================
+static void _dwtReport( struct RunTime *r )
+
+/* Summarise the retained window history. Quantiles come from sorting the (small) ring, which
+ * is plenty cheap at this size and exact rather than estimated.
+ */
+
+{
+    struct dwtStats *d = &r->dwt;
+    uint32_t n = ( d->windows < DWT_HISTORY_WINDOWS ) ? d->windows : DWT_HISTORY_WINDOWS;
+    uint32_t sorted[DWT_HISTORY_WINDOWS];
+
+    if ( !n )
+    {
+        genericsReport( V_WARN, "No completed DWT counter windows" EOL );
+        return;
+    }
+
+    genericsReport( V_WARN, "DWT counters over the last %" PRIu32 " of %" PRIu32 " windows (events/s):" EOL, n, d->windows );
+    genericsReport( V_WARN, "  %-6s %10s %10s %10s %10s" EOL, "Event", "Total", "p50", "p90", "Max" );
+
+    for ( int i = 0; i < DWT_NUM_EVENTS; i++ )
+    {
+        for ( uint32_t w = 0; w < n; w++ )
+        {
+            sorted[w] = d->hist[w][i];
+        }
+
+        qsort( sorted, n, sizeof( uint32_t ), _dwt_sort_fn );
+        genericsReport( V_WARN, "  %-6s %10" PRIu64 " %10" PRIu32 " %10" PRIu32 " %10" PRIu32 EOL,
+                        _dwtEvName[i], d->total[i],
+                        sorted[( ( n - 1 ) * 50 ) / 100], sorted[( ( n - 1 ) * 90 ) / 100], sorted[n - 1] );
+    }
+}
+// ====================================================================================================
+static void _handleException( struct RunTime *r )
+
+/* Entry/exit/resume of an exception handler; maintain the preemption stack */
+
+{
+    struct excMsg *m = ( struct excMsg * )&r->m;
+
+    switch ( m->eventType )
+    {
+        case EXEVENT_ENTER:
+
+            /* Whoever is running now gets preempted; remember them for the return */
+            if ( r->ctxStackLen < MAX_EXCEPTION_DEPTH )
+            {
+                r->ctxStack[r->ctxStackLen++] = r->activeCtx;
+            }
+            else if ( !r->ctxOverflowed )
+            {
+                genericsReport( V_WARN, "Exception nesting deeper than %d, attribution will be inexact" EOL, MAX_EXCEPTION_DEPTH );
+                r->ctxOverflowed = true;
+            }
+
+            _contextActivate( r, _contextGet( r, m->exceptionNumber ) );
+            break;
+
+        case EXEVENT_EXIT:
+            if ( r->ctxStackLen )
+            {
+                _contextActivate( r, r->ctxStack[--r->ctxStackLen] );
+            }
+
+            break;
+
+        case EXEVENT_RESUME:
+
+            /* Return into a previously preempted context; trim the nesting to match */
+            if ( ( r->ctxStackLen ) && ( r->ctxStack[r->ctxStackLen - 1]->exceptionNumber == m->exceptionNumber ) )
+            {
+                r->ctxStackLen--;
+            }
+
+            _contextActivate( r, _contextGet( r, m->exceptionNumber ) );
+            break;
+
+        default:
+            break;
+    }
+}
+// ====================================================================================================
+static void _handlePCSample( struct RunTime *r )
+
+/* Attribute a PC sample to whichever context is currently running */
+
+{
+    struct pcSampleMsg *m = ( struct pcSampleMsg * )&r->m;
+
+    if ( !m->sleep )
+    {
+        r->activeCtx->samples++;
+    }
+}
+// ====================================================================================================
+static void _contextReport( struct RunTime *r )
+
+/* Emit the per-context attribution summary */
+
+{
+    struct stackContext *c;
+
+    /* Settle the context which was active when sampling stopped */
+    if ( r->activeCtx )
+    {
+        r->activeCtx->ticks += r->tcount - r->activeCtx->inTicks;
+        r->activeCtx->inTicks = r->tcount;
+    }
+
+    genericsReport( V_WARN, "Context        Entries      Samples        Ticks" EOL );
+
+    for ( c = r->ctxhead; c; c = c->hh.next )
+    {
+        if ( c->exceptionNumber == THREAD_CONTEXT )
+        {
+            genericsReport( V_WARN, "Thread    %12" PRIu64 " %12" PRIu64 " %12" PRIu64 EOL, c->entries, c->samples, c->ticks );
+        }
+        else
+        {
+            genericsReport( V_WARN, "Exc %-4d  %12" PRIu64 " %12" PRIu64 " %12" PRIu64 EOL, c->exceptionNumber, c->entries, c->samples, c->ticks );
+        }
+    }
+}
+// ====================================================================================================
+static void _columnCheckpoint( struct RunTime *r )
+
+/* Append a checkpoint of the current statistics to the columnar output file */
+
+{
+    struct execEntryHash *f;
+    struct stackContext *c;
+    uint64_t *v;
+    uint32_t num, n;
+    uint64_t now = genericsTimestampuS();
+
+    ext_ff_columnChunk( &r->col, COL_WALLTIME_US, &now, 1 );
+
+    /* Instruction table, one chunk per metric, all in the same iteration order */
+    num = HASH_COUNT( r->insthead );
+
+    if ( num )
+    {
+        v = ( uint64_t * )malloc( num * sizeof( uint64_t ) );
+
+        if ( !v )
+        {
+            genericsExit( ENOMEM,  "Memory allocation failure at %s::%d", __FILE__, __LINE__ );
+        }
+
+        for ( n = 0, f = r->insthead; f; f = f->hh.next )
+        {
+            v[n++] = f->addr;
+        }
+
+        ext_ff_columnChunk( &r->col, COL_ADDR, v, num );
+
+        for ( n = 0, f = r->insthead; f; f = f->hh.next )
+        {
+            v[n++] = f->count;
+        }
+
+        ext_ff_columnChunk( &r->col, COL_COUNT, v, num );
+
+        for ( n = 0, f = r->insthead; f; f = f->hh.next )
+        {
+            v[n++] = f->scount;
+        }
+
+        ext_ff_columnChunk( &r->col, COL_SCOUNT, v, num );
+        free( v );
+    }
+
+    /* Context table likewise */
+    num = HASH_COUNT( r->ctxhead );
+
+    if ( num )
+    {
+        v = ( uint64_t * )malloc( num * sizeof( uint64_t ) );
+
+        if ( !v )
+        {
+            genericsExit( ENOMEM,  "Memory allocation failure at %s::%d", __FILE__, __LINE__ );
+        }
+
+        for ( n = 0, c = r->ctxhead; c; c = c->hh.next )
+        {
+            v[n++] = c->exceptionNumber;
+        }
+
+        ext_ff_columnChunk( &r->col, COL_EXC_NUM, v, num );
+
+        for ( n = 0, c = r->ctxhead; c; c = c->hh.next )
+        {
+            v[n++] = c->entries;
+        }
+
+        ext_ff_columnChunk( &r->col, COL_EXC_ENTRIES, v, num );
+
+        for ( n = 0, c = r->ctxhead; c; c = c->hh.next )
+        {
+            v[n++] = c->samples;
+        }
+
+        ext_ff_columnChunk( &r->col, COL_EXC_SAMPLES, v, num );
+
+        for ( n = 0, c = r->ctxhead; c; c = c->hh.next )
+        {
+            v[n++] = c->ticks;
+        }
+
+        ext_ff_columnChunk( &r->col, COL_EXC_TICKS, v, num );
+        free( v );
+    }
+
+    ext_ff_columnCheckpoint( &r->col );
+    r->lastCheckpointmS = genericsTimestampmS();
+}
 // ====================================================================================================
 // Callback function for trace messages from the target CPU (via ITM channel)
 // ====================================================================================================
@@ -304,17 +694,30 @@ static void _handleSW( struct RunTime *r )
                     s->inTicks = r->tcount;
                     s->count++;
 
-                    /* ...and add it to the call stack */
-                    r->substack = ( struct subcall ** )realloc( r->substack, ( r->substacklen + 1 ) * sizeof( struct subcall * ) );
-                    r->substack[r->substacklen++] = s;
+                    /* ...and add it to the shadow stack of the running context, growing by */
+                    /* doubling so pushes stay amortised O(1)                               */
+                    struct stackContext *ctx = r->activeCtx;
+
+                    if ( ctx->substacklen == ctx->substackcap )
+                    {
+                        ctx->substackcap = ctx->substackcap ? ctx->substackcap * 2 : 64;
+                        ctx->substack = ( struct subcall ** )realloc( ctx->substack, ctx->substackcap * sizeof( struct subcall * ) );
+
+                        if ( !ctx->substack )
+                        {
+                            genericsExit( ENOMEM,  "Memory allocation failure at %s::%d", __FILE__, __LINE__ );
+                        }
+                    }
+
+                    ctx->substack[ctx->substacklen++] = s;
                 }
                 else
                 {
                     /* We've come out */
-                    if ( r->substacklen )
+                    if ( r->activeCtx->substacklen )
                     {
                         /* We don't bother deallocating memory here cos it'll be done on the next isSubCall */
-                        s = r->substack[--r->substacklen];
+                        s = r->activeCtx->substack[--r->activeCtx->substacklen];
 
                         if ( ( s->sig.src != r->from->addr ) || ( s->sig.dst != r->to->addr ) )
                         {
@@ -352,9 +755,9 @@ void _itmPumpProcess( struct RunTime *r, char c )
         /* MSG_OSW */             NULL,
         /* MSG_DATA_ACCESS_WP */  NULL,
         /* MSG_DATA_RWWP */       NULL,
-        /* MSG_PC_SAMPLE */       NULL,
-        /* MSG_DWT_EVENT */       NULL,
-        /* MSG_EXCEPTION */       NULL,
+        /* MSG_PC_SAMPLE */       ( handlers )_handlePCSample,
+        /* MSG_DWT_EVENT */       ( handlers )_handleDWTEvent,
+        /* MSG_EXCEPTION */       ( handlers )_handleException,
         /* MSG_TS */              NULL
     };
 
@@ -397,6 +800,11 @@ void _itmPumpProcess( struct RunTime *r, char c )
 
             break;
 
+        // ------------------------------------
+        case ITM_EV_BULK_RXED:
+            /* No bulk channel consumer here; spans are simply discarded */
+            break;
+
             // ------------------------------------
     }
 }
@@ -405,6 +813,7 @@ static void _printHelp( struct RunTime *r )
 
 {
     genericsFPrintf( stderr, "Usage: %s [options]" EOL, r->progName );
+    genericsFPrintf( stderr, "    -c, --column-file:  <Filename> columnar binary statistics output" EOL );
     genericsFPrintf( stderr, "    -D, --no-demangle:  Switch off C++ symbol demangling" EOL );
     genericsFPrintf( stderr, "    -d, --del-prefix:   <String> Material to delete off front of filenames" EOL );
     genericsFPrintf( stderr, "    -e, --elf-file:     <ElfFile> to use for symbols" EOL );
@@ -422,6 +831,9 @@ static void _printHelp( struct RunTime *r )
     genericsFPrintf( stderr, "    -T, --all-truncate: truncate -d material off all references (i.e. make output relative)" EOL );
     genericsFPrintf( stderr, "    -v, --verbose:      <level> Verbose mode 0(errors)..3(debug)" EOL );
     genericsFPrintf( stderr, "    -V, --version:      Print version and exit" EOL );
+    genericsFPrintf( stderr, "    -w, --dwt-stats:    <Filename> stream per-second DWT counter windows as CSV, with" EOL
+                     "                        a quantile summary at exit" EOL );
+    genericsFPrintf( stderr, "    -u, --graph-cut:    <Percent> Omit graph edges below this percentage of the hottest edge" EOL );
     genericsFPrintf( stderr, "    -y, --graph-file:   <Filename> dotty filename for structured callgraph output" EOL );
     genericsFPrintf( stderr, "    -z, --cache-file:   <Filename> profile filename for kcachegrind output" EOL );
 }
@@ -434,6 +846,7 @@ void _printVersion( void )
 // ====================================================================================================
 static struct option _longOptions[] =
 {
+    {"column-file", required_argument, NULL, 'c'},
     {"no-demangle", no_argument, NULL, 'D'},
     {"del-prefix", required_argument, NULL, 'd'},
     {"elf-file", required_argument, NULL, 'e'},
@@ -452,6 +865,8 @@ static struct option _longOptions[] =
     {"all-truncate", no_argument, NULL, 'T'},
     {"verbose", required_argument, NULL, 'v'},
     {"version", no_argument, NULL, 'V'},
+    {"dwt-stats", required_argument, NULL, 'w'},
+    {"graph-cut", required_argument, NULL, 'u'},
     {"graph-file", required_argument, NULL, 'y'},
     {"cache-file", required_argument, NULL, 'z'},
     {NULL, no_argument, NULL, 0}
@@ -465,9 +880,14 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
     bool serverExplicit = false;
     bool portExplicit = false;
 
-    while ( ( c = getopt_long ( argc, argv, "Dd:e:Ef:g:hI:nO:p:s:t:Tv:Vy:z:", _longOptions, &optionIndex ) ) != -1 )
+    while ( ( c = getopt_long ( argc, argv, "c:Dd:e:Ef:g:hI:nO:p:s:t:Tu:v:Vw:y:z:", _longOptions, &optionIndex ) ) != -1 )
         switch ( c )
         {
+            // ------------------------------------
+            case 'c':
+                r->options->columnfile = optarg;
+                break;
+
             // ------------------------------------
             case 'd':
                 r->options->deleteMaterial = optarg;
@@ -604,6 +1024,24 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
                 break;
 
             // ------------------------------------
+            case 'w':
+                r->options->dwtstatfile = optarg;
+                break;
+
+            // ------------------------------------
+            case 'u':
+                r->options->dotCut = atoi( optarg );
+
+                if ( r->options->dotCut > 100 )
+                {
+                    genericsReport( V_ERROR, "Graph cut percentage out of range" EOL );
+                    return false;
+                }
+
+                break;
+
+            // ------------------------------------
+
             case 'y':
                 r->options->dotfile = optarg;
                 break;
@@ -661,6 +1099,7 @@ static bool _processOptions( int argc, char *argv[], struct RunTime *r )
     genericsReport( V_INFO, "Delete Material : %s" EOL, r->options->deleteMaterial ? r->options->deleteMaterial : "None" );
     genericsReport( V_INFO, "Elf File        : %s %s" EOL, r->options->elffile, r->options->truncateDeleteMaterial ? "(Truncate)" : "(Don't Truncate)" );
     genericsReport( V_INFO, "DOT file        : %s" EOL, r->options->dotfile ? r->options->dotfile : "None" );
+    genericsReport( V_INFO, "Column file     : %s" EOL, r->options->columnfile ? r->options->columnfile : "None" );
     genericsReport( V_INFO, "ForceSync       : %s" EOL, r->options->forceITMSync ? "true" : "false" );
     genericsReport( V_INFO, "Sample Duration : %d mS" EOL, r->options->sampleDuration );
     genericsReport( V_INFO, "Objdump options  : %s" EOL, r->options->odoptions ? r->options->odoptions : "None" );
@@ -717,6 +1156,8 @@ static void _OFLOWpacketRxed ( struct OFLOWFrame *p, void *param )
 int main( int argc, char *argv[] )
 
 {
+    selfprofInit( "orbstat" );
+
     struct Stream *stream = NULL;
     enum symbolErr r;
     struct timeval tv;
@@ -755,6 +1196,27 @@ int main( int argc, char *argv[] )
     ITMDecoderInit( &_r.i, _r.options->forceITMSync );
     OFLOWInit( &_r.c );
 
+    /* Until an exception record says otherwise, everything is thread mode */
+    _r.activeCtx = _contextGet( &_r, THREAD_CONTEXT );
+    _r.activeCtx->entries = 1;
+
+    if ( ( _r.options->columnfile ) && ( !ext_ff_columnOpen( &_r.col, _r.options->columnfile ) ) )
+    {
+        genericsExit( -1, "Could not open columnar statistics file" EOL );
+    }
+
+    if ( _r.options->dwtstatfile )
+    {
+        _r.dwtFile = fopen( _r.options->dwtstatfile, "w" );
+
+        if ( !_r.dwtFile )
+        {
+            genericsExit( -1, "Could not open DWT statistics file" EOL );
+        }
+
+        fprintf( _r.dwtFile, "window,cpi,exc,sleep,lsu,fold,cyc\n" );
+    }
+
     while ( !_r.ending )
     {
         if ( _r.options->file != NULL )
@@ -856,6 +1318,19 @@ int main( int argc, char *argv[] )
                 genericsReport( V_WARN, "Got a TPIU sync while decoding ITM...did you miss a -t option?" EOL );
             }
 
+            /* Append a columnar checkpoint at intervals so long runs remain readable mid-flight */
+            if ( ( _r.options->columnfile ) && ( _r.sampling ) &&
+                    ( ( genericsTimestampmS() - _r.lastCheckpointmS ) >= COLUMN_CHECKPOINT_MS ) )
+            {
+                _columnCheckpoint( &_r );
+            }
+
+            /* Keep DWT windows turning over even when the counters go quiet */
+            if ( _r.options->dwtstatfile )
+            {
+                _dwtWindowRoll( &_r, genericsTimestampmS() );
+            }
+
             /* Update the intervals */
             if ( ( _r.sampling ) && ( ( genericsTimestampmS() - _r.starttime ) > _r.options->sampleDuration ) )
             {
@@ -870,9 +1345,32 @@ int main( int argc, char *argv[] )
     /* Data are collected, now process and report */
     genericsReport( V_WARN, "Received %d raw sample bytes, %ld function changes, %ld distinct addresses" EOL, _r.intervalBytes, HASH_COUNT( _r.subhead ), HASH_COUNT( _r.insthead ) );
 
+    /* If anything beyond thread mode was seen then show who actually ran */
+    if ( HASH_COUNT( _r.ctxhead ) > 1 )
+    {
+        _contextReport( &_r );
+    }
+
+    if ( _r.options->columnfile )
+    {
+        /* Take a final checkpoint, then seal the file with its directory */
+        _columnCheckpoint( &_r );
+
+        if ( ext_ff_columnClose( &_r.col ) )
+        {
+            genericsReport( V_WARN, "Output columnar statistics" EOL );
+        }
+    }
+
+    if ( _r.options->dwtstatfile )
+    {
+        _dwtReport( &_r );
+        fclose( _r.dwtFile );
+    }
+
     if ( HASH_COUNT( _r.subhead ) )
     {
-        if ( ext_ff_outputDot( _r.options->dotfile, _r.subhead, _r.s ) )
+        if ( ext_ff_outputDot( _r.options->dotfile, _r.subhead, _r.s, _r.options->dotCut ) )
         {
             genericsReport( V_WARN, "Output DOT" EOL );
         }
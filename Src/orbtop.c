@@ -16,17 +16,23 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
-#include "cJSON.h"
 #include "generics.h"
-#include "uthash.h"
+#include "flathash.h"
 #include "git_version_info.h"
+#include "selfprof.h"
 #include "itmDecoder.h"
 #include "oflow.h"
+#include "tsclock.h"
 #include "symbols.h"
 #include "msgSeq.h"
+#include "sampleComp.h"
 #include "nw.h"
 #include "stream.h"
+#include "statseg.h"
 
 #define CUTOFF              (10)             /* Default cutoff at 0.1% */
 #define TOP_UPDATE_INTERVAL (1000)           /* Interval between each on screen update */
@@ -34,7 +40,13 @@
 #define MAX_EXCEPTIONS      (512)            /* Maximum number of exceptions to be considered */
 #define NO_EXCEPTION        (0xFFFFFFFF)     /* Flag indicating no exception is being processed */
 
+#define EXC_HISTO_BUCKETS   (32)             /* Latency histogram buckets, one per power of two of ticks */
+#define EXC_HISTO_WINDOW    (8)              /* Number of report intervals the histogram window spans */
+#define EXC_TRACE_DEPTH     (16)             /* Recent entry/exit records kept per exception vector */
+
 #define MSG_REORDER_BUFLEN  (10)             /* Maximum number of samples to re-order for timekeeping */
+#define PC_BUFF_LEN         (65536)          /* Length of raw PC sample buffer ahead of aggregation, power of two */
+#define WORKER_WAIT_MS      (10)             /* Backstop interval for the aggregation worker wakeup */
 
 #define DWT_NUM_EVENTS 6
 const char *evName[DWT_NUM_EVENTS] = {"CPI", "Exc", "Slp", "LSU", "Fld", "Cyc"};
@@ -43,8 +55,25 @@ struct visitedAddr                           /* Structure for Hashmap of visited
 {
     uint64_t visits;
     struct nameEntry *n;
+};
 
-    UT_hash_handle hh;
+/* The visited-address map is sharded on address bits; code locality means an interval's samples
+ * land in few shards, so consolidation only has to walk the shards which actually took samples.
+ */
+#define NUM_ADDR_SHARDS (64)                 /* Number of map shards, power of two */
+
+/* Direct-mapped front cache over the address hash. Sample distributions are heavily
+ * skewed, so the hot addresses live in this one small L1-resident array and skip the
+ * shard probe entirely. Power of two entries.
+ */
+#define FRONT_CACHE_LEN (1024)
+#define FRONT_CACHE_IDX(a) ( ( ( a ) >> 1 ) & ( FRONT_CACHE_LEN - 1 ) )
+#define ADDR_SHARD(a)   ( ( ( a ) >> 10 ) & ( NUM_ADDR_SHARDS - 1 ) )
+
+struct addrShard                             /* One shard of the visited-address map */
+{
+    struct flatHash addresses;               /* Flat map of addresses landing in this shard */
+    bool dirty;                              /* Shard took samples since the last consolidation */
 };
 
 struct reportLine
@@ -54,9 +83,28 @@ struct reportLine
     struct nameEntry *n;
 };
 
+#define HEATMAP_MAX_SPAN (16384)             /* Give up on a function spanning more source lines than this */
+
+struct heatFunc                              /* Per-function line heat, assembled at consolidation time */
+
+{
+    struct nameEntry *n;                     /* Representative entry for name and file resolution */
+    uint32_t firstLine;                      /* Lowest source line which took samples this interval */
+    uint32_t nlines;                         /* Extent of the count array */
+    uint64_t *count;                         /* Samples per line, indexed by delta from firstLine */
+};
+
 enum Prot { PROT_OFLOW, PROT_ITM, PROT_UNKNOWN };
 const char *protString[] = {"OFLOW", "ITM", NULL};
 
+struct excTraceEntry                         /* One completed exception instance, for spike forensics */
+
+{
+    int64_t at;                              /* Timestamp the instance was entered */
+    int64_t runt;                            /* Execution time, excluding time stolen by preemptors */
+    int64_t wallt;                           /* Wall time from entry to final exit */
+};
+
 struct exceptionRecord                       /* Record of exception activity */
 
 {
@@ -67,6 +115,13 @@ struct exceptionRecord                       /* Record of exception activity */
     int64_t maxWallTime;
     uint32_t maxDepth;
 
+    /* Latency distribution, kept per report interval so old runs age out of the window */
+    uint32_t histo[EXC_HISTO_WINDOW][EXC_HISTO_BUCKETS];
+
+    /* Ring of recent instances; statically sized so the event path is just a few stores */
+    struct excTraceEntry trace[EXC_TRACE_DEPTH];
+    uint32_t traceWp;
+
     /* Elements used in calcuation */
     int64_t entryTime;
     int64_t thisTime;
@@ -81,6 +136,8 @@ struct                                       /* Record for options, either defau
     uint32_t tag;                            /* Which OFLOW stream are we decoding? */
     bool reportFilenames;                    /* Report filenames for each routine? */
     bool outputExceptions;                   /* Set to include exceptions in output flow */
+    bool exTraces;                           /* Set to include recent per-vector instance traces in JSON output */
+    bool heatmap;                            /* Set to include per-line heat counts in JSON output */
     bool forceITMSync;                       /* Must ITM start synced? */
     char *file;                              /* File host connection */
 
@@ -92,6 +149,9 @@ struct                                       /* Record for options, either defau
     char *odoptions;                         /* Options to pass directly to objdump */
 
     char *json;                              /* Output in JSON format rather than human readable, either '-' for screen or filename */
+    char *baselineFile;                      /* Saved JSON report to diff the live view against */
+    char *remoteFile;                        /* Stream compact screen-diff records here for a remote renderer, '-' for stdout */
+    char *covFile;                           /* File to write visited-function coverage to each interval */
     char *outfile;                           /* File to output current information */
     char *logfile;                           /* File to output historic information */
     bool mono;                               /* Supress colour in output */
@@ -102,6 +162,8 @@ struct                                       /* Record for options, either defau
     bool demangle;                           /* Do we want to demangle any C++ we come across? */
     int64_t displayInterval;                 /* What is the display interval? */
 
+    bool benchmark;                          /* Replay input file at full speed and report pipeline costs */
+
     int port;                                /* Source information */
     char *server;
     enum Prot protocol;                      /* What protocol to communicate (default to OFLOW (== orbuculum)) */
@@ -127,18 +189,24 @@ struct
     struct MSGSeq    d;                                   /* Message (re-)sequencer */
     struct ITMPacket h;
     struct OFLOW c;
-    enum timeDelay timeStatus;                         /* Indicator of if this time is exact */
-    uint64_t timeStamp;                                /* Latest received time */
+    struct TSClock tsClock;                            /* Running model of the target timestamp clock */
     struct Frame cobsPart;                             /* Any part frame that has been received */
 
     struct SymbolSet *s;                               /* Symbols read from elf */
     struct nameEntry *n;                               /* Current table of recognised names */
 
-    struct visitedAddr *addresses;                     /* Addresses we received in the SWV */
+    struct addrShard addressShard[NUM_ADDR_SHARDS];    /* Sharded map of addresses we received in the SWV */
+    struct visitedAddr **visited;                      /* Scratch list of entries with samples this interval */
+    uint32_t visitedCap;                               /* ...and its current capacity */
+
+    struct heatFunc *heat;                             /* Per-line heat for the functions sampled this interval */
+    uint32_t heatFuncs;                                /* Number of functions with heat data */
+    uint32_t heatCap;                                  /* Capacity of the heat array */
 
     struct exceptionRecord er[MAX_EXCEPTIONS];         /* Exceptions we received on this interval */
     uint32_t currentException;                         /* Exception we are currently embedded in */
     uint32_t erDepth;                                  /* Current depth of exception stack */
+    uint32_t histoSlot;                                /* Window slot latency samples are filed into */
     char *depthList;                                   /* Record of maximum depth of exceptions */
 
     int64_t lastReportus;                              /* Last time an output report was generated, in microseconds */
@@ -150,10 +218,43 @@ struct
     uint32_t dwt_event_acc[DWT_NUM_EVENTS];            /* Accumulator for DWT events */
 
     FILE *jsonfile;                                    /* File where json output is being dumped */
+    FILE *remotefile;                                  /* Stream receiving screen-diff records */
     uint32_t interrupts;
     uint32_t sleeps;
     uint32_t notFound;
-    bool ending;                                       /* Flag to exit */
+    volatile bool ending;                              /* Flag to exit */
+
+    /* Two-stage sample pipeline; the decode loop appends raw PCs here and a worker thread
+     * does the symbol lookup and hash aggregation, so decode never stalls on a lookup. */
+    uint32_t pcBuff[PC_BUFF_LEN];                      /* Raw PC samples awaiting aggregation */
+    atomic_uint_fast32_t pcWp;                         /* Sample write index (decode loop only) */
+    atomic_uint_fast32_t pcRp;                         /* Sample read index (worker only) */
+    pthread_t workerThread;                            /* Thread performing the aggregation */
+    pthread_mutex_t pcMutex;                           /* Protects the sample wakeup condition only */
+    pthread_cond_t pcUpdated;                          /* Signalled when the sample buffer goes non-empty */
+    pthread_mutex_t addressLock;                       /* Held to use the address hash or symbol set */
+    uint32_t samplesDropped;                           /* Samples lost because the worker fell behind */
+
+    struct statSlot *stats;                            /* Shared telemetry slot for this tool */
+
+    uint64_t samplesSeen;                              /* Total PC samples through the decode side */
+    uint64_t lookupHits;                               /* Aggregations satisfied from the address hash */
+    uint64_t lookupMisses;                             /* Aggregations which needed a full symbol lookup */
+    uint64_t frontHits;                                /* Aggregations satisfied by the front cache alone */
+
+    /* Function coverage accumulated from the sample stream */
+    uint64_t *covEver;                                 /* Bitmap of functions ever seen */
+    uint64_t *covInterval;                             /* Bitmap of functions seen this interval */
+    uint32_t covLen;                                   /* Length of the bitmaps, in words */
+
+
+    /* Front cache; worker thread only. Entries point into the address hash's values, which
+     * stay put until _flushHash, where this cache is swept too. */
+    struct frontCacheEnt
+    {
+        uint32_t pc;                                   /* Address this entry covers */
+        struct visitedAddr *a;                         /* Its aggregation record, NULL if empty */
+    } frontCache[FRONT_CACHE_LEN];
 
 } _r;
 
@@ -189,29 +290,20 @@ int _addresses_sort_fn( void *a, void *b )
     return 0;
 }
 // ====================================================================================================
-int _routines_sort_fn( void *a, void *b )
-
+/* A visited record with its grouping identity packed into one integer, so ordering for
+ * consolidation never chases pointers; names are only looked at when rows are rendered */
+struct packedRow
 {
-    int r;
-
-    if ( ( options.reportFilenames ) && ( ( ( ( struct visitedAddr * )a )->n->fileindex ) && ( ( ( struct visitedAddr * )b )->n->fileindex ) ) )
-    {
-        r = ( ( int )( ( struct visitedAddr * )a )->n->fileindex ) - ( ( int )( ( struct visitedAddr * )b )->n->fileindex );
-
-        if ( r )
-        {
-            return r;
-        }
-    }
-
-    r = ( ( int )( ( struct visitedAddr * )a )->n->functionindex ) - ( ( int )( ( struct visitedAddr * )b )->n->functionindex );
+    uint64_t key;                        /* file(16):function(24):line(24) */
+    struct visitedAddr *a;               /* The record itself */
+};
 
-    if ( r )
-    {
-        return r;
-    }
+static int _row_sort_fn( const void *a, const void *b )
 
-    return ( ( int )( ( struct visitedAddr * )a )->n->line ) - ( ( int )( ( struct visitedAddr * )b )->n->line );
+{
+    uint64_t ka = ( ( const struct packedRow * )a )->key;
+    uint64_t kb = ( ( const struct packedRow * )b )->key;
+    return ( ka > kb ) - ( ka < kb );
 }
 // ====================================================================================================
 int _report_sort_fn( const void *a, const void *b )
@@ -257,6 +349,16 @@ void _exitEx( int64_t ts )
         _r.er[_r.currentException].maxTime = _r.er[_r.currentException].thisTime;
     }
 
+    /* File this latency in the distribution; bucket is floor(log2), so one shift-count */
+    uint32_t bucket = 63 - __builtin_clzll( ( uint64_t )_r.er[_r.currentException].thisTime | 1 );
+
+    if ( bucket >= EXC_HISTO_BUCKETS )
+    {
+        bucket = EXC_HISTO_BUCKETS - 1;
+    }
+
+    _r.er[_r.currentException].histo[_r.histoSlot][bucket]++;
+
     const int64_t walltime = _r.er[_r.currentException].thisTime + _r.er[_r.currentException].stealTime;
 
     if ( walltime > _r.er[_r.currentException].maxWallTime )
@@ -269,6 +371,13 @@ void _exitEx( int64_t ts )
         _r.er[_r.currentException].maxDepth = _r.erDepth;
     }
 
+    /* Keep this instance in the per-vector forensics ring */
+    struct excTraceEntry *te = &_r.er[_r.currentException].trace[_r.er[_r.currentException].traceWp];
+    _r.er[_r.currentException].traceWp = ( _r.er[_r.currentException].traceWp + 1 ) % EXC_TRACE_DEPTH;
+    te->at = ts - walltime;
+    te->runt = _r.er[_r.currentException].thisTime;
+    te->wallt = walltime;
+
     /* Step out of this exception */
     _r.currentException = _r.er[_r.currentException].prev;
 
@@ -290,8 +399,7 @@ void _handleTS( struct TSMsg *m, struct ITMDecoder *i )
 {
     assert( m->msgtype == MSG_TS );
 
-    _r.timeStatus = m->timeStatus;
-    _r.timeStamp += m->timeInc;
+    TSClockTick( &_r.tsClock, m, _timestamp() );
 }
 // ====================================================================================================
 void _handleException( struct excMsg *m, struct ITMDecoder *i )
@@ -315,7 +423,7 @@ void _handleException( struct excMsg *m, struct ITMDecoder *i )
             if ( _r.currentException != NO_EXCEPTION )
             {
                 /* Already in an exception ... account for time until now */
-                _r.er[_r.currentException].thisTime += _r.timeStamp - _r.er[_r.currentException].entryTime;
+                _r.er[_r.currentException].thisTime += TSClockTicks( &_r.tsClock ) - _r.er[_r.currentException].entryTime;
             }
 
             /* Record however we got to this exception */
@@ -323,7 +431,7 @@ void _handleException( struct excMsg *m, struct ITMDecoder *i )
 
             /* Now dip into this exception */
             _r.currentException = m->exceptionNumber;
-            _r.er[m->exceptionNumber].entryTime = _r.timeStamp;
+            _r.er[m->exceptionNumber].entryTime = TSClockTicks( &_r.tsClock );
             _r.er[m->exceptionNumber].thisTime = 0;
             _r.er[m->exceptionNumber].stealTime = 0;
             _r.erDepth++;
@@ -332,13 +440,13 @@ void _handleException( struct excMsg *m, struct ITMDecoder *i )
         case EXEVENT_RESUME: /* Unwind all levels of exception (deals with tail chaining) */
             while ( ( _r.currentException != m->exceptionNumber ) && ( _r.erDepth ) )
             {
-                _exitEx( _r.timeStamp );
+                _exitEx( TSClockTicks( &_r.tsClock ) );
             }
 
             break;
 
         case EXEVENT_EXIT: /* Exit single level of exception */
-            _exitEx( _r.timeStamp );
+            _exitEx( TSClockTicks( &_r.tsClock ) );
             break;
 
         default:
@@ -365,6 +473,61 @@ void _handleSW( struct ITMDecoder *i, struct ITMPacket *p )
 
 {
 
+}
+// ====================================================================================================
+static void _exHistoPercentiles( uint32_t e, uint64_t *p50, uint64_t *p90, uint64_t *p99 )
+
+/* Estimate latency percentiles for an exception from its windowed histogram. Each estimate
+ * is the upper bound of the bucket where the cumulative count crosses the quantile, so it
+ * is pessimistic by at most a factor of two - plenty to spot a tail growing.
+ */
+
+{
+    uint64_t bucketTotal[EXC_HISTO_BUCKETS];
+    uint64_t population = 0;
+
+    for ( uint32_t b = 0; b < EXC_HISTO_BUCKETS; b++ )
+    {
+        bucketTotal[b] = 0;
+
+        for ( uint32_t s = 0; s < EXC_HISTO_WINDOW; s++ )
+        {
+            bucketTotal[b] += _r.er[e].histo[s][b];
+        }
+
+        population += bucketTotal[b];
+    }
+
+    *p50 = *p90 = *p99 = 0;
+
+    if ( !population )
+    {
+        return;
+    }
+
+    uint64_t seen = 0;
+
+    for ( uint32_t b = 0; b < EXC_HISTO_BUCKETS; b++ )
+    {
+        seen += bucketTotal[b];
+        uint64_t bound = ( 2ULL << b ) - 1;
+
+        if ( ( !*p50 ) && ( seen * 2 >= population ) )
+        {
+            *p50 = bound;
+        }
+
+        if ( ( !*p90 ) && ( seen * 10 >= population * 9 ) )
+        {
+            *p90 = bound;
+        }
+
+        if ( ( !*p99 ) && ( seen * 100 >= population * 99 ) )
+        {
+            *p99 = bound;
+            break;
+        }
+    }
 }
 // ====================================================================================================
 // ====================================================================================================
@@ -380,19 +543,135 @@ uint32_t _consolodateReport( struct reportLine **returnReport, uint32_t *returnR
     uint32_t reportLines = 0;
     struct reportLine *report = NULL;
     uint32_t total = 0;
+    uint32_t numVisited = 0;
+
+    /* Collect the entries which took samples; only dirty shards can hold any, so a long-running
+     * map costs nothing here beyond the entries actually exercised in this interval.
+     */
+    for ( uint32_t s = 0; s < NUM_ADDR_SHARDS; s++ )
+    {
+        struct addrShard *sh = &_r.addressShard[s];
+
+        if ( !sh->dirty )
+        {
+            continue;
+        }
 
+        uint32_t it = 0;
 
-    /* Put the address into order of the file and function names */
-    HASH_SORT( _r.addresses, _routines_sort_fn );
+        while ( ( a = ( struct visitedAddr * )flathashNext( &sh->addresses, &it ) ) != NULL )
+        {
+            if ( !a->visits )
+            {
+                continue;
+            }
 
-    /* Now merge them together */
-    for ( a = _r.addresses; a != NULL; a = a->hh.next )
+            if ( numVisited == _r.visitedCap )
+            {
+                _r.visitedCap = _r.visitedCap ? _r.visitedCap * 2 : 1024;
+                _r.visited = ( struct visitedAddr ** )realloc( _r.visited, sizeof( struct visitedAddr * ) * _r.visitedCap );
+                MEMCHECK( _r.visited, 0 );
+            }
+
+            _r.visited[numVisited++] = a;
+        }
+
+        sh->dirty = false;
+    }
+
+    /* Put the visited addresses into file, function, line order. Each record's identity is
+     * packed into a single integer key up front, so the sort compares plain integers in a
+     * contiguous array rather than dereferencing into name records per comparison. */
+    struct packedRow *rows = ( struct packedRow * )malloc( numVisited * sizeof( struct packedRow ) );
+    MEMCHECK( rows, 0 );
+
+    for ( uint32_t v = 0; v < numVisited; v++ )
     {
-        if ( !a->visits )
+        struct nameEntry *n = _r.visited[v]->n;
+        uint64_t file = options.reportFilenames ? ( n->fileindex & 0xffff ) : 0;
+        uint64_t func = ( n->functionindex > 0xffffff ) ? 0xffffff : n->functionindex;
+        uint64_t line = ( n->line > 0xffffff ) ? 0xffffff : n->line;
+        rows[v].key = ( file << 48 ) | ( func << 24 ) | line;
+        rows[v].a = _r.visited[v];
+    }
+
+    qsort( rows, numVisited, sizeof( struct packedRow ), _row_sort_fn );
+
+    for ( uint32_t v = 0; v < numVisited; v++ )
+    {
+        _r.visited[v] = rows[v].a;
+    }
+
+    free( rows );
+
+    /* Line heat is assembled from the same visited set, before the merge below retires the
+     * visit counts. The sort just performed leaves each function's entries contiguous. */
+    if ( options.heatmap )
+    {
+        for ( uint32_t h = 0; h < _r.heatFuncs; h++ )
         {
-            continue;
+            free( _r.heat[h].count );
         }
 
+        _r.heatFuncs = 0;
+
+        uint32_t i = 0;
+
+        while ( i < numVisited )
+        {
+            uint32_t j = i;
+            uint32_t lo = NO_LINE;
+            uint32_t hi = 0;
+
+            while ( ( j < numVisited ) && ( _r.visited[j]->n->functionindex == _r.visited[i]->n->functionindex ) )
+            {
+                uint32_t ln = _r.visited[j]->n->line;
+
+                if ( ( ln ) && ( ln != NO_LINE ) )
+                {
+                    lo = ( ln < lo ) ? ln : lo;
+                    hi = ( ln > hi ) ? ln : hi;
+                }
+
+                j++;
+            }
+
+            if ( ( lo <= hi ) && ( hi - lo < HEATMAP_MAX_SPAN ) )
+            {
+                if ( _r.heatFuncs == _r.heatCap )
+                {
+                    _r.heatCap = _r.heatCap ? _r.heatCap * 2 : 64;
+                    _r.heat = ( struct heatFunc * )realloc( _r.heat, sizeof( struct heatFunc ) * _r.heatCap );
+                    MEMCHECK( _r.heat, 0 );
+                }
+
+                struct heatFunc *hf = &_r.heat[_r.heatFuncs++];
+                hf->n = _r.visited[i]->n;
+                hf->firstLine = lo;
+                hf->nlines = hi - lo + 1;
+                hf->count = ( uint64_t * )calloc( hf->nlines, sizeof( uint64_t ) );
+                MEMCHECK( hf->count, 0 );
+
+                for ( uint32_t k = i; k < j; k++ )
+                {
+                    uint32_t ln = _r.visited[k]->n->line;
+
+                    if ( ( ln ) && ( ln != NO_LINE ) )
+                    {
+                        hf->count[ln - lo] += _r.visited[k]->visits;
+                    }
+                }
+            }
+
+            i = j;
+        }
+    }
+
+    /* Now merge them together */
+    for ( uint32_t i = 0; i < numVisited; i++ )
+    {
+        a = _r.visited[i];
+
         if ( ( reportLines == 0 ) ||
                 ( ( options.reportFilenames ) &&  ( report[reportLines - 1].n->fileindex != a->n->fileindex ) ) ||
                 ( report[reportLines - 1].n->functionindex != a->n->functionindex ) ||
@@ -426,10 +705,13 @@ uint32_t _consolodateReport( struct reportLine **returnReport, uint32_t *returnR
     }
 
     uint32_t addr = FN_SLEEPING;
-    HASH_FIND_INT( _r.addresses, &addr, a );
+    struct addrShard *sleepShard = &_r.addressShard[ADDR_SHARD( addr )];
+    void **slot = flathashEntry( &sleepShard->addresses, addr );
+    MEMCHECKV( slot );
 
-    if ( a )
+    if ( *slot )
     {
+        a = ( struct visitedAddr * )*slot;
         n = a->n;
     }
     else
@@ -445,7 +727,7 @@ uint32_t _consolodateReport( struct reportLine **returnReport, uint32_t *returnR
         n->line = 0;
 
         a->n = n;
-        HASH_ADD_INT( _r.addresses, n->addr, a );
+        *slot = a;
     }
 
     report[reportLines].n = n;
@@ -454,8 +736,24 @@ uint32_t _consolodateReport( struct reportLine **returnReport, uint32_t *returnR
     total += _r.sleeps;
     _r.sleeps = 0;
 
-    /* Now put the whole thing into order of number of samples */
-    qsort( report, reportLines, sizeof( struct reportLine ), _report_sort_fn );
+    /* Order by sample count, but only where order is observable. Every consumer gates its
+     * rows on the display cutoff, and lines below it feed nothing but totals, so those stay
+     * in arbitrary order; at most 10000/CUTOFF lines can sit at or above the cutoff, which
+     * bounds the sort by the displayable page rather than the function count.
+     */
+    uint32_t sorted = 0;
+
+    for ( uint32_t i = 0; i < reportLines; i++ )
+    {
+        if ( ( total ) && ( ( ( report[i].count * 10000 ) / total ) >= CUTOFF ) )
+        {
+            struct reportLine t = report[sorted];
+            report[sorted++]    = report[i];
+            report[i]           = t;
+        }
+    }
+
+    qsort( report, sorted, sizeof( struct reportLine ), _report_sort_fn );
 
     *returnReport = report;
     *returnReportLines = reportLines;
@@ -464,54 +762,142 @@ uint32_t _consolodateReport( struct reportLine **returnReport, uint32_t *returnR
     return total;
 }
 // ====================================================================================================
+/* Streaming JSON serializer. The buffer is grown on demand over the first few reports and
+ * then reused for the life of the run, so steady-state report production allocates nothing.
+ */
+static struct
+{
+    char *d;                                 /* The output under construction */
+    unsigned int len;                        /* Amount of buffer used */
+    unsigned int cap;                        /* Amount of buffer allocated */
+} _json;
+
+#define JSON_INITIAL_CAP   (65536)
+#define JSON_NUM_MAX_LEN   (24)              /* Worst case rendered int64, with sign */
+
+// ====================================================================================================
+static void _jsonEnsure( unsigned int more )
+
+{
+    if ( _json.len + more > _json.cap )
+    {
+        _json.cap = _json.cap ? _json.cap * 2 : JSON_INITIAL_CAP;
+
+        while ( _json.len + more > _json.cap )
+        {
+            _json.cap *= 2;
+        }
+
+        _json.d = ( char * )realloc( _json.d, _json.cap );
+        MEMCHECKV( _json.d );
+    }
+}
+// ====================================================================================================
+static void _jsonRaw( const char *s )
+
+/* Append literal text; used for the structural elements and pre-vetted keys */
+
+{
+    unsigned int l = strlen( s );
+    _jsonEnsure( l );
+    memcpy( &_json.d[_json.len], s, l );
+    _json.len += l;
+}
+// ====================================================================================================
+static void _jsonInt( int64_t v )
+
+/* Append a number; everything in the report is integral, so no float path is needed */
+
+{
+    char num[JSON_NUM_MAX_LEN];
+    char *p = &num[JSON_NUM_MAX_LEN];
+    uint64_t u = ( v < 0 ) ? ( uint64_t ) - v : ( uint64_t )v;
+
+    do
+    {
+        *--p = '0' + ( u % 10 );
+        u /= 10;
+    }
+    while ( u );
+
+    if ( v < 0 )
+    {
+        *--p = '-';
+    }
+
+    unsigned int l = &num[JSON_NUM_MAX_LEN] - p;
+    _jsonEnsure( l );
+    memcpy( &_json.d[_json.len], p, l );
+    _json.len += l;
+}
+// ====================================================================================================
+static void _jsonStr( const char *s )
+
+/* Append a quoted string, escaping anything JSON requires us to */
+
+{
+    _jsonEnsure( 1 );
+    _json.d[_json.len++] = '"';
+
+    for ( ; s && *s; s++ )
+    {
+        unsigned char c = *s;
+
+        if ( ( '"' == c ) || ( '\\' == c ) )
+        {
+            _jsonEnsure( 2 );
+            _json.d[_json.len++] = '\\';
+            _json.d[_json.len++] = c;
+        }
+        else if ( c < 0x20 )
+        {
+            char esc[8];
+            snprintf( esc, sizeof( esc ), "\\u%04x", c );
+            _jsonRaw( esc );
+        }
+        else
+        {
+            _jsonEnsure( 1 );
+            _json.d[_json.len++] = c;
+        }
+    }
+
+    _jsonEnsure( 1 );
+    _json.d[_json.len++] = '"';
+}
+// ====================================================================================================
+static void _jsonKeyInt( const char *key, int64_t v, bool first )
+
+{
+    _jsonRaw( first ? "\"" : ",\"" );
+    _jsonRaw( key );
+    _jsonRaw( "\":" );
+    _jsonInt( v );
+}
+// ====================================================================================================
 static void _outputJson( FILE *f, uint32_t total, uint32_t reportLines, struct reportLine *report, int64_t timeStamp )
 
 /* Produce the output to JSON */
 
 {
-    /* JSON output constructor */
-    cJSON *jsonStore;
-    cJSON *jsonElement;
-    cJSON *jsonTopTable;
-    cJSON *jsonStatsTable;
-    cJSON *jsonTableEntry;
-    cJSON *jsonIntTable;
-    char *opString;
+    _json.len = 0;
 
     /* Start of frame  ====================================================== */
-    jsonStore = cJSON_CreateObject();
-    assert( jsonStore );
-    jsonElement = cJSON_CreateNumber( timeStamp );
-    assert( jsonElement );
-    cJSON_AddItemToObject( jsonStore, "timestamp", jsonElement );
-    jsonElement = cJSON_CreateNumber( total );
-    assert( jsonElement );
-    cJSON_AddItemToObject( jsonStore, "elements", jsonElement );
-    jsonElement = cJSON_CreateNumber( timeStamp - _r.lastReportus );
-    assert( jsonElement );
-    cJSON_AddItemToObject( jsonStore, "interval", jsonElement );
+    _jsonRaw( "{" );
+    _jsonKeyInt( "timestamp", timeStamp, true );
+    _jsonKeyInt( "elements", total, false );
+    _jsonKeyInt( "interval", timeStamp - _r.lastReportus, false );
 
     /* Create stats ========================================================= */
-    jsonStatsTable = cJSON_CreateObject();
-    assert( jsonStatsTable );
-    cJSON_AddItemToObject( jsonStore, "stats", jsonStatsTable );
-
-    jsonElement = cJSON_CreateNumber( ITMDecoderGetStats( &_r.i )->overflow );
-    assert( jsonElement );
-    cJSON_AddItemToObject( jsonStatsTable, "overflow", jsonElement );
-
-    jsonElement = cJSON_CreateNumber( ITMDecoderGetStats( &_r.i )->syncCount );
-    assert( jsonElement );
-    cJSON_AddItemToObject( jsonStatsTable, "itmsync", jsonElement );
-    jsonElement = cJSON_CreateNumber( ITMDecoderGetStats( &_r.i )->ErrorPkt );
-    assert( jsonElement );
-    cJSON_AddItemToObject( jsonStatsTable, "error", jsonElement );
-
+    _jsonRaw( ",\"stats\":{" );
+    _jsonKeyInt( "overflow", ITMDecoderGetStats( &_r.i )->overflow, true );
+    _jsonKeyInt( "itmsync", ITMDecoderGetStats( &_r.i )->syncCount, false );
+    _jsonKeyInt( "error", ITMDecoderGetStats( &_r.i )->ErrorPkt, false );
+    _jsonRaw( "}" );
 
     /* Create top table ====================================================== */
-    jsonTopTable = cJSON_CreateArray();
-    assert( jsonTopTable );
-    cJSON_AddItemToObject( jsonStore, "toptable", jsonTopTable );
+    _jsonRaw( ",\"toptable\":[" );
+    bool firstEntry = true;
 
     for ( uint32_t n = 0; n < reportLines; n++ )
     {
@@ -519,75 +905,143 @@ static void _outputJson( FILE *f, uint32_t total, uint32_t reportLines, struct r
         {
             char *d = NULL;
 
-            /* Output in JSON Format */
-            jsonTableEntry = cJSON_CreateObject();
-            assert( jsonTableEntry );
-
-            jsonElement = cJSON_CreateNumber( report[n].count );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "count", jsonElement );
-            jsonElement = cJSON_CreateString( SymbolFilename( _r.s, report[n].n->fileindex ) );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "filename", jsonElement );
-
-            jsonElement = cJSON_CreateString(  d ? d : SymbolFunction( _r.s, report[n].n->functionindex ) );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "function", jsonElement );
+            _jsonRaw( firstEntry ? "{" : ",{" );
+            firstEntry = false;
+            _jsonKeyInt( "count", report[n].count, true );
+            _jsonRaw( ",\"filename\":" );
+            _jsonStr( SymbolFilename( _r.s, report[n].n->fileindex ) );
+            _jsonRaw( ",\"function\":" );
+            _jsonStr( d ? d : SymbolFunction( _r.s, report[n].n->functionindex ) );
 
             if ( options.lineDisaggregation )
             {
-                jsonElement = cJSON_CreateNumber( report[n].n->line ? report[n].n->line : 0 );
-                assert( jsonElement );
-                cJSON_AddItemToObject( jsonTableEntry, "line", jsonElement );
+                _jsonKeyInt( "line", report[n].n->line ? report[n].n->line : 0, false );
             }
 
-            cJSON_AddItemToObject( jsonTopTable, "top", jsonTableEntry );
+            _jsonRaw( "}" );
         }
     }
 
     /* Now add the interrupt metrics ================================================ */
-    jsonIntTable = cJSON_CreateArray();
-    assert( jsonIntTable );
-    cJSON_AddItemToObject( jsonStore, "exceptions", jsonIntTable );
+    _jsonRaw( "],\"exceptions\":[" );
+    firstEntry = true;
 
     for ( uint32_t e = 0; e < MAX_EXCEPTIONS; e++ )
     {
         if ( _r.er[e].visits )
         {
-            jsonTableEntry = cJSON_CreateObject();
-            assert( jsonTableEntry );
-            cJSON_AddItemToObject( jsonIntTable, "exceptions", jsonTableEntry );
-            jsonElement = cJSON_CreateNumber( e );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "ex", jsonElement );
-            jsonElement = cJSON_CreateNumber( _r.er[e].visits );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "count", jsonElement );
-            jsonElement = cJSON_CreateNumber( _r.er[e].maxDepth );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "maxd", jsonElement );
-            jsonElement = cJSON_CreateNumber( _r.er[e].totalTime );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "totalt", jsonElement );
-            jsonElement = cJSON_CreateNumber( _r.er[e].minTime );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "mint", jsonElement );
-            jsonElement = cJSON_CreateNumber( _r.er[e].maxTime );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "maxt", jsonElement );
-            jsonElement = cJSON_CreateNumber( _r.er[e].maxWallTime );
-            assert( jsonElement );
-            cJSON_AddItemToObject( jsonTableEntry, "maxwt", jsonElement );
+            uint64_t p50, p90, p99;
+
+            _exHistoPercentiles( e, &p50, &p90, &p99 );
+
+            _jsonRaw( firstEntry ? "{" : ",{" );
+            firstEntry = false;
+            _jsonKeyInt( "ex", e, true );
+            _jsonKeyInt( "count", _r.er[e].visits, false );
+            _jsonKeyInt( "maxd", _r.er[e].maxDepth, false );
+            _jsonKeyInt( "totalt", _r.er[e].totalTime, false );
+            _jsonKeyInt( "mint", _r.er[e].minTime, false );
+            _jsonKeyInt( "maxt", _r.er[e].maxTime, false );
+            _jsonKeyInt( "maxwt", _r.er[e].maxWallTime, false );
+            _jsonKeyInt( "p50t", p50, false );
+            _jsonKeyInt( "p90t", p90, false );
+            _jsonKeyInt( "p99t", p99, false );
+
+            /* Windowed latency distribution */
+            _jsonRaw( ",\"histo\":[" );
+
+            for ( uint32_t b = 0; b < EXC_HISTO_BUCKETS; b++ )
+            {
+                uint64_t count = 0;
+
+                for ( uint32_t s = 0; s < EXC_HISTO_WINDOW; s++ )
+                {
+                    count += _r.er[e].histo[s][b];
+                }
+
+                if ( b )
+                {
+                    _jsonRaw( "," );
+                }
+
+                _jsonInt( count );
+            }
+
+            _jsonRaw( "]" );
+
+            /* Recent instances from the forensics ring, oldest first */
+            if ( options.exTraces )
+            {
+                _jsonRaw( ",\"recent\":[" );
+                bool firstTrace = true;
+
+                for ( uint32_t n = 0; n < EXC_TRACE_DEPTH; n++ )
+                {
+                    const struct excTraceEntry *te = &_r.er[e].trace[( _r.er[e].traceWp + n ) % EXC_TRACE_DEPTH];
+
+                    if ( !te->wallt )
+                    {
+                        /* Slot hasn't been used yet */
+                        continue;
+                    }
+
+                    _jsonRaw( firstTrace ? "{" : ",{" );
+                    firstTrace = false;
+                    _jsonKeyInt( "at", te->at, true );
+                    _jsonKeyInt( "runt", te->runt, false );
+                    _jsonKeyInt( "wallt", te->wallt, false );
+                    _jsonRaw( "}" );
+                }
+
+                _jsonRaw( "]" );
+            }
+
+            _jsonRaw( "}" );
         }
     }
 
-    /* Close off JSON report - if you want your printing pretty then use the first line */
-    //opString=cJSON_Print(jsonStore);
+    _jsonRaw( "]" );
+
+    /* Per-line heat, one entry per function sampled this interval ================== */
+    if ( options.heatmap )
+    {
+        _jsonRaw( ",\"heatmap\":[" );
+        firstEntry = true;
+
+        for ( uint32_t h = 0; h < _r.heatFuncs; h++ )
+        {
+            struct heatFunc *hf = &_r.heat[h];
+
+            _jsonRaw( firstEntry ? "{" : ",{" );
+            firstEntry = false;
+            _jsonRaw( "\"function\":" );
+            _jsonStr( SymbolFunction( _r.s, hf->n->functionindex ) );
+            _jsonRaw( ",\"filename\":" );
+            _jsonStr( SymbolFilename( _r.s, hf->n->fileindex ) );
+            _jsonKeyInt( "line0", hf->firstLine, false );
+            _jsonRaw( ",\"counts\":[" );
+
+            for ( uint32_t l = 0; l < hf->nlines; l++ )
+            {
+                if ( l )
+                {
+                    _jsonRaw( "," );
+                }
+
+                _jsonInt( hf->count[l] );
+            }
 
-    opString = cJSON_PrintUnformatted( jsonStore );
-    cJSON_Delete( jsonStore );
-    fprintf( f, "%s" EOL, opString );
-    free( opString );
+            _jsonRaw( "]}" );
+        }
+
+        _jsonRaw( "]" );
+    }
+
+    _jsonRaw( "}" );
+    _jsonEnsure( 1 );
+    _json.d[_json.len] = 0;
+
+    fprintf( f, "%s" EOL, _json.d );
 }
 
 static const char *ExceptionNames[] =
@@ -610,6 +1064,511 @@ static const char *ExceptionNames[] =
     [15] = "SysTick",
 };
 
+/* Display form of every possible vector, rendered once and indexed thereafter so the interval
+ * report doesn't re-run snprintf for each active vector at every refresh */
+static char _exDisplayName[MAX_EXCEPTIONS][16];
+
+static const char *_exceptionDisplayName( uint32_t e )
+
+{
+    if ( !_exDisplayName[0][0] )
+    {
+        for ( uint32_t i = 0; i < MAX_EXCEPTIONS; i++ )
+        {
+            if ( i < 16 )
+            {
+                snprintf( _exDisplayName[i], sizeof( _exDisplayName[i] ), "(%s)", ExceptionNames[i] );
+            }
+            else
+            {
+                snprintf( _exDisplayName[i], sizeof( _exDisplayName[i] ), "(IRQ %" PRIu32 ")", i - 16 );
+            }
+        }
+    }
+
+    return _exDisplayName[e];
+}
+
+// ====================================================================================================
+/* Baseline report for cross-run diffing. Loaded once at startup from a file of _outputJson
+ * frames and hashed by function name, so the live view costs one O(1) lookup per rendered
+ * row to show how each function moved against the saved run; no tables are joined per
+ * interval, and rows the screen differ skips don't even pay the lookup.
+ */
+
+#define BASELINE_NAME_MAX (512)              /* Longest function name we'll key on, demangled C++ included */
+
+struct baselineEnt
+{
+    char *key;                               /* Function name, "name::line" if the baseline disaggregated */
+    uint64_t count;                          /* Samples against it in the baseline interval */
+    uint32_t pct;                            /* Share of the baseline interval, in hundredths of a percent */
+    UT_hash_handle hh;
+};
+
+static struct
+{
+    struct baselineEnt *ent;                 /* Hash of baseline rows, keyed by name */
+    uint64_t total;                          /* Sum of baseline counts */
+    bool loaded;
+} _baseline;
+
+// ====================================================================================================
+static const char *_baselineScanStr( const char *p, char *out, size_t sz )
+
+/* Unescape a JSON string; p points at the opening quote, return points past the closing one.
+ * out may be NULL to just step over the value. Only the escapes _jsonStr produces matter,
+ * but unknown ones are skipped rather than trusted.
+ */
+
+{
+    size_t used = 0;
+    p++;
+
+    while ( ( *p ) && ( *p != '"' ) )
+    {
+        char c = *p++;
+
+        if ( '\\' == c )
+        {
+            if ( !*p )
+            {
+                break;
+            }
+
+            c = *p++;
+
+            if ( 'u' == c )
+            {
+                /* We only ever emit these for control characters; drop them */
+                for ( int i = 0; ( i < 4 ) && ( *p ); i++ )
+                {
+                    p++;
+                }
+
+                continue;
+            }
+
+            if ( ( c != '"' ) && ( c != '\\' ) && ( c != '/' ) )
+            {
+                continue;
+            }
+        }
+
+        if ( ( out ) && ( used < sz - 1 ) )
+        {
+            out[used++] = c;
+        }
+    }
+
+    if ( out )
+    {
+        out[used] = 0;
+    }
+
+    return ( *p ) ? p + 1 : p;
+}
+// ====================================================================================================
+static bool _baselineParseFrame( const char *l )
+
+/* Pull the toptable out of one serialized report frame into a fresh baseline hash, replacing
+ * whatever a previous frame left there. Returns false if the line holds no table.
+ */
+
+{
+    const char *p = strstr( l, "\"toptable\":[" );
+
+    if ( !p )
+    {
+        return false;
+    }
+
+    p += strlen( "\"toptable\":[" );
+
+    /* This frame supersedes any earlier one in the file */
+    struct baselineEnt *e, *tmp;
+    HASH_ITER( hh, _baseline.ent, e, tmp )
+    {
+        HASH_DEL( _baseline.ent, e );
+        free( e->key );
+        free( e );
+    }
+
+    _baseline.total = 0;
+
+    while ( ( *p ) && ( *p != ']' ) )
+    {
+        if ( *p != '{' )
+        {
+            p++;
+            continue;
+        }
+
+        p++;
+
+        uint64_t count = 0;
+        uint32_t line = 0;
+        bool haveLine = false;
+        char name[BASELINE_NAME_MAX] = { 0 };
+
+        /* Walk the key/value pairs of this entry; it's flat, and strings can hide braces */
+        while ( ( *p ) && ( *p != '}' ) )
+        {
+            if ( *p != '"' )
+            {
+                p++;
+                continue;
+            }
+
+            char key[16];
+            p = _baselineScanStr( p, key, sizeof( key ) );
+
+            while ( ( *p ) && ( *p != ':' ) )
+            {
+                p++;
+            }
+
+            if ( *p )
+            {
+                p++;
+            }
+
+            while ( ( *p == ' ' ) || ( *p == '\t' ) )
+            {
+                p++;
+            }
+
+            if ( *p == '"' )
+            {
+                bool isFn = !strcmp( key, "function" );
+                p = _baselineScanStr( p, isFn ? name : NULL, isFn ? sizeof( name ) : 0 );
+            }
+            else
+            {
+                char *end;
+                uint64_t v = strtoull( p, &end, 10 );
+                p = end;
+
+                if ( !strcmp( key, "count" ) )
+                {
+                    count = v;
+                }
+                else if ( !strcmp( key, "line" ) )
+                {
+                    line = ( uint32_t )v;
+                    haveLine = true;
+                }
+            }
+        }
+
+        if ( *p )
+        {
+            p++;
+        }
+
+        if ( ( !name[0] ) || ( !count ) )
+        {
+            continue;
+        }
+
+        char keyed[BASELINE_NAME_MAX + 16];
+        const char *k = name;
+
+        if ( ( haveLine ) && ( line ) )
+        {
+            snprintf( keyed, sizeof( keyed ), "%s::%" PRIu32, name, line );
+            k = keyed;
+        }
+
+        HASH_FIND_STR( _baseline.ent, k, e );
+
+        if ( !e )
+        {
+            e = ( struct baselineEnt * )calloc( 1, sizeof( struct baselineEnt ) );
+            MEMCHECK( e, false );
+            e->key = strdup( k );
+            MEMCHECK( e->key, false );
+            HASH_ADD_KEYPTR( hh, _baseline.ent, e->key, strlen( e->key ), e );
+        }
+
+        e->count += count;
+        _baseline.total += count;
+    }
+
+    return ( NULL != _baseline.ent );
+}
+// ====================================================================================================
+static void _baselineLoad( char *filename )
+
+/* Load the baseline table from a saved JSON report. The file holds one frame per interval;
+ * the last parseable one wins, that being the run's steady state.
+ */
+
+{
+    FILE *f = fopen( filename, "r" );
+
+    if ( !f )
+    {
+        genericsExit( -1, "Couldn't open baseline report file %s" EOL, filename );
+    }
+
+    char *l = NULL;
+    size_t cap = 0;
+    bool got = false;
+
+    while ( getline( &l, &cap, f ) >= 0 )
+    {
+        got |= _baselineParseFrame( l );
+    }
+
+    free( l );
+    fclose( f );
+
+    if ( !got )
+    {
+        genericsExit( -1, "No report found in baseline file %s" EOL, filename );
+    }
+
+    /* Fix each row's share of its own run now, so render time is subtraction only */
+    struct baselineEnt *e, *tmp;
+    HASH_ITER( hh, _baseline.ent, e, tmp )
+    {
+        e->pct = ( uint32_t )( ( e->count * 10000 ) / _baseline.total );
+    }
+
+    _baseline.loaded = true;
+    genericsReport( V_INFO, "Baseline of %u functions over %" PRIu64 " samples loaded" EOL,
+                    HASH_COUNT( _baseline.ent ), _baseline.total );
+}
+// ====================================================================================================
+/* Previous interval's rendered report rows, kept so only changed screen lines are repainted */
+
+#define TOPROW_TEXT_MAX (512)                /* Rendered row length bound, including colours */
+
+struct topRow
+{
+    uint32_t functionindex;                  /* Identity of the row... */
+    uint32_t fileindex;
+    uint32_t line;
+    uint64_t count;                          /* ...and the values displayed in it */
+    uint32_t percentage;
+    char text[TOPROW_TEXT_MAX];              /* Rendered line, including colour codes */
+};
+
+static struct
+{
+    struct topRow *row;                      /* Rows as they appeared last interval */
+    uint32_t rows;                           /* Number of rows in the previous frame */
+    uint32_t cap;                            /* Rows allocated */
+    bool valid;                              /* Cleared to force a full repaint */
+} _screen;
+
+// ====================================================================================================
+static void _renderTopLine( char *buf, size_t sz, struct reportLine *l, uint32_t percentage )
+
+/* Render one report line into a buffer, colour codes included, without emitting it */
+
+{
+    size_t used = snprintf( buf, sz, C_DATA "%3d.%02d%% " C_SUPPORT " %7" PRIu64 " ", percentage / 100, percentage % 100, l->count );
+
+    if ( ( _baseline.loaded ) && ( used < sz ) )
+    {
+        /* Movement against the saved run; one hash probe, and only for rows being repainted */
+        char keyed[BASELINE_NAME_MAX + 16];
+        const char *k = SymbolFunction( _r.s, l->n->functionindex );
+
+        if ( ( options.lineDisaggregation ) && ( l->n->line ) )
+        {
+            snprintf( keyed, sizeof( keyed ), "%s::%" PRIu32, k, l->n->line );
+            k = keyed;
+        }
+
+        struct baselineEnt *be;
+        HASH_FIND_STR( _baseline.ent, k, be );
+
+        if ( !be )
+        {
+            used += snprintf( buf + used, sz - used, C_CONTEXT "    new  " C_RESET " " );
+        }
+        else
+        {
+            int32_t d = ( int32_t )percentage - ( int32_t )be->pct;
+            uint32_t m = ( d < 0 ) ? -d : d;
+            used += snprintf( buf + used, sz - used, C_CONTEXT "%c%3" PRIu32 ".%02" PRIu32 "%% " C_RESET " ",
+                              ( d < 0 ) ? '-' : '+', m / 100, m % 100 );
+        }
+    }
+
+    if ( ( options.reportFilenames ) && ( l->n->fileindex != NO_FILE ) && ( used < sz ) )
+    {
+        used += snprintf( buf + used, sz - used, C_CONTEXT "%s" C_RESET "::", SymbolFilename( _r.s, l->n->fileindex ) );
+    }
+
+    if ( used >= sz )
+    {
+        return;
+    }
+
+    if ( ( options.lineDisaggregation ) && ( l->n->line ) )
+    {
+        snprintf( buf + used, sz - used, C_SUPPORT2 "%s" C_RESET "::" C_CONTEXT "%d", SymbolFunction( _r.s, l->n->functionindex ), l->n->line );
+    }
+    else
+    {
+        snprintf( buf + used, sz - used, C_SUPPORT2 "%s" C_RESET, SymbolFunction( _r.s, l->n->functionindex ) );
+    }
+}
+// ====================================================================================================
+static void _outputCoverage( void )
+
+/* Write visited-function coverage for the dashboard; one line per known function with its
+ * ever-seen and seen-this-interval flags, then restart the interval bitmap.
+ */
+
+{
+    uint32_t nFunctions = _r.s ? _r.s->functionCount : 0;
+    uint32_t words = ( nFunctions + 63 ) / 64;
+
+    if ( words > _r.covLen )
+    {
+        words = _r.covLen;
+    }
+
+    /* Snapshot under the lock so the file write doesn't hold the worker off */
+    uint64_t *ever = ( uint64_t * )malloc( words * sizeof( uint64_t ) );
+    uint64_t *interval = ( uint64_t * )malloc( words * sizeof( uint64_t ) );
+    MEMCHECKV( ever );
+    MEMCHECKV( interval );
+
+    pthread_mutex_lock( &_r.addressLock );
+    memcpy( ever, _r.covEver, words * sizeof( uint64_t ) );
+    memcpy( interval, _r.covInterval, words * sizeof( uint64_t ) );
+    memset( _r.covInterval, 0, _r.covLen * sizeof( uint64_t ) );
+    pthread_mutex_unlock( &_r.addressLock );
+
+    FILE *f = fopen( options.covFile, "w" );
+
+    if ( !f )
+    {
+        genericsReport( V_ERROR, "Couldn't open coverage file for write" EOL );
+        free( ever );
+        free( interval );
+        return;
+    }
+
+    uint32_t covered = 0;
+
+    for ( uint32_t w = 0; w < words; w++ )
+    {
+        covered += __builtin_popcountll( ever[w] );
+    }
+
+    fprintf( f, "# %" PRIu32 "/%" PRIu32 " functions visited" EOL, covered, nFunctions );
+
+    for ( uint32_t i = 0; i < nFunctions; i++ )
+    {
+        bool e = ( i >> 6 ) < words ? ( 0 != ( ever[i >> 6] & ( 1ULL << ( i & 63 ) ) ) ) : false;
+        bool n = ( i >> 6 ) < words ? ( 0 != ( interval[i >> 6] & ( 1ULL << ( i & 63 ) ) ) ) : false;
+        fprintf( f, "%s,%d,%d" EOL, SymbolFunction( _r.s, i ), e ? 1 : 0, n ? 1 : 0 );
+    }
+
+    fclose( f );
+    free( ever );
+    free( interval );
+}
+// ====================================================================================================
+
+/* Shadow of the rows last sent to the remote renderer, so only changed rows travel */
+static struct
+{
+    struct topRow *row;
+    uint32_t rows;
+    uint32_t cap;
+    uint32_t seq;                            /* Frame sequence number */
+} _remote;
+
+static void _outputRemote( FILE *f, uint32_t total, uint32_t reportLines, struct reportLine *report )
+
+/* Serialize this interval as compact diff records for a thin remote renderer. One frame is
+ * 'B <seq>', an 'R <idx> <pct> <count> <name>' per row that differs from the previous frame,
+ * 'T <rows>' if the table shrank, then 'E <dispPct> <dispSamples> <samples>'. Unchanged rows
+ * send nothing, so steady-state bandwidth is a few bytes per interval rather than a repaint.
+ */
+
+{
+    uint64_t samples = 0;
+    uint64_t dispSamples = 0;
+    uint32_t totPercent = 0;
+    uint32_t printed = 0;
+
+    fprintf( f, "B %" PRIu32 EOL, _remote.seq++ );
+
+    for ( uint32_t n = 0; n < reportLines; n++ )
+    {
+        uint32_t percentage = ( report[n].count * 10000 ) / total;
+        samples += report[n].count;
+
+        if ( ( !report[n].count ) || ( percentage < CUTOFF ) ||
+                ( ( options.cutscreen ) && ( n >= options.cutscreen ) ) )
+        {
+            continue;
+        }
+
+        dispSamples += report[n].count;
+        totPercent += percentage;
+
+        if ( printed >= _remote.cap )
+        {
+            _remote.cap = _remote.cap ? _remote.cap * 2 : 64;
+            _remote.row = ( struct topRow * )realloc( _remote.row, _remote.cap * sizeof( struct topRow ) );
+            MEMCHECKV( _remote.row );
+        }
+
+        struct topRow *row = &_remote.row[printed];
+
+        if ( ( printed >= _remote.rows ) ||
+                ( row->functionindex != report[n].n->functionindex ) ||
+                ( row->fileindex != report[n].n->fileindex ) ||
+                ( row->line != report[n].n->line ) ||
+                ( row->count != report[n].count ) ||
+                ( row->percentage != percentage ) )
+        {
+            row->functionindex = report[n].n->functionindex;
+            row->fileindex     = report[n].n->fileindex;
+            row->line          = report[n].n->line;
+            row->count         = report[n].count;
+            row->percentage    = percentage;
+
+            fprintf( f, "R %" PRIu32 " %" PRIu32 " %" PRIu64 " ", printed, percentage, report[n].count );
+
+            if ( ( options.reportFilenames ) && ( report[n].n->fileindex != NO_FILE ) )
+            {
+                fprintf( f, "%s::", SymbolFilename( _r.s, report[n].n->fileindex ) );
+            }
+
+            if ( ( options.lineDisaggregation ) && ( report[n].n->line ) )
+            {
+                fprintf( f, "%s::%d" EOL, SymbolFunction( _r.s, report[n].n->functionindex ), report[n].n->line );
+            }
+            else
+            {
+                fprintf( f, "%s" EOL, SymbolFunction( _r.s, report[n].n->functionindex ) );
+            }
+        }
+
+        printed++;
+    }
+
+    if ( printed < _remote.rows )
+    {
+        fprintf( f, "T %" PRIu32 EOL, printed );
+    }
+
+    _remote.rows = printed;
+
+    fprintf( f, "E %" PRIu32 " %" PRIu64 " %" PRIu64 EOL, totPercent, dispSamples, samples );
+    fflush( f );
+}
 // ====================================================================================================
 static void _outputTop( uint32_t total, uint32_t reportLines, struct reportLine *report, int64_t lastTime )
 
@@ -637,7 +1596,12 @@ static void _outputTop( uint32_t total, uint32_t reportLines, struct reportLine
         q = fopen( options.logfile, "a" );
     }
 
-    genericsFPrintf( stdout, CLEAR_SCREEN );
+    /* With an interactive screen we repaint only the rows that changed since the last
+     * interval; otherwise, or on the first frame, fall back to a full clear and redraw.
+     */
+    bool diffing = genericsIsScreenHandling() && _screen.valid;
+
+    genericsFPrintf( stdout, diffing ? C_HOME : CLEAR_SCREEN );
 
     if ( total )
     {
@@ -655,21 +1619,34 @@ static void _outputTop( uint32_t total, uint32_t reportLines, struct reportLine
                     dispSamples += report[n].count;
                     totPercent += percentage;
 
-                    genericsFPrintf( stdout, C_DATA "%3d.%02d%% " C_SUPPORT " %7" PRIu64 " ", percentage / 100, percentage % 100, report[n].count );
-
-
-                    if ( ( options.reportFilenames ) && ( report[n].n->fileindex != NO_FILE ) )
+                    if ( printed >= _screen.cap )
                     {
-                        genericsFPrintf( stdout, C_CONTEXT "%s" C_RESET "::", SymbolFilename( _r.s, report[n].n->fileindex ) );
+                        _screen.cap = _screen.cap ? _screen.cap * 2 : 64;
+                        _screen.row = ( struct topRow * )realloc( _screen.row, _screen.cap * sizeof( struct topRow ) );
+                        MEMCHECKV( _screen.row );
                     }
 
-                    if ( ( options.lineDisaggregation ) && ( report[n].n->line ) )
+                    struct topRow *row = &_screen.row[printed];
+
+                    if ( ( diffing ) && ( printed < _screen.rows ) &&
+                            ( row->functionindex == report[n].n->functionindex ) &&
+                            ( row->fileindex == report[n].n->fileindex ) &&
+                            ( row->line == report[n].n->line ) &&
+                            ( row->count == report[n].count ) &&
+                            ( row->percentage == percentage ) )
                     {
-                        genericsFPrintf( stdout, C_SUPPORT2 "%s" C_RESET "::" C_CONTEXT "%d" EOL, d ? d : SymbolFunction( _r.s, report[n].n->functionindex ), report[n].n->line );
+                        /* This row is already on the screen as-is; just step over it */
+                        genericsFPrintf( stdout, EOL );
                     }
                     else
                     {
-                        genericsFPrintf( stdout, C_SUPPORT2 "%s" C_RESET EOL, d ? d : SymbolFunction( _r.s, report[n].n->functionindex ) );
+                        row->functionindex = report[n].n->functionindex;
+                        row->fileindex     = report[n].n->fileindex;
+                        row->line          = report[n].n->line;
+                        row->count         = report[n].count;
+                        row->percentage    = percentage;
+                        _renderTopLine( row->text, TOPROW_TEXT_MAX, &report[n], percentage );
+                        genericsFPrintf( stdout, "%s" C_CLR_LN EOL, row->text );
                     }
 
                     printed++;
@@ -709,6 +1686,14 @@ static void _outputTop( uint32_t total, uint32_t reportLines, struct reportLine
         }
     }
 
+    /* Everything below the table is cheap to produce and changes most intervals, so from
+     * here on just wipe to the end of the screen and repaint.
+     */
+    genericsFPrintf( stdout, C_CLR_EOS );
+
+    _screen.rows = printed;
+    _screen.valid = genericsIsScreenHandling();
+
     genericsFPrintf( stdout, C_RESET "-----------------" EOL );
 
     genericsFPrintf( stdout, C_DATA "%3d.%02d%% " C_SUPPORT " %7" PRIu64 " " C_RESET "of "C_DATA" %" PRIu64 " "C_RESET" Samples" EOL, totPercent / 100, totPercent % 100, dispSamples, samples );
@@ -749,30 +1734,22 @@ static void _outputTop( uint32_t total, uint32_t reportLines, struct reportLine
             genericsFPrintf( stdout, EOL );
         }
 
-        genericsFPrintf( stdout, EOL " Exception         |   Count  |  MaxD | TotalTicks  |   %%   |  AveTicks  |  minTicks  |  maxTicks  |  maxWall " EOL );
-        genericsFPrintf( stdout, /**/"-------------------+----------+-------+-------------+-------+------------+------------+------------+----------" EOL );
+        genericsFPrintf( stdout, EOL " Exception         |   Count  |  MaxD | TotalTicks  |   %%   |  AveTicks  |  minTicks  |  maxTicks  |  maxWall |    ~p50   |    ~p90   |    ~p99 " EOL );
+        genericsFPrintf( stdout, /**/"-------------------+----------+-------+-------------+-------+------------+------------+------------+----------+-----------+-----------+---------" EOL );
 
         for ( uint32_t e = 0; e < MAX_EXCEPTIONS; e++ )
         {
 
             if ( _r.er[e].visits )
             {
-                char exceptionName[30] = { 0 };
-
-                if ( e < 16 )
-                {
-                    snprintf( exceptionName, sizeof( exceptionName ), "(%s)", ExceptionNames[e] );
-                }
-                else
-                {
-                    snprintf( exceptionName, sizeof( exceptionName ), "(IRQ %d)", e - 16 );
-                }
-
-                const float util_percent = ( float )_r.er[e].totalTime / ( _r.timeStamp - _r.lastReportTicks ) * 100.0f;
+                const float util_percent = ( float )_r.er[e].totalTime / ( TSClockTicks( &_r.tsClock ) - _r.lastReportTicks ) * 100.0f;
+                uint64_t p50, p90, p99;
+                _exHistoPercentiles( e, &p50, &p90, &p99 );
                 genericsFPrintf( stdout, C_DATA "%3" PRId32 " %-14s" C_RESET " | " C_DATA "%8" PRIu64 C_RESET " |" C_DATA " %5"
                                  PRIu32 C_RESET " | "C_DATA " %9" PRIu64 C_RESET "  |" C_DATA "%6.1f" C_RESET " |  " C_DATA "%9" PRIu64 C_RESET " | " C_DATA "%9" PRIu64 C_RESET "  | " C_DATA" %9" PRIu64 C_RESET " | " C_DATA "%9"
-                                 PRIu64 C_RESET EOL,
-                                 e, exceptionName, _r.er[e].visits, _r.er[e].maxDepth, _r.er[e].totalTime, util_percent, _r.er[e].totalTime / _r.er[e].visits, _r.er[e].minTime, _r.er[e].maxTime, _r.er[e].maxWallTime );
+                                 PRIu64 C_RESET " | " C_DATA "%9" PRIu64 C_RESET " | " C_DATA "%9" PRIu64 C_RESET " | " C_DATA "%9" PRIu64 C_RESET EOL,
+                                 e, _exceptionDisplayName( e ), _r.er[e].visits, _r.er[e].maxDepth, _r.er[e].totalTime, util_percent, _r.er[e].totalTime / _r.er[e].visits, _r.er[e].minTime, _r.er[e].maxTime, _r.er[e].maxWallTime,
+                                 p50, p90, p99 );
             }
         }
     }
@@ -785,7 +1762,7 @@ static void _outputTop( uint32_t total, uint32_t reportLines, struct reportLine
 
     if ( ( _r.lastReportTicks ) && ( lastTime != _r.lastReportus ) )
         genericsFPrintf( stdout, "Interval = " C_DATA "%" PRIu64 "ms " C_RESET "/ "C_DATA "%" PRIu64 C_RESET " (~" C_DATA "%" PRIu64 C_RESET " Ticks/ms)" EOL,
-                         ( ( lastTime - _r.lastReportus ) ) / 1000, _r.timeStamp - _r.lastReportTicks, ( ( _r.timeStamp - _r.lastReportTicks ) * 1000 ) / ( lastTime - _r.lastReportus ) );
+                         ( ( lastTime - _r.lastReportus ) ) / 1000, TSClockTicks( &_r.tsClock ) - _r.lastReportTicks, ( ( TSClockTicks( &_r.tsClock ) - _r.lastReportTicks ) * 1000 ) / ( lastTime - _r.lastReportus ) );
     else
     {
         genericsFPrintf( stdout, C_RESET "Interval = " C_DATA "%" PRIu64 C_RESET "ms" EOL, ( ( lastTime - _r.lastReportus ) ) / 1000 );
@@ -799,13 +1776,158 @@ static void _outputTop( uint32_t total, uint32_t reportLines, struct reportLine
 }
 
 // ====================================================================================================
-void _handlePCSample( struct pcSampleMsg *m, struct ITMDecoder *i )
+static void _covMark( uint32_t functionindex )
+
+/* Note a sample landing in this function. Worker thread only, with the address lock held */
 
 {
-    assert( m->msgtype == MSG_PC_SAMPLE );
+    if ( !options.covFile )
+    {
+        return;
+    }
+
+    uint32_t word = functionindex >> 6;
+
+    if ( word >= _r.covLen )
+    {
+        /* Sized to the symbol set, but sentinel indices (sleep, interrupt) land beyond it */
+        uint32_t newLen = word + 1;
+        _r.covEver = ( uint64_t * )realloc( _r.covEver, newLen * sizeof( uint64_t ) );
+        MEMCHECKV( _r.covEver );
+        _r.covInterval = ( uint64_t * )realloc( _r.covInterval, newLen * sizeof( uint64_t ) );
+        MEMCHECKV( _r.covInterval );
+        memset( &_r.covEver[_r.covLen], 0, ( newLen - _r.covLen ) * sizeof( uint64_t ) );
+        memset( &_r.covInterval[_r.covLen], 0, ( newLen - _r.covLen ) * sizeof( uint64_t ) );
+        _r.covLen = newLen;
+    }
+
+    _r.covEver[word]     |= 1ULL << ( functionindex & 63 );
+    _r.covInterval[word] |= 1ULL << ( functionindex & 63 );
+}
+// ====================================================================================================
+static void _aggregatePC( uint32_t pc )
 
+/* Account for a PC sample in the address hash, creating its entry if it's new. Worker
+ * thread only, with the address lock held.
+ */
+
+{
     struct visitedAddr *a;
 
+    /* Skewed distributions mean most samples hit a handful of addresses; those are
+     * resolved from the front cache in one probe without touching the shards */
+    struct frontCacheEnt *fc = &_r.frontCache[FRONT_CACHE_IDX( pc )];
+
+    if ( ( fc->a ) && ( fc->pc == pc ) )
+    {
+        fc->a->visits++;
+        _r.frontHits++;
+        _r.addressShard[ADDR_SHARD( pc )].dirty = true;
+        _covMark( fc->a->n->functionindex );
+        return;
+    }
+
+    struct addrShard *sh = &_r.addressShard[ADDR_SHARD( pc )];
+
+    sh->dirty = true;
+
+    /* One probe covers both lookup and insertion */
+    void **slot = flathashEntry( &sh->addresses, pc );
+    MEMCHECKV( slot );
+
+    if ( *slot )
+    {
+        a = ( struct visitedAddr * )*slot;
+        a->visits++;
+        _r.lookupHits++;
+        fc->pc = pc;
+        fc->a  = a;
+        _covMark( a->n->functionindex );
+    }
+    else
+    {
+        struct nameEntry n;
+
+        _r.lookupMisses++;
+
+        /* Find a matching name record if there is one */
+        SymbolLookup( _r.s, pc, &n );
+
+        /* This is a new entry - record it */
+
+        a = ( struct visitedAddr * )calloc( 1, sizeof( struct visitedAddr ) );
+        MEMCHECKV( a );
+        a->visits = 1;
+
+        a->n = ( struct nameEntry * )malloc( sizeof( struct nameEntry ) );
+        MEMCHECKV( a->n );
+        memcpy( a->n, &n, sizeof( struct nameEntry ) );
+        *slot = a;
+        fc->pc = pc;
+        fc->a  = a;
+        _covMark( a->n->functionindex );
+    }
+}
+// ====================================================================================================
+static void *_sampleWorkerTask( void *arg )
+
+/* Drain raw PC samples into the address hash. Runs parallel to the decode loop so symbol
+ * lookups and hash maintenance never hold up reception at high sample rates.
+ */
+
+{
+    struct timespec ts;
+
+    while ( !_r.ending )
+    {
+        pthread_mutex_lock( &_r.pcMutex );
+
+        if ( atomic_load( &_r.pcWp ) == atomic_load( &_r.pcRp ) )
+        {
+            clock_gettime( CLOCK_REALTIME, &ts );
+            ts.tv_nsec += WORKER_WAIT_MS * 1000000;
+
+            if ( ts.tv_nsec >= 1000000000 )
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+
+            pthread_cond_timedwait( &_r.pcUpdated, &_r.pcMutex, &ts );
+        }
+
+        pthread_mutex_unlock( &_r.pcMutex );
+
+        uint32_t wp = atomic_load( &_r.pcWp );
+        uint32_t rp = atomic_load( &_r.pcRp );
+
+        STATSEG_SET( _r.stats, queueDepth, wp - rp );
+
+        if ( wp == rp )
+        {
+            continue;
+        }
+
+        pthread_mutex_lock( &_r.addressLock );
+
+        while ( rp != wp )
+        {
+            _aggregatePC( _r.pcBuff[rp % PC_BUFF_LEN] );
+            rp++;
+        }
+
+        atomic_store( &_r.pcRp, rp );
+        pthread_mutex_unlock( &_r.addressLock );
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+void _handlePCSample( struct pcSampleMsg *m, struct ITMDecoder *i )
+
+{
+    assert( m->msgtype == MSG_PC_SAMPLE );
+
     if ( m->sleep )
     {
         /* This is a sleep packet */
@@ -813,48 +1935,91 @@ void _handlePCSample( struct pcSampleMsg *m, struct ITMDecoder *i )
     }
     else
     {
-        HASH_FIND_INT( _r.addresses, &m->pc, a );
+        _r.samplesSeen++;
+        STATSEG_ADD( _r.stats, events, 1 );
+        uint32_t wp = atomic_load( &_r.pcWp );
 
-        if ( a )
+        if ( wp - atomic_load( &_r.pcRp ) >= PC_BUFF_LEN )
         {
-            a->visits++;
+            /* The worker has fallen a whole buffer behind...shed this sample rather than stall */
+            _r.samplesDropped++;
+            STATSEG_ADD( _r.stats, drops, 1 );
         }
         else
         {
-            struct nameEntry n;
+            _r.pcBuff[wp % PC_BUFF_LEN] = m->pc;
+            atomic_store( &_r.pcWp, wp + 1 );
+
+            /* Only kick the worker on the empty-to-nonempty edge; its timed wait covers the rest */
+            if ( wp == atomic_load( &_r.pcRp ) )
+            {
+                pthread_mutex_lock( &_r.pcMutex );
+                pthread_cond_signal( &_r.pcUpdated );
+                pthread_mutex_unlock( &_r.pcMutex );
+            }
+        }
+    }
+}
+// ====================================================================================================
+static void _handleSampleRun( uint32_t addr, uint32_t count, void *param )
+
+/* One run from a daemon-compressed sample batch; same destination as _handlePCSample but
+ * a whole run of identical addresses is costed and queued in one pass.
+ */
 
-            /* Find a matching name record if there is one */
-            SymbolLookup( _r.s, m->pc, &n );
+{
+    uint32_t wp = atomic_load( &_r.pcWp );
+    uint32_t rp = atomic_load( &_r.pcRp );
+    uint32_t space = PC_BUFF_LEN - ( wp - rp );
+    uint32_t take = ( count < space ) ? count : space;
+
+    _r.samplesSeen += count;
+    _r.samplesDropped += count - take;
+    STATSEG_ADD( _r.stats, events, count );
+    STATSEG_ADD( _r.stats, drops, count - take );
 
-            /* This is a new entry - record it */
+    for ( uint32_t i = 0; i < take; i++ )
+    {
+        _r.pcBuff[( wp + i ) % PC_BUFF_LEN] = addr;
+    }
 
-            a = ( struct visitedAddr * )calloc( 1, sizeof( struct visitedAddr ) );
-            MEMCHECKV( a );
-            a->visits = 1;
+    if ( take )
+    {
+        atomic_store( &_r.pcWp, wp + take );
 
-            a->n = ( struct nameEntry * )malloc( sizeof( struct nameEntry ) );
-            MEMCHECKV( a->n );
-            memcpy( a->n, &n, sizeof( struct nameEntry ) );
-            HASH_ADD_INT( _r.addresses, n->addr, a );
+        if ( wp == rp )
+        {
+            pthread_mutex_lock( &_r.pcMutex );
+            pthread_cond_signal( &_r.pcUpdated );
+            pthread_mutex_unlock( &_r.pcMutex );
         }
     }
 }
 // ====================================================================================================
-void _flushHash( void )
+static void _disposeAddr( void *v )
 
 {
-    struct visitedAddr *a, *tmp;
+    struct visitedAddr *a = ( struct visitedAddr * )v;
 
-    HASH_ITER( hh, _r.addresses, a, tmp )
+    if ( a->n )
     {
-        if ( a->n )
-        {
-            free( a->n );
-        }
+        free( a->n );
+    }
+
+    free( a );
+}
+// ====================================================================================================
+void _flushHash( void )
 
-        HASH_DEL( _r.addresses, a );
-        free( a );
+{
+    for ( uint32_t s = 0; s < NUM_ADDR_SHARDS; s++ )
+    {
+        flathashEmpty( &_r.addressShard[s].addresses, _disposeAddr );
+        _r.addressShard[s].dirty = false;
     }
+
+    /* The front cache points into what was just freed */
+    memset( _r.frontCache, 0, sizeof( _r.frontCache ) );
 }
 // ====================================================================================================
 // Pump characters into the itm decoder
@@ -919,6 +2084,8 @@ void _printHelp( const char *const progName )
 
 {
     genericsFPrintf( stderr, "Usage: %s [options]" EOL, progName );
+    genericsFPrintf( stderr, "    -b, --bench:        Replay input file at full speed and report pipeline costs" EOL );
+    genericsFPrintf( stderr, "    -B, --baseline:     <filename> Saved JSON report to show per-function deltas against" EOL );
     genericsFPrintf( stderr, "    -c, --cut-after:    <num> Cut screen output after number of lines" EOL );
     genericsFPrintf( stderr, "    -D, --no-demangle:  Switch off C++ symbol demangling" EOL );
     genericsFPrintf( stderr, "    -d, --del-prefix:   <DeleteMaterial> to take off front of filenames" EOL );
@@ -927,8 +2094,10 @@ void _printHelp( const char *const progName )
     genericsFPrintf( stderr, "    -f, --input-file:   <filename> Take input from specified file" EOL );
     genericsFPrintf( stderr, "    -g, --record-file:  <LogFile> append historic records to specified file" EOL );
     genericsFPrintf( stderr, "    -h, --help:         This help" EOL );
+    genericsFPrintf( stderr, "    -H, --heatmap:      Include per-line sample counts in JSON output" EOL );
     genericsFPrintf( stderr, "    -I, --interval:     <interval> Display interval in milliseconds (defaults to %dms)" EOL, TOP_UPDATE_INTERVAL );
     genericsFPrintf( stderr, "    -j, --json-file:    <filename> Output to file in JSON format (or screen if <filename> is '-')" EOL );
+    genericsFPrintf( stderr, "    -k, --coverage-file: <filename> Write visited-function coverage each interval" EOL );
     genericsFPrintf( stderr, "    -l, --agg-lines:    Aggregate per line rather than per function" EOL );
     genericsFPrintf( stderr, "    -M, --no-colour:    Supress colour in output" EOL );
     genericsFPrintf( stderr, "    -n, --itm-sync:     Enforce sync requirement for ITM (i.e. ITM needs to issue syncs)" EOL );
@@ -940,8 +2109,10 @@ void _printHelp( const char *const progName )
     genericsFPrintf( stderr, "    -R, --report-files: Report filenames as part of function discriminator" EOL );
     genericsFPrintf( stderr, "    -s, --server:       <Server>:<Port> to use" EOL );
     genericsFPrintf( stderr, "    -t, --tag:          <stream> Which OFLOW tag to use (normally 1)" EOL );
+    genericsFPrintf( stderr, "    -u, --remote-file:  <filename> Emit compact screen-diff records for a remote renderer ('-' for stdout)" EOL );
     genericsFPrintf( stderr, "    -v, --verbose:      <level> Verbose mode 0(errors)..3(debug)" EOL );
     genericsFPrintf( stderr, "    -V, --version:      Print version and exit" EOL );
+    genericsFPrintf( stderr, "    -x, --ex-traces:    Include the last %d entry/exit records per exception vector in JSON output" EOL, EXC_TRACE_DEPTH );
     genericsFPrintf( stderr, EOL "Environment Variables;" EOL );
     genericsFPrintf( stderr, "  OBJDUMP: to use non-standard obbdump binary" EOL );
 }
@@ -954,6 +2125,8 @@ void _printVersion( void )
 // ====================================================================================================
 static struct option _longOptions[] =
 {
+    {"bench", no_argument, NULL, 'b'},
+    {"baseline", required_argument, NULL, 'B'},
     {"cut-after", required_argument, NULL, 'c'},
     {"no-demangle", required_argument, NULL, 'D'},
     {"del-prefix", required_argument, NULL, 'd'},
@@ -961,9 +2134,11 @@ static struct option _longOptions[] =
     {"exceptions", no_argument, NULL, 'E'},
     {"input-file", required_argument, NULL, 'f'},
     {"record-file", required_argument, NULL, 'g'},
+    {"heatmap", no_argument, NULL, 'H'},
     {"help", no_argument, NULL, 'h'},
     {"interval", required_argument, NULL, 'I'},
     {"json-file", required_argument, NULL, 'j'},
+    {"coverage-file", required_argument, NULL, 'k'},
     {"agg-lines", no_argument, NULL, 'l'},
     {"itm-sync", no_argument, NULL, 'n'},
     {"no-colour", no_argument, NULL, 'M'},
@@ -976,8 +2151,10 @@ static struct option _longOptions[] =
     {"report-files", no_argument, NULL, 'R'},
     {"server", required_argument, NULL, 's'},
     {"tag", required_argument, NULL, 't'},
+    {"remote-file", required_argument, NULL, 'u'},
     {"verbose", required_argument, NULL, 'v'},
     {"version", no_argument, NULL, 'V'},
+    {"ex-traces", no_argument, NULL, 'x'},
     {NULL, no_argument, NULL, 0}
 };
 // ====================================================================================================
@@ -988,9 +2165,19 @@ errcode _processOptions( int argc, char *argv[] )
     bool protExplicit = false;
     bool serverExplicit = false;
 
-    while ( ( c = getopt_long ( argc, argv, "c:d:DEe:f:g:hVI:j:lMnO:o:p:P:r:Rs:t:v:", _longOptions, &optionIndex ) ) != -1 )
+    while ( ( c = getopt_long ( argc, argv, "bB:c:d:DEe:f:g:hHVI:j:k:lMnO:o:p:P:r:Rs:t:u:v:x", _longOptions, &optionIndex ) ) != -1 )
         switch ( c )
         {
+            // ------------------------------------
+            case 'b':
+                options.benchmark = true;
+                break;
+
+            // ------------------------------------
+            case 'B':
+                options.baselineFile = optarg;
+                break;
+
             // ------------------------------------
             case 'c':
                 options.cutscreen = atoi( optarg );
@@ -1059,6 +2246,12 @@ errcode _processOptions( int argc, char *argv[] )
                 break;
 
             // ------------------------------------
+            case 'k':
+                options.covFile = optarg;
+                break;
+
+            // ------------------------------------
+
             case 'o':
                 options.outfile = optarg;
                 break;
@@ -1121,11 +2314,26 @@ errcode _processOptions( int argc, char *argv[] )
                 options.tag = atoi( optarg );
                 break;
 
+            // ------------------------------------
+            case 'u':
+                options.remoteFile = optarg;
+                break;
+
             // ------------------------------------
             case 'R':
                 options.reportFilenames = true;
                 break;
 
+            // ------------------------------------
+            case 'x':
+                options.exTraces = true;
+                break;
+
+            // ------------------------------------
+            case 'H':
+                options.heatmap = true;
+                break;
+
             // ------------------------------------
             case 's':
                 options.server = optarg;
@@ -1195,6 +2403,18 @@ errcode _processOptions( int argc, char *argv[] )
         return ERR;
     }
 
+    if ( ( options.heatmap ) && ( !options.json ) )
+    {
+        genericsReport( V_ERROR, "Heatmap output is only produced in JSON mode (-j)" EOL );
+        return ERR;
+    }
+
+    if ( ( options.benchmark ) && ( !options.file ) )
+    {
+        genericsReport( V_ERROR, "Benchmark mode needs a recorded input file" EOL );
+        return ERR;
+    }
+
     genericsReport( V_INFO, "orbtop version " GIT_DESCRIBE EOL );
 
     if ( options.file )
@@ -1213,6 +2433,7 @@ errcode _processOptions( int argc, char *argv[] )
     genericsReport( V_INFO, "C++ Demangle     : %s" EOL, options.demangle ? "true" : "false" );
     genericsReport( V_INFO, "Display Interval : %d ms" EOL, options.displayInterval / 1000 );
     genericsReport( V_INFO, "Log File         : %s" EOL, options.logfile ? options.logfile : "None" );
+    genericsReport( V_INFO, "Remote Stream    : %s" EOL, options.remoteFile ? options.remoteFile : "None" );
     genericsReport( V_INFO, "Objdump options  : %s" EOL, options.odoptions ? options.odoptions : "None" );
 
     switch ( options.protocol )
@@ -1256,6 +2477,14 @@ static void _OFLOWpacketRxed ( struct OFLOWFrame *p, void *param )
                 _itmPumpProcess( p->d[i] );
             }
         }
+        else if ( p->tag == SAMPLECOMP_TAG )
+        {
+            /* Daemon-side compressed sample batch; bypasses ITM decode entirely */
+            if ( !SampleCompDecode( p->d, p->len, _handleSampleRun, NULL ) )
+            {
+                genericsReport( V_INFO, "Bad sample batch received" EOL );
+            }
+        }
     }
 }
 
@@ -1273,6 +2502,109 @@ static struct Stream *_openStream( void )
     }
 }
 
+// ====================================================================================================
+static void _runBenchmark( void )
+
+/* Replay a recorded file through the full pipeline at maximum speed with the UI disabled, */
+/* then report decode rate, lookup-cache effectiveness and report-generation time.         */
+
+{
+    uint8_t cbw[TRANSFER_SIZE];
+    struct timeval tv;
+    size_t receivedSize;
+    uint64_t totalBytes = 0;
+    struct reportLine *report;
+    uint32_t reportLines = 0;
+    uint32_t total;
+
+    /* Symbols have to be in place before any samples arrive */
+    pthread_mutex_lock( &_r.addressLock );
+
+    if ( !SymbolSetValid( &_r.s, options.elffile ) )
+    {
+        if ( SYMBOL_OK != SymbolSetCreate( &_r.s, options.elffile, options.deleteMaterial, options.demangle, true, true, options.odoptions ) )
+        {
+            pthread_mutex_unlock( &_r.addressLock );
+            genericsExit( -1, "Couldn't load elf file for benchmark" EOL );
+        }
+    }
+
+    pthread_mutex_unlock( &_r.addressLock );
+
+    struct Stream *stream = _openStream();
+
+    if ( !stream )
+    {
+        genericsExit( -1, "Couldn't open %s" EOL, options.file );
+    }
+
+    int64_t pumpStart = _timestamp();
+
+    while ( !_r.ending )
+    {
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        enum ReceiveResult r = stream->receive( stream, cbw, TRANSFER_SIZE, &tv, &receivedSize );
+
+        if ( receivedSize )
+        {
+            totalBytes += receivedSize;
+
+            if ( PROT_OFLOW == options.protocol )
+            {
+                OFLOWPump( &_r.c, cbw, receivedSize, _OFLOWpacketRxed, &_r );
+            }
+            else
+            {
+                uint8_t *c = cbw;
+
+                while ( receivedSize-- )
+                {
+                    _itmPumpProcess( *c++ );
+                }
+            }
+        }
+
+        if ( ( r == RECEIVE_RESULT_EOF ) || ( r == RECEIVE_RESULT_ERROR ) )
+        {
+            break;
+        }
+    }
+
+    int64_t pumpTime = _timestamp() - pumpStart;
+
+    /* Let the aggregation worker catch up before we measure the report */
+    while ( atomic_load( &_r.pcRp ) != atomic_load( &_r.pcWp ) )
+    {
+        usleep( 1000 );
+    }
+
+    int64_t drainTime = _timestamp() - pumpStart;
+
+    pthread_mutex_lock( &_r.addressLock );
+    int64_t reportStart = _timestamp();
+    total = _consolodateReport( &report, &reportLines );
+    int64_t reportTime = _timestamp() - reportStart;
+    pthread_mutex_unlock( &_r.addressLock );
+    free( report );
+
+    uint64_t lookups = _r.frontHits + _r.lookupHits + _r.lookupMisses;
+
+    genericsFPrintf( stdout, "Replay  : %" PRIu64 " bytes in %" PRId64 " us (%.2f MB/s)" EOL,
+                     totalBytes, pumpTime, pumpTime ? ( ( double )totalBytes / 1.048576 ) / pumpTime : 0 );
+    genericsFPrintf( stdout, "Samples : %" PRIu64 " processed, %" PRIu32 " dropped, %" PRIu64 " samples/sec (%" PRIu64 " incl. aggregation drain)" EOL,
+                     _r.samplesSeen, _r.samplesDropped,
+                     pumpTime ? ( _r.samplesSeen * 1000000 ) / pumpTime : 0,
+                     drainTime ? ( _r.samplesSeen * 1000000 ) / drainTime : 0 );
+    genericsFPrintf( stdout, "Lookups : %" PRIu64 " front cache, %" PRIu64 " hash hits, %" PRIu64 " symbol lookups (%.2f%% cached)" EOL,
+                     _r.frontHits, _r.lookupHits, _r.lookupMisses,
+                     lookups ? ( 100.0 * ( _r.frontHits + _r.lookupHits ) ) / lookups : 0 );
+    genericsFPrintf( stdout, "Report  : %" PRIu32 " lines over %" PRIu32 " samples in %" PRId64 " us" EOL,
+                     reportLines, total, reportTime );
+
+    stream->close( stream );
+    free( stream );
+}
 // ====================================================================================================
 static void _intHandler( int sig )
 
@@ -1290,6 +2622,8 @@ static void _intHandler( int sig )
 int main( int argc, char *argv[] )
 
 {
+    selfprofInit( "orbtop" );
+
     uint8_t cbw[TRANSFER_SIZE];
 
     /* Output variables for interval report */
@@ -1340,11 +2674,22 @@ int main( int argc, char *argv[] )
         genericsReport( V_INFO, "Files:      %d" EOL "Functions: %d" EOL "Source:    %d" EOL, _r.s->fileCount, _r.s->functionCount, _r.s->sourceCount );
     }
 
+    /* Let the kernel tell us about image changes where it can; interval processing then
+     * never has to stat the elf, which matters when it sits on a network filesystem. */
+    struct symbolWatcher *watcher = SymbolWatcherCreate( options.elffile );
+
+    if ( watcher )
+    {
+        genericsReport( V_INFO, "Watching elf for change notifications" EOL );
+    }
+
 
     /* Reset the handlers before we start */
     ITMDecoderInit( &_r.i, options.forceITMSync );
     OFLOWInit( &_r.c );
+    TSClockInit( &_r.tsClock, 0 );
     MSGSeqInit( &_r.d, &_r.i, MSG_REORDER_BUFLEN );
+    _r.stats = statsegPublish( "orbtop" );
 
     /* This ensures the signal handler gets called */
     if ( SIG_ERR == signal( SIGINT, _intHandler ) )
@@ -1356,6 +2701,16 @@ int main( int argc, char *argv[] )
     _r.lastReportus = _timestamp();
     _r.currentException = NO_EXCEPTION;
 
+    /* Get the sample aggregation worker going */
+    pthread_mutex_init( &_r.pcMutex, NULL );
+    pthread_cond_init( &_r.pcUpdated, NULL );
+    pthread_mutex_init( &_r.addressLock, NULL );
+
+    if ( pthread_create( &_r.workerThread, NULL, &_sampleWorkerTask, NULL ) )
+    {
+        genericsExit( -1, "Failed to create sample aggregation thread" EOL );
+    }
+
     /* Open file for JSON output if we have one */
     if ( options.json )
     {
@@ -1375,6 +2730,38 @@ int main( int argc, char *argv[] )
         }
     }
 
+    /* Saved run to diff the live view against, hashed once here */
+    if ( options.baselineFile )
+    {
+        _baselineLoad( options.baselineFile );
+    }
+
+    /* ...and the stream carrying diff records to a remote renderer */
+    if ( options.remoteFile )
+    {
+        if ( options.remoteFile[0] == '-' )
+        {
+            _r.remotefile = stdout;
+        }
+        else
+        {
+            _r.remotefile = fopen( options.remoteFile, "w" );
+
+            if ( !_r.remotefile )
+            {
+                perror( "Couldn't open remote diff output file" );
+                return -ENOENT;
+            }
+        }
+    }
+
+    if ( options.benchmark )
+    {
+        /* Replay-bench takes over the whole run; no UI, no interval reports */
+        _runBenchmark();
+        _r.ending = true;
+    }
+
     while ( !_r.ending )
     {
         struct Stream *stream = _openStream();
@@ -1432,8 +2819,29 @@ int main( int argc, char *argv[] )
                 /* We are at EOF, hopefully next loop will get more data. */
             }
 
-            /* Check to make sure our symbols are still appropriate */
-            if ( !SymbolSetValid( &_r.s, options.elffile ) )
+            /* Check to make sure our symbols are still appropriate. The worker resolves
+             * against these symbols and holds references into the hash, so it has to be
+             * stopped at the fence while they're replaced. */
+            pthread_mutex_lock( &_r.addressLock );
+
+            bool symbolsValid;
+
+            if ( watcher )
+            {
+                /* Change notification is pushed by the kernel, so this path never stats the file */
+                if ( SymbolWatcherChanged( watcher ) )
+                {
+                    SymbolSetDelete( &_r.s );
+                }
+
+                symbolsValid = ( NULL != _r.s );
+            }
+            else
+            {
+                symbolsValid = SymbolSetValid( &_r.s, options.elffile );
+            }
+
+            if ( !symbolsValid )
             {
                 /* Make sure old references are invalidated */
                 _flushHash();
@@ -1460,22 +2868,28 @@ int main( int argc, char *argv[] )
 
                 if ( SYMBOL_NOELF == r )
                 {
+                    pthread_mutex_unlock( &_r.addressLock );
                     usleep( 1000000L );
                     continue;
                 }
 
                 genericsReport( V_WARN, "Loaded %s" EOL, options.elffile );
 
+                /* Symbol indices have changed, so the cached screen rows are meaningless */
+                _screen.valid = false;
+
                 if ( _r.s )
                 {
                     genericsReport( V_INFO, "Files:      %d" EOL "Functions: %d" EOL "Source:    %d" EOL, _r.s->fileCount, _r.s->functionCount, _r.s->sourceCount );
                 }
             }
 
-
+            pthread_mutex_unlock( &_r.addressLock );
 
             if ( receivedSize )
             {
+                STATSEG_ADD( _r.stats, bytes, receivedSize );
+
                 if ( PROT_OFLOW == options.protocol )
                 {
                     OFLOWPump( &_r.c, cbw, receivedSize, _OFLOWpacketRxed, &_r );
@@ -1496,23 +2910,46 @@ int main( int argc, char *argv[] )
             /* See if its time to post-process it */
             if ( receiveResult == RECEIVE_RESULT_TIMEOUT || remainTime <= 0 )
             {
-                /* Create the report that we will output */
+                /* Create the report that we will output. The worker is held off for the
+                 * duration since the report borrows name records owned by the hash. */
+                pthread_mutex_lock( &_r.addressLock );
+
+                if ( _r.samplesDropped )
+                {
+                    genericsReport( V_WARN, "%" PRIu32 " samples dropped, aggregation did not keep up" EOL, _r.samplesDropped );
+                    _r.samplesDropped = 0;
+                }
+
                 total = _consolodateReport( &report, &reportLines );
 
+                /* Rendering happens outside the lock; the worker only adds entries and bumps
+                 * visit counts, so the name records the report borrows stay valid. The address
+                 * map itself persists, which means no repeated symbol lookups on long sessions. */
+                pthread_mutex_unlock( &_r.addressLock );
+
                 if ( options.json )
                 {
                     _outputJson( _r.jsonfile, total, reportLines, report, thisTime );
                 }
 
-                if ( ( !options.json ) || ( options.json[0] != '-' ) )
+                if ( ( _r.remotefile ) && ( total ) )
+                {
+                    _outputRemote( _r.remotefile, total, reportLines, report );
+                }
+
+                if ( ( ( !options.json ) || ( options.json[0] != '-' ) ) &&
+                        ( ( !options.remoteFile ) || ( options.remoteFile[0] != '-' ) ) )
                 {
                     _outputTop( total, reportLines, report, thisTime );
                 }
 
+                if ( ( options.covFile ) && ( _r.covLen ) )
+                {
+                    _outputCoverage();
+                }
+
                 /* ... and we are done with the report now, get rid of it */
                 free( report );
-                /* and, the hash of seen addresses! */
-                _flushHash();
 
                 /* ...and zero the exception records */
                 for ( uint32_t e = 0; e < MAX_EXCEPTIONS; e++ )
@@ -1520,6 +2957,14 @@ int main( int argc, char *argv[] )
                     _r.er[e].visits = _r.er[e].maxDepth = _r.er[e].totalTime = _r.er[e].minTime = _r.er[e].maxTime = _r.er[e].maxWallTime = 0;
                 }
 
+                /* Rotate the histogram window; the oldest interval's distribution is retired */
+                _r.histoSlot = ( _r.histoSlot + 1 ) % EXC_HISTO_WINDOW;
+
+                for ( uint32_t e = 0; e < MAX_EXCEPTIONS; e++ )
+                {
+                    memset( _r.er[e].histo[_r.histoSlot], 0, sizeof( _r.er[e].histo[_r.histoSlot] ) );
+                }
+
                 /* ... and the event counters */
                 for ( uint32_t i = 0; i < DWT_NUM_EVENTS; i++ )
                 {
@@ -1540,7 +2985,7 @@ int main( int argc, char *argv[] )
                 _r.TSPkt = ITMDecoderGetStats( &_r.i )->TSPkt;
                 _r.HWPkt = ITMDecoderGetStats( &_r.i )->HWPkt;
                 _r.lastReportus =  thisTime;
-                _r.lastReportTicks = _r.timeStamp;
+                _r.lastReportTicks = TSClockTicks( &_r.tsClock );
 
                 /* Check to make sure there's not an unexpected TPIU in here */
                 if ( ITMDecoderGetStats( &_r.i )->tpiuSyncCount )
@@ -1560,7 +3005,18 @@ int main( int argc, char *argv[] )
         free( stream );
     }
 
-    if ( !_r.ending && ( !ITMDecoderGetStats( &_r.i )->tpiuSyncCount ) )
+    /* Collect the aggregation worker before we go */
+    bool wasEnding = _r.ending;
+    _r.ending = true;
+    pthread_mutex_lock( &_r.pcMutex );
+    pthread_cond_signal( &_r.pcUpdated );
+    pthread_mutex_unlock( &_r.pcMutex );
+    pthread_join( _r.workerThread, NULL );
+
+    SymbolWatcherDelete( &watcher );
+    statsegUnpublish( _r.stats );
+
+    if ( !wasEnding && ( !ITMDecoderGetStats( &_r.i )->tpiuSyncCount ) )
     {
         genericsReport( V_ERROR, "Read failed" EOL );
     }
@@ -16,6 +16,7 @@
 #include <getopt.h>
 
 #include "git_version_info.h"
+#include "selfprof.h"
 #include "generics.h"
 
 #include "orbtraceIf.h"
@@ -42,6 +43,7 @@ struct Options
     uint32_t serial_speed;    /* Speed of serial communication via SWO */
 
     /* Power settings */
+    char *sessionFile;        /* Batched command lines to run over one device connection */
     bool forceVoltage;        /* Force application of voltage */
     int TPwrmv;               /* Target power setting in mv */
     int TRefmv;               /* Target voltage setting in mv */
@@ -52,7 +54,7 @@ struct Options
 enum Actions { ACTION_BRIGHTNESS, ACTION_ENCHANGE_VTREF, ACTION_ENCHANGE_VTPWR, ACTION_LIST_DEVICES,
                ACTION_LOCKDEVICE, ACTION_SETNICK, ACTION_VCHANGE_VTREF, ACTION_VCHANGE_VTPWR, ACTION_SN,
                ACTION_UNLOCK, ACTION_WRITE_PARAMS, ACTION_READ_PARAMS, ACTION_RESET_PARAMS, ACTION_SET_TRACE,
-               ACTION_SERIAL_SPEED,
+               ACTION_SERIAL_SPEED, ACTION_CAL_SPEED,
                ACTION_ENCHANGE_ALL
              };
 
@@ -139,6 +141,8 @@ static void _printHelp( const char *const progName )
 {
     genericsFPrintf( stderr, "Usage: %s [options]" EOL, progName );
     genericsFPrintf( stderr, "       -a, --serial-speed:  <serialSpeed> to use (when SWO UART is selected)" EOL );
+    genericsFPrintf( stderr, "       -C, --calibrate:     Calibrate SWO UART baudrate to the highest rate that decodes" EOL \
+                     "                            cleanly, capped by -a when given" EOL );
     genericsFPrintf( stderr, "       -e, --power:         <Ch>,<On> Enable or Disable power. Ch is vtref, vtpwr or all" EOL );
     genericsFPrintf( stderr, "       -h, --help::         This help" EOL );
     genericsFPrintf( stderr, "       -l, --list:          Show all OrbTrace devices attached to system" EOL );
@@ -148,6 +152,8 @@ static void _printHelp( const char *const progName )
                      "                                              M for Manchester SWO+TPIU, U=UART SWO+TPIU" EOL );
     genericsFPrintf( stderr, "       -n, --serial-number: <Serial> any part of serial number to differentiate specific OrbTrace device" EOL );
     genericsFPrintf( stderr, "       -p, --voltage:       <Ch>,<Voltage> Set voltage in V, Ch is vtref or vtpwr" EOL );
+    genericsFPrintf( stderr, "       -s, --session:       <file> Run option lines from file ('-' for stdin) over one" EOL \
+                     "                            device connection, avoiding USB re-enumeration per operation" EOL );
     genericsFPrintf( stderr, "       -v, --verbose:       <level> Verbose mode 0(errors)..3(debug)" EOL );
     genericsFPrintf( stderr, "       -V, --version:       Print version and exit" EOL );
 
@@ -172,6 +178,7 @@ void _printVersion( void )
 static struct option _longOptions[] =
 {
     {"serial-speed", required_argument, NULL, 'a'},
+    {"calibrate", no_argument, NULL, 'C'},
     {"power", required_argument, NULL, 'e'},
     {"help", no_argument, NULL, 'h'},
     {"list", no_argument, NULL, 'l'},
@@ -181,6 +188,7 @@ static struct option _longOptions[] =
     {"trace-format", required_argument, NULL, 'T'},
     {"serial-number", required_argument, NULL, 'n'},
     {"voltage", required_argument, NULL, 'p'},
+    {"session", required_argument, NULL, 's'},
     {"verbose", required_argument, NULL, 'v'},
     {"version", no_argument, NULL, 'V'},
     {NULL, no_argument, NULL, 0}
@@ -218,7 +226,7 @@ static int _processOptions( struct RunTime *r, int argc, char *argv[]  )
     bool action;
     char *a;
 
-    while ( ( c = getopt_long ( argc, argv, "a:e:hlp:Mn:T:v:V", _longOptions, &optionIndex ) ) != -1 )
+    while ( ( c = getopt_long ( argc, argv, "a:Ce:hlp:Mn:s:T:v:V", _longOptions, &optionIndex ) ) != -1 )
         switch ( c )
         {
             // ------------------------------------
@@ -233,6 +241,11 @@ static int _processOptions( struct RunTime *r, int argc, char *argv[]  )
                 _set_action( r, ACTION_BRIGHTNESS );
                 break;
 
+            // ------------------------------------
+            case 'C': /* Calibrate serial speed */
+                _set_action( r, ACTION_CAL_SPEED );
+                break;
+
             // ------------------------------------
             case 'e':
                 channel = OrbtraceIfNameToChannel( optarg );
@@ -356,6 +369,11 @@ static int _processOptions( struct RunTime *r, int argc, char *argv[]  )
                 _set_action( r, ACTION_SET_TRACE );
                 break;
 
+            // ------------------------------------
+            case 's': /* Run a batched session */
+                r->options->sessionFile = optarg;
+                break;
+
             // ------------------------------------
             case 'p': /* Set power */
                 channel = OrbtraceIfNameToChannel( optarg );
@@ -464,6 +482,12 @@ static int _processOptions( struct RunTime *r, int argc, char *argv[]  )
         return false;
     }
 
+    if ( _tst_action( r, ACTION_CAL_SPEED ) && ( r->options->swoMANCH ) )
+    {
+        genericsReport( V_ERROR, "Baudrate calibration applies to UART SWO only; Manchester is self-clocking" EOL );
+        return false;
+    }
+
     if ( ( _tst_action( r, ACTION_SET_TRACE ) ) &&
             ( ( ( r->options->traceWidth ) && ( ( r->options->swoUART ) || ( r->options->swoMANCH ) ) ) ||
               ( ( r->options->swoUART ) && ( r->options->swoMANCH ) ) ) )
@@ -498,6 +522,153 @@ static int _processOptions( struct RunTime *r, int argc, char *argv[]  )
     return true;
 }
 // ====================================================================================================
+static int _performActions( struct RunTime *r );
+
+static int _executeActions( struct RunTime *r )
+
+/* Validate and stage the requested actions against the open device, then commit them */
+
+{
+    int retVal;
+
+    if ( !_checkVoltages( r ) )
+    {
+        genericsReport( V_ERROR, "Specified interface voltage check failed" EOL );
+        return -1;
+    }
+
+    /* Stage the settings from the actions and send them in as few transfers as the firmware allows */
+    OrbtraceIfBatchBegin( r->dev );
+    retVal = _performActions( r );
+
+    if ( !OrbtraceIfBatchCommit( r->dev ) )
+    {
+        genericsReport( V_ERROR, "Committing settings to device failed" EOL );
+        retVal |= -1;
+    }
+
+    /* Calibration samples live trace at each candidate rate, so it has to run after any trace
+     * mode change has actually reached the device, not inside the batch.
+     */
+    if ( _tcl_action( r, ACTION_CAL_SPEED ) )
+    {
+        uint32_t calibrated;
+
+        genericsReport( V_INFO, "Calibrating SWO baudrate : " );
+
+        if ( OrbtraceIfCalibrateSWOBaudrate( r->dev, r->options->serial_speed, &calibrated ) )
+        {
+            genericsReport( V_INFO, "OK, %d bps" EOL, calibrated );
+        }
+        else
+        {
+            genericsReport( V_ERROR, "SWO baudrate calibration failed" EOL );
+            retVal |= -1;
+        }
+    }
+
+    return retVal;
+}
+// ====================================================================================================
+static int _runSession( struct RunTime *r, const char *fileName )
+
+/* Run option lines from a file or stdin against the already-open device. Each line is parsed
+ * exactly like a command line, so scripts migrate by joining their per-call arguments onto
+ * lines; the probe is enumerated and opened once for the whole session rather than once per
+ * operation. A failing line is reported and counted, but the session carries on.
+ */
+
+{
+    FILE *f = stdin;
+    char line[256];
+    char *argv[32];
+    int retVal = 0;
+    int lineNo = 0;
+
+    if ( strcmp( fileName, "-" ) )
+    {
+        f = fopen( fileName, "r" );
+
+        if ( !f )
+        {
+            genericsReport( V_ERROR, "Couldn't open session file %s" EOL, fileName );
+            return -1;
+        }
+    }
+
+    while ( fgets( line, sizeof( line ), f ) )
+    {
+        lineNo++;
+
+        /* Tokenise in place; a sythesised argv[0] keeps getopt happy */
+        int argc = 1;
+        argv[0] = "session";
+        char *p = line;
+
+        while ( ( *p ) && ( argc < ( int )( sizeof( argv ) / sizeof( argv[0] ) ) - 1 ) )
+        {
+            while ( ( *p == ' ' ) || ( *p == '\t' ) || ( *p == '\n' ) || ( *p == '\r' ) )
+            {
+                p++;
+            }
+
+            if ( ( !*p ) || ( *p == '#' ) )
+            {
+                break;
+            }
+
+            argv[argc++] = p;
+
+            while ( ( *p ) && ( *p != ' ' ) && ( *p != '\t' ) && ( *p != '\n' ) && ( *p != '\r' ) )
+            {
+                p++;
+            }
+
+            if ( *p )
+            {
+                *p++ = 0;
+            }
+        }
+
+        if ( argc == 1 )
+        {
+            /* Blank or comment line */
+            continue;
+        }
+
+        /* Each line starts with a clean slate of actions; sticky options persist */
+        r->actions = 0;
+        r->options->sessionFile = NULL;
+        optind = 1;
+
+        if ( !_processOptions( r, argc, argv ) )
+        {
+            genericsReport( V_ERROR, "Session line %d not understood" EOL, lineNo );
+            retVal |= -1;
+            continue;
+        }
+
+        if ( ( r->options->sessionFile ) || ( _tcl_action( r, ACTION_LIST_DEVICES ) ) )
+        {
+            genericsReport( V_ERROR, "Session line %d: sessions and device listing can't nest" EOL, lineNo );
+            retVal |= -1;
+            continue;
+        }
+
+        if ( _num_actions( r ) )
+        {
+            retVal |= _executeActions( r );
+        }
+    }
+
+    if ( f != stdin )
+    {
+        fclose( f );
+    }
+
+    return retVal;
+}
+// ====================================================================================================
 static void _doExit( void )
 
 {
@@ -628,16 +799,23 @@ static int _performActions( struct RunTime *r )
     // -----------------------------------------------------------------------------------
     if ( _tcl_action( r, ACTION_SERIAL_SPEED ) )
     {
-        genericsReport( V_INFO, "Setting baudrate to %d bps" EOL, r->options->serial_speed );
-
-        if ( OrbtraceIfSetSWOBaudrate( r->dev, r->options->serial_speed ) )
+        if ( _tst_action( r, ACTION_CAL_SPEED ) )
         {
-            genericsReport( V_INFO, "OK" EOL );
+            /* -a caps the calibration search rather than setting a rate directly */
         }
         else
         {
-            genericsReport( V_ERROR, "Setting serial speed failed" EOL );
-            retVal |= -1;
+            genericsReport( V_INFO, "Setting baudrate to %d bps" EOL, r->options->serial_speed );
+
+            if ( OrbtraceIfSetSWOBaudrate( r->dev, r->options->serial_speed ) )
+            {
+                genericsReport( V_INFO, "OK" EOL );
+            }
+            else
+            {
+                genericsReport( V_ERROR, "Setting serial speed failed" EOL );
+                retVal |= -1;
+            }
         }
     }
 
@@ -690,6 +868,8 @@ static int _performActions( struct RunTime *r )
 int main( int argc, char *argv[] )
 
 {
+    selfprofInit( "orbtrace" );
+
     int selection = 0;
     int retVal = 0;
 
@@ -731,7 +911,7 @@ int main( int argc, char *argv[] )
         {
             selection = OrbtraceIfSelectDevice( _r.dev );
 
-            if ( _num_actions( &_r ) )
+            if ( ( _num_actions( &_r ) ) || ( _r.options->sessionFile ) )
             {
                 genericsReport( V_INFO, "Got device [%s %s, S/N %s]" EOL,
                                 OrbtraceIfGetManufacturer( _r.dev, selection ),
@@ -743,13 +923,16 @@ int main( int argc, char *argv[] )
                     genericsExit( -1, "Couldn't open device" EOL );
                 }
 
-                /* Check voltages now we know what interface we're connected to */
-                if ( !_checkVoltages( &_r ) )
+                if ( _num_actions( &_r ) )
                 {
-                    genericsExit( -2, "Specified interface voltage check failed" EOL );
+                    retVal = _executeActions( &_r );
                 }
 
-                retVal = _performActions( &_r );
+                /* Any batched session runs over the same open handle */
+                if ( _r.options->sessionFile )
+                {
+                    retVal |= _runSession( &_r, _r.options->sessionFile );
+                }
             }
 
             OrbtraceIfCloseDevice( _r.dev );
@@ -12,6 +12,7 @@
 #include <ctype.h>
 #include <stdio.h>
 #include "orbtraceIf.h"
+#include "itmDecoder.h"
 #include "generics.h"
 
 /* List of device VID/PID pairs this library works with */
@@ -43,6 +44,29 @@ static const struct OrbtraceInterfaceType _validDevices[DEVICE_NUM_DEVICES] =
 #define RQ_SET_ENABLE  (1)
 #define RQ_SET_VOLTAGE (2)
 
+/* Command, on either endpoint, carrying a batch of settings in one transfer. Payload is a
+ * sequence of [request u8][channel u8][len u8][data, little endian] records. Firmware which
+ * predates this command stalls the transfer, which we use for capability detection.
+ */
+#define RQ_SET_BATCH   (0x10)
+
+/* Worst case batch payload; one record per settable item on an interface */
+#define BATCH_MAX_PAYLOAD (32)
+
+/* SWO baudrate calibration. Each candidate rate is judged on a short capture decoded as
+ * ITM; the coarse ladder finds the highest clean rung, then bisection tightens the answer.
+ */
+#define CAL_SAMPLE_LEN     (16384)                  /* Bytes of trace sampled per candidate rate */
+#define CAL_SAMPLE_TIME_MS (50)                     /* Longest wait for those bytes */
+#define CAL_DRAIN_TIME_MS  (5)                      /* Timeout per read when flushing stale capture */
+#define CAL_MAX_DRAINS     (16)                     /* Bound on those flush reads */
+#define CAL_DEFAULT_MAX    (12000000)               /* Highest rate probed when no cap is given */
+#define CAL_REFINE_STEPS   (8)                      /* Bisection passes over the winning bracket */
+
+/* Coarse calibration rungs, highest first */
+static const uint32_t _calLadder[] = { 12000000, 10000000, 8000000, 6000000, 4000000, 2000000, 1000000, 500000, 250000, 115200 };
+#define CAL_LADDER_LEN ( sizeof( _calLadder ) / sizeof( _calLadder[0] ) )
+
 /* Maximum descriptor length from USB specification */
 #define MAX_USB_DESC_LEN (256)
 
@@ -453,6 +477,13 @@ bool OrbtraceIfOpenDevice( struct OrbtraceIf *o, int entry )
     }
 
     o->activeDevice = entry;
+
+    /* Probe state is unknown until we write it */
+    o->current.valid = 0;
+    o->staged.valid = 0;
+    o->batching = false;
+    o->batchUnsupported = false;
+
     return true;
 }
 // ====================================================================================================
@@ -674,39 +705,58 @@ void OrbtraceIfCloseTransfers( struct OrbtraceIf *o )
 
 // ====================================================================================================
 
-bool OrbtraceIfSetTraceWidth( struct OrbtraceIf *o, int width )
+static bool _setTraceMode( struct OrbtraceIf *o, uint16_t mode )
+
+/* Common path for the trace width/SWO mode register, with no-op elimination and staging */
 
 {
-    uint16_t d = ( width != 4 ) ? width : 3;
+    if ( ( o->current.valid & OTS_TRACEMODE ) && ( o->current.traceMode == mode ) )
+    {
+        return true;
+    }
 
-    if ( ( d < 1 ) || ( d > 3 ) )
+    if ( o->batching )
     {
-        return false;
+        o->staged.traceMode = mode;
+        o->staged.valid |= OTS_TRACEMODE;
+        return true;
     }
 
-    return _doInterfaceControlTransfer(
+    if ( !_doInterfaceControlTransfer(
                        o,
                        OrbtraceIfGetTraceIF( o, OrbtraceIfGetActiveDevnum( o ) ),
                        RQ_SET_TWIDTH,
-                       d,
+                       mode,
                        0,
                        0,
                        NULL
-           );
+       ) )
+    {
+        return false;
+    }
+
+    o->current.traceMode = mode;
+    o->current.valid |= OTS_TRACEMODE;
+    return true;
+}
+// ====================================================================================================
+bool OrbtraceIfSetTraceWidth( struct OrbtraceIf *o, int width )
+
+{
+    uint16_t d = ( width != 4 ) ? width : 3;
+
+    if ( ( d < 1 ) || ( d > 3 ) )
+    {
+        return false;
+    }
+
+    return _setTraceMode( o, d );
 }
 // ====================================================================================================
 bool OrbtraceIfSetTraceSWO( struct OrbtraceIf *o, bool isMANCH, bool useTPIU )
 
 {
-    return _doInterfaceControlTransfer(
-                       o,
-                       OrbtraceIfGetTraceIF( o, OrbtraceIfGetActiveDevnum( o ) ),
-                       RQ_SET_TWIDTH,
-                       ( isMANCH ? 0x10 : 0x12 ) | ( useTPIU ? 0x01 : 0x00 ),
-                       0,
-                       0,
-                       NULL
-           );
+    return _setTraceMode( o, ( isMANCH ? 0x10 : 0x12 ) | ( useTPIU ? 0x01 : 0x00 ) );
 }
 // ====================================================================================================
 bool OrbtraceIfSetSWOBaudrate( struct OrbtraceIf *o, uint32_t speed )
@@ -714,7 +764,19 @@ bool OrbtraceIfSetSWOBaudrate( struct OrbtraceIf *o, uint32_t speed )
 {
     uint8_t speed_le[4] = { ( speed & 0xff ), ( speed >> 8 ) & 0xff, ( speed >> 16 ) & 0xff, ( speed >> 24 ) & 0xff };
 
-    return _doInterfaceControlTransfer(
+    if ( ( o->current.valid & OTS_BAUDRATE ) && ( o->current.baudrate == speed ) )
+    {
+        return true;
+    }
+
+    if ( o->batching )
+    {
+        o->staged.baudrate = speed;
+        o->staged.valid |= OTS_BAUDRATE;
+        return true;
+    }
+
+    if ( !_doInterfaceControlTransfer(
                        o,
                        OrbtraceIfGetTraceIF( o, OrbtraceIfGetActiveDevnum( o ) ),
                        RQ_SET_SPEED,
@@ -722,7 +784,131 @@ bool OrbtraceIfSetSWOBaudrate( struct OrbtraceIf *o, uint32_t speed )
                        0,
                        4,
                        &speed_le
-           );
+       ) )
+    {
+        return false;
+    }
+
+    o->current.baudrate = speed;
+    o->current.valid |= OTS_BAUDRATE;
+    return true;
+}
+// ====================================================================================================
+static bool _calClean( struct OrbtraceIf *o, uint32_t speed, int *seen )
+
+/* Sample a short capture at this rate and judge whether it decodes as clean ITM. A wrongly
+ * sampled UART stream shows up as sync hunting, decode errors or silence, all of which fail
+ * here; only a stream that syncs and stays synced without protocol errors passes.
+ */
+
+{
+    uint8_t buf[CAL_SAMPLE_LEN];
+    struct ITMDecoder i;
+    int transferred = 0;
+
+    if ( !OrbtraceIfSetSWOBaudrate( o, speed ) )
+    {
+        return false;
+    }
+
+    /* Flush anything sampled at the previous rate out of the capture pipeline */
+    for ( int d = 0; d < CAL_MAX_DRAINS; d++ )
+    {
+        if ( ( 0 != libusb_bulk_transfer( o->handle, o->ep, buf, CAL_SAMPLE_LEN, &transferred, CAL_DRAIN_TIME_MS ) ) ||
+                ( !transferred ) )
+        {
+            break;
+        }
+    }
+
+    /* Now take the sample to be scored; a timeout with partial data is still usable */
+    int err = libusb_bulk_transfer( o->handle, o->ep, buf, CAL_SAMPLE_LEN, &transferred, CAL_SAMPLE_TIME_MS );
+
+    if ( ( 0 != err ) && ( LIBUSB_ERROR_TIMEOUT != err ) )
+    {
+        return false;
+    }
+
+    *seen += transferred;
+
+    if ( !transferred )
+    {
+        return false;
+    }
+
+    ITMDecoderInit( &i, false );
+
+    for ( int b = 0; b < transferred; b++ )
+    {
+        ITMPump( &i, buf[b] );
+    }
+
+    struct ITMDecoderStats *s = ITMDecoderGetStats( &i );
+
+    return ( ITMDecoderIsSynced( &i ) ) && ( s->syncCount ) &&
+           ( !s->lostSyncCount ) && ( !s->ErrorPkt ) && ( !s->ReservedPkt );
+}
+// ====================================================================================================
+bool OrbtraceIfCalibrateSWOBaudrate( struct OrbtraceIf *o, uint32_t maxSpeed, uint32_t *calibrated )
+
+{
+    int seen = 0;
+    uint32_t lo = 0;
+    uint32_t hi = ( maxSpeed ) ? maxSpeed : CAL_DEFAULT_MAX;
+
+    /* Sampling needs the trace endpoint, which config-only callers won't have claimed yet */
+    if ( ( !o->handle ) || ( ( !o->ep ) && ( !OrbtraceGetIfandEP( o ) ) ) )
+    {
+        return false;
+    }
+
+    /* Coarse pass down the ladder to the highest rung which samples cleanly */
+    for ( uint32_t n = 0; n < CAL_LADDER_LEN; n++ )
+    {
+        if ( _calLadder[n] > hi )
+        {
+            continue;
+        }
+
+        if ( _calClean( o, _calLadder[n], &seen ) )
+        {
+            lo = _calLadder[n];
+            break;
+        }
+
+        hi = _calLadder[n];
+    }
+
+    if ( !lo )
+    {
+        genericsReport( V_WARN, ( seen ) ? "No clean rate found; is the target emitting ITM over SWO?" EOL
+                        : "No data received at any rate; is the target emitting at all?" EOL );
+        return false;
+    }
+
+    /* Bisect up into the bracket above the clean rung, keeping the highest rate that passes */
+    for ( int step = 0; ( step < CAL_REFINE_STEPS ) && ( hi - lo > lo / 64 ); step++ )
+    {
+        uint32_t mid = lo + ( hi - lo ) / 2;
+
+        if ( _calClean( o, mid, &seen ) )
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    /* Leave the probe running at the winner */
+    if ( !OrbtraceIfSetSWOBaudrate( o, lo ) )
+    {
+        return false;
+    }
+
+    *calibrated = lo;
+    return true;
 }
 // ====================================================================================================
 enum Channel OrbtraceIfNameToChannel( char *x )
@@ -755,7 +941,19 @@ bool OrbtraceIfVoltage( struct OrbtraceIf *o, enum Channel ch, int voltage )
         return false;
     }
 
-    return _doInterfaceControlTransfer(
+    if ( ( o->current.valid & OTS_VOLTAGE( ch ) ) && ( o->current.voltage[ch] == voltage ) )
+    {
+        return true;
+    }
+
+    if ( o->batching )
+    {
+        o->staged.voltage[ch] = voltage;
+        o->staged.valid |= OTS_VOLTAGE( ch );
+        return true;
+    }
+
+    if ( !_doInterfaceControlTransfer(
                        o,
                        OrbtraceIfGetPowerIF( o, OrbtraceIfGetActiveDevnum( o ) ),
                        RQ_SET_VOLTAGE,
@@ -763,7 +961,14 @@ bool OrbtraceIfVoltage( struct OrbtraceIf *o, enum Channel ch, int voltage )
                        ch,
                        0,
                        NULL
-           );
+       ) )
+    {
+        return false;
+    }
+
+    o->current.voltage[ch] = voltage;
+    o->current.valid |= OTS_VOLTAGE( ch );
+    return true;
 }
 
 // ====================================================================================================
@@ -775,7 +980,36 @@ bool OrbtraceIfSetVoltageEn( struct OrbtraceIf *o, enum Channel ch, bool isOn )
         return false;
     }
 
-    return _doInterfaceControlTransfer(
+    /* CH_ALL covers every individual channel for caching purposes */
+    int firstCh = ( ch == CH_ALL ) ? 0 : ch;
+    int lastCh = ( ch == CH_ALL ) ? CH_MAX - 1 : ch;
+    bool allCurrent = true;
+
+    for ( int c = firstCh; c <= lastCh; c++ )
+    {
+        if ( ( !( o->current.valid & OTS_ENABLE( c ) ) ) || ( o->current.enable[c] != isOn ) )
+        {
+            allCurrent = false;
+        }
+    }
+
+    if ( allCurrent )
+    {
+        return true;
+    }
+
+    if ( o->batching )
+    {
+        for ( int c = firstCh; c <= lastCh; c++ )
+        {
+            o->staged.enable[c] = isOn;
+            o->staged.valid |= OTS_ENABLE( c );
+        }
+
+        return true;
+    }
+
+    if ( !_doInterfaceControlTransfer(
                        o,
                        OrbtraceIfGetPowerIF( o, OrbtraceIfGetActiveDevnum( o ) ),
                        RQ_SET_ENABLE,
@@ -783,7 +1017,224 @@ bool OrbtraceIfSetVoltageEn( struct OrbtraceIf *o, enum Channel ch, bool isOn )
                        ch,
                        0,
                        NULL
-           );
+       ) )
+    {
+        return false;
+    }
+
+    for ( int c = firstCh; c <= lastCh; c++ )
+    {
+        o->current.enable[c] = isOn;
+        o->current.valid |= OTS_ENABLE( c );
+    }
+
+    return true;
+}
+// ====================================================================================================
+static int _batchRecord( uint8_t *p, uint8_t request, uint8_t channel, uint32_t value, uint8_t dlen )
+
+/* Append one [request][channel][len][data] record to a batch payload, returning its length */
+
+{
+    *p++ = request;
+    *p++ = channel;
+    *p++ = dlen;
+
+    for ( int i = 0; i < dlen; i++ )
+    {
+        *p++ = ( value >> ( 8 * i ) ) & 0xff;
+    }
+
+    return 3 + dlen;
+}
+// ====================================================================================================
+static void _mergeStaged( struct OrbtraceIf *o )
+
+/* Fold successfully committed staged settings into the current settings cache */
+
+{
+    if ( o->staged.valid & OTS_TRACEMODE )
+    {
+        o->current.traceMode = o->staged.traceMode;
+    }
+
+    if ( o->staged.valid & OTS_BAUDRATE )
+    {
+        o->current.baudrate = o->staged.baudrate;
+    }
+
+    for ( int c = 0; c < CH_MAX; c++ )
+    {
+        if ( o->staged.valid & OTS_VOLTAGE( c ) )
+        {
+            o->current.voltage[c] = o->staged.voltage[c];
+        }
+
+        if ( o->staged.valid & OTS_ENABLE( c ) )
+        {
+            o->current.enable[c] = o->staged.enable[c];
+        }
+    }
+
+    o->current.valid |= o->staged.valid;
+}
+// ====================================================================================================
+static bool _commitSingly( struct OrbtraceIf *o )
+
+/* Replay staged settings as individual transfers, for firmware without batch support */
+
+{
+    uint8_t traceIf = OrbtraceIfGetTraceIF( o, OrbtraceIfGetActiveDevnum( o ) );
+    uint8_t powerIf = OrbtraceIfGetPowerIF( o, OrbtraceIfGetActiveDevnum( o ) );
+    bool isOk = true;
+
+    if ( o->staged.valid & OTS_TRACEMODE )
+    {
+        if ( _doInterfaceControlTransfer( o, traceIf, RQ_SET_TWIDTH, o->staged.traceMode, 0, 0, NULL ) )
+        {
+            o->current.traceMode = o->staged.traceMode;
+            o->current.valid |= OTS_TRACEMODE;
+        }
+        else
+        {
+            isOk = false;
+        }
+    }
+
+    if ( o->staged.valid & OTS_BAUDRATE )
+    {
+        uint32_t speed = o->staged.baudrate;
+        uint8_t speed_le[4] = { ( speed & 0xff ), ( speed >> 8 ) & 0xff, ( speed >> 16 ) & 0xff, ( speed >> 24 ) & 0xff };
+
+        if ( _doInterfaceControlTransfer( o, traceIf, RQ_SET_SPEED, 0, 0, 4, &speed_le ) )
+        {
+            o->current.baudrate = speed;
+            o->current.valid |= OTS_BAUDRATE;
+        }
+        else
+        {
+            isOk = false;
+        }
+    }
+
+    for ( int c = 0; c < CH_MAX; c++ )
+    {
+        if ( o->staged.valid & OTS_VOLTAGE( c ) )
+        {
+            if ( _doInterfaceControlTransfer( o, powerIf, RQ_SET_VOLTAGE, o->staged.voltage[c], c, 0, NULL ) )
+            {
+                o->current.voltage[c] = o->staged.voltage[c];
+                o->current.valid |= OTS_VOLTAGE( c );
+            }
+            else
+            {
+                isOk = false;
+            }
+        }
+
+        if ( o->staged.valid & OTS_ENABLE( c ) )
+        {
+            if ( _doInterfaceControlTransfer( o, powerIf, RQ_SET_ENABLE, o->staged.enable[c], c, 0, NULL ) )
+            {
+                o->current.enable[c] = o->staged.enable[c];
+                o->current.valid |= OTS_ENABLE( c );
+            }
+            else
+            {
+                isOk = false;
+            }
+        }
+    }
+
+    return isOk;
+}
+// ====================================================================================================
+void OrbtraceIfBatchBegin( struct OrbtraceIf *o )
+
+/* Start staging settings; nothing is sent to the probe until OrbtraceIfBatchCommit */
+
+{
+    o->staged.valid = 0;
+    o->batching = true;
+}
+// ====================================================================================================
+bool OrbtraceIfBatchCommit( struct OrbtraceIf *o )
+
+/* Send all staged settings, in one control transfer per interface where the firmware allows */
+
+{
+    if ( !o->batching )
+    {
+        return false;
+    }
+
+    o->batching = false;
+
+    if ( !o->staged.valid )
+    {
+        return true;
+    }
+
+    if ( !o->batchUnsupported )
+    {
+        uint8_t payload[BATCH_MAX_PAYLOAD];
+        bool isOk = true;
+        int len = 0;
+
+        if ( o->staged.valid & OTS_TRACEMODE )
+        {
+            len += _batchRecord( &payload[len], RQ_SET_TWIDTH, 0, o->staged.traceMode, 2 );
+        }
+
+        if ( o->staged.valid & OTS_BAUDRATE )
+        {
+            len += _batchRecord( &payload[len], RQ_SET_SPEED, 0, o->staged.baudrate, 4 );
+        }
+
+        if ( len )
+        {
+            isOk = _doInterfaceControlTransfer( o, OrbtraceIfGetTraceIF( o, OrbtraceIfGetActiveDevnum( o ) ),
+                                               RQ_SET_BATCH, 0, 0, len, payload );
+        }
+
+        if ( isOk )
+        {
+            len = 0;
+
+            for ( int c = 0; c < CH_MAX; c++ )
+            {
+                if ( o->staged.valid & OTS_VOLTAGE( c ) )
+                {
+                    len += _batchRecord( &payload[len], RQ_SET_VOLTAGE, c, o->staged.voltage[c], 2 );
+                }
+
+                if ( o->staged.valid & OTS_ENABLE( c ) )
+                {
+                    len += _batchRecord( &payload[len], RQ_SET_ENABLE, c, o->staged.enable[c], 1 );
+                }
+            }
+
+            if ( len )
+            {
+                isOk = _doInterfaceControlTransfer( o, OrbtraceIfGetPowerIF( o, OrbtraceIfGetActiveDevnum( o ) ),
+                                                   RQ_SET_BATCH, 0, 0, len, payload );
+            }
+        }
+
+        if ( isOk )
+        {
+            _mergeStaged( o );
+            o->staged.valid = 0;
+            return true;
+        }
+
+        /* Firmware predating the batch command stalls it; remember and replay individually */
+        o->batchUnsupported = true;
+    }
+
+    bool isOk = _commitSingly( o );
+    o->staged.valid = 0;
+    return isOk;
 }
 // ====================================================================================================
 void OrbtraceIfCloseDevice( struct OrbtraceIf *o )
@@ -797,5 +1248,8 @@ void OrbtraceIfCloseDevice( struct OrbtraceIf *o )
     o->activeDevice = NO_DEVICE;
     o->handle = NULL;
     o->dev = NULL;
+    o->current.valid = 0;
+    o->staged.valid = 0;
+    o->batching = false;
 }
 // ====================================================================================================
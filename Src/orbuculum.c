@@ -7,10 +7,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <inttypes.h>
 #ifdef WIN32
     #include <winsock2.h>
 #else
@@ -22,6 +27,9 @@
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
+#if !defined( WIN32 )
+    #include <sys/mman.h>
+#endif
 #include <strings.h>
 #include <string.h>
 #include <getopt.h>
@@ -32,6 +40,7 @@
 #elif defined LINUX
     #include <libusb-1.0/libusb.h>
     #include <asm/ioctls.h>
+    #include <linux/serial.h>
     #if defined TCGETS2
         #include <asm/termios.h>
         /* Manual declaration to avoid conflict. */
@@ -51,13 +60,25 @@
 #endif
 #include <signal.h>
 
+#if defined( WITH_ZSTD )
+    #include <zstd.h>
+#endif
+
 #include "git_version_info.h"
+#include "selfprof.h"
 #include "generics.h"
 #include "tpiuDecoder.h"
+#include "itmDecoder.h"
+#include "msgDecoder.h"
+#include "sampleComp.h"
 #include "oflow.h"
+#include "swoDecoder.h"
 #include "nwclient.h"
+#include "timerwheel.h"
 #include "orbtraceIf.h"
 #include "stream.h"
+#include "statseg.h"
+#include "traceDecoder.h"
 
 #define MAX_LINE_LEN (1024)
 #define ORBTRACE "orbtrace"
@@ -66,21 +87,164 @@
 /* Multiple blocks are used for USB, otherwise just the one */
 #define NUM_RAW_BLOCKS (32)
 
+/* Bounds for how many USB transfers may be outstanding concurrently */
+#define MIN_USB_TRANSFERS (8)
+#define MAX_USB_TRANSFERS (NUM_RAW_BLOCKS)
+
+/* USB transfer sizing tiers. Fill levels are tracked as an EWMA and the submission size/timeout
+ * moved between these closed-loop; short timeouts and deep buffers while data are flowing, long
+ * timeouts and shallow buffers when the link is idle so we don't burn CPU on empty completions.
+ */
+static const struct
+{
+    uint32_t len;                                        /* Requested transfer length */
+    uint32_t timeoutMs;                                  /* ...and its completion timeout */
+} _usbTier[] =
+{
+    {  4096,             500 },                          /* Idle link */
+    { 16384,             100 },                          /* Ticking over */
+    { USB_TRANSFER_SIZE, 100 }                           /* Bursting; matches the static pre-adaptive config */
+};
+
+#define NUM_USB_TIERS ( sizeof( _usbTier ) / sizeof( _usbTier[0] ) )
+
 /* File header for OFLOW formatted file */
 #define OFLOW_SIG (const char*)"%%ORBFLOW1.0.0%%"
 #define OFLOW_SIG_LEN (strlen(OFLOW_SIG))
 
+/* Native capture recording. Index frames ride in the capture itself as OFLOW frames on a
+ * reserved tag, so tools which don't understand them just see an unknown tag. Seek works by
+ * binary probing the file and scanning to the next index frame, so one is emitted at least
+ * every RECORD_INDEX_MAX_BYTES as well as every RECORD_INDEX_INTERVAL_US.
+ */
+#define RECORD_INDEX_TAG         (0x7D)
+#define RECORD_INDEX_VERSION     (1)
+#define RECORD_INDEX_INTERVAL_US (1000000)
+#define RECORD_INDEX_MAX_BYTES   (4*1024*1024)
+#define RECORD_INDEX_MAX_TAGS    (16)
+
+/* Maximum number of capture files which can be replayed together in one merged timeline */
+#define MAX_REPLAY_FILES         (8)
+
+/* Relay fan-in. Each remote daemon is granted a window of RELAY_TAG_STRIDE tags in the
+ * aggregated stream, so tag t from source n reappears as n*RELAY_TAG_STRIDE+t locally.
+ * Remapped tags must stay below the transport-level range (OFLOW_CAP_TAG upwards).
+ */
+#define MAX_RELAY_SOURCES        (8)
+#define RELAY_TAG_STRIDE         (16)
+
+/* Pre-trigger history retained while the capture file is gated by -g */
+#define TRIGGER_HISTORY_SIZE     (4*1024*1024)
+
+/* Arrival gaps beyond this restart the per-probe clock model rather than being filtered */
+#define CLOCK_RESYNC_NS          (100000000L)
+#define RECORD_RING_SIZE         (8 * USB_TRANSFER_SIZE)
+#define RECORD_RING_MASK         (RECORD_RING_SIZE - 1)
+
+/* pcapng export. Every OFLOW tag is presented as its own capture interface so Wireshark can
+ * filter and index per tag. Frames are staged in a ring with a small per-record header and
+ * written out by a low-priority buffered writer; a full ring sheds rather than stalls.
+ */
+#define PCAP_RING_SIZE        (8 * USB_TRANSFER_SIZE)
+#define PCAP_RING_MASK        (PCAP_RING_SIZE - 1)
+#define PCAP_REC_HDR_LEN      (12)                       /* [tag][0][len.2][tstamp.8] */
+#define PCAP_SHB_TYPE         (0x0A0D0D0AU)
+#define PCAP_IDB_TYPE         (1)
+#define PCAP_EPB_TYPE         (6)
+#define PCAP_BYTE_ORDER_MAGIC (0x1A2B3C4DU)
+#define PCAP_LINKTYPE_USER0   (147)
+#define PCAP_OPT_IF_NAME      (2)
+#define PCAP_OPT_IF_TSRESOL   (9)
+
 /* Number of potential tags */
 #define NUM_TAGS (256)
 #define LAST_TAG_SEEN_TIME_NS (2*1000L*1000L*1000L)
 
+/* Per-tag forwarding ring; must be a power of two, and hold several raw transfers */
+#define HANDLER_RING_SIZE (8 * USB_TRANSFER_SIZE)
+#define HANDLER_RING_MASK (HANDLER_RING_SIZE - 1)
+
+/* Coalescing workers stop waiting at this fill so the producer never hits the drop path */
+#define HANDLER_RING_HIGHWATER (HANDLER_RING_SIZE / 2)
+#define MAX_TAG_LATENCY_MS (10000)
+
+/* Hot-path instrumentation stages. Note that a stage which performs a client write inline
+ * (e.g. OFLOW batch flushes during deframe) has that write time counted in both stages.
+ */
+enum instrStage
+{
+    INSTR_STAGE_USB_CALLBACK,                            /* USB event thread callback, including decode queue handoff */
+    INSTR_STAGE_DEFRAME,                                 /* OFLOW/TPIU deframe and per-tag accounting */
+    INSTR_STAGE_ENQUEUE,                                 /* Fan-out of stripped blocks to the tag worker rings */
+    INSTR_STAGE_CLIENT_WRITE,                            /* Despatch to connected network clients */
+    INSTR_STAGE_SERIAL_QUEUE,                            /* Serial block wait from arrival to decode start */
+    INSTR_STAGE_SERIAL_STALL,                            /* Serial reader waits for a free block; overrun risk window */
+    INSTR_STAGE_NUM_STAGES
+};
+
+#define INSTR_STAGE_NAMES "usb_callback", "deframe", "fanout_enqueue", "client_write", "serial_queue", "serial_stall"
+#define INSTR_NUM_BUCKETS (32)                           /* log2(ns) histogram; bucket n holds durations < 2^(n+1) ns */
+#define INSTR_MAX_RESPONSE (65536)
+
+/* How the decode thread behaves while its handoff queue is empty. Park costs a futex round
+ * trip per wakeup but no CPU while idle; spin is the opposite trade; yield spins briefly and
+ * then hands the core back once per pass. Selectable at boot or by options-file reload.
+ */
+enum dqWaitStrategy
+{
+    DQ_WAIT_PARK,                                        /* Sleep on the condvar until the producer signals */
+    DQ_WAIT_YIELD,                                       /* Spin briefly, then concede the core each pass */
+    DQ_WAIT_SPIN,                                        /* Pure busy-wait; lowest handoff latency */
+    DQ_WAIT_NUM_STRATEGIES
+};
+
+#define DQ_WAIT_NAMES { "park", "yield", "spin" }
+#define DQ_YIELD_SPIN_PASSES (2000)                      /* Spin passes between core concessions in yield mode */
+
+/* Trace quality forensics. Each anomaly seen in the incoming stream is timestamped into
+ * a ring together with the cumulative byte count at that moment, so a report shows both
+ * when trouble happened and how hard the link was being driven around it.
+ */
+enum anomalyKind
+{
+    ANOM_ITM_OVERFLOW,                                   /* Target ITM reported an overflow packet */
+    ANOM_ITM_ERROR,                                      /* ITM protocol decode error */
+    ANOM_TPIU_SYNCLOSS,                                  /* TPIU layer fell out of sync */
+    ANOM_TPIU_ERROR,                                     /* TPIU frame error */
+    ANOM_NUM_KINDS
+};
+
+#define ANOMALY_KIND_NAMES "itm_overflow", "itm_error", "tpiu_syncloss", "tpiu_error"
+#define ANOMALY_RING_LEN      (256)                      /* Anomalies retained for the report */
+#define ANOMALY_REPORT_EVENTS (64)                       /* Most recent events listed individually */
+
+struct anomalyRec
+{
+    uint64_t ns;                                         /* Monotonic time it was seen */
+    uint64_t totalBytes;                                 /* Raw bytes ever received at that point */
+    uint8_t  kind;
+};
+
+/* Timing record for one pipeline stage. Atomics because client writes happen on multiple threads */
+struct stageStats
+{
+    atomic_uint_fast64_t count;                          /* Passes through this stage */
+    atomic_uint_fast64_t totalNs;                        /* Summed wall time spent in it */
+    atomic_uint_fast64_t maxNs;                          /* Longest single pass */
+    atomic_uint_fast64_t bucket[INSTR_NUM_BUCKETS];      /* log2 latency histogram */
+};
+
 /* Record of transferred data per tag */
 struct TagDataCount
 {
     bool     hasHandler;
     uint64_t ts;
     uint64_t totalData;
-    uint64_t intervalData;
+    uint64_t totalDrop;                                  /* Bytes lost because this tag's worker fell behind */
+
+    /* Totals as of the previous interval report; owned by the reporting thread */
+    uint64_t lastData;
+    uint64_t lastDrop;
 };
 
 /* Record for options, either defaults or from command line */
@@ -97,9 +261,23 @@ struct Options
     bool useTPIU;                                        /* Are we using TPIU, and stripping TPIU frames? */
     uint32_t dataSpeed;                                  /* Effective data speed (can be less than link speed!) */
     char *file;                                          /* File host connection */
+    char *inputFile[MAX_REPLAY_FILES];                   /* Every replay input; more than one means merged replay */
+    int numInputFiles;                                   /* Number of replay inputs given */
+    char *relay[MAX_RELAY_SOURCES];                      /* Remote daemons to fan in as one aggregated stream */
+    int numRelays;                                       /* Number of relay sources given */
     bool fileTerminate;                                  /* Terminate when file read isn't successful */
     char *outfile;                                       /* Output file for raw data dumping */
+    char *triggerSpec;                                   /* Raw trigger specification from the command line */
+    enum TRACEprotocol triggerProt;                      /* Trace protocol the trigger scanner decodes */
+    int triggerTag;                                      /* Tag carrying the trace stream to scan */
+    uint32_t triggerLow;                                 /* Bottom of the triggering address range */
+    uint32_t triggerHigh;                                /* Top of the triggering address range */
     char *otcl;                                          /* Orbtrace command line options */
+    char *optFile;                                       /* Options file re-read on SIGHUP */
+    char *spillSpec;                                     /* Laggard spill specification from the command line */
+    char *spillDir;                                      /* Directory for laggard spill files */
+    uint32_t spillClientMB;                              /* Per-client spill budget in MB */
+    uint32_t spillTotalMB;                               /* Aggregate spill budget in MB */
     uint32_t intervalReportTime;                         /* If we want interval reports about performance */
     bool mono;                                           /* Supress colour in output */
     int paceDelay;                                       /* Delay between blocks of data transmission in file readout */
@@ -107,6 +285,23 @@ struct Options
     bool hiresTime;                                      /* Use hiresolution time (shorter timeouts...obsolete) */
     char *sn;                                            /* Any part serial number for identifying a specific device */
     int listenPort;                                      /* Listening port for network */
+    int usbTransferCount;                                /* Number of USB transfers to keep in flight */
+    int instrPort;                                       /* Port serving stage timing queries; 0 disables instrumentation */
+    bool sampleComp;                                     /* Republish PC samples as compressed batches on SAMPLECOMP_TAG */
+    char *captureFile;                                   /* File to record an indexed OFLOW capture into */
+    char *pcapFile;                                      /* File to export OFLOW frames into as pcapng */
+    int jumpTime;                                        /* Seconds into an indexed capture to start file replay from */
+    bool multi;                                          /* Serve every matching USB probe from this one daemon */
+    char *swoLineSpec;                                   /* SWO line decode specification */
+    enum SWOLineMode swoLineMode;                        /* Line coding for raw sample input, SWOLINE_NONE if not in use */
+    uint32_t swoLineSpb;                                 /* Samples per bit for raw sample input */
+    char *tagLatency;                                    /* Per-tag latency budget specification */
+    uint32_t tagLatencyUs[NUM_TAGS];                     /* Parsed coalescing budgets; 0 = despatch immediately */
+    char *affinity;                                      /* Pipeline thread placement specification */
+    int cpuFeeder;                                       /* CPU for the feeder thread, -1 to leave floating */
+    int cpuDecode;                                       /* CPU for the decode thread, -1 to leave floating */
+    int cpuNet;                                          /* CPU for network despatch threads, -1 to leave floating */
+    int dqWaitStrategy;                                  /* How the decode thread waits for queued blocks */
 };
 
 struct handlers
@@ -114,18 +309,46 @@ struct handlers
     int channel;                                         /* Channel number for this handler */
     struct dataBlock *strippedBlock;                     /* Processed buffers for output to clients */
     struct nwclientsHandle *n;                           /* Link to the network client subsystem */
+    uint32_t latencyBudgetUs;                            /* Coalescing budget for this tag; 0 = despatch immediately */
+
+    /* Per-tag despatch pipeline; the demux thread fills the ring, the worker drains it */
+    uint8_t *ring;                                       /* Forwarding ring for this tag */
+    atomic_uint_fast64_t ringWp;                         /* Ring write point (demux thread only) */
+    atomic_uint_fast64_t ringRp;                         /* Ring read point (worker thread only) */
+    pthread_t        worker;                             /* Thread despatching this tag to its clients */
+    pthread_mutex_t  mutex;                              /* Protects the wakeup condition only */
+    pthread_cond_t   updated;                            /* Signalled when data are queued */
+    volatile bool    exit;                               /* Flag asking the worker to end */
 };
 
 struct RunTime
 {
     struct TPIUDecoder t;                                /* TPIU decoder instance, in case we need it */
     struct OFLOW oflow;                                  /* OFLOW instance, in case we need it */
+    struct SWOLineDecoder swoLine;                       /* Line decoder for raw SWO pin captures, in case we need it */
 
     struct OrbtraceIf  *o;                               /* For accessing ORBTrace devices + BMPs */
 
-    uint64_t  intervalRawBytes;                          /* Number of bytes transferred in current interval */
+    uint64_t  totalRawBytes;                             /* Number of bytes transferred since startup */
+    uint64_t lastRawBytes;                               /* ...total as of the previous interval report (reporting thread) */
     uint64_t lastInterval;                               /* Timestamp of previous interval */
 
+    struct genericsSeqLock statSeq;                      /* Guards the decode-side counters against torn reads */
+    struct statSlot *stats;                              /* Shared telemetry slot for this pipeline */
+
+    uint64_t clkPredicted;                               /* De-jittered arrival time estimate for this probe */
+
+    struct ITMDecoder qcITM;                             /* Scan-only ITM decode for trace quality forensics */
+    struct anomalyRec anomaly[ANOMALY_RING_LEN];         /* Most recent anomalies observed */
+    atomic_uint_fast32_t anomalyWp;                      /* Anomalies ever recorded */
+    atomic_uint_fast64_t anomalyCount[ANOM_NUM_KINDS];   /* Running totals per kind */
+
+    /* Trace trigger; a scan-only decode of one tag which gates the raw capture file */
+    struct TRACEDecoder trigDec;                         /* Decoder instance run over the trigger tag */
+    uint8_t *trigRing;                                   /* Pre-trigger history of raw blocks */
+    uint64_t trigWp;                                     /* Total bytes retained so far */
+    bool triggered;                                      /* Armed condition has hit; capture is running */
+
     bool      ending;                                    /* Flag indicating app is terminating */
     bool      errored;                                   /* Flag indicating problem in reception process */
     bool      conn;                                      /* Flag indicating that we have a good connection */
@@ -137,9 +360,64 @@ struct RunTime
 
     struct dataBlock rawBlock[NUM_RAW_BLOCKS];           /* Transfer buffers from the receiver */
 
+    /* USB decode pipeline; completed transfers are handed from the USB event thread to the decoder over this SPSC queue */
+    struct dataBlock *decodeQueue[NUM_RAW_BLOCKS + 1];   /* Completed USB blocks awaiting decode */
+    atomic_uint_fast32_t dqWp;                           /* Queue write index (USB event thread only) */
+    atomic_uint_fast32_t dqRp;                           /* Queue read index (decode thread only) */
+    pthread_t        decodeThread;                       /* Thread running _handleBlock for USB blocks */
+    pthread_mutex_t  dqMutex;                            /* Protects the wakeup condition only */
+    pthread_cond_t   dqUpdated;                          /* Signalled when blocks are queued */
+    volatile bool    decodeExit;                         /* Flag asking the decode thread to end */
+    atomic_bool      dqWaiting;                          /* Consumer is parked or committing to park; producer must signal */
+    atomic_uint_fast64_t dqStatParks;                    /* Times the consumer actually parked */
+    atomic_uint_fast64_t dqStatWakeups;                  /* Parked-consumer signals the producer sent */
+    atomic_uint_fast64_t dqStatSpins;                    /* Empty-queue spin passes */
+    atomic_uint_fast64_t dqStatYields;                   /* Core concessions made in yield mode */
+
+    /* Native capture recording; the send path feeds the ring, a low-priority writer drains it */
+    uint8_t *recordRing;                                 /* Staging ring ahead of the capture file */
+    atomic_uint_fast64_t recWp;                          /* Ring write point (decode thread only) */
+    atomic_uint_fast64_t recRp;                          /* Ring read point (writer thread only) */
+    pthread_t        recordThread;                       /* Thread writing the capture file */
+    pthread_mutex_t  recMutex;                           /* Protects the wakeup condition only */
+    pthread_cond_t   recUpdated;                         /* Signalled when capture data are queued */
+    volatile bool    recordExit;                         /* Flag asking the writer to finish up */
+    int recordFd;                                        /* Handle onto the capture file */
+    uint64_t recordDropped;                              /* Capture bytes shed because the writer fell behind */
+#if defined( WITH_ZSTD )
+    ZSTD_CCtx *recordZstd;                               /* Compressor, when capturing to a .zst file */
+    uint8_t *recordZBuf;                                 /* Compressed output staging buffer */
+    size_t recordZBufLen;                                /* ...its allocated size */
+#endif
+
+    /* pcapng export; the decode path feeds the ring, a low-priority writer drains it */
+    uint8_t *pcapRing;                                   /* Staging ring ahead of the pcapng file */
+    atomic_uint_fast64_t pcapWp;                         /* Ring write point (decode thread only) */
+    atomic_uint_fast64_t pcapRp;                         /* Ring read point (writer thread only) */
+    pthread_t        pcapThread;                         /* Thread writing the pcapng file */
+    pthread_mutex_t  pcapMutex;                          /* Protects the wakeup condition only */
+    pthread_cond_t   pcapUpdated;                        /* Signalled when frames are queued */
+    volatile bool    pcapExit;                           /* Flag asking the writer to finish up */
+    FILE *pcapFp;                                        /* Handle onto the pcapng file */
+    uint64_t pcapDropped;                                /* Frames shed because the writer fell behind */
+
+    /* Sample compression; ITM from the default stream is scanned for PC samples to batch up */
+    struct ITMDecoder sampITM;                           /* ITM decode instance for the sample scanner */
+    struct sampleCompEncoder sampEnc;                    /* Batch encoder for the compressed sample tag */
+
+    /* Closed-loop USB transfer sizing; fed by the event thread, applied by both resubmission paths */
+    atomic_uint_fast32_t usbEwmaFill;                    /* Smoothed fill level of completed transfers */
+    atomic_uint_fast32_t usbTier;                        /* Tier currently in force from _usbTier */
+
     struct nwclientsHandle *oflowHandler;                /* Handle to OFLOW output handler */
     bool usingOFLOW;                                     /* Flag that OFLOW protocol is in use from the source */
 
+    uint8_t oflowBatch[TRANSFER_SIZE];                   /* Encoded OFLOW frames awaiting despatch to clients */
+    uint32_t oflowBatchLen;                              /* Amount of data in the despatch accumulator */
+
+    struct stageStats instrStat[INSTR_STAGE_NUM_STAGES]; /* Per-stage timing, when instrumentation is enabled */
+    pthread_t instrThread;                               /* Thread serving instrumentation queries */
+
     struct TagDataCount tagCount[NUM_TAGS];              /* Data carried per tag/TPIU channel */
     int numHandlers;                                     /* Number of TPIU channel handlers in use */
     struct handlers *handler;
@@ -156,6 +434,9 @@ struct RunTime
 
 #define NUM_OFLOW_CHANNELS 0x7F
 
+/* Port spacing between devices in multi-probe mode; covers the OFLOW port plus the legacy tag ports */
+#define MULTI_PORT_STRIDE  (100)
+
 #define INTERVAL_100US (100U)
 #define INTERVAL_1MS   (10*INTERVAL_100US)
 #define INTERVAL_100MS (100*INTERVAL_1MS)
@@ -166,10 +447,24 @@ struct Options _options =
     .listenPort   = OFCLIENT_SERVER_PORT,
     .nwserverHost = NWSERVER_HOST,
     .channelList  = "1",
+    .usbTransferCount = MAX_USB_TRANSFERS,
+    .cpuFeeder    = -1,
+    .cpuDecode    = -1,
+    .cpuNet       = -1,
 };
 
 struct RunTime _r;
 
+/* Additional capture instances when serving multiple probes; _r remains the primary */
+static struct RunTime **_multiInstance;
+static int _numMultiInstances;
+
+/* Timer wheel running all of the daemon's periodic housekeeping on one thread */
+static struct twHandle *_timers;
+
+/* Interval report timer for the primary instance, kept so a reload can re-cadence it */
+static struct twTimer *_intervalTimer;
+
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
@@ -331,12 +626,49 @@ static void _doExit( void )
 {
     _r.ending = true;
 
+    for ( int i = 0; i < _numMultiInstances; i++ )
+    {
+        _multiInstance[i]->ending = true;
+        statsegUnpublish( _multiInstance[i]->stats );
+    }
+
+    statsegUnpublish( _r.stats );
+
+    /* Stop the housekeeping timers so nothing fires into a half-torn-down daemon */
+    twShutdown( _timers );
+    _timers = NULL;
+
     if ( _r.opFileHandle )
     {
         close( _r.opFileHandle );
         _r.opFileHandle = 0;
     }
 
+    if ( _r.recordRing )
+    {
+        /* Flush the capture writer so the tail of the session isn't lost */
+        _r.recordExit = true;
+        pthread_mutex_lock( &_r.recMutex );
+        pthread_cond_signal( &_r.recUpdated );
+        pthread_mutex_unlock( &_r.recMutex );
+        pthread_join( _r.recordThread, NULL );
+        _r.recordRing = NULL;
+    }
+
+    if ( _r.pcapRing )
+    {
+        /* Flush the pcapng writer so the tail of the session isn't lost */
+        _r.pcapExit = true;
+        pthread_mutex_lock( &_r.pcapMutex );
+        pthread_cond_signal( &_r.pcapUpdated );
+        pthread_mutex_unlock( &_r.pcapMutex );
+        pthread_join( _r.pcapThread, NULL );
+        _r.pcapRing = NULL;
+    }
+
+    /* Drain any queued diagnostics before the process goes away */
+    genericsReportAsync( false );
+
     /* Need to nudge our own process in case it's stuck in a read or similar */
     _exit( 0 );
 }
@@ -353,22 +685,43 @@ void _printHelp( const char *const progName, struct RunTime *r )
 {
     genericsFPrintf( stderr, "Usage: %s [options]" EOL, progName );
     genericsFPrintf( stderr, "    -a, --serial-speed:  <serialSpeed> to use" EOL );
+    genericsFPrintf( stderr, "    -A, --affinity:      <feeder>,<decode>,<net> Pin pipeline threads to these CPUs (-1 = don't pin)" EOL );
+    genericsFPrintf( stderr, "    -b, --tag-latency:   <tag>:<ms>[,...] Coalesce legacy despatch for tag up to <ms> (default 0 = immediate)" EOL );
+    genericsFPrintf( stderr, "    -c, --opt-file:      <filename> Apply <key>=<value> options from this file, and again on SIGHUP" EOL );
+    genericsFPrintf( stderr, "    -e, --spill:         <dir>:<clientMB>:<totalMB> Spill laggard client backlog to files" EOL
+                     "                         in <dir>, within per-client and aggregate budgets" EOL );
     genericsFPrintf( stderr, "    -E, --eof:           When reading from file, terminate at end of file" EOL );
-    genericsFPrintf( stderr, "    -f, --input-file:    <filename> Take input from specified file" EOL );
+    genericsFPrintf( stderr, "    -f, --input-file:    <filename> Take input from specified file. Repeat to merge several" EOL
+                     "                         OFLOW captures into one time-ordered replay" EOL );
     genericsFPrintf( stderr, "    -h, --help:          This help" EOL );
+    genericsFPrintf( stderr, "    -I, --instrument:    <port> Time each pipeline stage and serve the histograms on localhost:<port>" EOL );
+    genericsFPrintf( stderr, "    -j, --jump:          <seconds> Start file replay this far into an indexed OFLOW capture" EOL );
     genericsFPrintf( stderr, "    -l, --listen-port:   <port> Listen port for incoming ORBFLOW connections (defaults to %d)" EOL, r->options->listenPort );
+    genericsFPrintf( stderr, "    -L, --swo-line:      <uart|manch>:<samplesPerBit> Demodulate input as raw SWO pin samples" EOL );
     genericsFPrintf( stderr, "    -m, --monitor:       <interval> Output monitor information about the link at <interval>ms, min 500ms" EOL );
     genericsFPrintf( stderr, "    -M, --no-colour:     Supress colour in output" EOL );
     genericsFPrintf( stderr, "    -n, --serial-number: <Serial> any part of serial number to differentiate specific device" EOL );
+    genericsFPrintf( stderr, "    -g, --trigger:       <prot>:<tag>:<low>-<high> Gate the dump file until the traced" EOL );
+    genericsFPrintf( stderr, "                           program branches into the (hex) address range" EOL );
     genericsFPrintf( stderr, "    -o, --output-file:   <filename> to be used for dump file" EOL );
     genericsFPrintf( stderr, "    -O, --orbtrace:      \"<options>\" run orbtrace with specified options on device connect" EOL );
     genericsFPrintf( stderr, "    -p, --serial-port:   <serialPort> to use" EOL );
     genericsFPrintf( stderr, "    -P, --pace:          <microseconds> delay in block of data transmission to clients" EOL );
+    genericsFPrintf( stderr, "    -q, --wait-strategy: <park|yield|spin> How the decode thread waits for work (default park)" EOL );
+    genericsFPrintf( stderr, "    -R, --relay:         <host>[:<port>] Fan in the OFLOW stream from this remote daemon (default" EOL
+                     "                         port %d). Repeat for several; source n gets tags n*%d upwards" EOL,
+                     OFCLIENT_SERVER_PORT, RELAY_TAG_STRIDE );
     genericsFPrintf( stderr, "    -s, --server:        <Server>:<Port> to use" EOL );
+    genericsFPrintf( stderr, "    -S, --sample-comp:   Republish PC samples from the default stream as compressed batches on tag %d" EOL, SAMPLECOMP_TAG );
     genericsFPrintf( stderr, "    -T, --tpiu:          Strip TPIU framing from input flows (mostly not relevant)" EOL );
     genericsFPrintf( stderr, "    -t, --tag:           <stream,stream....> Legacy TPIU streams to decode and route (Default %s)" EOL, r->options->channelList );
+    genericsFPrintf( stderr, "    -u, --usb-transfers: <count> Number of USB transfers to keep in flight, %d..%d (default %d)" EOL,
+                     MIN_USB_TRANSFERS, MAX_USB_TRANSFERS, r->options->usbTransferCount );
     genericsFPrintf( stderr, "    -v, --verbose:       <level> Verbose mode 0(errors)..3(debug)" EOL );
     genericsFPrintf( stderr, "    -V, --version:       Print version, connected usb devices, and exit" EOL );
+    genericsFPrintf( stderr, "    -w, --write-capture: <filename> Record the OFLOW output as an indexed capture file" EOL );
+    genericsFPrintf( stderr, "    -W, --write-pcapng:  <filename> Export OFLOW frames as pcapng for Wireshark analysis" EOL );
+    genericsFPrintf( stderr, "    -x, --multi:         Serve every matching USB probe, ports offset by %d per device" EOL, MULTI_PORT_STRIDE );
 }
 
 // ====================================================================================================
@@ -396,10 +749,18 @@ void _printVersion( struct RunTime *r )
 static struct option _longOptions[] =
 {
     {"serial-speed", required_argument, NULL, 'a'},
+    {"affinity", required_argument, NULL, 'A'},
+    {"tag-latency", required_argument, NULL, 'b'},
+    {"opt-file", required_argument, NULL, 'c'},
+    {"spill", required_argument, NULL, 'e'},
     {"eof", no_argument, NULL, 'E'},
+    {"trigger", required_argument, NULL, 'g'},
     {"input-file", required_argument, NULL, 'f'},
     {"help", no_argument, NULL, 'h'},
+    {"instrument", required_argument, NULL, 'I'},
+    {"jump", required_argument, NULL, 'j'},
     {"listen-port", required_argument, NULL, 'l'},
+    {"swo-line", required_argument, NULL, 'L'},
     {"monitor", required_argument, NULL, 'm'},
     {"no-colour", no_argument, NULL, 'M'},
     {"no-color", no_argument, NULL, 'M'},
@@ -408,13 +769,43 @@ static struct option _longOptions[] =
     {"orbtrace", required_argument, NULL, 'O'},
     {"serial-port", required_argument, NULL, 'p'},
     {"pace", required_argument, NULL, 'P'},
+    {"wait-strategy", required_argument, NULL, 'q'},
+    {"relay", required_argument, NULL, 'R'},
     {"server", required_argument, NULL, 's'},
+    {"sample-comp", no_argument, NULL, 'S'},
     {"tpiu", required_argument, NULL, 'T'},
     {"tag", required_argument, NULL, 't'},
+    {"usb-transfers", required_argument, NULL, 'u'},
     {"verbose", required_argument, NULL, 'v'},
     {"version", no_argument, NULL, 'V'},
+    {"write-capture", required_argument, NULL, 'w'},
+    {"write-pcapng", required_argument, NULL, 'W'},
+    {"multi", no_argument, NULL, 'x'},
     {NULL, no_argument, NULL, 0}
 };
+// ====================================================================================================
+static const char *_dqWaitName[DQ_WAIT_NUM_STRATEGIES] = DQ_WAIT_NAMES;
+
+static int _dqWaitStrategyFromName( const char *name )
+
+/* Translate a wait strategy name to its enum, or -1 if it isn't one */
+
+{
+    for ( int i = 0; i < DQ_WAIT_NUM_STRATEGIES; i++ )
+    {
+        if ( !strcasecmp( name, _dqWaitName[i] ) )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+// ====================================================================================================
+
+/* Defined with the rest of the reload machinery below; boot-time application happens here too */
+static bool _optionsFileApply( struct RunTime *r, bool live );
+
 // ====================================================================================================
 bool _processOptions( int argc, char *argv[], struct RunTime *r )
 
@@ -422,7 +813,7 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
     int c, optionIndex = 0;
 #define DELIMITER ','
 
-    while ( ( c = getopt_long ( argc, argv, "a:Ef:hVl:m:Mn:o:O:p:P:s:Tt:v:", _longOptions, &optionIndex ) ) != -1 )
+    while ( ( c = getopt_long ( argc, argv, "a:A:b:c:e:Ef:g:hI:j:Vl:L:m:Mn:o:O:p:P:q:R:s:STt:u:v:w:W:x", _longOptions, &optionIndex ) ) != -1 )
         switch ( c )
         {
             // ------------------------------------
@@ -440,13 +831,44 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
 
             // ------------------------------------
 
+            case 'A':
+                r->options->affinity = optarg;
+                break;
+
+            // ------------------------------------
+
+            case 'b':
+                r->options->tagLatency = optarg;
+                break;
+
+            // ------------------------------------
+
+            case 'c':
+                r->options->optFile = optarg;
+                break;
+
+            // ------------------------------------
+
+            case 'e':
+                r->options->spillSpec = optarg;
+                break;
+
+            // ------------------------------------
+
             case 'E':
                 r->options->fileTerminate = true;
                 break;
 
             // ------------------------------------
             case 'f':
-                r->options->file = optarg;
+                if ( r->options->numInputFiles == MAX_REPLAY_FILES )
+                {
+                    genericsReport( V_ERROR, "At most %d input files can be merged" EOL, MAX_REPLAY_FILES );
+                    return false;
+                }
+
+                r->options->inputFile[r->options->numInputFiles++] = optarg;
+                r->options->file = r->options->inputFile[0];
                 break;
 
             // ------------------------------------
@@ -456,6 +878,32 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
 
             // ------------------------------------
 
+            case 'I':
+                r->options->instrPort = atoi( optarg );
+
+                if ( ( r->options->instrPort <= 0 ) || ( r->options->instrPort > 0xffff ) )
+                {
+                    genericsReport( V_ERROR, "Instrumentation port is out of range" EOL );
+                    return false;
+                }
+
+                break;
+
+            // ------------------------------------
+
+            case 'j':
+                r->options->jumpTime = atoi( optarg );
+
+                if ( r->options->jumpTime <= 0 )
+                {
+                    genericsReport( V_ERROR, "Jump time is out of range" EOL );
+                    return false;
+                }
+
+                break;
+
+            // ------------------------------------
+
             case 'V':
                 _printVersion( r );
                 return false;
@@ -475,6 +923,12 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
 
             // ------------------------------------
 
+            case 'L':
+                r->options->swoLineSpec = optarg;
+                break;
+
+            // ------------------------------------
+
             case 'm':
                 r->options->intervalReportTime = atoi( optarg );
 
@@ -500,6 +954,12 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
 
             // ------------------------------------
 
+            case 'g':
+                r->options->triggerSpec = optarg;
+                break;
+
+            // ------------------------------------
+
             case 'o':
                 r->options->outfile = optarg;
                 break;
@@ -531,6 +991,31 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
 
             // ------------------------------------
 
+            case 'q':
+                r->options->dqWaitStrategy = _dqWaitStrategyFromName( optarg );
+
+                if ( r->options->dqWaitStrategy < 0 )
+                {
+                    genericsReport( V_ERROR, "Wait strategy must be park, yield or spin" EOL );
+                    return false;
+                }
+
+                break;
+
+            // ------------------------------------
+
+            case 'R':
+                if ( r->options->numRelays == MAX_RELAY_SOURCES )
+                {
+                    genericsReport( V_ERROR, "At most %d relay sources can be fanned in" EOL, MAX_RELAY_SOURCES );
+                    return false;
+                }
+
+                r->options->relay[r->options->numRelays++] = optarg;
+                break;
+
+            // ------------------------------------
+
             case 's':
                 r->options->nwserverHost = optarg;
 
@@ -555,6 +1040,11 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
 
                 break;
 
+            // ------------------------------------
+            case 'S':
+                r->options->sampleComp = true;
+                break;
+
             // ------------------------------------
             case 'T':
                 r->options->useTPIU = true;
@@ -565,6 +1055,33 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
                 r->options->channelList = optarg;
                 break;
 
+            // ------------------------------------
+            case 'u':
+                r->options->usbTransferCount = atoi( optarg );
+
+                if ( ( r->options->usbTransferCount < MIN_USB_TRANSFERS ) || ( r->options->usbTransferCount > MAX_USB_TRANSFERS ) )
+                {
+                    genericsReport( V_ERROR, "USB transfer count is out of range" EOL );
+                    return false;
+                }
+
+                break;
+
+            // ------------------------------------
+            case 'w':
+                r->options->captureFile = optarg;
+                break;
+
+            // ------------------------------------
+            case 'W':
+                r->options->pcapFile = optarg;
+                break;
+
+            // ------------------------------------
+            case 'x':
+                r->options->multi = true;
+                break;
+
             // ------------------------------------
             case 'v':
                 if ( !isdigit( *optarg ) )
@@ -602,6 +1119,122 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
                 // ------------------------------------
         }
 
+    /* Options file values land ahead of the validation passes below, so they behave
+     * exactly as if they had been given as flags; the file wins where both are present.
+     */
+    if ( ( r->options->optFile ) && ( !_optionsFileApply( r, false ) ) )
+    {
+        return false;
+    }
+
+    if ( r->options->affinity )
+    {
+        if ( 3 != sscanf( r->options->affinity, "%d,%d,%d", &r->options->cpuFeeder, &r->options->cpuDecode, &r->options->cpuNet ) )
+        {
+            genericsReport( V_ERROR, "Affinity specification must be <feeder>,<decode>,<net>" EOL );
+            return false;
+        }
+    }
+
+    if ( r->options->swoLineSpec )
+    {
+        char proto[10];
+        uint32_t spb = 0;
+
+        if ( 2 != sscanf( r->options->swoLineSpec, "%9[a-z]:%u", proto, &spb ) )
+        {
+            genericsReport( V_ERROR, "SWO line specification must be <uart|manch>:<samplesPerBit>" EOL );
+            return false;
+        }
+
+        if ( !strcmp( proto, "uart" ) )
+        {
+            r->options->swoLineMode = SWOLINE_UART;
+        }
+        else if ( !strcmp( proto, "manch" ) )
+        {
+            r->options->swoLineMode = SWOLINE_MANCH;
+        }
+        else
+        {
+            genericsReport( V_ERROR, "Unrecognised SWO line coding '%s'" EOL, proto );
+            return false;
+        }
+
+        if ( ( spb < 4 ) || ( spb > 1000 ) )
+        {
+            genericsReport( V_ERROR, "SWO samples per bit is out of range" EOL );
+            return false;
+        }
+
+        r->options->swoLineSpb = spb;
+    }
+
+    if ( r->options->spillSpec )
+    {
+        char dir[256];
+        unsigned int clientMB, totalMB;
+
+        if ( 3 != sscanf( r->options->spillSpec, "%255[^:]:%u:%u", dir, &clientMB, &totalMB ) )
+        {
+            genericsReport( V_ERROR, "Spill specification must be <dir>:<clientMB>:<totalMB>" EOL );
+            return false;
+        }
+
+        if ( ( !clientMB ) || ( !totalMB ) || ( clientMB > totalMB ) )
+        {
+            genericsReport( V_ERROR, "Spill budgets must be non-zero and client <= total" EOL );
+            return false;
+        }
+
+        r->options->spillDir = strdup( dir );
+        MEMCHECK( r->options->spillDir, false );
+        r->options->spillClientMB = clientMB;
+        r->options->spillTotalMB = totalMB;
+    }
+
+    if ( r->options->tagLatency )
+    {
+        char *c = r->options->tagLatency;
+
+        while ( *c )
+        {
+            unsigned int tag, ms;
+            int adv = 0;
+
+            if ( 2 != sscanf( c, "%u:%u%n", &tag, &ms, &adv ) )
+            {
+                genericsReport( V_ERROR, "Tag latency specification must be <tag>:<milliseconds>[,...]" EOL );
+                return false;
+            }
+
+            if ( tag >= NUM_TAGS )
+            {
+                genericsReport( V_ERROR, "Tag number out of range in latency specification" EOL );
+                return false;
+            }
+
+            if ( ms > MAX_TAG_LATENCY_MS )
+            {
+                genericsReport( V_ERROR, "Tag latency is out of range" EOL );
+                return false;
+            }
+
+            r->options->tagLatencyUs[tag] = ms * 1000;
+            c += adv;
+
+            if ( *c == ',' )
+            {
+                c++;
+            }
+            else if ( *c )
+            {
+                genericsReport( V_ERROR, "Illegal character in latency specification (%c)" EOL, *c );
+                return false;
+            }
+        }
+    }
+
     /* ... and dump the config if we're being verbose */
     genericsReport( V_INFO, "orbuculum version " GIT_DESCRIBE EOL );
 
@@ -641,6 +1274,13 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
         genericsReport( V_INFO, "Raw Output file: %s" EOL, r->options->outfile );
     }
 
+    if ( r->options->triggerSpec )
+    {
+        genericsReport( V_INFO, "Trigger        : %s branch into 0x%08x-0x%08x on tag %d" EOL,
+                        TRACEDecodeGetProtocolName( r->options->triggerProt ),
+                        r->options->triggerLow, r->options->triggerHigh, r->options->triggerTag );
+    }
+
     if ( r->options->nwserverPort )
     {
         genericsReport( V_INFO, "NW Server      : %s:%d" EOL, r->options->nwserverHost, r->options->nwserverPort );
@@ -649,49 +1289,178 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
     genericsReport( V_INFO, "Use/Strip TPIU : %s" EOL, r->options->useTPIU ? "True" : "False" );
     genericsReport( V_INFO, "Decode/Forward : %s" EOL, r->options->channelList ? r->options->channelList : "None" );
 
+    if ( r->options->tagLatency )
+    {
+        genericsReport( V_INFO, "Tag Latency    : %s" EOL, r->options->tagLatency );
+    }
+
     if ( r->options->otcl )
     {
         genericsReport( V_INFO, "Orbtrace CL    : %s" EOL, r->options->otcl );
     }
 
-    genericsReport( V_INFO, "OFLOW Port     : %d" EOL, r->options->listenPort );
-
-    if ( r->options->file )
+    if ( r->options->optFile )
     {
-        genericsReport( V_INFO, "Pace Delay     : %dus" EOL, r->options->paceDelay );
-        genericsReport( V_INFO, "Input File  : %s", r->options->file );
-
-        if ( r->options->fileTerminate )
-        {
-            genericsReport( V_INFO, " (Terminate on exhaustion)" EOL );
-        }
-        else
-        {
-            genericsReport( V_INFO, " (Ongoing read)" EOL );
-        }
+        genericsReport( V_INFO, "Options File   : %s (SIGHUP re-reads)" EOL, r->options->optFile );
     }
 
-    if ( r->options->hiresTime )
+    if ( r->options->spillSpec )
     {
-        genericsReport( V_INFO, "High Res Time" EOL );
+        genericsReport( V_INFO, "Laggard Spill  : %s, %uMB/client, %uMB total" EOL,
+                        r->options->spillDir, r->options->spillClientMB, r->options->spillTotalMB );
     }
 
-    if ( ( r->options->file ) && ( ( r->options->port ) || ( r->options->nwserverPort ) ) )
+    genericsReport( V_INFO, "OFLOW Port     : %d" EOL, r->options->listenPort );
+
+    if ( r->options->dqWaitStrategy != DQ_WAIT_PARK )
     {
-        genericsReport( V_ERROR, "Cannot specify file and port or NW Server at same time" EOL );
-        return false;
+        genericsReport( V_INFO, "Wait Strategy  : %s" EOL, _dqWaitName[r->options->dqWaitStrategy] );
     }
 
-    if ( (     r->options->paceDelay ) && ( !r->options->file ) )
+    if ( r->options->instrPort )
     {
-        genericsReport( V_ERROR, "Pace Delay only makes sense when input is from a file" EOL );
-        return false;
+        genericsReport( V_INFO, "Instrumentation: localhost:%d" EOL, r->options->instrPort );
     }
 
-    if ( ( r->options->port ) && ( r->options->nwserverPort ) )
+    if ( r->options->sampleComp )
     {
-        genericsReport( V_ERROR, "Cannot specify port and NW Server at same time" EOL );
-        return false;
+        genericsReport( V_INFO, "Sample Comp    : On tag %d" EOL, SAMPLECOMP_TAG );
+    }
+
+    if ( r->options->captureFile )
+    {
+        genericsReport( V_INFO, "Capture File   : %s" EOL, r->options->captureFile );
+    }
+
+    if ( r->options->jumpTime )
+    {
+        genericsReport( V_INFO, "Replay Jump    : %d seconds" EOL, r->options->jumpTime );
+    }
+
+    if ( r->options->pcapFile )
+    {
+        genericsReport( V_INFO, "pcapng File    : %s" EOL, r->options->pcapFile );
+    }
+
+    if ( r->options->affinity )
+    {
+        genericsReport( V_INFO, "Affinity       : feeder=%d decode=%d net=%d" EOL,
+                        r->options->cpuFeeder, r->options->cpuDecode, r->options->cpuNet );
+    }
+
+    if ( r->options->swoLineMode != SWOLINE_NONE )
+    {
+        genericsReport( V_INFO, "SWO Line Decode: %s at %u samples/bit" EOL,
+                        ( r->options->swoLineMode == SWOLINE_UART ) ? "uart" : "manch", r->options->swoLineSpb );
+    }
+
+    if ( r->options->file )
+    {
+        genericsReport( V_INFO, "Pace Delay     : %dus" EOL, r->options->paceDelay );
+
+        for ( int i = 0; i < r->options->numInputFiles; i++ )
+        {
+            genericsReport( V_INFO, "Input File  : %s", r->options->inputFile[i] );
+
+            if ( r->options->numInputFiles > 1 )
+            {
+                genericsReport( V_INFO, " (Merged replay)" EOL );
+            }
+            else if ( r->options->fileTerminate )
+            {
+                genericsReport( V_INFO, " (Terminate on exhaustion)" EOL );
+            }
+            else
+            {
+                genericsReport( V_INFO, " (Ongoing read)" EOL );
+            }
+        }
+    }
+
+    if ( r->options->hiresTime )
+    {
+        genericsReport( V_INFO, "High Res Time" EOL );
+    }
+
+    if ( ( r->options->file ) && ( ( r->options->port ) || ( r->options->nwserverPort ) ) )
+    {
+        genericsReport( V_ERROR, "Cannot specify file and port or NW Server at same time" EOL );
+        return false;
+    }
+
+    if ( (     r->options->paceDelay ) && ( !r->options->file ) )
+    {
+        genericsReport( V_ERROR, "Pace Delay only makes sense when input is from a file" EOL );
+        return false;
+    }
+
+    if ( ( r->options->jumpTime ) && ( !r->options->file ) )
+    {
+        genericsReport( V_ERROR, "Jump only makes sense when input is from a file" EOL );
+        return false;
+    }
+
+    if ( r->options->triggerSpec )
+    {
+        char protName[10];
+
+        if ( 4 != sscanf( r->options->triggerSpec, "%9[^:]:%d:%x-%x", protName,
+                          &r->options->triggerTag, &r->options->triggerLow, &r->options->triggerHigh ) )
+        {
+            genericsReport( V_ERROR, "Trigger format is <protocol>:<tag>:<lowaddr>-<highaddr>" EOL );
+            return false;
+        }
+
+        for ( r->options->triggerProt = TRACE_PROT_LIST_START;
+                ( ( r->options->triggerProt != TRACE_PROT_NUM ) && strcasecmp( protName, TRACEDecodeGetProtocolName( r->options->triggerProt ) ) );
+                r->options->triggerProt++ )
+        {}
+
+        if ( r->options->triggerProt == TRACE_PROT_NUM )
+        {
+            genericsReport( V_ERROR, "Unrecognised trigger trace protocol %s" EOL, protName );
+            return false;
+        }
+
+        if ( r->options->triggerLow > r->options->triggerHigh )
+        {
+            genericsReport( V_ERROR, "Trigger address range is inverted" EOL );
+            return false;
+        }
+
+        if ( !r->options->outfile )
+        {
+            genericsReport( V_ERROR, "Trigger gates the dump file, so -o must be given too" EOL );
+            return false;
+        }
+    }
+
+#if defined( WIN32 )
+
+    if ( r->options->numInputFiles > 1 )
+    {
+        genericsReport( V_ERROR, "Merged replay is not supported on this platform" EOL );
+        return false;
+    }
+
+#endif
+
+    if ( ( r->options->port ) && ( r->options->nwserverPort ) )
+    {
+        genericsReport( V_ERROR, "Cannot specify port and NW Server at same time" EOL );
+        return false;
+    }
+
+    if ( ( r->options->multi ) && ( ( r->options->file ) || ( r->options->port ) || ( r->options->nwserverPort ) || ( r->options->numRelays ) ) )
+    {
+        genericsReport( V_ERROR, "Multi-probe mode only makes sense for USB sources" EOL );
+        return false;
+    }
+
+    if ( ( r->options->numRelays ) && ( ( r->options->file ) || ( r->options->port ) || ( r->options->nwserverPort ) ) )
+    {
+        genericsReport( V_ERROR, "Relay fan-in cannot be combined with another stream source" EOL );
+        return false;
     }
 
     return true;
@@ -699,26 +1468,50 @@ bool _processOptions( int argc, char *argv[], struct RunTime *r )
 // ====================================================================================================
 void _checkInterval( void *params )
 
-/* Perform any interval reporting that may be needed */
+/* Perform any interval reporting that may be needed. Timer wheel callback, so this runs
+ * at its cadence whether or not any data are flowing.
+ */
 
 {
     struct RunTime *r = ( struct RunTime * )params;
     struct timespec ts;
     uint64_t tnow;
     uint64_t snapInterval;
+    static uint64_t snapData[NUM_TAGS];
+    static uint64_t snapDrop[NUM_TAGS];
+    uint64_t snapRawBytes;
+    uint32_t sq;
     int w;
 
     if ( r->options->intervalReportTime )
     {
         clock_gettime( CLOCK_REALTIME, &ts );
         tnow = ts.tv_sec * 1000000000L + ts.tv_nsec;
+        uint64_t elapsed = tnow - r->lastInterval;
 
-        if ( tnow - r->lastInterval >= r->options->intervalReportTime * 1000000L )
+        if ( elapsed )
         {
             r->lastInterval = tnow;
 
-            /* Grab the interval and scale to bits per 1 second */
-            snapInterval = r->intervalRawBytes * 8000L / r->options->intervalReportTime;
+            /* Take a consistent snapshot of the decode-side totals, without stalling the writer */
+            do
+            {
+                sq = genericsSeqReadBegin( &r->statSeq );
+                snapRawBytes = r->totalRawBytes;
+
+                for ( int i = 0; i < NUM_TAGS; i++ )
+                {
+                    snapData[i] = r->tagCount[i].totalData;
+                    snapDrop[i] = r->tagCount[i].totalDrop;
+                }
+            }
+            while ( genericsSeqReadRetry( &r->statSeq, sq ) );
+
+            const uint64_t rawBytes = snapRawBytes - r->lastRawBytes;
+            r->lastRawBytes = snapRawBytes;
+
+            /* Grab the interval and scale to bits per 1 second of what was actually measured */
+            snapInterval = rawBytes * 8000000000ULL / elapsed;
 
             if ( r->conn )
             {
@@ -739,15 +1532,17 @@ void _checkInterval( void *params )
 
                 uint64_t totalPct = 0;
 
-                if ( r->intervalRawBytes )
+                if ( rawBytes )
                 {
                     for ( int i = 0; i < NUM_TAGS; i++ )
                     {
+                        const uint64_t tagData = snapData[i] - r->tagCount[i].lastData;
+                        const uint64_t tagDrop = snapDrop[i] - r->tagCount[i].lastDrop;
                         w = 0;
 
-                        if ( r->tagCount[i].intervalData )
+                        if ( tagData )
                         {
-                            w = ( r->tagCount[i].intervalData * 1000 ) / r->intervalRawBytes;
+                            w = ( tagData * 1000 ) / rawBytes;
                             r->tagCount[i].ts = tnow;
                             totalPct += w;
                         }
@@ -764,13 +1559,28 @@ void _checkInterval( void *params )
                             }
                         }
 
-                        r->tagCount[i].intervalData = 0;
+                        if ( tagDrop )
+                        {
+                            genericsFPrintf( stdout, C_NOCHAN " %d:drop %lu " C_RESET, i, ( unsigned long )tagDrop );
+                        }
                     }
 
                     w = ( totalPct < 1000 ) ? 1000 - totalPct : 0;
                     genericsFPrintf( stdout, " Waste:" C_DATA "%2d.%01d%% " C_RESET,  w / 10, w % 10 );
                 }
 
+                if ( r->options->spillDir )
+                {
+                    uint64_t spillHeld, spillEver;
+                    nwclientSpillStats( &spillHeld, &spillEver );
+
+                    if ( spillEver )
+                    {
+                        genericsFPrintf( stdout, " Spill:" C_DATA "%luK/%luK " C_RESET,
+                                         ( unsigned long )( spillHeld / 1024 ), ( unsigned long )( spillEver / 1024 ) );
+                    }
+                }
+
                 if ( r->options->dataSpeed > 100 )
                 {
                     /* Conversion to percentage done as a division to avoid overflow */
@@ -782,147 +1592,1581 @@ void _checkInterval( void *params )
                 genericsFPrintf( stdout, "   " C_RESET C_CLR_LN EOL );
             }
 
-            r->intervalRawBytes = 0;
+            /* Step the reporting baseline forward whether or not anything was printed */
+            for ( int i = 0; i < NUM_TAGS; i++ )
+            {
+                r->tagCount[i].lastData = snapData[i];
+                r->tagCount[i].lastDrop = snapDrop[i];
+            }
         }
     }
 }
 // ====================================================================================================
-// Block decoders and handlers for the various line formats
+// Options file hot reload
 // ====================================================================================================
-static void _purgeBlock( struct RunTime *r, bool createOFLOW )
+static volatile sig_atomic_t _reloadReq;
 
-/* Send any packets to clients who want it, no matter where they originate from */
+static void _hupHandler( int sig )
 
 {
-    struct Frame oflowOtg;
-    struct handlers *h = r->handler;
-    int i = r->numHandlers;
+    /* Parsing isn't async-signal-safe, so just note the request for the housekeeping thread */
+    ( void )sig;
+    _reloadReq = 1;
+}
+// ====================================================================================================
+static bool _optionsFileApply( struct RunTime *r, bool live )
+
+/* Read the options file named by -c and apply what it contains. At boot the values land in
+ * the options block ahead of the normal validation passes, so they behave exactly like
+ * command line flags. On a SIGHUP reload only settings which are safe to change under a
+ * running capture are accepted, and the whole file is parsed into staging before anything
+ * is touched, so a bad edit leaves the running configuration alone. Ports and device
+ * bindings are deliberately not reloadable; changing those tears down client connections,
+ * which is the very disruption a live reload exists to avoid.
+ */
 
-    while ( i-- )
+{
+    char line[256];
+    char protName[10];
+    uint32_t lineNo = 0;
+    bool ok = true;
+    enum verbLevel complainAt = live ? V_WARN : V_ERROR;
+
+    /* Staging; negative or NULL means the key wasn't present in the file */
+    int32_t stgVerbose = -1;
+    int32_t stgMonitor = -1;
+    int32_t stgPace = -1;
+    int32_t stgWait = -1;
+    char *stgTrigger = NULL;
+    char *stgLatency = NULL;
+    int stgTrigTag = 0;
+    uint32_t stgTrigLow = 0;
+    uint32_t stgTrigHigh = 0;
+    uint32_t stgLatencyUs[NUM_TAGS];
+
+    memcpy( stgLatencyUs, r->options->tagLatencyUs, sizeof( stgLatencyUs ) );
+
+    FILE *f = fopen( r->options->optFile, "r" );
+
+    if ( !f )
     {
-        if ( h->strippedBlock->fillLevel )
-        {
-            nwclientSend( h->n, h->strippedBlock->fillLevel, h->strippedBlock->buffer );
+        genericsReport( complainAt, "Cannot open options file %s" EOL, r->options->optFile );
+        return false;
+    }
 
-            if ( createOFLOW )
-            {
-                /* The OFLOW encoded version goes out on the combined OFLOW channel, with a specific channel header */
-                int j = h->strippedBlock->fillLevel;
-                const uint8_t *b = h->strippedBlock->buffer;
+    while ( ok && fgets( line, sizeof( line ), f ) )
+    {
+        lineNo++;
+        char *c = line;
+        char *e = strchr( c, '#' );
 
-                while ( j )
-                {
-                    OFLOWEncode( h->channel, 0, b, ( j < OFLOW_MAX_PACKET_LEN ) ? j : OFLOW_MAX_PACKET_LEN, &oflowOtg );
-                    nwclientSend( _r.oflowHandler, oflowOtg.len, oflowOtg.d );
-                    b += ( j < OFLOW_MAX_PACKET_LEN ) ? j : OFLOW_MAX_PACKET_LEN;
-                    j -= ( j < OFLOW_MAX_PACKET_LEN ) ? j : OFLOW_MAX_PACKET_LEN;
-                }
-            }
+        if ( e )
+        {
+            *e = 0;
+        }
 
-            h->strippedBlock->fillLevel = 0;
+        while ( isspace( *c ) )
+        {
+            c++;
         }
 
-        h++;
-    }
-}
-// ====================================================================================================
-static void _TPIUpacketRxed( enum TPIUPumpEvent e, struct TPIUPacket *p, void *param )
+        e = c + strlen( c );
 
-/* Callback for when a TPIU frame has been assembled */
+        while ( ( e > c ) && ( isspace( *( e - 1 ) ) ) )
+        {
+            *--e = 0;
+        }
 
-{
-    struct RunTime *r = ( struct RunTime * )param;
+        if ( !*c )
+        {
+            continue;
+        }
 
-    struct handlers *h = NULL;
-    int cachedChannel = -1;
-    int chIndex = 0;
+        char *v = strchr( c, '=' );
 
-    switch ( e )
-    {
-        case TPIU_EV_RXEDPACKET:
+        if ( !v )
+        {
+            genericsReport( complainAt, "Options file line %u is not <key>=<value>" EOL, lineNo );
+            ok = false;
+            break;
+        }
 
-            /* Iterate through the packet, putting it into the correct output buffers */
-            for ( uint32_t g = 0; g < p->len; g++ )
-            {
-                if ( cachedChannel != p->packet[g].s )
-                {
-                    /* Whatever happens, cache this result */
-                    cachedChannel = p->packet[g].s;
+        /* Split the assignment and trim both sides of it */
+        e = v++;
 
-                    /* Search for channel */
-                    h = r->handler;
+        while ( ( e > c ) && ( isspace( *( e - 1 ) ) ) )
+        {
+            e--;
+        }
 
-                    for ( chIndex = 0; chIndex < r->numHandlers; chIndex++ )
-                    {
-                        if ( h->channel == p->packet[g].s )
-                        {
-                            break;
-                        }
+        *e = 0;
 
-                        h++;
-                    }
-                }
+        while ( isspace( *v ) )
+        {
+            v++;
+        }
 
-                r->tagCount[p->packet[g].s].totalData++;
-                r->tagCount[p->packet[g].s].intervalData++;
+        if ( !strcmp( c, "verbose" ) )
+        {
+            stgVerbose = isdigit( *v ) ? atoi( v ) : -1;
 
-                if ( ( chIndex != r->numHandlers ) && ( h ) )
-                {
-                    /* We must have found a match for this at some point, so add it to the queue */
-                    h->strippedBlock->buffer[h->strippedBlock->fillLevel++] = p->packet[g].d;
-                }
-                else
-                {
-                    genericsReport( V_DEBUG, "No handler for tag %d" EOL, p->packet[g].s );
-                }
+            if ( ( stgVerbose < 0 ) || ( stgVerbose >= V_MAX_VERBLEVEL ) )
+            {
+                genericsReport( complainAt, "Verbosity out of range in options file" EOL );
+                ok = false;
             }
+        }
+        else if ( !strcmp( c, "monitor" ) )
+        {
+            stgMonitor = atoi( v );
 
-            break;
+            /* A live reload may set 0 to turn reporting off; at boot mirror the -m range check */
+            if ( ( stgMonitor < 500 ) && ( ( !live ) || ( stgMonitor ) ) )
+            {
+                genericsReport( complainAt, "intervalReportTime is out of range in options file" EOL );
+                ok = false;
+            }
+        }
+        else if ( !strcmp( c, "pace" ) )
+        {
+            stgPace = atoi( v );
 
-        case TPIU_EV_ERROR:
-            genericsReport( V_WARN, "****ERROR****%s" EOL, ( r->options->intervalReportTime ) ? EOL : "" );
-            break;
+            if ( stgPace <= 0 )
+            {
+                genericsReport( complainAt, "paceDelay is out of range in options file" EOL );
+                ok = false;
+            }
+        }
+        else if ( !strcmp( c, "wait-strategy" ) )
+        {
+            stgWait = _dqWaitStrategyFromName( v );
 
-        case TPIU_EV_NEWSYNC:
-        case TPIU_EV_SYNCED:
-        case TPIU_EV_RXING:
-        case TPIU_EV_NONE:
-        case TPIU_EV_UNSYNCED:
-        default:
-            break;
+            if ( stgWait < 0 )
+            {
+                genericsReport( complainAt, "Wait strategy in options file must be park, yield or spin" EOL );
+                ok = false;
+            }
+        }
+        else if ( !strcmp( c, "trigger" ) )
+        {
+            free( stgTrigger );
+            stgTrigger = strdup( v );
+            MEMCHECK( stgTrigger, false );
+        }
+        else if ( !strcmp( c, "tag-latency" ) )
+        {
+            free( stgLatency );
+            stgLatency = strdup( v );
+            MEMCHECK( stgLatency, false );
+        }
+        else
+        {
+            genericsReport( complainAt, "Options file key '%s' is not recognised" EOL, c );
+            ok = false;
+        }
     }
-}
-// ====================================================================================================
-
-static void _OFLOWpacketRxed( struct OFLOWFrame *p, void *param )
-
-/* OFLOW packet received, account for it and reflect it to legacy buffers if needed */
 
-{
-    int chIndex;
-    struct RunTime *r = ( struct RunTime * )param;
-    struct handlers *h = _r.handler;
+    fclose( f );
 
-    if ( !p->good )
-    {
-        genericsReport( V_INFO, "Bad packet received" EOL );
-    }
-    else if ( ( r->options->useTPIU ) && ( h->channel == DEFAULT_ITM_STREAM ) )
+    /* The compound keys get validated in full before anything at all is applied. At boot
+     * they are simply handed to the flag validation below us, so only the live path checks
+     * them here.
+     */
+    if ( ( ok ) && ( live ) && ( stgTrigger ) )
     {
-        /* Deal with the bizzare combination of OFLOW and TPIU in channel 1 */
-        /* Accounting will be done in TPIUPump */
-        TPIUPump( &r->t, p->d, p->len, _TPIUpacketRxed, r );
+        if ( !r->options->triggerSpec )
+        {
+            genericsReport( V_WARN, "Trigger cannot be introduced by reload; the scanner is only armed at startup" EOL );
+            ok = false;
+        }
+        else if ( 4 != sscanf( stgTrigger, "%9[^:]:%d:%x-%x", protName, &stgTrigTag, &stgTrigLow, &stgTrigHigh ) )
+        {
+            genericsReport( V_WARN, "Trigger format is <protocol>:<tag>:<lowaddr>-<highaddr>" EOL );
+            ok = false;
+        }
+        else if ( strcasecmp( protName, TRACEDecodeGetProtocolName( r->options->triggerProt ) ) )
+        {
+            genericsReport( V_WARN, "Trigger protocol cannot be changed by reload" EOL );
+            ok = false;
+        }
+        else if ( stgTrigLow > stgTrigHigh )
+        {
+            genericsReport( V_WARN, "Trigger address range is inverted" EOL );
+            ok = false;
+        }
     }
-    else
+
+    if ( ( ok ) && ( live ) && ( stgLatency ) )
     {
-        /* Account for this reception */
-        r->tagCount[p->tag].totalData += p->len;
-        r->tagCount[p->tag].intervalData += p->len;
+        char *l = stgLatency;
 
-        /* Search for channel */
-        for ( chIndex = 0; chIndex < r->numHandlers; chIndex++ )
+        while ( ( ok ) && ( *l ) )
         {
-            if ( h->channel == p->tag )
+            unsigned int tag, ms;
+            int adv = 0;
+
+            if ( ( 2 != sscanf( l, "%u:%u%n", &tag, &ms, &adv ) ) || ( tag >= NUM_TAGS ) || ( ms > MAX_TAG_LATENCY_MS ) )
+            {
+                genericsReport( V_WARN, "Bad tag latency specification in options file" EOL );
+                ok = false;
+                break;
+            }
+
+            stgLatencyUs[tag] = ms * 1000;
+            l += adv;
+
+            if ( *l == ',' )
+            {
+                l++;
+            }
+            else if ( *l )
+            {
+                genericsReport( V_WARN, "Illegal character in latency specification (%c)" EOL, *l );
+                ok = false;
+            }
+        }
+    }
+
+    if ( !ok )
+    {
+        free( stgTrigger );
+        free( stgLatency );
+        return false;
+    }
+
+    if ( stgVerbose >= 0 )
+    {
+        genericsSetReportLevel( ( enum verbLevel )stgVerbose );
+    }
+
+    if ( !live )
+    {
+        /* Boot; hand everything to the validation passes that follow, exactly as flags would */
+        if ( stgMonitor >= 0 )
+        {
+            r->options->intervalReportTime = stgMonitor;
+        }
+
+        if ( stgPace > 0 )
+        {
+            r->options->paceDelay = stgPace;
+        }
+
+        if ( stgWait >= 0 )
+        {
+            r->options->dqWaitStrategy = stgWait;
+        }
+
+        if ( stgTrigger )
+        {
+            r->options->triggerSpec = stgTrigger;
+        }
+
+        if ( stgLatency )
+        {
+            r->options->tagLatency = stgLatency;
+        }
+
+        return true;
+    }
+
+    /* Live; each swap below is a plain scalar store which the pipelines pick up at the next
+     * block boundary, so nothing in flight is disturbed and no captured bytes are lost.
+     */
+    if ( ( stgMonitor >= 0 ) && ( ( uint32_t )stgMonitor != r->options->intervalReportTime ) )
+    {
+        r->options->intervalReportTime = stgMonitor;
+
+        /* Re-cadence the primary report timer; extra probe instances keep their boot cadence */
+        if ( _intervalTimer )
+        {
+            twCancel( _timers, _intervalTimer );
+            _intervalTimer = NULL;
+        }
+
+        if ( stgMonitor )
+        {
+            _intervalTimer = twRepeat( _timers, ( uint64_t )stgMonitor * 1000ULL, _checkInterval, r );
+        }
+    }
+
+    if ( stgPace > 0 )
+    {
+        r->options->paceDelay = stgPace;
+    }
+
+    if ( ( stgWait >= 0 ) && ( stgWait != r->options->dqWaitStrategy ) )
+    {
+        r->options->dqWaitStrategy = stgWait;
+
+        /* Nudge a parked consumer so it re-evaluates the strategy rather than sleeping on */
+        if ( atomic_load( &r->dqWaiting ) )
+        {
+            pthread_mutex_lock( &r->dqMutex );
+            pthread_cond_signal( &r->dqUpdated );
+            pthread_mutex_unlock( &r->dqMutex );
+        }
+    }
+
+    if ( stgTrigger )
+    {
+        r->options->triggerTag = stgTrigTag;
+        r->options->triggerLow = stgTrigLow;
+        r->options->triggerHigh = stgTrigHigh;
+        r->triggered = false;                      /* Re-arm against the new range */
+        free( stgTrigger );
+    }
+
+    if ( stgLatency )
+    {
+        memcpy( r->options->tagLatencyUs, stgLatencyUs, sizeof( stgLatencyUs ) );
+
+        for ( int i = 0; i < r->numHandlers; i++ )
+        {
+            r->handler[i].latencyBudgetUs = stgLatencyUs[r->handler[i].channel];
+        }
+
+        free( stgLatency );
+    }
+
+    return true;
+}
+// ====================================================================================================
+static void _checkReload( void *params )
+
+/* Act on any pending SIGHUP. Timer wheel callback, so the parse and swap run on the
+ * housekeeping thread rather than in signal context.
+ */
+
+{
+    struct RunTime *r = ( struct RunTime * )params;
+
+    if ( _reloadReq )
+    {
+        _reloadReq = 0;
+
+        if ( _optionsFileApply( r, true ) )
+        {
+            genericsReport( V_INFO, "Reloaded options from %s" EOL, r->options->optFile );
+        }
+        else
+        {
+            genericsReport( V_WARN, "Options reload failed; running configuration unchanged" EOL );
+        }
+    }
+}
+// ====================================================================================================
+// Hot-path instrumentation
+// ====================================================================================================
+static inline uint64_t _instrStamp( struct RunTime *r )
+
+/* Timestamp the start of a pipeline stage, or 0 when instrumentation is off */
+
+{
+    struct timespec ts;
+
+    if ( !r->options->instrPort )
+    {
+        return 0;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    /* Never return 0 for a live stamp, that means 'off' to _instrRecord */
+    return ( ( uint64_t )ts.tv_sec * 1000000000L + ts.tv_nsec ) | 1;
+}
+// ====================================================================================================
+static void _instrRecord( struct RunTime *r, enum instrStage s, uint64_t start )
+
+/* Fold the elapsed time since start into the stage's histogram */
+
+{
+    struct timespec ts;
+    int b = 0;
+
+    if ( !start )
+    {
+        return;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    uint64_t d = ( ( uint64_t )ts.tv_sec * 1000000000L + ts.tv_nsec ) - start;
+    struct stageStats *t = &r->instrStat[s];
+
+    atomic_fetch_add( &t->count, 1 );
+    atomic_fetch_add( &t->totalNs, d );
+
+    uint64_t prevMax = atomic_load( &t->maxNs );
+
+    while ( ( d > prevMax ) && ( !atomic_compare_exchange_weak( &t->maxNs, &prevMax, d ) ) )
+    {
+        /* Another thread moved the maximum; retry against the fresh value */
+    }
+
+    while ( ( b < INSTR_NUM_BUCKETS - 1 ) && ( d >> ( b + 1 ) ) )
+    {
+        b++;
+    }
+
+    atomic_fetch_add( &t->bucket[b], 1 );
+}
+// ====================================================================================================
+static void _anomalyNote( struct RunTime *r, enum anomalyKind k )
+
+/* File one stream anomaly into the forensic ring. Anomalies are rare by definition, so
+ * taking a clock read here costs nothing on the healthy path.
+ */
+
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    struct anomalyRec *a = &r->anomaly[atomic_load( &r->anomalyWp ) % ANOMALY_RING_LEN];
+    a->ns         = ( uint64_t )ts.tv_sec * 1000000000L + ts.tv_nsec;
+    a->totalBytes = r->totalRawBytes;
+    a->kind       = k;
+
+    atomic_fetch_add( &r->anomalyCount[k], 1 );
+    atomic_fetch_add( &r->anomalyWp, 1 );
+}
+// ====================================================================================================
+static void *_instrServer( void *params )
+
+/* Serve the stage histograms as JSON over a local socket; one dump per connection */
+
+{
+    struct RunTime *r = ( struct RunTime * )params;
+    static const char *_stageName[INSTR_STAGE_NUM_STAGES] = { INSTR_STAGE_NAMES };
+    struct sockaddr_in serv_addr;
+    int sockfd, newsockfd;
+    int flag = 1;
+    char op[INSTR_MAX_RESPONSE];
+
+    sockfd = socket( AF_INET, SOCK_STREAM, 0 );
+    setsockopt( sockfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof( flag ) );
+    setsockopt( sockfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof( flag ) );
+
+    if ( sockfd < 0 )
+    {
+        genericsExit( -1, "Error opening instrumentation socket" EOL );
+    }
+
+    memset( ( char * ) &serv_addr, 0, sizeof( serv_addr ) );
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    serv_addr.sin_port = htons( r->options->instrPort );
+
+    if ( bind( sockfd, ( struct sockaddr * ) &serv_addr, sizeof( serv_addr ) ) < 0 )
+    {
+        genericsExit( -1, "Instrumentation port %d already in use" EOL, r->options->instrPort );
+    }
+
+    listen( sockfd, 5 );
+
+    while ( !r->ending )
+    {
+        newsockfd = accept( sockfd, NULL, NULL );
+
+        if ( newsockfd < 0 )
+        {
+            continue;
+        }
+
+        int l = 0;
+        l += snprintf( &op[l], sizeof( op ) - l, "{" EOL "  \"stages\": [" EOL );
+
+        for ( int s = 0; s < INSTR_STAGE_NUM_STAGES; s++ )
+        {
+            struct stageStats *t = &r->instrStat[s];
+
+            l += snprintf( &op[l], sizeof( op ) - l,
+                           "    { \"name\": \"%s\", \"count\": %" PRIu64 ", \"total_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 ", \"log2_ns_buckets\": [",
+                           _stageName[s],
+                           ( uint64_t )atomic_load( &t->count ),
+                           ( uint64_t )atomic_load( &t->totalNs ),
+                           ( uint64_t )atomic_load( &t->maxNs ) );
+
+            for ( int b = 0; b < INSTR_NUM_BUCKETS; b++ )
+            {
+                l += snprintf( &op[l], sizeof( op ) - l, "%s%" PRIu64, b ? "," : "", ( uint64_t )atomic_load( &t->bucket[b] ) );
+            }
+
+            l += snprintf( &op[l], sizeof( op ) - l, "] }%s" EOL, ( s < INSTR_STAGE_NUM_STAGES - 1 ) ? "," : "" );
+        }
+
+        l += snprintf( &op[l], sizeof( op ) - l, "  ]," EOL );
+
+        /* Decode queue health; live occupancy plus how the consumer has been waiting */
+        l += snprintf( &op[l], sizeof( op ) - l,
+                       "  \"decode_queue\": { \"wait_strategy\": \"%s\", \"occupancy\": %u, \"parks\": %" PRIu64
+                       ", \"wakeups\": %" PRIu64 ", \"spins\": %" PRIu64 ", \"yields\": %" PRIu64 " }," EOL,
+                       _dqWaitName[r->options->dqWaitStrategy],
+                       ( unsigned int )( ( atomic_load( &r->dqWp ) + NUM_RAW_BLOCKS + 1 - atomic_load( &r->dqRp ) ) % ( NUM_RAW_BLOCKS + 1 ) ),
+                       ( uint64_t )atomic_load( &r->dqStatParks ),
+                       ( uint64_t )atomic_load( &r->dqStatWakeups ),
+                       ( uint64_t )atomic_load( &r->dqStatSpins ),
+                       ( uint64_t )atomic_load( &r->dqStatYields ) );
+
+        /* Forensic anomaly report; totals, report-time periodicity analysis and recent events */
+        static const char *_kindName[ANOM_NUM_KINDS] = { ANOMALY_KIND_NAMES };
+        uint32_t awp = atomic_load( &r->anomalyWp );
+        uint32_t anum = ( awp > ANOMALY_RING_LEN ) ? ANOMALY_RING_LEN : awp;
+        l += snprintf( &op[l], sizeof( op ) - l, "  \"anomalies\": { \"total\": %" PRIu64 ", \"kinds\": [" EOL,
+                       ( uint64_t )awp );
+
+        for ( int k = 0; k < ANOM_NUM_KINDS; k++ )
+        {
+            /* A kind is called periodic when at least four successive gaps agree within 12% */
+            uint64_t lastNs = 0;
+            uint64_t sumGap = 0;
+            uint64_t minGap = UINT64_MAX;
+            uint64_t maxGap = 0;
+            uint32_t nGaps = 0;
+
+            for ( uint32_t i = awp - anum; i != awp; i++ )
+            {
+                struct anomalyRec *a = &r->anomaly[i % ANOMALY_RING_LEN];
+
+                if ( a->kind != k )
+                {
+                    continue;
+                }
+
+                if ( lastNs )
+                {
+                    uint64_t gap = a->ns - lastNs;
+                    sumGap += gap;
+                    minGap = ( gap < minGap ) ? gap : minGap;
+                    maxGap = ( gap > maxGap ) ? gap : maxGap;
+                    nGaps++;
+                }
+
+                lastNs = a->ns;
+            }
+
+            uint64_t meanGap = nGaps ? sumGap / nGaps : 0;
+            bool periodic = ( nGaps >= 4 ) && ( ( maxGap - minGap ) * 8 < meanGap );
+
+            l += snprintf( &op[l], sizeof( op ) - l,
+                           "    { \"name\": \"%s\", \"count\": %" PRIu64 ", \"periodic\": %s, \"period_us\": %" PRIu64 " }%s" EOL,
+                           _kindName[k],
+                           ( uint64_t )atomic_load( &r->anomalyCount[k] ),
+                           periodic ? "true" : "false",
+                           periodic ? meanGap / 1000 : 0,
+                           ( k < ANOM_NUM_KINDS - 1 ) ? "," : "" );
+        }
+
+        uint32_t elist = ( anum > ANOMALY_REPORT_EVENTS ) ? ANOMALY_REPORT_EVENTS : anum;
+        l += snprintf( &op[l], sizeof( op ) - l, "  ], \"events\": [" EOL );
+
+        for ( uint32_t i = awp - elist; i != awp; i++ )
+        {
+            struct anomalyRec *a = &r->anomaly[i % ANOMALY_RING_LEN];
+            l += snprintf( &op[l], sizeof( op ) - l,
+                           "    { \"kind\": \"%s\", \"ns\": %" PRIu64 ", \"total_bytes\": %" PRIu64 " }%s" EOL,
+                           _kindName[a->kind], a->ns, a->totalBytes, ( i != awp - 1 ) ? "," : "" );
+        }
+
+        l += snprintf( &op[l], sizeof( op ) - l, "  ] }" EOL "}" EOL );
+
+        if ( write( newsockfd, op, l ) < 0 )
+        {
+            genericsReport( V_DEBUG, "Instrumentation client went away" EOL );
+        }
+
+        close( newsockfd );
+    }
+
+    close( sockfd );
+    return NULL;
+}
+// ====================================================================================================
+// Native capture recording
+// ====================================================================================================
+static void _put64le( uint8_t *d, uint64_t v )
+
+/* Explicit little-endian so captures read back across hosts */
+
+{
+    for ( int i = 0; i < 8; i++ )
+    {
+        *d++ = v & 0xff;
+        v >>= 8;
+    }
+}
+// ====================================================================================================
+static uint64_t _get64le( const uint8_t *d )
+
+{
+    uint64_t v = 0;
+
+    for ( int i = 7; i >= 0; i-- )
+    {
+        v = ( v << 8 ) | d[i];
+    }
+
+    return v;
+}
+// ====================================================================================================
+static void _recordBytes( struct RunTime *r, uint32_t len, const uint8_t *buffer )
+
+/* Queue OFLOW output for the capture writer. A full ring sheds rather than stalls; the
+ * recording is a convenience and must never hold up the live clients.
+ */
+
+{
+    if ( ( !r->recordRing ) || ( !len ) )
+    {
+        return;
+    }
+
+    uint64_t wp = atomic_load( &r->recWp );
+    uint64_t rp = atomic_load( &r->recRp );
+
+    if ( len > RECORD_RING_SIZE - ( uint32_t )( wp - rp ) )
+    {
+        r->recordDropped += len;
+        return;
+    }
+
+    uint32_t wi = wp & RECORD_RING_MASK;
+
+    if ( wi + len > RECORD_RING_SIZE )
+    {
+        uint32_t firstSpan = RECORD_RING_SIZE - wi;
+        memcpy( &r->recordRing[wi], buffer, firstSpan );
+        memcpy( &r->recordRing[0], &buffer[firstSpan], len - firstSpan );
+    }
+    else
+    {
+        memcpy( &r->recordRing[wi], buffer, len );
+    }
+
+    atomic_store( &r->recWp, wp + len );
+
+    pthread_mutex_lock( &r->recMutex );
+    pthread_cond_signal( &r->recUpdated );
+    pthread_mutex_unlock( &r->recMutex );
+}
+// ====================================================================================================
+static void _recordWrite( struct RunTime *r, const uint8_t *d, uint32_t len, bool flush )
+
+/* Put bytes to the capture file, through the compressor if one is in use. A flush makes the
+ * data so far decodable, so a truncated capture is still usable up to its last flush point.
+ */
+
+{
+#if defined( WITH_ZSTD )
+
+    if ( r->recordZstd )
+    {
+        ZSTD_inBuffer in = { d, len, 0 };
+        ZSTD_EndDirective mode = flush ? ZSTD_e_flush : ZSTD_e_continue;
+        size_t remaining;
+
+        do
+        {
+            ZSTD_outBuffer out = { r->recordZBuf, r->recordZBufLen, 0 };
+            remaining = ZSTD_compressStream2( r->recordZstd, &out, &in, mode );
+
+            if ( ZSTD_isError( remaining ) )
+            {
+                genericsReport( V_ERROR, "Capture compression failed: %s" EOL, ZSTD_getErrorName( remaining ) );
+                return;
+            }
+
+            if ( ( out.pos ) && ( write( r->recordFd, r->recordZBuf, out.pos ) < 0 ) )
+            {
+                genericsReport( V_ERROR, "Capture write failed" EOL );
+                return;
+            }
+        }
+        while ( ( in.pos < in.size ) || ( ( flush ) && ( remaining ) ) );
+
+        return;
+    }
+
+#else
+    ( void )flush;
+#endif
+
+    if ( write( r->recordFd, d, len ) < 0 )
+    {
+        genericsReport( V_ERROR, "Capture write failed" EOL );
+    }
+}
+// ====================================================================================================
+static void _recordEmitIndex( struct RunTime *r, uint64_t captureBytes )
+
+/* Append an index frame; walltime, capture position and per-tag running totals at this point */
+
+{
+    struct Frame f;
+    uint8_t p[18 + RECORD_INDEX_MAX_TAGS * 9];
+    struct timespec ts;
+    int l = 0;
+    int numTags = 0;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+
+    p[l++] = RECORD_INDEX_VERSION;
+    _put64le( &p[l], ( uint64_t )ts.tv_sec * 1000000L + ts.tv_nsec / 1000 );
+    l += 8;
+    _put64le( &p[l], captureBytes );
+    l += 8;
+
+    int tagCountAt = l++;
+
+    for ( int i = 0; ( i < NUM_TAGS ) && ( numTags < RECORD_INDEX_MAX_TAGS ); i++ )
+    {
+        uint64_t d;
+        GENERICS_SEQ_SNAPSHOT( &r->statSeq, d, r->tagCount[i].totalData );
+
+        if ( d )
+        {
+            p[l++] = i;
+            _put64le( &p[l], d );
+            l += 8;
+            numTags++;
+        }
+    }
+
+    p[tagCountAt] = numTags;
+
+    OFLOWEncode( RECORD_INDEX_TAG, 0, p, l, &f );
+
+    /* Index points are also flush points, so a truncated capture decodes up to its last index */
+    _recordWrite( r, f.d, f.len, true );
+}
+// ====================================================================================================
+static void *_recordWorker( void *params )
+
+/* Low priority drain of the capture ring to disk, interleaving periodic index frames */
+
+{
+    struct RunTime *r = ( struct RunTime * )params;
+    struct timespec ts;
+    uint64_t captureBytes = 0;
+    uint64_t bytesSinceIndex = 0;
+    uint64_t lastIndexUs;
+
+#if defined( LINUX )
+    /* Disk writing should lose the CPU to every decode and despatch thread */
+    struct sched_param sp = { 0 };
+    pthread_setschedparam( pthread_self(), SCHED_IDLE, &sp );
+#endif
+
+    _recordWrite( r, ( const uint8_t * )OFLOW_SIG, OFLOW_SIG_LEN, false );
+
+    /* Lead with an index so the replay side always has a base time */
+    _recordEmitIndex( r, captureBytes );
+    clock_gettime( CLOCK_REALTIME, &ts );
+    lastIndexUs = ( uint64_t )ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+
+    while ( true )
+    {
+        pthread_mutex_lock( &r->recMutex );
+
+        while ( ( atomic_load( &r->recRp ) == atomic_load( &r->recWp ) ) && ( !r->recordExit ) )
+        {
+            pthread_cond_wait( &r->recUpdated, &r->recMutex );
+        }
+
+        pthread_mutex_unlock( &r->recMutex );
+
+        uint64_t rp = atomic_load( &r->recRp );
+        uint64_t wp = atomic_load( &r->recWp );
+
+        if ( rp == wp )
+        {
+            /* Nothing left to drain, so this must be an exit request */
+            break;
+        }
+
+        /* Write in contiguous spans, wrapping over the ring end if needed */
+        while ( rp != wp )
+        {
+            uint32_t ri  = rp & RECORD_RING_MASK;
+            uint32_t len = wp - rp;
+
+            if ( ri + len > RECORD_RING_SIZE )
+            {
+                len = RECORD_RING_SIZE - ri;
+            }
+
+            _recordWrite( r, &r->recordRing[ri], len, false );
+
+            captureBytes += len;
+            bytesSinceIndex += len;
+            rp += len;
+            atomic_store( &r->recRp, rp );
+        }
+
+        clock_gettime( CLOCK_REALTIME, &ts );
+        uint64_t now = ( uint64_t )ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+
+        if ( ( now - lastIndexUs >= RECORD_INDEX_INTERVAL_US ) || ( bytesSinceIndex >= RECORD_INDEX_MAX_BYTES ) )
+        {
+            _recordEmitIndex( r, captureBytes );
+            lastIndexUs = now;
+            bytesSinceIndex = 0;
+        }
+    }
+
+    /* Closing index so a replay can bound the session */
+    _recordEmitIndex( r, captureBytes );
+
+#if defined( WITH_ZSTD )
+
+    if ( r->recordZstd )
+    {
+        /* Drain the compressor and finish the frame */
+        ZSTD_inBuffer in = { NULL, 0, 0 };
+        size_t remaining;
+
+        do
+        {
+            ZSTD_outBuffer out = { r->recordZBuf, r->recordZBufLen, 0 };
+            remaining = ZSTD_compressStream2( r->recordZstd, &out, &in, ZSTD_e_end );
+
+            if ( ZSTD_isError( remaining ) )
+            {
+                genericsReport( V_ERROR, "Capture compression failed: %s" EOL, ZSTD_getErrorName( remaining ) );
+                break;
+            }
+
+            if ( ( out.pos ) && ( write( r->recordFd, r->recordZBuf, out.pos ) < 0 ) )
+            {
+                genericsReport( V_ERROR, "Capture write failed" EOL );
+                break;
+            }
+        }
+        while ( remaining );
+
+        ZSTD_freeCCtx( r->recordZstd );
+        r->recordZstd = NULL;
+    }
+
+#endif
+
+    close( r->recordFd );
+    r->recordFd = 0;
+
+    if ( r->recordDropped )
+    {
+        genericsReport( V_WARN, "%" PRIu64 " capture bytes were shed because the writer fell behind" EOL, r->recordDropped );
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+// pcapng export
+// ====================================================================================================
+static void _put32le( uint8_t *d, uint32_t v )
+
+{
+    for ( int i = 0; i < 4; i++ )
+    {
+        *d++ = v & 0xff;
+        v >>= 8;
+    }
+}
+// ====================================================================================================
+static void _pcapQueue( struct RunTime *r, uint8_t tag, uint64_t tstamp, const uint8_t *d, uint32_t len )
+
+/* Queue one OFLOW frame for the pcapng writer. Whole frames only; if the ring can't take
+ * this one it is shed, since the export must never hold up the live clients.
+ */
+
+{
+    uint8_t hdr[PCAP_REC_HDR_LEN];
+
+    if ( ( !r->pcapRing ) || ( !len ) )
+    {
+        return;
+    }
+
+    uint64_t wp = atomic_load( &r->pcapWp );
+    uint64_t rp = atomic_load( &r->pcapRp );
+
+    if ( PCAP_REC_HDR_LEN + len > PCAP_RING_SIZE - ( uint32_t )( wp - rp ) )
+    {
+        r->pcapDropped++;
+        return;
+    }
+
+    if ( !tstamp )
+    {
+        /* Frame with no time of its own gets the reception wallclock */
+        struct timespec ts;
+        clock_gettime( CLOCK_REALTIME, &ts );
+        tstamp = ( uint64_t )ts.tv_sec * 1000000000L + ts.tv_nsec;
+    }
+
+    hdr[0] = tag;
+    hdr[1] = 0;
+    hdr[2] = len & 0xff;
+    hdr[3] = ( len >> 8 ) & 0xff;
+    _put64le( &hdr[4], tstamp );
+
+    for ( int part = 0; part < 2; part++ )
+    {
+        const uint8_t *s = part ? d : hdr;
+        uint32_t l       = part ? len : PCAP_REC_HDR_LEN;
+        uint32_t wi      = wp & PCAP_RING_MASK;
+
+        if ( wi + l > PCAP_RING_SIZE )
+        {
+            uint32_t firstSpan = PCAP_RING_SIZE - wi;
+            memcpy( &r->pcapRing[wi], s, firstSpan );
+            memcpy( &r->pcapRing[0], &s[firstSpan], l - firstSpan );
+        }
+        else
+        {
+            memcpy( &r->pcapRing[wi], s, l );
+        }
+
+        wp += l;
+    }
+
+    atomic_store( &r->pcapWp, wp );
+
+    pthread_mutex_lock( &r->pcapMutex );
+    pthread_cond_signal( &r->pcapUpdated );
+    pthread_mutex_unlock( &r->pcapMutex );
+}
+// ====================================================================================================
+static void _pcapRingOut( struct RunTime *r, uint64_t rp, uint8_t *d, uint32_t len )
+
+/* Copy bytes out of the export ring, wrapping over the end if needed */
+
+{
+    uint32_t ri = rp & PCAP_RING_MASK;
+
+    if ( ri + len > PCAP_RING_SIZE )
+    {
+        uint32_t firstSpan = PCAP_RING_SIZE - ri;
+        memcpy( d, &r->pcapRing[ri], firstSpan );
+        memcpy( &d[firstSpan], &r->pcapRing[0], len - firstSpan );
+    }
+    else
+    {
+        memcpy( d, &r->pcapRing[ri], len );
+    }
+}
+// ====================================================================================================
+static void _pcapEmitIDB( struct RunTime *r, uint8_t tag )
+
+/* Write an Interface Description Block for a tag; interface names carry the tag number and
+ * timestamps are declared in nanoseconds.
+ */
+
+{
+    uint8_t b[64];
+    char name[16];
+    uint32_t nameLen = snprintf( name, sizeof( name ), "oflow_tag_%d", tag );
+    uint32_t namePad = ( 4 - ( nameLen & 3 ) ) & 3;
+
+    /* Fixed part, if_name option, if_tsresol option, end of options, trailing length */
+    uint32_t total = 16 + ( 4 + nameLen + namePad ) + 8 + 4 + 4;
+    uint32_t l = 0;
+
+    _put32le( &b[l], PCAP_IDB_TYPE );
+    l += 4;
+    _put32le( &b[l], total );
+    l += 4;
+    _put32le( &b[l], PCAP_LINKTYPE_USER0 );
+    l += 4;
+    _put32le( &b[l], 0 );                                /* No snap length limit */
+    l += 4;
+
+    b[l++] = PCAP_OPT_IF_NAME & 0xff;
+    b[l++] = 0;
+    b[l++] = nameLen & 0xff;
+    b[l++] = 0;
+    memcpy( &b[l], name, nameLen );
+    l += nameLen;
+    memset( &b[l], 0, namePad );
+    l += namePad;
+
+    b[l++] = PCAP_OPT_IF_TSRESOL & 0xff;
+    b[l++] = 0;
+    b[l++] = 1;
+    b[l++] = 0;
+    b[l++] = 9;                                          /* 10^-9; frame times are in ns */
+    b[l++] = 0;
+    b[l++] = 0;
+    b[l++] = 0;
+
+    _put32le( &b[l], 0 );                                /* End of options */
+    l += 4;
+    _put32le( &b[l], total );
+    l += 4;
+
+    fwrite( b, 1, l, r->pcapFp );
+}
+// ====================================================================================================
+static void *_pcapWorker( void *params )
+
+/* Low priority drain of the export ring, wrapping each frame in an Enhanced Packet Block */
+
+{
+    struct RunTime *r = ( struct RunTime * )params;
+    static uint8_t payload[OFLOW_MAX_PACKET_LEN];
+    uint8_t hdr[PCAP_REC_HDR_LEN];
+    uint8_t b[32];
+    int ifForTag[NUM_TAGS];
+    int numIfs = 0;
+
+    for ( int i = 0; i < NUM_TAGS; i++ )
+    {
+        ifForTag[i] = -1;
+    }
+
+#if defined( LINUX )
+    /* Disk writing should lose the CPU to every decode and despatch thread */
+    struct sched_param sp = { 0 };
+    pthread_setschedparam( pthread_self(), SCHED_IDLE, &sp );
+#endif
+
+    /* Section Header Block opens the file */
+    uint32_t l = 0;
+    _put32le( &b[l], PCAP_SHB_TYPE );
+    l += 4;
+    _put32le( &b[l], 28 );
+    l += 4;
+    _put32le( &b[l], PCAP_BYTE_ORDER_MAGIC );
+    l += 4;
+    b[l++] = 1;                                          /* Major version */
+    b[l++] = 0;
+    b[l++] = 0;                                          /* Minor version */
+    b[l++] = 0;
+    _put64le( &b[l], ( uint64_t ) - 1 );                 /* Section length unknown */
+    l += 8;
+    _put32le( &b[l], 28 );
+    l += 4;
+    fwrite( b, 1, l, r->pcapFp );
+
+    while ( true )
+    {
+        pthread_mutex_lock( &r->pcapMutex );
+
+        while ( ( atomic_load( &r->pcapRp ) == atomic_load( &r->pcapWp ) ) && ( !r->pcapExit ) )
+        {
+            pthread_cond_wait( &r->pcapUpdated, &r->pcapMutex );
+        }
+
+        pthread_mutex_unlock( &r->pcapMutex );
+
+        uint64_t rp = atomic_load( &r->pcapRp );
+        uint64_t wp = atomic_load( &r->pcapWp );
+
+        if ( rp == wp )
+        {
+            /* Nothing left to drain, so this must be an exit request */
+            break;
+        }
+
+        /* Records were queued whole, so each header promises a complete frame behind it */
+        while ( rp != wp )
+        {
+            _pcapRingOut( r, rp, hdr, PCAP_REC_HDR_LEN );
+            rp += PCAP_REC_HDR_LEN;
+
+            uint8_t tag = hdr[0];
+            uint32_t len = hdr[2] | ( hdr[3] << 8 );
+            uint64_t tstamp = _get64le( &hdr[4] );
+
+            _pcapRingOut( r, rp, payload, len );
+            rp += len;
+            atomic_store( &r->pcapRp, rp );
+
+            if ( ifForTag[tag] < 0 )
+            {
+                _pcapEmitIDB( r, tag );
+                ifForTag[tag] = numIfs++;
+            }
+
+            uint32_t pad = ( 4 - ( len & 3 ) ) & 3;
+            uint32_t total = 32 + len + pad;
+            l = 0;
+            _put32le( &b[l], PCAP_EPB_TYPE );
+            l += 4;
+            _put32le( &b[l], total );
+            l += 4;
+            _put32le( &b[l], ifForTag[tag] );
+            l += 4;
+            _put32le( &b[l], tstamp >> 32 );
+            l += 4;
+            _put32le( &b[l], tstamp & 0xffffffff );
+            l += 4;
+            _put32le( &b[l], len );                      /* Captured length */
+            l += 4;
+            _put32le( &b[l], len );                      /* Original length */
+            l += 4;
+            fwrite( b, 1, l, r->pcapFp );
+            fwrite( payload, 1, len, r->pcapFp );
+            fwrite( ( uint8_t[4] ) {0}, 1, pad, r->pcapFp );
+            _put32le( b, total );
+            fwrite( b, 1, 4, r->pcapFp );
+        }
+    }
+
+    fclose( r->pcapFp );
+    r->pcapFp = NULL;
+
+    if ( r->pcapDropped )
+    {
+        genericsReport( V_WARN, "%" PRIu64 " frames were shed because the pcapng writer fell behind" EOL, r->pcapDropped );
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+static void _pinPipelineThread( const char *role, int cpu )
+
+/* Apply any requested CPU placement to the calling pipeline thread */
+
+{
+    if ( cpu < 0 )
+    {
+        return;
+    }
+
+    if ( genericsSetThreadAffinity( cpu ) )
+    {
+        genericsReport( V_INFO, "%s thread pinned to CPU %d" EOL, role, cpu );
+    }
+    else
+    {
+        genericsReport( V_WARN, "Could not pin %s thread to CPU %d" EOL, role, cpu );
+    }
+}
+// ====================================================================================================
+// Block decoders and handlers for the various line formats
+// ====================================================================================================
+static void *_handlerWorker( void *params )
+
+/* Despatch thread for a single tag, draining that tag's forwarding ring to its clients */
+
+{
+    struct handlers *h = ( struct handlers * )params;
+
+    _pinPipelineThread( "Despatch", _r.options->cpuNet );
+
+    while ( true )
+    {
+        pthread_mutex_lock( &h->mutex );
+
+        while ( ( atomic_load( &h->ringRp ) == atomic_load( &h->ringWp ) ) && ( !h->exit ) )
+        {
+            pthread_cond_wait( &h->updated, &h->mutex );
+        }
+
+        if ( ( h->latencyBudgetUs ) && ( !h->exit ) )
+        {
+            /* Deadline-aware coalescing; sit on the queue until the oldest byte reaches its
+             * latency budget, or the ring fills towards the producer's drop point, so bulk
+             * tags cost one client write per window rather than one per block.
+             */
+            struct timespec dl;
+            clock_gettime( CLOCK_REALTIME, &dl );
+            dl.tv_nsec += ( uint64_t )h->latencyBudgetUs * 1000ULL;
+            dl.tv_sec += dl.tv_nsec / 1000000000L;
+            dl.tv_nsec %= 1000000000L;
+
+            while ( ( !h->exit ) &&
+                    ( ( uint32_t )( atomic_load( &h->ringWp ) - atomic_load( &h->ringRp ) ) < HANDLER_RING_HIGHWATER ) &&
+                    ( ETIMEDOUT != pthread_cond_timedwait( &h->updated, &h->mutex, &dl ) ) )
+            {
+            }
+        }
+
+        pthread_mutex_unlock( &h->mutex );
+
+        uint64_t rp = atomic_load( &h->ringRp );
+        uint64_t wp = atomic_load( &h->ringWp );
+
+        if ( rp == wp )
+        {
+            /* Nothing left to drain, so this must be an exit request */
+            break;
+        }
+
+        /* Despatch in contiguous spans, wrapping over the ring end if needed */
+        while ( rp != wp )
+        {
+            uint32_t ri  = rp & HANDLER_RING_MASK;
+            uint32_t len = wp - rp;
+
+            if ( ri + len > HANDLER_RING_SIZE )
+            {
+                len = HANDLER_RING_SIZE - ri;
+            }
+
+            uint64_t is = _instrStamp( &_r );
+            nwclientSend( h->n, len, &h->ring[ri] );
+            _instrRecord( &_r, INSTR_STAGE_CLIENT_WRITE, is );
+            rp += len;
+            atomic_store( &h->ringRp, rp );
+        }
+    }
+
+    return NULL;
+}
+// ====================================================================================================
+static void _sampleCompEmit( struct RunTime *r )
+
+/* Publish any batched PC samples to the OFLOW clients on the dedicated tag */
+
+{
+    struct Frame f;
+    const uint8_t *b;
+    uint32_t len = SampleCompFinish( &r->sampEnc, &b );
+
+    if ( len )
+    {
+        OFLOWEncode( SAMPLECOMP_TAG, 0, b, len, &f );
+        nwclientSend( r->oflowHandler, f.len, f.d );
+        _recordBytes( r, f.len, f.d );
+    }
+}
+// ====================================================================================================
+static void _sampleCompFeed( struct RunTime *r, uint32_t len, const uint8_t *buffer )
+
+/* Scan clean ITM from the default stream for PC samples and batch them up */
+
+{
+    struct msg m;
+
+    while ( len-- )
+    {
+        if ( ITM_EV_PACKET_RXED == ITMPump( &r->sampITM, *buffer++ ) )
+        {
+            if ( ( ITMGetDecodedPacket( &r->sampITM, &m ) ) &&
+                    ( m.genericMsg.msgtype == MSG_PC_SAMPLE ) && ( !m.pcSampleMsg.sleep ) )
+            {
+                if ( SampleCompAdd( &r->sampEnc, m.pcSampleMsg.pc ) )
+                {
+                    _sampleCompEmit( r );
+                }
+            }
+        }
+    }
+}
+// ====================================================================================================
+// ====================================================================================================
+// Trace trigger. A scan-only decode over the configured tag watches for a branch into the
+// armed address range; until it hits, raw blocks destined for the dump file are parked in a
+// ring so the window leading up to the trigger still reaches the file.
+// ====================================================================================================
+static void _triggerRetain( struct RunTime *r, const uint8_t *buffer, uint32_t len )
+
+{
+    while ( len )
+    {
+        uint32_t wi = r->trigWp % TRIGGER_HISTORY_SIZE;
+        uint32_t span = ( len < TRIGGER_HISTORY_SIZE - wi ) ? len : TRIGGER_HISTORY_SIZE - wi;
+
+        memcpy( &r->trigRing[wi], buffer, span );
+        r->trigWp += span;
+        buffer += span;
+        len -= span;
+    }
+}
+// ====================================================================================================
+static void _triggerFlushHistory( struct RunTime *r )
+
+/* Write the retained pre-trigger window to the dump file, oldest bytes first */
+
+{
+    uint64_t rp = ( r->trigWp > TRIGGER_HISTORY_SIZE ) ? r->trigWp - TRIGGER_HISTORY_SIZE : 0;
+
+    while ( rp != r->trigWp )
+    {
+        uint32_t ri = rp % TRIGGER_HISTORY_SIZE;
+        uint32_t span = r->trigWp - rp;
+
+        if ( ri + span > TRIGGER_HISTORY_SIZE )
+        {
+            span = TRIGGER_HISTORY_SIZE - ri;
+        }
+
+        if ( write( r->opFileHandle, &r->trigRing[ri], span ) <= 0 )
+        {
+            genericsExit( -3, "Writing to file failed" EOL );
+        }
+
+        rp += span;
+    }
+}
+// ====================================================================================================
+static void _triggerCB( void *param )
+
+/* Callback for each decoded trace sentence on the trigger tag; only address changes matter */
+
+{
+    struct RunTime *r = ( struct RunTime * )param;
+    struct TRACECPUState *cpu = TRACECPUState( &r->trigDec );
+
+    if ( ( !r->triggered ) && ( TRACEStateChanged( &r->trigDec, EV_CH_ADDRESS ) ) &&
+            ( cpu->addr >= r->options->triggerLow ) && ( cpu->addr <= r->options->triggerHigh ) )
+    {
+        r->triggered = true;
+        genericsReport( V_WARN, "Trigger hit at 0x%08x, capture file is running" EOL, cpu->addr );
+        _triggerFlushHistory( r );
+    }
+}
+// ====================================================================================================
+static void _handlerQueue( struct RunTime *r, struct handlers *h, uint32_t len, const uint8_t *buffer )
+
+/* Hand a stripped block to the tag worker. If this tag's ring is full then the data for it are
+ * dropped and accounted for; stalling here would hold up every other tag in the demux.
+ */
+
+{
+    if ( !len )
+    {
+        return;
+    }
+
+    /* The sample scanner sees everything on the default stream, even data a slow client will lose */
+    if ( ( r->options->sampleComp ) && ( h->channel == DEFAULT_ITM_STREAM ) )
+    {
+        _sampleCompFeed( r, len, buffer );
+    }
+
+    /* Likewise the trigger scanner on its tag, for as long as the capture is still gated */
+    if ( ( r->options->triggerSpec ) && ( !r->triggered ) && ( h->channel == r->options->triggerTag ) )
+    {
+        TRACEDecoderPump( &r->trigDec, ( uint8_t * )buffer, len, _triggerCB, r );
+    }
+
+    /* The quality scanner watches the default stream for target-side trouble */
+    if ( ( r->options->instrPort ) && ( h->channel == DEFAULT_ITM_STREAM ) )
+    {
+        for ( uint32_t qi = 0; qi < len; qi++ )
+        {
+            switch ( ITMPump( &r->qcITM, buffer[qi] ) )
+            {
+                case ITM_EV_OVERFLOW:
+                    _anomalyNote( r, ANOM_ITM_OVERFLOW );
+                    break;
+
+                case ITM_EV_ERROR:
+                    _anomalyNote( r, ANOM_ITM_ERROR );
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    uint64_t wp = atomic_load( &h->ringWp );
+    uint64_t rp = atomic_load( &h->ringRp );
+
+    if ( len > HANDLER_RING_SIZE - ( uint32_t )( wp - rp ) )
+    {
+        r->tagCount[h->channel].totalDrop += len;
+        return;
+    }
+
+    uint32_t wi = wp & HANDLER_RING_MASK;
+
+    if ( wi + len > HANDLER_RING_SIZE )
+    {
+        uint32_t firstSpan = HANDLER_RING_SIZE - wi;
+        memcpy( &h->ring[wi], buffer, firstSpan );
+        memcpy( &h->ring[0], &buffer[firstSpan], len - firstSpan );
+    }
+    else
+    {
+        memcpy( &h->ring[wi], buffer, len );
+    }
+
+    atomic_store( &h->ringWp, wp + len );
+
+    pthread_mutex_lock( &h->mutex );
+    pthread_cond_signal( &h->updated );
+    pthread_mutex_unlock( &h->mutex );
+}
+// ====================================================================================================
+static void _flushOFLOWBatch( struct RunTime *r )
+
+/* Despatch any accumulated OFLOW frames to the clients in a single write */
+
+{
+    if ( r->oflowBatchLen )
+    {
+        uint64_t is = _instrStamp( r );
+        nwclientSend( r->oflowHandler, r->oflowBatchLen, r->oflowBatch );
+        _instrRecord( r, INSTR_STAGE_CLIENT_WRITE, is );
+        _recordBytes( r, r->oflowBatchLen, r->oflowBatch );
+        r->oflowBatchLen = 0;
+    }
+}
+// ====================================================================================================
+static void _batchOFLOWFrame( struct RunTime *r, const struct Frame *f )
+
+/* Append one encoded OFLOW frame to the accumulator, despatching first if it wouldn't fit */
+
+{
+    if ( r->oflowBatchLen + f->len > sizeof( r->oflowBatch ) )
+    {
+        _flushOFLOWBatch( r );
+    }
+
+    memcpy( &r->oflowBatch[r->oflowBatchLen], f->d, f->len );
+    r->oflowBatchLen += f->len;
+}
+// ====================================================================================================
+static void _purgeBlock( struct RunTime *r, bool createOFLOW )
+
+/* Send any packets to clients who want it, no matter where they originate from */
+
+{
+    struct Frame oflowOtg;
+    struct handlers *h = r->handler;
+    int i = r->numHandlers;
+
+    while ( i-- )
+    {
+        if ( h->strippedBlock->fillLevel )
+        {
+            _handlerQueue( r, h, h->strippedBlock->fillLevel, h->strippedBlock->buffer );
+
+            if ( createOFLOW )
+            {
+                /* The OFLOW encoded version goes out on the combined OFLOW channel, with a specific channel header */
+                int j = h->strippedBlock->fillLevel;
+                const uint8_t *b = h->strippedBlock->buffer;
+
+                while ( j )
+                {
+                    int chunk = ( j < OFLOW_MAX_PACKET_LEN ) ? j : OFLOW_MAX_PACKET_LEN;
+                    OFLOWEncode( h->channel, 0, b, chunk, &oflowOtg );
+                    _batchOFLOWFrame( r, &oflowOtg );
+                    _pcapQueue( r, h->channel, 0, b, chunk );
+                    b += chunk;
+                    j -= chunk;
+                }
+            }
+
+            h->strippedBlock->fillLevel = 0;
+        }
+
+        h++;
+    }
+
+    /* Everything for this block is encoded now, so it can all go in one writing */
+    _flushOFLOWBatch( r );
+}
+// ====================================================================================================
+static void _TPIUpacketRxed( enum TPIUPumpEvent e, struct TPIUPacket *p, void *param )
+
+/* Callback for when a TPIU frame has been assembled */
+
+{
+    struct RunTime *r = ( struct RunTime * )param;
+
+    struct handlers *h = NULL;
+    int cachedChannel = -1;
+    int chIndex = 0;
+
+    switch ( e )
+    {
+        case TPIU_EV_RXEDPACKET:
+
+            /* Iterate through the packet, putting it into the correct output buffers */
+            for ( uint32_t g = 0; g < p->len; g++ )
+            {
+                if ( cachedChannel != p->packet[g].s )
+                {
+                    /* Whatever happens, cache this result */
+                    cachedChannel = p->packet[g].s;
+
+                    /* Search for channel */
+                    h = r->handler;
+
+                    for ( chIndex = 0; chIndex < r->numHandlers; chIndex++ )
+                    {
+                        if ( h->channel == p->packet[g].s )
+                        {
+                            break;
+                        }
+
+                        h++;
+                    }
+                }
+
+                r->tagCount[p->packet[g].s].totalData++;
+
+                if ( ( chIndex != r->numHandlers ) && ( h ) )
+                {
+                    /* We must have found a match for this at some point, so add it to the queue */
+                    h->strippedBlock->buffer[h->strippedBlock->fillLevel++] = p->packet[g].d;
+                }
+                else
+                {
+                    genericsReport( V_DEBUG, "No handler for tag %d" EOL, p->packet[g].s );
+                }
+            }
+
+            break;
+
+        case TPIU_EV_ERROR:
+            genericsReport( V_WARN, "****ERROR****%s" EOL, ( r->options->intervalReportTime ) ? EOL : "" );
+            _anomalyNote( r, ANOM_TPIU_ERROR );
+            break;
+
+        case TPIU_EV_UNSYNCED:
+            _anomalyNote( r, ANOM_TPIU_SYNCLOSS );
+            break;
+
+        case TPIU_EV_NEWSYNC:
+        case TPIU_EV_SYNCED:
+        case TPIU_EV_RXING:
+        case TPIU_EV_NONE:
+        default:
+            break;
+    }
+}
+// ====================================================================================================
+
+static void _OFLOWpacketRxed( struct OFLOWFrame *p, void *param )
+
+/* OFLOW packet received, account for it and reflect it to legacy buffers if needed */
+
+{
+    int chIndex;
+    struct RunTime *r = ( struct RunTime * )param;
+    struct handlers *h = _r.handler;
+
+    if ( !p->good )
+    {
+        genericsReport( V_INFO, "Bad packet received" EOL );
+        return;
+    }
+
+    /* Reflect the frame into the pcapng export if one is running */
+    _pcapQueue( r, p->tag, p->tstamp, p->d, p->len );
+
+    if ( ( r->options->useTPIU ) && ( h->channel == DEFAULT_ITM_STREAM ) )
+    {
+        /* Deal with the bizzare combination of OFLOW and TPIU in channel 1 */
+        /* Accounting will be done in TPIUPump */
+        TPIUPump( &r->t, p->d, p->len, _TPIUpacketRxed, r );
+    }
+    else
+    {
+        /* Account for this reception */
+        r->tagCount[p->tag].totalData += p->len;
+
+        /* Search for channel */
+        for ( chIndex = 0; chIndex < r->numHandlers; chIndex++ )
+        {
+            if ( h->channel == p->tag )
             {
                 break;
             }
@@ -930,514 +3174,1528 @@ static void _OFLOWpacketRxed( struct OFLOWFrame *p, void *param )
             h++;
         }
 
-        if ( ( chIndex != r->numHandlers ) && ( h ) )
+        if ( ( chIndex != r->numHandlers ) && ( h ) )
+        {
+            /* We must have found a match for this at some point, so add it to the queue */
+            for ( int i = 0; i < p->len; i++ )
+            {
+                h->strippedBlock->buffer[h->strippedBlock->fillLevel++] = p->d[i];
+
+                if ( h->strippedBlock->fillLevel == sizeof( h->strippedBlock->buffer ) )
+                {
+                    /* We filled this block...better send it right now */
+                    _handlerQueue( r, h, h->strippedBlock->fillLevel, h->strippedBlock->buffer );
+                    h->strippedBlock->fillLevel = 0;
+                }
+            }
+        }
+    }
+}
+
+// ====================================================================================================
+
+static void _processNonOFLOWBlock( struct RunTime *r, ssize_t fillLevel, uint8_t *buffer )
+
+/* Not an OFLOW block, so might be TPIU or clean ITM...deal with both */
+
+{
+    struct Frame oflowOtg;
+
+    if ( fillLevel )
+    {
+        if ( r-> options->useTPIU )
+        {
+            /* Strip the TPIU framing from this input */
+            TPIUPump( &r->t, buffer, fillLevel, _TPIUpacketRxed, r );
+        }
+        else
+        {
+            /* Not TPIU ... need to assume this is ITM on the first channel..and assume it's present */
+            r->tagCount[DEFAULT_ITM_STREAM].totalData += fillLevel;
+
+            if ( r->handler )
+            {
+                _handlerQueue( r, r->handler, fillLevel, buffer );
+            }
+
+            /* The OFLOW encoded version goes out on the default OFLOW channel */
+            uint8_t *b = buffer;
+
+            while ( fillLevel )
+            {
+                int chunk = ( fillLevel < OFLOW_MAX_PACKET_LEN ) ? fillLevel : OFLOW_MAX_PACKET_LEN;
+                OFLOWEncode( DEFAULT_ITM_STREAM, 0, b, chunk, &oflowOtg );
+                _batchOFLOWFrame( r, &oflowOtg );
+                _pcapQueue( r, DEFAULT_ITM_STREAM, 0, b, chunk );
+                b += chunk;
+                fillLevel -= chunk;
+            }
+
+            _flushOFLOWBatch( r );
+        }
+    }
+}
+// ====================================================================================================
+static void _swoLineBytes( const uint8_t *bytes, int count, void *param )
+
+/* Callback for bytes demodulated off a raw SWO pin capture; they join the normal decode path */
+
+{
+    struct RunTime *r = ( struct RunTime * )param;
+    _processNonOFLOWBlock( r, count, ( uint8_t * )bytes );
+}
+// ====================================================================================================
+static void _handleBlock( struct RunTime *r, ssize_t fillLevel, uint8_t *buffer )
+
+/* Handle an incoming block from any source in either 'conventional' or orbflow format */
+
+{
+    if ( fillLevel )
+    {
+        genericsReport( V_DEBUG, "RXED Packet of %d bytes%s" EOL, fillLevel, ( r->options->intervalReportTime ) ? EOL : "" );
+
+        if ( r->opFileHandle )
+        {
+            if ( ( r->options->triggerSpec ) && ( !r->triggered ) )
+            {
+                /* Capture is gated; park the block so the pre-trigger window survives */
+                _triggerRetain( r, buffer, fillLevel );
+            }
+            else if ( write( r->opFileHandle, buffer, fillLevel ) <= 0 )
+            {
+                genericsExit( -3, "Writing to file failed" EOL );
+            }
+        }
+
+        /* One write section covers all the counter updates the decode below performs */
+        genericsSeqWriteBegin( &r->statSeq );
+
+        uint64_t is = _instrStamp( r );
+
+        if ( r->usingOFLOW )
+        {
+            /* We need to decode this so we can get the stats out of it, and to reflect it out */
+            OFLOWPump( &r->oflow, buffer, fillLevel, _OFLOWpacketRxed, r );
+            _instrRecord( r, INSTR_STAGE_DEFRAME, is );
+
+            /* ...and reflect this packet to the outgoing OFLOW channels, if we don't need to reconstruct them */
+            if ( !r->options->useTPIU )
+            {
+                is = _instrStamp( r );
+                nwclientSend( r->oflowHandler, fillLevel, buffer );
+                _instrRecord( r, INSTR_STAGE_CLIENT_WRITE, is );
+                _recordBytes( r, fillLevel, buffer );
+            }
+        }
+        else
+        {
+            if ( r->options->swoLineMode != SWOLINE_NONE )
+            {
+                /* Raw pin samples...demodulate to bytes ahead of the normal decode */
+                SWOLineDecoderPump( &r->swoLine, buffer, fillLevel, _swoLineBytes, r );
+            }
+            else
+            {
+                _processNonOFLOWBlock( r, fillLevel, buffer );
+            }
+
+            _instrRecord( r, INSTR_STAGE_DEFRAME, is );
+        }
+
+        r->totalRawBytes += fillLevel;
+        STATSEG_ADD( r->stats, bytes, fillLevel );
+
+        /* Send the block to clients, but only send OFLOW if it wasn't OFLOW already */
+        /* or if we're decoding TPIU in the default tag. This can account drops, so it
+         * stays inside the write section. */
+        is = _instrStamp( r );
+        _purgeBlock( r, ( !r->usingOFLOW ) || r->options->useTPIU );
+        _instrRecord( r, INSTR_STAGE_ENQUEUE, is );
+        genericsSeqWriteEnd( &r->statSeq );
+
+        /* Close out the sample batch each block so batching doesn't add latency */
+        if ( r->options->sampleComp )
+        {
+            _sampleCompEmit( r );
+        }
+    }
+}
+
+// ====================================================================================================
+static void _usbAdaptFeedback( struct RunTime *r, uint32_t fill )
+
+/* Fold the fill level of a completed transfer into the sizing loop. Event thread only. */
+
+{
+    uint32_t ewma = ( atomic_load( &r->usbEwmaFill ) * 7 + fill ) / 8;
+    atomic_store( &r->usbEwmaFill, ewma );
+
+    uint32_t tier = atomic_load( &r->usbTier );
+
+    if ( ( tier < NUM_USB_TIERS - 1 ) && ( ewma > _usbTier[tier].len / 2 ) )
+    {
+        atomic_store( &r->usbTier, tier + 1 );
+    }
+    else if ( ( tier > 0 ) && ( ewma < _usbTier[tier].len / 32 ) )
+    {
+        atomic_store( &r->usbTier, tier - 1 );
+    }
+}
+// ====================================================================================================
+static void _usbAdaptTransfer( struct RunTime *r, struct libusb_transfer *t )
+
+/* Apply the current sizing tier to a transfer which is about to be (re)submitted */
+
+{
+    uint32_t tier = atomic_load( &r->usbTier );
+
+    t->length  = _usbTier[tier].len;
+    t->timeout = r->options->hiresTime ? 1 : _usbTier[tier].timeoutMs;
+}
+// ====================================================================================================
+static uint64_t _clockReconcile( struct RunTime *r, uint64_t arrival )
+
+/* Map a raw USB completion time onto this probe's reconciled timeline. All probes stamp
+ * against the same monotonic clock, so cross-probe ordering only needs the per-probe USB
+ * completion jitter filtered out; a first order loop tracks each probe's delivery cadence
+ * and absorbs scheduling noise, snapping back if the stream pauses or steps.
+ */
+
+{
+    int64_t err;
+
+    if ( !r->clkPredicted )
+    {
+        r->clkPredicted = arrival;
+        return arrival;
+    }
+
+    err = ( int64_t )( arrival - r->clkPredicted );
+
+    if ( ( err < 0 ) || ( err > CLOCK_RESYNC_NS ) )
+    {
+        /* Too far out for filtering to be meaningful; restart the model here */
+        r->clkPredicted = arrival;
+        return arrival;
+    }
+
+    /* Track the arrival cadence, trimming an eighth of the residual jitter per block */
+    r->clkPredicted += err - ( err >> 3 );
+    return r->clkPredicted;
+}
+// ====================================================================================================
+// Decode queue wait strategies
+// ====================================================================================================
+
+/* Processor hint that we are in a busy-wait, so a hyperthread sibling gets the core */
+#if defined( __SSE2__ )
+    #define DQ_RELAX() __builtin_ia32_pause()
+#elif defined( __aarch64__ )
+    #define DQ_RELAX() __asm__ __volatile__ ( "yield" )
+#else
+    #define DQ_RELAX()
+#endif
+
+static void _dqWaitForWork( struct RunTime *r )
+
+/* Wait until the decode queue is non-empty, or we are asked to exit, using the configured
+ * strategy. Spin and yield watch the queue indices directly and never touch the mutex; park
+ * takes the condition variable, but announces itself through dqWaiting first and re-checks
+ * the queue under the flag, so a producer that published work after our check is guaranteed
+ * to see the flag and deliver the wakeup.
+ */
+
+{
+    uint64_t spins = 0;
+    uint64_t yields = 0;
+
+    while ( ( atomic_load( &r->dqRp ) == atomic_load( &r->dqWp ) ) && ( !r->decodeExit ) )
+    {
+        switch ( r->options->dqWaitStrategy )
+        {
+            case DQ_WAIT_SPIN:
+                DQ_RELAX();
+                spins++;
+                break;
+
+            case DQ_WAIT_YIELD:
+                if ( ++spins % DQ_YIELD_SPIN_PASSES )
+                {
+                    DQ_RELAX();
+                }
+                else
+                {
+                    sched_yield();
+                    yields++;
+                }
+
+                break;
+
+            default: /* DQ_WAIT_PARK */
+                pthread_mutex_lock( &r->dqMutex );
+                atomic_store( &r->dqWaiting, true );
+
+                /* Re-check now the flag is visible; the producer tests it after publishing its
+                 * write pointer, so at least one side always sees the other and the wakeup
+                 * cannot be lost.
+                 */
+                if ( ( atomic_load( &r->dqRp ) == atomic_load( &r->dqWp ) ) && ( !r->decodeExit ) )
+                {
+                    atomic_fetch_add( &r->dqStatParks, 1 );
+                    pthread_cond_wait( &r->dqUpdated, &r->dqMutex );
+                }
+
+                atomic_store( &r->dqWaiting, false );
+                pthread_mutex_unlock( &r->dqMutex );
+                break;
+        }
+    }
+
+    if ( spins )
+    {
+        atomic_fetch_add( &r->dqStatSpins, spins );
+    }
+
+    if ( yields )
+    {
+        atomic_fetch_add( &r->dqStatYields, yields );
+    }
+}
+
+// ====================================================================================================
+
+static void _dqNotify( struct RunTime *r )
+
+/* Tell the decode thread work has arrived. Spinning and yielding consumers watch the queue
+ * indices directly, so the mutex and signal are only paid for when a consumer is parked.
+ */
+
+{
+    if ( atomic_load( &r->dqWaiting ) )
+    {
+        pthread_mutex_lock( &r->dqMutex );
+        pthread_cond_signal( &r->dqUpdated );
+        pthread_mutex_unlock( &r->dqMutex );
+        atomic_fetch_add( &r->dqStatWakeups, 1 );
+    }
+}
+
+// ====================================================================================================
+// Generic handlers for each of the source types. These all call _handleBlock above to process.
+// ====================================================================================================
+static void _usb_callback( struct libusb_transfer *t )
+
+/* Queue a completed USB block for the decode thread, so the event loop can get straight back
+ * to keeping the bus busy. The transfer is resubmitted by the decoder once the block is free.
+ */
+
+{
+    struct dataBlock *b = ( struct dataBlock * )( t->buffer - offsetof( struct dataBlock, buffer ) );
+    uint64_t is = _instrStamp( &_r );
+
+    if ( ( t->status != LIBUSB_TRANSFER_COMPLETED ) &&
+            ( t->status != LIBUSB_TRANSFER_TIMED_OUT ) &&
+            ( t->status != LIBUSB_TRANSFER_CANCELLED )
+       )
+    {
+        if ( !_r.errored )
+        {
+            genericsReport( V_WARN, "Errored out with status %d (%s)" EOL, t->status, libusb_error_name( t->status ) );
+        }
+
+        _r.errored = true;
+        return;
+    }
+
+    if ( t->status == LIBUSB_TRANSFER_CANCELLED )
+    {
+        return;
+    }
+
+    _usbAdaptFeedback( &_r, t->actual_length );
+
+    if ( t->actual_length )
+    {
+        /* Hand this block to the decoder. Queue is sized for every block to be in it at once, so it cannot overrun */
+        b->fillLevel = t->actual_length;
+        struct timespec ats;
+        clock_gettime( CLOCK_MONOTONIC, &ats );
+        b->arrival = ( uint64_t )ats.tv_sec * 1000000000L + ats.tv_nsec;
+        uint32_t wp = atomic_load( &_r.dqWp );
+        _r.decodeQueue[wp] = b;
+        atomic_store( &_r.dqWp, ( wp + 1 ) % ( NUM_RAW_BLOCKS + 1 ) );
+
+        _dqNotify( &_r );
+    }
+    else
+    {
+        /* Nothing arrived, just go around again */
+        _usbAdaptTransfer( &_r, t );
+        libusb_submit_transfer( t );
+    }
+
+    _instrRecord( &_r, INSTR_STAGE_USB_CALLBACK, is );
+}
+
+// ====================================================================================================
+
+static void *_usbDecoder( void *arg )
+
+/* Drain the queue of completed USB blocks, decoding each and resubmitting its transfer when done */
+
+{
+    struct RunTime *r = ( struct RunTime * )arg;
+
+    _pinPipelineThread( "Decode", r->options->cpuDecode );
+
+    while ( true )
+    {
+        _dqWaitForWork( r );
+
+        if ( r->decodeExit )
+        {
+            break;
+        }
+
+        uint32_t rp = atomic_load( &r->dqRp );
+        struct dataBlock *b = r->decodeQueue[rp];
+        atomic_store( &r->dqRp, ( rp + 1 ) % ( NUM_RAW_BLOCKS + 1 ) );
+
+        STATSEG_SET( r->stats, queueDepth,
+                     ( atomic_load( &r->dqWp ) + NUM_RAW_BLOCKS + 1 - atomic_load( &r->dqRp ) ) % ( NUM_RAW_BLOCKS + 1 ) );
+
+        if ( r->usingOFLOW )
+        {
+            /* Frames in this block get the reconciled completion time, not the decode time */
+            OFLOWSetArrivalTime( &r->oflow, _clockReconcile( r, b->arrival ) );
+        }
+
+        _handleBlock( r, b->fillLevel, b->buffer );
+        b->fillLevel = 0;
+
+        if ( ( !r->ending ) && ( !r->errored ) )
+        {
+            _usbAdaptTransfer( r, b->usbtfr );
+            libusb_submit_transfer( b->usbtfr );
+        }
+    }
+
+    return NULL;
+}
+
+// ====================================================================================================
+
+void _actionOrbtraceCommand( struct RunTime *r, char *sn, enum ORBTraceDevice d )
+
+/* There is an orbtrace command line to be executed as part of the probe connect process */
+
+{
+    char commandLine[MAX_LINE_LEN];
+
+    /* If we have any configuration to do on this device, go ahead */
+    if ( r->options->otcl )
+    {
+        if ( getenv( ORBTRACEENVNAME ) )
+        {
+            snprintf( commandLine, MAX_LINE_LEN, "%s %s %s %s", getenv( ORBTRACEENVNAME ), r->options->otcl, sn ? ( ( d == DEVICE_ORBTRACE_MINI ) ? "-n " : "-s " ) : "", sn ? sn : "" );
+        }
+        else
+        {
+            char *baseDirectory = genericsGetBaseDirectory( );
+
+            if ( !baseDirectory )
+            {
+                genericsExit( -1, "Failed to establish base directory" EOL );
+            }
+
+            snprintf( commandLine, MAX_LINE_LEN, "%s" ORBTRACE " %s %s %s", baseDirectory, r->options->otcl, sn ? ( ( d == DEVICE_ORBTRACE_MINI ) ? "-n " : "-s " ) : "", sn ? sn : "" );
+            free( baseDirectory );
+        }
+
+        genericsReport( V_INFO, "%s" EOL, commandLine );
+
+        if (  system( commandLine ) )
+        {
+            genericsReport( V_ERROR, "Invoking orbtrace failed" EOL );
+        }
+    }
+}
+
+// ====================================================================================================
+static int _usbFeeder( struct RunTime *r )
+
+/* Setup USB transfers from an ORBTrace or BMP */
+
+{
+    bool firstRunThrough = true;
+    int workingDev;
+
+    /* Copy any part serial number across, unless we were already bound to a specific probe */
+    if ( ( r->options->sn ) && ( !r->sn ) )
+    {
+        r->sn = strdup( r->options->sn );
+    }
+
+    pthread_mutex_init( &r->dqMutex, NULL );
+    pthread_cond_init( &r->dqUpdated, NULL );
+
+    /* Pin before first touch so the transfer buffers below get placed local to this thread */
+    _pinPipelineThread( "Feeder", r->options->cpuFeeder );
+
+    if ( r->options->cpuFeeder >= 0 )
+    {
+        memset( r->rawBlock, 0, sizeof( r->rawBlock ) );
+    }
+
+    while ( !r->ending )
+    {
+        r->errored = false;
+
+        /* ...just in case we had a context */
+        OrbtraceIfDestroyContext( r->o );
+        r->o = OrbtraceIfCreateContext();
+        assert( r->o );
+
+        /* Scan quickly at first so a probe appearing just after exec is picked up within
+         * milliseconds, then back off to the old one second cadence while we wait.
+         */
+        uint32_t scanDelay = 10 * INTERVAL_1MS;
+
+        while ( 0 == OrbtraceIfGetDeviceList( r->o, r->sn, DEVTYPE_ALL ) )
+        {
+            usleep( scanDelay );
+            scanDelay = ( scanDelay * 2 < INTERVAL_1S ) ? scanDelay * 2 : INTERVAL_1S;
+        }
+
+        genericsReport( V_INFO, "Found device" EOL );
+        workingDev = OrbtraceIfSelectDevice( r->o );
+
+        if ( !OrbtraceIfOpenDevice( r->o, workingDev ) )
+        {
+            genericsReport( V_INFO, "Couldn't open device" EOL );
+            break;
+        }
+
+        /* Take a record of what device we're using...we'll use that next time around to re-connect */
+        if ( r->sn )
+        {
+            free( r->sn );
+        }
+
+        r->sn = strdup( OrbtraceIfGetSN( r->o, workingDev ) );
+
+        /* Before we open, perform any orbtrace configuration that is needed */
+        _actionOrbtraceCommand( r, r->sn, OrbtraceIfGetDevtype( r->o, workingDev ) );
+
+        if ( !OrbtraceGetIfandEP( r->o ) )
+        {
+            genericsReport( V_INFO, "Couldn't get IF and EP" EOL );
+            break;
+        }
+
+        r->usingOFLOW = OrbtraceSupportsOFLOW( r->o );
+
+        if ( r->usingOFLOW )
+        {
+            genericsReport( V_INFO, "Orbtrace supports ORBFLOW protocol" EOL );
+
+            if ( r->options->useTPIU )
+            {
+                genericsReport( V_WARN, "TPIU decoding specified, but ORBTrace supports ORBFLOW, are you sure?" EOL );
+            }
+
+            if ( firstRunThrough && r->opFileHandle )
+            {
+                if ( write( r->opFileHandle, OFLOW_SIG, OFLOW_SIG_LEN ) < 0 )
+                {
+                    genericsExit( -4, "Could not write OFLOW signature to file (%s)" EOL, strerror( errno ) );
+                }
+            }
+
+            /* We only attempt to write the file header on the first run through */
+            firstRunThrough = false;
+        }
+        else
+        {
+            genericsReport( V_INFO, "Orbtrace supports legacy protocol" EOL );
+        }
+
+        genericsReport( V_DEBUG, "USB Interface claimed, ready for data" EOL );
+
+        /* Start with an empty handoff queue and a fresh decode thread for this connection */
+        atomic_store( &r->dqWp, 0 );
+        atomic_store( &r->dqRp, 0 );
+        r->decodeExit = false;
+
+        if ( pthread_create( &r->decodeThread, NULL, &_usbDecoder, r ) )
+        {
+            genericsExit( -1, "Failed to create USB decode thread" EOL );
+        }
+
+        /* Start the sizing loop at the top tier; the initial submissions below go out full-sized */
+        atomic_store( &r->usbTier, NUM_USB_TIERS - 1 );
+        atomic_store( &r->usbEwmaFill, USB_TRANSFER_SIZE );
+
+        /* Create the USB transfer blocks .. if we are connected depends on if there was an error submitting the requests */
+        r->errored = !( r->conn = OrbtraceIfSetupTransfers( r->o, r->options->hiresTime, r->rawBlock, r->options->usbTransferCount, _usb_callback ) );
+
+        /* =========================== The main dispatch loop ======================================= */
+        while ( ( !r->ending )  && ( !r->errored ) )
+        {
+            int ret =   OrbtraceIfHandleEvents( r->o );
+
+            if ( ( ret ) && ( ret != LIBUSB_ERROR_INTERRUPTED ) )
+            {
+                genericsReport( V_ERROR, "Error waiting for USB requests to complete %d" EOL, ret );
+            }
+
+        }
+
+        /* ========================================================================================= */
+
+        r->conn = false;
+
+        /* Collect the decode thread before the transfers it references go away */
+        r->decodeExit = true;
+        pthread_mutex_lock( &r->dqMutex );
+        pthread_cond_signal( &r->dqUpdated );
+        pthread_mutex_unlock( &r->dqMutex );
+        pthread_join( r->decodeThread, NULL );
+
+        /* Remove transfers from list and release the memory */
+        OrbtraceIfCloseTransfers( r->o );
+
+        if ( !r->ending )
+        {
+            genericsReport( V_INFO, "USB connection lost" EOL );
+        }
+
+        genericsReport( V_INFO, "USB Interface closed" EOL );
+    }
+
+    return 0;
+}
+// ====================================================================================================
+static void *_usbFeederThread( void *params )
+
+/* Thread wrapper around _usbFeeder for the additional probes in multi-probe mode */
+
+{
+    _usbFeeder( ( struct RunTime * )params );
+    return NULL;
+}
+// ====================================================================================================
+
+// ====================================================================================================
+// Stream source pump. The network, serial and non-seekable file sources all have the same
+// shape: establish a stream, drain it into the block handler, report and back off on loss.
+// Each source supplies only its connect step; the pump owns the loop and the error handling.
+// ====================================================================================================
+static void _pumpStream( struct RunTime *r, struct Stream *stream, bool waitAtEOF, bool pace )
+
+/* Drain one established stream into the block handler until it ends, fails, or we do */
+
+{
+    struct dataBlock *rxBlock = &r->rawBlock[0];
+
+    r->conn = true;
+
+    while ( !r->ending )
+    {
+        size_t fl = 0;
+        enum ReceiveResult result = stream->receive( stream, rxBlock->buffer, USB_TRANSFER_SIZE, NULL, &fl );
+
+        if ( RECEIVE_RESULT_EOF == result )
+        {
+            if ( !waitAtEOF )
+            {
+                break;
+            }
+
+            /* The source may still be growing under us; look again shortly */
+            usleep( INTERVAL_100MS );
+            continue;
+        }
+
+        if ( RECEIVE_RESULT_ERROR == result )
         {
-            /* We must have found a match for this at some point, so add it to the queue */
-            for ( int i = 0; i < p->len; i++ )
-            {
-                h->strippedBlock->buffer[h->strippedBlock->fillLevel++] = p->d[i];
+            break;
+        }
 
-                if ( h->strippedBlock->fillLevel == sizeof( h->strippedBlock->buffer ) )
-                {
-                    /* We filled this block...better send it right now */
-                    nwclientSend( h->n, h->strippedBlock->fillLevel, h->strippedBlock->buffer );
-                    h->strippedBlock->fillLevel = 0;
-                }
-            }
+        rxBlock->fillLevel = fl;
+
+        if ( rxBlock->fillLevel )
+        {
+            _handleBlock( r, rxBlock->fillLevel, rxBlock->buffer );
+        }
+
+        if ( ( pace ) && ( r->options->paceDelay ) )
+        {
+            usleep( r->options->paceDelay );
+        }
+    }
+
+    r->conn = false;
+}
+// ====================================================================================================
+static int _streamFeeder( struct RunTime *r, const char *name, struct Stream *( *connect )( struct RunTime *r ) )
+
+/* Generic reconnecting source; establish the stream, drain it, back off on loss and go again */
+
+{
+    while ( !r->ending )
+    {
+        struct Stream *stream = connect( r );
+
+        if ( !stream )
+        {
+            usleep( INTERVAL_100MS );
+            continue;
+        }
+
+        genericsReport( V_INFO, "Established %s link" EOL, name );
+        _pumpStream( r, stream, false, false );
+
+        if ( !r->ending )
+        {
+            genericsReport( V_INFO, "Lost %s link" EOL, name );
         }
+
+        stream->close( stream );
+        free( stream );
     }
+
+    return 0;
+}
+// ====================================================================================================
+static struct Stream *_nwserverConnect( struct RunTime *r )
+
+{
+    return streamCreateSocket( r->options->nwserverHost, r->options->nwserverPort );
 }
+// ====================================================================================================
+static int _nwserverFeeder( struct RunTime *r )
+
+/* Setup network based transfers (typically used for things like J-Link but can also be a legacy orbuculum session */
 
+{
+    return _streamFeeder( r, "NW Server", _nwserverConnect );
+}
+// ====================================================================================================
+// Relay fan-in. Each remote daemon's OFLOW service is drained by its own reconnecting
+// thread, which deframes the stream, moves every frame into that source's tag window and
+// re-encodes it into the shared pipeline. Downstream the aggregate is indistinguishable
+// from a single many-tag source, so recording, export and serving all apply unchanged.
 // ====================================================================================================
+struct relaySource
+{
+    struct RunTime *r;                                   /* Shared pipeline the re-tagged frames feed */
+    int index;                                           /* Position on the command line; selects the tag window */
+    char *host;                                          /* Remote daemon to connect to... */
+    int port;                                            /* ...and the port its OFLOW service is on */
+    struct OFLOW decoder;                                /* Deframer for this source's stream */
+    struct Frame enc;                                    /* Re-encode target for the aggregated frame */
+    uint64_t forwarded;                                  /* Frames moved into the aggregate */
+    uint64_t shed;                                       /* Frames dropped because the remap left the regular tag range */
+    pthread_t thread;                                    /* Thread draining this source */
+};
 
-static void _processNonOFLOWBlock( struct RunTime *r, ssize_t fillLevel, uint8_t *buffer )
+/* The block handler and everything below it assume a single feeder, so fan-in serialises here */
+static pthread_mutex_t _relayMutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* Not an OFLOW block, so might be TPIU or clean ITM...deal with both */
+// ====================================================================================================
+static void _relayFrameRxed( struct OFLOWFrame *p, void *param )
+
+/* Move one remote frame into this source's tag window and hand it to the shared pipeline */
 
 {
-    struct Frame oflowOtg;
+    struct relaySource *s = ( struct relaySource * )param;
+    int newTag = s->index * RELAY_TAG_STRIDE + p->tag;
 
-    if ( fillLevel )
+    if ( !p->good )
     {
-        if ( r-> options->useTPIU )
+        return;
+    }
+
+    if ( newTag >= OFLOW_CAP_TAG )
+    {
+        /* No room left in this source's window; shed rather than collide with transport tags */
+        s->shed++;
+        return;
+    }
+
+    OFLOWEncode( newTag, p->tstamp, p->d, p->len, &s->enc );
+
+    pthread_mutex_lock( &_relayMutex );
+    _handleBlock( s->r, s->enc.len, s->enc.d );
+    pthread_mutex_unlock( &_relayMutex );
+    s->forwarded++;
+}
+// ====================================================================================================
+static void *_relayFeederTask( void *params )
+
+/* Reconnecting drain of one remote daemon; the shape of _streamFeeder, but bytes go through
+ * the per-source deframer for re-tagging rather than into the block handler directly.
+ */
+
+{
+    struct relaySource *s = ( struct relaySource * )params;
+    struct RunTime *r = s->r;
+    uint8_t buffer[USB_TRANSFER_SIZE];
+
+    while ( !r->ending )
+    {
+        struct Stream *stream = streamCreateSocket( s->host, s->port );
+
+        if ( !stream )
         {
-            /* Strip the TPIU framing from this input */
-            TPIUPump( &r->t, buffer, fillLevel, _TPIUpacketRxed, r );
+            usleep( INTERVAL_100MS );
+            continue;
         }
-        else
+
+        genericsReport( V_INFO, "Established relay link to %s:%d" EOL, s->host, s->port );
+
+        while ( !r->ending )
         {
-            /* Not TPIU ... need to assume this is ITM on the first channel..and assume it's present */
-            r->tagCount[DEFAULT_ITM_STREAM].totalData += fillLevel;
-            r->tagCount[DEFAULT_ITM_STREAM].intervalData += fillLevel;
+            size_t fl = 0;
+            enum ReceiveResult result = stream->receive( stream, buffer, USB_TRANSFER_SIZE, NULL, &fl );
 
-            if ( r->handler )
+            if ( ( RECEIVE_RESULT_EOF == result ) || ( RECEIVE_RESULT_ERROR == result ) )
             {
-                nwclientSend( r->handler->n, fillLevel, buffer );
+                break;
             }
 
-            /* The OFLOW encoded version goes out on the default OFLOW channel */
-            uint8_t *b = buffer;
-
-            while ( fillLevel )
+            if ( fl )
             {
-                OFLOWEncode( DEFAULT_ITM_STREAM, 0, b,
-                             ( fillLevel < OFLOW_MAX_PACKET_LEN ) ? fillLevel : OFLOW_MAX_PACKET_LEN,
-                             &oflowOtg );
-                nwclientSend( r->oflowHandler, oflowOtg.len, oflowOtg.d );
-                b += ( fillLevel < OFLOW_MAX_PACKET_LEN ) ? fillLevel : OFLOW_MAX_PACKET_LEN;
-                fillLevel -= ( fillLevel < OFLOW_MAX_PACKET_LEN ) ? fillLevel : OFLOW_MAX_PACKET_LEN;
+                OFLOWPump( &s->decoder, buffer, fl, _relayFrameRxed, s );
             }
         }
+
+        if ( !r->ending )
+        {
+            genericsReport( V_INFO, "Lost relay link to %s:%d" EOL, s->host, s->port );
+        }
+
+        stream->close( stream );
+        free( stream );
     }
+
+    return NULL;
 }
 // ====================================================================================================
-static void _handleBlock( struct RunTime *r, ssize_t fillLevel, uint8_t *buffer )
+static int _relayFeeder( struct RunTime *r )
 
-/* Handle an incoming block from any source in either 'conventional' or orbflow format */
+/* Fan in the OFLOW streams from every given remote daemon as one aggregated local service */
 
 {
-    if ( fillLevel )
+    static struct relaySource src[MAX_RELAY_SOURCES];
+    int n = r->options->numRelays;
+
+    r->usingOFLOW = true;
+    r->conn = true;
+
+    for ( int i = 0; i < n; i++ )
     {
-        genericsReport( V_DEBUG, "RXED Packet of %d bytes%s" EOL, fillLevel, ( r->options->intervalReportTime ) ? EOL : "" );
+        struct relaySource *s = &src[i];
+        s->r = r;
+        s->index = i;
+        s->host = r->options->relay[i];
+        s->port = OFCLIENT_SERVER_PORT;
 
-        if ( r->opFileHandle )
+        /* See if we have an optional port number too */
+        char *a = s->host;
+
+        while ( ( *a ) && ( *a != ':' ) )
         {
-            if ( write( r->opFileHandle, buffer, fillLevel ) <= 0 )
-            {
-                genericsExit( -3, "Writing to file failed" EOL );
-            }
+            a++;
         }
 
-        if ( r->usingOFLOW )
+        if ( *a == ':' )
         {
-            /* We need to decode this so we can get the stats out of it, and to reflect it out */
-            OFLOWPump( &r->oflow, buffer, fillLevel, _OFLOWpacketRxed, r );
+            *a = 0;
+            s->port = atoi( ++a );
 
-            /* ...and reflect this packet to the outgoing OFLOW channels, if we don't need to reconstruct them */
-            if ( !r->options->useTPIU )
+            if ( ( s->port <= 0 ) || ( s->port > 0xffff ) )
             {
-                nwclientSend( r->oflowHandler, fillLevel, buffer );
+                genericsExit( -1, "Relay port for %s is out of range" EOL, s->host );
             }
         }
-        else
+
+        OFLOWInit( &s->decoder );
+
+        if ( pthread_create( &s->thread, NULL, &_relayFeederTask, s ) )
         {
-            _processNonOFLOWBlock( r, fillLevel, buffer );
+            genericsExit( -1, "Failed to create relay feeder thread" EOL );
         }
 
-        r->intervalRawBytes += fillLevel;
+        genericsReport( V_INFO, "Relaying %s:%d into tags %d..%d" EOL, s->host, s->port,
+                        i * RELAY_TAG_STRIDE, i * RELAY_TAG_STRIDE + RELAY_TAG_STRIDE - 1 );
+    }
 
-        /* Send the block to clients, but only send OFLOW if it wasn't OFLOW already */
-        /* or if we're decoding TPIU in the default tag */
-        _purgeBlock( r, ( !r->usingOFLOW ) || r->options->useTPIU );
+    for ( int i = 0; i < n; i++ )
+    {
+        pthread_join( src[i].thread, NULL );
+    }
+
+    for ( int i = 0; i < n; i++ )
+    {
+        if ( src[i].shed )
+        {
+            genericsReport( V_WARN, "%" PRIu64 " frames from %s fell outside its tag window and were shed" EOL,
+                            src[i].shed, src[i].host );
+        }
     }
 
-    _checkInterval( r );
+    r->conn = false;
+    return 0;
 }
+// ====================================================================================================
 
+
+#ifdef WIN32
 // ====================================================================================================
-// Generic handlers for each of the source types. These all call _handleBlock above to process.
+// WIN32 Specific Driver
 // ====================================================================================================
-static void _usb_callback( struct libusb_transfer *t )
-
-/* For the USB case the ringbuffer isn't used .. packets are sent directly from this callback */
 
+static int _serialFeeder( struct RunTime *r )
 {
-    /* Whatever the status that comes back, there may be data... */
-    _handleBlock( &_r, t->actual_length, t->buffer );
+    char portPath[MAX_PATH] = { 0 };
+    snprintf( portPath, sizeof( portPath ), "\\\\.\\%s", r->options->port );
 
-    if ( ( t->status != LIBUSB_TRANSFER_COMPLETED ) &&
-            ( t->status != LIBUSB_TRANSFER_TIMED_OUT ) &&
-            ( t->status != LIBUSB_TRANSFER_CANCELLED )
-       )
+    while ( !r->ending )
     {
-        if ( !_r.errored )
+        HANDLE portHandle = CreateFile( portPath,
+                                        GENERIC_READ,
+                                        0,      //  must be opened with exclusive-access
+                                        NULL,   //  default security attributes
+                                        OPEN_EXISTING, //  must use OPEN_EXISTING
+                                        0,    //  not overlapped I/O
+                                        NULL ); //  hTemplate must be NULL for comm devices
+
+        if ( portHandle == INVALID_HANDLE_VALUE )
         {
-            genericsReport( V_WARN, "Errored out with status %d (%s)" EOL, t->status, libusb_error_name( t->status ) );
+            genericsExit( 1, "Can't open serial port" EOL );
         }
 
-        _r.errored = true;
+        genericsReport( V_INFO, "Port opened" EOL );
+
+        if ( !_setSerialSpeed( portHandle, r->options->speed ) )
+        {
+            genericsExit( 2, "setSerialConfig failed" EOL );
+        }
+
+        SetCommMask( portHandle, EV_RXCHAR );
+
+        genericsReport( V_INFO, "Port configured" EOL );
+
+        r->conn = true;
+
+        while ( !r->ending )
+        {
+            DWORD eventMask = 0;
+            WaitCommEvent( portHandle, &eventMask, NULL );
+            DWORD unused;
+            COMSTAT stats;
+            ClearCommError( portHandle, &unused, &stats );
+
+            if ( stats.cbInQue == 0 )
+            {
+                continue;
+            }
+
+            struct dataBlock *rxBlock = &r->rawBlock[0];
+
+            DWORD transferSize = stats.cbInQue;
+
+            if ( transferSize > USB_TRANSFER_SIZE )
+            {
+                transferSize = USB_TRANSFER_SIZE;
+            }
+
+            ReadFile( portHandle, rxBlock->buffer, transferSize, &rxBlock->fillLevel, NULL );
+
+            if ( rxBlock->fillLevel <= 0 )
+            {
+                break;
+            }
+
+            _handleBlock( r, rxBlock->fillLevel, rxBlock->buffer );
+        }
+
+        r->conn = false;
+
+        if ( ! r->ending )
+        {
+            genericsReport( V_INFO, "Read failed" EOL );
+        }
+
+        CloseHandle( portHandle );
     }
-    else
+
+    return 0;
+}
+
+#else
+// =========================================================================================================
+// Default Driver ( OSX and Linux )
+// =========================================================================================================
+
+static struct Stream *_serialConnect( struct RunTime *r )
+
+/* Open and configure the serial port, handing it over as a stream */
+
+{
+    int ret;
+
+#ifdef OSX
+    int flags;
+
+    if ( ( r->f = open( r->options->port, O_RDONLY | O_NONBLOCK ) ) < 0 )
+#else
+    if ( ( r->f = open( r->options->port, O_RDONLY ) ) < 0 )
+#endif
+    {
+        genericsReport( V_WARN, "Can't open serial port" EOL );
+        return NULL;
+    }
+
+    genericsReport( V_INFO, "Port opened" EOL );
+
+#ifdef OSX
+    /* Remove the O_NONBLOCK flag now the port is open (OSX Only) */
+
+    if ( ( flags = fcntl( r->f, F_GETFL, NULL ) ) < 0 )
+    {
+        genericsExit( -3, "F_GETFL failed" EOL );
+    }
+
+    flags &= ~O_NONBLOCK;
+
+    if ( ( flags = fcntl( r->f, F_SETFL, flags ) ) < 0 )
+    {
+        genericsExit( -3, "F_SETFL failed" EOL );
+    }
+
+#endif
+
+    if ( ( ret = _setSerialConfig ( r->f, r->options->speed ) ) < 0 )
+    {
+        genericsExit( ret, "setSerialConfig failed" EOL );
+    }
+
+    struct Stream *stream = streamCreateFdFile( r->f );
+
+    if ( !stream )
     {
-        if ( t->status != LIBUSB_TRANSFER_CANCELLED )
-        {
-            libusb_submit_transfer( t );
-        }
+        close( r->f );
     }
-}
 
+    return stream;
+}
 // ====================================================================================================
+static void *_serialDecoder( void *arg )
 
-void _actionOrbtraceCommand( struct RunTime *r, char *sn, enum ORBTraceDevice d )
-
-/* There is an orbtrace command line to be executed as part of the probe connect process */
+/* Drain the queue of serial blocks. The shape of _usbDecoder, except a finished block is
+ * recycled by marking it empty rather than by resubmitting a transfer, and the time each
+ * block spent queued goes into the serial latency histogram.
+ */
 
 {
-    char commandLine[MAX_LINE_LEN];
+    struct RunTime *r = ( struct RunTime * )arg;
 
-    /* If we have any configuration to do on this device, go ahead */
-    if ( r->options->otcl )
+    _pinPipelineThread( "Decode", r->options->cpuDecode );
+
+    while ( true )
     {
-        if ( getenv( ORBTRACEENVNAME ) )
+        _dqWaitForWork( r );
+
+        if ( r->decodeExit )
         {
-            snprintf( commandLine, MAX_LINE_LEN, "%s %s %s %s", getenv( ORBTRACEENVNAME ), r->options->otcl, sn ? ( ( d == DEVICE_ORBTRACE_MINI ) ? "-n " : "-s " ) : "", sn ? sn : "" );
+            break;
         }
-        else
-        {
-            char *baseDirectory = genericsGetBaseDirectory( );
 
-            if ( !baseDirectory )
-            {
-                genericsExit( -1, "Failed to establish base directory" EOL );
-            }
+        uint32_t rp = atomic_load( &r->dqRp );
+        struct dataBlock *b = r->decodeQueue[rp];
+        atomic_store( &r->dqRp, ( rp + 1 ) % ( NUM_RAW_BLOCKS + 1 ) );
 
-            snprintf( commandLine, MAX_LINE_LEN, "%s" ORBTRACE " %s %s %s", baseDirectory, r->options->otcl, sn ? ( ( d == DEVICE_ORBTRACE_MINI ) ? "-n " : "-s " ) : "", sn ? sn : "" );
-            free( baseDirectory );
-        }
+        STATSEG_SET( r->stats, queueDepth,
+                     ( atomic_load( &r->dqWp ) + NUM_RAW_BLOCKS + 1 - atomic_load( &r->dqRp ) ) % ( NUM_RAW_BLOCKS + 1 ) );
 
-        genericsReport( V_INFO, "%s" EOL, commandLine );
+        /* How long this block sat behind earlier decode work */
+        _instrRecord( r, INSTR_STAGE_SERIAL_QUEUE, b->arrival | 1 );
 
-        if (  system( commandLine ) )
-        {
-            genericsReport( V_ERROR, "Invoking orbtrace failed" EOL );
-        }
+        _handleBlock( r, b->fillLevel, b->buffer );
+
+        /* Hand the block back to the reader; fillLevel doubles as the in-flight marker */
+        atomic_thread_fence( memory_order_release );
+        b->fillLevel = 0;
     }
-}
 
+    return NULL;
+}
 // ====================================================================================================
-static int _usbFeeder( struct RunTime *r )
+static int _serialFeeder( struct RunTime *r )
 
-/* Setup USB transfers from an ORBTrace or BMP */
+/* Pipelined feed from a serial port. A dedicated reader drains the port into the raw block
+ * ring while the decode thread works, so a long decode no longer leaves the port unread; at
+ * SWO rates the kernel buffer only has to cover the gap between two read calls. Time a block
+ * spends queued, and any wait for a free block (the only window in which the kernel could
+ * still overrun), both land in the instrumentation histograms.
+ */
 
 {
-    bool firstRunThrough = true;
-    int workingDev;
+    pthread_mutex_init( &r->dqMutex, NULL );
+    pthread_cond_init( &r->dqUpdated, NULL );
 
-    /* Copy any part serial number across */
-    if ( r->options->sn )
-    {
-        r->sn = strdup( r->options->sn );
-    }
+    _pinPipelineThread( "Feeder", r->options->cpuFeeder );
 
     while ( !r->ending )
     {
-        r->errored = false;
-
-        /* ...just in case we had a context */
-        OrbtraceIfDestroyContext( r->o );
-        r->o = OrbtraceIfCreateContext();
-        assert( r->o );
+        struct Stream *stream = _serialConnect( r );
 
-        while ( 0 == OrbtraceIfGetDeviceList( r->o, r->sn, DEVTYPE_ALL ) )
+        if ( !stream )
         {
-            usleep( INTERVAL_1S );
+            usleep( INTERVAL_100MS );
+            continue;
         }
 
-        genericsReport( V_INFO, "Found device" EOL );
-        workingDev = OrbtraceIfSelectDevice( r->o );
+#if defined( LINUX ) && defined( ASYNC_LOW_LATENCY )
+        /* A tty's kernel receive buffer isn't host-sizeable, but USB serial adaptors sit on
+         * data until their latency timer fires; ask for low-latency delivery so blocks reach
+         * the ring as they arrive. Best effort, not every driver supports it.
+         */
+        struct serial_struct ss;
 
-        if ( !OrbtraceIfOpenDevice( r->o, workingDev ) )
+        if ( !ioctl( r->f, TIOCGSERIAL, &ss ) )
         {
-            genericsReport( V_INFO, "Couldn't open device" EOL );
-            break;
+            ss.flags |= ASYNC_LOW_LATENCY;
+            ioctl( r->f, TIOCSSERIAL, &ss );
         }
 
-        /* Take a record of what device we're using...we'll use that next time around to re-connect */
-        if ( r->sn )
-        {
-            free( r->sn );
-        }
+#endif
 
-        r->sn = strdup( OrbtraceIfGetSN( r->o, workingDev ) );
+        genericsReport( V_INFO, "Established serial port link" EOL );
 
-        /* Before we open, perform any orbtrace configuration that is needed */
-        _actionOrbtraceCommand( r, r->sn, OrbtraceIfGetDevtype( r->o, workingDev ) );
+        /* Start with an empty handoff queue and a fresh decode thread for this connection */
+        atomic_store( &r->dqWp, 0 );
+        atomic_store( &r->dqRp, 0 );
+        r->decodeExit = false;
 
-        if ( !OrbtraceGetIfandEP( r->o ) )
+        for ( int i = 0; i < NUM_RAW_BLOCKS; i++ )
         {
-            genericsReport( V_INFO, "Couldn't get IF and EP" EOL );
-            break;
+            r->rawBlock[i].fillLevel = 0;
         }
 
-        r->usingOFLOW = OrbtraceSupportsOFLOW( r->o );
+        if ( pthread_create( &r->decodeThread, NULL, &_serialDecoder, r ) )
+        {
+            genericsExit( -1, "Failed to create serial decode thread" EOL );
+        }
 
-        if ( r->usingOFLOW )
+        r->conn = true;
+        uint32_t blk = 0;
+
+        while ( !r->ending )
         {
-            genericsReport( V_INFO, "Orbtrace supports ORBFLOW protocol" EOL );
+            struct dataBlock *rxBlock = &r->rawBlock[blk];
 
-            if ( r->options->useTPIU )
+            if ( rxBlock->fillLevel )
             {
-                genericsReport( V_WARN, "TPIU decoding specified, but ORBTrace supports ORBFLOW, are you sure?" EOL );
-            }
+                /* The decoder still owns every block; wait for one back */
+                uint64_t is = _instrStamp( r );
 
-            if ( firstRunThrough && _r.opFileHandle )
-            {
-                if ( write( _r.opFileHandle, OFLOW_SIG, OFLOW_SIG_LEN ) < 0 )
+                while ( ( rxBlock->fillLevel ) && ( !r->ending ) )
                 {
-                    genericsExit( -4, "Could not write OFLOW signature to file (%s)" EOL, strerror( errno ) );
+                    usleep( INTERVAL_100US );
                 }
-            }
 
-            /* We only attempt to write the file header on the first run through */
-            firstRunThrough = false;
-        }
-        else
-        {
-            genericsReport( V_INFO, "Orbtrace supports legacy protocol" EOL );
-        }
+                _instrRecord( r, INSTR_STAGE_SERIAL_STALL, is );
+            }
 
-        genericsReport( V_DEBUG, "USB Interface claimed, ready for data" EOL );
+            atomic_thread_fence( memory_order_acquire );
 
-        /* Create the USB transfer blocks .. if we are connected depends on if there was an error submitting the requests */
-        r->errored = !( r->conn = OrbtraceIfSetupTransfers( r->o, r->options->hiresTime, r->rawBlock, NUM_RAW_BLOCKS, _usb_callback ) );
+            size_t fl = 0;
+            enum ReceiveResult result = stream->receive( stream, rxBlock->buffer, USB_TRANSFER_SIZE, NULL, &fl );
 
-        /* =========================== The main dispatch loop ======================================= */
-        while ( ( !r->ending )  && ( !r->errored ) )
-        {
-            int ret =   OrbtraceIfHandleEvents( r->o );
+            if ( ( RECEIVE_RESULT_EOF == result ) || ( RECEIVE_RESULT_ERROR == result ) )
+            {
+                break;
+            }
 
-            if ( ( ret ) && ( ret != LIBUSB_ERROR_INTERRUPTED ) )
+            if ( !fl )
             {
-                genericsReport( V_ERROR, "Error waiting for USB requests to complete %d" EOL, ret );
+                continue;
             }
 
-        }
+            struct timespec ats;
+            clock_gettime( CLOCK_MONOTONIC, &ats );
+            rxBlock->arrival = ( uint64_t )ats.tv_sec * 1000000000L + ats.tv_nsec;
+            rxBlock->fillLevel = fl;
 
-        /* ========================================================================================= */
+            uint32_t wp = atomic_load( &r->dqWp );
+            r->decodeQueue[wp] = rxBlock;
+            atomic_store( &r->dqWp, ( wp + 1 ) % ( NUM_RAW_BLOCKS + 1 ) );
+
+            _dqNotify( r );
+
+            blk = ( blk + 1 ) % NUM_RAW_BLOCKS;
+        }
 
         r->conn = false;
 
-        /* Remove transfers from list and release the memory */
-        OrbtraceIfCloseTransfers( r->o );
+        /* Collect the decode thread before the stream it references goes away */
+        r->decodeExit = true;
+        pthread_mutex_lock( &r->dqMutex );
+        pthread_cond_signal( &r->dqUpdated );
+        pthread_mutex_unlock( &r->dqMutex );
+        pthread_join( r->decodeThread, NULL );
 
         if ( !r->ending )
         {
-            genericsReport( V_INFO, "USB connection lost" EOL );
+            genericsReport( V_INFO, "Lost serial port link" EOL );
         }
 
-        genericsReport( V_INFO, "USB Interface closed" EOL );
+        stream->close( stream );
+        free( stream );
     }
 
     return 0;
 }
-// ====================================================================================================
+#endif
 
-static int _nwserverFeeder( struct RunTime *r )
+// ====================================================================================================
+static bool _indexFrameAfter( const uint8_t *map, size_t maplen, size_t from, bool aligned,
+                              size_t *atPos, uint64_t *walltimeUs )
 
-/* Setup network based transfers (typically used for things like J-Link but can also be a legacy orbuculum session */
+/* Align to the next frame boundary at or after 'from' and walk forward to the next index frame.
+ * The walk is bounded because the recorder drops an index at least every RECORD_INDEX_MAX_BYTES.
+ */
 
 {
-    struct dataBlock *rxBlock = &r->rawBlock[0];
+    struct Frame f;
+    const uint8_t *p = &map[from];
+    const uint8_t *end = &map[maplen];
 
-    while ( true )
+    if ( !aligned )
     {
-        struct Stream *stream = streamCreateSocket( r->options->nwserverHost, r->options->nwserverPort );
+        /* An arbitrary probe point is mid-frame; spool on to the delimiter first */
+        p = COBSgetFrameExtent( p, end - p );
+    }
 
-        if ( stream == NULL )
+    while ( p < end )
+    {
+        while ( ( p < end ) && ( COBSisEOFRAME( p ) ) )
         {
-            continue;
+            p++;
         }
 
-        genericsReport( V_INFO, "Established NW Server Link" EOL );
-
-        r->conn = true;
-
-        while ( !r->ending )
+        if ( p >= end )
         {
-            size_t fl;
-            enum ReceiveResult result = stream->receive( stream, rxBlock->buffer, USB_TRANSFER_SIZE, NULL, &fl );
-            rxBlock->fillLevel = fl;
+            break;
+        }
 
-            if ( result != RECEIVE_RESULT_OK )
-            {
-                break;
-            }
+        const uint8_t *fe = COBSgetFrameExtent( p, end - p );
 
-            _handleBlock( r, rxBlock->fillLevel, rxBlock->buffer );
+        if ( !COBSisEOFRAME( fe ) )
+        {
+            /* This frame runs off the end of the file */
+            break;
         }
 
-        if ( !r->ending )
+        /* Decoded minimum is tag + version + time + position + tag count + checksum */
+        if ( ( COBSSimpleDecode( p, fe - p, &f ) ) && ( f.len >= 20 ) &&
+                ( f.d[0] == RECORD_INDEX_TAG ) && ( f.d[1] == RECORD_INDEX_VERSION ) )
         {
-            genericsReport( V_INFO, "Lost NW Server Link" EOL );
+            *atPos = p - map;
+            *walltimeUs = _get64le( &f.d[2] );
+            return true;
         }
 
-        r->conn = false;
-        free( stream );
+        p = fe;
     }
 
-    return 0;
+    return false;
 }
 // ====================================================================================================
+static size_t _seekCapture( struct RunTime *r, const uint8_t *map, size_t maplen, size_t start )
 
+/* Resolve the requested jump time to a replay offset by binary probing the index frames.
+ * Returns 'start' unchanged when the capture carries no usable index.
+ */
 
-#ifdef WIN32
-// ====================================================================================================
-// WIN32 Specific Driver
-// ====================================================================================================
-
-static int _serialFeeder( struct RunTime *r )
 {
-    char portPath[MAX_PATH] = { 0 };
-    snprintf( portPath, sizeof( portPath ), "\\\\.\\%s", r->options->port );
+    size_t pos;
+    uint64_t t;
+    size_t basePos;
+    uint64_t baseTime;
 
-    while ( !r->ending )
+    if ( !_indexFrameAfter( map, maplen, start, true, &basePos, &baseTime ) )
     {
-        HANDLE portHandle = CreateFile( portPath,
-                                        GENERIC_READ,
-                                        0,      //  must be opened with exclusive-access
-                                        NULL,   //  default security attributes
-                                        OPEN_EXISTING, //  must use OPEN_EXISTING
-                                        0,    //  not overlapped I/O
-                                        NULL ); //  hTemplate must be NULL for comm devices
+        genericsReport( V_WARN, "No index in capture; replaying from the start" EOL );
+        return start;
+    }
 
-        if ( portHandle == INVALID_HANDLE_VALUE )
-        {
-            genericsExit( 1, "Can't open serial port" EOL );
-        }
+    uint64_t target = baseTime + ( uint64_t )r->options->jumpTime * 1000000L;
 
-        genericsReport( V_INFO, "Port opened" EOL );
+    /* Invariant; the last index frame at or before lo is no later than the target, hi is beyond it */
+    size_t lo = basePos;
+    size_t hi = maplen;
 
-        if ( !_setSerialSpeed( portHandle, r->options->speed ) )
+    while ( hi - lo > USB_TRANSFER_SIZE )
+    {
+        size_t mid = lo + ( hi - lo ) / 2;
+
+        if ( ( _indexFrameAfter( map, maplen, mid, false, &pos, &t ) ) && ( t <= target ) )
         {
-            genericsExit( 2, "setSerialConfig failed" EOL );
+            lo = pos;
+        }
+        else
+        {
+            hi = mid;
         }
+    }
 
-        SetCommMask( portHandle, EV_RXCHAR );
+    /* Tidy up over the final window; settle on the last index frame not beyond the target */
+    while ( ( _indexFrameAfter( map, maplen, lo + 1, false, &pos, &t ) ) && ( t <= target ) )
+    {
+        lo = pos;
+    }
 
-        genericsReport( V_INFO, "Port configured" EOL );
+    return lo;
+}
+// ====================================================================================================
+#if !defined( WIN32 )
 
-        r->conn = true;
+/* One input of a merged replay. Bytes in [pos,nextPos) all carry 'time'; the index frame at
+ * nextPos opens the following span at 'nextTime'.
+ */
+struct mergeSource
+{
+    const char *name;                    /* Filename, for reporting */
+    int fd;                              /* Handle the capture was opened on */
+    uint8_t *map;                        /* Mapping of the capture */
+    size_t maplen;                       /* Length of the capture */
+    size_t pos;                          /* Next byte to be forwarded */
+    size_t nextPos;                      /* Where the current span ends */
+    uint64_t time;                       /* Wall time governing the current span */
+    uint64_t nextTime;                   /* Wall time of the index frame at nextPos */
+    bool live;                           /* There is another index frame to advance to */
+};
+// ====================================================================================================
+static void _mergeSiftDown( struct mergeSource **h, int n, int i )
 
-        while ( !r->ending )
-        {
-            DWORD eventMask = 0;
-            WaitCommEvent( portHandle, &eventMask, NULL );
-            DWORD unused;
-            COMSTAT stats;
-            ClearCommError( portHandle, &unused, &stats );
+/* Restore min-heap order on span time after the element at i changed */
 
-            if ( stats.cbInQue == 0 )
+{
+    while ( true )
+    {
+        int m = i;
+
+        for ( int c = 2 * i + 1; ( c <= 2 * i + 2 ) && ( c < n ); c++ )
+        {
+            if ( h[c]->time < h[m]->time )
             {
-                continue;
+                m = c;
             }
+        }
 
-            struct dataBlock *rxBlock = &r->rawBlock[0];
+        if ( m == i )
+        {
+            break;
+        }
 
-            DWORD transferSize = stats.cbInQue;
+        struct mergeSource *t = h[i];
+        h[i] = h[m];
+        h[m] = t;
+        i = m;
+    }
+}
+// ====================================================================================================
+static bool _mergeAdvance( struct mergeSource *s )
 
-            if ( transferSize > USB_TRANSFER_SIZE )
-            {
-                transferSize = USB_TRANSFER_SIZE;
-            }
+/* Adopt the span opened by the index frame at nextPos, then hunt for the index frame after it.
+ * Returns false when none follows; nextPos is then left at the end of the last complete frame.
+ */
 
-            ReadFile( portHandle, rxBlock->buffer, transferSize, &rxBlock->fillLevel, NULL );
+{
+    s->pos = s->nextPos;
+    s->time = s->nextTime;
 
-            if ( rxBlock->fillLevel <= 0 )
-            {
-                break;
-            }
+    /* Spool past the index frame itself before looking for its successor */
+    size_t from = COBSgetFrameExtent( &s->map[s->pos], s->maplen - s->pos ) - s->map;
 
-            _handleBlock( r, rxBlock->fillLevel, rxBlock->buffer );
+    if ( _indexFrameAfter( s->map, s->maplen, from, true, &s->nextPos, &s->nextTime ) )
+    {
+        return true;
+    }
+
+    /* No further index; everything complete from here belongs to the current span */
+    const uint8_t *p = &s->map[from];
+    const uint8_t *end = &s->map[s->maplen];
+
+    while ( p < end )
+    {
+        while ( ( p < end ) && ( COBSisEOFRAME( p ) ) )
+        {
+            p++;
         }
 
-        r->conn = false;
+        if ( p >= end )
+        {
+            break;
+        }
 
-        if ( ! r->ending )
+        const uint8_t *fe = COBSgetFrameExtent( p, end - p );
+
+        if ( ( fe >= end ) || ( !COBSisEOFRAME( fe ) ) )
         {
-            genericsReport( V_INFO, "Read failed" EOL );
+            /* This frame runs off the end of the file; don't forward the partial */
+            break;
         }
 
-        CloseHandle( portHandle );
+        p = fe;
     }
 
-    return 0;
+    s->nextPos = p - s->map;
+    return false;
 }
+// ====================================================================================================
+static int _mergeFeeder( struct RunTime *r )
 
-#else
-// =========================================================================================================
-// Default Driver ( OSX and Linux )
-// =========================================================================================================
-
-static int _serialFeeder( struct RunTime *r )
-
-/* Setup incoming feed from a serial port */
+/* Replay several OFLOW captures as one stream, ordered by the wall times in their index frames.
+ * A k-way heap merge despatches whichever source owns the earliest pending span; spans between
+ * index frames are forwarded whole, so ordering granularity is the index interval.
+ */
 
 {
-    int ret;
-    struct dataBlock *rxBlock = &r->rawBlock[0];
+    static struct mergeSource src[MAX_REPLAY_FILES];
+    struct mergeSource *h[MAX_REPLAY_FILES];
+    int n = r->options->numInputFiles;
+    struct stat st;
 
-    while ( !r->ending )
+    for ( int i = 0; i < n; i++ )
     {
-#ifdef OSX
-        int flags;
-
-        while ( !r->ending && ( r->f = open( r->options->port, O_RDONLY | O_NONBLOCK ) ) < 0 )
-#else
-        while ( !r->ending && ( r->f = open( r->options->port, O_RDONLY ) ) < 0 )
-#endif
+        struct mergeSource *s = &src[i];
+        s->name = r->options->inputFile[i];
+
+        if ( ( s->fd = open( s->name, O_RDONLY ) ) < 0 )
         {
-            genericsReport( V_WARN, "Can't open serial port" EOL );
-            usleep( INTERVAL_100MS );
+            genericsExit( -4, "Can't open file %s" EOL, s->name );
         }
 
-        genericsReport( V_INFO, "Port opened" EOL );
+        if ( ( 0 != fstat( s->fd, &st ) ) || ( !S_ISREG( st.st_mode ) ) || ( !st.st_size ) )
+        {
+            genericsExit( -4, "%s is not a regular file; cannot merge" EOL, s->name );
+        }
 
-#ifdef OSX
-        /* Remove the O_NONBLOCK flag now the port is open (OSX Only) */
+        s->maplen = st.st_size;
+        s->map = ( uint8_t * )mmap( NULL, s->maplen, PROT_READ, MAP_PRIVATE, s->fd, 0 );
 
-        if ( ( flags = fcntl( r->f, F_GETFL, NULL ) ) < 0 )
+        if ( MAP_FAILED == s->map )
         {
-            genericsExit( -3, "F_GETFL failed" EOL );
+            genericsExit( -4, "Failed to map %s" EOL, s->name );
         }
 
-        flags &= ~O_NONBLOCK;
-
-        if ( ( flags = fcntl( r->f, F_SETFL, flags ) ) < 0 )
+        if ( ( s->maplen < OFLOW_SIG_LEN ) || ( strncmp( OFLOW_SIG, ( char * )s->map, OFLOW_SIG_LEN ) ) )
         {
-            genericsExit( -3, "F_SETFL failed" EOL );
+            genericsExit( -4, "%s is not an OFLOW capture; cannot merge" EOL, s->name );
         }
 
-#endif
+        s->pos = OFLOW_SIG_LEN;
 
-        if ( ( ret = _setSerialConfig ( r->f, r->options->speed ) ) < 0 )
+        if ( !_indexFrameAfter( s->map, s->maplen, s->pos, true, &s->nextPos, &s->nextTime ) )
         {
-            genericsExit( ret, "setSerialConfig failed" EOL );
+            genericsExit( -4, "%s carries no index frames; cannot merge" EOL, s->name );
         }
 
-        r->conn = true;
+        /* Anything ahead of the first index frame adopts its time */
+        s->time = s->nextTime;
+        s->live = true;
+        h[i] = s;
+    }
 
-        while ( !r->ending )
+    if ( r->options->jumpTime )
+    {
+        genericsReport( V_WARN, "Jump is not supported for merged replay; replaying from the start" EOL );
+    }
+
+    r->usingOFLOW = true;
+    r->conn = true;
+
+    for ( int i = n / 2 - 1; i >= 0; i-- )
+    {
+        _mergeSiftDown( h, n, i );
+    }
+
+    while ( ( n ) && ( !r->ending ) )
+    {
+        struct mergeSource *s = h[0];
+
+        while ( ( s->pos < s->nextPos ) && ( !r->ending ) )
         {
-            if ( ( rxBlock->fillLevel = read( r->f, rxBlock->buffer, USB_TRANSFER_SIZE ) ) <= 0 )
+            size_t t = s->nextPos - s->pos;
+
+            if ( t > USB_TRANSFER_SIZE )
             {
-                break;
+                t = USB_TRANSFER_SIZE;
             }
 
-            _handleBlock( r, rxBlock->fillLevel, rxBlock->buffer );
-        }
+            _handleBlock( r, t, &s->map[s->pos] );
+            s->pos += t;
 
-        r->conn = false;
+            if ( r->options->paceDelay )
+            {
+                usleep( r->options->paceDelay );
+            }
+        }
 
-        if ( ! r->ending )
+        if ( s->live )
         {
-            genericsReport( V_INFO, "Read failed" EOL );
+            s->live = _mergeAdvance( s );
+            _mergeSiftDown( h, n, 0 );
+        }
+        else
+        {
+            /* This source is drained; drop it from the heap */
+            munmap( s->map, s->maplen );
+            close( s->fd );
+            h[0] = h[--n];
+            _mergeSiftDown( h, n, 0 );
         }
+    }
 
-        close( r->f );
+    /* Anything still mapped is only here because we are ending early */
+    while ( n )
+    {
+        struct mergeSource *s = h[--n];
+        munmap( s->map, s->maplen );
+        close( s->fd );
     }
 
-    return 0;
+    r->conn = false;
+    genericsReport( V_INFO, "Merged replay complete" EOL );
+    return true;
 }
 #endif
-
 // ====================================================================================================
 static int _fileFeeder( struct RunTime *r )
 
 /* Setup incoming data stream from a file in either legacy or OFLOW format */
 
 {
-    struct dataBlock *rxBlock = &r->rawBlock[0];
+#if !defined( WIN32 )
+
+    if ( r->options->numInputFiles > 1 )
+    {
+        return _mergeFeeder( r );
+    }
 
+#endif
+    struct dataBlock *rxBlock = &r->rawBlock[0];
+#if !defined( WIN32 )
+    struct stat st;
+    uint8_t *map = MAP_FAILED;
+    size_t maplen = 0;
+#endif
 
     if ( ( r->f = open( r->options->file, O_RDONLY ) ) < 0 )
     {
@@ -1446,41 +4704,127 @@ static int _fileFeeder( struct RunTime *r )
 
     r->conn = true;
 
-    /* Start off by checking if this is OFLOW formatted */
-    rxBlock->fillLevel = read( r->f, rxBlock->buffer, OFLOW_SIG_LEN );
-    r->usingOFLOW = ( ( OFLOW_SIG_LEN == rxBlock->fillLevel ) && ( !strncmp( OFLOW_SIG, ( char * )rxBlock->buffer, OFLOW_SIG_LEN ) ) );
-    genericsReport( V_INFO, "File is %sin OFLOW format" EOL, ( r->usingOFLOW ) ? "" : "not " );
+#if !defined( WIN32 )
 
-    if ( r->usingOFLOW )
+    /* A regular file gets mapped and handed to the block handler in place, so multi-gigabyte
+     * replays don't pay a copy per transfer. Anything else (fifo, device) uses reads below. */
+    if ( ( 0 == fstat( r->f, &st ) ) && S_ISREG( st.st_mode ) && ( st.st_size > 0 ) )
     {
-        /* This is OFLOW, so we need to read the first data after the header */
-        rxBlock->fillLevel = read( r->f, rxBlock->buffer, USB_TRANSFER_SIZE );
+        map = ( uint8_t * )mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, r->f, 0 );
     }
 
-    while ( !r->ending )
+    if ( MAP_FAILED != map )
     {
-        if ( !rxBlock->fillLevel )
+        size_t o = 0;
+        maplen = st.st_size;
+        madvise( map, maplen, MADV_SEQUENTIAL );
+
+        r->usingOFLOW = ( ( maplen >= OFLOW_SIG_LEN ) && ( !strncmp( OFLOW_SIG, ( char * )map, OFLOW_SIG_LEN ) ) );
+        genericsReport( V_INFO, "File is %sin OFLOW format" EOL, ( r->usingOFLOW ) ? "" : "not " );
+
+        if ( r->usingOFLOW )
         {
-            if ( r->options->fileTerminate )
+            o = OFLOW_SIG_LEN;
+
+            if ( r->options->jumpTime )
             {
-                break;
+                o = _seekCapture( r, map, maplen, o );
+                genericsReport( V_INFO, "Replay starts %d seconds in, at offset %zu of %zu" EOL,
+                                r->options->jumpTime, o, maplen );
             }
-            else
+        }
+        else if ( r->options->jumpTime )
+        {
+            genericsReport( V_WARN, "Not an OFLOW capture; cannot jump, replaying from the start" EOL );
+        }
+
+        while ( !r->ending )
+        {
+            if ( o >= maplen )
             {
-                // Just spin for a while to avoid clogging the CPU
+                if ( r->options->fileTerminate )
+                {
+                    break;
+                }
+
+                /* The file may still be growing under us (e.g. a live capture); look again */
                 usleep( INTERVAL_100MS );
+
+                if ( ( 0 == fstat( r->f, &st ) ) && ( ( size_t )st.st_size > maplen ) )
+                {
+                    munmap( map, maplen );
+                    maplen = st.st_size;
+                    map = ( uint8_t * )mmap( NULL, maplen, PROT_READ, MAP_PRIVATE, r->f, 0 );
+
+                    if ( MAP_FAILED == map )
+                    {
+                        break;
+                    }
+
+                    madvise( map, maplen, MADV_SEQUENTIAL );
+                }
+
                 continue;
             }
+
+            size_t t = maplen - o;
+
+            if ( t > USB_TRANSFER_SIZE )
+            {
+                t = USB_TRANSFER_SIZE;
+            }
+
+            _handleBlock( r, t, &map[o] );
+            o += t;
+
+            if ( r->options->paceDelay )
+            {
+                usleep( r->options->paceDelay );
+            }
         }
 
-        _handleBlock( r, rxBlock->fillLevel, rxBlock->buffer );
+        if ( MAP_FAILED != map )
+        {
+            munmap( map, maplen );
+        }
+    }
+    else
+#endif
+    {
+        /* Byte-stream input (fifo, device, or a platform without the mapping path) goes
+         * through the common pump; only the format sniff is particular to files. */
+#if defined( WIN32 )
+        struct Stream *stream = streamCreateFile( r->options->file );
+#else
+        struct Stream *stream = streamCreateFdFile( r->f );
+#endif
+        MEMCHECK( stream, -4 );
 
-        if ( r->options->paceDelay )
+        size_t fl = 0;
+        stream->receive( stream, rxBlock->buffer, OFLOW_SIG_LEN, NULL, &fl );
+        rxBlock->fillLevel = fl;
+        r->usingOFLOW = ( ( OFLOW_SIG_LEN == rxBlock->fillLevel ) && ( !strncmp( OFLOW_SIG, ( char * )rxBlock->buffer, OFLOW_SIG_LEN ) ) );
+        genericsReport( V_INFO, "File is %sin OFLOW format" EOL, ( r->usingOFLOW ) ? "" : "not " );
+
+        if ( ( !r->usingOFLOW ) && ( rxBlock->fillLevel ) )
         {
-            usleep( r->options->paceDelay );
+            /* Not a header after all; what we sniffed is payload */
+            _handleBlock( r, rxBlock->fillLevel, rxBlock->buffer );
+        }
+
+        if ( r->options->jumpTime )
+        {
+            genericsReport( V_WARN, "Input is not seekable; cannot jump, replaying from the start" EOL );
         }
 
-        rxBlock->fillLevel = read( r->f, rxBlock->buffer, USB_TRANSFER_SIZE );
+        _pumpStream( r, stream, !r->options->fileTerminate, true );
+
+        stream->close( stream );
+        free( stream );
+#if !defined( WIN32 )
+        /* The descriptor went down with the stream */
+        r->f = -1;
+#endif
     }
 
     r->conn = false;
@@ -1490,7 +4834,11 @@ static int _fileFeeder( struct RunTime *r )
         genericsReport( V_INFO, "File read error" EOL );
     }
 
-    close( r->f );
+    if ( r->f >= 0 )
+    {
+        close( r->f );
+    }
+
     return true;
 }
 // ====================================================================================================
@@ -1501,57 +4849,45 @@ static int _fileFeeder( struct RunTime *r )
 // ====================================================================================================
 // ====================================================================================================
 
-int main( int argc, char *argv[] )
+static void _instanceInit( struct RunTime *r, int basePort )
+
+/* Start the decoders, tag handlers and network interfaces for one capture instance */
 
 {
     struct timespec ts;
 
-    /* This is set here to avoid huge .data section in startup image */
-    _r.options = &_options;
-
-#ifdef WIN32
-    WSADATA wsaData;
-    WSAStartup( MAKEWORD( 2, 2 ), &wsaData );
-#endif
-
-    if ( !_processOptions( argc, argv, &_r ) )
+    if ( r->options->useTPIU )
     {
-        /* processOptions generates its own error messages */
-        genericsExit( -1, "" EOL );
+        TPIUDecoderInit( &r->t );
     }
 
-    if ( _r.options->useTPIU )
+    if ( r->options->swoLineMode != SWOLINE_NONE )
     {
-        TPIUDecoderInit( &_r.t );
+        SWOLineDecoderInit( &r->swoLine, r->options->swoLineMode, r->options->swoLineSpb );
     }
 
-    OFLOWInit( &_r.oflow );
-
-    genericsScreenHandling( !_r.options->mono );
+    OFLOWInit( &r->oflow );
+    genericsSeqInit( &r->statSeq );
+    r->stats = statsegPublish( "orbuculum" );
 
-    /* Make sure the network clients get removed at the end */
-    atexit( _doExit );
+    /* Network manager threads created below inherit any requested placement */
+    nwclientSetPlacement( r->options->cpuNet );
 
-    /* This ensures the atexit gets called */
-    if ( SIG_ERR == signal( SIGINT, _intHandler ) )
+    if ( r->options->instrPort )
     {
-        genericsExit( -1, "Failed to establish Int handler" EOL );
+        ITMDecoderInit( &r->qcITM, true );
     }
 
-    /* Don't kill a sub-process when any reader or writer evaporates */
-#if !defined WIN32
-
-    if ( SIG_ERR == signal( SIGPIPE, SIG_IGN ) )
+    if ( r->options->sampleComp )
     {
-        genericsExit( -1, "Failed to ignore SIGPIPEs" EOL );
+        ITMDecoderInit( &r->sampITM, true );
+        SampleCompInit( &r->sampEnc );
     }
 
-#endif
-
-    if ( _r.options->channelList )
+    if ( r->options->channelList )
     {
         /* Channel list is only needed for legacy ports that we are re-exporting (i.e. clean unencapsulated flows) */
-        char *c = _r.options->channelList;
+        char *c = r->options->channelList;
         int x = 0;
 
         while ( *c )
@@ -1579,27 +4915,201 @@ int main( int argc, char *argv[] )
                     genericsExit( -1, "Channel number out of range" EOL );
                 }
 
-                _r.handler = ( struct handlers * )realloc( _r.handler, sizeof( struct handlers ) * ( _r.numHandlers + 1 ) );
+                r->handler = ( struct handlers * )realloc( r->handler, sizeof( struct handlers ) * ( r->numHandlers + 1 ) );
 
-                _r.handler[_r.numHandlers].channel = x;
-                _r.handler[_r.numHandlers].strippedBlock = ( struct dataBlock * )calloc( 1, sizeof( struct dataBlock ) );
-                _r.tagCount[x].hasHandler = true;
-                _r.handler[_r.numHandlers].n = nwclientStart(  _r.options->listenPort + LEGACY_SERVER_PORT_OFS + _r.numHandlers );
-                genericsReport( V_INFO, "Will decode tag %d, exported Legacy interface on port %d" EOL, x, _r.options->listenPort + LEGACY_SERVER_PORT_OFS + _r.numHandlers );
+                r->handler[r->numHandlers].channel = x;
+                r->handler[r->numHandlers].strippedBlock = ( struct dataBlock * )calloc( 1, sizeof( struct dataBlock ) );
+                r->handler[r->numHandlers].latencyBudgetUs = r->options->tagLatencyUs[x];
+                r->tagCount[x].hasHandler = true;
+                r->handler[r->numHandlers].n = nwclientStart(  basePort + LEGACY_SERVER_PORT_OFS + r->numHandlers );
+                genericsReport( V_INFO, "Will decode tag %d, exported Legacy interface on port %d" EOL, x, basePort + LEGACY_SERVER_PORT_OFS + r->numHandlers );
 
-                _r.numHandlers++;
+                r->numHandlers++;
                 x = 0;
             }
         }
     }
 
+    /* The handler table won't move again now, so it's safe to hang worker threads off it */
+    for ( int i = 0; i < r->numHandlers; i++ )
+    {
+        struct handlers *h = &r->handler[i];
+
+        h->ring = ( uint8_t * )malloc( HANDLER_RING_SIZE );
+        MEMCHECKV( h->ring );
+        atomic_store( &h->ringWp, 0 );
+        atomic_store( &h->ringRp, 0 );
+        h->exit = false;
+        pthread_mutex_init( &h->mutex, NULL );
+        pthread_cond_init( &h->updated, NULL );
+
+        if ( pthread_create( &h->worker, NULL, &_handlerWorker, h ) )
+        {
+            genericsExit( -1, "Failed to create tag despatch thread" EOL );
+        }
+    }
+
     /* The OFLOW handler doesn't need a channel list ... it works on all channels */
-    _r.oflowHandler = nwclientStart( _r.options->listenPort );
-    genericsReport( V_INFO, "Started Network interface for OFLOW on port %d" EOL, _r.options->listenPort );
+    r->oflowHandler = nwclientStart( basePort );
+    nwclientEnableFlowReports( r->oflowHandler );
+    genericsReport( V_INFO, "Started Network interface for OFLOW on port %d" EOL, basePort );
 
     /* Don't do anything with interval times for at least the first interval time */
     clock_gettime( CLOCK_REALTIME, &ts );
-    _r.lastInterval = ts.tv_sec * 1000000000L + ts.tv_nsec;
+    r->lastInterval = ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+// ====================================================================================================
+int main( int argc, char *argv[] )
+
+{
+    selfprofInit( "orbuculum" );
+
+    /* This is set here to avoid huge .data section in startup image */
+    _r.options = &_options;
+
+#ifdef WIN32
+    WSADATA wsaData;
+    WSAStartup( MAKEWORD( 2, 2 ), &wsaData );
+#endif
+
+    if ( !_processOptions( argc, argv, &_r ) )
+    {
+        /* processOptions generates its own error messages */
+        genericsExit( -1, "" EOL );
+    }
+
+    genericsScreenHandling( !_r.options->mono );
+
+    /* Diagnostics go via the async sink so -v 3 doesn't throttle the feeders */
+    genericsReportAsync( true );
+
+    /* Make sure the network clients get removed at the end */
+    atexit( _doExit );
+
+    /* This ensures the atexit gets called */
+    if ( SIG_ERR == signal( SIGINT, _intHandler ) )
+    {
+        genericsExit( -1, "Failed to establish Int handler" EOL );
+    }
+
+    /* Don't kill a sub-process when any reader or writer evaporates */
+#if !defined WIN32
+
+    if ( SIG_ERR == signal( SIGPIPE, SIG_IGN ) )
+    {
+        genericsExit( -1, "Failed to ignore SIGPIPEs" EOL );
+    }
+
+    /* SIGHUP asks for the options file to be re-read */
+    if ( ( _r.options->optFile ) && ( SIG_ERR == signal( SIGHUP, _hupHandler ) ) )
+    {
+        genericsExit( -1, "Failed to establish reload handler" EOL );
+    }
+
+#endif
+
+    /* All periodic housekeeping shares one scheduler thread */
+    _timers = twInit();
+
+    if ( !_timers )
+    {
+        genericsExit( -1, "Failed to create timer service" EOL );
+    }
+
+    if ( _r.options->spillDir )
+    {
+        nwclientSetSpill( _r.options->spillDir, ( uint64_t )_r.options->spillClientMB << 20,
+                          ( uint64_t )_r.options->spillTotalMB << 20 );
+    }
+
+    /* Decoders, tag handlers and network interfaces for the primary instance */
+    _instanceInit( &_r, _r.options->listenPort );
+
+    if ( _r.options->intervalReportTime )
+    {
+        _intervalTimer = twRepeat( _timers, ( uint64_t )_r.options->intervalReportTime * 1000ULL, _checkInterval, &_r );
+    }
+
+    if ( _r.options->optFile )
+    {
+        /* Reload requests are only flagged by the signal handler; this polls and acts on them */
+        twRepeat( _timers, INTERVAL_1S, _checkReload, &_r );
+    }
+
+    if ( _r.options->instrPort )
+    {
+        if ( pthread_create( &_r.instrThread, NULL, &_instrServer, &_r ) )
+        {
+            genericsExit( -1, "Failed to create instrumentation thread" EOL );
+        }
+
+        genericsReport( V_INFO, "Started instrumentation interface on localhost port %d" EOL, _r.options->instrPort );
+    }
+
+    if ( _r.options->captureFile )
+    {
+        _r.recordFd = open( _r.options->captureFile, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH );
+
+        if ( _r.recordFd < 0 )
+        {
+            genericsExit( -2, "Could not open capture file for writing" EOL );
+        }
+
+        /* A .zst suffix requests compressed recording; replay handles it transparently */
+        size_t cfl = strlen( _r.options->captureFile );
+
+        if ( ( cfl > 4 ) && ( !strcmp( &_r.options->captureFile[cfl - 4], ".zst" ) ) )
+        {
+#if defined( WITH_ZSTD )
+            _r.recordZstd = ZSTD_createCCtx();
+            _r.recordZBufLen = ZSTD_CStreamOutSize();
+            _r.recordZBuf = ( uint8_t * )malloc( _r.recordZBufLen );
+
+            if ( ( !_r.recordZstd ) || ( !_r.recordZBuf ) )
+            {
+                genericsExit( -1, "Could not establish capture compressor" EOL );
+            }
+
+            ZSTD_CCtx_setParameter( _r.recordZstd, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT );
+#else
+            genericsExit( -1, "Compressed capture requested, but this build has no zstd support" EOL );
+#endif
+        }
+
+        _r.recordRing = ( uint8_t * )malloc( RECORD_RING_SIZE );
+        MEMCHECK( _r.recordRing, -1 );
+        pthread_mutex_init( &_r.recMutex, NULL );
+        pthread_cond_init( &_r.recUpdated, NULL );
+
+        if ( pthread_create( &_r.recordThread, NULL, &_recordWorker, &_r ) )
+        {
+            genericsExit( -1, "Failed to create capture writer thread" EOL );
+        }
+
+        genericsReport( V_INFO, "Recording indexed OFLOW capture to %s" EOL, _r.options->captureFile );
+    }
+
+    if ( _r.options->pcapFile )
+    {
+        _r.pcapFp = fopen( _r.options->pcapFile, "wb" );
+
+        if ( !_r.pcapFp )
+        {
+            genericsExit( -2, "Could not open pcapng file for writing" EOL );
+        }
+
+        _r.pcapRing = ( uint8_t * )malloc( PCAP_RING_SIZE );
+        MEMCHECK( _r.pcapRing, -1 );
+        pthread_mutex_init( &_r.pcapMutex, NULL );
+        pthread_cond_init( &_r.pcapUpdated, NULL );
+
+        if ( pthread_create( &_r.pcapThread, NULL, &_pcapWorker, &_r ) )
+        {
+            genericsExit( -1, "Failed to create pcapng writer thread" EOL );
+        }
+
+        genericsReport( V_INFO, "Exporting pcapng to %s" EOL, _r.options->pcapFile );
+    }
 
     if ( _r.options->outfile )
     {
@@ -1610,6 +5120,14 @@ int main( int argc, char *argv[] )
             genericsReport( V_ERROR, "Could not open output file for writing" EOL );
             return -2;
         }
+
+        if ( _r.options->triggerSpec )
+        {
+            /* Arm the trigger; the file stays gated until the watched range is entered */
+            TRACEDecoderInit( &_r.trigDec, _r.options->triggerProt, true, genericsReport );
+            _r.trigRing = ( uint8_t * )malloc( TRIGGER_HISTORY_SIZE );
+            MEMCHECK( _r.trigRing, -1 );
+        }
     }
 
     /* Blank line for tidyness' sake */
@@ -1633,7 +5151,60 @@ int main( int argc, char *argv[] )
         }
     }
 
+    if ( _r.options->numRelays )
+    {
+        exit( _relayFeeder( &_r ) );
+    }
+
     /* ...nothing else left, it must be usb (either ORBTrace or BMP) */
+    if ( _r.options->multi )
+    {
+        /* Enumerate the matching probes and bind a feeder to each by exact serial number; the
+         * first probe is served by the main thread below, the rest get a thread and a port
+         * window of their own. Capture, dump file and instrumentation stay with the first.
+         */
+        struct OrbtraceIf *scan = OrbtraceIfCreateContext();
+        assert( scan );
+        int ndev = OrbtraceIfGetDeviceList( scan, _r.options->sn, DEVTYPE_ALL );
+
+        if ( !ndev )
+        {
+            genericsExit( -1, "No matching devices found for multi-probe mode" EOL );
+        }
+
+        _r.sn = strdup( OrbtraceIfGetSN( scan, 0 ) );
+        genericsReport( V_INFO, "Serving probe %s, OFLOW on port %d" EOL, _r.sn, _r.options->listenPort );
+
+        for ( int d = 1; d < ndev; d++ )
+        {
+            pthread_t feeder;
+            struct RunTime *rd = ( struct RunTime * )calloc( 1, sizeof( struct RunTime ) );
+            MEMCHECK( rd, -1 );
+
+            rd->options = _r.options;
+            rd->sn = strdup( OrbtraceIfGetSN( scan, d ) );
+            _instanceInit( rd, _r.options->listenPort + d * MULTI_PORT_STRIDE );
+
+            _multiInstance = ( struct RunTime ** )realloc( _multiInstance, sizeof( struct RunTime * ) * ( _numMultiInstances + 1 ) );
+            MEMCHECK( _multiInstance, -1 );
+            _multiInstance[_numMultiInstances++] = rd;
+
+            if ( _r.options->intervalReportTime )
+            {
+                twRepeat( _timers, ( uint64_t )_r.options->intervalReportTime * 1000ULL, _checkInterval, rd );
+            }
+
+            if ( pthread_create( &feeder, NULL, &_usbFeederThread, rd ) )
+            {
+                genericsExit( -1, "Failed to create multi-probe feeder thread" EOL );
+            }
+
+            genericsReport( V_INFO, "Serving probe %s, OFLOW on port %d" EOL, rd->sn, _r.options->listenPort + d * MULTI_PORT_STRIDE );
+        }
+
+        OrbtraceIfDestroyContext( scan );
+    }
+
     exit( _usbFeeder( &_r ) );
 }
 // ====================================================================================================
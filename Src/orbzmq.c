@@ -10,11 +10,15 @@
 #include <zmq.h>
 #include <inttypes.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include "generics.h"
 #include "git_version_info.h"
+#include "selfprof.h"
 #include "nw.h"
 #include "stream.h"
+#include "statseg.h"
 #include "itmDecoder.h"
 #include "msgDecoder.h"
 #include "oflow.h"
@@ -25,84 +29,863 @@
 
 #define DEFAULT_ZMQ_BIND_URL "tcp://*:3442"  /* by default bind to all source interfaces */
 
+#define BATCH_ARENA_SIZE  (32768)            /* Payload accumulated per topic before a flush is forced */
+#define BATCH_MAX_EVENTS  (256)              /* Maximum number of events batched into one message */
+#define BATCH_MAX_TOPICS  (NUM_CHANNELS + HWEVENT_NISYNC + 1) /* Worst case number of distinct topics */
+
 enum Prot { PROT_OFLOW, PROT_ITM, PROT_UNKNOWN };
 const char *protString[] = {"OFLOW", "ITM", NULL};
 
-// Record for options, either defaults or from command line
+/* Load-shedding policies applied per topic, ahead of the socket */
+enum shedPolicy
+{
+    SHED_NONE,                                       /* Everything is published */
+    SHED_NTH,                                        /* Keep one event in every N */
+    SHED_RESERVOIR,                                  /* Keep N randomly chosen events per flush interval */
+    SHED_LATEST                                      /* Only ever hold the newest event (conflation) */
+};
+
+// Record for options, either defaults or from command line
+
+struct Channel
+{
+    char *topic;
+    char *format;
+};
+
+struct
+{
+    /* Config information */
+    uint32_t tag;
+    bool forceITMSync;
+    uint32_t hwOutputs;
+    bool binary;                                        /* Publish hardware events as fixed-layout records */
+
+    /* Sink information */
+    char *bindUrl;
+    struct Channel channel[NUM_CHANNELS + 1];
+
+    /* Source information */
+    int port;
+    char *server;
+    enum Prot protocol;                                 /* What protocol to communicate (default to OFLOW (== orbuculum)) */
+    bool mono;                                          /* Supress colour in output */
+
+    char *file;                                         /* File host connection */
+    bool endTerminate;                                  /* Terminate when file/socket "ends" */
+
+    /* Per-topic load shedding requested on the command line */
+    struct shedSpec
+    {
+        char *topic;                                    /* Topic the policy applies to */
+        enum shedPolicy policy;
+        uint32_t param;                                 /* N for the policies which take one */
+    } shed[BATCH_MAX_TOPICS];
+    uint32_t numShed;
+
+    char *filterSpec;                                   /* Predicate every event must satisfy to be published */
+
+} options =
+{
+    .forceITMSync = true,
+    .tag = 1,
+    .bindUrl = DEFAULT_ZMQ_BIND_URL,
+    .port = OFCLIENT_SERVER_PORT,
+    .server = "localhost"
+};
+
+struct
+{
+    /* The decoders and the packets from them */
+    struct ITMDecoder i;
+    struct ITMPacket h;
+    struct OFLOW c;
+    struct OFLOWTimeline timeline;                /* Hardware to wall clock correlation */
+
+    /* Timestamp info */
+    uint64_t lastHWExceptionTS;
+    enum timeDelay timeStatus;                    /* Indicator of if this time is exact */
+    uint64_t timeStamp;                           /* Latest received time */
+
+    void *zmqContext;
+    void *zmqSocket;
+    bool ending;
+
+    struct msgBatch mbatch;                       /* Reusable pool for block-at-a-time decode */
+
+    /* Event batching */
+    struct Batch
+    {
+        const char *topic;                        /* Topic this batch accumulates for */
+        struct batchArena *arena;                 /* Arena being filled, or NULL if empty */
+        size_t used;                              /* Bytes of the arena in use */
+        uint32_t count;                           /* Number of events accumulated */
+        enum shedPolicy policy;                   /* Load shedding applied to this topic */
+        uint32_t param;                           /* N for the policies which take one */
+        uint32_t seen;                            /* Events offered since the policy interval began */
+        uint64_t shed;                            /* Events this policy has discarded or displaced */
+        struct
+        {
+            size_t off;                           /* Offset of this event in the arena */
+            size_t len;                           /* Length of this event */
+        } ev[BATCH_MAX_EVENTS];
+    } batch[BATCH_MAX_TOPICS];
+    uint32_t numBatches;                          /* Number of topics seen so far */
+
+    struct batchArena *arenaPool;                 /* Arenas ready for re-use */
+    pthread_mutex_t arenaLock;                    /* Pool lock; the free callback runs on a zmq thread */
+
+    struct statSlot *stats;                       /* Shared telemetry slot for this tool */
+
+} _r;
+
+/* Payload memory which outlives the flush; freed back to the pool once zmq has sent every frame over it */
+struct batchArena
+{
+    uint8_t d[BATCH_ARENA_SIZE];
+    atomic_int refs;                              /* Number of in-flight zero-copy frames over this arena */
+    struct batchArena *next;                      /* Pool linkage */
+};
+
+// ====================================================================================================
+// Batched message publishing
+// ====================================================================================================
+static void _arenaRelease( void *data, void *hint )
+
+/* Callback from zmq when a zero-copy frame has been fully despatched */
+
+{
+    ( void )data;
+    struct batchArena *a = ( struct batchArena * )hint;
+
+    if ( atomic_fetch_sub( &a->refs, 1 ) == 1 )
+    {
+        pthread_mutex_lock( &_r.arenaLock );
+        a->next = _r.arenaPool;
+        _r.arenaPool = a;
+        pthread_mutex_unlock( &_r.arenaLock );
+    }
+}
+// ====================================================================================================
+static struct batchArena *_arenaClaim( void )
+
+/* Get an arena to accumulate into, from the pool if one is free */
+
+{
+    pthread_mutex_lock( &_r.arenaLock );
+    struct batchArena *a = _r.arenaPool;
+
+    if ( a )
+    {
+        _r.arenaPool = a->next;
+    }
+
+    pthread_mutex_unlock( &_r.arenaLock );
+
+    if ( !a )
+    {
+        a = ( struct batchArena * )malloc( sizeof( struct batchArena ) );
+        MEMCHECK( a, NULL );
+    }
+
+    atomic_store( &a->refs, 0 );
+    return a;
+}
+// ====================================================================================================
+static void _flushBatch( struct Batch *b )
+
+/* Publish everything accumulated for this topic as one multipart message, one frame per event */
+
+{
+    if ( !b->count )
+    {
+        return;
+    }
+
+    zmq_send( _r.zmqSocket, b->topic, strlen( b->topic ), ZMQ_SNDMORE );
+
+    /* Each frame holds a reference over the arena; it goes back in the pool when the last one is sent */
+    atomic_store( &b->arena->refs, ( int )b->count );
+
+    for ( uint32_t i = 0; i < b->count; i++ )
+    {
+        zmq_msg_t msg;
+        zmq_msg_init_data( &msg, &b->arena->d[b->ev[i].off], b->ev[i].len, _arenaRelease, b->arena );
+        zmq_msg_send( &msg, _r.zmqSocket, ( i < b->count - 1 ) ? ZMQ_SNDMORE : 0 );
+    }
+
+    b->arena = NULL;
+    b->used  = 0;
+    b->count = 0;
+
+    /* A reservoir samples over one flush interval, so its population restarts here */
+    if ( b->policy == SHED_RESERVOIR )
+    {
+        b->seen = 0;
+    }
+}
+// ====================================================================================================
+static void _flushAllBatches( void )
+
+/* Publish anything accumulated on any topic */
+
+{
+    for ( uint32_t i = 0; i < _r.numBatches; i++ )
+    {
+        _flushBatch( &_r.batch[i] );
+    }
+}
+// ====================================================================================================
+void _publishMessage( const char *topic, void *payload, size_t size )
+
+/* Accumulate an event against its topic; only a memcpy on this path, the sends happen at flush time */
+
+{
+    struct Batch *b = NULL;
+
+    STATSEG_ADD( _r.stats, events, 1 );
+
+    /* Topics are interned strings, so matching on pointer is sufficient */
+    for ( uint32_t i = 0; i < _r.numBatches; i++ )
+    {
+        if ( _r.batch[i].topic == topic )
+        {
+            b = &_r.batch[i];
+            break;
+        }
+    }
+
+    if ( !b )
+    {
+        assert( _r.numBatches < BATCH_MAX_TOPICS );
+        b = &_r.batch[_r.numBatches++];
+        b->topic = topic;
+
+        /* Bind any requested shedding policy to the topic on first sight */
+        for ( uint32_t i = 0; i < options.numShed; i++ )
+        {
+            if ( !strcmp( options.shed[i].topic, topic ) )
+            {
+                b->policy = options.shed[i].policy;
+                b->param  = options.shed[i].param;
+                break;
+            }
+        }
+    }
+
+    b->seen++;
+
+    switch ( b->policy )
+    {
+        case SHED_NTH:
+
+            /* Deterministic downsampling; every Nth event survives */
+            if ( b->seen % b->param )
+            {
+                b->shed++;
+                STATSEG_ADD( _r.stats, drops, 1 );
+                return;
+            }
+
+            break;
+
+        case SHED_LATEST:
+
+            /* Conflation; anything still unsent is superseded by this event */
+            if ( b->count )
+            {
+                b->shed += b->count;
+                STATSEG_ADD( _r.stats, drops, b->count );
+                b->used  = 0;
+                b->count = 0;
+            }
+
+            break;
+
+        case SHED_RESERVOIR:
+
+            /* Classic reservoir; beyond capacity each arrival either displaces a random
+             * earlier event, keeping the sample unbiased over the interval, or is dropped */
+            if ( b->count >= b->param )
+            {
+                uint32_t victim = rand() % b->seen;
+
+                if ( ( victim < b->param ) && ( b->ev[victim].len >= size ) )
+                {
+                    memcpy( &b->arena->d[b->ev[victim].off], payload, size );
+                    b->ev[victim].len = size;
+                }
+
+                b->shed++;
+                STATSEG_ADD( _r.stats, drops, 1 );
+                return;
+            }
+
+            break;
+
+        default:
+            break;
+    }
+
+    /* If this event won't fit then get what we have out of the door first */
+    if ( ( b->count == BATCH_MAX_EVENTS ) || ( b->used + size > BATCH_ARENA_SIZE ) )
+    {
+        _flushBatch( b );
+    }
+
+    if ( !b->arena )
+    {
+        b->arena = _arenaClaim();
+
+        if ( !b->arena )
+        {
+            return;
+        }
+    }
+
+    memcpy( &b->arena->d[b->used], payload, size );
+    b->ev[b->count].off = b->used;
+    b->ev[b->count].len = size;
+    b->used += size;
+    b->count++;
+}
+
+/* Every published hardware event in one place; the topic strings, their binary variants and
+ * the -e argument parser are all expanded from this table so they can never drift apart. */
+#define HW_TOPIC_LIST(X)           \
+    X( HWEVENT_TS,        "TS" )   \
+    X( HWEVENT_EXCEPTION, "EXCP" ) \
+    X( HWEVENT_PCSample,  "PC" )   \
+    X( HWEVENT_DWT,       "DWT" )  \
+    X( HWEVENT_RWWT,      "RWWT" ) \
+    X( HWEVENT_AWP,       "AWP" )  \
+    X( HWEVENT_OFS,       "OFS" )
+
+static const char *hwEventNames[] =
+{
+#define X( ev, name ) [ev] = HWFIFO_NAME name,
+    HW_TOPIC_LIST( X )
+#undef X
+    [HWEVENT_UNUSED] = NULL,
+    [HWEVENT_NISYNC] = NULL,
+};
+
+/* Binary variants live under their own prefix; with a PUB socket the topic subscription is
+ * itself the representation negotiation, so each subscriber just picks the form it wants. */
+#define HWBIN_NAME "hwbin"
+
+static const char *hwBinEventNames[] =
+{
+#define X( ev, name ) [ev] = HWBIN_NAME name,
+    HW_TOPIC_LIST( X )
+#undef X
+};
+
+/* Fixed-layout little-endian records for the binary topics. Every record leads with the
+ * 64-bit delta timestamp except TS, which carries the timebase itself.
+ *   TS   : u8 timeStatus, u32 timeInc
+ *   EXCP : u64 dts, u8 eventType, u32 exceptionNumber
+ *   PC   : u64 dts, u8 sleep, u32 pc
+ *   DWT  : u64 dts, u8 eventFlags
+ *   RWWT : u64 dts, u8 comp, u8 isWrite, u32 data
+ *   AWP  : u64 dts, u8 comp, u32 data
+ *   OFS  : u64 dts, u8 comp, u16 offset
+ */
+static void _put32le( uint8_t *d, uint32_t v )
+
+{
+    d[0] = v & 0xff;
+    d[1] = ( v >> 8 ) & 0xff;
+    d[2] = ( v >> 16 ) & 0xff;
+    d[3] = ( v >> 24 ) & 0xff;
+}
+
+static void _put64le( uint8_t *d, uint64_t v )
+
+{
+    _put32le( d, ( uint32_t )v );
+    _put32le( &d[4], ( uint32_t )( v >> 32 ) );
+}
+
+// ====================================================================================================
+// Event filter expressions
+// ====================================================================================================
+// A predicate compiled once from the command line and evaluated against every decoded event
+// before its handler formats and publishes it. Grammar;
+//
+//   expr  := or
+//   or    := and ( '||' and )*
+//   and   := not ( '&&' not )*
+//   not   := '!' not | '(' expr ')' | cmp
+//   cmp   := term ( ( '==' | '!=' | '<' | '<=' | '>' | '>=' ) term )?
+//   term  := number | field | typename
+//
+// Fields; type, channel, value, len, vector, event, addr, data, comp, ts. Type names; sw,
+// exception, dwt, pc, watch, wpt, offset, nisync, time. A field the current event doesn't
+// carry makes its comparison false, so mixed-type expressions behave sensibly.
+
+enum filtOp
+{
+    FILT_LIT,                                     /* Push a literal */
+    FILT_FIELD,                                   /* Push an event field (or mark it absent) */
+    FILT_EQ, FILT_NE, FILT_LT, FILT_LE, FILT_GT, FILT_GE,
+    FILT_AND, FILT_OR, FILT_NOT
+};
+
+enum filtField
+{
+    FF_TYPE, FF_CHANNEL, FF_VALUE, FF_LEN, FF_VECTOR, FF_EVENT, FF_ADDR, FF_DATA, FF_COMP, FF_TS
+};
+
+struct filtInstruction
+{
+    enum filtOp op;
+    uint64_t lit;                                 /* FILT_LIT: the value; FILT_FIELD: the field */
+};
+
+#define FILT_MAX_PROG  (64)                       /* Instructions; enough for any sane predicate */
+#define FILT_MAX_STACK (16)
+
+static struct filtInstruction _filtProg[FILT_MAX_PROG];
+static uint32_t _filtLen;
+
+// ====================================================================================================
+static bool _filterEmit( enum filtOp op, uint64_t lit )
+
+{
+    if ( _filtLen == FILT_MAX_PROG )
+    {
+        return false;
+    }
+
+    _filtProg[_filtLen].op = op;
+    _filtProg[_filtLen++].lit = lit;
+    return true;
+}
+// ====================================================================================================
+static bool _filterExpr( const char **p );
+
+static void _filterSkip( const char **p )
+
+{
+    while ( isspace( ( unsigned char ) * *p ) )
+    {
+        ( *p )++;
+    }
+}
+// ====================================================================================================
+static bool _filterTerm( const char **p )
+
+{
+    static const struct { const char *name; enum filtField f; } fields[] =
+    {
+        { "type", FF_TYPE }, { "channel", FF_CHANNEL }, { "value", FF_VALUE }, { "len", FF_LEN },
+        { "vector", FF_VECTOR }, { "event", FF_EVENT }, { "addr", FF_ADDR }, { "data", FF_DATA },
+        { "comp", FF_COMP }, { "ts", FF_TS }, { NULL, 0 }
+    };
+    static const struct { const char *name; enum MSGType t; } types[] =
+    {
+        { "sw", MSG_SOFTWARE }, { "exception", MSG_EXCEPTION }, { "dwt", MSG_DWT_EVENT },
+        { "pc", MSG_PC_SAMPLE }, { "watch", MSG_DATA_RWWP }, { "wpt", MSG_DATA_ACCESS_WP },
+        { "offset", MSG_OSW }, { "nisync", MSG_NISYNC }, { "time", MSG_TS }, { NULL, 0 }
+    };
+
+    _filterSkip( p );
+
+    if ( isdigit( ( unsigned char ) * *p ) )
+    {
+        char *e;
+        uint64_t v = strtoull( *p, &e, 0 );
+        *p = e;
+        return _filterEmit( FILT_LIT, v );
+    }
+
+    if ( isalpha( ( unsigned char ) * *p ) )
+    {
+        const char *s = *p;
+
+        while ( isalnum( ( unsigned char ) * *p ) )
+        {
+            ( *p )++;
+        }
+
+        size_t l = *p - s;
+
+        for ( uint32_t i = 0; fields[i].name; i++ )
+        {
+            if ( ( strlen( fields[i].name ) == l ) && ( !strncmp( s, fields[i].name, l ) ) )
+            {
+                return _filterEmit( FILT_FIELD, fields[i].f );
+            }
+        }
+
+        for ( uint32_t i = 0; types[i].name; i++ )
+        {
+            if ( ( strlen( types[i].name ) == l ) && ( !strncmp( s, types[i].name, l ) ) )
+            {
+                return _filterEmit( FILT_LIT, types[i].t );
+            }
+        }
+    }
+
+    return false;
+}
+// ====================================================================================================
+static bool _filterNot( const char **p )
+
+{
+    _filterSkip( p );
+
+    if ( **p == '!' )
+    {
+        /* Take care not to eat the '!' of a '!=' */
+        if ( ( *p )[1] != '=' )
+        {
+            ( *p )++;
+            return ( _filterNot( p ) ) && ( _filterEmit( FILT_NOT, 0 ) );
+        }
+    }
+
+    if ( **p == '(' )
+    {
+        ( *p )++;
+
+        if ( !_filterExpr( p ) )
+        {
+            return false;
+        }
+
+        _filterSkip( p );
+
+        if ( **p != ')' )
+        {
+            return false;
+        }
+
+        ( *p )++;
+        return true;
+    }
+
+    if ( !_filterTerm( p ) )
+    {
+        return false;
+    }
+
+    _filterSkip( p );
+
+    enum filtOp op;
+
+    if ( ( **p == '=' ) && ( ( *p )[1] == '=' ) )
+    {
+        op = FILT_EQ;
+        *p += 2;
+    }
+    else if ( ( **p == '!' ) && ( ( *p )[1] == '=' ) )
+    {
+        op = FILT_NE;
+        *p += 2;
+    }
+    else if ( **p == '<' )
+    {
+        op = ( ( *p )[1] == '=' ) ? FILT_LE : FILT_LT;
+        *p += ( op == FILT_LE ) ? 2 : 1;
+    }
+    else if ( **p == '>' )
+    {
+        op = ( ( *p )[1] == '=' ) ? FILT_GE : FILT_GT;
+        *p += ( op == FILT_GE ) ? 2 : 1;
+    }
+    else
+    {
+        /* A bare term is truthy on its own */
+        return true;
+    }
+
+    return ( _filterTerm( p ) ) && ( _filterEmit( op, 0 ) );
+}
+// ====================================================================================================
+static bool _filterAnd( const char **p )
+
+{
+    if ( !_filterNot( p ) )
+    {
+        return false;
+    }
+
+    _filterSkip( p );
+
+    while ( ( **p == '&' ) && ( ( *p )[1] == '&' ) )
+    {
+        *p += 2;
+
+        if ( ( !_filterNot( p ) ) || ( !_filterEmit( FILT_AND, 0 ) ) )
+        {
+            return false;
+        }
+
+        _filterSkip( p );
+    }
+
+    return true;
+}
+// ====================================================================================================
+static bool _filterExpr( const char **p )
+
+{
+    if ( !_filterAnd( p ) )
+    {
+        return false;
+    }
+
+    _filterSkip( p );
+
+    while ( ( **p == '|' ) && ( ( *p )[1] == '|' ) )
+    {
+        *p += 2;
+
+        if ( ( !_filterAnd( p ) ) || ( !_filterEmit( FILT_OR, 0 ) ) )
+        {
+            return false;
+        }
+
+        _filterSkip( p );
+    }
+
+    return true;
+}
+// ====================================================================================================
+static bool _filterCompile( const char *expr )
+
+{
+    const char *p = expr;
+    _filtLen = 0;
+
+    if ( !_filterExpr( &p ) )
+    {
+        return false;
+    }
+
+    _filterSkip( &p );
+    return !*p;
+}
+// ====================================================================================================
+static bool _filterFetch( const struct msg *m, enum filtField f, uint64_t *v )
+
+/* Fetch a field from the event, or report that this event type doesn't carry it */
+
+{
+    switch ( f )
+    {
+        case FF_TYPE:
+            *v = m->genericMsg.msgtype;
+            return true;
+
+        case FF_TS:
+            *v = m->genericMsg.ts;
+            return true;
+
+        case FF_CHANNEL:
+            if ( m->genericMsg.msgtype == MSG_SOFTWARE )
+            {
+                *v = m->swMsg.srcAddr;
+                return true;
+            }
+
+            return false;
+
+        case FF_VALUE:
+            switch ( m->genericMsg.msgtype )
+            {
+                case MSG_SOFTWARE:
+                    *v = m->swMsg.value;
+                    return true;
+
+                case MSG_DATA_ACCESS_WP:
+                    *v = m->wptMsg.data;
+                    return true;
+
+                case MSG_DATA_RWWP:
+                    *v = m->watchMsg.data;
+                    return true;
+
+                default:
+                    return false;
+            }
+
+        case FF_LEN:
+            if ( m->genericMsg.msgtype == MSG_SOFTWARE )
+            {
+                *v = m->swMsg.len;
+                return true;
+            }
+
+            return false;
+
+        case FF_VECTOR:
+            if ( m->genericMsg.msgtype == MSG_EXCEPTION )
+            {
+                *v = m->excMsg.exceptionNumber;
+                return true;
+            }
+
+            return false;
+
+        case FF_EVENT:
+            if ( m->genericMsg.msgtype == MSG_EXCEPTION )
+            {
+                *v = m->excMsg.eventType;
+                return true;
+            }
+
+            if ( m->genericMsg.msgtype == MSG_DWT_EVENT )
+            {
+                *v = m->dwtMsg.event;
+                return true;
+            }
+
+            return false;
+
+        case FF_ADDR:
+            if ( m->genericMsg.msgtype == MSG_PC_SAMPLE )
+            {
+                *v = m->pcSampleMsg.pc;
+                return true;
+            }
+
+            if ( m->genericMsg.msgtype == MSG_NISYNC )
+            {
+                *v = m->nisyncMsg.addr;
+                return true;
+            }
+
+            return false;
+
+        case FF_DATA:
+            if ( m->genericMsg.msgtype == MSG_DATA_ACCESS_WP )
+            {
+                *v = m->wptMsg.data;
+                return true;
+            }
+
+            if ( m->genericMsg.msgtype == MSG_DATA_RWWP )
+            {
+                *v = m->watchMsg.data;
+                return true;
+            }
+
+            return false;
+
+        case FF_COMP:
+            switch ( m->genericMsg.msgtype )
+            {
+                case MSG_OSW:
+                    *v = m->oswMsg.comp;
+                    return true;
+
+                case MSG_DATA_ACCESS_WP:
+                    *v = m->wptMsg.comp;
+                    return true;
+
+                case MSG_DATA_RWWP:
+                    *v = m->watchMsg.comp;
+                    return true;
+
+                default:
+                    return false;
+            }
+    }
 
-struct Channel
-{
-    char *topic;
-    char *format;
-};
+    return false;
+}
+// ====================================================================================================
+static bool _filterPass( const struct msg *m )
+
+/* Evaluate the compiled predicate against one event. No filter means everything passes. */
 
-struct
 {
-    /* Config information */
-    uint32_t tag;
-    bool forceITMSync;
-    uint32_t hwOutputs;
+    struct { uint64_t v; bool valid; } stack[FILT_MAX_STACK];
+    int sp = 0;
 
-    /* Sink information */
-    char *bindUrl;
-    struct Channel channel[NUM_CHANNELS + 1];
+    if ( !_filtLen )
+    {
+        return true;
+    }
 
-    /* Source information */
-    int port;
-    char *server;
-    enum Prot protocol;                                 /* What protocol to communicate (default to OFLOW (== orbuculum)) */
-    bool mono;                                          /* Supress colour in output */
+    for ( uint32_t i = 0; i < _filtLen; i++ )
+    {
+        const struct filtInstruction *in = &_filtProg[i];
 
-    char *file;                                         /* File host connection */
-    bool endTerminate;                                  /* Terminate when file/socket "ends" */
+        switch ( in->op )
+        {
+            case FILT_LIT:
+                stack[sp].v = in->lit;
+                stack[sp++].valid = true;
+                break;
 
-} options =
-{
-    .forceITMSync = true,
-    .tag = 1,
-    .bindUrl = DEFAULT_ZMQ_BIND_URL,
-    .port = OFCLIENT_SERVER_PORT,
-    .server = "localhost"
-};
+            case FILT_FIELD:
+                stack[sp].valid = _filterFetch( m, ( enum filtField )in->lit, &stack[sp].v );
+                sp++;
+                break;
 
-struct
-{
-    /* The decoders and the packets from them */
-    struct ITMDecoder i;
-    struct ITMPacket h;
-    struct OFLOW c;
+            case FILT_NOT:
+                stack[sp - 1].v = !( ( stack[sp - 1].valid ) && ( stack[sp - 1].v ) );
+                stack[sp - 1].valid = true;
+                break;
 
-    /* Timestamp info */
-    uint64_t lastHWExceptionTS;
-    enum timeDelay timeStatus;                    /* Indicator of if this time is exact */
-    uint64_t timeStamp;                           /* Latest received time */
+            default:
+            {
+                /* All the binaries; an absent field poisons a comparison to false */
+                sp--;
+                bool valid = ( stack[sp - 1].valid ) && ( stack[sp].valid );
+                uint64_t a = stack[sp - 1].v;
+                uint64_t b = stack[sp].v;
+                bool res = false;
+
+                if ( ( in->op == FILT_AND ) || ( in->op == FILT_OR ) )
+                {
+                    bool ba = ( stack[sp - 1].valid ) && ( a );
+                    bool bb = ( stack[sp].valid ) && ( b );
+                    res = ( in->op == FILT_AND ) ? ( ba && bb ) : ( ba || bb );
+                }
+                else if ( valid )
+                {
+                    switch ( in->op )
+                    {
+                        case FILT_EQ:
+                            res = ( a == b );
+                            break;
 
-    void *zmqContext;
-    void *zmqSocket;
-    bool ending;
+                        case FILT_NE:
+                            res = ( a != b );
+                            break;
 
-} _r;
+                        case FILT_LT:
+                            res = ( a < b );
+                            break;
 
-// ====================================================================================================
-void _publishMessage( const char *topic, void *payload, size_t size )
-{
-    zmq_send( _r.zmqSocket, topic, strlen( topic ), ZMQ_SNDMORE );
-    zmq_send( _r.zmqSocket, payload, size, 0 );
-}
+                        case FILT_LE:
+                            res = ( a <= b );
+                            break;
 
-static const char *hwEventNames[] =
-{
-    [HWEVENT_TS] = HWFIFO_NAME "TS",
-    [HWEVENT_EXCEPTION] = HWFIFO_NAME "EXCP",
-    [HWEVENT_PCSample] = HWFIFO_NAME "PC",
-    [HWEVENT_DWT] = HWFIFO_NAME "DWT",
-    [HWEVENT_RWWT] = HWFIFO_NAME "RWWT",
-    [HWEVENT_AWP] = HWFIFO_NAME "AWP",
-    [HWEVENT_OFS] = HWFIFO_NAME "OFS",
-    [HWEVENT_UNUSED] = NULL,
-    [HWEVENT_NISYNC] = NULL,
-};
+                        case FILT_GT:
+                            res = ( a > b );
+                            break;
+
+                        default:
+                            res = ( a >= b );
+                            break;
+                    }
+                }
+
+                stack[sp - 1].v = res;
+                stack[sp - 1].valid = true;
+                break;
+            }
+        }
+    }
 
+    return ( sp == 1 ) && ( stack[0].valid ) && ( stack[0].v );
+}
 // ====================================================================================================
 // Decoders for each message
 // ====================================================================================================
@@ -111,6 +894,11 @@ void _handleSW( struct swMsg *m, struct ITMDecoder *i )
 {
     assert( m->msgtype == MSG_SOFTWARE );
 
+    if ( !_filterPass( ( const struct msg * )m ) )
+    {
+        return;
+    }
+
     if ( ( m->srcAddr < NUM_CHANNELS ) && ( options.channel[m->srcAddr].topic ) )
     {
         struct Channel *channel = &options.channel[m->srcAddr];
@@ -155,6 +943,11 @@ void _handleException( struct excMsg *m )
 {
     assert( m->msgtype == MSG_EXCEPTION );
 
+    if ( !_filterPass( ( const struct msg * )m ) )
+    {
+        return;
+    }
+
     if ( !( options.hwOutputs & ( 1 << HWEVENT_EXCEPTION ) ) )
     {
         return;
@@ -171,6 +964,16 @@ void _handleException( struct excMsg *m )
 
     _r.lastHWExceptionTS = m->ts;
 
+    if ( options.binary )
+    {
+        uint8_t rec[13];
+        _put64le( rec, eventdifftS );
+        rec[8] = m->eventType;
+        _put32le( &rec[9], m->exceptionNumber );
+        _publishMessage( hwBinEventNames[HWEVENT_EXCEPTION], rec, sizeof( rec ) );
+        return;
+    }
+
     if ( m->exceptionNumber < 16 )
     {
         /* This is a system based exception */
@@ -190,6 +993,11 @@ void _handleDWTEvent( struct dwtMsg *m )
 {
     assert( m->msgtype == MSG_DWT_EVENT );
 
+    if ( !_filterPass( ( const struct msg * )m ) )
+    {
+        return;
+    }
+
     if ( !( options.hwOutputs & ( 1 << HWEVENT_DWT ) ) )
     {
         return;
@@ -203,6 +1011,16 @@ void _handleDWTEvent( struct dwtMsg *m )
     uint64_t eventdifftS = m->ts - _r.lastHWExceptionTS;
 
     _r.lastHWExceptionTS = m->ts;
+
+    if ( options.binary )
+    {
+        uint8_t rec[9];
+        _put64le( rec, eventdifftS );
+        rec[8] = m->event;
+        _publishMessage( hwBinEventNames[HWEVENT_DWT], rec, sizeof( rec ) );
+        return;
+    }
+
     opLen = snprintf( outputString, MAX_STRING_LENGTH, "%" PRIu64, eventdifftS );
 
     for ( uint32_t i = 0; i < NUM_EVENTS; i++ )
@@ -231,6 +1049,11 @@ void _handlePCSample( struct pcSampleMsg *m )
 {
     assert( m->msgtype == MSG_PC_SAMPLE );
 
+    if ( !_filterPass( ( const struct msg * )m ) )
+    {
+        return;
+    }
+
     if ( !( options.hwOutputs & ( 1 << HWEVENT_PCSample ) ) )
     {
         return;
@@ -242,6 +1065,16 @@ void _handlePCSample( struct pcSampleMsg *m )
 
     _r.lastHWExceptionTS = m->ts;
 
+    if ( options.binary )
+    {
+        uint8_t rec[13];
+        _put64le( rec, eventdifftS );
+        rec[8] = m->sleep ? 1 : 0;
+        _put32le( &rec[9], m->pc );
+        _publishMessage( hwBinEventNames[HWEVENT_PCSample], rec, sizeof( rec ) );
+        return;
+    }
+
     if ( m->sleep )
     {
         /* This is a sleep packet */
@@ -262,6 +1095,11 @@ void _handleDataRWWP( struct watchMsg *m )
 {
     assert( m->msgtype == MSG_DATA_RWWP );
 
+    if ( !_filterPass( ( const struct msg * )m ) )
+    {
+        return;
+    }
+
     if ( !( options.hwOutputs & ( 1 << HWEVENT_RWWT ) ) )
     {
         return;
@@ -273,6 +1111,17 @@ void _handleDataRWWP( struct watchMsg *m )
 
     _r.lastHWExceptionTS = m->ts;
 
+    if ( options.binary )
+    {
+        uint8_t rec[14];
+        _put64le( rec, eventdifftS );
+        rec[8] = m->comp;
+        rec[9] = m->isWrite ? 1 : 0;
+        _put32le( &rec[10], m->data );
+        _publishMessage( hwBinEventNames[HWEVENT_RWWT], rec, sizeof( rec ) );
+        return;
+    }
+
     opLen = snprintf( outputString, MAX_STRING_LENGTH, "%" PRIu64 ",%d,%s,0x%x", eventdifftS, m->comp, m->isWrite ? "Write" : "Read", m->data );
     _publishMessage( hwEventNames[HWEVENT_RWWT], outputString, opLen );
 }
@@ -284,6 +1133,11 @@ void _handleDataAccessWP( struct wptMsg *m )
 {
     assert( m->msgtype == MSG_DATA_ACCESS_WP );
 
+    if ( !_filterPass( ( const struct msg * )m ) )
+    {
+        return;
+    }
+
     if ( !( options.hwOutputs & ( 1 << HWEVENT_AWP ) ) )
     {
         return;
@@ -295,6 +1149,17 @@ void _handleDataAccessWP( struct wptMsg *m )
     uint64_t eventdifftS = m->ts - _r.lastHWExceptionTS;
 
     _r.lastHWExceptionTS = m->ts;
+
+    if ( options.binary )
+    {
+        uint8_t rec[13];
+        _put64le( rec, eventdifftS );
+        rec[8] = m->comp;
+        _put32le( &rec[9], m->data );
+        _publishMessage( hwBinEventNames[HWEVENT_AWP], rec, sizeof( rec ) );
+        return;
+    }
+
     opLen = snprintf( outputString, MAX_STRING_LENGTH, "%" PRIu64 ",%d,0x%08x", eventdifftS, m->comp, m->data );
     _publishMessage( hwEventNames[HWEVENT_AWP], outputString, opLen );
 }
@@ -306,6 +1171,11 @@ void _handleDataOffsetWP( struct oswMsg *m )
 {
     assert( m->msgtype == MSG_OSW );
 
+    if ( !_filterPass( ( const struct msg * )m ) )
+    {
+        return;
+    }
+
     if ( !( options.hwOutputs & ( 1 << HWEVENT_OFS ) ) )
     {
         return;
@@ -316,6 +1186,18 @@ void _handleDataOffsetWP( struct oswMsg *m )
     uint64_t eventdifftS = m->ts - _r.lastHWExceptionTS;
 
     _r.lastHWExceptionTS = m->ts;
+
+    if ( options.binary )
+    {
+        uint8_t rec[11];
+        _put64le( rec, eventdifftS );
+        rec[8] = m->comp;
+        rec[9] = m->offset & 0xff;
+        rec[10] = ( m->offset >> 8 ) & 0xff;
+        _publishMessage( hwBinEventNames[HWEVENT_OFS], rec, sizeof( rec ) );
+        return;
+    }
+
     opLen = snprintf( outputString, MAX_STRING_LENGTH, "%" PRIu64 ",%d,0x%04x", eventdifftS, m->comp, m->offset );
     _publishMessage( hwEventNames[HWEVENT_OFS], outputString, opLen );
 }
@@ -327,51 +1209,63 @@ void _handleTS( struct TSMsg *m )
 {
     assert( m->msgtype == MSG_TS );
 
+    /* Time always accumulates and is correlated, whether or not TS records are published */
+    _r.timeStamp += m->timeInc;
+    _r.timeStatus = m->timeStatus;
+    OFLOWTimelineNote( &_r.timeline, _r.timeStamp, genericsTimestampuS() );
+
+    if ( !_filterPass( ( const struct msg * )m ) )
+    {
+        return;
+    }
+
     if ( !( options.hwOutputs & ( 1 << HWEVENT_TS ) ) )
     {
         return;
     }
 
-    assert( m->msgtype == MSG_TS );
+    if ( options.binary )
+    {
+        uint8_t rec[5];
+        rec[0] = m->timeStatus;
+        _put32le( &rec[1], m->timeInc );
+        _publishMessage( hwBinEventNames[HWEVENT_TS], rec, sizeof( rec ) );
+        return;
+    }
+
     char outputString[MAX_STRING_LENGTH];
     int opLen;
 
-    _r.timeStamp += m->timeInc;
-    _r.timeStatus = m->timeStatus;
-
     opLen = snprintf( outputString, MAX_STRING_LENGTH, "%d,%" PRIu32, m->timeStatus, m->timeInc );
     _publishMessage( hwEventNames[HWEVENT_TS], outputString, opLen );
 }
 // ====================================================================================================
-void _itmPumpProcess( char c )
+/* Handlers for each complete message received. genericMsg is just used to access */
+/* the first two members of the decoded structs in a portable way.                */
+static const msgHandler h[MSG_NUM_MSGS] =
 {
-    struct msg decoded;
-
-    typedef void ( *handlers )( void *, struct ITMDecoder * i );
+    /* MSG_UNKNOWN */         NULL,
+    /* MSG_RESERVED */        NULL,
+    /* MSG_ERROR */           NULL,
+    /* MSG_NONE */            NULL,
+    /* MSG_SOFTWARE */        ( msgHandler )_handleSW,
+    /* MSG_NISYNC */          NULL,
+    /* MSG_OSW */             ( msgHandler )_handleDataOffsetWP,
+    /* MSG_DATA_ACCESS_WP */  ( msgHandler )_handleDataAccessWP,
+    /* MSG_DATA_RWWP */       ( msgHandler )_handleDataRWWP,
+    /* MSG_PC_SAMPLE */       ( msgHandler )_handlePCSample,
+    /* MSG_DWT_EVENT */       ( msgHandler )_handleDWTEvent,
+    /* MSG_EXCEPTION */       ( msgHandler )_handleException,
+    /* MSG_TS */              ( msgHandler )_handleTS
+};
+// ====================================================================================================
+void _itmOtherEvent( enum ITMPumpEvent e, void *param )
 
-    /* Handlers for each complete message received */
-    static const handlers h[MSG_NUM_MSGS] =
-    {
-        /* MSG_UNKNOWN */         NULL,
-        /* MSG_RESERVED */        NULL,
-        /* MSG_ERROR */           NULL,
-        /* MSG_NONE */            NULL,
-        /* MSG_SOFTWARE */        ( handlers )_handleSW,
-        /* MSG_NISYNC */          NULL,
-        /* MSG_OSW */             ( handlers )_handleDataOffsetWP,
-        /* MSG_DATA_ACCESS_WP */  ( handlers )_handleDataAccessWP,
-        /* MSG_DATA_RWWP */       ( handlers )_handleDataRWWP,
-        /* MSG_PC_SAMPLE */       ( handlers )_handlePCSample,
-        /* MSG_DWT_EVENT */       ( handlers )_handleDWTEvent,
-        /* MSG_EXCEPTION */       ( handlers )_handleException,
-        /* MSG_TS */              ( handlers )_handleTS
-    };
+/* Status events from the decoder; completed packets are batched and never arrive here */
 
-    switch ( ITMPump( &_r.i, c ) )
+{
+    switch ( e )
     {
-        case ITM_EV_NONE:
-            break;
-
         case ITM_EV_UNSYNCED:
             genericsReport( V_INFO, "ITM Unsynced" EOL );
             break;
@@ -388,18 +1282,6 @@ void _itmPumpProcess( char c )
             genericsReport( V_WARN, "ITM Error" EOL );
             break;
 
-        case ITM_EV_PACKET_RXED:
-            ITMGetDecodedPacket( &_r.i, &decoded );
-
-            /* See if we decoded a dispatchable match. genericMsg is just used to access */
-            /* the first two members of the decoded structs in a portable way.           */
-            if ( h[decoded.genericMsg.msgtype] )
-            {
-                ( h[decoded.genericMsg.msgtype] )( &decoded, &_r.i );
-            }
-
-            break;
-
         default:
             break;
     }
@@ -415,15 +1297,18 @@ void _printHelp( const char *const progName )
 
 {
     genericsFPrintf( stderr, "Usage: %s [options]" EOL, progName );
+    genericsFPrintf( stderr, "    -b, --binary:     Publish hwevents as fixed-layout binary records on " HWBIN_NAME "* topics" EOL );
     genericsFPrintf( stderr, "    -c, --channel:    <Number>,<Name>,<Format> of channel to populate (repeat per channel)" EOL );
     genericsFPrintf( stderr, "    -e, --hwevent:    Comma-separated list of published hwevents" EOL );
     genericsFPrintf( stderr, "    -E, --eof:        Terminate when the file/socket ends/is closed, otherwise wait to reconnect" EOL );
     genericsFPrintf( stderr, "    -f, --input-file: <filename> Take input from specified file" EOL );
+    genericsFPrintf( stderr, "    -F, --filter:     <expr> Only publish events matching expression (e.g. 'type==exception && vector>15')" EOL );
     genericsFPrintf( stderr, "    -h, --help:       This help" EOL );
     genericsFPrintf( stderr, "    -M, --no-colour:  Supress colour in output" EOL );
     genericsFPrintf( stderr, "    -n, --itm-sync:   Enforce sync requirement for ITM (i.e. ITM needs to issue syncs)" EOL );
     genericsFPrintf( stderr, "    -p, --protocol:   Protocol to communicate. Defaults to OFLOW if -s is not set, otherwise ITM" EOL );
     genericsFPrintf( stderr, "    -s, --server:     <Server>:<Port> to use, default %s:%d" EOL, options.server, options.port );
+    genericsFPrintf( stderr, "    -S, --shed:       <topic>:nth:<N>|reservoir:<N>|latest Load shedding for a topic (repeatable)" EOL );
     genericsFPrintf( stderr, "    -t, --tag:        <stream>: Which Orbflow tag to use (normally 1)" EOL );
     genericsFPrintf( stderr, "    -v, --verbose:    <level> Verbose mode 0(errors)..3(debug)" EOL );
     genericsFPrintf( stderr, "    -V, --version:    Print version and exit" EOL );
@@ -455,35 +1340,18 @@ static int32_t _parseHWEventsArg( char *s )
 
     while ( token )
     {
-        if ( strcasecmp( token, "TS" ) == 0 )
-        {
-            result |= 1 << HWEVENT_TS;
-        }
-        else if ( strcasecmp( token, "EXCP" ) == 0 )
-        {
-            result |= 1 << HWEVENT_EXCEPTION;
-        }
-        else if ( strcasecmp( token, "PC" ) == 0 )
-        {
-            result |= 1 << HWEVENT_PCSample;
-        }
-        else if ( strcasecmp( token, "DWT" ) == 0 )
-        {
-            result |= 1 << HWEVENT_DWT;
-        }
-        else if ( strcasecmp( token, "RWWT" ) == 0 )
-        {
-            result |= 1 << HWEVENT_RWWT;
-        }
-        else if ( strcasecmp( token, "AWP" ) == 0 )
-        {
-            result |= 1 << HWEVENT_AWP;
-        }
-        else if ( strcasecmp( token, "OFS" ) == 0 )
-        {
-            result |= 1 << HWEVENT_OFS;
-        }
-        else
+        bool found = false;
+
+#define X( ev, name )                          \
+    if ( strcasecmp( token, name ) == 0 )      \
+    {                                          \
+        result |= 1 << ( ev );                 \
+        found = true;                          \
+    }
+        HW_TOPIC_LIST( X )
+#undef X
+
+        if ( !found )
         {
             genericsReport( V_ERROR, "Unrecognied hardware event '%s'" EOL, token );
             return -1;
@@ -498,11 +1366,14 @@ static int32_t _parseHWEventsArg( char *s )
 // ====================================================================================================
 static struct option _longOptions[] =
 {
+    {"shed", required_argument, NULL, 'S'},
     {"zbind", required_argument, NULL, 'z'},
+    {"binary", no_argument, NULL, 'b'},
     {"channel", required_argument, NULL, 'c'},
     {"hwevent", required_argument, NULL, 'e'},
     {"eof", no_argument, NULL, 'E'},
     {"input-file", required_argument, NULL, 'f'},
+    {"filter", required_argument, NULL, 'F'},
     {"help", no_argument, NULL, 'h'},
     {"itm-sync", no_argument, NULL, 'n'},
     {"no-colour", no_argument, NULL, 'M'},
@@ -534,7 +1405,7 @@ bool _processOptions( int argc, char *argv[] )
         options.channel[g].topic = NULL;
     }
 
-    while ( ( c = getopt_long ( argc, argv, "c:e:Ef:hnp:s:t:v:Vz:", _longOptions, &optionIndex ) ) != -1 )
+    while ( ( c = getopt_long ( argc, argv, "bc:e:EF:f:hnp:s:S:t:v:Vz:", _longOptions, &optionIndex ) ) != -1 )
     {
         switch ( c )
         {
@@ -548,6 +1419,11 @@ bool _processOptions( int argc, char *argv[] )
                 _printVersion();
                 return false;
 
+            // ------------------------------------
+            case 'b':
+                options.binary = true;
+                break;
+
             // ------------------------------------
             case 'E':
                 options.endTerminate = true;
@@ -558,6 +1434,11 @@ bool _processOptions( int argc, char *argv[] )
                 options.file = optarg;
                 break;
 
+            // ------------------------------------
+            case 'F':
+                options.filterSpec = optarg;
+                break;
+
             // ------------------------------------
             case 'M':
                 options.mono = true;
@@ -694,6 +1575,70 @@ bool _processOptions( int argc, char *argv[] )
 
                 break;
 
+            case 'S':
+            {
+                if ( options.numShed == BATCH_MAX_TOPICS )
+                {
+                    genericsReport( V_ERROR, "Too many shed policies" EOL );
+                    return false;
+                }
+
+                char *spec = strdup( optarg );
+                MEMCHECK( spec, false );
+                char *mode = strchr( spec, ':' );
+
+                if ( !mode )
+                {
+                    genericsReport( V_ERROR, "No policy in shed specification [%s]" EOL, optarg );
+                    return false;
+                }
+
+                *mode++ = 0;
+                char *param = strchr( mode, ':' );
+
+                if ( param )
+                {
+                    *param++ = 0;
+                }
+
+                struct shedSpec *sh = &options.shed[options.numShed];
+                sh->topic = spec;
+                sh->param = param ? atoi( param ) : 0;
+
+                if ( !strcasecmp( mode, "nth" ) )
+                {
+                    sh->policy = SHED_NTH;
+
+                    if ( sh->param < 2 )
+                    {
+                        genericsReport( V_ERROR, "nth shedding needs N of 2 or more" EOL );
+                        return false;
+                    }
+                }
+                else if ( !strcasecmp( mode, "reservoir" ) )
+                {
+                    sh->policy = SHED_RESERVOIR;
+
+                    if ( ( sh->param < 1 ) || ( sh->param > BATCH_MAX_EVENTS ) )
+                    {
+                        genericsReport( V_ERROR, "reservoir shedding needs N between 1 and %d" EOL, BATCH_MAX_EVENTS );
+                        return false;
+                    }
+                }
+                else if ( !strcasecmp( mode, "latest" ) )
+                {
+                    sh->policy = SHED_LATEST;
+                }
+                else
+                {
+                    genericsReport( V_ERROR, "Unrecognised shed policy [%s]" EOL, mode );
+                    return false;
+                }
+
+                options.numShed++;
+                break;
+            }
+
             case 'e':
                 hwOutputs = _parseHWEventsArg( optarg );
 
@@ -741,6 +1686,12 @@ bool _processOptions( int argc, char *argv[] )
         options.port = NWCLIENT_SERVER_PORT;
     }
 
+    if ( ( options.filterSpec ) && ( !_filterCompile( options.filterSpec ) ) )
+    {
+        genericsReport( V_ERROR, "Filter expression [%s] not understood" EOL, options.filterSpec );
+        return false;
+    }
+
     genericsReport( V_INFO, "orbzmq version " GIT_DESCRIBE EOL );
     genericsReport( V_INFO, "Server      : %s:%d" EOL, options.server, options.port );
     genericsReport( V_INFO, "ForceSync   : %s" EOL, options.forceITMSync ? "true" : "false" );
@@ -762,6 +1713,11 @@ bool _processOptions( int argc, char *argv[] )
 
     genericsReport( V_INFO, "Tag         : " EOL, options.tag );
     genericsReport( V_INFO, "ZeroMQ bind : %s" EOL, options.bindUrl );
+
+    if ( options.filterSpec )
+    {
+        genericsReport( V_INFO, "Filter      : %s" EOL, options.filterSpec );
+    }
     genericsReport( V_INFO, "Channels    :" EOL );
 
     for ( int g = 0; g < NUM_CHANNELS; g++ )
@@ -833,10 +1789,8 @@ static void _OFLOWpacketRxed ( struct OFLOWFrame *p, void *param )
     {
         if ( p->tag == options.tag )
         {
-            for ( int i = 0; i < p->len; i++ )
-            {
-                _itmPumpProcess( p->d[i] );
-            }
+            msgDecoderBatch( &_r.i, p->d, p->len, &_r.mbatch, _itmOtherEvent, NULL );
+            msgBatchDispatch( &_r.mbatch, h, &_r.i );
         }
     }
 }
@@ -846,16 +1800,33 @@ static void _feedStream( struct Stream *stream )
 {
     unsigned char cbw[TRANSFER_SIZE];
 
+    /* When the stream exports a readiness descriptor this loop owns it directly; waiting
+     * happens in zmq_poll so trace input and the ZMQ machinery share one thread, and an
+     * exit request never sits behind an open-ended blocking receive.
+     */
+    int readFd = streamGetReadFd( stream );
+
     while ( !_r.ending )
     {
         size_t receivedSize;
+
+        if ( readFd >= 0 )
+        {
+            zmq_pollitem_t item = { .socket = NULL, .fd = readFd, .events = ZMQ_POLLIN };
+
+            if ( zmq_poll( &item, 1, 100 ) <= 0 )
+            {
+                continue;
+            }
+        }
+
         enum ReceiveResult result = stream->receive( stream, cbw, TRANSFER_SIZE, NULL, &receivedSize );
 
         if ( result != RECEIVE_RESULT_OK )
         {
             if ( result == RECEIVE_RESULT_EOF && options.endTerminate )
             {
-                return;
+                break;
             }
             else if ( result == RECEIVE_RESULT_ERROR )
             {
@@ -867,22 +1838,25 @@ static void _feedStream( struct Stream *stream )
             }
         }
 
+        STATSEG_ADD( _r.stats, bytes, receivedSize );
+
         if ( PROT_OFLOW == options.protocol )
         {
             OFLOWPump( &_r.c, cbw, receivedSize, _OFLOWpacketRxed, &_r );
         }
         else
         {
-            unsigned char *c = cbw;
-
-            while ( receivedSize-- )
-            {
-                _itmPumpProcess( *c++ );
-            }
-
+            msgDecoderBatch( &_r.i, cbw, receivedSize, &_r.mbatch, _itmOtherEvent, NULL );
+            msgBatchDispatch( &_r.mbatch, h, &_r.i );
             fflush( stdout );
         }
+
+        /* Everything this read produced goes out as one batch per topic */
+        _flushAllBatches();
     }
+
+    /* Don't hold on to anything over a disconnect */
+    _flushAllBatches();
 }
 
 // ====================================================================================================
@@ -898,6 +1872,8 @@ static void _intHandler( int sig )
 
 int main( int argc, char *argv[] )
 {
+    selfprofInit( "orbzmq" );
+
     bool alreadyReported = false;
 
     if ( !_processOptions( argc, argv ) )
@@ -911,8 +1887,12 @@ int main( int argc, char *argv[] )
     _r.zmqSocket = zmq_socket( _r.zmqContext, ZMQ_PUB );
     zmq_bind( _r.zmqSocket, "tcp://*:3442" ); //options.bindUrl );
 
+    pthread_mutex_init( &_r.arenaLock, NULL );
+
     /* Reset the OFLOW handler before we start */
     OFLOWInit( &_r.c );
+    OFLOWTimelineInit( &_r.timeline );
+    _r.stats = statsegPublish( "orbzmq" );
 
     /* This ensures the signal handler gets called */
     if ( SIG_ERR == signal( SIGINT, _intHandler ) )
@@ -968,5 +1948,15 @@ int main( int argc, char *argv[] )
         }
     }
 
+    for ( uint32_t i = 0; i < _r.numBatches; i++ )
+    {
+        if ( _r.batch[i].shed )
+        {
+            genericsReport( V_INFO, "Topic %s shed %lu events" EOL, _r.batch[i].topic, ( unsigned long )_r.batch[i].shed );
+        }
+    }
+
+    statsegUnpublish( _r.stats );
+
     return 0;
 }
@@ -2,6 +2,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#if !defined(WIN32)
+    #include <unistd.h>
+    #include <sys/stat.h>
+#endif
+
 #include "generics.h"
 
 #define BLOCKSIZE    (65536)
@@ -61,6 +69,99 @@ char *readsourcefile( char *path, size_t *l )
 
 #else
 
+// ====================================================================================================
+static const char *_resolveSource( const char *path, char *scratch, size_t scratchLen )
+
+/* Map a source path to somewhere locally readable. A file that exists is used as-is. When it
+ * doesn't (typically because the build ran on another host) and ORB_SOURCE_CACHE names a
+ * directory, we look for a cached copy keyed by a hash of the path; on a miss with
+ * ORB_SOURCE_FETCH set that command is run with the path as its argument and its stdout
+ * becomes the cache entry. First display of a file pays one fetch, every later session is
+ * fully local, and nothing here ever touches a file nobody asks to see.
+ */
+
+{
+    if ( !access( path, R_OK ) )
+    {
+        return path;
+    }
+
+    const char *cache = getenv( "ORB_SOURCE_CACHE" );
+
+    if ( !cache )
+    {
+        return path;
+    }
+
+    /* FNV-1a of the path keys the cache entry; paths are unique, collisions are academic */
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for ( const char *c = path; *c; c++ )
+    {
+        h = ( h ^ ( uint8_t )*c ) * 0x100000001b3ULL;
+    }
+
+    snprintf( scratch, scratchLen, "%s/%016llx.src", cache, ( unsigned long long )h );
+
+    if ( !access( scratch, R_OK ) )
+    {
+        return scratch;
+    }
+
+    const char *fetch = getenv( "ORB_SOURCE_FETCH" );
+
+    if ( !fetch )
+    {
+        return path;
+    }
+
+    mkdir( cache, 0755 );
+
+    char commandLine[MAX_LINE_LEN];
+    snprintf( commandLine, MAX_LINE_LEN, "%s %s", fetch, path );
+    FILE *in = popen( commandLine, "r" );
+
+    if ( !in )
+    {
+        return path;
+    }
+
+    /* Land the transfer beside the entry and only rename a good one into place, so a failed
+     * or interrupted fetch never poisons the cache.
+     */
+    char tmpName[MAX_LINE_LEN + 8];
+    snprintf( tmpName, sizeof( tmpName ), "%s.tmp", scratch );
+    FILE *out = fopen( tmpName, "w" );
+
+    if ( !out )
+    {
+        pclose( in );
+        return path;
+    }
+
+    char block[BLOCKSIZE];
+    size_t got;
+    size_t total = 0;
+    bool ok = true;
+
+    while ( ( got = fread( block, 1, BLOCKSIZE, in ) ) )
+    {
+        ok &= ( fwrite( block, 1, got, out ) == got );
+        total += got;
+    }
+
+    ok &= !pclose( in );
+    ok &= !fclose( out );
+
+    if ( ( ok ) && ( total ) && ( !rename( tmpName, scratch ) ) )
+    {
+        return scratch;
+    }
+
+    unlink( tmpName );
+    return path;
+}
+// ====================================================================================================
 char *readsourcefile( char *path, size_t *l )
 
 /* Return either a malloced buffer containing the source file, or NULL if the file isn't available */
@@ -74,6 +175,10 @@ char *readsourcefile( char *path, size_t *l )
     char *retBuffer = ( char * )malloc( BLOCKSIZE );
     size_t insize = 0;
 
+    /* Swap in a cached or freshly-fetched copy if the file isn't local to this host */
+    char cachePath[MAX_LINE_LEN];
+    path = ( char * )_resolveSource( path, cachePath, MAX_LINE_LEN );
+
     if ( !prettyPrinterTested )
     {
         /* Try and grab the file via a prettyprinter. If that doesn't work, grab it via cat */
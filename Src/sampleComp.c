@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Sample Compression Module
+ * =========================
+ *
+ * PC samples taken at high rates mostly land on nearby (and frequently identical)
+ * addresses, so batches are encoded as runs; a zigzag varint delta from the previous
+ * run's address, followed by a varint repeat count. A version byte leads each batch.
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "sampleComp.h"
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Internal routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+
+static uint32_t _putVarint( uint8_t *d, uint32_t v )
+
+/* 7-bits-per-byte little endian encoding, high bit flags continuation */
+
+{
+    uint32_t len = 0;
+
+    while ( v > 0x7f )
+    {
+        d[len++] = ( v & 0x7f ) | 0x80;
+        v >>= 7;
+    }
+
+    d[len++] = v;
+    return len;
+}
+// ====================================================================================================
+static bool _getVarint( const uint8_t *d, int len, int *i, uint32_t *v )
+
+{
+    uint32_t r = 0;
+    int shift = 0;
+
+    while ( *i < len )
+    {
+        uint8_t c = d[( *i )++];
+        r |= ( uint32_t )( c & 0x7f ) << shift;
+
+        if ( !( c & 0x80 ) )
+        {
+            *v = r;
+            return true;
+        }
+
+        shift += 7;
+
+        if ( shift > 28 )
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+// ====================================================================================================
+static void _closeRun( struct sampleCompEncoder *e )
+
+/* Emit the open run into the batch as delta+count */
+
+{
+    if ( e->runCount )
+    {
+        /* Zigzag the delta so short backwards hops stay short on the wire */
+        int32_t delta = ( int32_t )( e->runAddr - e->lastAddr );
+        uint32_t zz = ( ( uint32_t )delta << 1 ) ^ ( uint32_t )( delta >> 31 );
+
+        e->len += _putVarint( &e->d[e->len], zz );
+        e->len += _putVarint( &e->d[e->len], e->runCount - 1 );
+        e->lastAddr = e->runAddr;
+        e->runCount = 0;
+    }
+}
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Externally available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+
+void SampleCompInit( struct sampleCompEncoder *e )
+
+{
+    memset( e, 0, sizeof( struct sampleCompEncoder ) );
+    e->d[e->len++] = SAMPLECOMP_VERSION;
+}
+// ====================================================================================================
+bool SampleCompAdd( struct sampleCompEncoder *e, uint32_t addr )
+
+{
+    if ( ( e->runCount ) && ( addr == e->runAddr ) )
+    {
+        e->runCount++;
+    }
+    else
+    {
+        _closeRun( e );
+        e->runAddr = addr;
+        e->runCount = 1;
+    }
+
+    e->numSamples++;
+
+    /* Room must remain for this run and one more to be closed out */
+    return e->len + 2 * SAMPLECOMP_MAX_RECORD > SAMPLECOMP_MAX_BATCH;
+}
+// ====================================================================================================
+uint32_t SampleCompFinish( struct sampleCompEncoder *e, const uint8_t **d )
+
+{
+    _closeRun( e );
+
+    if ( e->numSamples == 0 )
+    {
+        return 0;
+    }
+
+    uint32_t len = e->len;
+    *d = e->d;
+
+    /* Reset for the next batch; deltas restart from zero so batches stand alone */
+    e->lastAddr = 0;
+    e->numSamples = 0;
+    e->len = 0;
+    e->d[e->len++] = SAMPLECOMP_VERSION;
+
+    return len;
+}
+// ====================================================================================================
+bool SampleCompDecode( const uint8_t *d, int len, sampleCompCB cb, void *param )
+
+{
+    uint32_t lastAddr = 0;
+    uint32_t zz;
+    uint32_t count;
+    int i = 0;
+
+    if ( ( len < 1 ) || ( d[i++] != SAMPLECOMP_VERSION ) )
+    {
+        return false;
+    }
+
+    while ( i < len )
+    {
+        if ( ( !_getVarint( d, len, &i, &zz ) ) || ( !_getVarint( d, len, &i, &count ) ) )
+        {
+            return false;
+        }
+
+        lastAddr += ( zz >> 1 ) ^ ( uint32_t ) - ( int32_t )( zz & 1 );
+        cb( lastAddr, count + 1, param );
+    }
+
+    return true;
+}
+// ====================================================================================================
@@ -0,0 +1,276 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Self-profiling Module
+ * =====================
+ *
+ * Samples the running process with an ITIMER_PROF timer signal so consumer-side
+ * bottlenecks can be diagnosed on hosts where attaching an external profiler isn't
+ * an option. The signal lands on whichever of the tool's threads is burning CPU,
+ * giving an unbiased on-CPU profile across all of them. Samples go through a
+ * lock-free ring to an aggregation thread, and SIGUSR2 dumps the merged stacks
+ * in the collapsed format flamegraph.pl and speedscope understand.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#if defined( LINUX ) || defined( OSX )
+    #include <sys/time.h>
+    #include <execinfo.h>
+    #include <dlfcn.h>
+#endif
+
+#include "selfprof.h"
+
+#define SELFPROF_DEFAULT_HZ  (199)           /* Default sample rate; prime, to dodge periodic work */
+#define SELFPROF_MAX_DEPTH   (32)            /* Deepest stack we record */
+#define SELFPROF_SKIP_FRAMES (2)             /* Frames belonging to the signal handler itself */
+#define SELFPROF_RING_LEN    (4096)          /* Samples buffered between handler and aggregator */
+#define SELFPROF_HASH_LEN    (1024)          /* Buckets in the merged-stack table */
+
+#if defined( LINUX ) || defined( OSX )
+
+struct selfprofSample
+{
+    int depth;                               /* Number of valid frames, 0 = slot free */
+    void *frame[SELFPROF_MAX_DEPTH];         /* Return addresses, leaf first */
+};
+
+struct selfprofStack
+
+/* One unique stack with its accumulated hit count */
+
+{
+    struct selfprofStack *next;              /* Hash chain */
+    uint64_t count;                          /* Number of times this stack was sampled */
+    int depth;                               /* Number of valid frames */
+    void *frame[SELFPROF_MAX_DEPTH];         /* Return addresses, leaf first */
+};
+
+static struct
+{
+    const char *toolName;                    /* Name used in output lines and the dump filename */
+
+    struct selfprofSample *ring;             /* Handler to aggregator transfer ring */
+    atomic_uint_fast32_t wp;                 /* Ring write point (signal handler only) */
+    atomic_uint_fast32_t rp;                 /* Ring read point (aggregator only) */
+    uint64_t shed;                           /* Samples lost to a full ring */
+
+    struct selfprofStack *stack[SELFPROF_HASH_LEN]; /* Merged stacks, keyed on frame addresses */
+    volatile sig_atomic_t dumpRequest;       /* Set by SIGUSR2, actioned by the aggregator */
+    pthread_t aggregator;                    /* Thread merging samples and writing dumps */
+} _s;
+
+// ====================================================================================================
+static void _profSignal( int sig )
+
+/* SIGPROF handler; capture this thread's stack into the ring if there's room */
+
+{
+    ( void )sig;
+    uint32_t wp = atomic_load( &_s.wp );
+    uint32_t nwp = ( wp + 1 ) % SELFPROF_RING_LEN;
+
+    if ( nwp == atomic_load( &_s.rp ) )
+    {
+        /* Aggregator has fallen behind; shed the sample rather than block here */
+        _s.shed++;
+        return;
+    }
+
+    struct selfprofSample *p = &_s.ring[wp];
+    void *raw[SELFPROF_MAX_DEPTH + SELFPROF_SKIP_FRAMES];
+    int depth = backtrace( raw, SELFPROF_MAX_DEPTH + SELFPROF_SKIP_FRAMES );
+
+    p->depth = ( depth > SELFPROF_SKIP_FRAMES ) ? depth - SELFPROF_SKIP_FRAMES : 0;
+    memcpy( p->frame, &raw[SELFPROF_SKIP_FRAMES], p->depth * sizeof( void * ) );
+    atomic_store( &_s.wp, nwp );
+}
+// ====================================================================================================
+static void _dumpSignal( int sig )
+
+/* SIGUSR2 handler; just flag the request, the aggregator does the unsafe work */
+
+{
+    ( void )sig;
+    _s.dumpRequest = true;
+}
+// ====================================================================================================
+static void _mergeSample( const struct selfprofSample *p )
+
+/* Fold one sample into the merged-stack table */
+
+{
+    uintptr_t h = 0;
+
+    for ( int i = 0; i < p->depth; i++ )
+    {
+        h = ( h * 31 ) ^ ( uintptr_t )p->frame[i];
+    }
+
+    struct selfprofStack **s = &_s.stack[h % SELFPROF_HASH_LEN];
+
+    while ( *s )
+    {
+        if ( ( ( *s )->depth == p->depth ) &&
+                ( !memcmp( ( *s )->frame, p->frame, p->depth * sizeof( void * ) ) ) )
+        {
+            ( *s )->count++;
+            return;
+        }
+
+        s = &( *s )->next;
+    }
+
+    *s = ( struct selfprofStack * )calloc( 1, sizeof( struct selfprofStack ) );
+    MEMCHECKV( *s );
+    ( *s )->depth = p->depth;
+    memcpy( ( *s )->frame, p->frame, p->depth * sizeof( void * ) );
+    ( *s )->count = 1;
+}
+// ====================================================================================================
+static void _printFrame( FILE *f, void *a )
+
+/* Resolve one return address against our own image, falling back to the raw address */
+
+{
+    Dl_info d;
+
+    if ( ( dladdr( a, &d ) ) && ( d.dli_sname ) )
+    {
+        fprintf( f, "%s", d.dli_sname );
+    }
+    else
+    {
+        fprintf( f, "0x%" PRIxPTR, ( uintptr_t )a );
+    }
+}
+// ====================================================================================================
+static void _writeDump( void )
+
+/* Write the merged stacks collected so far in collapsed format, root frame first */
+
+{
+    char fn[FILENAME_MAX];
+    snprintf( fn, FILENAME_MAX, "%s.selfprof.%d.folded", _s.toolName, ( int )getpid() );
+    FILE *f = fopen( fn, "w" );
+
+    if ( !f )
+    {
+        genericsReport( V_ERROR, "Could not open self-profile output file %s" EOL, fn );
+        return;
+    }
+
+    uint64_t total = 0;
+
+    for ( int b = 0; b < SELFPROF_HASH_LEN; b++ )
+    {
+        for ( struct selfprofStack *s = _s.stack[b]; s; s = s->next )
+        {
+            fprintf( f, "%s", _s.toolName );
+
+            for ( int i = s->depth - 1; i >= 0; i-- )
+            {
+                fprintf( f, ";" );
+                _printFrame( f, s->frame[i] );
+            }
+
+            fprintf( f, " %" PRIu64 "\n", s->count );
+            total += s->count;
+        }
+    }
+
+    fclose( f );
+    genericsReport( V_INFO, "Self-profile (%" PRIu64 " samples, %" PRIu64 " shed) written to %s" EOL,
+                    total, _s.shed, fn );
+}
+// ====================================================================================================
+static void *_aggregatorTask( void *param )
+
+/* Drain the sample ring into the merged-stack table, dumping whenever we're asked to */
+
+{
+    ( void )param;
+
+    while ( true )
+    {
+        uint32_t rp = atomic_load( &_s.rp );
+
+        if ( rp != atomic_load( &_s.wp ) )
+        {
+            _mergeSample( &_s.ring[rp] );
+            atomic_store( &_s.rp, ( rp + 1 ) % SELFPROF_RING_LEN );
+            continue;
+        }
+
+        if ( _s.dumpRequest )
+        {
+            _s.dumpRequest = false;
+            _writeDump();
+        }
+
+        /* Ring is empty; signal handlers can't poke a condvar safely, so sleep-poll instead */
+        usleep( 10000 );
+    }
+
+    return NULL;
+}
+#endif
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Publicly available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+void selfprofInit( const char *toolName )
+
+{
+#if defined( LINUX ) || defined( OSX )
+    const char *e = getenv( "ORB_SELFPROF" );
+
+    if ( !e )
+    {
+        return;
+    }
+
+    int hz = atoi( e );
+
+    if ( hz <= 0 )
+    {
+        hz = SELFPROF_DEFAULT_HZ;
+    }
+
+    _s.toolName = toolName;
+    _s.ring = ( struct selfprofSample * )calloc( SELFPROF_RING_LEN, sizeof( struct selfprofSample ) );
+    MEMCHECKV( _s.ring );
+
+    if ( pthread_create( &_s.aggregator, NULL, &_aggregatorTask, NULL ) )
+    {
+        genericsExit( -1, "Failed to create self-profile aggregator thread" EOL );
+    }
+
+    struct sigaction sa = { 0 };
+    sa.sa_handler = _profSignal;
+    sa.sa_flags = SA_RESTART;
+    sigaction( SIGPROF, &sa, NULL );
+    sa.sa_handler = _dumpSignal;
+    sigaction( SIGUSR2, &sa, NULL );
+
+    struct itimerval tv = { 0 };
+    tv.it_interval.tv_usec = 1000000 / hz;
+    tv.it_value = tv.it_interval;
+    setitimer( ITIMER_PROF, &tv, NULL );
+
+    genericsReport( V_INFO, "Self-profiling %s at %dHz, SIGUSR2 dumps collapsed stacks" EOL, toolName, hz );
+#else
+    ( void )toolName;
+#endif
+}
+// ====================================================================================================
@@ -81,6 +81,8 @@ struct SIOInstance
 
     /* Current position in buffer */
     struct sioline **opText;            /* Pointer to lines of Text of the output buffer */
+    SIOLineProvider lineProvider;       /* Provider of further buffer lines on demand, or NULL */
+    void *lineProviderContext;          /* Context to hand back to the provider */
     int32_t opTextWline;                /* Next line number to be written */
     int32_t opTextRline;                /* Current read position in op buffer */
     int32_t oldopTextRline;             /* Old read position in op buffer (for redraw) */
@@ -101,6 +103,33 @@ struct SIOInstance
 
     const char *progName;
     const char *elffile;
+
+    /* Damage tracking for the output window */
+    struct siodamage
+    {
+        int32_t lineNum;                /* Buffer line rendered on this row, or NO_DISPLAY_LINE */
+        const char *text;               /* Text that was rendered there */
+        enum LineType lt;               /* Type it was rendered as */
+        int32_t line;                   /* Source line number it carried */
+        bool highlight;                 /* Whether it was rendered highlighted */
+    } *painted;                         /* What is currently on each screen row */
+    bool *overpainted;                  /* Rows which have had tag marks painted over them */
+    int32_t paintedLines;               /* Number of rows in the painted record */
+    bool paintedInvalid;                /* Set when the record no longer reflects the window */
+    enum DISP dmgDisplayMode;           /* Render state which the painted record was built under... */
+    bool dmgOutputDebug;
+    enum SRCH dmgSearchMode;
+    bool dmgSearchOK;
+    char *dmgSearchString;              /* Copy of search string at last paint */
+
+    /* Trigram index over the output buffer, so searches don't scan every line */
+    struct sidxBucket
+    {
+        uint32_t *block;                /* Blocks in which this trigram appears, ascending */
+        uint32_t count;                 /* Number of entries in use */
+        uint32_t size;                  /* Number of entries allocated */
+    } *sidx;                            /* Hash buckets, allocated on first search */
+    int32_t sidxLines;                  /* Number of buffer lines folded into the index */
 };
 
 /* Window sizes/positions */
@@ -109,6 +138,15 @@ struct SIOInstance
 #define STATUS_WINDOW_L (2)
 #define STATUS_WINDOW_W (sio->cols)
 
+/* Marker for a screen row with no buffer line on it */
+#define NO_DISPLAY_LINE (-1)
+
+/* Search index geometry */
+#define SIDX_BLOCK_SHIFT (8)                           /* Buffer lines per index block */
+#define SIDX_BLOCK_MASK  ((1<<SIDX_BLOCK_SHIFT)-1)
+#define SIDX_HASH_BITS   (17)                          /* log2 of the number of hash buckets */
+#define SIDX_BUCKETS     (1<<SIDX_HASH_BITS)
+
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
@@ -183,6 +221,7 @@ static void _outputHelp( struct SIOInstance *sio )
 
 {
     werase( sio->outputWindow );
+    sio->paintedInvalid = true;
     wattrset( sio->outputWindow, A_BOLD | COLOR_PAIR( CP_NORMAL ) );
     wprintw( sio->outputWindow, EOL "  Important Keys..." EOL EOL );
     wprintw( sio->outputWindow, "       D: Cycle through available display modes" EOL );
@@ -227,6 +266,28 @@ static bool _onDisplay( struct SIOInstance *sio, int32_t lineNum )
            );
 }
 // ====================================================================================================
+static void _ensureLines( struct SIOInstance *sio, int32_t upToLine )
+
+/* Ask the line provider, if one is registered, to materialize the buffer at least up to
+ * upToLine (-1 = everything), extending the window over it if more lines appear.
+ */
+
+{
+    if ( ( !sio->lineProvider ) || ( sio->amDiving ) ||
+            ( ( upToLine >= 0 ) && ( upToLine < sio->opTextWline ) ) )
+    {
+        return;
+    }
+
+    int32_t avail = ( sio->lineProvider )( sio->lineProviderContext, upToLine );
+
+    if ( avail > sio->opTextWline )
+    {
+        sio->opTextWline = avail;
+        SIOrequestRefresh( sio );
+    }
+}
+// ====================================================================================================
 static void _moveCursor( struct SIOInstance *sio, int lines )
 
 /* Move cursor by specified number of lines, in light of current display mode */
@@ -367,6 +428,7 @@ static enum SIOEvent _processRegularKeys( struct SIOInstance *sio )
             break;
 
         case 338: /* ---------------------------- NEXT PAGE -------------------------------------- */
+            _ensureLines( sio, sio->opTextRline + 2 * OUTPUT_WINDOW_L );
             _moveCursor( sio, OUTPUT_WINDOW_L );
             op = SIO_EV_CONSUMED;
             break;
@@ -379,6 +441,7 @@ static enum SIOEvent _processRegularKeys( struct SIOInstance *sio )
             break;
 
         case 360: /* ---------------------------- END -------------------------------------------- */
+            _ensureLines( sio, -1 );
             sio->opTextRline = sio->opTextWline - 1;
             _moveCursor( sio, -1 );
             _moveCursor( sio, 1 );
@@ -386,11 +449,13 @@ static enum SIOEvent _processRegularKeys( struct SIOInstance *sio )
             break;
 
         case 258: /* ---------------------------- DOWN ------------------------------------------- */
+            _ensureLines( sio, sio->opTextRline + OUTPUT_WINDOW_L );
             _moveCursor( sio, 1 );
             op = SIO_EV_CONSUMED;
             break;
 
         case 396: /* ---------------------------- With shift for added speeeeeed ----------------- */
+            _ensureLines( sio, sio->opTextRline + 11 * OUTPUT_WINDOW_L );
             _moveCursor( sio, 10 * OUTPUT_WINDOW_L );
             op = SIO_EV_CONSUMED;
             break;
@@ -402,11 +467,196 @@ static enum SIOEvent _processRegularKeys( struct SIOInstance *sio )
     return op;
 }
 // ====================================================================================================
+static uint32_t _sidxHash( const char *t )
+
+/* Hash three consecutive bytes into a bucket number */
+
+{
+    uint32_t v = ( ( uint32_t )( uint8_t )t[0] << 16 ) | ( ( uint32_t )( uint8_t )t[1] << 8 ) | ( uint8_t )t[2];
+    return ( v * 2654435761U ) >> ( 32 - SIDX_HASH_BITS );
+}
+// ====================================================================================================
+static void _sidxReset( struct SIOInstance *sio )
+
+/* Empty the search index, keeping its storage for re-use */
+
+{
+    if ( sio->sidx )
+    {
+        for ( uint32_t b = 0; b < SIDX_BUCKETS; b++ )
+        {
+            sio->sidx[b].count = 0;
+        }
+    }
+
+    sio->sidxLines = 0;
+}
+// ====================================================================================================
+static void _sidxAddLine( struct SIOInstance *sio, int32_t l )
+
+/* Fold the trigrams of one buffer line into the index */
+
+{
+    const char *t = ( *sio->opText )[l].buffer;
+    uint32_t blk = ( uint32_t )l >> SIDX_BLOCK_SHIFT;
+
+    if ( !t )
+    {
+        return;
+    }
+
+    for ( ; t[0] && t[1] && t[2]; t++ )
+    {
+        struct sidxBucket *k = &sio->sidx[_sidxHash( t )];
+
+        if ( ( k->count ) && ( k->block[k->count - 1] == blk ) )
+        {
+            /* This block is already listed against this trigram */
+            continue;
+        }
+
+        if ( k->count == k->size )
+        {
+            k->size = k->size ? k->size * 2 : 4;
+            k->block = ( uint32_t * )realloc( k->block, k->size * sizeof( uint32_t ) );
+            MEMCHECKV( k->block );
+        }
+
+        k->block[k->count++] = blk;
+    }
+}
+// ====================================================================================================
+static void _sidxSync( struct SIOInstance *sio )
+
+/* Bring the search index up to date with the current output buffer */
+
+{
+    if ( !sio->sidx )
+    {
+        sio->sidx = ( struct sidxBucket * )calloc( SIDX_BUCKETS, sizeof( struct sidxBucket ) );
+        MEMCHECKV( sio->sidx );
+    }
+
+    while ( sio->sidxLines < sio->opTextWline )
+    {
+        _sidxAddLine( sio, sio->sidxLines++ );
+    }
+}
+// ====================================================================================================
 static bool _updateSearch( struct SIOInstance *sio )
 
 /* Progress search to next element, or ping and return false if we can't */
 
 {
+    /* A forwards search can only be answered against the fully materialized buffer */
+    if ( sio->searchMode == SRCH_FORWARDS )
+    {
+        _ensureLines( sio, -1 );
+    }
+
+    if ( strlen( sio->searchString ) >= 3 )
+    {
+        /* Long enough to use the trigram index; candidate blocks come from the rarest trigram */
+        /* of the pattern and each candidate line is then verified directly */
+        _sidxSync( sio );
+
+        struct sidxBucket *k = NULL;
+
+        for ( const char *t = sio->searchString; t[0] && t[1] && t[2]; t++ )
+        {
+            struct sidxBucket *c = &sio->sidx[_sidxHash( t )];
+
+            if ( ( !k ) || ( c->count < k->count ) )
+            {
+                k = c;
+            }
+        }
+
+        if ( sio->searchMode == SRCH_FORWARDS )
+        {
+            uint32_t startBlk = ( uint32_t )sio->opTextRline >> SIDX_BLOCK_SHIFT;
+            uint32_t lo = 0;
+            uint32_t hi = k->count;
+
+            /* Find the first candidate block at or beyond the start point */
+            while ( lo < hi )
+            {
+                uint32_t mid = ( lo + hi ) / 2;
+
+                if ( k->block[mid] < startBlk )
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+
+            for ( ; lo < k->count; lo++ )
+            {
+                int32_t f = ( int32_t )( k->block[lo] << SIDX_BLOCK_SHIFT );
+                int32_t s = ( f > sio->opTextRline ) ? f : sio->opTextRline;
+                int32_t e = ( f + SIDX_BLOCK_MASK < sio->opTextWline - 2 ) ? f + SIDX_BLOCK_MASK : sio->opTextWline - 2;
+
+                for ( int32_t l = s; l <= e; l++ )
+                {
+                    if ( ( ( *sio->opText )[l].buffer ) && strstr( ( *sio->opText )[l].buffer, sio->searchString ) )
+                    {
+                        /* This is a match */
+                        sio->opTextRline = l;
+                        sio->searchOK = true;
+                        return true;
+                    }
+                }
+            }
+        }
+        else
+        {
+            uint32_t startBlk = ( uint32_t )sio->opTextRline >> SIDX_BLOCK_SHIFT;
+            uint32_t lo = 0;
+            uint32_t hi = k->count;
+
+            /* Find the first candidate block beyond the start point, then work downwards */
+            while ( lo < hi )
+            {
+                uint32_t mid = ( lo + hi ) / 2;
+
+                if ( k->block[mid] <= startBlk )
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+
+            while ( lo-- )
+            {
+                int32_t f = ( int32_t )( k->block[lo] << SIDX_BLOCK_SHIFT );
+                int32_t s = ( f + SIDX_BLOCK_MASK < sio->opTextRline ) ? f + SIDX_BLOCK_MASK : sio->opTextRline;
+
+                for ( int32_t l = s; ( l >= f ) && ( l > 0 ); l-- )
+                {
+                    if ( ( ( *sio->opText )[l].buffer ) && strstr( ( *sio->opText )[l].buffer, sio->searchString ) )
+                    {
+                        /* This is a match */
+                        sio->opTextRline = l;
+                        sio->searchOK = true;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        /* If we get here then we had no match */
+        SIObeep();
+        sio->searchOK = false;
+        return false;
+    }
+
+    /* Pattern too short for the index...fall back to a line-by-line scan */
     for ( int32_t l = sio->opTextRline;
             ( sio->searchMode == SRCH_FORWARDS ) ? ( l < sio->opTextWline - 1 ) : ( l > 0 );
             ( sio->searchMode == SRCH_FORWARDS ) ? l++ : l-- )
@@ -597,6 +847,48 @@ static bool _displayLine( struct SIOInstance *sio, int32_t lineNum, int32_t scre
     getyx( sio->outputWindow, y, x );
     ( void )y;
 
+    /* A line with no search highlighting, embedded colour escapes or tabs can be masked to
+     * printable ASCII in one pass and emitted as a block, rather than a cell at a time with
+     * a cursor interrogation per character */
+    if ( ( u ) && ( ( sio->searchMode == SRCH_OFF ) || ( !*sio->searchString ) ) )
+    {
+        char masked[1024];
+        const char *e = u;
+
+        while ( ( *e ) && ( *e != '\n' ) && ( *e != '\r' ) && ( *e != 27 ) && ( *e != '\t' ) )
+        {
+            e++;
+        }
+
+        int32_t l = e - u;
+
+        if ( ( ( !*e ) || ( *e == '\n' ) || ( *e == '\r' ) ) && ( l < ( int32_t )sizeof( masked ) ) )
+        {
+            int32_t avail = OUTPUT_WINDOW_W - 1 - x;
+
+            if ( avail > 0 )
+            {
+                bool clipped = ( l > avail );
+                genericsPrintable( masked, ( const uint8_t * )u, clipped ? avail : l );
+                waddnstr( sio->outputWindow, masked, clipped ? avail : l );
+                x += clipped ? avail : l;
+
+                if ( clipped )
+                {
+                    waddch( sio->outputWindow, '>' );
+                    x++;
+                }
+            }
+            else if ( ( l ) && ( x < OUTPUT_WINDOW_W ) )
+            {
+                waddch( sio->outputWindow, '>' );
+                x++;
+            }
+
+            u = NULL;
+        }
+    }
+
     while ( u && ( *u ) && ( *u != '\n' ) && ( *u != '\r' ) && ( x < OUTPUT_WINDOW_W ) )
     {
         /* Colour matches if we're in search mode, but whatever is happening, output the characters */
@@ -672,39 +964,191 @@ static bool _displayLine( struct SIOInstance *sio, int32_t lineNum, int32_t scre
     return true;
 }
 // ====================================================================================================
-static void _outputOutput( struct SIOInstance *sio )
+static void _buildDisplayMap( struct SIOInstance *sio, int32_t *map )
+
+/* Work out which buffer line lands on each screen row for the current cursor position, */
+/* mirroring the fill order the painter uses (forwards from centre, then backwards)     */
 
 {
-    werase( sio->outputWindow );
     int32_t cp, cl;
 
+    for ( cl = 0; cl < OUTPUT_WINDOW_L; cl++ )
+    {
+        map[cl] = NO_DISPLAY_LINE;
+    }
 
-    /* First, output lines _forward_ from current position */
     cp = sio->opTextRline;
     cl = ( OUTPUT_WINDOW_L / 2 );
 
-    /* Firstly go forwards filling in each line of the screen */
     while ( ( cl < OUTPUT_WINDOW_L ) && ( cp < sio->opTextWline ) )
     {
-        if ( _displayLine( sio, cp++, cl, ( cl == ( OUTPUT_WINDOW_L / 2 ) ) ) )
+        if ( ( cp < 0 ) || _onDisplay( sio, cp ) )
         {
-            cl++;
+            map[cl++] = ( cp >= 0 ) ? cp : NO_DISPLAY_LINE;
         }
+
+        cp++;
     }
 
-    /* Now go backwards doing likewise */
     cp = sio->opTextRline - 1;
     cl = ( OUTPUT_WINDOW_L / 2 ) - 1;
 
     while ( ( cl >= 0 ) && ( cp >= 0 ) )
     {
-        if ( _displayLine( sio, cp--, cl, false ) )
+        if ( _onDisplay( sio, cp ) )
         {
-            cl--;
+            map[cl--] = cp;
         }
+
+        cp--;
     }
 }
 // ====================================================================================================
+static bool _renderStateChanged( struct SIOInstance *sio )
+
+/* Check (and re-record) anything which affects how every row of the output window renders */
+
+{
+    bool changed = ( sio->dmgDisplayMode != sio->displayMode ) ||
+                   ( sio->dmgOutputDebug != sio->outputDebug ) ||
+                   ( sio->dmgSearchMode  != sio->searchMode )  ||
+                   ( sio->dmgSearchOK    != sio->searchOK )    ||
+                   ( !sio->dmgSearchString ) ||
+                   ( strcmp( sio->dmgSearchString, sio->searchString ) );
+
+    if ( changed )
+    {
+        sio->dmgDisplayMode = sio->displayMode;
+        sio->dmgOutputDebug = sio->outputDebug;
+        sio->dmgSearchMode  = sio->searchMode;
+        sio->dmgSearchOK    = sio->searchOK;
+        sio->dmgSearchString = ( char * )realloc( sio->dmgSearchString, strlen( sio->searchString ) + 1 );
+        MEMCHECK( sio->dmgSearchString, true );
+        strcpy( sio->dmgSearchString, sio->searchString );
+    }
+
+    return changed;
+}
+// ====================================================================================================
+static void _outputOutput( struct SIOInstance *sio )
+
+/* Repaint the output window, but only the rows which are damaged; cost scales with how */
+/* many lines actually changed rather than with the size of the window                  */
+
+{
+    int32_t row, sr;
+    int32_t scrollBy = 0;
+    bool full;
+
+    /* (Re)establish the painted record if the window geometry moved under us */
+    if ( sio->paintedLines != OUTPUT_WINDOW_L )
+    {
+        sio->painted = ( struct siodamage * )realloc( sio->painted, sizeof( struct siodamage ) * OUTPUT_WINDOW_L );
+        MEMCHECKV( sio->painted );
+        sio->overpainted = ( bool * )realloc( sio->overpainted, sizeof( bool ) * OUTPUT_WINDOW_L );
+        MEMCHECKV( sio->overpainted );
+        memset( sio->overpainted, 0, sizeof( bool ) * OUTPUT_WINDOW_L );
+        sio->paintedLines = OUTPUT_WINDOW_L;
+        sio->paintedInvalid = true;
+    }
+
+    int32_t map[OUTPUT_WINDOW_L];
+    _buildDisplayMap( sio, map );
+
+    full = _renderStateChanged( sio ) || sio->paintedInvalid;
+
+    if ( !full )
+    {
+        /* See if the old window contents appear in the new map, just shifted; if so it's a */
+        /* scroll, and the terminal can move those rows far cheaper than we can repaint them */
+        int32_t centre = OUTPUT_WINDOW_L / 2;
+
+        if ( map[centre] != NO_DISPLAY_LINE )
+        {
+            for ( row = 0; row < OUTPUT_WINDOW_L; row++ )
+            {
+                if ( ( sio->painted[row].lineNum == map[centre] ) &&
+                        ( sio->painted[row].text == ( *sio->opText )[map[centre]].buffer ) )
+                {
+                    scrollBy = row - centre;
+                    break;
+                }
+            }
+        }
+
+        if ( scrollBy )
+        {
+            scrollok( sio->outputWindow, true );
+            wscrl( sio->outputWindow, scrollBy );
+            scrollok( sio->outputWindow, false );
+
+            /* Slide the painted record to match what the terminal now shows, iterating away */
+            /* from the source rows so we never overwrite one before it has been copied      */
+            for ( sr = 0; sr < OUTPUT_WINDOW_L; sr++ )
+            {
+                row = ( scrollBy > 0 ) ? sr : ( OUTPUT_WINDOW_L - 1 - sr );
+                int32_t from = row + scrollBy;
+
+                if ( ( from >= 0 ) && ( from < OUTPUT_WINDOW_L ) )
+                {
+                    sio->painted[row] = sio->painted[from];
+                    sio->overpainted[row] = sio->overpainted[from];
+                }
+                else
+                {
+                    sio->painted[row].lineNum = NO_DISPLAY_LINE;
+                    sio->painted[row].text = NULL;
+                    sio->painted[row].highlight = false;
+                    sio->overpainted[row] = false;
+                }
+            }
+        }
+    }
+    else
+    {
+        werase( sio->outputWindow );
+    }
+
+    for ( row = 0; row < OUTPUT_WINDOW_L; row++ )
+    {
+        const char *text = ( map[row] != NO_DISPLAY_LINE ) ? ( *sio->opText )[map[row]].buffer : NULL;
+        enum LineType lt = ( map[row] != NO_DISPLAY_LINE ) ? ( *sio->opText )[map[row]].lt : LT_SOURCE;
+        int32_t line = ( map[row] != NO_DISPLAY_LINE ) ? ( *sio->opText )[map[row]].line : 0;
+        bool highlight = ( row == OUTPUT_WINDOW_L / 2 );
+
+        if ( ( !full ) && ( !sio->overpainted[row] ) &&
+                ( sio->painted[row].lineNum == map[row] ) &&
+                ( sio->painted[row].text == text ) &&
+                ( sio->painted[row].lt == lt ) &&
+                ( sio->painted[row].line == line ) &&
+                ( sio->painted[row].highlight == highlight ) )
+        {
+            /* Whatever is on this row is still correct */
+            continue;
+        }
+
+        if ( !full )
+        {
+            wmove( sio->outputWindow, row, 0 );
+            wclrtoeol( sio->outputWindow );
+        }
+
+        if ( map[row] != NO_DISPLAY_LINE )
+        {
+            _displayLine( sio, map[row], row, highlight );
+        }
+
+        sio->painted[row].lineNum = map[row];
+        sio->painted[row].text = text;
+        sio->painted[row].lt = lt;
+        sio->painted[row].line = line;
+        sio->painted[row].highlight = highlight;
+        sio->overpainted[row] = false;
+    }
+
+    sio->paintedInvalid = false;
+}
+// ====================================================================================================
 static void _outputStatus( struct SIOInstance *sio, uint64_t oldintervalBytes )
 
 {
@@ -795,8 +1239,15 @@ static void _outputStatus( struct SIOInstance *sio, uint64_t oldintervalBytes )
                         ( sio->tag[t] <= ( sio->opTextRline + ( OUTPUT_WINDOW_L + 1 ) / 2 ) ) )
                 {
                     /* This tag is on the visible page */
+                    int32_t tagRow = ( OUTPUT_WINDOW_L ) / 2 + sio->tag[t] - sio->opTextRline - 1;
                     wattrset( sio->outputWindow, A_BOLD | COLOR_PAIR( CP_BASELINETEXT ) );
-                    mvwprintw( sio->outputWindow, ( OUTPUT_WINDOW_L ) / 2 + sio->tag[t] - sio->opTextRline - 1, OUTPUT_WINDOW_W - 1, "%d", t );
+                    mvwprintw( sio->outputWindow, tagRow, OUTPUT_WINDOW_W - 1, "%d", t );
+
+                    /* ...and the row it sits over must be repainted once it moves away */
+                    if ( ( sio->overpainted ) && ( tagRow >= 0 ) && ( tagRow < sio->paintedLines ) )
+                    {
+                        sio->overpainted[tagRow] = true;
+                    }
                 }
             }
             else
@@ -1011,6 +1462,12 @@ void SIOrequestRefresh( struct SIOInstance *sio  )
 void SIOsetOutputBuffer( struct SIOInstance *sio, int32_t numLines, int32_t currentLine, struct sioline **opTextSet, bool amDiving )
 
 {
+    /* If the buffer has been switched or shrunk then the search index over it is void */
+    if ( ( opTextSet != sio->opText ) || ( numLines < sio->sidxLines ) )
+    {
+        _sidxReset( sio );
+    }
+
     sio->opText      = opTextSet;
 
     /* If we're starting diving store the current cursor position, on surfacing restore it */
@@ -1042,6 +1499,68 @@ void SIOsetOutputBuffer( struct SIOInstance *sio, int32_t numLines, int32_t curr
     SIOrequestRefresh( sio );
 }
 // ====================================================================================================
+void SIOextendOutputBuffer( struct SIOInstance *sio, int32_t numLines )
+
+/* More lines have become available at the end of the output buffer. If the cursor was parked
+ * on the last line then it follows the tail, otherwise it stays where the user put it.
+ */
+
+{
+    if ( ( sio->amDiving ) || ( numLines <= sio->opTextWline ) )
+    {
+        return;
+    }
+
+    if ( sio->opTextRline == sio->opTextWline - 1 )
+    {
+        sio->opTextRline = numLines - 1;
+    }
+
+    sio->opTextWline = numLines;
+    SIOrequestRefresh( sio );
+}
+// ====================================================================================================
+void SIOsetLineProvider( struct SIOInstance *sio, SIOLineProvider provider, void *context )
+
+/* Register the callback used to materialize further output buffer lines on demand */
+
+{
+    assert( sio );
+    sio->lineProvider = provider;
+    sio->lineProviderContext = context;
+}
+// ====================================================================================================
+void SIOtrimOutputBuffer( struct SIOInstance *sio, int32_t numLines )
+
+/* Tell the UI that only the first numLines lines of the output buffer remain valid */
+
+{
+    /* Only whole blocks can be kept; the first affected block gets re-indexed on the next search */
+    int32_t keep = numLines & ~SIDX_BLOCK_MASK;
+
+    if ( sio->sidxLines <= keep )
+    {
+        return;
+    }
+
+    if ( sio->sidx )
+    {
+        uint32_t keepBlk = ( uint32_t )keep >> SIDX_BLOCK_SHIFT;
+
+        for ( uint32_t b = 0; b < SIDX_BUCKETS; b++ )
+        {
+            struct sidxBucket *k = &sio->sidx[b];
+
+            while ( ( k->count ) && ( k->block[k->count - 1] >= keepBlk ) )
+            {
+                k->count--;
+            }
+        }
+    }
+
+    sio->sidxLines = keep;
+}
+// ====================================================================================================
 void SIOtagText ( struct SIOInstance *sio, const char *ttext )
 
 {
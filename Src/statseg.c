@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Shared telemetry segment
+ * ========================
+ *
+ * Implementation of the statseg publisher side. The segment is created lazily by whichever
+ * tool arrives first; slots are claimed by compare-and-swap on the pid field so concurrent
+ * startups cannot collide. Failure to obtain shared memory is deliberately non-fatal: the
+ * caller gets a process-local slot and the counters simply aren't visible externally.
+ */
+
+#include <string.h>
+
+#if !defined( WIN32 )
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "generics.h"
+#include "statseg.h"
+
+static struct statSeg *_seg;                 /* Mapped segment, if we managed to get one */
+static struct statSlot _localSlot;           /* Fallback when shared memory is unavailable */
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Internal routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+#if !defined( WIN32 )
+static struct statSeg *_mapSegment( void )
+
+{
+    int fd = shm_open( STATSEG_NAME, O_CREAT | O_RDWR, 0666 );
+
+    if ( fd < 0 )
+    {
+        genericsReport( V_INFO, "Couldn't open stats segment %s" EOL, STATSEG_NAME );
+        return NULL;
+    }
+
+    if ( ftruncate( fd, sizeof( struct statSeg ) ) < 0 )
+    {
+        genericsReport( V_INFO, "Couldn't size stats segment" EOL );
+        close( fd );
+        return NULL;
+    }
+
+    struct statSeg *seg = mmap( NULL, sizeof( struct statSeg ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+
+    if ( seg == MAP_FAILED )
+    {
+        genericsReport( V_INFO, "Couldn't map stats segment" EOL );
+        return NULL;
+    }
+
+    /* First one in stamps the header; losers of the race just check what's there */
+    uint32_t expected = 0;
+
+    if ( atomic_compare_exchange_strong( &seg->magic, &expected, STATSEG_MAGIC ) )
+    {
+        seg->version = STATSEG_VERSION;
+    }
+    else if ( ( expected != STATSEG_MAGIC ) || ( seg->version != STATSEG_VERSION ) )
+    {
+        genericsReport( V_WARN, "Stats segment %s has unexpected layout, not publishing to it" EOL, STATSEG_NAME );
+        munmap( seg, sizeof( struct statSeg ) );
+        return NULL;
+    }
+
+    return seg;
+}
+#endif
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Publicly available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+struct statSlot *statsegPublish( const char *name )
+
+{
+#if !defined( WIN32 )
+
+    if ( !_seg )
+    {
+        _seg = _mapSegment();
+    }
+
+    if ( _seg )
+    {
+        uint32_t me = ( uint32_t )getpid();
+
+        for ( int i = 0; i < STATSEG_MAX_TOOLS; i++ )
+        {
+            struct statSlot *s = &_seg->slot[i];
+            uint32_t expected = 0;
+
+            if ( atomic_compare_exchange_strong( &s->pid, &expected, me ) )
+            {
+                memset( s->name, 0, STATSEG_NAME_LEN );
+                strncpy( s->name, name, STATSEG_NAME_LEN - 1 );
+                STATSEG_SET( s, bytes, 0 );
+                STATSEG_SET( s, events, 0 );
+                STATSEG_SET( s, drops, 0 );
+                STATSEG_SET( s, queueDepth, 0 );
+                return s;
+            }
+        }
+
+        genericsReport( V_INFO, "No free slot in stats segment" EOL );
+    }
+
+#endif
+    /* Shared memory didn't work out (or this is Windows); count locally instead */
+    memset( &_localSlot, 0, sizeof( _localSlot ) );
+    strncpy( _localSlot.name, name, STATSEG_NAME_LEN - 1 );
+    return &_localSlot;
+}
+// ====================================================================================================
+void statsegUnpublish( struct statSlot *s )
+
+{
+    if ( ( !s ) || ( s == &_localSlot ) )
+    {
+        return;
+    }
+
+    STATSEG_SET( s, pid, 0 );
+}
+// ====================================================================================================
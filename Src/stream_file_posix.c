@@ -46,6 +46,12 @@ static enum ReceiveResult _posixFileStreamReceive( struct Stream *stream, void *
     return RECEIVE_RESULT_OK;
 }
 
+// ====================================================================================================
+static int _posixFileStreamGetReadFd( struct Stream *stream )
+{
+    return SELF( stream )->file;
+}
+
 // ====================================================================================================
 static void _posixFileStreamClose( struct Stream *stream )
 {
@@ -82,23 +88,61 @@ static int _posixFileStreamCreate( const char *file )
 
 struct Stream *streamCreateFile( const char *file )
 {
+    int f = _posixFileStreamCreate( file );
+
+    if ( f == -1 )
+    {
+        return NULL;
+    }
+
+    /* Compressed captures are handled transparently; sniff for the zstd magic */
+    uint8_t magic[4];
+    bool isZstd = ( ( read( f, magic, 4 ) == 4 ) &&
+                    ( magic[0] == 0x28 ) && ( magic[1] == 0xb5 ) &&
+                    ( magic[2] == 0x2f ) && ( magic[3] == 0xfd ) );
+    lseek( f, 0, SEEK_SET );
+
+    if ( isZstd )
+    {
+#if defined( WITH_ZSTD )
+        return streamCreateZstdFile( f );
+#else
+        genericsExit( -4, "File %s is zstd compressed, but this build has no zstd support" EOL, file );
+#endif
+    }
+
     struct PosixFileStream *stream = SELF( calloc( 1, sizeof( struct PosixFileStream ) ) );
 
     if ( stream == NULL )
     {
+        close( f );
         return NULL;
     }
 
     stream->base.receive = _posixFileStreamReceive;
     stream->base.close = _posixFileStreamClose;
-    stream->file = _posixFileStreamCreate( file );
+    stream->base.getReadFd = _posixFileStreamGetReadFd;
+    stream->file = f;
+
+    return &stream->base;
+}
 
-    if ( stream->file == -1 )
+// ====================================================================================================
+struct Stream *streamCreateFdFile( int fileDescriptor )
+
+{
+    struct PosixFileStream *stream = SELF( calloc( 1, sizeof( struct PosixFileStream ) ) );
+
+    if ( stream == NULL )
     {
-        free( stream );
         return NULL;
     }
 
+    stream->base.receive = _posixFileStreamReceive;
+    stream->base.close = _posixFileStreamClose;
+    stream->base.getReadFd = _posixFileStreamGetReadFd;
+    stream->file = fileDescriptor;
+
     return &stream->base;
 }
 #pragma GCC diagnostic pop
@@ -7,15 +7,47 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <poll.h>
+#ifdef LINUX
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <signal.h>
+    #include <time.h>
+    #include <stdatomic.h>
+    #include <pthread.h>
+#endif
 
 #include "generics.h"
+#ifdef LINUX
+    #include "shmring.h"
+#endif
 
 /* How long to wait for a connection before declaring failure */
 #define CONNECT_WAIT_TIME_MS (2000)
 
+/* Limits for the exponential backoff between failed connection attempts */
+#define BACKOFF_MIN_MS (10)
+#define BACKOFF_MAX_MS (1000)
+
+#define CACHED_SERVER_LEN (256)
+
+/* The client tools call streamCreateSocket() from a tight retry loop, so connection state
+ * is remembered between calls here. The cached resolution means a down server doesn't cost
+ * a DNS round trip on every attempt, and calls inside the backoff window return immediately
+ * rather than re-probing the network each time. */
+static struct
+{
+    char server[CACHED_SERVER_LEN];      /* Server the cached state refers to */
+    int port;                            /* ...and the port */
+    struct sockaddr_in addr;             /* Resolved address for the server */
+    bool addrValid;                      /* Flag indicating resolution is usable */
+    uint32_t backoffMs;                  /* Current length of the backoff window */
+    uint32_t retryAfter;                 /* Time before which we don't try again */
+} _conn;
+
 struct PosixSocketStream
 {
     struct Stream base;
@@ -24,6 +56,16 @@ struct PosixSocketStream
 
 #define SELF(stream) ((struct PosixSocketStream*)(stream))
 
+#ifdef LINUX
+struct PosixShmStream
+{
+    struct Stream base;
+    struct shmRing *r;           /* The mapped segment published by the daemon */
+    size_t maplen;               /* Length of the mapping, for munmap */
+    uint64_t rp;                 /* Our private read cursor into the ring */
+};
+#endif
+
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
@@ -67,6 +109,12 @@ static enum ReceiveResult _posixSocketStreamReceive( struct Stream *stream, void
     return RECEIVE_RESULT_OK;
 }
 
+// ====================================================================================================
+static int _posixSocketStreamGetReadFd( struct Stream *stream )
+{
+    return SELF( stream )->socket;
+}
+
 // ====================================================================================================
 static void _posixSocketStreamClose( struct Stream *stream )
 {
@@ -75,57 +123,134 @@ static void _posixSocketStreamClose( struct Stream *stream )
 }
 
 // ====================================================================================================
-static int _posixSocketStreamCreate( const char *server, int port )
+static bool _resolveServer( const char *server, int port, struct sockaddr_in *addr )
+
+/* Fill in addr for server, hitting DNS only when the name isn't a plain dotted quad */
+
 {
-    int sockfd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
-    int flag = 1;
-    struct sockaddr_in serv_addr;
-    struct hostent *serverEnt = gethostbyname( server );
+    memset( addr, 0, sizeof( struct sockaddr_in ) );
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons( port );
 
-    if ( !serverEnt )
+    if ( 1 == inet_pton( AF_INET, server, &addr->sin_addr ) )
+    {
+        return true;
+    }
+
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+
+    if ( ( 0 != getaddrinfo( server, NULL, &hints, &res ) ) || ( !res ) )
+    {
+        return false;
+    }
+
+    addr->sin_addr = ( ( struct sockaddr_in * )res->ai_addr )->sin_addr;
+    freeaddrinfo( res );
+    return true;
+}
+
+// ====================================================================================================
+static void _enableKeepalive( int sockfd )
+
+/* Arrange for a peer that vanishes without a FIN (e.g. a power-cycled probe host) to be
+ * noticed by the receive path rather than the connection idling forever.
+ */
+
+{
+    int v = 1;
+    setsockopt( sockfd, SOL_SOCKET, SO_KEEPALIVE, ( const void * )&v, sizeof( v ) );
+
+#ifdef TCP_KEEPIDLE
+    v = 5;
+    setsockopt( sockfd, IPPROTO_TCP, TCP_KEEPIDLE, ( const void * )&v, sizeof( v ) );
+    v = 1;
+    setsockopt( sockfd, IPPROTO_TCP, TCP_KEEPINTVL, ( const void * )&v, sizeof( v ) );
+    v = 3;
+    setsockopt( sockfd, IPPROTO_TCP, TCP_KEEPCNT, ( const void * )&v, sizeof( v ) );
+#elif defined( TCP_KEEPALIVE )
+    v = 5;
+    setsockopt( sockfd, IPPROTO_TCP, TCP_KEEPALIVE, ( const void * )&v, sizeof( v ) );
+#endif
+}
+
+// ====================================================================================================
+static int _connectionFailed( int sockfd )
+
+/* Record a failed attempt; widen the backoff window and force re-resolution next time */
+
+{
+    if ( sockfd >= 0 )
     {
         close( sockfd );
-        genericsReport( V_ERROR, "Cannot find host" EOL );
-        return -1;
     }
 
-    setsockopt( sockfd, SOL_SOCKET, SO_REUSEPORT, ( const void * )&flag, sizeof( flag ) );
+    _conn.addrValid = false;
+    _conn.retryAfter = genericsTimestampmS() + _conn.backoffMs;
+    _conn.backoffMs = ( _conn.backoffMs * 2 > BACKOFF_MAX_MS ) ? BACKOFF_MAX_MS : _conn.backoffMs * 2;
+    return -1;
+}
 
-    if ( sockfd < 0 )
+// ====================================================================================================
+static int _posixSocketStreamCreate( const char *server, int port )
+{
+    int flag = 1;
+    uint32_t now = genericsTimestampmS();
+
+    /* Forget cached state if the target has changed */
+    if ( ( 0 != strncmp( _conn.server, server, CACHED_SERVER_LEN - 1 ) ) || ( _conn.port != port ) )
+    {
+        memset( _conn.server, 0, CACHED_SERVER_LEN );
+        strncpy( _conn.server, server, CACHED_SERVER_LEN - 1 );
+        _conn.port = port;
+        _conn.addrValid = false;
+        _conn.backoffMs = BACKOFF_MIN_MS;
+        _conn.retryAfter = now;
+    }
+
+    /* Inside the backoff window from a previous failure there's nothing useful to do */
+    if ( ( int32_t )( now - _conn.retryAfter ) < 0 )
     {
-        genericsReport( V_ERROR, "Error creating socket" EOL );
         return -1;
     }
 
+    if ( !_conn.addrValid )
+    {
+        if ( !_resolveServer( server, port, &_conn.addr ) )
+        {
+            genericsReport( V_ERROR, "Cannot find host" EOL );
+            return _connectionFailed( -1 );
+        }
 
-    /* Now open the network connection */
-    memset( &serv_addr, 0, sizeof( serv_addr ) );
+        _conn.addrValid = true;
+    }
 
-    serv_addr.sin_family = AF_INET;
+    int sockfd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
 
-    memcpy( &serv_addr.sin_addr.s_addr, serverEnt->h_addr, serverEnt->h_length );
+    if ( sockfd < 0 )
+    {
+        genericsReport( V_ERROR, "Error creating socket" EOL );
+        return -1;
+    }
 
-    serv_addr.sin_port = htons( port );
+    setsockopt( sockfd, SOL_SOCKET, SO_REUSEPORT, ( const void * )&flag, sizeof( flag ) );
 
     /* Make sure we don't wait too long before failing the call */
     int sockfd_flags_before = fcntl( sockfd, F_GETFL, 0 );
 
     fcntl( sockfd, F_SETFL, sockfd_flags_before | O_NONBLOCK );
 
-    connect( sockfd, ( struct sockaddr * )&serv_addr, sizeof( serv_addr ) );
-
-    if ( ( errno != EWOULDBLOCK ) && ( errno != EINPROGRESS ) )
+    if ( ( connect( sockfd, ( struct sockaddr * )&_conn.addr, sizeof( struct sockaddr_in ) ) < 0 ) &&
+            ( errno != EWOULDBLOCK ) && ( errno != EINPROGRESS ) )
     {
-        close( sockfd );
-        return -1;
+        return _connectionFailed( sockfd );
     }
 
     struct pollfd pfds[] = { { .fd = sockfd, .events = POLLOUT } };
 
     if ( 0 == poll( pfds, 1, CONNECT_WAIT_TIME_MS ) )
     {
-        close( sockfd );
-        return -1;
+        return _connectionFailed( sockfd );
     }
 
     socklen_t error;
@@ -133,7 +258,7 @@ static int _posixSocketStreamCreate( const char *server, int port )
 
     if ( 0 != getsockopt( sockfd, SOL_SOCKET, SO_ERROR, &error, &len ) )
     {
-        flag = -1;
+        error = 1;
     }
 
     fcntl( sockfd, F_SETFL, sockfd_flags_before );
@@ -141,13 +266,218 @@ static int _posixSocketStreamCreate( const char *server, int port )
     /* If we got an error give up */
     if ( 0 != error )
     {
-        close( sockfd );
-        return -1;
+        return _connectionFailed( sockfd );
     }
 
+    /* We're connected; forget the backoff and watch for the peer silently going away */
+    _conn.backoffMs = BACKOFF_MIN_MS;
+    _conn.retryAfter = now;
+    _enableKeepalive( sockfd );
+
     return sockfd;
 }
 
+#ifdef LINUX
+// ====================================================================================================
+static bool _shmPublisherGone( struct shmRing *r )
+
+/* Check if the daemon which published this segment has withdrawn it or exited */
+
+{
+    return ( r->magic != SHMRING_MAGIC ) || ( ( kill( r->pid, 0 ) < 0 ) && ( ESRCH == errno ) );
+}
+
+// ====================================================================================================
+static enum ReceiveResult _posixShmStreamReceive( struct Stream *stream, void *buffer, size_t bufferSize,
+        struct timeval *timeout, size_t *receivedSize )
+{
+    struct PosixShmStream *self = ( struct PosixShmStream * )stream;
+    struct shmRing *r = self->r;
+    struct timespec ts;
+
+    *receivedSize = 0;
+
+    uint64_t wp = atomic_load( &r->wp );
+
+    if ( wp == self->rp )
+    {
+        /* Nothing waiting...sleep until the publisher kicks us. An open-ended wait is
+         * taken in bounded steps so a vanished publisher still gets noticed. */
+        int64_t leftUs = timeout ? ( ( int64_t )timeout->tv_sec * 1000000 + timeout->tv_usec ) : -1;
+
+        if ( EOWNERDEAD == pthread_mutex_lock( &r->lock ) )
+        {
+            pthread_mutex_consistent( &r->lock );
+        }
+
+        while ( ( wp = atomic_load( &r->wp ) ) == self->rp )
+        {
+            int64_t step = ( ( leftUs < 0 ) || ( leftUs > 1000000 ) ) ? 1000000 : leftUs;
+
+            clock_gettime( CLOCK_MONOTONIC, &ts );
+            ts.tv_sec  += step / 1000000;
+            ts.tv_nsec += ( step % 1000000 ) * 1000;
+
+            if ( ts.tv_nsec >= 1000000000 )
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+
+            int res = pthread_cond_timedwait( &r->dataAvailable, &r->lock, &ts );
+
+            if ( EOWNERDEAD == res )
+            {
+                pthread_mutex_consistent( &r->lock );
+            }
+            else if ( ETIMEDOUT == res )
+            {
+                if ( leftUs >= 0 )
+                {
+                    leftUs -= step;
+
+                    if ( leftUs <= 0 )
+                    {
+                        break;
+                    }
+                }
+
+                if ( _shmPublisherGone( r ) )
+                {
+                    break;
+                }
+            }
+        }
+
+        pthread_mutex_unlock( &r->lock );
+
+        if ( wp == self->rp )
+        {
+            return _shmPublisherGone( r ) ? RECEIVE_RESULT_EOF : RECEIVE_RESULT_TIMEOUT;
+        }
+    }
+
+    if ( wp - self->rp > r->ringSize )
+    {
+        /* We fell a whole ring behind the publisher; jump to the live edge and let the
+         * protocol layers resynchronise. */
+        genericsReport( V_WARN, "Shared memory reader overran" EOL );
+        self->rp = wp;
+        return RECEIVE_RESULT_TIMEOUT;
+    }
+
+    uint64_t t = wp - self->rp;
+
+    if ( t > bufferSize )
+    {
+        t = bufferSize;
+    }
+
+    uint32_t ri = self->rp & ( r->ringSize - 1 );
+
+    if ( ri + t > r->ringSize )
+    {
+        uint32_t firstSpan = r->ringSize - ri;
+        memcpy( buffer, &r->d[ri], firstSpan );
+        memcpy( ( uint8_t * )buffer + firstSpan, r->d, t - firstSpan );
+    }
+    else
+    {
+        memcpy( buffer, &r->d[ri], t );
+    }
+
+    /* If the publisher lapped us while we were copying then what we got may be torn */
+    if ( atomic_load( &r->wp ) - self->rp > r->ringSize )
+    {
+        genericsReport( V_WARN, "Shared memory reader overran" EOL );
+        self->rp = atomic_load( &r->wp );
+        return RECEIVE_RESULT_TIMEOUT;
+    }
+
+    self->rp += t;
+    *receivedSize = t;
+    return RECEIVE_RESULT_OK;
+}
+
+// ====================================================================================================
+static void _posixShmStreamClose( struct Stream *stream )
+{
+    struct PosixShmStream *self = ( struct PosixShmStream * )stream;
+    munmap( self->r, self->maplen );
+}
+
+// ====================================================================================================
+static struct Stream *_posixShmStreamAttach( const char *server, int port )
+
+/* See if the server we've been asked for is a local daemon advertising shared memory,
+ * and ride that instead of loopback TCP if so.
+ */
+
+{
+    char name[SHMRING_NAME_MAX_LEN];
+    struct stat st;
+
+    if ( strcmp( server, "localhost" ) && strcmp( server, "127.0.0.1" ) )
+    {
+        return NULL;
+    }
+
+    snprintf( name, sizeof( name ), SHMRING_NAME_FORMAT, port );
+
+    int fd = shm_open( name, O_RDWR, 0 );
+
+    if ( fd < 0 )
+    {
+        return NULL;
+    }
+
+    if ( ( fstat( fd, &st ) < 0 ) || ( ( size_t )st.st_size < sizeof( struct shmRing ) ) )
+    {
+        close( fd );
+        return NULL;
+    }
+
+    struct shmRing *r = ( struct shmRing * )mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+
+    if ( MAP_FAILED == r )
+    {
+        return NULL;
+    }
+
+    /* Make sure this is a live segment with a layout we understand */
+    if ( ( r->magic != SHMRING_MAGIC ) || ( r->version != SHMRING_VERSION ) ||
+            ( !r->ringSize ) || ( r->ringSize & ( r->ringSize - 1 ) ) ||
+            ( ( size_t )st.st_size < sizeof( struct shmRing ) + r->ringSize ) ||
+            ( ( kill( r->pid, 0 ) < 0 ) && ( ESRCH == errno ) ) )
+    {
+        munmap( r, st.st_size );
+        return NULL;
+    }
+
+    struct PosixShmStream *stream = ( struct PosixShmStream * )calloc( 1, sizeof( struct PosixShmStream ) );
+
+    if ( NULL == stream )
+    {
+        munmap( r, st.st_size );
+        return NULL;
+    }
+
+    stream->base.receive = _posixShmStreamReceive;
+    stream->base.close   = _posixShmStreamClose;
+    /* No getReadFd; wakeup here is a condvar in the segment, there's no descriptor to poll */
+    stream->r = r;
+    stream->maplen = st.st_size;
+
+    /* Start from the live edge...no history over this transport either */
+    stream->rp = atomic_load( &r->wp );
+
+    genericsReport( V_INFO, "Connected to %s over shared memory" EOL, name );
+
+    return &stream->base;
+}
+#endif
+
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
@@ -164,6 +494,17 @@ static int _posixSocketStreamCreate( const char *server, int port )
 
 struct Stream *streamCreateSocket( const char *server, int port )
 {
+#ifdef LINUX
+    /* A daemon on this host may be offering the port over shared memory too, which is
+     * considerably cheaper than the loopback network stack at high trace rates. */
+    struct Stream *shmStream = _posixShmStreamAttach( server, port );
+
+    if ( shmStream )
+    {
+        return shmStream;
+    }
+
+#endif
     struct PosixSocketStream *stream = SELF( calloc( 1, sizeof( struct PosixSocketStream ) ) );
 
     if ( stream == NULL )
@@ -173,6 +514,7 @@ struct Stream *streamCreateSocket( const char *server, int port )
 
     stream->base.receive = _posixSocketStreamReceive;
     stream->base.close = _posixSocketStreamClose;
+    stream->base.getReadFd = _posixSocketStreamGetReadFd;
     stream->socket = _posixSocketStreamCreate( server, port );
 
     if ( stream->socket == -1 )
@@ -181,6 +523,17 @@ struct Stream *streamCreateSocket( const char *server, int port )
         return NULL;
     }
 
+#ifdef LINUX
+    /* Prefer an io_uring receive path over the connected socket when the kernel offers one */
+    struct Stream *uringStream = streamUringCreateSocket( stream->socket );
+
+    if ( uringStream )
+    {
+        free( stream );
+        return uringStream;
+    }
+
+#endif
     return &stream->base;
 }
 #pragma GCC diagnostic pop
@@ -0,0 +1,409 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * io_uring Stream Backend
+ * =======================
+ *
+ * Linux-only receive path over an io_uring with a provided-buffer ring and a
+ * multi-shot receive. The kernel delivers completions into buffers it picks
+ * from the ring without a submission per block, so the steady-state cost of a
+ * receive is a lock-free completion-queue reap with no syscall at all; the
+ * ring only enters the kernel when the queue is empty and it has to wait.
+ * Falls back (by returning NULL at create time) wherever io_uring is missing
+ * or forbidden, in which case the caller keeps its classic POSIX path.
+ */
+
+#include "stream.h"
+
+#if defined( LINUX )
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+#include "generics.h"
+
+/* Number of kernel-filled receive buffers; must be a power of two */
+#define URING_NUM_BUFS   (16)
+
+/* Size of each receive buffer */
+#define URING_BUF_SIZE   (65536)
+
+/* Submission queue depth; only the multi-shot arm ever occupies it */
+#define URING_SQ_DEPTH   (8)
+
+/* Buffer group id used for the provided-buffer ring */
+#define URING_BUF_GROUP  (0)
+
+struct UringStream
+{
+    struct Stream base;
+    int sock;                            /* Socket being received from */
+    int ring;                            /* The io_uring itself */
+
+    /* Submission side mappings */
+    uint8_t *sqMap;                      /* SQ ring mapping */
+    size_t sqMapLen;
+    struct io_uring_sqe *sqes;           /* SQE array mapping */
+    size_t sqesLen;
+    unsigned int *sqTail;                /* Ring pointers within the mappings */
+    unsigned int *sqMask;
+    unsigned int *sqArray;
+
+    /* Completion side mappings */
+    uint8_t *cqMap;                      /* CQ ring mapping */
+    size_t cqMapLen;
+    unsigned int *cqHead;
+    unsigned int *cqTail;
+    unsigned int *cqMask;
+    struct io_uring_cqe *cqes;
+
+    /* Provided buffer ring and the memory behind it */
+    struct io_uring_buf_ring *bufRing;
+    size_t bufRingLen;
+    uint8_t *bufs;                       /* URING_NUM_BUFS contiguous receive buffers */
+    unsigned short bufTail;              /* Local shadow of the buffer ring tail */
+
+    bool armed;                          /* A multi-shot receive is outstanding */
+
+    /* Completion not yet fully drained into the caller */
+    int pendingBid;                      /* Buffer holding the residue, or -1 */
+    size_t pendingOff;                   /* How far through it the caller has read */
+    size_t pendingLen;                   /* Total valid bytes in it */
+};
+
+#define SELF(stream) ((struct UringStream*)(stream))
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Private routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+static int _uringSetup( unsigned int entries, struct io_uring_params *p )
+{
+    return syscall( __NR_io_uring_setup, entries, p );
+}
+// ====================================================================================================
+static int _uringEnter( int ring, unsigned int toSubmit, unsigned int minComplete, unsigned int flags,
+                        void *arg, size_t argsz )
+{
+    return syscall( __NR_io_uring_enter, ring, toSubmit, minComplete, flags, arg, argsz );
+}
+// ====================================================================================================
+static int _uringRegister( int ring, unsigned int op, void *arg, unsigned int nrArgs )
+{
+    return syscall( __NR_io_uring_register, ring, op, arg, nrArgs );
+}
+// ====================================================================================================
+static void _recycleBuffer( struct UringStream *self, int bid )
+
+/* Hand a drained buffer back to the kernel's provided-buffer ring */
+
+{
+    struct io_uring_buf *slot = &self->bufRing->bufs[self->bufTail & ( URING_NUM_BUFS - 1 )];
+
+    slot->addr = ( uint64_t )( uintptr_t )&self->bufs[bid * URING_BUF_SIZE];
+    slot->len  = URING_BUF_SIZE;
+    slot->bid  = bid;
+    self->bufTail++;
+    __atomic_store_n( &self->bufRing->tail, self->bufTail, __ATOMIC_RELEASE );
+}
+// ====================================================================================================
+static bool _armReceive( struct UringStream *self )
+
+/* Queue the multi-shot receive; it keeps completing until cancelled or out of buffers */
+
+{
+    unsigned int tail = *self->sqTail;
+    unsigned int idx = tail & *self->sqMask;
+    struct io_uring_sqe *sqe = &self->sqes[idx];
+
+    memset( sqe, 0, sizeof( struct io_uring_sqe ) );
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = self->sock;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->buf_group = URING_BUF_GROUP;
+
+    self->sqArray[idx] = idx;
+    __atomic_store_n( self->sqTail, tail + 1, __ATOMIC_RELEASE );
+
+    if ( _uringEnter( self->ring, 1, 0, 0, NULL, 0 ) < 0 )
+    {
+        return false;
+    }
+
+    self->armed = true;
+    return true;
+}
+// ====================================================================================================
+static enum ReceiveResult _drainPending( struct UringStream *self, void *buffer, size_t bufferSize,
+        size_t *receivedSize )
+
+/* Copy as much held completion data as the caller has room for, recycling the buffer once empty */
+
+{
+    size_t n = self->pendingLen - self->pendingOff;
+
+    if ( n > bufferSize )
+    {
+        n = bufferSize;
+    }
+
+    memcpy( buffer, &self->bufs[self->pendingBid * URING_BUF_SIZE + self->pendingOff], n );
+    self->pendingOff += n;
+
+    if ( self->pendingOff == self->pendingLen )
+    {
+        _recycleBuffer( self, self->pendingBid );
+        self->pendingBid = -1;
+    }
+
+    *receivedSize = n;
+    return RECEIVE_RESULT_OK;
+}
+// ====================================================================================================
+static enum ReceiveResult _uringStreamReceive( struct Stream *stream, void *buffer, size_t bufferSize,
+        struct timeval *timeout, size_t *receivedSize )
+{
+    struct UringStream *self = SELF( stream );
+
+    *receivedSize = 0;
+
+    /* Residue from an earlier completion goes out first */
+    if ( self->pendingBid >= 0 )
+    {
+        return _drainPending( self, buffer, bufferSize, receivedSize );
+    }
+
+    for ( ;; )
+    {
+        unsigned int head = *self->cqHead;
+
+        if ( head != __atomic_load_n( self->cqTail, __ATOMIC_ACQUIRE ) )
+        {
+            /* A completion is already waiting; no syscall needed on this path */
+            struct io_uring_cqe *cqe = &self->cqes[head & *self->cqMask];
+            int res = cqe->res;
+            unsigned int flags = cqe->flags;
+            __atomic_store_n( self->cqHead, head + 1, __ATOMIC_RELEASE );
+
+            if ( !( flags & IORING_CQE_F_MORE ) )
+            {
+                /* The multi-shot terminated with this completion; re-arm before the next wait */
+                self->armed = false;
+            }
+
+            if ( res == 0 )
+            {
+                return RECEIVE_RESULT_EOF;
+            }
+
+            if ( res == -ENOBUFS )
+            {
+                /* Ran dry while the caller held buffers; they're recycled now, so go again */
+                continue;
+            }
+
+            if ( res < 0 )
+            {
+                return RECEIVE_RESULT_ERROR;
+            }
+
+            self->pendingBid = ( flags >> IORING_CQE_BUFFER_SHIFT );
+            self->pendingOff = 0;
+            self->pendingLen = res;
+            return _drainPending( self, buffer, bufferSize, receivedSize );
+        }
+
+        if ( ( !self->armed ) && ( !_armReceive( self ) ) )
+        {
+            return RECEIVE_RESULT_ERROR;
+        }
+
+        /* Nothing queued; wait in the kernel for a completion or the caller's timeout */
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset( &arg, 0, sizeof( arg ) );
+
+        if ( timeout )
+        {
+            ts.tv_sec  = timeout->tv_sec;
+            ts.tv_nsec = timeout->tv_usec * 1000LL;
+            arg.ts = ( uint64_t )( uintptr_t )&ts;
+        }
+
+        int r = _uringEnter( self->ring, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                             &arg, sizeof( arg ) );
+
+        if ( ( r < 0 ) && ( errno == ETIME ) )
+        {
+            return RECEIVE_RESULT_TIMEOUT;
+        }
+
+        if ( ( r < 0 ) && ( errno != EINTR ) )
+        {
+            return RECEIVE_RESULT_ERROR;
+        }
+    }
+}
+// ====================================================================================================
+static void _uringStreamClose( struct Stream *stream )
+{
+    struct UringStream *self = SELF( stream );
+
+    munmap( self->bufRing, self->bufRingLen );
+    free( self->bufs );
+    munmap( self->sqes, self->sqesLen );
+    munmap( self->sqMap, self->sqMapLen );
+    munmap( self->cqMap, self->cqMapLen );
+    close( self->ring );
+    close( self->sock );
+}
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Publicly available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+struct Stream *streamUringCreateSocket( int socket )
+
+/* Wrap a connected socket in an io_uring receive path, or return NULL if the kernel
+ * can't provide one, in which case the caller should fall back to its POSIX path.
+ */
+
+{
+    struct io_uring_params p;
+    memset( &p, 0, sizeof( p ) );
+
+    int ring = _uringSetup( URING_SQ_DEPTH, &p );
+
+    if ( ring < 0 )
+    {
+        return NULL;
+    }
+
+    /* Waiting with a timeout and the buffer ring both need reasonably recent kernels */
+    if ( !( p.features & IORING_FEAT_EXT_ARG ) )
+    {
+        close( ring );
+        return NULL;
+    }
+
+    struct UringStream *self = SELF( calloc( 1, sizeof( struct UringStream ) ) );
+
+    if ( !self )
+    {
+        close( ring );
+        return NULL;
+    }
+
+    self->ring = ring;
+    self->sock = socket;
+    self->pendingBid = -1;
+
+    /* Map the three kernel rings */
+    self->sqMapLen = p.sq_off.array + p.sq_entries * sizeof( unsigned int );
+    self->sqMap = ( uint8_t * )mmap( NULL, self->sqMapLen, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING );
+
+    self->cqMapLen = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+    self->cqMap = ( uint8_t * )mmap( NULL, self->cqMapLen, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING );
+
+    self->sqesLen = p.sq_entries * sizeof( struct io_uring_sqe );
+    self->sqes = ( struct io_uring_sqe * )mmap( NULL, self->sqesLen, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES );
+
+    /* The provided-buffer ring has to be its own page-aligned mapping */
+    self->bufRingLen = URING_NUM_BUFS * sizeof( struct io_uring_buf );
+    self->bufRing = ( struct io_uring_buf_ring * )mmap( NULL, self->bufRingLen, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+    self->bufs = ( uint8_t * )malloc( URING_NUM_BUFS * URING_BUF_SIZE );
+
+    if ( ( self->sqMap == MAP_FAILED ) || ( self->cqMap == MAP_FAILED ) ||
+            ( self->sqes == MAP_FAILED ) || ( self->bufRing == MAP_FAILED ) || ( !self->bufs ) )
+    {
+        goto fail;
+    }
+
+    self->sqTail  = ( unsigned int * )( self->sqMap + p.sq_off.tail );
+    self->sqMask  = ( unsigned int * )( self->sqMap + p.sq_off.ring_mask );
+    self->sqArray = ( unsigned int * )( self->sqMap + p.sq_off.array );
+    self->cqHead  = ( unsigned int * )( self->cqMap + p.cq_off.head );
+    self->cqTail  = ( unsigned int * )( self->cqMap + p.cq_off.tail );
+    self->cqMask  = ( unsigned int * )( self->cqMap + p.cq_off.ring_mask );
+    self->cqes    = ( struct io_uring_cqe * )( self->cqMap + p.cq_off.cqes );
+
+    struct io_uring_buf_reg reg;
+    memset( &reg, 0, sizeof( reg ) );
+    reg.ring_addr    = ( uint64_t )( uintptr_t )self->bufRing;
+    reg.ring_entries = URING_NUM_BUFS;
+    reg.bgid         = URING_BUF_GROUP;
+
+    if ( _uringRegister( ring, IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 )
+    {
+        goto fail;
+    }
+
+    /* Give the kernel its initial set of buffers */
+    for ( int i = 0; i < URING_NUM_BUFS; i++ )
+    {
+        _recycleBuffer( self, i );
+    }
+
+    self->base.receive = _uringStreamReceive;
+    self->base.close = _uringStreamClose;
+    /* No getReadFd; a partly-drained completion buffer means data can be ready while
+     * neither the ring nor the socket shows readable */
+
+    if ( !_armReceive( self ) )
+    {
+        goto fail;
+    }
+
+    genericsReport( V_DEBUG, "Receive path is io_uring multi-shot" EOL );
+    return &self->base;
+
+fail:
+
+    if ( ( self->bufRing ) && ( self->bufRing != MAP_FAILED ) )
+    {
+        munmap( self->bufRing, self->bufRingLen );
+    }
+
+    free( self->bufs );
+
+    if ( ( self->sqes ) && ( self->sqes != MAP_FAILED ) )
+    {
+        munmap( self->sqes, self->sqesLen );
+    }
+
+    if ( ( self->sqMap ) && ( self->sqMap != MAP_FAILED ) )
+    {
+        munmap( self->sqMap, self->sqMapLen );
+    }
+
+    if ( ( self->cqMap ) && ( self->cqMap != MAP_FAILED ) )
+    {
+        munmap( self->cqMap, self->cqMapLen );
+    }
+
+    close( ring );
+    free( self );
+    return NULL;
+}
+
+#endif /* LINUX */
+// ====================================================================================================
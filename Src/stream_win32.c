@@ -115,6 +115,7 @@ bool streamWin32Initialize( struct Win32Stream *stream, HANDLE sourceHandle )
 
     stream->base.receive = _win32StreamReceive;
     stream->base.close = _win32StreamCloseInner;
+    /* No getReadFd; readiness on this platform is event-object based, not descriptor based */
     stream->source = sourceHandle;
     stream->readDoneEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
 
@@ -0,0 +1,288 @@
+#if defined( WITH_ZSTD )
+
+#include "stream.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <zstd.h>
+
+#include "generics.h"
+
+/* Decompressed data ring between the reader thread and the consumer. The thread keeps it
+ * topped up so disk reads and decompression overlap the caller's decode.
+ */
+#define ZSTD_STREAM_RING_SIZE (1<<20)
+
+struct ZstdFileStream
+{
+    struct Stream base;
+    int file;                           /* Underlying compressed file */
+
+    ZSTD_DStream *dstream;              /* Decompression state */
+    uint8_t *inBuf;                     /* Compressed read buffer */
+    size_t inBufLen;                    /* ...its allocated size */
+
+    uint8_t *ring;                      /* Decompressed data ring */
+    atomic_uint_fast64_t wp;            /* Producer position (absolute, monotonic) */
+    atomic_uint_fast64_t rp;            /* Consumer position (absolute, monotonic) */
+
+    pthread_t thread;                   /* Reader/decompressor thread */
+    pthread_mutex_t mutex;              /* Protection for the condition variables */
+    pthread_cond_t dataAvail;           /* Signalled when the thread produces data */
+    pthread_cond_t spaceAvail;          /* Signalled when the consumer frees space */
+
+    volatile bool eof;                  /* Thread reached the end of the compressed input */
+    volatile bool error;                /* Thread hit a read or decompression error */
+    volatile bool closing;              /* Consumer has requested shutdown */
+};
+
+#define SELF(stream) ((struct ZstdFileStream*)(stream))
+
+// ====================================================================================================
+static void *_zstdReaderTask( void *params )
+
+/* Read compressed spans and decompress them into the ring, ahead of the consumer */
+
+{
+    struct ZstdFileStream *self = ( struct ZstdFileStream * )params;
+    ZSTD_inBuffer in = { self->inBuf, 0, 0 };
+    bool inputDone = false;
+
+    while ( !self->closing )
+    {
+        if ( ( in.pos == in.size ) && ( !inputDone ) )
+        {
+            ssize_t r = read( self->file, self->inBuf, self->inBufLen );
+
+            if ( r < 0 )
+            {
+                self->error = true;
+                break;
+            }
+
+            inputDone = ( r == 0 );
+            in.size = r;
+            in.pos = 0;
+        }
+
+        if ( ( in.pos == in.size ) && ( inputDone ) )
+        {
+            break;
+        }
+
+        /* Wait for contiguous space in the ring to decompress into */
+        uint64_t wp = atomic_load( &self->wp );
+        uint64_t rp = atomic_load( &self->rp );
+
+        if ( ZSTD_STREAM_RING_SIZE - ( wp - rp ) == 0 )
+        {
+            pthread_mutex_lock( &self->mutex );
+
+            while ( ( ZSTD_STREAM_RING_SIZE - ( atomic_load( &self->wp ) - atomic_load( &self->rp ) ) == 0 ) &&
+                    ( !self->closing ) )
+            {
+                pthread_cond_wait( &self->spaceAvail, &self->mutex );
+            }
+
+            pthread_mutex_unlock( &self->mutex );
+            continue;
+        }
+
+        uint64_t wi = wp % ZSTD_STREAM_RING_SIZE;
+        uint64_t space = ZSTD_STREAM_RING_SIZE - ( wp - rp );
+
+        if ( wi + space > ZSTD_STREAM_RING_SIZE )
+        {
+            space = ZSTD_STREAM_RING_SIZE - wi;
+        }
+
+        ZSTD_outBuffer out = { &self->ring[wi], space, 0 };
+        size_t ret = ZSTD_decompressStream( self->dstream, &out, &in );
+
+        if ( ZSTD_isError( ret ) )
+        {
+            genericsReport( V_ERROR, "zstd decompression failed: %s" EOL, ZSTD_getErrorName( ret ) );
+            self->error = true;
+            break;
+        }
+
+        if ( out.pos )
+        {
+            atomic_store( &self->wp, wp + out.pos );
+
+            pthread_mutex_lock( &self->mutex );
+            pthread_cond_signal( &self->dataAvail );
+            pthread_mutex_unlock( &self->mutex );
+        }
+    }
+
+    self->eof = true;
+
+    /* One last kick so a blocked consumer notices the state change */
+    pthread_mutex_lock( &self->mutex );
+    pthread_cond_signal( &self->dataAvail );
+    pthread_mutex_unlock( &self->mutex );
+
+    return NULL;
+}
+// ====================================================================================================
+static enum ReceiveResult _zstdStreamReceive( struct Stream *stream, void *buffer, size_t bufferSize,
+        struct timeval *timeout, size_t *receivedSize )
+{
+    struct ZstdFileStream *self = SELF( stream );
+
+    uint64_t rp = atomic_load( &self->rp );
+
+    if ( atomic_load( &self->wp ) == rp )
+    {
+        if ( self->error )
+        {
+            return RECEIVE_RESULT_ERROR;
+        }
+
+        if ( self->eof )
+        {
+            return RECEIVE_RESULT_EOF;
+        }
+
+        /* Nothing ready yet...wait for the reader, but not past the callers' timeout */
+        struct timespec then;
+        clock_gettime( CLOCK_REALTIME, &then );
+        then.tv_sec += timeout->tv_sec;
+        then.tv_nsec += timeout->tv_usec * 1000;
+
+        if ( then.tv_nsec >= 1000000000L )
+        {
+            then.tv_sec++;
+            then.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock( &self->mutex );
+
+        while ( ( atomic_load( &self->wp ) == rp ) && ( !self->eof ) && ( !self->error ) )
+        {
+            if ( ETIMEDOUT == pthread_cond_timedwait( &self->dataAvail, &self->mutex, &then ) )
+            {
+                break;
+            }
+        }
+
+        pthread_mutex_unlock( &self->mutex );
+
+        if ( atomic_load( &self->wp ) == rp )
+        {
+            if ( self->error )
+            {
+                return RECEIVE_RESULT_ERROR;
+            }
+
+            if ( self->eof )
+            {
+                return RECEIVE_RESULT_EOF;
+            }
+
+            *receivedSize = 0;
+            return RECEIVE_RESULT_TIMEOUT;
+        }
+    }
+
+    uint64_t avail = atomic_load( &self->wp ) - rp;
+    uint64_t ri = rp % ZSTD_STREAM_RING_SIZE;
+
+    if ( avail > bufferSize )
+    {
+        avail = bufferSize;
+    }
+
+    if ( ri + avail > ZSTD_STREAM_RING_SIZE )
+    {
+        avail = ZSTD_STREAM_RING_SIZE - ri;
+    }
+
+    memcpy( buffer, &self->ring[ri], avail );
+    atomic_store( &self->rp, rp + avail );
+
+    pthread_mutex_lock( &self->mutex );
+    pthread_cond_signal( &self->spaceAvail );
+    pthread_mutex_unlock( &self->mutex );
+
+    *receivedSize = avail;
+    return RECEIVE_RESULT_OK;
+}
+
+// ====================================================================================================
+static void _zstdStreamClose( struct Stream *stream )
+{
+    struct ZstdFileStream *self = SELF( stream );
+
+    self->closing = true;
+
+    pthread_mutex_lock( &self->mutex );
+    pthread_cond_signal( &self->spaceAvail );
+    pthread_mutex_unlock( &self->mutex );
+
+    pthread_join( self->thread, NULL );
+
+    ZSTD_freeDStream( self->dstream );
+    free( self->inBuf );
+    free( self->ring );
+    close( self->file );
+}
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Publicly available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+
+struct Stream *streamCreateZstdFile( int file )
+
+/* Wrap an already-opened zstd compressed file in a decompressing stream. Takes ownership of
+ * the descriptor. Used by streamCreateFile when it spots the zstd magic; not normally called
+ * directly.
+ */
+
+{
+    struct ZstdFileStream *stream = SELF( calloc( 1, sizeof( struct ZstdFileStream ) ) );
+
+    if ( stream == NULL )
+    {
+        return NULL;
+    }
+
+    stream->base.receive = _zstdStreamReceive;
+    stream->base.close   = _zstdStreamClose;
+    /* No getReadFd; decompressed data can be waiting here while the file descriptor shows nothing */
+    stream->file         = file;
+
+    stream->dstream  = ZSTD_createDStream();
+    stream->inBufLen = ZSTD_DStreamInSize();
+    stream->inBuf    = ( uint8_t * )malloc( stream->inBufLen );
+    stream->ring     = ( uint8_t * )malloc( ZSTD_STREAM_RING_SIZE );
+
+    if ( ( !stream->dstream ) || ( !stream->inBuf ) || ( !stream->ring ) )
+    {
+        genericsExit( -1, "Out of memory establishing zstd stream" EOL );
+    }
+
+    ZSTD_initDStream( stream->dstream );
+    pthread_mutex_init( &stream->mutex, NULL );
+    pthread_cond_init( &stream->dataAvail, NULL );
+    pthread_cond_init( &stream->spaceAvail, NULL );
+
+    if ( pthread_create( &stream->thread, NULL, &_zstdReaderTask, stream ) )
+    {
+        genericsExit( -1, "Failed to create zstd reader thread" EOL );
+    }
+
+    return &stream->base;
+}
+// ====================================================================================================
+
+#endif /* WITH_ZSTD */
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * String Interning Module
+ * =======================
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "generics.h"
+#include "strintern.h"
+
+#define INITIAL_SLOTS  (1024)            /* Starting hash size; must be a power of two */
+#define ARENA_CHUNK    (65536)           /* Granularity of string storage allocation */
+
+/* Strings live in a chain of fixed chunks so they never move once stored; oversized
+ * strings simply get a chunk to themselves.
+ */
+struct arenaChunk
+{
+    struct arenaChunk *next;             /* Older chunks in the chain */
+    uint32_t capacity;                   /* Bytes available in this chunk */
+    uint32_t used;                       /* Bytes consumed so far */
+    char d[];                            /* The string storage itself */
+};
+
+struct internSlot
+{
+    const char *key;                     /* Stored string, NULL while slot is empty */
+    uint32_t hash;                       /* Cached hash, saves strcmp on most probes */
+    uint32_t index;                      /* Dense first-seen index of this string */
+};
+
+struct strInternTable
+{
+    struct internSlot *slot;             /* Open-addressed slot array */
+    uint32_t nSlots;                     /* Size of slot array; always a power of two */
+    uint32_t nUsed;                      /* Number of distinct strings held */
+    struct arenaChunk *chunk;            /* Head of the storage chain */
+};
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Internal Routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+static uint32_t _hash( const char *key )
+
+/* FNV-1a over the string; cheap and mixes path-like keys well */
+
+{
+    uint32_t h = 2166136261u;
+
+    while ( *key )
+    {
+        h = ( h ^ ( uint8_t )( *key++ ) ) * 16777619u;
+    }
+
+    return h;
+}
+// ====================================================================================================
+static const char *_arenaStore( struct strInternTable *t, const char *key )
+
+/* Copy key into stable storage, extending the chunk chain as needed */
+
+{
+    uint32_t len = strlen( key ) + 1;
+
+    if ( ( !t->chunk ) || ( t->chunk->used + len > t->chunk->capacity ) )
+    {
+        uint32_t capacity = ( len > ARENA_CHUNK ) ? len : ARENA_CHUNK;
+        struct arenaChunk *c = ( struct arenaChunk * )malloc( sizeof( struct arenaChunk ) + capacity );
+        MEMCHECK( c, NULL );
+        c->next = t->chunk;
+        c->capacity = capacity;
+        c->used = 0;
+        t->chunk = c;
+    }
+
+    char *d = &t->chunk->d[t->chunk->used];
+    memcpy( d, key, len );
+    t->chunk->used += len;
+    return d;
+}
+// ====================================================================================================
+static bool _growSlots( struct strInternTable *t )
+
+/* Double the slot array and re-place every held string */
+
+{
+    uint32_t newSize = t->nSlots * 2;
+    struct internSlot *newSlot = ( struct internSlot * )calloc( newSize, sizeof( struct internSlot ) );
+    MEMCHECK( newSlot, false );
+
+    for ( uint32_t i = 0; i < t->nSlots; i++ )
+    {
+        if ( t->slot[i].key )
+        {
+            uint32_t j = t->slot[i].hash & ( newSize - 1 );
+
+            while ( newSlot[j].key )
+            {
+                j = ( j + 1 ) & ( newSize - 1 );
+            }
+
+            newSlot[j] = t->slot[i];
+        }
+    }
+
+    free( t->slot );
+    t->slot = newSlot;
+    t->nSlots = newSize;
+    return true;
+}
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Publicly available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+struct strInternTable *strinternCreate( void )
+
+{
+    struct strInternTable *t = ( struct strInternTable * )calloc( 1, sizeof( struct strInternTable ) );
+    MEMCHECK( t, NULL );
+
+    t->nSlots = INITIAL_SLOTS;
+    t->slot = ( struct internSlot * )calloc( t->nSlots, sizeof( struct internSlot ) );
+    MEMCHECK( t->slot, NULL );
+
+    return t;
+}
+// ====================================================================================================
+void strinternDelete( struct strInternTable *t )
+
+{
+    if ( !t )
+    {
+        return;
+    }
+
+    while ( t->chunk )
+    {
+        struct arenaChunk *c = t->chunk;
+        t->chunk = c->next;
+        free( c );
+    }
+
+    free( t->slot );
+    free( t );
+}
+// ====================================================================================================
+uint32_t strinternIndex( struct strInternTable *t, const char *key, const char **stored )
+
+/* Return the dense index for key, adding it to the table on first sight */
+
+{
+    /* Keep occupancy below three quarters so probe chains stay short */
+    if ( t->nUsed * 4 >= t->nSlots * 3 )
+    {
+        if ( !_growSlots( t ) )
+        {
+            return STRINTERN_NOT_FOUND;
+        }
+    }
+
+    uint32_t h = _hash( key );
+    uint32_t i = h & ( t->nSlots - 1 );
+
+    while ( t->slot[i].key )
+    {
+        if ( ( t->slot[i].hash == h ) && ( !strcmp( t->slot[i].key, key ) ) )
+        {
+            if ( stored )
+            {
+                *stored = t->slot[i].key;
+            }
+
+            return t->slot[i].index;
+        }
+
+        i = ( i + 1 ) & ( t->nSlots - 1 );
+    }
+
+    const char *d = _arenaStore( t, key );
+
+    if ( !d )
+    {
+        return STRINTERN_NOT_FOUND;
+    }
+
+    t->slot[i].key = d;
+    t->slot[i].hash = h;
+    t->slot[i].index = t->nUsed++;
+
+    if ( stored )
+    {
+        *stored = d;
+    }
+
+    return t->slot[i].index;
+}
+// ====================================================================================================
+uint32_t strinternFind( struct strInternTable *t, const char *key )
+
+/* Look key up without adding it */
+
+{
+    uint32_t h = _hash( key );
+    uint32_t i = h & ( t->nSlots - 1 );
+
+    while ( t->slot[i].key )
+    {
+        if ( ( t->slot[i].hash == h ) && ( !strcmp( t->slot[i].key, key ) ) )
+        {
+            return t->slot[i].index;
+        }
+
+        i = ( i + 1 ) & ( t->nSlots - 1 );
+    }
+
+    return STRINTERN_NOT_FOUND;
+}
+// ====================================================================================================
+uint32_t strinternCount( struct strInternTable *t )
+
+{
+    return t->nUsed;
+}
+// ====================================================================================================
@@ -0,0 +1,343 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * SWO Line Decoder Module
+ * =======================
+ *
+ * Software demodulation of raw SWO pin samples into bytes. The hot loop is
+ * level searching over the packed sample bitmap; runs of idle line are
+ * skipped with wide compares so raw captures at high sample rates remain
+ * cheap to chew through, and individual edges are then located with a bit
+ * scan inside the interesting word.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#if defined( __SSE2__ )
+    #include <emmintrin.h>
+#elif defined( __ARM_NEON )
+    #include <arm_neon.h>
+#endif
+#include "swoDecoder.h"
+#include "generics.h"
+
+/* Decoded output is batched up to this much before the callback fires */
+#define SWOLINE_OUT_CHUNK (4096)
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Internal routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+
+static inline uint32_t _sampleAt( const uint8_t *smp, uint64_t i )
+
+{
+    return ( smp[i >> 3] >> ( i & 7 ) ) & 1;
+}
+
+// ====================================================================================================
+
+static uint64_t _findLevel( const uint8_t *smp, uint64_t from, uint64_t to, uint32_t level )
+
+/* Return index of the first sample in [from,to) matching level, or 'to' if there isn't one.
+ * The byte holding a matching sample differs from the all-ones/all-zeroes idle pattern, so
+ * whole words of the opposite level are skipped with wide compares before bit-scanning.
+ */
+
+{
+    const uint8_t skip = level ? 0x00 : 0xff;
+
+    /* Deal with any samples sharing the byte 'from' points into */
+    while ( ( from < to ) && ( from & 7 ) )
+    {
+        if ( _sampleAt( smp, from ) == level )
+        {
+            return from;
+        }
+
+        from++;
+    }
+
+    uint64_t byte = from >> 3;
+    const uint64_t byteEnd = ( to + 7 ) >> 3;
+
+#if defined( __SSE2__ )
+    const __m128i vskip = _mm_set1_epi8( ( char )skip );
+
+    while ( byte + 16 <= byteEnd )
+    {
+        __m128i v = _mm_loadu_si128( ( const __m128i * )&smp[byte] );
+        int m = ( ~_mm_movemask_epi8( _mm_cmpeq_epi8( v, vskip ) ) ) & 0xffff;
+
+        if ( m )
+        {
+            byte += __builtin_ctz( m );
+            break;
+        }
+
+        byte += 16;
+    }
+
+#elif defined( __ARM_NEON )
+
+    while ( byte + 16 <= byteEnd )
+    {
+        uint8x16_t v = vld1q_u8( &smp[byte] );
+        uint8x16_t e = vceqq_u8( v, vdupq_n_u8( skip ) );
+
+        if ( vminvq_u8( e ) != 0xff )
+        {
+            break;
+        }
+
+        byte += 16;
+    }
+
+#endif
+
+    while ( ( byte < byteEnd ) && ( smp[byte] == skip ) )
+    {
+        byte++;
+    }
+
+    if ( byte >= byteEnd )
+    {
+        return to;
+    }
+
+    /* There's a matching sample somewhere in this byte...bit-scan for it */
+    uint8_t b = level ? smp[byte] : ( uint8_t )~smp[byte];
+    uint64_t i = ( byte << 3 ) + __builtin_ctz( b );
+
+    if ( i < from )
+    {
+        i = from;
+
+        while ( ( i < to ) && ( _sampleAt( smp, i ) != level ) )
+        {
+            i++;
+        }
+    }
+
+    return ( i < to ) ? i : to;
+}
+
+// ====================================================================================================
+
+static int _decodeUART( struct SWOLineDecoder *d, uint64_t total, uint8_t *op )
+
+/* Demodulate as many NRZ byte frames as the staged samples allow. Returns number of bytes
+ * produced into op (at most SWOLINE_OUT_CHUNK), leaving d->pos at the first unconsumed sample.
+ */
+
+{
+    int count = 0;
+    const uint32_t spb = d->spb;
+
+    while ( count < SWOLINE_OUT_CHUNK )
+    {
+        /* The line is high wherever we left it, so the next low sample opens a start bit.
+         * Looking for the preceding high run would lose a frame that begins exactly where
+         * the previous pump's consumption ended.
+         */
+        uint64_t start = _findLevel( d->smp, d->pos, total, 0 );
+
+        if ( start == total )
+        {
+            /* No start bit in what we hold...everything up to here is consumed */
+            d->pos = total;
+            break;
+        }
+
+        if ( start + 10 * spb > total )
+        {
+            /* Frame runs off the end of the staged samples...wait for more */
+            d->pos = start;
+            break;
+        }
+
+        /* The start bit must still be low at its midpoint, else this was a runt pulse */
+        if ( _sampleAt( d->smp, start + spb / 2 ) )
+        {
+            d->stats.framingErrors++;
+            d->pos = start + 1;
+            continue;
+        }
+
+        /* Sample each data bit mid-bit */
+        uint32_t v = 0;
+
+        for ( uint32_t b = 0; b < 8; b++ )
+        {
+            v |= _sampleAt( d->smp, start + spb / 2 + spb * ( b + 1 ) ) << b;
+        }
+
+        if ( !_sampleAt( d->smp, start + spb / 2 + spb * 9 ) )
+        {
+            /* Stop bit isn't high...resync from the next edge */
+            d->stats.framingErrors++;
+            d->pos = start + 1;
+            continue;
+        }
+
+        op[count++] = v;
+        d->stats.rxedBytes++;
+        d->pos = start + spb / 2 + spb * 9;
+    }
+
+    return count;
+}
+
+// ====================================================================================================
+
+static int _decodeManch( struct SWOLineDecoder *d, uint64_t total, uint8_t *op )
+
+/* Demodulate biphase-L byte frames; the rising mid-transition of the start bit gives the
+ * timing reference and each data bit is the level of its second half-cell.
+ */
+
+{
+    int count = 0;
+    const uint32_t spb = d->spb;
+    const uint32_t half = spb / 2;
+
+    while ( count < SWOLINE_OUT_CHUNK )
+    {
+        /* Find the line idling low, then the rising edge in the middle of a start bit */
+        uint64_t quiet = _findLevel( d->smp, d->pos, total, 0 );
+        uint64_t start = _findLevel( d->smp, quiet, total, 1 );
+
+        if ( start == total )
+        {
+            /* No edge yet, but the tail of the low run may be the first half of a start
+             * bit...keep up to one bit period of it so the edge isn't lost at a pump boundary.
+             */
+            d->pos = ( total - quiet > spb ) ? total - spb : quiet;
+            break;
+        }
+
+        if ( start + half + 8 * spb > total )
+        {
+            /* Hold position just ahead of the edge, so the low-then-rising hunt refinds it
+             * once the rest of the frame has been staged.
+             */
+            d->pos = start - 1;
+            break;
+        }
+
+        /* Bit cell b spans [start + half + b*spb, +spb); sample midway into its second half */
+        uint32_t v = 0;
+        bool good = true;
+
+        for ( uint32_t b = 0; b < 8; b++ )
+        {
+            uint64_t cell = start + half + b * spb;
+
+            /* Biphase-L carries a guaranteed mid-cell transition; its absence means we
+             * synced onto something that wasn't a start bit.
+             */
+            if ( _sampleAt( d->smp, cell + half / 2 ) == _sampleAt( d->smp, cell + half + half / 2 ) )
+            {
+                good = false;
+                break;
+            }
+
+            v |= _sampleAt( d->smp, cell + half + half / 2 ) << b;
+        }
+
+        if ( !good )
+        {
+            d->stats.framingErrors++;
+            d->pos = start + 1;
+            continue;
+        }
+
+        op[count++] = v;
+        d->stats.rxedBytes++;
+        d->pos = start + half + 8 * spb;
+    }
+
+    return count;
+}
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Externally available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+
+void SWOLineDecoderInit( struct SWOLineDecoder *d, enum SWOLineMode mode, uint32_t samplesPerBit )
+
+{
+    memset( d, 0, sizeof( struct SWOLineDecoder ) );
+    d->mode = mode;
+    d->spb = samplesPerBit;
+}
+
+// ====================================================================================================
+
+void SWOLineDecoderPump( struct SWOLineDecoder *d, const uint8_t *samples, int len,
+                         void ( *bytesRxed )( const uint8_t *bytes, int count, void *param ),
+                         void *param )
+
+{
+    uint8_t op[SWOLINE_OUT_CHUNK];
+
+    if ( ( d->mode == SWOLINE_NONE ) || ( len <= 0 ) )
+    {
+        return;
+    }
+
+    /* Stage the new samples behind whatever is left from the previous pump */
+    if ( d->smpLen + len > d->smpCap )
+    {
+        d->smpCap = ( d->smpLen + len ) * 2;
+        d->smp = ( uint8_t * )realloc( d->smp, d->smpCap );
+        MEMCHECKV( d->smp );
+    }
+
+    memcpy( &d->smp[d->smpLen], samples, len );
+    d->smpLen += len;
+    d->stats.samples += ( uint64_t )len * 8;
+
+    const uint64_t total = ( uint64_t )d->smpLen * 8;
+    int count;
+
+    do
+    {
+        count = ( d->mode == SWOLINE_UART ) ? _decodeUART( d, total, op ) : _decodeManch( d, total, op );
+
+        if ( count )
+        {
+            bytesRxed( op, count, param );
+        }
+    }
+    while ( count == SWOLINE_OUT_CHUNK );
+
+    /* Shuffle the unconsumed tail down, in whole bytes so sample alignment is kept */
+    uint32_t drop = d->pos >> 3;
+
+    if ( drop )
+    {
+        memmove( d->smp, &d->smp[drop], d->smpLen - drop );
+        d->smpLen -= drop;
+        d->pos -= ( uint64_t )drop << 3;
+    }
+}
+
+// ====================================================================================================
+
+void SWOLineDecoderDelete( struct SWOLineDecoder *d )
+
+{
+    free( d->smp );
+    d->smp = NULL;
+    d->smpLen = d->smpCap = 0;
+}
+
+// ====================================================================================================
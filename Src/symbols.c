@@ -9,16 +9,25 @@
 #include <stdio.h>
 #include <assert.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "generics.h"
 #include "symbols.h"
+#include "strintern.h"
 #if defined(WIN32)
     #include <Windows.h>
     #include <io.h>
     #include <fcntl.h>
+#else
+    #include <sys/mman.h>
+#endif
+#if defined(LINUX)
+    #include <time.h>
+    #include <sys/inotify.h>
 #endif
 
 #define MAX_LINE_LEN (4096)
 #define ELF_RELOAD_DELAY_TIME 1000000   /* Time before elf reload will be attempted when its been lost */
+#define ELF_WATCH_SETTLE_TIME 250000    /* Quiet time after the last change event before a reload is reported */
 
 #define OBJDUMP "arm-none-eabi-objdump"
 #define OBJENVNAME "OBJDUMP"
@@ -38,7 +47,22 @@
 #endif
 
 enum LineType { LT_NULL, LT_NOISE, LT_PROC_LABEL, LT_LABEL, LT_SOURCE, LT_ASSEMBLY, LT_FILEANDLINE, LT_NEWLINE, LT_ERROR };
-enum ProcessingState {PS_IDLE, PS_GET_SOURCE, PS_GET_ASSY} ps = PS_IDLE;
+enum ProcessingState {PS_IDLE, PS_GET_SOURCE, PS_GET_ASSY};
+
+/* All line and assembly text is bump-allocated from region chunks owned by the set, so
+ * teardown hands whole chunks back instead of walking every allocation. Nothing in a
+ * region is ever individually freed; superseded blocks just lie fallow until the set dies.
+ */
+#define SYM_REGION_CHUNK_SIZE (4*1024*1024)
+#define SYM_REGION_ALIGN(x)   (((x) + 15) & ~( size_t )15)
+
+struct symbolRegionChunk
+
+{
+    struct symbolRegionChunk *next;         /* Link to older chunks */
+    size_t len;                             /* Total mapped length, header included */
+    size_t used;                            /* Bump point */
+};
 
 // ====================================================================================================
 // ====================================================================================================
@@ -47,19 +71,110 @@ enum ProcessingState {PS_IDLE, PS_GET_SOURCE, PS_GET_ASSY} ps = PS_IDLE;
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
-static uint32_t _getFileEntryIdx( struct SymbolSet *s, char *filename )
+static void *_regionAlloc( struct SymbolSet *s, size_t len )
 
-/* Get index to file entry in the files table, or SYM_NOT_FOUND */
+/* Draw memory from the set's region, growing it by a chunk when the current one is spent */
 
 {
-    uint32_t i = 0;
+    len = SYM_REGION_ALIGN( len );
+    struct symbolRegionChunk *c = s->region;
 
-    while ( ( i < s->fileCount ) && ( strcmp( s->files[i].name, filename ) ) )
+    if ( ( !c ) || ( c->used + len > c->len ) )
     {
-        i++;
+        size_t clen = SYM_REGION_ALIGN( sizeof( struct symbolRegionChunk ) ) + len;
+
+        if ( clen < SYM_REGION_CHUNK_SIZE )
+        {
+            clen = SYM_REGION_CHUNK_SIZE;
+        }
+
+#if defined( WIN32 )
+        c = ( struct symbolRegionChunk * )malloc( clen );
+        MEMCHECK( c, NULL );
+#else
+        c = ( struct symbolRegionChunk * )mmap( NULL, clen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+        if ( c == MAP_FAILED )
+        {
+            genericsExit( ENOMEM, "Out of memory at %s::%d" EOL, __FILE__, __LINE__ );
+            return NULL;
+        }
+
+#endif
+        c->next = s->region;
+        c->len  = clen;
+        c->used = SYM_REGION_ALIGN( sizeof( struct symbolRegionChunk ) );
+        s->region = c;
     }
 
-    return ( i < s->fileCount ) ? i : SYM_NOT_FOUND;
+    void *p = ( uint8_t * )c + c->used;
+    c->used += len;
+    return p;
+}
+// ====================================================================================================
+static void *_regionGrow( struct SymbolSet *s, void *p, size_t oldLen, size_t newLen )
+
+/* Extend a region allocation; in place when it is still the top of the current chunk,
+ * otherwise by copying it to a fresh block and abandoning the old one.
+ */
+
+{
+    struct symbolRegionChunk *c = s->region;
+    size_t oldAligned = SYM_REGION_ALIGN( oldLen );
+    size_t newAligned = SYM_REGION_ALIGN( newLen );
+
+    if ( ( p ) && ( c ) && ( ( uint8_t * )p + oldAligned == ( uint8_t * )c + c->used ) &&
+            ( c->used - oldAligned + newAligned <= c->len ) )
+    {
+        c->used += newAligned - oldAligned;
+        return p;
+    }
+
+    void *n = _regionAlloc( s, newLen );
+
+    if ( ( p ) && ( n ) )
+    {
+        memcpy( n, p, oldLen );
+    }
+
+    return n;
+}
+// ====================================================================================================
+static char *_regionStrdup( struct SymbolSet *s, const char *str )
+
+/* strdup into the set's region */
+
+{
+    size_t l = strlen( str ) + 1;
+    char *p = ( char * )_regionAlloc( s, l );
+
+    if ( p )
+    {
+        memcpy( p, str, l );
+    }
+
+    return p;
+}
+// ====================================================================================================
+static void _regionDelete( struct SymbolSet *s )
+
+/* Hand every chunk of the set's region back in one go */
+
+{
+    struct symbolRegionChunk *c = s->region;
+
+    while ( c )
+    {
+        struct symbolRegionChunk *n = c->next;
+#if defined( WIN32 )
+        free( c );
+#else
+        munmap( c, c->len );
+#endif
+        c = n;
+    }
+
+    s->region = NULL;
 }
 // ====================================================================================================
 static uint32_t _getOrAddFileEntryIdx( struct SymbolSet *s, char *filename )
@@ -69,6 +184,7 @@ static uint32_t _getOrAddFileEntryIdx( struct SymbolSet *s, char *filename )
 {
     char *fl = filename;
     char *d  = s->deleteMaterial;
+    const char *stored;
 
     /* Scan forwards past any delete material on the front */
     while ( ( d ) && ( *d ) && ( *fl == *d ) )
@@ -83,63 +199,42 @@ static uint32_t _getOrAddFileEntryIdx( struct SymbolSet *s, char *filename )
         fl = filename;
     }
 
+    uint32_t f = strinternIndex( s->fileNames, fl, &stored );
 
-    uint32_t f = _getFileEntryIdx( s, fl );
-
-    if ( SYM_NOT_FOUND == f )
+    if ( f == s->fileCount )
     {
-        /* Doesn't exist, so create it */
+        /* First sighting of this name, so give it a table entry */
         s->files = ( struct fileEntry * )realloc( s->files, sizeof( struct fileEntry ) * ( s->fileCount + 1 ) );
-        f = s->fileCount;
+        MEMCHECK( s->files, 0 );
         memset( &( s->files[f] ), 0, sizeof( struct fileEntry ) );
-        s->files[f].name = strdup( fl );
+        s->files[f].name = ( char * )stored;
         s->fileCount++;
     }
 
     return f;
 }
 // ====================================================================================================
-static uint32_t _getFunctionEntryIdx( struct SymbolSet *s, char *function )
-
-/* Get index to file entry in the functions table, or SYM_NOT_FOUND */
-
-{
-    uint32_t i = 0;
-
-    while ( ( i < s->functionCount ) && ( strcmp( s->functions[i].name, function ) ) )
-    {
-        i++;
-    }
-
-    return ( i < s->functionCount ) ? i : SYM_NOT_FOUND;
-}
-// ====================================================================================================
-// Strdup leak is deliberately ignored. That is the central purpose of this code!
-#pragma GCC diagnostic push
-#if !defined(__clang__)
-    #pragma GCC diagnostic ignored "-Wanalyzer-malloc-leak"
-#endif
 static uint32_t _getOrAddFunctionEntryIdx( struct SymbolSet *s, char *function )
 
 /* Return index to file entry in the functions table, or create an entry and return that */
 
 {
-    uint32_t f = _getFunctionEntryIdx( s, function );
+    const char *stored;
+
+    uint32_t f = strinternIndex( s->functionNames, function, &stored );
 
-    if ( SYM_NOT_FOUND == f )
+    if ( f == s->functionCount )
     {
-        /* Doesn't exist, so create it */
+        /* First sighting of this name, so give it a table entry */
         s->functions = ( struct functionEntry * )realloc( s->functions, sizeof( struct functionEntry ) * ( s->functionCount + 1 ) );
-        f = s->functionCount;
+        MEMCHECK( s->functions, 0 );
         memset( &( s->functions[f] ), 0, sizeof( struct functionEntry ) );
-        s->functions[f].name = strdup( function );
-        MEMCHECK( s->functions[f].name, 0 );
+        s->functions[f].name = ( char * )stored;
         s->functionCount++;
     }
 
     return f;
 }
-#pragma GCC diagnostic pop
 // ====================================================================================================
 static struct sourceLineEntry *_AddSourceLineEntry( struct SymbolSet *s )
 
@@ -155,39 +250,102 @@ static struct sourceLineEntry *_AddSourceLineEntry( struct SymbolSet *s )
 }
 
 // ====================================================================================================
-static int _compareLines( const void *a, const void *b )
+static void _sortLines( struct SymbolSet *s )
 
-/* Compare two lines for ordinal value (used for bsort/bsearch) */
+/* Sort lines into address order. Packed (startAddr,ordinal) composites go through an LSD
+ * radix sort and the records are then permuted in a single pass; linear rather than the
+ * n log n of a comparison sort, which dominated construction time on large line tables.
+ */
 
 {
-    struct sourceLineEntry *sa = ( struct sourceLineEntry * )a;
-    struct sourceLineEntry *sb = ( struct sourceLineEntry * )b;
+    uint32_t n = s->sourceCount;
 
-    /* Is it before the start of this line? */
-    if ( sa->startAddr < sb->startAddr )
+    if ( n < 2 )
     {
-        return -1;
+        return;
+    }
+
+    uint64_t *key = ( uint64_t * )malloc( n * sizeof( uint64_t ) );
+    uint64_t *alt = ( uint64_t * )malloc( n * sizeof( uint64_t ) );
+    MEMCHECKV( key );
+    MEMCHECKV( alt );
+
+    for ( uint32_t i = 0; i < n; i++ )
+    {
+        key[i] = ( ( uint64_t )s->sources[i].startAddr << 32 ) | i;
+    }
+
+    /* Four 8-bit passes over the address half; the ordinal half is already in order */
+    for ( uint32_t shift = 32; shift < 64; shift += 8 )
+    {
+        uint32_t count[256] = { 0 };
+
+        for ( uint32_t i = 0; i < n; i++ )
+        {
+            count[( key[i] >> shift ) & 0xff]++;
+        }
+
+        /* Nothing to move in this pass if every key shares the digit */
+        if ( count[( key[0] >> shift ) & 0xff] == n )
+        {
+            continue;
+        }
+
+        uint32_t total = 0;
+
+        for ( uint32_t d = 0; d < 256; d++ )
+        {
+            uint32_t c = count[d];
+            count[d] = total;
+            total += c;
+        }
+
+        for ( uint32_t i = 0; i < n; i++ )
+        {
+            alt[count[( key[i] >> shift ) & 0xff]++] = key[i];
+        }
+
+        uint64_t *t = key;
+        key = alt;
+        alt = t;
     }
 
-    /* Is it after the end of this line? */
-    if ( sa->startAddr > sb->endAddr )
+    /* Permute the records to match the sorted keys */
+    struct sourceLineEntry *sorted = ( struct sourceLineEntry * )malloc( n * sizeof( struct sourceLineEntry ) );
+    MEMCHECKV( sorted );
+
+    for ( uint32_t i = 0; i < n; i++ )
     {
-        return 1;
+        sorted[i] = s->sources[key[i] & 0xffffffff];
     }
 
-    /* Hmm...match must be on this line then */
-    return 0;
+    memcpy( s->sources, sorted, n * sizeof( struct sourceLineEntry ) );
+    free( sorted );
+    free( key );
+    free( alt );
 }
 
 // ====================================================================================================
-static void _sortLines( struct SymbolSet *s )
+static void _buildAddressIndex( struct SymbolSet *s )
 
-/* Sort lines into ordinal value as defined by _compareLines */
+/* Construct packed start/end address arrays over the (already sorted) sources table, so that
+ * lookup is a binary search over contiguous memory rather than striding through full records.
+ */
 
 {
-    qsort( s->sources, s->sourceCount, sizeof( struct sourceLineEntry ), _compareLines );
-}
+    s->idxStart = ( uint32_t * )realloc( s->idxStart, sizeof( uint32_t ) * s->sourceCount );
+    MEMCHECKV( s->idxStart );
+    s->idxEnd   = ( uint32_t * )realloc( s->idxEnd, sizeof( uint32_t ) * s->sourceCount );
+    MEMCHECKV( s->idxEnd );
 
+    for ( uint32_t i = 0; i < s->sourceCount; i++ )
+    {
+        s->idxStart[i] = s->sources[i].startAddr;
+        s->idxEnd[i]   = s->sources[i].endAddr;
+    }
+
+    s->mruLine = 0;
+}
 // ====================================================================================================
 static bool _find_symbol( struct SymbolSet *s, uint32_t workingAddr,
                           uint32_t *fileindex, uint32_t *functionindex, uint32_t *pline,
@@ -198,8 +356,35 @@ static bool _find_symbol( struct SymbolSet *s, uint32_t workingAddr,
 /* Find symbol and return pointers to contents */
 
 {
-    struct sourceLineEntry needle = { .startAddr = workingAddr, .endAddr = workingAddr };
-    struct sourceLineEntry *found = bsearch( &needle, s->sources, s->sourceCount, sizeof( struct sourceLineEntry ), _compareLines );
+    struct sourceLineEntry *found = NULL;
+
+    if ( s->sourceCount )
+    {
+        /* Most consecutive samples land on the same line, so check the MRU entry first */
+        uint32_t probe = s->mruLine;
+
+        if ( !( ( workingAddr >= s->idxStart[probe] ) && ( workingAddr <= s->idxEnd[probe] ) ) )
+        {
+            /* Branch-light binary search for the last line starting at or below this address */
+            const uint32_t *base = s->idxStart;
+            uint32_t n = s->sourceCount;
+
+            while ( n > 1 )
+            {
+                uint32_t half = n / 2;
+                base += ( base[half] <= workingAddr ) ? half : 0;
+                n -= half;
+            }
+
+            probe = base - s->idxStart;
+        }
+
+        if ( ( workingAddr >= s->idxStart[probe] ) && ( workingAddr <= s->idxEnd[probe] ) )
+        {
+            s->mruLine = probe;
+            found = &s->sources[probe];
+        }
+    }
 
     if ( found )
     {
@@ -464,6 +649,7 @@ static enum symbolErr _getTargetProgramInfo( struct SymbolSet *s )
     uint32_t functionEntryIdx;                  /* Index into function entry table */
     uint32_t nullFileEntry;                     /* Tag for when we don't have a filename */
     struct sourceLineEntry *sourceEntry = NULL; /* pointer to current source entry */
+    enum ProcessingState ps = PS_IDLE;          /* Parse state machine; one per loader, they can run in parallel */
 
     if ( stat( s->elfFile, &s->st ) != 0 )
     {
@@ -640,7 +826,9 @@ static enum symbolErr _getTargetProgramInfo( struct SymbolSet *s )
                         // Add this to source line repository
                         if ( s->recordSource )
                         {
-                            sourceEntry->lineText = ( char * )realloc( sourceEntry->lineText, strlen( line ) - strlen( SOURCE_INDICATOR ) + existingTextLen + 1 );
+                            sourceEntry->lineText = ( char * )_regionGrow( s, sourceEntry->lineText,
+                                                    existingTextLen ? existingTextLen + 1 : 0,
+                                                    strlen( line ) - strlen( SOURCE_INDICATOR ) + existingTextLen + 1 );
                             strcpy( &sourceEntry->lineText[existingTextLen], &line[strlen( SOURCE_INDICATOR )] );
                             sourceEntry->linesInBlock++;
                             GTPIP( "Got Source [%s]", &line[strlen( SOURCE_INDICATOR )] );
@@ -689,7 +877,16 @@ static enum symbolErr _getTargetProgramInfo( struct SymbolSet *s )
                         /* If we're recording entries and this is not seomthing we explicitly want to ignore */
                         if ( ( s->recordAssy )  && ( !strstr( p4, ".word" ) ) && ( !strstr( p4, ".short" ) ) )
                         {
-                            sourceEntry->assy = ( struct assyLineEntry * )realloc( sourceEntry->assy, sizeof( struct assyLineEntry ) * ( sourceEntry->assyLines + 1 ) );
+                            if ( sourceEntry->assyLines == sourceEntry->assyCap )
+                            {
+                                /* Grow geometrically; region blocks can't shuffle, so make copies rare */
+                                uint32_t ncap = sourceEntry->assyCap ? sourceEntry->assyCap * 2 : 8;
+                                sourceEntry->assy = ( struct assyLineEntry * )_regionGrow( s, sourceEntry->assy,
+                                                    sizeof( struct assyLineEntry ) * sourceEntry->assyCap,
+                                                    sizeof( struct assyLineEntry ) * ncap );
+                                sourceEntry->assyCap = ncap;
+                            }
+
                             sourceEntry->assy[sourceEntry->assyLines].addr = sourceEntry->endAddr;
                             sourceEntry->assy[sourceEntry->assyLines].is4Byte = ( ( *p2 ) != 0 );
                             sourceEntry->assy[sourceEntry->assyLines].codes = strtoul( p3, NULL, 16 );
@@ -699,7 +896,7 @@ static enum symbolErr _getTargetProgramInfo( struct SymbolSet *s )
                                 sourceEntry->assy[sourceEntry->assyLines].codes |= ( strtoul( p2, NULL, 16 ) << 16 );
                             }
 
-                            sourceEntry->assy[sourceEntry->assyLines].lineText           = strdup( line );
+                            sourceEntry->assy[sourceEntry->assyLines].lineText           = _regionStrdup( s, line );
                             sourceEntry->assy[sourceEntry->assyLines].isJump             = false;
                             sourceEntry->assy[sourceEntry->assyLines].isReturn           = false;
                             sourceEntry->assy[sourceEntry->assyLines].isSubCall          = false;
@@ -709,7 +906,7 @@ static enum symbolErr _getTargetProgramInfo( struct SymbolSet *s )
                             sourceEntry->assy[sourceEntry->assyLines].assy = strstr( sourceEntry->assy[sourceEntry->assyLines].lineText, p4 );
 
                             /* Record the label is there was one */
-                            sourceEntry->assy[sourceEntry->assyLines].label = *label ? strdup( label ) : NULL;
+                            sourceEntry->assy[sourceEntry->assyLines].label = *label ? _regionStrdup( s, label ) : NULL;
                             GTPIP( "%08x %x [%s]" EOL, sourceEntry->assy[sourceEntry->assyLines].addr,
                                    sourceEntry->assy[sourceEntry->assyLines].codes,
                                    sourceEntry->assy[sourceEntry->assyLines].lineText );
@@ -854,6 +1051,7 @@ static enum symbolErr _getTargetProgramInfo( struct SymbolSet *s )
 #endif
 
     _sortLines( s );
+    _buildAddressIndex( s );
 
 #ifdef _DUMP_SYMBOLS
     uint32_t sline = 0;
@@ -959,74 +1157,40 @@ bool SymbolLookup( struct SymbolSet *s, uint32_t addr, struct nameEntry *n )
 // ====================================================================================================
 void SymbolSetDelete( struct SymbolSet **s )
 
-/* Delete existing symbol set, by means of deleting all memory-allocated components of it first */
+/* Delete existing symbol set. All the per-line text lives in the region, so this is a
+ * fixed number of operations however big the image was.
+ */
 
 {
     if ( *s )
     {
         free( ( *s )->elfFile );
 
-        /* Free off any files dynamic memory we allocated */
-        if ( ( *s )->files )
-        {
-            for ( uint32_t i = 0; i < ( *s )->fileCount; i++ )
-            {
-                if ( ( *s )->files[i].name )
-                {
-                    free( ( *s )->files[i].name );
-                }
-            }
-
-            free( ( *s )->files );
-        }
+        /* The name strings are owned by the interning tables, so only the arrays go here */
+        free( ( *s )->files );
+        free( ( *s )->functions );
+        strinternDelete( ( *s )->fileNames );
+        strinternDelete( ( *s )->functionNames );
 
-        /* Free off any functions dynamic memory we allocated */
-        if ( ( *s )->functions )
-        {
-            for ( uint32_t i = 0; i < ( *s )->functionCount; i++ )
-            {
-                if ( ( *s )->functions[i].name )
-                {
-                    free( ( *s )->functions[i].name );
-                }
-            }
+        /* Line and assembly text go back chunk-wise, without visiting the allocations */
+        _regionDelete( *s );
+        free( ( *s )->sources );
 
-            free( ( *s )->functions );
-        }
+        free( ( *s )->idxStart );
+        free( ( *s )->idxEnd );
 
-        /* Free off any sources dynamic memory we allocated */
-        if ( ( *s )->sources )
+        if ( ( *s )->image )
         {
-            for ( uint32_t i = 0; i < ( *s )->sourceCount; i++ )
+            for ( uint32_t i = 0; i < ( *s )->imageCount; i++ )
             {
-                if ( ( *s )->sources[i].lineText )
-                {
-                    free( ( *s )->sources[i].lineText );
-                }
-
-                /* For any source line, free off it's assembly if there is some */
-                if ( ( *s )->sources[i].assy )
-                {
-                    if ( ( *s )->sources[i].assy->label )
-                    {
-                        free( ( *s )->sources[i].assy->label );
-                    }
-
-                    for ( uint32_t j = 0; j < ( *s )->sources[i].assyLines; j++ )
-                    {
-                        if ( ( *s )->sources[i].assy[j].lineText )
-                        {
-                            free( ( *s )->sources[i].assy[j].lineText );
-                        }
-                    }
-
-                    free( ( *s )->sources[i].assy );
-                }
+                free( ( *s )->image[i] );
             }
 
-            free( ( *s )->sources );
+            free( ( *s )->image );
         }
 
+        free( ( *s )->imageSt );
+
         if ( ( *s )->deleteMaterial )
         {
             free( ( *s )->deleteMaterial );
@@ -1042,6 +1206,24 @@ void SymbolSetDelete( struct SymbolSet **s )
     }
 }
 // ====================================================================================================
+static bool _statsDiffer( const struct stat *a, const struct stat *b )
+
+/* Check filesize, modification time and status change time for any differences */
+
+{
+    return ( memcmp( &a->st_size, &b->st_size, sizeof( off_t ) ) ) ||
+#ifdef OSX
+           ( memcmp( &a->st_mtimespec, &b->st_mtimespec, sizeof( struct timespec ) ) ) ||
+           ( memcmp( &a->st_ctimespec, &b->st_ctimespec, sizeof( struct timespec ) ) );
+#elif WIN32
+           ( memcmp( &a->st_mtime, &b->st_mtime, sizeof( a->st_mtime ) ) ) ||
+           ( memcmp( &a->st_ctime, &b->st_ctime, sizeof( a->st_ctime ) ) );
+#else
+           ( memcmp( &a->st_mtim, &b->st_mtim, sizeof( struct timespec ) ) ) ||
+           ( memcmp( &a->st_ctim, &b->st_ctim, sizeof( struct timespec ) ) );
+#endif
+}
+// ====================================================================================================
 bool SymbolSetValid( struct SymbolSet **s, char *filename )
 
 /* Check if current symbol set remains valid */
@@ -1049,6 +1231,27 @@ bool SymbolSetValid( struct SymbolSet **s, char *filename )
 {
     struct stat n;
 
+    if ( ( *s ) && ( ( *s )->imageCount > 1 ) )
+    {
+        /* This is a federated set; the spec must be unchanged and every image must still match */
+        if ( strcmp( filename, ( *s )->elfFile ) )
+        {
+            SymbolSetDelete( s );
+            return false;
+        }
+
+        for ( uint32_t i = 0; i < ( *s )->imageCount; i++ )
+        {
+            if ( ( 0 != stat( ( *s )->image[i], &n ) ) || ( _statsDiffer( &n, &( *s )->imageSt[i] ) ) )
+            {
+                SymbolSetDelete( s );
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     if ( 0 != stat( filename, &n ) )
     {
         /* We can't even stat the file, assume it's invalid */
@@ -1056,21 +1259,7 @@ bool SymbolSetValid( struct SymbolSet **s, char *filename )
         return false;
     }
 
-    /* We check filesize, modification time and status change time for any differences */
-    if ( ( !( *s ) ) ||
-            ( memcmp( &n.st_size, &( ( *s )->st.st_size ), sizeof( off_t ) ) ) ||
-
-#ifdef OSX
-            ( memcmp( &n.st_mtimespec, &( ( *s )->st.st_mtimespec ), sizeof( struct timespec ) ) ) ||
-            ( memcmp( &n.st_ctimespec, &( ( *s )->st.st_ctimespec ), sizeof( struct timespec ) ) )
-#elif WIN32
-            ( memcmp( &n.st_mtime, &( ( *s )->st.st_mtime ), sizeof( n.st_mtime ) ) ) ||
-            ( memcmp( &n.st_ctime, &( ( *s )->st.st_ctime ), sizeof( n.st_ctime ) ) )
-#else
-            ( memcmp( &n.st_mtim, &( ( *s )->st.st_mtim ), sizeof( struct timespec ) ) ) ||
-            ( memcmp( &n.st_ctim, &( ( *s )->st.st_ctim ), sizeof( struct timespec ) ) )
-#endif
-       )
+    if ( ( !( *s ) ) || ( _statsDiffer( &n, &( ( *s )->st ) ) ) )
     {
         SymbolSetDelete( s );
         return false;
@@ -1081,6 +1270,145 @@ bool SymbolSetValid( struct SymbolSet **s, char *filename )
     }
 }
 // ====================================================================================================
+static uint32_t _splitImageList( const char *filename, char ***images )
+
+/* Split comma-separated elf specification into its individual images. Returns number of images found. */
+
+{
+    uint32_t count = 0;
+    const char *p = filename;
+
+    *images = NULL;
+
+    while ( *p )
+    {
+        const char *e = strchr( p, ',' );
+        size_t l = e ? ( size_t )( e - p ) : strlen( p );
+
+        if ( l )
+        {
+            *images = ( char ** )realloc( *images, sizeof( char * ) * ( count + 1 ) );
+            MEMCHECK( *images, 0 );
+            ( *images )[count] = ( char * )malloc( l + 1 );
+            MEMCHECK( ( *images )[count], 0 );
+            memcpy( ( *images )[count], p, l );
+            ( *images )[count][l] = 0;
+            count++;
+        }
+
+        p += l + ( e ? 1 : 0 );
+    }
+
+    return count;
+}
+// ====================================================================================================
+static struct SymbolSet *_cloneEmptySet( struct SymbolSet *s, const char *image )
+
+/* Create an empty symbol set with the same options as s, covering a single image */
+
+{
+    struct SymbolSet *t = ( struct SymbolSet * )calloc( sizeof( struct SymbolSet ), 1 );
+    MEMCHECK( t, NULL );
+
+    t->elfFile        = strdup( image );
+    MEMCHECK( t->elfFile, NULL );
+    t->odoptions      = strdup( s->odoptions );
+    MEMCHECK( t->odoptions, NULL );
+    t->deleteMaterial = strdup( s->deleteMaterial );
+    MEMCHECK( t->deleteMaterial, NULL );
+    t->recordSource   = s->recordSource;
+    t->recordAssy     = s->recordAssy;
+    t->demanglecpp    = s->demanglecpp;
+    t->fileNames      = strinternCreate();
+    MEMCHECK( t->fileNames, NULL );
+    t->functionNames  = strinternCreate();
+    MEMCHECK( t->functionNames, NULL );
+
+    return t;
+}
+// ====================================================================================================
+struct imageLoadJob
+
+{
+    struct SymbolSet *set;                  /* Private set this image is loaded into */
+    enum symbolErr err;                     /* Outcome of the load */
+    pthread_t thread;                       /* Thread performing it */
+    bool started;                           /* Set if the thread was actually created */
+};
+
+static void *_imageLoaderTask( void *params )
+
+/* Thread wrapper; each image gets its own objdump process and parser so they genuinely overlap */
+
+{
+    struct imageLoadJob *j = ( struct imageLoadJob * )params;
+    j->err = _getTargetProgramInfo( j->set );
+    return NULL;
+}
+// ====================================================================================================
+static void _absorbSet( struct SymbolSet *s, struct SymbolSet *t )
+
+/* Merge a single-image subset into the federation set, stealing its allocated line and assembly text */
+
+{
+    uint32_t *fileMap = ( uint32_t * )malloc( sizeof( uint32_t ) * t->fileCount );
+    MEMCHECKV( fileMap );
+    uint32_t *funcMap = ( uint32_t * )malloc( sizeof( uint32_t ) * t->functionCount );
+    MEMCHECKV( funcMap );
+
+    /* Re-intern the names; indicies will generally differ between the sets */
+    for ( uint32_t i = 0; i < t->fileCount; i++ )
+    {
+        fileMap[i] = _getOrAddFileEntryIdx( s, t->files[i].name );
+    }
+
+    for ( uint32_t i = 0; i < t->functionCount; i++ )
+    {
+        uint32_t prevCount = s->functionCount;
+        funcMap[i] = _getOrAddFunctionEntryIdx( s, t->functions[i].name );
+
+        if ( funcMap[i] == prevCount )
+        {
+            /* Fresh entry, so bring over its extent. On a cross-image name clash the first image wins. */
+            s->functions[funcMap[i]].startAddr    = t->functions[i].startAddr;
+            s->functions[funcMap[i]].endAddr      = t->functions[i].endAddr;
+            s->functions[funcMap[i]].fileEntryIdx = fileMap[t->functions[i].fileEntryIdx];
+        }
+    }
+
+    /* Bulk-append the source lines with their indicies rebased into the federation tables */
+    s->sources = ( struct sourceLineEntry * )realloc( s->sources, sizeof( struct sourceLineEntry ) * ( s->sourceCount + t->sourceCount ) );
+    MEMCHECKV( s->sources );
+
+    for ( uint32_t i = 0; i < t->sourceCount; i++ )
+    {
+        s->sources[s->sourceCount] = t->sources[i];
+        s->sources[s->sourceCount].fileIdx     = fileMap[t->sources[i].fileIdx];
+        s->sources[s->sourceCount].functionIdx = funcMap[t->sources[i].functionIdx];
+        s->sourceCount++;
+    }
+
+    /* The line and assembly text now belong to the federation, so adopt the region holding it */
+    t->sourceCount = 0;
+
+    if ( t->region )
+    {
+        struct symbolRegionChunk *c = t->region;
+
+        while ( c->next )
+        {
+            c = c->next;
+        }
+
+        c->next = s->region;
+        s->region = t->region;
+        t->region = NULL;
+    }
+
+    free( fileMap );
+    free( funcMap );
+}
+// ====================================================================================================
 // Malloc leak is deliberately ignored. That is the central purpose of this code!
 #pragma GCC diagnostic push
 #if !defined(__clang__)
@@ -1108,52 +1436,115 @@ enum symbolErr SymbolSetCreate( struct SymbolSet **ss, const char *filename, con
     s->recordSource     = recordSource;
     s->demanglecpp      = demanglecpp;
     s->recordAssy       = recordAssy;
+    s->fileNames        = strinternCreate();
+    MEMCHECK( s->fileNames, 0 );
+    s->functionNames    = strinternCreate();
+    MEMCHECK( s->functionNames, 0 );
+    s->imageCount       = _splitImageList( filename, &s->image );
 
-
-    /* Make sure this file is stable before trying to load it */
-    if ( ( stat( filename, &statbuf ) != 0 ) || !( statbuf.st_mode & S_IFREG ) )
+    if ( !s->imageCount )
     {
         ret = SYMBOL_NOELF;
     }
     else
     {
-        /* There is at least a file here */
+        ret = SYMBOL_OK;
 
-        while ( 1 )
+        /* Make sure every image is stable before trying to load anything */
+        for ( uint32_t i = 0; i < s->imageCount; i++ )
         {
-            usleep( ELF_RELOAD_DELAY_TIME );
+            if ( ( stat( s->image[i], &statbuf ) != 0 ) || !( statbuf.st_mode & S_IFREG ) )
+            {
+                ret = SYMBOL_NOELF;
+                break;
+            }
+
+            /* There is at least a file here */
 
-            if ( stat( filename, &newstatbuf ) == 0 )
+            while ( 1 )
             {
-                /* We check filesize, modification time and status change time for any differences */
-                if (
-                            ( !newstatbuf.st_size ) ||
-                            ( memcmp( &statbuf.st_size, &newstatbuf.st_size, sizeof( off_t ) ) ) ||
-#ifdef OSX
-                            ( memcmp( &statbuf.st_mtimespec, &newstatbuf.st_mtimespec, sizeof( struct timespec ) ) ) ||
-                            ( memcmp( &statbuf.st_ctimespec, &newstatbuf.st_ctimespec, sizeof( struct timespec ) ) )
-#elif WIN32
-                            ( memcmp( &statbuf.st_mtime, &newstatbuf.st_mtime, sizeof( statbuf.st_mtime ) ) ) ||
-                            ( memcmp( &statbuf.st_ctime, &newstatbuf.st_ctime, sizeof( statbuf.st_ctime ) ) )
-#else
-                            ( memcmp( &statbuf.st_mtim, &newstatbuf.st_mtim, sizeof( struct timespec ) ) ) ||
-                            ( memcmp( &statbuf.st_ctim, &newstatbuf.st_ctim, sizeof( struct timespec ) ) )
-#endif
-                )
+                usleep( ELF_RELOAD_DELAY_TIME );
+
+                if ( stat( s->image[i], &newstatbuf ) == 0 )
+                {
+                    if ( ( !newstatbuf.st_size ) || ( _statsDiffer( &statbuf, &newstatbuf ) ) )
+                    {
+                        /* Make this the version we check next time around */
+                        memcpy( &statbuf, &newstatbuf, sizeof( struct stat ) );
+                        continue;
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if ( ret == SYMBOL_OK )
+        {
+            if ( s->imageCount == 1 )
+            {
+                /* Files are stable, let's grab stuff from them */
+                ret =  _getTargetProgramInfo( s );
+            }
+            else
+            {
+                /* A federation; load each image on its own thread, then merge in specification order */
+                s->imageSt = ( struct stat * )calloc( s->imageCount, sizeof( struct stat ) );
+                MEMCHECK( s->imageSt, SYMBOL_UNSPECIFIED );
+                struct imageLoadJob *job = ( struct imageLoadJob * )calloc( s->imageCount, sizeof( struct imageLoadJob ) );
+                MEMCHECK( job, SYMBOL_UNSPECIFIED );
+
+                for ( uint32_t i = 0; i < s->imageCount; i++ )
+                {
+                    job[i].set = _cloneEmptySet( s, s->image[i] );
+                    MEMCHECK( job[i].set, SYMBOL_UNSPECIFIED );
+                    job[i].err = SYMBOL_UNSPECIFIED;
+                    job[i].started = ( 0 == pthread_create( &job[i].thread, NULL, &_imageLoaderTask, &job[i] ) );
+
+                    if ( !job[i].started )
+                    {
+                        /* Couldn't get a thread, so just do this one right here */
+                        _imageLoaderTask( &job[i] );
+                    }
+                }
+
+                for ( uint32_t i = 0; i < s->imageCount; i++ )
+                {
+                    if ( job[i].started )
+                    {
+                        pthread_join( job[i].thread, NULL );
+                    }
+
+                    if ( job[i].err != SYMBOL_OK )
+                    {
+                        ret = job[i].err;
+                    }
+                }
+
+                for ( uint32_t i = 0; i < s->imageCount; i++ )
                 {
-                    /* Make this the version we check next time around */
-                    memcpy( &statbuf, &newstatbuf, sizeof( struct stat ) );
-                    continue;
+                    if ( ret == SYMBOL_OK )
+                    {
+                        _absorbSet( s, job[i].set );
+                        memcpy( &s->imageSt[i], &job[i].set->st, sizeof( struct stat ) );
+                    }
+
+                    SymbolSetDelete( &job[i].set );
                 }
-                else
+
+                free( job );
+
+                if ( ret == SYMBOL_OK )
                 {
-                    break;
+                    /* A single ordering pass covers the whole federation */
+                    _sortLines( s );
+                    _buildAddressIndex( s );
+                    memcpy( &s->st, &s->imageSt[0], sizeof( struct stat ) );
                 }
             }
         }
-
-        /* File is stable, let's grab stuff from it */
-        ret =  _getTargetProgramInfo( s );
     }
 
     if ( ret != SYMBOL_OK )
@@ -1167,3 +1558,179 @@ enum symbolErr SymbolSetCreate( struct SymbolSet **ss, const char *filename, con
 }
 #pragma GCC diagnostic pop
 // ====================================================================================================
+// Symbol file watcher. Kernel-notified change detection as an alternative to stat-per-interval,
+// which can block for tens of milliseconds when the image lives on a network filesystem. The
+// parent directory of each image is watched rather than the file itself, so replace-by-rename
+// (the way linkers and editors usually update a file) is seen too. Events are debounced; a
+// change is only reported once the file has been quiet for ELF_WATCH_SETTLE_TIME.
+// ====================================================================================================
+#if defined( LINUX )
+
+struct symbolWatcher
+{
+    int fd;                                 /* The inotify instance, opened non-blocking */
+    uint32_t imageCount;                    /* Number of images being watched */
+    char **base;                            /* Basename of each image, for event matching */
+    int *wd;                                /* Watch descriptor of each image's directory */
+    uint64_t lastEventUs;                   /* When the most recent matching event arrived */
+    bool pending;                           /* A matching event has arrived and not yet been reported */
+};
+
+static uint64_t _watchNowUs( void )
+
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint64_t )ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+#endif
+// ====================================================================================================
+struct symbolWatcher *SymbolWatcherCreate( const char *filename )
+
+/* Start watching the image(s) of a (possibly comma-separated) elf specification for change.
+ * Returns NULL where kernel notification isn't available; callers fall back to SymbolSetValid.
+ */
+
+{
+#if defined( LINUX )
+    char **images;
+    uint32_t count = _splitImageList( filename, &images );
+
+    if ( !count )
+    {
+        return NULL;
+    }
+
+    struct symbolWatcher *w = ( struct symbolWatcher * )calloc( 1, sizeof( struct symbolWatcher ) );
+    MEMCHECK( w, NULL );
+    w->imageCount = count;
+    w->base = ( char ** )calloc( count, sizeof( char * ) );
+    MEMCHECK( w->base, NULL );
+    w->wd = ( int * )calloc( count, sizeof( int ) );
+    MEMCHECK( w->wd, NULL );
+
+    w->fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+    bool ok = ( w->fd >= 0 );
+
+    for ( uint32_t i = 0; ok && ( i < count ); i++ )
+    {
+        /* Watch the containing directory and remember the leafname to match against */
+        char *slash = strrchr( images[i], '/' );
+        const char *dir;
+
+        if ( slash )
+        {
+            w->base[i] = strdup( slash + 1 );
+            *slash = 0;
+            dir = ( slash == images[i] ) ? "/" : images[i];
+        }
+        else
+        {
+            w->base[i] = strdup( images[i] );
+            dir = ".";
+        }
+
+        MEMCHECK( w->base[i], NULL );
+
+        w->wd[i] = inotify_add_watch( w->fd, dir,
+                                      IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM );
+        ok = ( w->wd[i] >= 0 );
+    }
+
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        free( images[i] );
+    }
+
+    free( images );
+
+    if ( !ok )
+    {
+        SymbolWatcherDelete( &w );
+    }
+
+    return w;
+#else
+    ( void )filename;
+    return NULL;
+#endif
+}
+// ====================================================================================================
+bool SymbolWatcherChanged( struct symbolWatcher *w )
+
+/* Drain any queued change events and report whether a watched image has changed and since
+ * settled. Reads only from the in-kernel event queue; the filesystem itself is never touched.
+ */
+
+{
+#if defined( LINUX )
+    uint8_t buf[4096] __attribute__ ( ( aligned( __alignof__( struct inotify_event ) ) ) );
+    ssize_t len;
+
+    while ( ( len = read( w->fd, buf, sizeof( buf ) ) ) > 0 )
+    {
+        for ( uint8_t *p = buf; p < buf + len; )
+        {
+            struct inotify_event *e = ( struct inotify_event * )p;
+
+            if ( e->len )
+            {
+                for ( uint32_t i = 0; i < w->imageCount; i++ )
+                {
+                    if ( !strcmp( e->name, w->base[i] ) )
+                    {
+                        w->lastEventUs = _watchNowUs();
+                        w->pending = true;
+                        break;
+                    }
+                }
+            }
+
+            p += sizeof( struct inotify_event ) + e->len;
+        }
+    }
+
+    if ( ( w->pending ) && ( _watchNowUs() - w->lastEventUs >= ELF_WATCH_SETTLE_TIME ) )
+    {
+        w->pending = false;
+        return true;
+    }
+
+#else
+    ( void )w;
+#endif
+    return false;
+}
+// ====================================================================================================
+void SymbolWatcherDelete( struct symbolWatcher **w )
+
+/* Stop watching and release the watcher */
+
+{
+#if defined( LINUX )
+
+    if ( *w )
+    {
+        if ( ( *w )->fd >= 0 )
+        {
+            close( ( *w )->fd );
+        }
+
+        for ( uint32_t i = 0; i < ( *w )->imageCount; i++ )
+        {
+            free( ( *w )->base[i] );
+        }
+
+        free( ( *w )->base );
+        free( ( *w )->wd );
+        free( *w );
+        *w = NULL;
+    }
+
+#else
+    ( void )w;
+#endif
+}
+// ====================================================================================================
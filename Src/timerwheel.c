@@ -0,0 +1,368 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Timer Wheel support
+ * ===================
+ *
+ * Hierarchical timer wheel running all of the daemon's periodic housekeeping on a
+ * single scheduler thread, so adding another bit of interval work doesn't mean
+ * adding another thread to perturb capture. Insert and cancel are O(1); the
+ * scheduler sleeps to an absolute deadline so callback jitter is bounded by OS
+ * wakeup latency rather than by accumulated sleep drift.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdbool.h>
+
+#include "timerwheel.h"
+
+#define TW_TICK_US    (1000)                 /* Wheel granularity */
+#define TW_SLOT_BITS  (6)
+#define TW_SLOTS      (1 << TW_SLOT_BITS)    /* Slots per level */
+#define TW_LEVELS     (4)                    /* 64 slots ^ 4 levels * 1ms = ~4.6 hours of reach */
+
+struct twTimer
+{
+    struct twTimer *next;                    /* Forward link in slot or fire list */
+    struct twTimer **backp;                  /* Address of the pointer that points at us, for O(1) unlink */
+    uint64_t deadline;                       /* Expiry, in ticks since the wheel epoch */
+    uint64_t interval;                       /* Re-arm interval in ticks, 0 for a oneshot */
+    twCallback cb;                           /* What to call on expiry */
+    void *context;                           /* ...and what to hand it */
+    bool firing;                             /* Callback currently running with the lock dropped */
+    bool zombie;                             /* Cancelled while firing; scheduler does the free */
+};
+
+struct twHandle
+{
+    struct twTimer *slot[TW_LEVELS][TW_SLOTS]; /* The wheel itself */
+    uint64_t now;                            /* Current tick */
+    uint64_t epoch;                          /* Monotonic time of tick zero, uS */
+    uint32_t armed;                          /* Number of timers in the wheel */
+
+    pthread_mutex_t mutex;                   /* Protects the wheel and the flags below */
+    pthread_cond_t wake;                     /* Kicks the scheduler on insert or shutdown */
+    pthread_t scheduler;                     /* The one thread all callbacks run on */
+    bool ending;                             /* Shutdown request flag */
+};
+
+// ====================================================================================================
+// Internal routines
+// ====================================================================================================
+static uint64_t _monouS( void )
+
+/* Monotonic microsecond clock */
+
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint64_t )ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000ULL;
+}
+// ====================================================================================================
+static void _waitUntil( struct twHandle *h, uint64_t targetuS )
+
+/* Sleep on the wakeup condition until the given monotonic time, an insert or shutdown */
+
+{
+    uint64_t tnow = _monouS( );
+
+    if ( targetuS <= tnow )
+    {
+        return;
+    }
+
+    /* Condvar deadlines are wall clock, so carry the monotonic delta across */
+    struct timespec ts;
+    clock_gettime( CLOCK_REALTIME, &ts );
+    uint64_t t = ( uint64_t )ts.tv_sec * 1000000000ULL + ts.tv_nsec + ( targetuS - tnow ) * 1000ULL;
+    ts.tv_sec = t / 1000000000ULL;
+    ts.tv_nsec = t % 1000000000ULL;
+    pthread_cond_timedwait( &h->wake, &h->mutex, &ts );
+}
+// ====================================================================================================
+static void _hang( struct twHandle *h, struct twTimer *t )
+
+/* Hang a timer on the wheel level matching how far out its deadline is. Lock held. */
+
+{
+    uint64_t delta = ( t->deadline > h->now ) ? t->deadline - h->now : 1;
+    int l = 0;
+
+    while ( ( l < TW_LEVELS - 1 ) && ( delta >> ( TW_SLOT_BITS * ( l + 1 ) ) ) )
+    {
+        l++;
+    }
+
+    struct twTimer **s = &h->slot[l][( t->deadline >> ( TW_SLOT_BITS * l ) ) & ( TW_SLOTS - 1 )];
+
+    t->next = *s;
+
+    if ( t->next )
+    {
+        t->next->backp = &t->next;
+    }
+
+    t->backp = s;
+    *s = t;
+}
+// ====================================================================================================
+static void _unlink( struct twTimer *t )
+
+/* Take a timer off whatever list it is on. Lock held. */
+
+{
+    *t->backp = t->next;
+
+    if ( t->next )
+    {
+        t->next->backp = t->backp;
+    }
+
+    t->next = NULL;
+    t->backp = NULL;
+}
+// ====================================================================================================
+static void _cascade( struct twHandle *h, int l )
+
+/* Re-hang everything in the current slot of an upper level onto lower levels. Lock held. */
+
+{
+    uint32_t idx = ( h->now >> ( TW_SLOT_BITS * l ) ) & ( TW_SLOTS - 1 );
+    struct twTimer *t = h->slot[l][idx];
+    h->slot[l][idx] = NULL;
+
+    while ( t )
+    {
+        struct twTimer *n = t->next;
+        _hang( h, t );
+        t = n;
+    }
+
+    if ( ( !idx ) && ( l < TW_LEVELS - 1 ) )
+    {
+        _cascade( h, l + 1 );
+    }
+}
+// ====================================================================================================
+static void _tick( struct twHandle *h )
+
+/* Advance the wheel one tick, firing whatever is due. Lock held on entry and exit. */
+
+{
+    h->now++;
+    uint32_t idx = h->now & ( TW_SLOTS - 1 );
+
+    if ( !idx )
+    {
+        _cascade( h, 1 );
+    }
+
+    struct twTimer *due = h->slot[0][idx];
+    h->slot[0][idx] = NULL;
+
+    /* Everything due is marked in-flight first, so a cancel arriving while the lock is
+     * dropped below takes the zombie path rather than unlinking a timer that isn't hung.
+     */
+    for ( struct twTimer *t = due; t; t = t->next )
+    {
+        t->backp = NULL;
+        t->firing = true;
+    }
+
+    while ( due )
+    {
+        struct twTimer *t = due;
+        due = t->next;
+        t->next = NULL;
+
+        if ( !t->zombie )
+        {
+            /* Callbacks run with the lock dropped so they can (de)register timers themselves */
+            pthread_mutex_unlock( &h->mutex );
+            ( t->cb )( t->context );
+            pthread_mutex_lock( &h->mutex );
+        }
+
+        t->firing = false;
+
+        if ( ( t->zombie ) || ( !t->interval ) )
+        {
+            h->armed--;
+            free( t );
+        }
+        else
+        {
+            /* Re-arm from the old deadline, not from now, so the cadence doesn't drift */
+            t->deadline += t->interval;
+            _hang( h, t );
+        }
+    }
+}
+// ====================================================================================================
+static void *_schedulerTask( void *params )
+
+/* The one thread timer callbacks execute on */
+
+{
+    struct twHandle *h = ( struct twHandle * )params;
+
+    pthread_mutex_lock( &h->mutex );
+
+    while ( !h->ending )
+    {
+        if ( !h->armed )
+        {
+            /* Nothing to time; sleep until someone registers, then restart the epoch
+             * so the skipped interval isn't replayed tick by tick.
+             */
+            pthread_cond_wait( &h->wake, &h->mutex );
+            h->epoch = _monouS( ) - h->now * TW_TICK_US;
+            continue;
+        }
+
+        _waitUntil( h, h->epoch + ( h->now + 1 ) * TW_TICK_US );
+
+        if ( h->ending )
+        {
+            break;
+        }
+
+        uint64_t target = ( _monouS( ) - h->epoch ) / TW_TICK_US;
+
+        while ( ( h->now < target ) && ( !h->ending ) )
+        {
+            _tick( h );
+        }
+    }
+
+    pthread_mutex_unlock( &h->mutex );
+    return NULL;
+}
+// ====================================================================================================
+static struct twTimer *_register( struct twHandle *h, uint64_t firstuS, uint64_t intervaluS,
+                                  twCallback cb, void *context )
+
+/* Common arm path for repeating and oneshot timers */
+
+{
+    struct twTimer *t = ( struct twTimer * )calloc( 1, sizeof( struct twTimer ) );
+    MEMCHECK( t, NULL );
+
+    t->cb = cb;
+    t->context = context;
+    t->interval = intervaluS / TW_TICK_US;
+
+    pthread_mutex_lock( &h->mutex );
+    uint64_t delay = firstuS / TW_TICK_US;
+    t->deadline = h->now + ( delay ? delay : 1 );
+    _hang( h, t );
+    h->armed++;
+    pthread_cond_signal( &h->wake );
+    pthread_mutex_unlock( &h->mutex );
+
+    return t;
+}
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Publicly available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+struct twTimer *twRepeat( struct twHandle *h, uint64_t intervaluS, twCallback cb, void *context )
+
+/* Arm a repeating timer; the cadence is anchored to registration time and doesn't drift */
+
+{
+    return _register( h, intervaluS, intervaluS, cb, context );
+}
+// ====================================================================================================
+struct twTimer *twOneshot( struct twHandle *h, uint64_t delayuS, twCallback cb, void *context )
+
+/* Arm a timer which fires once and then disposes of itself */
+
+{
+    return _register( h, delayuS, 0, cb, context );
+}
+// ====================================================================================================
+void twCancel( struct twHandle *h, struct twTimer *t )
+
+/* Disarm a timer. Safe against the callback being in flight; it will finish, then die. */
+
+{
+    pthread_mutex_lock( &h->mutex );
+
+    if ( t->firing )
+    {
+        t->zombie = true;
+    }
+    else
+    {
+        _unlink( t );
+        h->armed--;
+        free( t );
+    }
+
+    pthread_mutex_unlock( &h->mutex );
+}
+// ====================================================================================================
+void twShutdown( struct twHandle *h )
+
+/* Stop the scheduler and throw away the wheel and anything still on it */
+
+{
+    if ( !h )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &h->mutex );
+    h->ending = true;
+    pthread_cond_signal( &h->wake );
+    pthread_mutex_unlock( &h->mutex );
+    pthread_join( h->scheduler, NULL );
+
+    for ( int l = 0; l < TW_LEVELS; l++ )
+    {
+        for ( int s = 0; s < TW_SLOTS; s++ )
+        {
+            struct twTimer *t = h->slot[l][s];
+
+            while ( t )
+            {
+                struct twTimer *n = t->next;
+                free( t );
+                t = n;
+            }
+        }
+    }
+
+    pthread_mutex_destroy( &h->mutex );
+    pthread_cond_destroy( &h->wake );
+    free( h );
+}
+// ====================================================================================================
+struct twHandle *twInit( void )
+
+/* Create a wheel and start its scheduler thread */
+
+{
+    struct twHandle *h = ( struct twHandle * )calloc( 1, sizeof( struct twHandle ) );
+    MEMCHECK( h, NULL );
+
+    pthread_mutex_init( &h->mutex, NULL );
+    pthread_cond_init( &h->wake, NULL );
+    h->epoch = _monouS( );
+
+    if ( pthread_create( &h->scheduler, NULL, &_schedulerTask, h ) )
+    {
+        free( h );
+        return NULL;
+    }
+
+    return h;
+}
+// ====================================================================================================
@@ -36,6 +36,10 @@
 #define TPIU_TIMEOUT_US (200000U)        // Note that this timeout must be less than 1sec (<1000000 us)
 #define STAT_SYNC_BYTE (0xA6)            // Sync header for status
 
+/* Only the pumping thread writes the counters; keep increments relaxed so readers elsewhere */
+/* see whole values without the decode loop paying for locked read-modify-writes             */
+#define STATS_INC(x) atomic_store_explicit( &(x), atomic_load_explicit( &(x), memory_order_relaxed ) + 1U, memory_order_relaxed )
+
 // ====================================================================================================
 struct TPIUDecoder *TPIUDecoderCreate( void )
 
@@ -58,6 +62,7 @@ void TPIUDecoderInit( struct TPIUDecoder *t )
 
     t->state = TPIU_UNSYNCED;
     t->syncMonitor = 0;
+    t->resyncLen = 0;
     TPIUDecoderZeroStats( t );
 }
 // ====================================================================================================
@@ -84,16 +89,40 @@ void TPIUDecoderForceSync( struct TPIUDecoder *t, uint8_t offset )
 {
     if ( t->state == TPIU_UNSYNCED )
     {
-        t->stats.syncCount++;
+        STATS_INC( t->stats.syncCount );
     }
 
     t->state = TPIU_RXING;
     t->byteCount = offset;
+    t->resyncLen = 0;
 
     /* Consider this a valid timestamp */
     gettimeofday( &t->lastPacket, NULL );
 }
 // ====================================================================================================
+static void _resyncRetain( struct TPIUDecoder *t, const uint8_t *d, uint32_t n )
+
+/* Keep hold of bytes being discarded during the sync hunt in case they can be recovered later */
+
+{
+    if ( n >= TPIU_RESYNC_BUFFER_LEN )
+    {
+        d += n - TPIU_RESYNC_BUFFER_LEN;
+        n = TPIU_RESYNC_BUFFER_LEN;
+        t->resyncLen = 0;
+    }
+    else if ( t->resyncLen + n > TPIU_RESYNC_BUFFER_LEN )
+    {
+        /* Slide the history down; only the most recent bytes can precede the eventual sync */
+        uint32_t keep = TPIU_RESYNC_BUFFER_LEN - n;
+        memmove( t->resyncBuffer, &t->resyncBuffer[t->resyncLen - keep], keep );
+        t->resyncLen = keep;
+    }
+
+    memcpy( &t->resyncBuffer[t->resyncLen], d, n );
+    t->resyncLen += n;
+}
+// ====================================================================================================
 bool _getPacket( struct TPIUDecoder *t, struct TPIUPacket *p )
 
 /* Copy received packet into transfer buffer, and reset receiver */
@@ -179,6 +208,67 @@ void _decodeCommsStats( struct TPIUDecoder *t )
     t->commsStats.totalFrames  = ( t->rxedPacket[11] << 24 ) | ( t->rxedPacket[10] << 16 ) | ( t->rxedPacket[9] << 8 ) | ( t->rxedPacket[8] );
 }
 // ====================================================================================================
+static void _resyncRecover( struct TPIUDecoder *t,
+                            void ( *packetRxed )( enum TPIUPumpEvent e, struct TPIUPacket *p, void *param ),
+                            void *param )
+
+/* A sync pattern has just been found after a hunt; the retained history ends with that
+ * pattern, and since the formatter only emits sync on a frame boundary, the bytes before
+ * it tile backwards into whole frames. Frames have no checksum, so consistency is judged
+ * structurally: any 0x7F octet must sit in the upper half of an aligned halfsync pair,
+ * otherwise it would have steered the live decode differently and the alignment is suspect.
+ * Everything from the earliest consistent frame onwards is replayed through the decoder.
+ */
+
+{
+    uint32_t end = ( t->resyncLen > 4 ) ? t->resyncLen - 4 : 0;
+    uint32_t start = end;
+
+    while ( start >= TPIU_PACKET_LEN )
+    {
+        const uint8_t *w = &t->resyncBuffer[start - TPIU_PACKET_LEN];
+        bool consistent = true;
+
+        for ( uint32_t j = 0; j < TPIU_PACKET_LEN; j++ )
+        {
+            if ( ( w[j] == HALFSYNC_HIGH ) && ( ( !( j & 1 ) ) || ( w[j - 1] != HALFSYNC_LOW ) ) )
+            {
+                consistent = false;
+                break;
+            }
+        }
+
+        if ( !consistent )
+        {
+            break;
+        }
+
+        start -= TPIU_PACKET_LEN;
+    }
+
+    if ( start < end )
+    {
+        /* Replay as a normal synced run; no sync pattern can lurk in here or the hunt would
+         * have ended on it instead, so this cannot recurse more than one level deep. */
+        t->state = TPIU_RXING;
+        t->byteCount = 0;
+        t->got_lowbits = false;
+        TPIUPump( t, &t->resyncBuffer[start], end - start, packetRxed, param );
+
+        uint32_t frames = ( end - start ) / TPIU_PACKET_LEN;
+
+        for ( uint32_t i = 0; i < frames; i++ )
+        {
+            STATS_INC( t->stats.recoveredFrames );
+        }
+
+        /* Back to unsynced so the caller's sync handling announces this as a fresh sync */
+        t->state = TPIU_UNSYNCED;
+    }
+
+    t->resyncLen = 0;
+}
+// ====================================================================================================
 void TPIUPump( struct TPIUDecoder *t, uint8_t *frame, int len,
                void ( *packetRxed )( enum TPIUPumpEvent e, struct TPIUPacket *p, void *param ),
                void *param )
@@ -202,25 +292,77 @@ void TPIUPump( struct TPIUDecoder *t, uint8_t *frame, int len,
         {
             /* There was a legal value for last time...this is not the startup case */
             genericsReport( V_WARN, ">>>>>>>>> PACKET INTERVAL TOO LONG <<<<<<<<<<<<<<" EOL );
-            t->stats.lostSync++;
+            STATS_INC( t->stats.lostSync );
         }
 
         t->state = TPIU_UNSYNCED;
+        t->resyncLen = 0;
         packetRxed( TPIU_EV_UNSYNCED, NULL, param );
     }
 
     memcpy( &t->lastPacket, &nowTime, sizeof( struct timeval ) );
 
     /* Now process the packet */
-    while ( len-- )
+    while ( len )
     {
+        /* ----------------------------------------------------------------------------------- */
+        /* Fast path : We are synced and frame-aligned with a whole frame in hand. Sync and    */
+        /* halfsync detection both complete on a 0x7F octet, so a window without one can be    */
+        /* taken as a frame directly, leaving only the sync shift register to be carried over. */
+        if ( ( t->state == TPIU_RXING ) && ( !t->byteCount ) && ( !t->got_lowbits ) &&
+                ( len >= TPIU_PACKET_LEN ) && ( !memchr( frame, HALFSYNC_HIGH, TPIU_PACKET_LEN ) ) )
+        {
+            memcpy( t->rxedPacket, frame, TPIU_PACKET_LEN );
+            t->syncMonitor = ( ( uint32_t )frame[TPIU_PACKET_LEN - 4] << 24 ) | ( frame[TPIU_PACKET_LEN - 3] << 16 ) |
+                             ( frame[TPIU_PACKET_LEN - 2] << 8 ) | frame[TPIU_PACKET_LEN - 1];
+            frame += TPIU_PACKET_LEN;
+            len -= TPIU_PACKET_LEN;
+            STATS_INC( t->stats.packets );
+
+            if ( _getPacket( t, &_packet ) )
+            {
+                packetRxed( TPIU_EV_RXEDPACKET, &_packet, param );
+            }
+
+            continue;
+        }
+
+        /* ----------------------------------------------------------------------------------- */
+        /* While hunting for sync only an 0x7F octet can complete the pattern, so leap to the   */
+        /* next candidate (or to the block tail, for a pattern spanning blocks) rather than     */
+        /* shifting the monitor along byte by byte.                                             */
+        if ( ( t->state == TPIU_UNSYNCED ) && ( len > 4 ) )
+        {
+            uint8_t *c = memchr( frame, HALFSYNC_HIGH, len );
+            uint32_t keep = ( c ) ? ( len - ( c - frame ) ) + 3 : 3;
+
+            if ( keep < ( uint32_t )len )
+            {
+                _resyncRetain( t, frame, len - keep );
+                frame += len - keep;
+                len = keep;
+            }
+        }
+
         d = *frame++;
+        len--;
         t->syncMonitor = ( t->syncMonitor << 8 ) | d;
 
+        if ( t->state == TPIU_UNSYNCED )
+        {
+            _resyncRetain( t, &d, 1 );
+        }
+
         /* ----------------------------------------------------------------------------------- */
         /* First case : This is a sync pattern. If so then process it, then move to next octet */
         if ( t->syncMonitor == SYNCPATTERN )
         {
+            if ( t->state == TPIU_UNSYNCED )
+            {
+                /* See what can be salvaged from the bytes the hunt passed over */
+                _resyncRecover( t, packetRxed, param );
+            }
+
             packetRxed( ( t->state == TPIU_UNSYNCED ) ? TPIU_EV_NEWSYNC : TPIU_EV_SYNCED, NULL, param );
 
             /* Deal with the special state that these are communication stats from the link */
@@ -231,7 +373,7 @@ void TPIUPump( struct TPIUDecoder *t, uint8_t *frame, int len,
             }
 
             t->state = TPIU_RXING;
-            t->stats.syncCount++;
+            STATS_INC( t->stats.syncCount );
             t->byteCount = 0;
             t->got_lowbits = false;
             genericsReport( V_DEBUG, "!!!! " EOL );
@@ -264,7 +406,7 @@ void TPIUPump( struct TPIUDecoder *t, uint8_t *frame, int len,
         if ( ( d == HALFSYNC_HIGH ) && ( t->rxedPacket[t->byteCount] == HALFSYNC_LOW ) )
         {
             // A halfsync, waste of space, to be ignored
-            t->stats.halfSyncCount++;
+            STATS_INC( t->stats.halfSyncCount );
             continue;
         }
 
@@ -275,7 +417,7 @@ void TPIUPump( struct TPIUDecoder *t, uint8_t *frame, int len,
 
         if ( t->byteCount == TPIU_PACKET_LEN )
         {
-            t->stats.packets++;
+            STATS_INC( t->stats.packets );
             t->byteCount = 0;
             genericsReport( V_DEBUG, EOL );
 
@@ -10,6 +10,7 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "msgDecoder.h"
 #include "traceDecoder.h"
@@ -111,15 +112,36 @@ void TRACEDecoderPump( struct TRACEDecoder *i, uint8_t *buf, int len, traceDecod
 
     /* len can arrive as 0 for the case of an unwrapped buffer */
 
-    if ( i->engine->action )
+    if ( i->engine->pump )
     {
-        while ( len-- )
+        /* The protocol supplies its own specialised loop; one despatch for the whole buffer */
+        i->engine->pump( i->engine, &i->cpu, buf, len, cb, d );
+    }
+    else if ( i->engine->action )
+    {
+        while ( len )
         {
+            if ( i->engine->actionSpan )
+            {
+                /* Engine offers a fast path over a lookahead window; see if it can take this packet whole */
+                int taken = i->engine->actionSpan( i->engine, &i->cpu, buf, len );
+
+                if ( taken )
+                {
+                    buf += taken;
+                    len -= taken;
+                    cb( d );
+                    continue;
+                }
+            }
+
             if ( i->engine->action(  i->engine, &i->cpu, *( buf++ ) ) )
             {
                 /* Something worthy of being reported happened */
                 cb( d );
             }
+
+            len--;
         }
 
     }
@@ -141,6 +163,42 @@ void TRACEDecoderPump( struct TRACEDecoder *i, uint8_t *buf, int len, traceDecod
     }
 }
 // ====================================================================================================
+struct TRACEDecoderSnapshot *TRACEDecoderSnapshotTake( struct TRACEDecoder *i, struct TRACEDecoderSnapshot *prev )
+
+/* Record complete decode state. Pass the previous snapshot back in for re-use of its memory */
+
+{
+    assert( i );
+    assert( i->engine );
+    assert( i->engine->stateSize );
+
+    struct TRACEDecoderSnapshot *s = ( struct TRACEDecoderSnapshot * )realloc( prev,
+            sizeof( struct TRACEDecoderSnapshot ) + i->engine->stateSize );
+
+    if ( s )
+    {
+        memcpy( &s->stats, &i->stats, sizeof( struct TRACEDecoderStats ) );
+        memcpy( &s->cpu, &i->cpu, sizeof( struct TRACECPUState ) );
+        memcpy( s->engineState, i->engine, i->engine->stateSize );
+    }
+
+    return s;
+}
+// ====================================================================================================
+void TRACEDecoderSnapshotRestore( struct TRACEDecoder *i, const struct TRACEDecoderSnapshot *s )
+
+/* Return the decoder to the state recorded in a snapshot taken from this same decoder */
+
+{
+    assert( i );
+    assert( i->engine );
+    assert( s );
+
+    memcpy( &i->stats, &s->stats, sizeof( struct TRACEDecoderStats ) );
+    memcpy( &i->cpu, &s->cpu, sizeof( struct TRACECPUState ) );
+    memcpy( i->engine, s->engineState, i->engine->stateSize );
+}
+// ====================================================================================================
 void TRACEDecoderInit( struct TRACEDecoder *i, enum TRACEprotocol protocol, bool usingAltAddrEncodeSet, genericsReportCB report )
 
 /* Reset a TRACEDecoder instance */
@@ -65,6 +65,15 @@ struct ETM35DecodeState
 };
 
 #define DEBUG(...) { if ( cpu->report ) cpu->report( V_DEBUG, __VA_ARGS__); }
+
+/* Precomputed payload bit positions for branch-address bytes, indexed by address mode then */
+/* byte number. The first byte of a packet is placed irregularly and is handled separately. */
+static const uint8_t _baShift[3][5] =
+{
+    /* TRACE_ADDRMODE_THUMB   */ { 0,  7, 14, 21, 28 },
+    /* TRACE_ADDRMODE_ARM     */ { 0,  8, 15, 22, 29 },
+    /* TRACE_ADDRMODE_JAZELLE */ { 0,  6, 13, 20, 27 }
+};
 // ====================================================================================================
 // ====================================================================================================
 // ====================================================================================================
@@ -615,6 +624,7 @@ static bool _pumpAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu
                 {
                     newState = TRACE_IDLE;
                     cpu->cycleCount = j->cycleConstruct;
+                    TRACECycleNote( cpu, j->cycleConstruct );
                     _stateChange( cpu, EV_CH_CYCLECOUNT );
 
                     DEBUG( "Cyclecount %d" EOL, cpu->cycleCount );
@@ -805,6 +815,7 @@ static bool _pumpAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu
                     /* Now go to get the rest of the ISYNC packet */
                     /* Collect either the context or the Info Byte next */
                     cpu->cycleCount = j->cycleConstruct;
+                    TRACECycleNote( cpu, j->cycleConstruct );
                     j->byteCount = j->contextBytes;
                     j->contextConstruct = 0;
                     _stateChange( cpu, EV_CH_CYCLECOUNT );
@@ -832,6 +843,114 @@ static bool _pumpAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu
 
 // ====================================================================================================
 
+static int _spanAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu, const uint8_t *buf, int len )
+
+/* Fast-path decode of a branch-address packet sitting complete in the lookahead window. Returns the */
+/* number of bytes consumed (a message was received), or 0 to drop into the generic state machine.   */
+/* Only exception-free packets of up to four bytes are taken here; they are what tight loops emit.   */
+
+{
+    struct ETM35DecodeState *j = ( struct ETM35DecodeState * )e;
+    uint32_t construct = j->addrConstruct;
+    uint8_t c = buf[0];
+    const uint8_t *shift = _baShift[cpu->addrMode];
+    bool C;
+    int n;
+
+    if ( ( j->p != TRACE_IDLE ) || ( !j->rxedISYNC ) || ( !( c & 0b1 ) ) )
+    {
+        return 0;
+    }
+
+    /* The lowest order 6 bits of address info... */
+    switch ( cpu->addrMode )
+    {
+        case TRACE_ADDRMODE_ARM:
+            construct = ( construct & ~( 0b11111100 ) ) | ( ( c & 0b01111110 ) << 1 );
+            break;
+
+        case TRACE_ADDRMODE_THUMB:
+            construct = ( construct & ~( 0b01111111 ) ) | ( c & 0b01111110 );
+            break;
+
+        case TRACE_ADDRMODE_JAZELLE:
+            construct = ( construct & ~( 0b00111111 ) ) | ( ( c & 0b01111110 ) >> 1 );
+            break;
+    }
+
+    C = ( c & 0x80 ) != 0;
+
+    for ( n = 1; C; n++ )
+    {
+        if ( ( n >= len ) || ( n == 4 ) )
+        {
+            /* Packet runs off the end of the window, or into five-byte/legacy-exception */
+            /* territory; leave the whole thing for the byte pump */
+            return 0;
+        }
+
+        c = buf[n];
+        C = ( c & 0x80 ) != 0;
+
+        if ( j->usingAltAddrEncode )
+        {
+            uint8_t mask = C ? 0x7f : 0x3f;
+            construct = ( construct & ~( ( uint32_t )mask << shift[n] ) ) | ( ( uint32_t )( c & mask ) << shift[n] );
+
+            if ( ( !C ) && ( c & 0x40 ) )
+            {
+                /* Exception information follows the address */
+                return 0;
+            }
+        }
+        else
+        {
+            /* Deliberately bit-identical to the standard format collection in the state machine */
+            construct = ( construct & ~( 0x7F << shift[n] ) ) | ( c & ( 0x7F << shift[n] ) );
+        }
+    }
+
+    /* A complete branch with nothing following it; commit and report */
+    j->addrConstruct = construct;
+    j->byteCount = n;
+    /* Only the terminating byte of a branch packet can be zero, so this tracks the byte pump */
+    j->asyncCount = c ? 0 : 1;
+    cpu->addr = construct;
+    _stateChange( cpu, EV_CH_ADDRESS );
+    DEBUG( "Branch to %08x" EOL, cpu->addr );
+    return n;
+}
+
+// ====================================================================================================
+
+static void _pump( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu, const uint8_t *buf, int len, traceDecodeCB cb, void *d )
+
+/* Specialised whole-buffer pump; the calls below are direct, so the handlers inline into this loop */
+
+{
+    while ( len )
+    {
+        int taken = _spanAction( e, cpu, buf, len );
+
+        if ( taken )
+        {
+            buf += taken;
+            len -= taken;
+            cb( d );
+            continue;
+        }
+
+        if ( _pumpAction( e, cpu, *( buf++ ) ) )
+        {
+            cb( d );
+        }
+
+        len--;
+    }
+}
+
+// ====================================================================================================
+
 static void _pumpDestroy( struct TRACEDecoderEngine *e )
 
 {
@@ -883,11 +1002,14 @@ struct TRACEDecoderEngine *ETM35DecoderPumpCreate( void )
 {
 
     struct TRACEDecoderEngine *e = ( struct TRACEDecoderEngine * )calloc( 1, sizeof( struct ETM35DecodeState ) );
+    e->pump          = _pump;
     e->action        = _pumpAction;
+    e->actionSpan    = _spanAction;
     e->destroy       = _pumpDestroy;
     e->synced        = _synced;
     e->forceSync     = _forceSync;
     e->altAddrEncode = _usingAltAddrEncode;
+    e->stateSize     = sizeof( struct ETM35DecodeState );
     return e;
 }
 
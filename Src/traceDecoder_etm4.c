@@ -404,9 +404,8 @@ static bool _pumpAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu
                         _stateChange( cpu, EV_CH_TRACESTART );
                         break;
 
-                    case 0b10010000 ... 0b10010011: /* Exact Match Address */
+                    case 0b10010000 ... 0b10010010: /* Exact Match Address; 0b10010011 is reserved */
                         match = c & 0x03;
-                        assert( c != 3 ); /* This value is reserved */
                         cpu->addr = j->q[match].addr;
                         retVal = TRACE_EV_MSG_RXED;
                         _stateChange( cpu, EV_CH_ADDRESS );
@@ -538,6 +537,13 @@ static bool _pumpAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu
                         break;
 
                     case 0b00000101: /* Function return element, Figure 6-9, Pg 6-265 */
+
+                        /* If the model knows the target, deliver it with the event */
+                        if ( TRACEReturnStackPop( cpu, &cpu->addr ) )
+                        {
+                            _stateChange( cpu, EV_CH_ADDRESS );
+                        }
+
                         retVal = TRACE_EV_MSG_RXED;
                         _stateChange( cpu, EV_CH_FNRETURN );
                         break;
@@ -826,6 +832,7 @@ static bool _pumpAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu
                 {
 
                     cpu->cycleCount += j->cntUpdate;
+                    TRACECycleNote( cpu, j->cntUpdate );
                     retVal = TRACE_EV_MSG_RXED;
                     _stateChange( cpu, EV_CH_CYCLECOUNT );
                     newState = TRACE_IDLE;
@@ -871,6 +878,7 @@ static bool _pumpAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu
                 j->plctl = c;
                 j->nextrhkey = 0;
                 _flushQ( j ); /* Reset the address stack too ( Section 6.4.12, Pg 6-291 ) */
+                TRACEReturnStackFlush( cpu ); /* ...and the return-stack model; history doesn't survive a resync */
 
                 if ( j->plctl & ( 1 << 0 ) )
                 {
@@ -987,6 +995,77 @@ static bool _pumpAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu
 }
 // ====================================================================================================
 
+/* Longest packet we will speculate across; anything bigger is left to cross blocks byte-wise */
+#define SPAN_SPEC_LIMIT (24)
+
+static int _spanAction( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu, const uint8_t *buf, int len )
+
+/* Speculatively decode one whole packet from the lookahead window, running the state machine */
+/* inline so there is a single despatch per packet rather than per byte. Returns the number of */
+/* bytes consumed, or 0 after rolling back to the snapshot if the packet is truncated at the   */
+/* block edge, in which case the byte pump carries the partial state across to the next block. */
+
+{
+    struct ETM4DecodeState *j = ( struct ETM4DecodeState * )e;
+
+    /* Speculation only pays off when synced and at a packet boundary. A leading zero is A-Sync */
+    /* padding which never completes a packet, so don't bother re-scanning those either.        */
+    if ( ( !j->rxedISYNC ) || ( j->p != TRACE_IDLE ) || ( !buf[0] ) )
+    {
+        return 0;
+    }
+
+    struct ETM4DecodeState savedState = *j;
+    struct TRACECPUState savedCpu = *cpu;
+
+    int limit = ( len < SPAN_SPEC_LIMIT ) ? len : SPAN_SPEC_LIMIT;
+
+    for ( int n = 0; n < limit; n++ )
+    {
+        if ( _pumpAction( e, cpu, buf[n] ) )
+        {
+            /* A complete packet; commit everything done so far */
+            return n + 1;
+        }
+    }
+
+    /* No complete packet in the window; undo the speculation wholesale */
+    *j = savedState;
+    *cpu = savedCpu;
+    return 0;
+}
+
+// ====================================================================================================
+
+static void _pump( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu, const uint8_t *buf, int len, traceDecodeCB cb, void *d )
+
+/* Specialised whole-buffer pump; speculation and the state machine are called directly so they */
+/* can inline into this loop */
+
+{
+    while ( len )
+    {
+        int taken = _spanAction( e, cpu, buf, len );
+
+        if ( taken )
+        {
+            buf += taken;
+            len -= taken;
+            cb( d );
+            continue;
+        }
+
+        if ( _pumpAction( e, cpu, *( buf++ ) ) )
+        {
+            cb( d );
+        }
+
+        len--;
+    }
+}
+
+// ====================================================================================================
+
 static void _pumpDestroy( struct TRACEDecoderEngine *e )
 
 {
@@ -1023,10 +1102,13 @@ struct TRACEDecoderEngine *ETM4DecoderPumpCreate( void )
 {
 
     struct TRACEDecoderEngine *e = ( struct TRACEDecoderEngine * )calloc( 1, sizeof( struct ETM4DecodeState ) );
-    e->action    = _pumpAction;
-    e->destroy   = _pumpDestroy;
-    e->synced    = _synced;
-    e->forceSync = _forceSync;
+    e->pump       = _pump;
+    e->action     = _pumpAction;
+    e->actionSpan = _spanAction;
+    e->destroy    = _pumpDestroy;
+    e->synced     = _synced;
+    e->forceSync  = _forceSync;
+    e->stateSize  = sizeof( struct ETM4DecodeState );
     return e;
 }
 
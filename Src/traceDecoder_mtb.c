@@ -21,10 +21,20 @@ enum TRACE_MTBprotoState
     TRACE_IDLE
 };
 
+#define MTB_INDEX_SIZE (65536)       /* Branch records retained in the streaming index (must be 2^n) */
+
 struct MTBDecodeState
 {
     struct TRACEDecoderEngine e; /* Must be first to allow object method access */
     enum TRACE_MTBprotoState p;  /* Current state of the receiver */
+
+    /* Materials for streaming mode, where alternating half-buffers arrive continuously */
+    bool streaming;              /* Are we consuming a continuous feed rather than one snapshot? */
+    uint64_t seq;                /* Sequence number of the next branch record */
+
+    /* Index of reconstructed branch records. This lives outside the snapshotted state; */
+    /* only the pointer is copied, so the index continues across snapshot/restore.      */
+    struct MTBBranchRecord *index;
 };
 
 #define REPORT(...) { if ( cpu->report ) cpu->report( V_DEBUG, __VA_ARGS__); }
@@ -52,6 +62,7 @@ static bool _pumpActionPair( struct TRACEDecoderEngine *e, struct TRACECPUState
 
     enum TRACE_MTBprotoState newState = j->p;
     enum TRACEDecoderPumpEvent retVal = TRACE_EV_NONE;
+    bool gapBefore = false;
 
     REPORT( "[From 0x%08x to 0x%08x]" EOL, source, dest );
 
@@ -88,6 +99,15 @@ static bool _pumpActionPair( struct TRACEDecoderEngine *e, struct TRACECPUState
                 _stateChange( cpu, EV_CH_TRACESTART );
             }
 
+            if ( ( j->streaming ) && ( !( dest & 1 ) ) && ( ( source & 0xFFFFFFFE ) < ( cpu->nextAddr & 0xFFFFFFFE ) ) )
+            {
+                /* Execution cannot move backwards without a recorded branch, so records   */
+                /* between the half-buffers (or inside one that wrapped) have been lost... */
+                gapBefore = true;
+                cpu->overflows++;
+                _stateChange( cpu, EV_CH_OVERFLOW );
+            }
+
             cpu->addr = cpu->nextAddr & 0xFFFFFFFE;
             cpu->nextAddr = ( dest & 0xFFFFFFFE ) | ( source & 1 );
             cpu->toAddr = source & 0xFFFFFFFE;
@@ -107,16 +127,51 @@ static bool _pumpActionPair( struct TRACEDecoderEngine *e, struct TRACECPUState
 
     }
 
+    if ( ( j->index ) && ( TRACE_EV_MSG_RXED == retVal ) )
+    {
+        /* File this reconstructed branch in the index, evicting the oldest if we've wrapped */
+        struct MTBBranchRecord *r = &j->index[j->seq & ( MTB_INDEX_SIZE - 1 )];
+        r->seq       = j->seq++;
+        r->from      = source & 0xFFFFFFFE;
+        r->to        = dest & 0xFFFFFFFE;
+        r->gapBefore = gapBefore;
+    }
 
     j->p = newState;
     return ( retVal != TRACE_EV_NONE );
 }
 // ====================================================================================================
 
+static void _pump( struct TRACEDecoderEngine *e, struct TRACECPUState *cpu, const uint8_t *buf, int len, traceDecodeCB cb, void *d )
+
+/* Specialised whole-buffer pump. MTB processes two words at a time...a from and to address */
+/* (yes, that could be +1 on a uint32_t increment, but I prefer being explicit) */
+
+{
+    while ( len > 7 )
+    {
+        if ( _pumpActionPair( e, cpu, *( uint32_t * )buf, *( uint32_t * )( buf + 4 ) ) )
+        {
+            cb( d );
+        }
+
+        buf += 8;
+        len -= 8;
+    }
+}
+
+// ====================================================================================================
+
 static void _pumpDestroy( struct TRACEDecoderEngine *e )
 
 {
     assert( e );
+
+    if ( ( ( struct MTBDecodeState * )e )->index )
+    {
+        free( ( ( struct MTBDecodeState * )e )->index );
+    }
+
     free( e );
 }
 
@@ -144,15 +199,60 @@ static void _forceSync(  struct TRACEDecoderEngine *e, bool isSynced )
 // ====================================================================================================
 // ====================================================================================================
 
+void MTBDecoderSetStreaming( struct TRACEDecoder *i, bool isStreaming )
+
+/* Switch between one-shot snapshot decode and continuous half-buffer streaming */
+
+{
+    assert( i->protocol == TRACE_PROT_MTB );
+    struct MTBDecodeState *j = ( struct MTBDecodeState * )i->engine;
+
+    j->streaming = isStreaming;
+
+    if ( ( isStreaming ) && ( !j->index ) )
+    {
+        j->index = ( struct MTBBranchRecord * )calloc( MTB_INDEX_SIZE, sizeof( struct MTBBranchRecord ) );
+        MEMCHECKV( j->index );
+    }
+}
+// ====================================================================================================
+uint64_t MTBDecoderIndexCount( struct TRACEDecoder *i )
+
+/* How many branch records have been reconstructed so far? */
+
+{
+    assert( i->protocol == TRACE_PROT_MTB );
+    return ( ( struct MTBDecodeState * )i->engine )->seq;
+}
+// ====================================================================================================
+bool MTBDecoderIndexRecord( struct TRACEDecoder *i, uint64_t seq, struct MTBBranchRecord *r )
+
+/* Retrieve a branch record by sequence number; fails if it has been evicted (or not yet seen) */
+
+{
+    assert( i->protocol == TRACE_PROT_MTB );
+    struct MTBDecodeState *j = ( struct MTBDecodeState * )i->engine;
+
+    if ( ( !j->index ) || ( seq >= j->seq ) || ( j->seq - seq > MTB_INDEX_SIZE ) )
+    {
+        return false;
+    }
+
+    *r = j->index[seq & ( MTB_INDEX_SIZE - 1 )];
+    return true;
+}
+// ====================================================================================================
 struct TRACEDecoderEngine *MTBDecoderPumpCreate( void )
 
 {
 
     struct TRACEDecoderEngine *e = ( struct TRACEDecoderEngine * )calloc( 1, sizeof( struct MTBDecodeState ) );
+    e->pump          = _pump;
     e->actionPair    = _pumpActionPair;
     e->destroy       = _pumpDestroy;
     e->synced        = _synced;
     e->forceSync     = _forceSync;
+    e->stateSize     = sizeof( struct MTBDecodeState );
     return e;
 }
 
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Target clock model
+ * ==================
+ *
+ * Keeps the running target timestamp for a tool and a nanoseconds-per-tick rate in
+ * Q32.32 fixed point. When the rate isn't pinned by the caller it is refitted about
+ * once a second from the wall clock and smoothed with an exponential moving average,
+ * so slow drift between target and host clocks is tracked without any per-message
+ * division or floating point.
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "tsclock.h"
+
+/* Refit the rate once this much wall time has been spanned */
+#define TSCLOCK_FIT_WINDOW_US  (1000000)
+
+/* A window this stale says the stream stalled; re-anchor without fitting. The limit
+ * also keeps the Q32.32 numerator of the fit division inside 64 bits.
+ */
+#define TSCLOCK_FIT_LIMIT_US   (4000000)
+
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Internal routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+static uint64_t _mulQ32( uint64_t a, uint64_t q )
+
+/* Return ( a * q ) >> 32, assembled from 32x32 partial products so no intermediate
+ * needs more than 64 bits.
+ */
+
+{
+    uint64_t ah = a >> 32;
+    uint64_t al = a & 0xffffffffULL;
+    uint64_t qh = q >> 32;
+    uint64_t ql = q & 0xffffffffULL;
+
+    return ( ( ah * qh ) << 32 ) + ah * ql + al * qh + ( ( al * ql ) >> 32 );
+}
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Externally available routines
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+void TSClockInit( struct TSClock *c, uint64_t cps )
+
+{
+    memset( c, 0, sizeof( struct TSClock ) );
+
+    if ( cps )
+    {
+        /* 1e9 < 2^32, so this shift cannot overflow */
+        c->nsPerTickQ32 = ( 1000000000ULL << 32 ) / cps;
+        c->pinned = true;
+    }
+}
+// ====================================================================================================
+void TSClockTick( struct TSClock *c, struct TSMsg *m, uint64_t walluS )
+
+{
+    assert( m->msgtype == MSG_TS );
+
+    c->ticks += m->timeInc;
+    c->status = m->timeStatus;
+
+    if ( c->pinned )
+    {
+        return;
+    }
+
+    if ( !c->refWalluS )
+    {
+        /* First observation just anchors the fit window */
+        c->refTicks = c->ticks;
+        c->refWalluS = walluS;
+        return;
+    }
+
+    uint64_t dWalluS = walluS - c->refWalluS;
+
+    if ( dWalluS < TSCLOCK_FIT_WINDOW_US )
+    {
+        return;
+    }
+
+    uint64_t dTicks = c->ticks - c->refTicks;
+
+    if ( ( dTicks ) && ( dWalluS < TSCLOCK_FIT_LIMIT_US ) )
+    {
+        uint64_t measured = ( ( dWalluS * 1000ULL ) << 32 ) / dTicks;
+
+        if ( c->nsPerTickQ32 )
+        {
+            /* EWMA with 1/8 gain; enough to follow drift, slow enough to ride out jitter */
+            c->nsPerTickQ32 += ( ( int64_t )( measured - c->nsPerTickQ32 ) ) / 8;
+        }
+        else
+        {
+            c->nsPerTickQ32 = measured;
+        }
+    }
+
+    c->refTicks = c->ticks;
+    c->refWalluS = walluS;
+}
+// ====================================================================================================
+uint64_t TSClockToNs( const struct TSClock *c, uint64_t ticks )
+
+{
+    return _mulQ32( ticks, c->nsPerTickQ32 );
+}
+// ====================================================================================================
+uint64_t TSClockToUs( const struct TSClock *c, uint64_t ticks )
+
+{
+    return _mulQ32( ticks, c->nsPerTickQ32 ) / 1000;
+}
+// ====================================================================================================
+uint64_t TSClockTicksPerSec( const struct TSClock *c )
+
+{
+    return c->nsPerTickQ32 ? ( 1000000000ULL << 32 ) / c->nsPerTickQ32 : 0;
+}
+// ====================================================================================================
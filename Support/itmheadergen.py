@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+#
+# Generate a single-header target-side ITM trace library from a channel definition file.
+#
+# The definition file uses the same comma syntax as the -c option of orbcat/orbfifo;
+#
+#   <channel>,<Name>[,<format>]
+#
+# one per line, '#' starts a comment. The optional format is the host-side presentation
+# string; it is carried into the header as a comment and as a ready-made orbcat command
+# line so the two sides of the link can't drift apart.
+#
+# The generated header is standalone (no CMSIS dependency) and the default per-channel
+# macros compile to a load, a test and a single store; when the port FIFO is busy, or
+# tracing is disabled, the write is dropped rather than stalling the application. _BLOCK
+# variants spin for the cases where losing a record is worse than waiting.
+#
+# Usage;
+#   ./itmheadergen.py <channels.def> [output.h]
+#
+
+import sys
+import re
+from datetime import date
+
+
+def parse(path):
+    """Return list of (channel, name, format-or-None) from a definition file"""
+    chans = []
+    seen = {}
+
+    for num, line in enumerate(open(path), start=1):
+        line = line.split('#', 1)[0].strip()
+        if not line:
+            continue
+
+        parts = line.split(',', 2)
+        if len(parts) < 2:
+            sys.exit("%s:%d: expected <channel>,<Name>[,<format>]" % (path, num))
+
+        try:
+            ch = int(parts[0], 0)
+        except ValueError:
+            sys.exit("%s:%d: channel '%s' is not a number" % (path, num, parts[0]))
+
+        if not 0 <= ch <= 31:
+            sys.exit("%s:%d: channel %d out of range 0..31" % (path, num, ch))
+
+        name = parts[1].strip()
+        if not re.fullmatch(r'[A-Za-z_][A-Za-z0-9_]*', name):
+            sys.exit("%s:%d: '%s' is not usable as a macro name" % (path, num, name))
+
+        if ch in seen:
+            sys.exit("%s:%d: channel %d already defined as '%s'" % (path, num, ch, seen[ch]))
+        seen[ch] = name
+
+        fmt = parts[2].strip() if len(parts) > 2 else None
+        chans.append((ch, name, fmt))
+
+    if not chans:
+        sys.exit("%s: no channel definitions found" % path)
+
+    return chans
+
+
+def emit(chans, out):
+    w = out.write
+    w("/* Generated by itmheadergen.py on %s -- edit the definition file, not this */\n" % date.today().isoformat())
+    w("""
+#ifndef ORB_TRACE_H_
+#define ORB_TRACE_H_
+
+#include <stdint.h>
+
+/* Cortex-M ITM register plumbing; fixed addresses across the architecture */
+#define ORB_ITM_STIM32( c ) ( *( volatile uint32_t * )( 0xE0000000UL + 4UL * ( c ) ) )
+#define ORB_ITM_STIM16( c ) ( *( volatile uint16_t * )( 0xE0000000UL + 4UL * ( c ) ) )
+#define ORB_ITM_STIM8( c )  ( *( volatile uint8_t  * )( 0xE0000000UL + 4UL * ( c ) ) )
+#define ORB_ITM_TER         ( *( volatile uint32_t * )0xE0000E00UL )
+#define ORB_ITM_TCR         ( *( volatile uint32_t * )0xE0000E80UL )
+#define ORB_DEMCR           ( *( volatile uint32_t * )0xE000EDFCUL )
+
+/* Reading a stimulus port returns its FIFO-ready flag, and reads as 0 whenever the port
+ * is disabled or tracing is off; so the try-write below is a load, a test and one store,
+ * and quietly costs only the load when nobody is listening.
+ */
+#define ORB_TRY32( c, x ) do { if ( ORB_ITM_STIM32( c ) ) { ORB_ITM_STIM32( c ) = ( uint32_t )( x ); } } while ( 0 )
+#define ORB_TRY16( c, x ) do { if ( ORB_ITM_STIM32( c ) ) { ORB_ITM_STIM16( c ) = ( uint16_t )( x ); } } while ( 0 )
+#define ORB_TRY8( c, x )  do { if ( ORB_ITM_STIM32( c ) ) { ORB_ITM_STIM8( c )  = ( uint8_t  )( x ); } } while ( 0 )
+
+/* Blocking variants, for records worth waiting for. These spin only while the FIFO is
+ * busy; a disabled port reads 0 forever, so the enable state is checked first to avoid
+ * hanging a build that runs without a debugger attached.
+ */
+#define ORB_ENABLED( c ) ( ( ORB_DEMCR & ( 1UL << 24 ) ) && ( ORB_ITM_TCR & 1UL ) && ( ORB_ITM_TER & ( 1UL << ( c ) ) ) )
+#define ORB_BLOCK32( c, x ) do { if ( ORB_ENABLED( c ) ) { while ( !ORB_ITM_STIM32( c ) ) {} ORB_ITM_STIM32( c ) = ( uint32_t )( x ); } } while ( 0 )
+#define ORB_BLOCK16( c, x ) do { if ( ORB_ENABLED( c ) ) { while ( !ORB_ITM_STIM32( c ) ) {} ORB_ITM_STIM16( c ) = ( uint16_t )( x ); } } while ( 0 )
+#define ORB_BLOCK8( c, x )  do { if ( ORB_ENABLED( c ) ) { while ( !ORB_ITM_STIM32( c ) ) {} ORB_ITM_STIM8( c )  = ( uint8_t  )( x ); } } while ( 0 )
+
+""")
+
+    w("/* Channels defined for this project */\n")
+
+    for ch, name, fmt in chans:
+        w("#define ORB_CHAN_%-24s ( %d )%s\n" % (name, ch, ("  /* %s */" % fmt) if fmt else ""))
+
+    mask = 0
+    for ch, _, _ in chans:
+        mask |= 1 << ch
+    w("\n/* Trace Enable Register bits covering every channel above */\n")
+    w("#define ORB_CHAN_TER_MASK ( 0x%08XUL )\n\n" % mask)
+
+    for ch, name, fmt in chans:
+        w("/* %s on channel %d%s */\n" % (name, ch, (", presented host-side as \"%s\"" % fmt) if fmt else ""))
+        w("#define ORB_%s( x )        ORB_TRY32( ORB_CHAN_%s, x )\n" % (name, name))
+        w("#define ORB_%s_8( x )      ORB_TRY8( ORB_CHAN_%s, x )\n" % (name, name))
+        w("#define ORB_%s_16( x )     ORB_TRY16( ORB_CHAN_%s, x )\n" % (name, name))
+        w("#define ORB_%s_BLOCK( x )  ORB_BLOCK32( ORB_CHAN_%s, x )\n\n" % (name, name))
+
+    w("""/* Enable the defined channels; tracing itself is normally turned on from the debugger
+ * side (see gdbtrace.init), this just makes sure our ports are in the enabled set.
+ */
+static inline void ORBchannelsInit( void )
+{
+    ORB_ITM_TER |= ORB_CHAN_TER_MASK;
+}
+
+""")
+
+    fmtchans = [(ch, fmt) for ch, _, fmt in chans if fmt]
+    if fmtchans:
+        w("/* Matching host-side presentation;\n *\n * orbcat %s\n */\n\n" %
+          " ".join('-c %d,"%s"' % (ch, fmt) for ch, fmt in fmtchans))
+
+    w("#endif /* ORB_TRACE_H_ */\n")
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit("Usage: %s <channels.def> [output.h]" % sys.argv[0])
+
+    chans = parse(sys.argv[1])
+    out = open(sys.argv[2], "w") if len(sys.argv) == 3 else sys.stdout
+    emit(chans, out)
+
+
+if __name__ == "__main__":
+    main()
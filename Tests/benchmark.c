@@ -0,0 +1,1049 @@
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Decode-rate benchmark
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+
+/* Drives the byte-pump hot paths (COBSPump, OFLOWPump, ITMPump, TPIUPump and TRACEDecoderPump)
+ * over synthetic corpora, or over a recorded corpus if a filename is given on the command line,
+ * and reports MB/s and cycles/byte per decoder as JSON on stdout.
+ *
+ * Given a directory instead of a file, every regular file in it is replayed in parallel
+ * worker processes; each file gets per-file MB/s plus a stable FNV-1a digest of the decoded
+ * output, so a corpus run doubles as a one-command decode regression gate.
+ *
+ * Build via the 'benchmark' target in meson, or standalone with;
+ * gcc Tests/benchmark.c Src/cobs.c Src/oflow.c Src/itmDecoder.c Src/msgDecoder.c Src/tpiuDecoder.c \
+ *     Src/traceDecoder.c Src/traceDecoder_etm35.c Src/traceDecoder_etm4.c Src/traceDecoder_mtb.c \
+ *     Src/generics.c -IInc -IInc/external -O2 -o benchmark
+ * Execute with;
+ * ./benchmark [recorded_corpus_file | corpus_directory]
+ * or distil a fuzzing corpus into a worst-case benchmark suite with;
+ * ./benchmark --distill <fuzz_directory> <suite_directory>
+ * or mine the recoverable frames out of a damaged OFLOW capture with;
+ * ./benchmark --salvage <damaged_capture> <repaired_capture>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include <errno.h>
+#ifndef WIN32
+    #include <unistd.h>
+    #include <dirent.h>
+    #include <sys/stat.h>
+    #include <sys/wait.h>
+#endif
+
+#include "cobs.h"
+#include "oflow.h"
+#include "itmDecoder.h"
+#include "tpiuDecoder.h"
+#include "traceDecoder.h"
+
+#define CORPUS_SIZE     (4 * 1024 * 1024)    /* Bytes of synthetic corpus per decoder */
+#define REPEATS         (16)                 /* Passes over the corpus per measurement */
+#define CHUNK_SIZE      (65536)              /* Feed size per pump call, like a read loop would use */
+
+/* Something for the callbacks to do, so the work can't be optimised away */
+static volatile uint64_t _sink;
+
+// ====================================================================================================
+static uint64_t _nsNow( void )
+
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint64_t )ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+// ====================================================================================================
+static inline uint64_t _cycles( void )
+
+/* Raw cycle (or constant-rate counter) read where the architecture gives us one, else 0 */
+
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ volatile ( "rdtsc" : "=a" ( lo ), "=d" ( hi ) );
+    return ( ( uint64_t )hi << 32 ) | lo;
+#elif defined(__aarch64__)
+    uint64_t c;
+    __asm__ volatile ( "mrs %0, cntvct_el0" : "=r" ( c ) );
+    return c;
+#else
+    return 0;
+#endif
+}
+// ====================================================================================================
+// Corpus builders
+// ====================================================================================================
+static int _buildITMCorpus( uint8_t *d, int size )
+
+/* A representative ITM stream; SW packets of each size over several channels, periodic syncs and timestamps */
+
+{
+    int len = 0;
+    uint32_t v = 0x12345678;
+
+    while ( len < size - 32 )
+    {
+        if ( !( v % 97 ) )
+        {
+            /* Periodic sync sequence */
+            memcpy( &d[len], "\x00\x00\x00\x00\x00\x80", 6 );
+            len += 6;
+        }
+
+        switch ( v % 3 )
+        {
+            case 0: /* One byte SW packet */
+                d[len++] = ( ( v % 29 ) << 3 ) | 1;
+                d[len++] = v & 0xff;
+                break;
+
+            case 1: /* Two byte SW packet */
+                d[len++] = ( ( v % 29 ) << 3 ) | 2;
+                d[len++] = v & 0xff;
+                d[len++] = ( v >> 8 ) & 0xff;
+                break;
+
+            default: /* Four byte SW packet */
+                d[len++] = ( ( v % 29 ) << 3 ) | 3;
+                memcpy( &d[len], &v, 4 );
+                len += 4;
+                break;
+        }
+
+        /* Local timestamp packet now and again */
+        if ( !( v % 13 ) )
+        {
+            d[len++] = 0xc0;
+            d[len++] = ( v >> 4 ) & 0x7f;
+            d[len++] = ( v >> 11 ) & 0x0f;
+        }
+
+        v = v * 1103515245 + 12345;
+    }
+
+    return len;
+}
+// ====================================================================================================
+static int _buildOFLOWCorpus( uint8_t *d, int size, const uint8_t *itm, int itmLen )
+
+/* The ITM corpus cut into OFLOW (COBS framed) packets, as it would arrive from an orbtrace */
+
+{
+    struct Frame f;
+    int len = 0;
+    int i = 0;
+
+    while ( ( i < itmLen ) && ( len + OFLOW_MAX_ENC_PACKET_LEN < size ) )
+    {
+        int take = ( itmLen - i ) < 512 ? ( itmLen - i ) : 512;
+        OFLOWEncode( 1, 0, &itm[i], take, &f );
+        memcpy( &d[len], f.d, f.len );
+        len += f.len;
+        i += take;
+    }
+
+    return len;
+}
+// ====================================================================================================
+static int _buildTPIUCorpus( uint8_t *d, int size, const uint8_t *itm, int itmLen )
+
+/* The ITM corpus wrapped into 16-byte TPIU frames on stream 1, with a leading sync */
+
+{
+    int len = 0;
+    int i = 0;
+
+    memcpy( &d[len], "\xff\xff\xff\x7f", 4 );
+    len += 4;
+
+    while ( ( i + 15 <= itmLen ) && ( len + TPIU_PACKET_LEN < size ) )
+    {
+        /* First byte carries the stream ID, odd bytes carry the aux bits (all zero here) */
+        d[len++] = ( 1 << 1 ) | 1;
+
+        for ( int b = 0; b < 14; b++ )
+        {
+            d[len++] = itm[i++];
+        }
+
+        d[len++] = itm[i++] & 0xfe;
+    }
+
+    return len;
+}
+// ====================================================================================================
+static int _buildMTBCorpus( uint8_t *d, int size )
+
+/* Forward-branching from/to address pairs, as read out of a Micro Trace Buffer */
+
+{
+    int len = 0;
+    uint32_t addr = 0x1000;
+
+    while ( len + 8 <= size )
+    {
+        uint32_t src = addr + 0x20;
+        uint32_t dst = addr + 0x40;
+        memcpy( &d[len], &src, 4 );
+        memcpy( &d[len + 4], &dst, 4 );
+        len += 8;
+        addr = dst;
+    }
+
+    return len;
+}
+// ====================================================================================================
+// Per-decoder callbacks; just count, the decode itself is what is being measured
+// ====================================================================================================
+static void _cobsCB( struct Frame *p, void *param )
+{
+    _sink += p->len;
+}
+// ====================================================================================================
+static void _oflowCB( struct OFLOWFrame *p, void *param )
+{
+    _sink += p->len;
+}
+// ====================================================================================================
+static void _itmCB( enum ITMPumpEvent e, void *param )
+{
+    _sink += e;
+}
+// ====================================================================================================
+static void _tpiuCB( enum TPIUPumpEvent e, struct TPIUPacket *p, void *param )
+{
+    _sink += e;
+}
+// ====================================================================================================
+static void _traceCB( void *d )
+{
+    _sink++;
+}
+// ====================================================================================================
+// Measurement
+// ====================================================================================================
+typedef void ( *pumpFn )( void *ctx, const uint8_t *d, int len );
+
+static void _measure( const char *name, pumpFn pump, void *ctx, const uint8_t *corpus, int corpusLen, bool first )
+
+/* Run the pump over the corpus repeatedly and emit one JSON record for it */
+
+{
+    uint64_t totalBytes = 0;
+    uint64_t startNs = _nsNow();
+    uint64_t startCy = _cycles();
+
+    for ( int r = 0; r < REPEATS; r++ )
+    {
+        int i = 0;
+
+        while ( i < corpusLen )
+        {
+            int take = ( corpusLen - i ) < CHUNK_SIZE ? ( corpusLen - i ) : CHUNK_SIZE;
+            pump( ctx, &corpus[i], take );
+            i += take;
+            totalBytes += take;
+        }
+    }
+
+    uint64_t elapsedNs = _nsNow() - startNs;
+    uint64_t elapsedCy = _cycles() - startCy;
+
+    double secs = ( double )elapsedNs / 1e9;
+    double mbs = ( ( double )totalBytes / ( 1024.0 * 1024.0 ) ) / secs;
+    double cpb = totalBytes ? ( double )elapsedCy / ( double )totalBytes : 0;
+
+    printf( "%s    { \"name\": \"%s\", \"bytes\": %" PRIu64 ", \"seconds\": %.6f, \"mb_per_s\": %.2f, \"cycles_per_byte\": %.3f }",
+            first ? "" : "," EOL, name, totalBytes, secs, mbs, cpb );
+}
+// ====================================================================================================
+// Pump adaptors
+// ====================================================================================================
+static void _pumpCOBS( void *ctx, const uint8_t *d, int len )
+{
+    COBSPump( ( struct COBS * )ctx, d, len, _cobsCB, NULL );
+}
+// ====================================================================================================
+static void _pumpOFLOW( void *ctx, const uint8_t *d, int len )
+{
+    OFLOWPump( ( struct OFLOW * )ctx, d, len, _oflowCB, NULL );
+}
+// ====================================================================================================
+static void _pumpITM( void *ctx, const uint8_t *d, int len )
+{
+    ITMPumpBuffer( ( struct ITMDecoder * )ctx, d, len, _itmCB, NULL );
+}
+// ====================================================================================================
+static void _pumpTPIU( void *ctx, const uint8_t *d, int len )
+{
+    TPIUPump( ( struct TPIUDecoder * )ctx, ( uint8_t * )d, len, _tpiuCB, NULL );
+}
+// ====================================================================================================
+static void _pumpTRACE( void *ctx, const uint8_t *d, int len )
+{
+    TRACEDecoderPump( ( struct TRACEDecoder * )ctx, ( uint8_t * )d, len, _traceCB, NULL );
+}
+// ====================================================================================================
+// Parallel corpus replay
+// ====================================================================================================
+#ifndef WIN32
+
+#define REPLAY_REPEATS  (4)                  /* Passes per file; digests must agree across them */
+#define REPLAY_MAX_LINE (512)                /* One result record; must stay within PIPE_BUF */
+
+struct replayDigest
+{
+    uint64_t h;                              /* Running FNV-1a over decoded output */
+};
+
+// ====================================================================================================
+static uint64_t _fnv1a( uint64_t h, const void *d, size_t len )
+
+{
+    const uint8_t *p = ( const uint8_t * )d;
+
+    while ( len-- )
+    {
+        h = ( h ^ *p++ ) * 0x100000001b3ULL;
+    }
+
+    return h;
+}
+// ====================================================================================================
+static void _replayOflowCB( struct OFLOWFrame *p, void *param )
+
+{
+    struct replayDigest *g = ( struct replayDigest * )param;
+
+    g->h = _fnv1a( g->h, &p->tag, 1 );
+    g->h = _fnv1a( g->h, p->d, p->len );
+}
+// ====================================================================================================
+static struct ITMDecoder _replayItm;       /* Worker-local; each file runs in its own process */
+
+static void _replayItmCB( enum ITMPumpEvent e, void *param )
+
+{
+    struct replayDigest *g = ( struct replayDigest * )param;
+
+    if ( e == ITM_EV_PACKET_RXED )
+    {
+        struct ITMPacket pkt;
+
+        if ( ITMGetPacket( &_replayItm, &pkt ) )
+        {
+            g->h = _fnv1a( g->h, &pkt.srcAddr, sizeof( pkt.srcAddr ) );
+            g->h = _fnv1a( g->h, &pkt.len, sizeof( pkt.len ) );
+            g->h = _fnv1a( g->h, pkt.d, pkt.len );
+        }
+    }
+}
+// ====================================================================================================
+static bool _replayFile( const char *path, const char *name, char *record, size_t recordLen )
+
+/* Replay one file through the OFLOW and ITM pumps, digesting the decoded output. Each pass
+ * starts from freshly initialised decoders, so the digest must be identical every time; a
+ * mismatch means decode isn't deterministic and is reported as such.
+ */
+
+{
+    FILE *f = fopen( path, "rb" );
+
+    if ( !f )
+    {
+        return false;
+    }
+
+    fseek( f, 0, SEEK_END );
+    long fileLen = ftell( f );
+    fseek( f, 0, SEEK_SET );
+
+    uint8_t *d = ( uint8_t * )malloc( fileLen ? fileLen : 1 );
+
+    if ( ( !d ) || ( fread( d, 1, fileLen, f ) != ( size_t )fileLen ) )
+    {
+        fclose( f );
+        free( d );
+        return false;
+    }
+
+    fclose( f );
+
+    uint64_t digest = 0;
+    bool stable = true;
+    uint64_t startNs = _nsNow();
+
+    for ( int r = 0; r < REPLAY_REPEATS; r++ )
+    {
+        struct replayDigest g = { .h = 0xcbf29ce484222325ULL };
+        struct OFLOW o;
+
+        /* Neither init call fully resets reused storage (ForceSync preserves a mid-packet
+         * state), so scrub both decoders for a genuinely identical start every pass */
+        memset( &o, 0, sizeof( o ) );
+        OFLOWInit( &o );
+        memset( &_replayItm, 0, sizeof( _replayItm ) );
+        ITMDecoderInit( &_replayItm, true );
+
+        long i = 0;
+
+        while ( i < fileLen )
+        {
+            int take = ( fileLen - i ) < CHUNK_SIZE ? ( int )( fileLen - i ) : CHUNK_SIZE;
+            OFLOWPump( &o, &d[i], take, _replayOflowCB, &g );
+            ITMPumpBuffer( &_replayItm, &d[i], take, _replayItmCB, &g );
+            i += take;
+        }
+
+        if ( !r )
+        {
+            digest = g.h;
+        }
+        else if ( g.h != digest )
+        {
+            stable = false;
+        }
+    }
+
+    uint64_t elapsedNs = _nsNow() - startNs;
+    double secs = ( double )elapsedNs / 1e9;
+    double mbs = secs ? ( ( double )fileLen * REPLAY_REPEATS / ( 1024.0 * 1024.0 ) ) / secs : 0;
+
+    snprintf( record, recordLen,
+              "    { \"file\": \"%s\", \"bytes\": %ld, \"mb_per_s\": %.2f, \"digest\": \"%016" PRIx64 "\", \"deterministic\": %s }" EOL,
+              name, fileLen, mbs, digest, stable ? "true" : "false" );
+    free( d );
+    return true;
+}
+// ====================================================================================================
+static int _recordCompare( const void *a, const void *b )
+
+{
+    return strcmp( *( const char *const * )a, *( const char *const * )b );
+}
+// ====================================================================================================
+static int _replayCorpus( const char *dir )
+
+/* Replay every regular file in the directory, farming files out to one worker process per
+ * CPU. Workers report over a shared pipe, one atomic record each, and the collected records
+ * are sorted by filename so the report is stable however the workers were scheduled.
+ */
+
+{
+    struct dirent **list;
+    int nFiles = scandir( dir, &list, NULL, alphasort );
+
+    if ( nFiles < 0 )
+    {
+        fprintf( stderr, "Couldn't read corpus directory %s" EOL, dir );
+        return -1;
+    }
+
+    int pfd[2];
+
+    if ( pipe( pfd ) )
+    {
+        return -1;
+    }
+
+    long maxWorkers = sysconf( _SC_NPROCESSORS_ONLN );
+
+    if ( maxWorkers < 1 )
+    {
+        maxWorkers = 1;
+    }
+
+    int live = 0;
+    int launched = 0;
+
+    for ( int i = 0; i < nFiles; i++ )
+    {
+        char path[4096];
+        struct stat s;
+
+        snprintf( path, sizeof( path ), "%s/%s", dir, list[i]->d_name );
+
+        if ( ( stat( path, &s ) ) || ( !S_ISREG( s.st_mode ) ) )
+        {
+            continue;
+        }
+
+        if ( live == maxWorkers )
+        {
+            wait( NULL );
+            live--;
+        }
+
+        if ( !fork() )
+        {
+            /* Worker: one file, one record, one atomic write */
+            char record[REPLAY_MAX_LINE];
+
+            close( pfd[0] );
+
+            if ( _replayFile( path, list[i]->d_name, record, sizeof( record ) ) )
+            {
+                if ( write( pfd[1], record, strlen( record ) ) < 0 )
+                {
+                    _exit( 1 );
+                }
+            }
+
+            _exit( 0 );
+        }
+
+        live++;
+        launched++;
+    }
+
+    while ( live-- )
+    {
+        wait( NULL );
+    }
+
+    close( pfd[1] );
+
+    /* Collect the records, then sort for a stable report */
+    size_t got = 0;
+    size_t cap = ( size_t )( launched ? launched : 1 ) * REPLAY_MAX_LINE + 1;
+    char *all = ( char * )malloc( cap );
+    ssize_t n;
+
+    while ( ( n = read( pfd[0], &all[got], cap - 1 - got ) ) > 0 )
+    {
+        got += n;
+    }
+
+    close( pfd[0] );
+    all[got] = 0;
+
+    char **lines = ( char ** )malloc( ( launched ? launched : 1 ) * sizeof( char * ) );
+    int nLines = 0;
+
+    for ( char *p = strtok( all, "\n" ); ( p ) && ( nLines < launched ); p = strtok( NULL, "\n" ) )
+    {
+        lines[nLines++] = p;
+    }
+
+    qsort( lines, nLines, sizeof( char * ), _recordCompare );
+
+    printf( "{" EOL "  \"corpus\": \"%s\"," EOL "  \"replay\": [" EOL, dir );
+
+    for ( int i = 0; i < nLines; i++ )
+    {
+        printf( "%s%s", lines[i], ( i < nLines - 1 ) ? "," EOL : EOL );
+    }
+
+    printf( "  ]" EOL "}" EOL );
+
+    free( lines );
+    free( all );
+
+    for ( int i = 0; i < nFiles; i++ )
+    {
+        free( list[i] );
+    }
+
+    free( list );
+    return 0;
+}
+// ====================================================================================================
+// Corpus distillation
+// ====================================================================================================
+
+/* Fuzzers leave thousands of inputs behind; only a few are interesting for performance. Each
+ * input is scored with its decode cost and a signature of which decoder behaviours it reached,
+ * then a greedy pass in cost order keeps just the inputs that add unseen behaviour (plus the
+ * outright most expensive ones), copying the winners into a directory the replay mode accepts.
+ */
+
+#define DISTILL_MAP_BITS (4096)              /* Behaviour signature size; collisions just merge features */
+#define DISTILL_KEEP_TOP (8)                 /* Most expensive inputs kept even without new behaviour */
+
+struct distillScore
+{
+    char *name;                              /* Filename within the fuzz directory */
+    long bytes;
+    double nsPerByte;                        /* Decode cost summed over the three pumps */
+    bool selected;
+    uint8_t map[DISTILL_MAP_BITS / 8];       /* Which behaviour features this input reached */
+};
+
+static struct ITMDecoder _distillItm;        /* The ITM feature callback needs packet readback */
+static struct TRACEDecoder _distillTrace;    /* The TRACE feature callback reads change flags */
+
+// ====================================================================================================
+static void _distillMark( uint8_t *map, uint32_t domain, uint32_t value )
+
+/* Fold one observed decode behaviour into the signature bitmap */
+
+{
+    uint32_t bit = ( ( domain << 24 ) ^ ( value * 2654435761U ) ) % DISTILL_MAP_BITS;
+    map[bit / 8] |= 1 << ( bit % 8 );
+}
+// ====================================================================================================
+static void _distillCobsCB( struct Frame *p, void *param )
+
+{
+    uint32_t b = 0;
+
+    /* Frame length bucketed to its power of two; exact lengths would swamp the map */
+    while ( ( 1U << b ) < ( uint32_t )p->len )
+    {
+        b++;
+    }
+
+    _distillMark( ( uint8_t * )param, 0, b );
+}
+// ====================================================================================================
+static void _distillItmCB( enum ITMPumpEvent e, void *param )
+
+{
+    uint8_t *map = ( uint8_t * )param;
+
+    _distillMark( map, 1, e );
+
+    if ( e == ITM_EV_PACKET_RXED )
+    {
+        struct ITMPacket pkt;
+
+        if ( ITMGetPacket( &_distillItm, &pkt ) )
+        {
+            _distillMark( map, 2, ( pkt.srcAddr << 3 ) | pkt.len );
+        }
+    }
+}
+// ====================================================================================================
+static void _distillTraceCB( void *param )
+
+{
+    uint8_t *map = ( uint8_t * )param;
+
+    for ( int c = 0; c < EV_CH_NUM_CHANGES; c++ )
+    {
+        if ( TRACEStateChanged( &_distillTrace, c ) )
+        {
+            _distillMark( map, 3, c );
+        }
+    }
+}
+// ====================================================================================================
+static bool _distillScoreFile( const char *path, struct distillScore *s )
+
+/* Run one input through the COBS, ITM and TRACE pumps, timing the lot and collecting the
+ * behaviour signature. ETM3.5 is the trace protocol here because that's what the fuzzers
+ * drive through orbmortem.
+ */
+
+{
+    FILE *f = fopen( path, "rb" );
+
+    if ( !f )
+    {
+        return false;
+    }
+
+    fseek( f, 0, SEEK_END );
+    long fileLen = ftell( f );
+    fseek( f, 0, SEEK_SET );
+
+    uint8_t *d = ( uint8_t * )malloc( fileLen ? fileLen : 1 );
+
+    if ( ( !d ) || ( fread( d, 1, fileLen, f ) != ( size_t )fileLen ) )
+    {
+        fclose( f );
+        free( d );
+        return false;
+    }
+
+    fclose( f );
+
+    struct COBS c;
+    COBSInit( &c );
+    memset( &_distillItm, 0, sizeof( _distillItm ) );
+    ITMDecoderInit( &_distillItm, true );
+    memset( &_distillTrace, 0, sizeof( _distillTrace ) );
+    TRACEDecoderInit( &_distillTrace, TRACE_PROT_ETM35, false, NULL );
+
+    uint64_t startNs = _nsNow();
+    long i = 0;
+
+    while ( i < fileLen )
+    {
+        int take = ( fileLen - i ) < CHUNK_SIZE ? ( int )( fileLen - i ) : CHUNK_SIZE;
+        COBSPump( &c, &d[i], take, _distillCobsCB, s->map );
+        ITMPumpBuffer( &_distillItm, &d[i], take, _distillItmCB, s->map );
+        TRACEDecoderPump( &_distillTrace, &d[i], take, _distillTraceCB, s->map );
+        i += take;
+    }
+
+    s->bytes = fileLen;
+    s->nsPerByte = fileLen ? ( double )( _nsNow() - startNs ) / ( double )fileLen : 0;
+    free( d );
+    return true;
+}
+// ====================================================================================================
+static int _distillCompare( const void *a, const void *b )
+
+{
+    double da = ( *( const struct distillScore *const * )a )->nsPerByte;
+    double db = ( *( const struct distillScore *const * )b )->nsPerByte;
+
+    return ( da < db ) - ( da > db );
+}
+// ====================================================================================================
+static bool _distillCopy( const char *from, const char *to )
+
+{
+    FILE *src = fopen( from, "rb" );
+    FILE *dst = src ? fopen( to, "wb" ) : NULL;
+    uint8_t buf[65536];
+    size_t n;
+    bool ok = ( dst != NULL );
+
+    while ( ( ok ) && ( ( n = fread( buf, 1, sizeof( buf ), src ) ) > 0 ) )
+    {
+        ok = ( fwrite( buf, 1, n, dst ) == n );
+    }
+
+    if ( src )
+    {
+        fclose( src );
+    }
+
+    if ( dst )
+    {
+        ok = ( !fclose( dst ) ) && ok;
+    }
+
+    return ok;
+}
+// ====================================================================================================
+static int _distillCorpus( const char *inDir, const char *outDir )
+
+/* Score every regular file in the fuzz directory, then select greedily by descending cost so
+ * each behaviour is represented by its most expensive exponent. Scoring is sequential; the
+ * timings are the selection key and mustn't fight other workers for the machine.
+ */
+
+{
+    struct dirent **list;
+    int nFiles = scandir( inDir, &list, NULL, alphasort );
+
+    if ( nFiles < 0 )
+    {
+        fprintf( stderr, "Couldn't read corpus directory %s" EOL, inDir );
+        return -1;
+    }
+
+    if ( ( mkdir( outDir, 0755 ) ) && ( errno != EEXIST ) )
+    {
+        fprintf( stderr, "Couldn't create suite directory %s" EOL, outDir );
+        return -1;
+    }
+
+    struct distillScore *score = ( struct distillScore * )calloc( nFiles, sizeof( struct distillScore ) );
+    struct distillScore **order = ( struct distillScore ** )malloc( nFiles * sizeof( struct distillScore * ) );
+    int nScored = 0;
+
+    for ( int i = 0; i < nFiles; i++ )
+    {
+        char path[4096];
+        struct stat st;
+
+        snprintf( path, sizeof( path ), "%s/%s", inDir, list[i]->d_name );
+
+        if ( ( stat( path, &st ) ) || ( !S_ISREG( st.st_mode ) ) )
+        {
+            continue;
+        }
+
+        score[nScored].name = list[i]->d_name;
+
+        if ( _distillScoreFile( path, &score[nScored] ) )
+        {
+            order[nScored] = &score[nScored];
+            nScored++;
+        }
+    }
+
+    qsort( order, nScored, sizeof( struct distillScore * ), _distillCompare );
+
+    /* Greedy cover; most expensive input first, so any behaviour bit is claimed by the
+     * costliest input that reaches it */
+    uint8_t covered[DISTILL_MAP_BITS / 8] = { 0 };
+    int nSelected = 0;
+
+    printf( "{" EOL "  \"corpus\": \"%s\"," EOL "  \"suite\": \"%s\"," EOL "  \"distilled\": [" EOL, inDir, outDir );
+
+    for ( int i = 0; i < nScored; i++ )
+    {
+        struct distillScore *s = order[i];
+        int newBits = 0;
+
+        for ( int b = 0; b < DISTILL_MAP_BITS / 8; b++ )
+        {
+            uint8_t add = s->map[b] & ~covered[b];
+
+            covered[b] |= add;
+
+            while ( add )
+            {
+                newBits += add & 1;
+                add >>= 1;
+            }
+        }
+
+        if ( ( !newBits ) && ( i >= DISTILL_KEEP_TOP ) )
+        {
+            continue;
+        }
+
+        char from[4096];
+        char to[4096];
+        snprintf( from, sizeof( from ), "%s/%s", inDir, s->name );
+        snprintf( to, sizeof( to ), "%s/%s", outDir, s->name );
+
+        if ( !_distillCopy( from, to ) )
+        {
+            fprintf( stderr, "Couldn't copy %s into the suite" EOL, s->name );
+            continue;
+        }
+
+        printf( "%s    { \"file\": \"%s\", \"bytes\": %ld, \"ns_per_byte\": %.3f, \"new_behaviours\": %d }",
+                nSelected ? "," EOL : "", s->name, s->bytes, s->nsPerByte, newBits );
+        nSelected++;
+        s->selected = true;
+    }
+
+    printf( EOL "  ]," EOL "  \"examined\": %d," EOL "  \"selected\": %d" EOL "}" EOL, nScored, nSelected );
+
+    free( order );
+    free( score );
+
+    for ( int i = 0; i < nFiles; i++ )
+    {
+        free( list[i] );
+    }
+
+    free( list );
+    return 0;
+}
+#endif
+// ====================================================================================================
+// Capture salvage
+// ====================================================================================================
+
+/* Block-reads a damaged capture through the OFLOW salvage scanner, re-encodes every frame
+ * that proved out into a clean capture any of the tools can consume, and reports the gap
+ * map and recovery statistics as JSON.
+ */
+
+#define SALVAGE_BLOCK_SIZE (1024 * 1024)     /* Read granularity over the damaged capture */
+
+struct salvageSink
+{
+    FILE *out;                               /* Repaired capture under construction */
+    struct Frame enc;                        /* Re-encode target for recovered frames */
+    uint64_t gapsPrinted;                    /* Gap records already emitted, for JSON commas */
+    bool writeFailed;                        /* Writing the repaired capture went wrong */
+};
+
+static void _salvageFrameCB( uint64_t at, struct OFLOWFrame *p, void *param )
+
+{
+    struct salvageSink *k = ( struct salvageSink * )param;
+
+    OFLOWEncode( p->tag, 0, p->d, p->len, &k->enc );
+
+    if ( fwrite( k->enc.d, 1, k->enc.len, k->out ) != k->enc.len )
+    {
+        k->writeFailed = true;
+    }
+}
+
+static void _salvageGapCB( uint64_t at, uint64_t len, void *param )
+
+{
+    struct salvageSink *k = ( struct salvageSink * )param;
+
+    printf( "%s    { \"at\": %" PRIu64 ", \"len\": %" PRIu64 " }",
+            k->gapsPrinted ? "," EOL : "", at, len );
+    k->gapsPrinted++;
+}
+
+static int _salvageCapture( const char *inFile, const char *outFile )
+
+{
+    static struct OFLOWSalvage sv;           /* Off the stack; it embeds two frame buffers */
+    struct salvageSink k = { 0 };
+    uint8_t *block = ( uint8_t * )malloc( SALVAGE_BLOCK_SIZE );
+    FILE *in = fopen( inFile, "rb" );
+    int n;
+
+    if ( ( !block ) || ( !in ) )
+    {
+        fprintf( stderr, "Couldn't open damaged capture %s" EOL, inFile );
+        return -1;
+    }
+
+    if ( !( k.out = fopen( outFile, "wb" ) ) )
+    {
+        fprintf( stderr, "Couldn't create repaired capture %s" EOL, outFile );
+        fclose( in );
+        return -1;
+    }
+
+    printf( "{" EOL "  \"damaged\": \"%s\"," EOL "  \"repaired\": \"%s\"," EOL "  \"gaps\": [" EOL, inFile, outFile );
+
+    OFLOWSalvageInit( &sv, _salvageFrameCB, _salvageGapCB, &k );
+
+    uint64_t startNs = _nsNow();
+
+    while ( ( n = fread( block, 1, SALVAGE_BLOCK_SIZE, in ) ) > 0 )
+    {
+        OFLOWSalvagePump( &sv, block, n );
+    }
+
+    OFLOWSalvageFinalise( &sv );
+
+    uint64_t elapsedNs = _nsNow() - startNs;
+
+    fclose( in );
+    free( block );
+
+    if ( ( fclose( k.out ) ) || ( k.writeFailed ) )
+    {
+        fprintf( stderr, "Couldn't write repaired capture %s" EOL, outFile );
+        return -1;
+    }
+
+    printf( EOL "  ]," EOL );
+    printf( "  \"frames_recovered\": %" PRIu64 "," EOL, sv.framesRecovered );
+    printf( "  \"payload_bytes_recovered\": %" PRIu64 "," EOL, sv.bytesRecovered );
+    printf( "  \"gap_count\": %" PRIu64 "," EOL, sv.gaps );
+    printf( "  \"bytes_lost\": %" PRIu64 "," EOL, sv.bytesLost );
+    printf( "  \"mbytes_per_sec\": %.1f" EOL "}" EOL,
+            elapsedNs ? ( ( double )sv.offset * 1000.0 ) / ( double )elapsedNs : 0.0 );
+
+    return 0;
+}
+// ====================================================================================================
+int main( int argc, char *argv[] )
+
+{
+    uint8_t *corpus = NULL;
+    int corpusLen = 0;
+    bool recorded = false;
+
+    uint8_t *itm = ( uint8_t * )malloc( CORPUS_SIZE );
+    uint8_t *enc = ( uint8_t * )malloc( CORPUS_SIZE * 2 );
+
+    if ( ( !itm ) || ( !enc ) )
+    {
+        fprintf( stderr, "Out of memory" EOL );
+        return -1;
+    }
+
+#ifndef WIN32
+
+    if ( ( argc == 4 ) && ( !strcmp( argv[1], "--distill" ) ) )
+    {
+        free( itm );
+        free( enc );
+        return _distillCorpus( argv[2], argv[3] );
+    }
+
+#endif
+
+    if ( ( argc == 4 ) && ( !strcmp( argv[1], "--salvage" ) ) )
+    {
+        free( itm );
+        free( enc );
+        return _salvageCapture( argv[2], argv[3] );
+    }
+
+#ifndef WIN32
+
+    if ( argc > 1 )
+    {
+        /* A directory means parallel replay of the whole corpus within it */
+        struct stat s;
+
+        if ( ( !stat( argv[1], &s ) ) && ( S_ISDIR( s.st_mode ) ) )
+        {
+            free( itm );
+            free( enc );
+            return _replayCorpus( argv[1] );
+        }
+    }
+
+#endif
+
+    if ( argc > 1 )
+    {
+        /* A recorded corpus; every decoder gets the file verbatim */
+        FILE *f = fopen( argv[1], "rb" );
+
+        if ( !f )
+        {
+            fprintf( stderr, "Couldn't open corpus file %s" EOL, argv[1] );
+            return -1;
+        }
+
+        corpus = ( uint8_t * )malloc( CORPUS_SIZE );
+        corpusLen = fread( corpus, 1, CORPUS_SIZE, f );
+        fclose( f );
+        recorded = true;
+    }
+
+    int itmLen = _buildITMCorpus( itm, CORPUS_SIZE );
+
+    printf( "{" EOL "  \"corpus\": \"%s\"," EOL "  \"benchmarks\": [" EOL, recorded ? argv[1] : "synthetic" );
+
+    /* COBS */
+    struct COBS c;
+    COBSInit( &c );
+    int encLen = recorded ? corpusLen : _buildOFLOWCorpus( enc, CORPUS_SIZE * 2, itm, itmLen );
+    _measure( "COBSPump", _pumpCOBS, &c, recorded ? corpus : enc, encLen, true );
+
+    /* OFLOW */
+    struct OFLOW o;
+    memset( &o, 0, sizeof( o ) );
+    OFLOWInit( &o );
+    _measure( "OFLOWPump", _pumpOFLOW, &o, recorded ? corpus : enc, encLen, false );
+
+    /* ITM */
+    struct ITMDecoder i;
+    ITMDecoderInit( &i, true );
+    _measure( "ITMPump", _pumpITM, &i, recorded ? corpus : itm, recorded ? corpusLen : itmLen, false );
+
+    /* TPIU */
+    struct TPIUDecoder t;
+    TPIUDecoderInit( &t );
+    encLen = recorded ? corpusLen : _buildTPIUCorpus( enc, CORPUS_SIZE * 2, itm, itmLen );
+    _measure( "TPIUPump", _pumpTPIU, &t, recorded ? corpus : enc, encLen, false );
+
+    /* TRACE (MTB protocol; the only one we can synthesise a valid stream for) */
+    struct TRACEDecoder tr;
+    TRACEDecoderInit( &tr, TRACE_PROT_MTB, false, NULL );
+    encLen = recorded ? corpusLen : _buildMTBCorpus( enc, CORPUS_SIZE );
+    _measure( "TRACEDecoderPump", _pumpTRACE, &tr, recorded ? corpus : enc, encLen, false );
+
+    printf( EOL "  ]" EOL "}" EOL );
+
+    free( itm );
+    free( enc );
+    free( corpus );
+    return 0;
+}
+// ====================================================================================================
@@ -58,6 +58,19 @@ void _packetRxed ( struct Frame *p, void *param )
     struct test *t = ( struct test * )param;
     int k;
 
+    uint8_t sum = 0;
+
+    for ( k = 0; k < p->len; k++ )
+    {
+        sum += p->d[k];
+    }
+
+    if ( sum != p->sum )
+    {
+        fprintf( stderr, "*********FAILED running sum %02x vs computed %02x\n", p->sum, sum );
+        return;
+    }
+
     for ( k = 0; ( ( k < p->len ) && ( p->d[k] == t->dec.d[k] ) ); k++ ) {}
 
     if ( k != p->len )
@@ -167,7 +180,7 @@ int main( int argc, void **argv )
     for ( int i = 0; i < sizeof( testSet ) / sizeof( struct test ); i++ )
     {
         fprintf( stderr, "%d: ", i + 1 );
-        COBSEncode( NULL, 0, testSet[i].dec.d, testSet[i].dec.len, &o );
+        COBSEncode( NULL, 0, NULL, 0, testSet[i].dec.d, testSet[i].dec.len, &o );
 
         if ( o.len != COBSgetFrameExtent( o.d, o.len ) - o.d + 1 )
         {
@@ -211,7 +224,7 @@ int main( int argc, void **argv )
             ipPacket[i] = random() % 256;
         }
 
-        COBSEncode( NULL, 0, ipPacket, TEST_PACKET_LEN, &opFrame );
+        COBSEncode( NULL, 0, NULL, 0, ipPacket, TEST_PACKET_LEN, &opFrame );
 
         if ( COBSSimpleDecode( opFrame.d, opFrame.len, &d->f ) )
         {
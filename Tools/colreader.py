@@ -0,0 +1,71 @@
+#!/usr/bin/python3
+# Reader for orbstat columnar statistics files (-c output). The file is mapped rather than
+# parsed, so individual metrics can be pulled out of multi-gigabyte captures directly.
+#
+# Layout: 8 byte magic, then raw little-endian u64 column chunks, then a footer directory
+# of (metric u32, sequence u32, count u32, pad u32, offset u64) entries, a u32 entry count
+# and 8 bytes of trailing magic. Only sealed files (ones with a footer) are readable; the
+# chunks themselves carry no framing.
+
+import mmap
+import struct
+import sys
+
+MAGIC = b"ORBCOL1\0"
+FOOTER_MAGIC = b"ORBCOLFT"
+
+METRICS = [
+    "walltime_us",
+    "addr",
+    "count",
+    "scount",
+    "exc_num",
+    "exc_entries",
+    "exc_samples",
+    "exc_ticks",
+]
+
+
+def load(filename):
+    """Map the file and return {sequence: {metric: memoryview-of-u64}}."""
+    f = open(filename, "rb")
+    m = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+    if m[:8] != MAGIC:
+        raise ValueError("not a columnar statistics file")
+
+    if m[-8:] != FOOTER_MAGIC:
+        raise ValueError("file is not sealed (no footer)")
+
+    (numchunks,) = struct.unpack_from("<I", m, len(m) - 12)
+    dirstart = len(m) - 12 - numchunks * 24
+
+    checkpoints = {}
+    for n in range(numchunks):
+        metric, sequence, count, _, offset = struct.unpack_from("<IIIIQ", m, dirstart + n * 24)
+        name = METRICS[metric] if metric < len(METRICS) else "metric%d" % metric
+        col = memoryview(m)[offset:offset + count * 8].cast("Q")
+        checkpoints.setdefault(sequence, {})[name] = col
+
+    return checkpoints
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("Usage: colreader.py <file>")
+        sys.exit(1)
+
+    checkpoints = load(sys.argv[1])
+    print("%d checkpoints" % len(checkpoints))
+
+    for sequence in sorted(checkpoints):
+        cols = checkpoints[sequence]
+        summary = " ".join("%s[%d]" % (name, len(col)) for name, col in cols.items())
+        print("checkpoint %d: %s" % (sequence, summary))
+
+    # Show the hottest addresses from the final checkpoint as a worked example
+    last = checkpoints[max(checkpoints)]
+    if "addr" in last and "count" in last:
+        hot = sorted(zip(last["addr"], last["count"]), key=lambda x: -x[1])[:10]
+        for addr, count in hot:
+            print("0x%08x %d" % (addr, count))